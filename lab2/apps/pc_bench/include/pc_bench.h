@@ -0,0 +1,38 @@
+#ifndef __PC_BENCH__
+#define __PC_BENCH__
+
+#define FILENAME_TO_RUN "pc_worker.dlx.obj"
+
+// How the producers and consumers wait for room and for items
+#define BENCH_LOCK 0    // poll under the lock, as q2 does
+#define BENCH_SEM  1    // semaphores count items and free slots
+#define BENCH_COND 2    // condition variables, as q4 does
+
+#define BENCH_PRODUCER 0
+#define BENCH_CONSUMER 1
+
+#define BENCH_MAX_BUFFER 1024
+#define BENCH_MAX_WORKERS 16  // Leaves room under PROCESS_MAX_PROCS
+
+// The shared page.  makeprocs fills it in and starts the workers,
+// which wait on start until it has read the statistics.
+typedef struct pc_shared {
+  int mode;
+  int size;                     // Buffer slots
+  int cs_len;                   // Busy loop iterations inside the lock
+  int per_producer;
+  int per_consumer;
+  lock_t lock;
+  sem_t items;                  // BENCH_SEM: items in the buffer
+  sem_t slots;                  //   and free slots
+  cond_t not_full;              // BENCH_COND
+  cond_t not_empty;
+  sem_t start;                  // Signalled once per worker to start
+  sem_t done;                   // Signalled by each worker at the end
+  int head;
+  int tail;
+  int count;                    // Items in the buffer
+  char buffer[BENCH_MAX_BUFFER];
+} pc_shared;
+
+#endif
@@ -0,0 +1,133 @@
+#include "lab2-api.h"
+#include "usertraps.h"
+#include "misc.h"
+
+#include "pc_bench.h"
+
+static pc_shared *sh;           // The page shared with the workers
+static char sh_handle_str[10];  // Its handle, as the workers' argument
+static char *mode_names[] = { "lock", "sem", "cond" };
+
+//--------------------------------------------------------------------
+// run starts the producers and consumers in mode, lets them go once
+// they've all been created, and waits for them.  lab2 has no clock,
+// so the time is the instruction counter, as sync_stats reads it.
+//--------------------------------------------------------------------
+static void run(int mode, int producers, int consumers, int items)
+{
+  sync_stats_t before, after;
+  char role_str[10];
+  uint32 instrs;
+  int i, n = producers + consumers;
+
+  sh->mode = mode;
+  sh->per_producer = items / producers;
+  sh->per_consumer = items / consumers;
+  sh->head = sh->tail = sh->count = 0;
+  for(i=0; i<n; i++) {
+    ditoa((i < producers) ? BENCH_PRODUCER : BENCH_CONSUMER, role_str);
+    process_create(FILENAME_TO_RUN, role_str, sh_handle_str, NULL);
+  }
+
+  sync_stats(&before);
+  for(i=0; i<n; i++) {
+    sem_signal(sh->start);
+  }
+  for(i=0; i<n; i++) {
+    if (sem_wait(sh->done) != SYNC_SUCCESS) {
+      Printf("Bad semaphore done (%d) in makeprocs, exiting...\n", sh->done);
+      Exit();
+    }
+  }
+  sync_stats(&after);
+
+  // Take out the sem_waits on start and done, two per worker
+  instrs = after.instrs - before.instrs;
+  Printf("%s: %d items, %d instructions each, %d items per million instructions\n",
+         mode_names[mode], items, instrs / items,
+         (int)((double)items * 1000000.0 / (double)instrs));
+  Printf("  per 100 items: %d lock_acquire, %d slept on the lock, %d switches\n",
+         (after.lockAcquires - before.lockAcquires) * 100 / items,
+         (after.lockSleeps - before.lockSleeps) * 100 / items,
+         (after.switches - before.switches) * 100 / items);
+  Printf("  per item: %d sem_wait, %d cond_wait, %d instructions asleep\n",
+         (after.semWaits - before.semWaits - 2 * n) / items,
+         (after.condWaits - before.condWaits) / items,
+         (after.waitInstrs - before.waitInstrs) / items);
+}
+
+void main (int argc, char *argv[])
+{
+  uint32 h_mem;                   // Handle to the shared page
+  int producers = 1, consumers = 1;
+  int items = 200;                // Items through the buffer per run
+  int mode, first, last;
+
+  if ((argc < 2) || (argc > 7)) {
+    Printf("Usage: "); Printf(argv[0]);
+    Printf(" <lock|sem|cond|all> [producers] [consumers] [buffer size] [critical section] [items]\n");
+    Exit();
+  }
+  first = BENCH_LOCK;
+  last = BENCH_COND;
+  for(mode=BENCH_LOCK; mode<=BENCH_COND; mode++) {
+    if (dstrncmp(argv[1], mode_names[mode], dstrlen(mode_names[mode]) + 1) == 0) {
+      first = last = mode;
+    }
+  }
+  if ((first != last) && (dstrncmp(argv[1], "all", 4) != 0)) {
+    Printf("Unknown mode "); Printf(argv[1]); Printf(", exiting...\n");
+    Exit();
+  }
+
+  if ((h_mem = shmget()) == 0) {
+    Printf("ERROR: could not allocate shared memory page in "); Printf(argv[0]); Printf(", exiting...\n");
+    Exit();
+  }
+  if ((sh = (pc_shared *)shmat(h_mem)) == NULL) {
+    Printf("Could not map the shared page to virtual address in "); Printf(argv[0]); Printf(", exiting..\n");
+    Exit();
+  }
+  ditoa(h_mem, sh_handle_str);
+
+  sh->size = BUFFERSIZE;
+  sh->cs_len = 0;
+  if (argc > 2) producers = dstrtol(argv[2], NULL, 10);
+  if (argc > 3) consumers = dstrtol(argv[3], NULL, 10);
+  if (argc > 4) sh->size = dstrtol(argv[4], NULL, 10);
+  if (argc > 5) sh->cs_len = dstrtol(argv[5], NULL, 10);
+  if (argc > 6) items = dstrtol(argv[6], NULL, 10);
+  if ((producers < 1) || (consumers < 1) || (producers + consumers > BENCH_MAX_WORKERS) ||
+      (sh->size < 1) || (sh->size > BENCH_MAX_BUFFER) || (sh->cs_len < 0)) {
+    Printf("Need 1 to %d workers and 1 to %d buffer slots, exiting...\n",
+           BENCH_MAX_WORKERS, BENCH_MAX_BUFFER);
+    Exit();
+  }
+  // Every producer and consumer moves the same number of items
+  items = (items / (producers * consumers)) * producers * consumers;
+  if (items <= 0) items = producers * consumers;
+
+  // The items and slots semaphores come back to where they started
+  // after each run, since as many items are taken as are put, so one
+  // set does for every run
+  if (((sh->lock = lock_create()) == SYNC_FAIL) ||
+      ((sh->not_full = cond_create(sh->lock)) == SYNC_FAIL) ||
+      ((sh->not_empty = cond_create(sh->lock)) == SYNC_FAIL)) {
+    Printf("Bad lock_create or cond_create in "); Printf(argv[0]); Printf("\n");
+    Exit();
+  }
+  if (((sh->items = sem_create(0)) == SYNC_FAIL) ||
+      ((sh->slots = sem_create(sh->size)) == SYNC_FAIL) ||
+      ((sh->start = sem_create(0)) == SYNC_FAIL) ||
+      ((sh->done = sem_create(0)) == SYNC_FAIL)) {
+    Printf("Bad sem_create in "); Printf(argv[0]); Printf("\n");
+    Exit();
+  }
+
+  Printf("%d producers, %d consumers, %d slots, critical section %d\n",
+         producers, consumers, sh->size, sh->cs_len);
+  for(mode=first; mode<=last; mode++) {
+    run(mode, producers, consumers, items);
+  }
+  Printf("makeprocs (%d): Done!\n", getpid());
+}
@@ -0,0 +1,133 @@
+#include "lab2-api.h"
+#include "usertraps.h"
+#include "misc.h"
+
+#include "pc_bench.h"
+
+static pc_shared *sh;
+
+// The work done while holding the lock
+static void critical_section()
+{
+  volatile int j;
+
+  for(j=0; j<sh->cs_len; j++);
+}
+
+// Put an item in or take one out; the caller holds the lock and has
+// checked there's room or an item
+static void put(char c)
+{
+  sh->buffer[sh->head] = c;
+  sh->head = (sh->head + 1) % sh->size;
+  sh->count++;
+  critical_section();
+}
+
+static char take()
+{
+  char c = sh->buffer[sh->tail];
+
+  sh->tail = (sh->tail + 1) % sh->size;
+  sh->count--;
+  critical_section();
+  return c;
+}
+
+static void produce(int n)
+{
+  int i = 0;
+
+  while (i < n) {
+    switch (sh->mode) {
+      case BENCH_LOCK:
+        lock_acquire(sh->lock);
+        if (sh->count < sh->size) {
+          put('a' + (i % 26));
+          i++;
+        }
+        lock_release(sh->lock);
+        break;
+      case BENCH_SEM:
+        sem_wait(sh->slots);
+        lock_acquire(sh->lock);
+        put('a' + (i % 26));
+        lock_release(sh->lock);
+        sem_signal(sh->items);
+        i++;
+        break;
+      case BENCH_COND:
+        lock_acquire(sh->lock);
+        while (sh->count == sh->size) {
+          cond_wait(sh->not_full);
+        }
+        put('a' + (i % 26));
+        cond_signal(sh->not_empty);
+        lock_release(sh->lock);
+        i++;
+        break;
+    }
+  }
+}
+
+static void consume(int n)
+{
+  int i = 0;
+
+  while (i < n) {
+    switch (sh->mode) {
+      case BENCH_LOCK:
+        lock_acquire(sh->lock);
+        if (sh->count > 0) {
+          take();
+          i++;
+        }
+        lock_release(sh->lock);
+        break;
+      case BENCH_SEM:
+        sem_wait(sh->items);
+        lock_acquire(sh->lock);
+        take();
+        lock_release(sh->lock);
+        sem_signal(sh->slots);
+        i++;
+        break;
+      case BENCH_COND:
+        lock_acquire(sh->lock);
+        while (sh->count == 0) {
+          cond_wait(sh->not_empty);
+        }
+        take();
+        cond_signal(sh->not_full);
+        lock_release(sh->lock);
+        i++;
+        break;
+    }
+  }
+}
+
+void main (int argc, char *argv[])
+{
+  int role;
+
+  if (argc != 3) {
+    Printf("Usage: "); Printf(argv[0]); Printf(" <role> <handle_to_shared_memory_page>\n");
+    Exit();
+  }
+  role = dstrtol(argv[1], NULL, 10);
+  if ((sh = (pc_shared *)shmat(dstrtol(argv[2], NULL, 10))) == NULL) {
+    Printf("Could not map the shared page in "); Printf(argv[0]); Printf(", exiting...\n");
+    Exit();
+  }
+
+  sem_wait(sh->start);
+  if (role == BENCH_PRODUCER) {
+    produce(sh->per_producer);
+  } else {
+    consume(sh->per_consumer);
+  }
+  if (sem_signal(sh->done) != SYNC_SUCCESS) {
+    Printf("Bad semaphore done (%d) in ", sh->done); Printf(argv[0]); Printf(", exiting...\n");
+    Exit();
+  }
+}
@@ -49,5 +49,19 @@ int cond_wait(cond_t cond);		//trap 0x456 Calls CondHandleWait()
 int cond_signal(cond_t cond);		//trap 0x457 Calls CondHandleSignal()
 int cond_broadcast(cond_t cond);	//trap 0x458 Calls CondHandleBroadcast()
 
+// Counts kept by the kernel since it started (must match SyncStats in
+// synch.h).  Take two and subtract.
+typedef struct sync_stats_t {
+  int lockAcquires;	// lock_acquire traps
+  int lockSleeps;	//   that found the lock held and slept
+  int semWaits;
+  int semSleeps;
+  int condWaits;
+  int switches;		// Times the scheduler ran a different process
+  uint32 waitInstrs;	// Instructions processes spent asleep, in all
+  uint32 instrs;	// The instruction counter, as it was read
+} sync_stats_t;
+int sync_stats(sync_stats_t *stats);	//trap 0x45a Calls SyncGetStats()
+
 #endif _LAB2_API_H_
 
@@ -37,6 +37,7 @@ extern char  debugstr[];
 extern int  CurrentIntrs ();
 extern int  SetIntrs (int);
 extern void  KbdModuleInit ();
+extern uint32  PerfCounterRead (int ctr);
 extern void  intrreturn ();
 
 inline int
@@ -41,6 +41,7 @@ typedef struct PCB {
   uint32	pagetable[16];	// Statically allocated page table
   int		npages;		// Number of pages allocated to this process
   Link		*l;		// Used for keeping PCB in queues
+  uint32	waitStart;	// Instruction count when it last went to sleep
 } PCB;
 
 // Offsets of various registers from the stack pointer in the register
@@ -55,6 +55,21 @@ int LockInit(Lock *);
 int LockAcquire(Lock *);
 int LockRelease(Lock *);
 
+// What sync_stats() reports.  Must match sync_stats_t in lab2-api.h.
+typedef struct SyncStats {
+  int lockAcquires;	// lock_acquire traps
+  int lockSleeps;	//   that found the lock held and slept
+  int semWaits;
+  int semSleeps;
+  int condWaits;
+  int switches;		// Times the scheduler ran a different process
+  uint32 waitInstrs;	// Instructions processes spent asleep, in all
+  uint32 instrs;	// The instruction counter, as it was read
+} SyncStats;
+
+extern SyncStats syncStats;	// process.c counts switches and waits
+void SyncGetStats(SyncStats *stats);
+
 typedef struct Cond {
   // Your code goes here
   Queue waiting;
@@ -63,6 +63,7 @@
 #define TRAP_COND_WAIT		0x457
 #define TRAP_COND_SIGNAL	0x458
 #define TRAP_COND_BROADCAST	0x459
+#define TRAP_SYNC_STATS		0x45a
 
 #define TRAP_USER_EXIT          0x500
 
@@ -74,6 +75,11 @@
 #define	DLX_KBD_NCHARSIN	0xfff001a0
 #define	DLX_KBD_INTR		0xfff001c0
 
+// Performance counters: counter n is a 64-bit value at
+// DLX_PERF_BASE + 8*n (low word first).
+#define	DLX_PERF_BASE		0xffff1000
+#define	DLX_PERF_INSTRS		0	// instructions retired
+
 #define	TRAP_STACK_SIZE		0x800	// interrupt stack is 2K words
 
 #endif	/* _dlxtraps_h_ */
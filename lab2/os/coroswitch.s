@@ -0,0 +1,136 @@
+;;;
+;;; Context switch for the user level coroutine library (coroutine.c).
+;;; This is part of the user library, not the operating system.
+;;;
+;;; coro_switch saves the caller's registers on its own stack, stores
+;;; the stack pointer, loads the other coroutine's and pops its
+;;; registers: a plain call and return, with no trap.  The frame is
+;;; r2-r28, r30, r31 and the double registers f0-f30:
+;;;
+;;;	0 .. 104	r2 .. r28
+;;;	108		r30
+;;;	112		r31
+;;;	120 .. 240	f0, f2 .. f30
+;;;
+;;; coroutine.c builds the first frame of a new coroutine by hand, with
+;;; r31 pointing at _coro_entry.
+;;;
+
+	.text
+	.align 2
+
+;;;----------------------------------------------------------------------
+;;; void coro_switch(unsigned int *savesp, unsigned int newsp);
+;;;----------------------------------------------------------------------
+.proc _coro_switch
+.global _coro_switch
+_coro_switch:
+	subui	r29,r29,#248
+	sw	0(r29),r2
+	sw	4(r29),r3
+	sw	8(r29),r4
+	sw	12(r29),r5
+	sw	16(r29),r6
+	sw	20(r29),r7
+	sw	24(r29),r8
+	sw	28(r29),r9
+	sw	32(r29),r10
+	sw	36(r29),r11
+	sw	40(r29),r12
+	sw	44(r29),r13
+	sw	48(r29),r14
+	sw	52(r29),r15
+	sw	56(r29),r16
+	sw	60(r29),r17
+	sw	64(r29),r18
+	sw	68(r29),r19
+	sw	72(r29),r20
+	sw	76(r29),r21
+	sw	80(r29),r22
+	sw	84(r29),r23
+	sw	88(r29),r24
+	sw	92(r29),r25
+	sw	96(r29),r26
+	sw	100(r29),r27
+	sw	104(r29),r28
+	sw	108(r29),r30
+	sw	112(r29),r31
+	sd	120(r29),f0
+	sd	128(r29),f2
+	sd	136(r29),f4
+	sd	144(r29),f6
+	sd	152(r29),f8
+	sd	160(r29),f10
+	sd	168(r29),f12
+	sd	176(r29),f14
+	sd	184(r29),f16
+	sd	192(r29),f18
+	sd	200(r29),f20
+	sd	208(r29),f22
+	sd	216(r29),f24
+	sd	224(r29),f26
+	sd	232(r29),f28
+	sd	240(r29),f30
+	lw	r1,248(r29)	; savesp
+	lw	r2,252(r29)	; newsp
+	sw	0(r1),r29
+	ori	r29,r2,0
+	lw	r2,0(r29)
+	lw	r3,4(r29)
+	lw	r4,8(r29)
+	lw	r5,12(r29)
+	lw	r6,16(r29)
+	lw	r7,20(r29)
+	lw	r8,24(r29)
+	lw	r9,28(r29)
+	lw	r10,32(r29)
+	lw	r11,36(r29)
+	lw	r12,40(r29)
+	lw	r13,44(r29)
+	lw	r14,48(r29)
+	lw	r15,52(r29)
+	lw	r16,56(r29)
+	lw	r17,60(r29)
+	lw	r18,64(r29)
+	lw	r19,68(r29)
+	lw	r20,72(r29)
+	lw	r21,76(r29)
+	lw	r22,80(r29)
+	lw	r23,84(r29)
+	lw	r24,88(r29)
+	lw	r25,92(r29)
+	lw	r26,96(r29)
+	lw	r27,100(r29)
+	lw	r28,104(r29)
+	lw	r30,108(r29)
+	lw	r31,112(r29)
+	ld	f0,120(r29)
+	ld	f2,128(r29)
+	ld	f4,136(r29)
+	ld	f6,144(r29)
+	ld	f8,152(r29)
+	ld	f10,160(r29)
+	ld	f12,168(r29)
+	ld	f14,176(r29)
+	ld	f16,184(r29)
+	ld	f18,192(r29)
+	ld	f20,200(r29)
+	ld	f22,208(r29)
+	ld	f24,216(r29)
+	ld	f26,224(r29)
+	ld	f28,232(r29)
+	ld	f30,240(r29)
+	addui	r29,r29,#248
+	jr	r31
+	nop
+.endproc _coro_switch
+
+;;;----------------------------------------------------------------------
+;;; First code a new coroutine runs: coro_main never returns.
+;;;----------------------------------------------------------------------
+.proc _coro_entry
+.global _coro_entry
+_coro_entry:
+	jal	_coro_main
+	nop
+.endproc _coro_entry
@@ -15,6 +15,7 @@
 #include "memory.h"
 #include "filesys.h"
 #include "share_memory.h"
+#include "traps.h"
 
 // Pointer to the current PCB.  This is used by the assembly language
 // routines for context switches.
@@ -216,6 +217,9 @@ void ProcessSchedule () {
 
   // Now, run the one at the head of the queue.
   pcb = (PCB *)AQueueObject(AQueueFirst(&runQueue));
+  if (pcb != currentPCB) {
+    syncStats.switches++;
+  }
   currentPCB = pcb;
   dbprintf ('p',"About to switch to PCB 0x%x,flags=0x%x @ 0x%x\n",
 	    (int)pcb, pcb->flags, (int)(pcb->sysStackPtr[PROCESS_STACK_IAR]));
@@ -252,6 +256,7 @@ void ProcessSuspend (PCB *suspend) {
   dbprintf ('p', "Suspending PCB 0x%x (%s).\n", (int)suspend, suspend->name);
   ASSERT (suspend->flags & PROCESS_STATUS_RUNNABLE, "Trying to suspend a non-running process!\n");
   ProcessSetStatus (suspend, PROCESS_STATUS_WAITING);
+  suspend->waitStart = PerfCounterRead(DLX_PERF_INSTRS);
   if (AQueueRemove(&(suspend->l)) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove process from run Queue in ProcessSuspend!\n");
     exitsim();
@@ -284,6 +289,7 @@ void ProcessWakeup (PCB *wakeup) {
   // Make sure it's not yet a runnable process.
   ASSERT (wakeup->flags & PROCESS_STATUS_WAITING, "Trying to wake up a non-sleeping process!\n");
   ProcessSetStatus (wakeup, PROCESS_STATUS_RUNNABLE);
+  syncStats.waitInstrs += PerfCounterRead(DLX_PERF_INSTRS) - wakeup->waitStart;
   if (AQueueRemove(&(wakeup->l)) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove wakeup PCB from waitQueue in ProcessWakeup!\n");
     exitsim();
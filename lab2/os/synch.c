@@ -10,10 +10,12 @@
 #include "process.h"
 #include "synch.h"
 #include "queue.h"
+#include "traps.h"
 
 static Sem sems[MAX_SEMS];      // All semaphores in the system
 static Lock locks[MAX_LOCKS];   // All locks in the system
 static Cond conds[MAX_CONDS];   //All conditional variables in the system
+SyncStats syncStats;            // For sync_stats()
 
 extern struct PCB *currentPCB; 
 //----------------------------------------------------------------------
@@ -102,7 +104,9 @@ int SemWait (Sem *sem) {
   intrval = DisableIntrs ();
   dbprintf ('I', "SemWait: Old interrupt value was 0x%x.\n", intrval);
   dbprintf ('s', "SemWait: Proc %d waiting on sem %d, count=%d.\n", GetCurrentPid(), (int)(sem-sems), sem->count);
+  syncStats.semWaits++;
   if (sem->count <= 0) {
+    syncStats.semSleeps++;
     dbprintf('s', "SemWait: putting process %d to sleep\n", GetCurrentPid());
     if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
       printf("FATAL ERROR: could not allocate link for semaphore queue in SemWait!\n");
@@ -239,6 +243,7 @@ int LockAcquire(Lock *k) {
 
   dbprintf ('s', "LockAcquire: Proc %d asking for lock %d.\n", GetCurrentPid(), (int)(k-locks));
   if (k->pid >= 0) { // Lock is already in use by another process
+    syncStats.lockSleeps++;
     dbprintf('s', "LockAcquire: putting process %d to sleep\n", GetCurrentPid());
     if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
       printf("FATAL ERROR: could not allocate link for lock queue in LockAcquire!\n");
@@ -399,6 +404,7 @@ int CondWait (Cond *cond) {
   dbprintf ('I', "CondWait: Old interrupt value was 0x%x.\n", intrval);
   dbprintf ('s', "CondWait: Proc %d waiting on cond %d\n", GetCurrentPid(), (int)(cond-conds));
   dbprintf ('s', "CondWait: putting process %d to sleep\n", GetCurrentPid());
+  syncStats.condWaits++;
 
   if ((l = AQueueAllocLink((void *)currentPCB)) == NULL) {
     printf("FATAL ERROR: could not allocate link for cond queue in CondWait!\n");
@@ -514,3 +520,17 @@ int CondBroadcast(Cond *cond) {
   RestoreIntrs(intrs);
   return SYNC_SUCCESS;
 }
+
+//---------------------------------------------------------------------------
+//	SyncGetStats
+//
+//	Copy out the counts kept for sync_stats(), with the instruction
+//	counter as it is now so that callers can take differences.
+//---------------------------------------------------------------------------
+void SyncGetStats(SyncStats *stats) {
+  int intrs = DisableIntrs();
+
+  syncStats.instrs = PerfCounterRead(DLX_PERF_INSTRS);
+  bcopy((char *)&syncStats, (char *)stats, sizeof(syncStats));
+  RestoreIntrs(intrs);
+}
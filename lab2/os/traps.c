@@ -43,6 +43,19 @@ KbdModuleInit ()
   *((uint32 *)DLX_KBD_INTR) = 1;
 }
 
+//----------------------------------------------------------------------
+//
+//	PerfCounterRead
+//
+//	Read the low word of a simulator performance counter.
+//
+//----------------------------------------------------------------------
+uint32
+PerfCounterRead (int ctr)
+{
+  return (*((uint32 *)(DLX_PERF_BASE + 8 * ctr)));
+}
+
 //--------------------------------------------------------------------
 // GetUintFromTrapArg(uint32 *trapArgs, int sysmode)
 //--------------------------------------------------------------------
@@ -145,6 +158,24 @@ static void TrapProcessCreateHandler(uint32 *trapArgs, int sysmode)
   ProcessFork(0, (uint32)allargs, name, 1);
 }
 
+//--------------------------------------------------------------------
+// Copy the synchronization statistics to the sync_stats_t the trap's
+// argument points to.  Returns SYNC_SUCCESS.
+//--------------------------------------------------------------------
+static int TrapSyncStatsHandler(uint32 *trapArgs, int sysmode)
+{
+  SyncStats stats;
+  char *userstats = (char *)GetUintFromTrapArg(trapArgs, sysmode);
+
+  SyncGetStats(&stats);
+  if (sysmode) {
+    bcopy((char *)&stats, userstats, sizeof(stats));
+  } else {
+    MemoryCopySystemToUser(currentPCB, (char *)&stats, userstats, sizeof(stats));
+  }
+  return SYNC_SUCCESS;
+}
+
 
 //----------------------------------------------------------------------
 //
@@ -357,6 +388,7 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       ProcessSetResult(currentPCB, ihandle); //Return handle
       break;
     case TRAP_LOCK_ACQUIRE:
+      syncStats.lockAcquires++;
       ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
       handle = LockHandleAcquire(ihandle);
       ProcessSetResult(currentPCB, handle); //Return SYNC_SUCCESS or SYNC_FAIL
@@ -386,6 +418,9 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       ihandle = CondHandleBroadcast(ihandle);
       ProcessSetResult(currentPCB, ihandle); //Return SYNC_SUCCESS or SYNC_FAIL
       break;
+    case TRAP_SYNC_STATS:
+      ProcessSetResult(currentPCB, TrapSyncStatsHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
     default:
       printf ("Got an unrecognized trap (0x%x) - exiting!\n",
 	      cause);
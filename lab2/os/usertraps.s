@@ -186,6 +186,14 @@ _cond_broadcast:
 	nop
 .endproc _cond_broadcast
 
+.proc _sync_stats
+.global _sync_stats
+_sync_stats:
+	trap	#0x45a
+	jr	r31
+	nop
+.endproc _sync_stats
+
 .proc _Exit
 .global _Exit
 _Exit:
@@ -0,0 +1,35 @@
+#ifndef __MBOX_BENCH__
+#define __MBOX_BENCH__
+
+#define FILENAME_TO_RUN "mbox_worker.dlx.obj"
+
+// What a worker does: its first argument
+#define BENCH_PRODUCER 0  // send per_producer messages of size bytes to data
+#define BENCH_CONSUMER 1  // receive per_consumer messages from data
+#define BENCH_CLIENT   2  // send to data and wait for the reply on reply, n times
+#define BENCH_ECHO     3  // receive from data and send it back on reply, n times
+
+#define BENCH_MAX_MESSAGE 100 // MBOX_MAX_MESSAGE_LENGTH in the kernel
+
+// The shared page.  makeprocs fills it in before it starts the
+// workers, which pass the barrier together; worker 0 reads the clock
+// as they start and each one reads it again as it's done, so end is
+// the last to finish.
+typedef struct bench_shared {
+  barrier_t start_barrier;
+  sem_t done;                   // Signalled by each worker at the end
+  sem_t credits;                // If not SYNC_FAIL, messages allowed in flight
+  mbox_t data;                  // Producers and the client send here
+  mbox_t reply;                 // The echo sends back here
+  int size;                     // Message bytes
+  int per_producer;
+  int per_consumer;
+  clock_sample_t start;
+  clock_sample_t end;
+} bench_shared;
+
+#ifndef NULL
+#define NULL (void *)0x0
+#endif
+
+#endif
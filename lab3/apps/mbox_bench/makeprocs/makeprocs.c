@@ -0,0 +1,157 @@
+#include "usertraps.h"
+#include "misc.h"
+
+#include "mbox_bench.h"
+
+static bench_shared *sh;        // The page shared with the workers
+static char sh_handle_str[10];  // Its handle, as the workers' argument
+
+//--------------------------------------------------------------------
+// report prints the rate and cost of msgs messages (or round trips)
+// over the last run.  The time moves a jiffy at a time, so it's only
+// as good as the number of messages is large, but the instruction
+// count is exact.
+//--------------------------------------------------------------------
+static void report(char *what, int msgs)
+{
+  int usec = sh->end.usec - sh->start.usec;
+  unsigned int instrs = sh->end.instrs - sh->start.instrs;
+  mbox_stats_t stats;
+
+  Printf("  %s: %d per second, %d us and %d instructions each", what,
+         (usec > 0) ? (int)((double)msgs * 1000000.0 / (double)usec) : 0,
+         usec / msgs, instrs / msgs);
+  if (mbox_stats(sh->data, &stats) == MBOX_SUCCESS) {
+    Printf(", peak depth %d", stats.peakDepth);
+  }
+  Printf("\n");
+}
+
+//--------------------------------------------------------------------
+// run starts producers workers in role and consumers in role2 (the
+// producers first, so a producer or the client is worker 0), with
+// fresh mailboxes, and waits for them to finish.
+//--------------------------------------------------------------------
+static void run(int role, int producers, int role2, int consumers)
+{
+  char role_str[10], index_str[10];
+  int i;
+
+  if (((sh->data = mbox_create()) == MBOX_FAIL) || (mbox_open(sh->data) == MBOX_FAIL) ||
+      ((sh->reply = mbox_create()) == MBOX_FAIL) || (mbox_open(sh->reply) == MBOX_FAIL)) {
+    Printf("makeprocs (%d): Could not make the mailboxes!\n", getpid());
+    Exit();
+  }
+  if ((sh->start_barrier = barrier_create(producers + consumers)) == SYNC_FAIL) {
+    Printf("makeprocs (%d): Bad barrier_create\n", getpid());
+    Exit();
+  }
+  for(i=0; i<producers+consumers; i++) {
+    ditoa((i < producers) ? role : role2, role_str);
+    ditoa(i, index_str);
+    process_create(FILENAME_TO_RUN, 0, 0, role_str, index_str, sh_handle_str, NULL);
+  }
+  if (sem_wait_n(sh->done, producers + consumers) != SYNC_SUCCESS) {
+    Printf("makeprocs (%d): Bad semaphore %d\n", getpid(), sh->done);
+    Exit();
+  }
+  barrier_destroy(sh->start_barrier);
+}
+
+static void done()
+{
+  mbox_close(sh->data);
+  mbox_close(sh->reply);
+}
+
+// n messages from p producers to c consumers, as long as size bytes
+static void stream(int n, int p, int c, int size)
+{
+  sh->size = size;
+  sh->per_producer = n / p;
+  sh->per_consumer = n / c;
+  run(BENCH_PRODUCER, p, BENCH_CONSUMER, c);
+}
+
+void main (int argc, char *argv[])
+{
+  static int sizes[] = { 1, 4, 16, 64, BENCH_MAX_MESSAGE };
+  static int depths[] = { 1, 2, 4, 8 };
+  static int ratios[][2] = { {1, 1}, {1, 4}, {4, 1}, {4, 4} };
+  unsigned int h_mem;             // Handle to the shared page
+  int n = 400;                    // Messages per measurement
+  char what[40];
+  int i;
+
+  if (argc > 2) {
+    Printf("Usage: %s [messages per measurement]\n", argv[0]);
+    Exit();
+  }
+  if (argc == 2) {
+    n = dstrtol(argv[1], NULL, 10);
+  }
+  n = (n / 4) * 4;                // Shared out evenly among 4
+  if (n <= 0) n = 4;
+
+  if ((h_mem = shmget()) == 0) {
+    Printf("makeprocs (%d): ERROR: could not allocate shared memory page!\n", getpid());
+    Exit();
+  }
+  if ((sh = (bench_shared *)shmat(h_mem)) == NULL) {
+    Printf("makeprocs (%d): Could not map the shared page!\n", getpid());
+    Exit();
+  }
+  ditoa(h_mem, sh_handle_str);
+  if ((sh->done = sem_create(0)) == SYNC_FAIL) {
+    Printf("makeprocs (%d): Bad sem_create\n", getpid());
+    Exit();
+  }
+  sh->credits = SYNC_FAIL;
+
+  Printf("Throughput by message size (1 producer, 1 consumer, %d messages):\n", n);
+  for(i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+    stream(n, 1, 1, sizes[i]);
+    dstrcpy(what, "bytes ");
+    ditoa(sizes[i], what + 6);
+    report(what, n);
+    done();
+  }
+
+  Printf("Throughput by messages in flight (%d-byte messages):\n", BENCH_MAX_MESSAGE);
+  for(i=0; i<sizeof(depths)/sizeof(depths[0]); i++) {
+    if ((sh->credits = sem_create(depths[i])) == SYNC_FAIL) {
+      Printf("makeprocs (%d): Bad sem_create\n", getpid());
+      Exit();
+    }
+    stream(n, 1, 1, BENCH_MAX_MESSAGE);
+    dstrcpy(what, "depth ");
+    ditoa(depths[i], what + 6);
+    report(what, n);
+    done();
+    sem_destroy(sh->credits);
+    sh->credits = SYNC_FAIL;
+  }
+
+  Printf("Throughput by producers:consumers (%d-byte messages):\n", BENCH_MAX_MESSAGE);
+  for(i=0; i<sizeof(ratios)/sizeof(ratios[0]); i++) {
+    stream(n, ratios[i][0], ratios[i][1], BENCH_MAX_MESSAGE);
+    ditoa(ratios[i][0], what);
+    dstrcpy(what + dstrlen(what), ":");
+    ditoa(ratios[i][1], what + dstrlen(what));
+    report(what, n);
+    done();
+  }
+
+  Printf("Ping-pong round trips (%d of them):\n", n);
+  for(i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+    sh->size = sizes[i];
+    sh->per_producer = sh->per_consumer = n;
+    run(BENCH_CLIENT, 1, BENCH_ECHO, 1);
+    dstrcpy(what, "bytes ");
+    ditoa(sizes[i], what + 6);
+    report(what, n);
+    done();
+  }
+
+  Printf("makeprocs (%d): Done!\n", getpid());
+}
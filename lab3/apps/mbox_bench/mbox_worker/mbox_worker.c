@@ -0,0 +1,73 @@
+#include "usertraps.h"
+#include "misc.h"
+
+#include "mbox_bench.h"
+
+void main (int argc, char *argv[])
+{
+  int role, index;              // What to do, and which worker this is
+  bench_shared *sh;             // The shared page, set up by makeprocs
+  char buf[BENCH_MAX_MESSAGE];  // The message
+  int i, n;
+
+  if (argc != 4) {
+    Printf("Usage: %s <role> <worker index> <shared memory handle>\n", argv[0]);
+    Exit();
+  }
+  role = dstrtol(argv[1], NULL, 10);
+  index = dstrtol(argv[2], NULL, 10);
+  if ((sh = (bench_shared *)shmat(dstrtol(argv[3], NULL, 10))) == NULL) {
+    Printf("mbox_worker (%d): Could not map the shared page!\n", getpid());
+    Exit();
+  }
+  if ((mbox_open(sh->data) == MBOX_FAIL) || (mbox_open(sh->reply) == MBOX_FAIL)) {
+    Printf("mbox_worker (%d): Could not open the mailboxes!\n", getpid());
+    Exit();
+  }
+  for(i=0; i<sh->size; i++) {
+    buf[i] = 'a' + (i % 26);
+  }
+
+  // Start together, so the timing doesn't include process creation
+  if (barrier_wait(sh->start_barrier) != SYNC_SUCCESS) {
+    Printf("mbox_worker (%d): Bad barrier %d\n", getpid(), sh->start_barrier);
+    Exit();
+  }
+  if (index == 0) {
+    clock_read(&sh->start);
+  }
+
+  n = (role == BENCH_CONSUMER) ? sh->per_consumer : sh->per_producer;
+  for(i=0; i<n; i++) {
+    switch (role) {
+      case BENCH_PRODUCER:
+        if (sh->credits != SYNC_FAIL) {
+          sem_wait(sh->credits);
+        }
+        mbox_send(sh->data, sh->size, buf);
+        break;
+      case BENCH_CONSUMER:
+        mbox_recv(sh->data, BENCH_MAX_MESSAGE, buf);
+        if (sh->credits != SYNC_FAIL) {
+          sem_signal(sh->credits);
+        }
+        break;
+      case BENCH_CLIENT:
+        mbox_send(sh->data, sh->size, buf);
+        mbox_recv(sh->reply, BENCH_MAX_MESSAGE, buf);
+        break;
+      case BENCH_ECHO:
+        mbox_recv(sh->data, BENCH_MAX_MESSAGE, buf);
+        mbox_send(sh->reply, sh->size, buf);
+        break;
+    }
+  }
+
+  clock_read(&sh->end);
+  mbox_close(sh->data);
+  mbox_close(sh->reply);
+  if (sem_signal(sh->done) != SYNC_SUCCESS) {
+    Printf("mbox_worker (%d): Bad semaphore %d\n", getpid(), sh->done);
+    Exit();
+  }
+}
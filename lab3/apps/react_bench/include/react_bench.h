@@ -0,0 +1,36 @@
+#ifndef __REACT_BENCH__
+#define __REACT_BENCH__
+
+#define FILENAME_TO_RUN "reactor.dlx.obj"
+
+// What a worker does: its first argument.  Each takes its share of
+// the rounds; a round is one S2 and eight CO, which make two SO4:
+//   S2 -> S + S, 4 CO -> 2 O2 + 2 C2 (twice), S + 2 O2 -> SO4 (twice)
+// so five reactions, with nothing left over.
+#define BENCH_INJECT_S2 0   // send 1 S2 per round to s2
+#define BENCH_INJECT_CO 1   // send 8 CO per round to co
+#define BENCH_SPLIT_S2  2   // S2 from s2, 2 S to s, once per round
+#define BENCH_SPLIT_CO  3   // 4 CO from co, 2 O2 to o2, twice per round
+#define BENCH_MAKE_SO4  4   // S from s and 2 O2 from o2, SO4 to so4, twice per round
+#define BENCH_ROLES     5
+
+#define BENCH_REACTIONS_PER_ROUND 5
+#define BENCH_MAX_PER_ROLE 4  // 5 roles of 4 and makeprocs fit PROCESS_MAX_PROCS
+
+// The shared page.  makeprocs fills it in before it starts the
+// workers, which pass the barrier together; worker 0 reads the clock
+// as they start.  makeprocs takes the SO4 and reads it again once it
+// has the last one.
+typedef struct bench_shared {
+  barrier_t start_barrier;
+  sem_t done;                   // Signalled by each worker at the end
+  mbox_t s2, co, s, o2, so4;
+  int per_worker[BENCH_ROLES];  // Rounds for each worker in a role
+  clock_sample_t start;
+} bench_shared;
+
+#ifndef NULL
+#define NULL (void *)0x0
+#endif
+
+#endif
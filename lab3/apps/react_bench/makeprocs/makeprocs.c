@@ -0,0 +1,172 @@
+#include "usertraps.h"
+#include "misc.h"
+
+#include "react_bench.h"
+
+static bench_shared *sh;        // The page shared with the workers
+static char sh_handle_str[10];  // Its handle, as the workers' argument
+
+static mbox_t make_mbox()
+{
+  mbox_t mbox;
+
+  if (((mbox = mbox_create()) == MBOX_FAIL) || (mbox_open(mbox) == MBOX_FAIL)) {
+    Printf("makeprocs (%d): Could not make a mailbox!\n", getpid());
+    Exit();
+  }
+  return mbox;
+}
+
+// Jiffies that senders and receivers spent waiting on mbox, in all
+static int mbox_blocked(mbox_t mbox)
+{
+  mbox_stats_t stats;
+
+  if (mbox_stats(mbox, &stats) != MBOX_SUCCESS) {
+    return 0;
+  }
+  return stats.sendBlocked + stats.recvBlocked;
+}
+
+//--------------------------------------------------------------------
+// run starts injectors processes for each kind of molecule and
+// reactors for each reaction, on fresh mailboxes, has them work
+// through rounds rounds, and reports on it.  makeprocs takes the SO4
+// as they're made, and the time runs until it has the last one.
+//--------------------------------------------------------------------
+static void run(int injectors, int reactors, int rounds)
+{
+  static int roles[BENCH_ROLES] = {
+    BENCH_INJECT_S2, BENCH_INJECT_CO, BENCH_SPLIT_S2, BENCH_SPLIT_CO, BENCH_MAKE_SO4
+  };
+  char role_str[10], index_str[10], msg[4];
+  sched_stats_t before, after;
+  clock_sample_t end;
+  int i, j, k, n, nworkers, reactions, usec, blocked;
+  unsigned int instrs;
+
+  sh->s2 = make_mbox();
+  sh->co = make_mbox();
+  sh->s = make_mbox();
+  sh->o2 = make_mbox();
+  sh->so4 = make_mbox();
+  nworkers = 2 * injectors + 3 * reactors;
+  if ((sh->start_barrier = barrier_create(nworkers)) == SYNC_FAIL) {
+    Printf("makeprocs (%d): Bad barrier_create\n", getpid());
+    Exit();
+  }
+  sched_stats(-1, &before);
+  k = 0;
+  for(i=0; i<BENCH_ROLES; i++) {
+    n = (roles[i] <= BENCH_INJECT_CO) ? injectors : reactors;
+    sh->per_worker[roles[i]] = rounds / n;
+    ditoa(roles[i], role_str);
+    for(j=0; j<n; j++) {
+      ditoa(k++, index_str);
+      process_create(FILENAME_TO_RUN, 0, 0, role_str, index_str, sh_handle_str, NULL);
+    }
+  }
+
+  for(i=0; i<2*rounds; i++) {
+    if (mbox_recv(sh->so4, sizeof(msg), msg) != 3) {
+      Printf("makeprocs (%d): Bad SO4\n", getpid());
+      Exit();
+    }
+  }
+  clock_read(&end);
+  if (sem_wait_n(sh->done, nworkers) != SYNC_SUCCESS) {
+    Printf("makeprocs (%d): Bad semaphore %d\n", getpid(), sh->done);
+    Exit();
+  }
+  sched_stats(-1, &after);
+  barrier_destroy(sh->start_barrier);
+  blocked = mbox_blocked(sh->s2) + mbox_blocked(sh->co) + mbox_blocked(sh->s) +
+            mbox_blocked(sh->o2) + mbox_blocked(sh->so4);
+  mbox_close(sh->s2);
+  mbox_close(sh->co);
+  mbox_close(sh->s);
+  mbox_close(sh->o2);
+  mbox_close(sh->so4);
+
+  // The scheduler counts take in process creation and exit too
+  reactions = rounds * BENCH_REACTIONS_PER_ROUND;
+  usec = end.usec - sh->start.usec;
+  instrs = end.instrs - sh->start.instrs;
+  Printf("  %d injectors, %d reactors of each: %d reactions, %d per second, %d instructions each\n",
+         injectors, reactors, reactions,
+         (usec > 0) ? (int)((double)reactions * 1000000.0 / (double)usec) : 0,
+         instrs / reactions);
+  n = after.schedules - before.schedules;
+  Printf("    scheduler: %d runs (%d per 100 reactions), %d preempted, %d per 1000 instructions\n",
+         n, n * 100 / reactions, after.involuntary - before.involuntary,
+         (int)((unsigned int)(after.schedInstrs - before.schedInstrs) /
+               ((instrs / 1000 > 0) ? instrs / 1000 : 1)));
+  Printf("    mailboxes: %d jiffies waiting in all, %d us per reaction\n", blocked,
+         blocked * 1000 / reactions);
+}
+
+void main (int argc, char *argv[])
+{
+  static int scales[] = { 1, 2, BENCH_MAX_PER_ROLE };
+  unsigned int h_mem;             // Handle to the shared page
+  int rounds = 96;                // Rounds per measurement
+  int injectors, reactors;
+  int i;
+
+  if ((argc != 1) && (argc != 2) && (argc != 4)) {
+    Printf("Usage: %s [rounds] | <injectors> <reactors> <rounds>\n", argv[0]);
+    Exit();
+  }
+  if (argc == 2) {
+    rounds = dstrtol(argv[1], NULL, 10);
+  }
+
+  if ((h_mem = shmget()) == 0) {
+    Printf("makeprocs (%d): ERROR: could not allocate shared memory page!\n", getpid());
+    Exit();
+  }
+  if ((sh = (bench_shared *)shmat(h_mem)) == NULL) {
+    Printf("makeprocs (%d): Could not map the shared page!\n", getpid());
+    Exit();
+  }
+  ditoa(h_mem, sh_handle_str);
+  if ((sh->done = sem_create(0)) == SYNC_FAIL) {
+    Printf("makeprocs (%d): Bad sem_create\n", getpid());
+    Exit();
+  }
+
+  // Just one run, as asked for; the rounds are shared out evenly
+  if (argc == 4) {
+    injectors = dstrtol(argv[1], NULL, 10);
+    reactors = dstrtol(argv[2], NULL, 10);
+    rounds = dstrtol(argv[3], NULL, 10);
+    if ((injectors < 1) || (injectors > BENCH_MAX_PER_ROLE) ||
+        (reactors < 1) || (reactors > BENCH_MAX_PER_ROLE)) {
+      Printf("makeprocs (%d): 1 to %d of each, please\n", getpid(), BENCH_MAX_PER_ROLE);
+      Exit();
+    }
+    rounds = (rounds / (injectors * reactors)) * injectors * reactors;
+    if (rounds <= 0) rounds = injectors * reactors;
+    run(injectors, reactors, rounds);
+    Printf("makeprocs (%d): Done!\n", getpid());
+    return;
+  }
+  rounds = (rounds / BENCH_MAX_PER_ROLE) * BENCH_MAX_PER_ROLE;
+  if (rounds <= 0) rounds = BENCH_MAX_PER_ROLE;
+
+  Printf("Scaling the processes (%d rounds of 1 S2 and 8 CO):\n", rounds);
+  for(i=0; i<sizeof(scales)/sizeof(scales[0]); i++) {
+    run(scales[i], scales[i], rounds);
+  }
+
+  Printf("Injectors against reactors (%d rounds):\n", rounds);
+  run(1, BENCH_MAX_PER_ROLE, rounds);
+  run(BENCH_MAX_PER_ROLE, 1, rounds);
+
+  Printf("Scaling the molecules (2 of each process):\n");
+  for(i=1; i<=4; i*=2) {
+    run(2, 2, rounds * i / 2);
+  }
+
+  Printf("makeprocs (%d): Done!\n", getpid());
+}
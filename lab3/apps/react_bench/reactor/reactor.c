@@ -0,0 +1,100 @@
+#include "usertraps.h"
+#include "misc.h"
+
+#include "react_bench.h"
+
+static bench_shared *sh;        // The shared page, set up by makeprocs
+
+// Receive a molecule from mbox, which had better be len bytes
+static void take(mbox_t mbox, int len)
+{
+  char msg[4];
+
+  if (mbox_recv(mbox, sizeof(msg), msg) != len) {
+    Printf("reactor (%d): Bad receive from mailbox %d\n", getpid(), mbox);
+    Exit();
+  }
+}
+
+static void give(mbox_t mbox, int len, char *molecule)
+{
+  if (mbox_send(mbox, len, molecule) != MBOX_SUCCESS) {
+    Printf("reactor (%d): Could not send to mailbox %d\n", getpid(), mbox);
+    Exit();
+  }
+}
+
+void main (int argc, char *argv[])
+{
+  int role, index;              // What to do, and which worker this is
+  int i, j;
+
+  if (argc != 4) {
+    Printf("Usage: %s <role> <worker index> <shared memory handle>\n", argv[0]);
+    Exit();
+  }
+  role = dstrtol(argv[1], NULL, 10);
+  index = dstrtol(argv[2], NULL, 10);
+  if ((sh = (bench_shared *)shmat(dstrtol(argv[3], NULL, 10))) == NULL) {
+    Printf("reactor (%d): Could not map the shared page!\n", getpid());
+    Exit();
+  }
+  if ((mbox_open(sh->s2) == MBOX_FAIL) || (mbox_open(sh->co) == MBOX_FAIL) ||
+      (mbox_open(sh->s) == MBOX_FAIL) || (mbox_open(sh->o2) == MBOX_FAIL) ||
+      (mbox_open(sh->so4) == MBOX_FAIL)) {
+    Printf("reactor (%d): Could not open the mailboxes!\n", getpid());
+    Exit();
+  }
+
+  // Start together, so the timing doesn't include process creation
+  if (barrier_wait(sh->start_barrier) != SYNC_SUCCESS) {
+    Printf("reactor (%d): Bad barrier %d\n", getpid(), sh->start_barrier);
+    Exit();
+  }
+  if (index == 0) {
+    clock_read(&sh->start);
+  }
+
+  for(i=0; i<sh->per_worker[role]; i++) {
+    switch (role) {
+      case BENCH_INJECT_S2:
+        give(sh->s2, 2, "S2");
+        break;
+      case BENCH_INJECT_CO:
+        for(j=0; j<8; j++) {
+          give(sh->co, 2, "CO");
+        }
+        break;
+      case BENCH_SPLIT_S2:
+        take(sh->s2, 2);
+        give(sh->s, 1, "S");
+        give(sh->s, 1, "S");
+        break;
+      case BENCH_SPLIT_CO:
+        for(j=0; j<2; j++) {
+          take(sh->co, 2); take(sh->co, 2); take(sh->co, 2); take(sh->co, 2);
+          give(sh->o2, 2, "O2");
+          give(sh->o2, 2, "O2");
+        }
+        break;
+      case BENCH_MAKE_SO4:
+        for(j=0; j<2; j++) {
+          take(sh->s, 1);
+          take(sh->o2, 2);
+          take(sh->o2, 2);
+          give(sh->so4, 3, "SO4");
+        }
+        break;
+    }
+  }
+
+  mbox_close(sh->s2);
+  mbox_close(sh->co);
+  mbox_close(sh->s);
+  mbox_close(sh->o2);
+  mbox_close(sh->so4);
+  if (sem_signal(sh->done) != SYNC_SUCCESS) {
+    Printf("reactor (%d): Bad semaphore %d\n", getpid(), sh->done);
+    Exit();
+  }
+}
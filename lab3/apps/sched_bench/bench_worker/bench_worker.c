@@ -0,0 +1,81 @@
+#include "usertraps.h"
+#include "misc.h"
+
+#include "bench.h"
+
+// One unit of busy work
+static void spin_unit()
+{
+  volatile int j;
+
+  for(j=0; j<BENCH_SPIN_UNIT; j++);
+}
+
+void main (int argc, char *argv[])
+{
+  int mode, index;         // What to do, and which worker this is
+  bench_shared *sh;        // The shared page, set up by sched_bench
+  sched_stats_t stats;     // Our own scheduler statistics at the end
+  int i;
+
+  if (argc != 4) {
+    Printf("Usage: %s <mode> <worker index> <shared memory handle>\n", argv[0]);
+    Exit();
+  }
+  mode = dstrtol(argv[1], NULL, 10);
+  index = dstrtol(argv[2], NULL, 10);
+  if ((sh = (bench_shared *)shmat(dstrtol(argv[3], NULL, 10))) == NULL) {
+    Printf("bench_worker (%d): Could not map the shared page!\n", getpid());
+    Exit();
+  }
+
+  // Start together, so the timing doesn't include process creation
+  if (barrier_wait(sh->start_barrier) != SYNC_SUCCESS) {
+    Printf("bench_worker (%d): Bad barrier %d\n", getpid(), sh->start_barrier);
+    Exit();
+  }
+  if (index == 0) {
+    clock_read(&sh->start);
+  }
+
+  switch (mode) {
+    case BENCH_YIELD:
+      for(i=0; i<sh->n; i++) {
+        yield();
+      }
+      break;
+    case BENCH_PONG:
+      for(i=0; i<sh->n; i++) {
+        if (index == 0) {
+          sem_signal(sh->ping);
+          sem_wait(sh->pong);
+        } else {
+          sem_wait(sh->ping);
+          sem_signal(sh->pong);
+        }
+      }
+      break;
+    case BENCH_SPIN:
+      for(i=0; i<sh->n; i++) {
+        spin_unit();
+      }
+      sh->units[index] = i;
+      break;
+    case BENCH_NICE:
+      for(i=0; !sh->stop; i++) {
+        spin_unit();
+      }
+      sh->units[index] = i;
+      break;
+  }
+
+  clock_read(&sh->end);
+  if (sched_stats(getpid(), &stats) == 1) {
+    sh->wakeups[index] = stats.wakeups;
+    sh->latencySum[index] = stats.latencySum;
+  }
+  if (sem_signal(sh->done) != SYNC_SUCCESS) {
+    Printf("bench_worker (%d): Bad semaphore %d\n", getpid(), sh->done);
+    Exit();
+  }
+}
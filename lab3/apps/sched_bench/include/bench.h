@@ -0,0 +1,37 @@
+#ifndef __BENCH__
+#define __BENCH__
+
+#define FILENAME_TO_RUN "bench_worker.dlx.obj"
+
+// What a worker does: its first argument
+#define BENCH_YIELD 0   // yield n times
+#define BENCH_PONG  1   // bounce a semaphore signal off the other worker n times
+#define BENCH_SPIN  2   // do n units of busy work
+#define BENCH_NICE  3   // do units of busy work until told to stop
+
+#define BENCH_MAX_WORKERS 31  // Every process but sched_bench
+#define BENCH_SPIN_UNIT 1000  // Loop iterations in a unit of busy work
+
+// The shared page.  sched_bench fills in the handles and n before it
+// starts the workers, which pass the barrier together; worker 0 reads
+// the clock as they start and each one reads it again as it's done,
+// so end is the last to finish.
+typedef struct bench_shared {
+  barrier_t start_barrier;
+  sem_t done;                   // Signalled by each worker at the end
+  sem_t ping;                   // BENCH_PONG: worker 0 to worker 1
+  sem_t pong;                   // ... and back
+  int n;
+  volatile int stop;            // BENCH_NICE: set to make them finish
+  clock_sample_t start;
+  clock_sample_t end;
+  int units[BENCH_MAX_WORKERS]; // Busy work each one got done
+  int wakeups[BENCH_MAX_WORKERS]; // From its sched_stats at the end
+  int latencySum[BENCH_MAX_WORKERS];
+} bench_shared;
+
+#ifndef NULL
+#define NULL (void *)0x0
+#endif
+
+#endif
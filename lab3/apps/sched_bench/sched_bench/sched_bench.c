@@ -0,0 +1,191 @@
+#include "usertraps.h"
+#include "misc.h"
+
+#include "bench.h"
+
+static bench_shared *sh;        // The page shared with the workers
+static char sh_handle_str[10];  // Its handle, as the workers' argument
+
+//--------------------------------------------------------------------
+// report prints what ops operations between from and to cost: the
+// time moves a jiffy at a time, so it's only as good as the number of
+// operations is large, but the instruction count is exact.
+//--------------------------------------------------------------------
+static void report(char *what, int ops, clock_sample_t *from, clock_sample_t *to)
+{
+  int usec = to->usec - from->usec;
+  unsigned int instrs = to->instrs - from->instrs;
+  int nsec;
+
+  if (ops <= 0) ops = 1;
+  nsec = (usec / ops) * 1000 + ((usec % ops) * 1000) / ops;
+  Printf("  %s: %d in %d us, %d ns and %d instructions each\n", what, ops,
+         usec, nsec, instrs / ops);
+}
+
+//--------------------------------------------------------------------
+// run_workers starts nworkers bench_workers doing mode with n (the
+// ones after the first with nice values from nices, if it isn't NULL)
+// and waits for them.  With stop_after_ms at 0 or more it lets them
+// run that long and then tells them to stop.
+//--------------------------------------------------------------------
+static void run_workers(int mode, int nworkers, int n, int *nices, int stop_after_ms)
+{
+  char mode_str[10], index_str[10];
+  int i;
+
+  sh->n = n;
+  sh->stop = 0;
+  for(i=0; i<BENCH_MAX_WORKERS; i++) {
+    sh->units[i] = sh->wakeups[i] = sh->latencySum[i] = 0;
+  }
+  if ((sh->start_barrier = barrier_create(nworkers)) == SYNC_FAIL) {
+    Printf("sched_bench (%d): Bad barrier_create\n", getpid());
+    Exit();
+  }
+  ditoa(mode, mode_str);
+  for(i=0; i<nworkers; i++) {
+    ditoa(i, index_str);
+    process_create(FILENAME_TO_RUN, (nices == NULL) ? 0 : nices[i], 0,
+                   mode_str, index_str, sh_handle_str, NULL);
+  }
+  if (stop_after_ms >= 0) {
+    msleep(stop_after_ms);
+    sh->stop = 1;
+  }
+  if (sem_wait_n(sh->done, nworkers) != SYNC_SUCCESS) {
+    Printf("sched_bench (%d): Bad semaphore %d\n", getpid(), sh->done);
+    Exit();
+  }
+  barrier_destroy(sh->start_barrier);
+}
+
+// Context switch cost: two workers yielding to each other
+static void bench_yield(int n)
+{
+  Printf("Context switch (yield ping-pong between 2 processes):\n");
+  run_workers(BENCH_YIELD, 2, n, NULL, -1);
+  report("switches", 2 * n, &sh->start, &sh->end);
+}
+
+// Wakeup latency: a semaphore signal bounced back and forth
+static void bench_pong(int n)
+{
+  int i, wakeups = 0, latency = 0;
+
+  Printf("Wakeup after sem_signal (semaphore ping-pong between 2 processes):\n");
+  run_workers(BENCH_PONG, 2, n, NULL, -1);
+  report("signal to wakeup", 2 * n, &sh->start, &sh->end);
+  for(i=0; i<2; i++) {
+    wakeups += sh->wakeups[i];
+    latency += sh->latencySum[i];
+  }
+  Printf("  scheduler: %d wakeups, %d jiffies from wakeup to running in all\n",
+         wakeups, latency);
+}
+
+// Sleep accuracy: how far past the time asked for msleep comes back
+static void bench_sleep(int n)
+{
+  static int ms[] = { 1, 2, 5, 10, 20 };
+  clock_sample_t from, to;
+  int i, j, usec, over, worst;
+
+  Printf("Sleep accuracy (msleep, %d times each):\n", n);
+  for(i=0; i<sizeof(ms)/sizeof(ms[0]); i++) {
+    over = worst = 0;
+    for(j=0; j<n; j++) {
+      clock_read(&from);
+      msleep(ms[i]);
+      clock_read(&to);
+      usec = to.usec - from.usec - ms[i] * 1000;
+      over += usec;
+      if (usec > worst) worst = usec;
+    }
+    Printf("  %d ms: %d us late on average, %d us at worst\n", ms[i], over / n,
+           worst);
+  }
+}
+
+// Scheduler overhead as the run queue grows: the same busy work in
+// every process, so anything past k times one process's time is the
+// scheduler's
+static void bench_spin(int n)
+{
+  static int procs[] = { 1, 8, BENCH_MAX_WORKERS };
+  sched_stats_t before, after;
+  unsigned int instrs;
+  int i, schedules, sched_instrs;
+
+  Printf("Scheduler overhead (%d units of busy work per process):\n", n);
+  for(i=0; i<sizeof(procs)/sizeof(procs[0]); i++) {
+    sched_stats(-1, &before);
+    run_workers(BENCH_SPIN, procs[i], n, NULL, -1);
+    sched_stats(-1, &after);
+    Printf(" %d runnable:\n", procs[i]);
+    report("units", procs[i] * n, &sh->start, &sh->end);
+    schedules = after.schedules - before.schedules;
+    sched_instrs = after.schedInstrs - before.schedInstrs;
+    instrs = sh->end.instrs - sh->start.instrs;
+    Printf("  scheduler: %d runs, %d instructions each, %d per 1000 of all\n",
+           schedules, sched_instrs / ((schedules > 0) ? schedules : 1),
+           (int)((unsigned int)sched_instrs / ((instrs / 1000 > 0) ? instrs / 1000 : 1)));
+  }
+}
+
+// Fairness: busy workers at different nice values, run for a while
+static void bench_nice(int ms)
+{
+  static int nices[] = { 0, 0, 5, 10, 19 };
+  int nworkers = sizeof(nices)/sizeof(nices[0]);
+  int i, total = 0;
+
+  Printf("Fairness (%d busy processes for %d ms):\n", nworkers, ms);
+  run_workers(BENCH_NICE, nworkers, 0, nices, ms);
+  for(i=0; i<nworkers; i++) {
+    total += sh->units[i];
+  }
+  if (total == 0) total = 1;
+  for(i=0; i<nworkers; i++) {
+    Printf("  nice %d: %d units, %d per 1000 of the CPU\n", nices[i], sh->units[i],
+           sh->units[i] * 1000 / total);
+  }
+}
+
+void main (int argc, char *argv[])
+{
+  unsigned int h_mem;             // Handle to the shared page
+  int n = 200;                    // Operations per measurement
+
+  if (argc > 2) {
+    Printf("Usage: %s [operations per measurement]\n", argv[0]);
+    Exit();
+  }
+  if (argc == 2) {
+    n = dstrtol(argv[1], NULL, 10);
+  }
+
+  if ((h_mem = shmget()) == 0) {
+    Printf("sched_bench (%d): ERROR: could not allocate shared memory page!\n", getpid());
+    Exit();
+  }
+  if ((sh = (bench_shared *)shmat(h_mem)) == NULL) {
+    Printf("sched_bench (%d): Could not map the shared page!\n", getpid());
+    Exit();
+  }
+  ditoa(h_mem, sh_handle_str);
+  if (((sh->done = sem_create(0)) == SYNC_FAIL) ||
+      ((sh->ping = sem_create(0)) == SYNC_FAIL) ||
+      ((sh->pong = sem_create(0)) == SYNC_FAIL)) {
+    Printf("sched_bench (%d): Bad sem_create\n", getpid());
+    Exit();
+  }
+
+  bench_yield(n);
+  bench_pong(n);
+  bench_sleep(5);
+  bench_spin(n / 10);
+  bench_nice(500);
+
+  Printf("sched_bench (%d): Done!\n", getpid());
+}
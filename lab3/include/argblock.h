@@ -0,0 +1,33 @@
+#ifndef __argblock_h__
+#define __argblock_h__
+
+//---------------------------------------------------------------------
+// Argument blocks for process_spawn.  A block is argc, then argv[0 ..
+// argc-1] as byte offsets from the start of the block and a 0, then
+// the strings back to back:
+//
+//	int argc | argv offsets ... | 0 | "name\0" "arg1\0" ...
+//
+// The kernel copies it onto the new process's stack in one go and
+// only adds the block's address to each offset, so the strings are
+// never scanned and a block built once can start any number of
+// processes.  It may be up to ARGBLOCK_MAX_BYTES long (the kernel's
+// PROCESS_MAX_ARG_BLOCK).  To use it, add
+//	LIBS+= argblock.o
+// to the application's Makefile.
+//---------------------------------------------------------------------
+
+#define ARGBLOCK_MAX_BYTES	16384
+#define ARGBLOCK_FAIL		-1
+
+// Lays out argv (NULL terminated, argv[0] the program name) in the
+// size bytes at block.  Returns the block's length, for process_spawn,
+// or ARGBLOCK_FAIL if it doesn't fit.
+int argblock_build(void *block, int size, char *argv[]);
+
+// Replaces the last argument of a block argblock_build made with arg,
+// leaving the rest as it was; handy for a per-worker index.  Returns
+// the new length, or ARGBLOCK_FAIL if it doesn't fit in size.
+int argblock_set_last(void *block, int size, char *arg);
+
+#endif
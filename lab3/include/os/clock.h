@@ -10,6 +10,14 @@
 // is called.
 #define CLOCK_PROCESS_JIFFIES    (10000/CLOCK_DEFAULT_RESOLUTION) // Call Process Schedule 
 
+// A reading of the clock for clock_read().  Must match clock_sample_t
+// in usertraps.h.
+typedef struct ClockSample {
+  int jiffies;        // Jiffies since the clock started
+  int usec;           // The same in microseconds
+  uint32 instrs;      // Instructions retired, exact (wraps at 2^32)
+} ClockSample;
+
 void ClkModuleInit();   // Initializes the clock module
 void ClkStart();        // Starts the clock firing
 void ClkStop();         // Stops the clock
@@ -19,5 +27,7 @@ inline int ClkGetResolution(); // Returns the resolution of the clock, in micros
 inline double ClkGetCurTime();    // Returns number of milliseconds since clock was started
 inline int ClkGetCurJiffies(); // Returns number of jiffies that have fired since clock started
 void ClkResetProcess();  // Resets the current process counter to the current time
+void ClkSetQuantum(int jiffies); // Sets the jiffies between ProcessSchedule triggers
+void ClkGetSample(ClockSample *sample); // Reads the time and the instruction counter
 
 #endif
@@ -36,6 +36,9 @@ extern char  debugstr[];
 
 extern int  CurrentIntrs ();
 extern int  SetIntrs (int);
+extern void WaitForInterrupt ();
+extern int  FindFirstSet (uint32);
+extern int  TestAndSet (volatile int *);
 extern void  KbdModuleInit ();
 extern void  intrreturn ();
 
@@ -1,57 +1,129 @@
-#ifndef __MBOX_OS__
-#define __MBOX_OS__
-
-#define MBOX_NUM_MBOXES 16           // Maximum number of mailboxes allowed in the system
-#define MBOX_NUM_BUFFERS 50          // Maximum number of message buffers allowed in the system
-#define MBOX_MAX_BUFFERS_PER_MBOX 10 // Maximum number of buffer slots available to any given mailbox
-#define MBOX_MAX_MESSAGE_LENGTH 100   // Buffer size of 100 for each message
-
-#define MBOX_FAIL -1
-#define MBOX_SUCCESS 1
-
-//---------------------------------------------
-// Define your mailbox structures here
-//--------------------------------------------
-
-typedef struct mbox_message {
-	char message[MBOX_MAX_MESSAGE_LENGTH];
-	int msize;
-	uint32 inuse;
-} mbox_message;
-
-typedef struct mbox {
- 	uint32 inuse;
- 	int pids[PROCESS_MAX_PROCS]; 	
- 	int used;						// A counter (used) to track number of processes that have opened the mailbox 
- 	int count;						// A counter (count) to track number of variable length, queued messages 
- 	Queue msg;
-	// Synchronization Variables
- 	//A lock (l) and two condition variables (moreSpace and moreData) for producers and consumers to wait on 
- 	lock_t l;						// lock for the mbox
- 	sem_t s_empty;				// moreSpace: producer’s message doesn’t fit it waits on moreSpace 
- 	sem_t s_full;					// moreData: consumer finds no messages it waits on moreData
-} mbox;
-
-typedef int mbox_t; // This is the "type" of mailbox handles
-
-//-------------------------------------------
-// Prototypes for Mbox functions you have to write
-//-------------------------------------------
-
-void MboxModuleInit();
-mbox_t MboxCreate();
-int MboxOpen(mbox_t m);
-int MboxClose(mbox_t m);
-int MboxSend(mbox_t m, int length, void *message);
-int MboxRecv(mbox_t m, int maxlength, void *message);
-int MboxCloseAllByPid(int pid);
-
-#ifndef false
-#define false 0
-#endif
-
-#ifndef true
-#define true 1
-#endif
-
-#endif
+#ifndef __MBOX_OS__
+#define __MBOX_OS__
+
+#include "spinlock.h"
+
+#define MBOX_NUM_MBOXES 16           // Maximum number of mailboxes allowed in the system
+                                     // (at most 32: PCB mboxesOpen has a bit per mailbox)
+#define MBOX_MAX_MESSAGE_LENGTH 100   // Buffer size of 100 for each message
+#define MBOX_RING_BYTES 1024         // Bytes of messages (with their headers) each mailbox can hold
+#define MBOX_HIGH_RING_BYTES 256     // More bytes, kept for MBOX_PRIO_HIGH messages only
+#define MBOX_BCAST_SLOTS 4           // Broadcasts each mailbox holds until every opener reads them
+
+#define MBOX_FAIL -1
+#define MBOX_SUCCESS 1
+#define MBOX_WOULDBLOCK 0	// From the Try calls: it would have had to wait
+#define MBOX_TIMEOUT -2		// From MboxSelect: nothing arrived in time
+
+// MboxSendPriority lanes.  Receivers take every high priority message
+// before any normal one, and the high lane has a ring of its own, so a
+// control message neither queues behind nor waits for room among data
+#define MBOX_PRIO_NORMAL 0
+#define MBOX_PRIO_HIGH 1
+#define MBOX_NUM_LANES 2
+
+//---------------------------------------------
+// Define your mailbox structures here
+//--------------------------------------------
+
+// Each message in a mailbox's ring is one of these followed by its
+// msize bytes
+typedef struct mbox_record {
+	unsigned short msize;
+	unsigned short ispage;		// The bytes are an mbox_page_record (MboxSendPage)
+} mbox_record;
+
+typedef struct mbox_page_record {
+	uint32 page;				// Its handle, from MemoryCreateSharedPage
+	int length;					// Bytes the sender put in it
+	int sender;					// PID whose mapping of it goes away on receipt
+} mbox_page_record;
+
+// One MboxBroadcast payload, stored once however many openers read it
+typedef struct mbox_bcast {
+	uint32 unread;				// Bit pid set: pid has yet to read it.  Free if 0
+	int seq;					// Broadcasts are read in seq order
+	int length;
+	char data[MBOX_MAX_MESSAGE_LENGTH];
+} mbox_bcast;
+
+// Queue metrics for one mailbox (see MboxGetStats), counted since it
+// was created.  Times are in jiffies.  This layout must match
+// mbox_stats in usertraps.h.
+typedef struct MboxStats {
+	int depth;					// Messages queued now
+	int peakDepth;
+	int bytes;					// Ring bytes in use now, headers included
+	int peakBytes;
+	int sends;					// Messages queued
+	int recvs;					// Messages taken
+	int bytesMoved;				// Payload bytes sent (a page counts its length)
+	int sendBlocked;			// Time senders spent waiting on s_empty
+	int recvBlocked;			// Time receivers spent waiting on s_full
+	int highSends;				// Of sends, those that went in the high lane
+} MboxStats;
+
+// One lane's ring: records in the order they were sent
+typedef struct mbox_lane {
+	char *ring;						// size bytes, fixed at boot
+	int size;
+	int head;						// Offset of the oldest message; the rest follow it
+	int bytes;						// Bytes of the ring in use
+	int count;						// Messages in it
+	sem_t s_empty;					// Free bytes: a sender whose message doesn't fit waits here
+} mbox_lane;
+
+typedef struct mbox {
+ 	uint32 inuse;
+ 	uint32 openMask;				// Bit pid set: pid has it open (PROCESS_MAX_PROCS <= 32)
+	mbox_lane lanes[MBOX_NUM_LANES];	// Indexed by MBOX_PRIO_*
+	// Synchronization Variables
+ 	//A lock (l) and a semaphore for consumers to wait on; producers wait on their lane's s_empty
+ 	lock_t l;						// lock for the mbox
+ 	sem_t s_full;					// moreData: consumer finds no messages (in either lane) it waits on moreData
+ 	MboxStats stats;				// depth and bytes are filled in by MboxGetStats
+ 	mbox_bcast *bcasts;				// MBOX_BCAST_SLOTS of them, fixed at boot
+ 	int bcastSeq;					// seq of the next broadcast
+ 	cond_t c_bcastData;				// Signalled (under l) when a broadcast arrives
+ 	cond_t c_bcastSpace;			// Signalled (under l) when a broadcast slot frees up
+	Spinlock sl;					// Also guards the lanes' counts and bytes and stats, for MboxGetStats
+} mbox;
+
+typedef int mbox_t; // This is the "type" of mailbox handles
+
+//-------------------------------------------
+// Prototypes for Mbox functions you have to write
+//
+// The calls that take a PCB copy the message bytes
+// straight between the mailbox and that process's
+// memory; a NULL PCB means the buffer is in the kernel.
+//-------------------------------------------
+
+void MboxModuleInit();
+mbox_t MboxCreate();
+int MboxOpen(mbox_t m);
+int MboxClose(mbox_t m);
+int MboxSend(mbox_t m, PCB *pcb, int length, void *message);
+int MboxSendPriority(mbox_t m, PCB *pcb, int length, void *message, int priority);
+int MboxRecv(mbox_t m, PCB *pcb, int maxlength, void *message);
+int MboxCloseAllByPid(int pid);
+int MboxSendPage(mbox_t m, uint32 page, int length);
+void *MboxRecvPage(mbox_t m, int *length);
+int MboxSendMany(mbox_t m, PCB *pcb, int count, int length, void *messages);
+int MboxRecvMany(mbox_t m, PCB *pcb, int maxcount, int length, void *messages);
+int MboxTrySend(mbox_t m, PCB *pcb, int length, void *message);
+int MboxTryRecv(mbox_t m, PCB *pcb, int maxlength, void *message);
+mbox_t MboxSelect(mbox_t *handles, int n, int timeout);
+int MboxGetStats(mbox_t m, MboxStats *stats);
+int MboxBroadcast(mbox_t m, PCB *pcb, int length, void *message);
+int MboxRecvBroadcast(mbox_t m, PCB *pcb, int maxlength, void *message);
+
+#ifndef false
+#define false 0
+#endif
+
+#ifndef true
+#define true 1
+#endif
+
+#endif
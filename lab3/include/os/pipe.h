@@ -0,0 +1,43 @@
+//
+//	pipe.h
+//
+//	Kernel pipes: byte streams between processes.  A pipe is a ring
+//	of PIPE_BUFFER_SIZE bytes; PipeWrite puts in as many bytes as
+//	fit and PipeRead takes out as many as are there, each blocking
+//	only while it can't move any at all.
+//
+
+#ifndef	_pipe_h_
+#define	_pipe_h_
+
+#include "process.h"
+#include "synch.h"
+
+#define MAX_PIPES		8	// Maximum 8 pipes allowed in the system
+#define PIPE_BUFFER_SIZE	4096	// Bytes each pipe can hold
+
+#define PIPE_FAIL -1
+#define PIPE_SUCCESS 1
+
+typedef int pipe_t;
+
+typedef struct Pipe {
+  char buffer[PIPE_BUFFER_SIZE];
+  int head;          // Offset of the oldest byte
+  int used;          // Bytes in the buffer
+  int waiting;       // Readers and writers blocked on it
+  lock_t lock;       // Guards all of the above
+  cond_t notEmpty;   // Readers wait here for bytes
+  cond_t notFull;    // Writers wait here for room
+  int inuse;         // Bookkeeping variable for free vs. used structures
+  int owner;         // PID of the process that created it
+} Pipe;
+
+void PipeModuleInit();
+pipe_t PipeCreate();
+int PipeDestroy(pipe_t p);
+int PipeWrite(pipe_t p, PCB *pcb, char *data, int n);
+int PipeRead(pipe_t p, PCB *pcb, char *data, int n);
+void PipeFreeProcess(int pid);   // From ProcessFreeResources
+
+#endif	//_pipe_h_
@@ -30,9 +30,35 @@
 #define PROCESS_STATUS_MASK 0x3f
 #define PROCESS_TYPE_SYSTEM 0x100
 #define PROCESS_TYPE_USER 0x200
+#define PROCESS_TYPE_REALTIME 0x400 // Fixed priority, runs ahead of the scheduler policy
+
+// Real time priorities, 0 (highest) to PROCESS_RT_PRIORITIES-1
+#define PROCESS_RT_PRIORITIES 8
+#define PROCESS_RT_PRIO_REAPER 4
 
 typedef void (*VoidFunc)();
 
+// Scheduler statistics, for the whole system or for one process (see
+// ProcessGetSchedStats).  Histogram bucket 0 counts zeros and bucket
+// i counts values in [2^(i-1), 2^i); the last one takes the rest.
+// This layout must match sched_stats in usertraps.h.
+#define SCHED_HIST_BUCKETS 8
+
+typedef struct SchedStats {
+  int dispatches;     // Times a process was switched to
+  int voluntary;      // Switches away from a process that slept, blocked, yielded or exited
+  int involuntary;    // Switches away from a process that was still runnable
+  int wakeups;        // Wakeups that have since been dispatched
+  int latencySum;     // Jiffies from wakeup to run, over those wakeups
+  int latencyMax;
+  int latencyHist[SCHED_HIST_BUCKETS];
+  int schedules;      // ProcessSchedule calls (system only)
+  int schedInstrs;    // Instructions spent in ProcessSchedule (system only)
+  int qlenSum;        // Runnable processes besides idle, sampled per schedule
+  int qlenMax;
+  int qlenHist[SCHED_HIST_BUCKETS];
+} SchedStats;
+
 typedef struct PCB {
   uint32  *currentSavedFrame; // -> current saved frame.  MUST BE 1ST!
   uint32  *sysStackPtr; // Current system stack pointer.  MUST BE 2ND!
@@ -41,15 +67,31 @@ typedef struct PCB {
   char    name[80]; // Process name
   uint32  pagetable[16];  // Statically allocated page table
   int   npages;   // Number of pages allocated to this process
-  Link    *l;   // Used for keeping PCB in queues
+  Link    *l;   // Used for keeping PCB in queues: always &link
+  Link    link; // Embedded, so moving queues never allocates
+  Link    waitLink; // On a semaphore, lock or condition's waiting queue
+  PQLink  sleepLink; // On qSleep, keyed by jWake
 
   int pinfo;          // Turns on printing of runtime stats
   int pnice;          // Used in priority calculation
 
   int jResume, jSleep, jTotal, jWake;
 
+  // Scheduler state; see sched.h
   int priority;
-  double estcpu;
+  int estcpu;         // Fixed point, ESTCPU_ONE == 1.0
+  int estcpuEpoch;    // Decay epoch estcpu was last brought up to
+  int tickets, stride, pass, heapIndex; // Stride scheduling
+
+  int jReady;         // When it was woken up, or -1 once it has run since
+
+  // Priority inheritance; see LockUpdateDonor in synch.c
+  struct PCB *donor;  // Most urgent waiter on a lock this one holds
+  struct Lock *blockedOn; // Lock this one waits for, or NULL
+  int waitTimedOut;   // A timed wait (ProcessSleepUntil) ran out
+  int semWant;        // Units it waits for on a semaphore's queue
+  uint32 mboxesOpen;  // Bit i set: it has mailbox i open
+  SchedStats stats;
 
 } PCB;
 
@@ -73,6 +115,19 @@ typedef struct PCB {
           // command-line arguments
 #define MAX_ARGS  128   // Max number of command-line
           // arguments
+#define PROCESS_MAX_ARG_BLOCK 16384 // Max bytes in a process_spawn argument block
+
+// ProcessFork's isUser is 1 for a user process whose param is its
+// argument strings back to back, ending in an empty one, or
+// PROCESS_USER_ARGBLOCK when param points at a ProcessArgBlock: a
+// prebuilt argc/argv block (see argblock.h) in from's memory, or in
+// system memory if from is NULL.
+#define PROCESS_USER_ARGBLOCK 2
+typedef struct ProcessArgBlock {
+  PCB *from;
+  uint32 addr;
+  int len;
+} ProcessArgBlock;
 
 // Number of jiffies in a single process quantum (i.e. how often ProcessSchedule is called)
 #define PROCESS_QUANTUM_JIFFIES  CLOCK_PROCESS_JIFFIES
@@ -83,6 +138,8 @@ typedef struct PCB {
 extern PCB  *currentPCB;
 
 int ProcessFork (VoidFunc func, uint32 param, int pnice, int pinfo,char *name, int isUser);
+void ProcessForkBatchBegin();
+void ProcessForkBatchEnd();
 extern void ProcessSchedule ();
 extern void ContextSwitch(void *, void *, int);
 extern void ProcessSuspend (PCB *);
@@ -93,31 +150,29 @@ extern void ProcessDestroy(PCB *pcb);
 extern unsigned GetCurrentPid();
 void process_create(char *name, ...);
 int GetPidFromAddress(PCB *pcb);
+PCB *ProcessFromPid(int pid);   // NULL if pid isn't a live process
 
 void ProcessUserSleep(int seconds);
+void ProcessUserSleepJiffies(int jiffies);
+int ProcessSleepUntil(int jDeadline);
 void ProcessYield();
 void ProcessIdle();
-int pow(int base, int exp);
-
-#define NUM_RUN_QUEUES 32
-#define PRIORITIES_PER_QUEUE 4
-#define CPU_WINDOWS_BETWEEN_DECAYS 10
-#define USER_PROCESS_BASE_PRIORITY 50
-#define KERNEL_PROCESS_BASE_PRIORITY 50
-#define PROCESS_LOAD 1
+void ProcessReaper();
+void ProcessMakeRealtime(PCB *pcb, int rtprio);
+int ProcessReschedPending();
+extern void ProcessContextSwitch ();
+
 #define JIFFIES_PER_SECOND 1000
+#define PROCESS_REAP_BATCH 4   // Zombies freed before the reaper yields
 
-void ProcessRecalcPriority(PCB *pcb);
-inline int WhichQueue(PCB *pcb);
 void ProcessInsertRunning(PCB *pcb);
-void ProcessDecayEstcpu(PCB *pcb);
-void ProcessFixRunQueues();
+int ProcessQueueRemove(PCB *pcb);
 int isEmptyqSleep();
 void ProcessPrintRunQueues();
 void ProcessUserWakeup();
-void ProcessDecayEstcpuSleep(PCB *pcb, int time_asleep_jiffies);
 PCB *ProcessFindHighestPriorityPCB();
+int ProcessGetSchedStats(int pid, SchedStats *stats);
 int runQueIdleProcChk();
-void ProcessDecayAllEstcpus();
+int ProcessPreemptNeeded();
 
 #endif  /* __process_h__ */
@@ -14,7 +14,21 @@
 #define	NULL	((void *)0)
 #endif
 
-#define	QUEUE_MAX_LINKS		400
+// The link pool is split between subsystems so that one of them
+// running out (a burst of mailbox traffic, say) can't starve the
+// others.  QUEUE_MAX_LINKS is the sum of the pool sizes.
+#define	QUEUE_POOL_SCHED	0	// Run, wait and sleep queues
+#define	QUEUE_POOL_SYNCH	1	// Semaphore, lock and condition waiters
+#define	QUEUE_POOL_MBOX		2	// Mailbox messages
+#define	QUEUE_POOL_MISC		3	// Everything else
+#define	QUEUE_NUM_POOLS		4
+
+#define	QUEUE_POOL_SCHED_LINKS	100
+#define	QUEUE_POOL_SYNCH_LINKS	100
+#define	QUEUE_POOL_MBOX_LINKS	150
+#define	QUEUE_POOL_MISC_LINKS	50
+#define	QUEUE_MAX_LINKS		(QUEUE_POOL_SCHED_LINKS + QUEUE_POOL_SYNCH_LINKS + \
+				 QUEUE_POOL_MBOX_LINKS + QUEUE_POOL_MISC_LINKS)
 
 #define QUEUE_FAIL 0
 #define QUEUE_SUCCESS 1
@@ -34,6 +48,40 @@ typedef struct Queue {
   int nitems;
 } Queue;
 
+// A node of a priority queue (PQueue), embedded in the object it
+// orders like an embedded Link, so inserting never allocates.  The
+// queue is a pairing heap: child is the first of this node's
+// subtrees, next the following sibling, and prev the previous sibling
+// or, for a first child, the parent.
+typedef struct PQLink {
+  struct PQLink *child;
+  struct PQLink *next;
+  struct PQLink *prev;
+  struct PQueue *queue;   // NULL if it's on no priority queue
+  int key;                // Smaller keys come out first
+  unsigned int seq;       // Insertion order, which breaks ties
+  void *object;
+} PQLink;
+
+// A priority queue of PQLinks, smallest key first.  Keys are compared
+// by the sign of their difference, as jiffy times are, so they can
+// wrap around as long as the live ones are less than 2^31 apart.
+// Equal keys come out in the order they went in.
+typedef struct PQueue {
+  struct PQLink *root;    // The first link, NULL if empty
+  int nitems;
+  unsigned int seq;       // seq of the next insert
+} PQueue;
+
+// Usage of one link pool.  Must match link_stats in usertraps.h.
+typedef struct QueuePoolStats {
+  int size;           // links in the pool
+  int inuse;          // currently allocated
+  int highwater;      // most ever allocated at once
+  int allocs;
+  int failures;       // allocations that found the pool empty
+} QueuePoolStats;
+
 // Returns the next pointer of a link
 Link *  AQueueNext(Link *l );
 
@@ -68,16 +116,70 @@ int AQueueInsertLast (Queue *q, Link *l);
 int AQueueMoveAfter(Queue *q, Link *after, Link *l);
 
 // Removes link "l" from the queue that it belongs to
-// and sets *l = NULL
+// and sets *l = NULL.  A link from a pool goes back to that pool's
+// free links; an embedded one (see AQueueLinkInit) is just detached.
 int AQueueRemove (Link **l);
 
+// Takes link "l" off its queue without freeing it
+int AQueueUnlink (Link *l);
+
 // Initializes the Queue module
 int AQueueModuleInit ();
 
-// Gets a free link from the queue of free links
-Link *AQueueAllocLink (void *pointer_to_store_in_queue);
+// Gets a free link from the free links of pool (QUEUE_POOL_*)
+Link *AQueueAllocLink (int pool, void *pointer_to_store_in_queue);
+
+// Copies the usage counters of pool into *stats; QUEUE_FAIL if
+// there's no such pool
+int AQueuePoolStats (int pool, QueuePoolStats *stats);
+
+// Sets up a link that's embedded in the object it stores (a PCB, a
+// message ...) instead of coming from the pool, and returns it.  It
+// can't run out, and moving the object between queues is just
+// relinking.  The link must not be on a queue.
+Link *AQueueLinkInit (Link *l, void *object);
 
 // Initializes a queue to have zero items
 int AQueueInit (Queue *q);
 
+// Priority queues.  First is O(1); Insert and ChangeKey to an earlier
+// key are O(1), and RemoveFirst, Remove and ChangeKey to a later key
+// O(log n), amortized.  Like the queues they don't lock: the caller
+// keeps out whoever else uses the queue.
+
+// Initializes a priority queue to have zero items
+int PQueueInit (PQueue *q);
+
+// Sets up a link embedded in object, and returns it.  The link must
+// not be on a priority queue.
+PQLink *PQueueLinkInit (PQLink *l, void *object);
+
+// Inserts link "l" into priority queue "q" with key "key"
+int PQueueInsert (PQueue *q, PQLink *l, int key);
+
+// Takes link "l" off the priority queue it's on
+int PQueueRemove (PQLink *l);
+
+// Takes the first link off priority queue "q" and returns it, or NULL
+// if q is empty
+PQLink *PQueueRemoveFirst (PQueue *q);
+
+// Moves link "l" to where key "key" puts it in its priority queue
+int PQueueChangeKey (PQLink *l, int key);
+
+// Returns the link with the smallest key, without removing it
+PQLink *PQueueFirst (PQueue *q);
+
+// Returns the object pointer inside a priority queue link
+void *PQueueObject (PQLink *l);
+
+// Returns the key of a priority queue link
+int PQueueKey (PQLink *l);
+
+// Returns the number of links in a priority queue
+int PQueueLength (PQueue *q);
+
+// Returns true if the priority queue is empty, false otherwise
+int PQueueEmpty (PQueue *q);
+
 #endif	// _queue_h_
@@ -0,0 +1,65 @@
+//
+//  sched.h
+//
+//  Scheduler policies.  The process code never looks at run queues
+//  itself; it makes runnable, removes, picks and charges PCBs through
+//  the SchedOps table of whichever policy was selected at boot with
+//  "-S <name>".
+//
+
+#ifndef __sched_h__
+#define __sched_h__
+
+#include "process.h"
+
+typedef struct SchedOps {
+  char  *name;
+  void  (*init) ();
+  void  (*fork) (PCB *pcb);         // Sets up a new PCB before its first enqueue
+  void  (*enqueue) (PCB *pcb);      // Puts pcb (with a fresh pcb->l) on the run queue
+  int   (*dequeue) (PCB *pcb);      // Takes pcb off the run queue, frees pcb->l
+  PCB * (*pickNext) ();             // Best runnable PCB; it stays on the run queue
+  void  (*tick) (PCB *pcb, int jiffies);  // pcb just used jiffies of CPU
+  void  (*wakeup) (PCB *pcb);       // pcb is about to be enqueued after sleeping
+  void  (*setIdle) (PCB *pcb);      // pcb is the idle process: run it last
+  int   (*onRunQueue) (PCB *pcb);   // Is pcb->l on this policy's run queue?
+  int   (*busy) ();                 // Number of runnable PCBs besides idle
+  int   (*quantum) (PCB *pcb);      // Jiffies pcb gets before it's preempted
+  void  (*inherit) (PCB *pcb);      // pcb->donor changed: rank pcb no lower than it
+  int   (*before) (PCB *a, PCB *b); // Should a run before b?
+} SchedOps;
+
+extern SchedOps *sched;             // The policy in use
+
+int SchedSelect (char *name);       // Returns 0 if there's no such policy
+void SchedModuleInit ();
+void SchedSetIdle (PCB *pcb);
+void SchedPrintRunQueues ();
+int SchedBefore (PCB *a, PCB *b);   // Also orders real time PCBs
+void SchedInherit (PCB *pcb, PCB *donor);
+int SchedCpuId ();                  // The CPU this is running on
+
+// 4.4BSD style multilevel queues ("mlq", the default)
+#define NUM_RUN_QUEUES 32
+#define PRIORITIES_PER_QUEUE 4
+#define CPU_WINDOWS_BETWEEN_DECAYS 10
+#define USER_PROCESS_BASE_PRIORITY 50
+#define KERNEL_PROCESS_BASE_PRIORITY 50
+#define PROCESS_LOAD 1
+#define ESTCPU_SHIFT 8
+#define ESTCPU_ONE (1 << ESTCPU_SHIFT)
+#define ESTCPU_DECAY_EPOCHS 32  // after this many epochs the decay factor is 0
+// The run queues are split into this many bands of equal size, and
+// each band's timeslice is twice the one before it, starting from
+// half of PROCESS_QUANTUM_JIFFIES: high priority (interactive)
+// processes get short slices, CPU bound ones long ones.
+#define MLQ_QUANTUM_BANDS 4
+
+// Stride scheduling ("stride").  A PCB gets STRIDE_BASE_TICKETS less
+// STRIDE_TICKETS_PER_NICE per pnice, and its pass advances by
+// STRIDE_ONE / tickets for each quantum it runs.
+#define STRIDE_ONE (1 << 16)
+#define STRIDE_BASE_TICKETS 100
+#define STRIDE_TICKETS_PER_NICE 5
+
+#endif  /* __sched_h__ */
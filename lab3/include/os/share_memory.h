@@ -15,17 +15,21 @@
 
 #define MEMORY_MAX_SHARED_PAGES 32 //Maximum number of pages that can be
 				   //shared amongst different processes
+#define MEMORY_MAX_SHARED_REGIONS 32 //Maximum number of shared regions
 #define PROCESS_MAX_PAGES 16	   //Maximum number of pages allowed in Level
 				   //1 page table
 
 void SharedInitModule();	//Turns on the shared memory module
 uint32 MemoryCreateSharedPage(PCB *pcb);
 				//Creates a shared page in the memory
+uint32 MemoryCreateSharedRegion(PCB *pcb, int npages);
+				//Creates a shared region of npages pages
+				//and maps it into pcb; 0 on failure
 void *mmap(PCB *pcb, uint32 handle);
-				//Maps a shared page to the virtual address
-				//space
+				//Maps a shared region (all of its pages,
+				//contiguously) to the virtual address space
 int MemoryFreeSharedPage(PCB *pcb, uint32 handle);
-				//Releases a shared page. The page is not
+				//Releases a shared region. The pages are not
 				//actually deallocated untill all the process
 				//release it.
 int MemoryFreeSharedPte(PCB *pcb, int pagenumber); // called in process.c when freeing resources
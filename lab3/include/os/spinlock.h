@@ -0,0 +1,31 @@
+//
+//	spinlock.h
+//
+//	Kernel spinlocks, for data that more than one CPU may touch.  A
+//	spinlock is one word claimed with the simulator's tas
+//	instruction, and taking it also turns interrupts off on this CPU
+//	(an interrupt handler that wanted the same lock would spin for
+//	ever otherwise).  With one CPU running that's all it does, so a
+//	spinlock costs little more than the DisableIntrs/RestoreIntrs it
+//	replaces, but it names the data it guards.
+//
+//	Hold a spinlock for a few instructions only, never across a sleep
+//	or a context switch, and never take one you hold.  When two are
+//	needed, take them in this order: run queue, mailbox, link pool.
+//
+
+#ifndef	_spinlock_h_
+#define	_spinlock_h_
+
+typedef struct Spinlock {
+  volatile int	held;		// 1 while some CPU has it
+  int		cpu;		// Which one
+  char		*name;		// For messages
+} Spinlock;
+
+void	SpinInit (Spinlock *l, char *name);
+int	SpinLock (Spinlock *l);		// Returns what to pass SpinUnlock
+void	SpinUnlock (Spinlock *l, int intrs);
+int	SpinHeld (Spinlock *l);		// Held by this CPU?
+
+#endif	// _spinlock_h_
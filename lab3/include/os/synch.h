@@ -19,63 +19,170 @@
 #define SYNC_FAIL -1    // Used as return values from most synchronization functions.
 #define SYNC_SUCCESS 1  // Note that many functions return a handle, hence the -1 value
                         // for failure.
+#define SYNC_TIMEOUT 0  // A timed wait's deadline passed first
 
 #define MAX_SEMS	32	//Maximum 32 semaphores allowed in the system
 #define MAX_LOCKS	64	//Maximum 64 locks allowed in the system
 				//This is because condition vars also use
 				//locks from the same pool
 #define MAX_CONDS	32	//Maximum 32 conds allowed in the system
+#define MAX_BARRIERS	16	//Maximum 16 barriers allowed in the system
+#define MAX_LATCHES	16	//Maximum 16 latches allowed in the system
 
 typedef int sem_t;
 typedef int lock_t;
 typedef int cond_t;
+typedef int barrier_t;
+typedef int latch_t;
 
 #define INVALID_SEM -1
 #define INVALID_LOCK -1
 #define INVALID_PROC -1
 #define INVALID_COND -1
+#define INVALID_BARRIER -1
+#define INVALID_LATCH -1
+
+// Contention counters, kept while synch_profile() has profiling on.
+// Times are in jiffies.  For a semaphore an acquire is a SemWait, for
+// a condition variable a CondWait (which always waits).
+typedef struct SynchStats {
+  int acquires;       // Successful acquires
+  int contended;      // Acquires that had to wait
+  int waitTotal;      // Jiffies spent waiting, over all of them
+  int waitMax;        // Longest single wait
+  int holdTotal;      // Jiffies the lock was held (locks only)
+  int lastContender;  // PID of the last process that had to wait, or -1
+} SynchStats;
+
 typedef struct Sem {
     Queue	waiting;
     int		count;
     uint32	inuse; 		//indicates whether the semaphore is being
     				//used by any process
+    int		owner;		//PID of the user process that created it, or -1
+    int		nextFree;	//Next free semaphore, while it's free
+    SynchStats	stats;
 } Sem;
 
 int SemInit (Sem *, int);
 int SemWait (Sem *);
 int SemSignal (Sem *);
+int SemDestroy (Sem *);
+int SemTimedWait (Sem *, int jDeadline);
+int SemWaitN (Sem *, int n);
+int SemSignalN (Sem *, int n);
+int SemTake (Sem *, int max);
+int SemAvailable (Sem *);
 
 typedef struct Lock {
   int pid;       // PID of process holding the lock, -1 if lock is available
+  struct PCB *holder; // The process holding it, NULL if it's available
   Queue waiting; // Queue of processes waiting on the lock
   int inuse;     // Bookkeeping variable for free vs. used structures
+  int owner;     // PID of the user process that created it, or -1
+  int nextFree;  // Next free lock, while it's free
+  int nconds;    // Condition variables using this lock
+  int jAcquired; // Jiffy the holder got it, for stats.holdTotal
+  SynchStats stats;
 } Lock;
 
 int LockInit(Lock *);
 int LockAcquire(Lock *);
 int LockRelease(Lock *);
+int LockDestroy(Lock *);
+int LockTimedAcquire(Lock *, int jDeadline);
 
 typedef struct Cond {
-  Lock *lock;    // Lock associated with this conditional variable
+  lock_t lock;   // Lock associated with this conditional variable
   Queue waiting; // Queue of processes waiting on the conditional variable 
   int inuse;     // Bookkeeping variable for free vs. used structures
+  int owner;     // PID of the user process that created it, or -1
+  int nextFree;  // Next free cond, while it's free
+  SynchStats stats;
 } Cond;
 
 int CondInit(Cond *);
 int CondWait(Cond *);
 int CondSignal(Cond *);
+int CondDestroy(Cond *);
+int CondTimedWait(Cond *, int jDeadline);
+
+// A barrier lets processes through in groups of parties: each
+// BarrierWait blocks until the last of the group arrives, which wakes
+// the rest in one pass and starts the next group.
+typedef struct Barrier {
+  Queue waiting; // Processes that have arrived in the current group
+  int parties;   // Arrivals that open the barrier
+  int arrived;   // Arrivals so far in the current group
+  int inuse;     // Bookkeeping variable for free vs. used structures
+  int owner;     // PID of the user process that created it, or -1
+  int nextFree;  // Next free barrier, while it's free
+} Barrier;
+
+int BarrierWait(Barrier *);
+int BarrierDestroy(Barrier *);
+
+// A latch counts down once: LatchWait blocks while count is above
+// zero, and the LatchCountDown that reaches zero wakes every waiter.
+// After that LatchWait doesn't block any more.
+typedef struct Latch {
+  Queue waiting; // Queue of processes waiting for count to reach 0
+  int count;     // Count downs still to come
+  int inuse;     // Bookkeeping variable for free vs. used structures
+  int owner;     // PID of the user process that created it, or -1
+  int nextFree;  // Next free latch, while it's free
+} Latch;
+
+int LatchCountDown(Latch *);
+int LatchWait(Latch *);
+int LatchDestroy(Latch *);
 
 int SynchModuleInit();
 
+// The Create calls make objects for the kernel.  The HandleCreate ones
+// (used by the traps) belong to the calling process instead, and
+// SynchFreeProcess destroys them when it exits.
+
 sem_t SemCreate(int count);
 int SemHandleWait(sem_t sem);
 int SemHandleSignal(sem_t sem);
+int SemHandleWaitN(sem_t sem, int n);
+int SemHandleSignalN(sem_t sem, int n);
+int SemHandleTake(sem_t sem, int max);
+int SemHandleAvailable(sem_t sem);
+sem_t SemHandleCreate(int count);
+int SemHandleDestroy(sem_t sem);
 lock_t LockCreate();
+lock_t LockHandleCreate();
+int LockHandleDestroy(lock_t lock);
 int LockHandleAcquire(lock_t lock);
 int LockHandleRelease(lock_t lock);
 cond_t CondCreate(lock_t lock);
+cond_t CondHandleCreate(lock_t lock);
+int CondHandleDestroy(cond_t cond);
 int CondHandleWait(cond_t cond);
 int CondHandleSignal(cond_t cond);
 int CondHandleBroadcast(cond_t cond);
+barrier_t BarrierCreate(int parties);
+barrier_t BarrierHandleCreate(int parties);
+int BarrierHandleWait(barrier_t barrier);
+int BarrierHandleDestroy(barrier_t barrier);
+latch_t LatchCreate(int count);
+latch_t LatchHandleCreate(int count);
+int LatchHandleCountDown(latch_t latch);
+int LatchHandleWait(latch_t latch);
+int LatchHandleDestroy(latch_t latch);
+
+void SynchFreeProcess(struct PCB *pcb);  // From ProcessFreeResources
+void SynchTimeout(struct PCB *pcb);      // From ProcessUserWakeup
+
+// Timed waits for the traps: timeout is in milliseconds
+int SemHandleTimedWait(sem_t sem, int timeout);
+int LockHandleTimedAcquire(lock_t lock, int timeout);
+int CondHandleTimedWait(cond_t cond, int timeout);
+
+// Lock contention profiling, for the synch_profile traps
+void SynchProfile(int enable);
+void SynchProfileDump();
 
 #endif	//_synch_h_
@@ -62,8 +62,11 @@
 #define	TRAP_PROCESS_FORK	0x430
 #define TRAP_PROCESS_GETPID	0x431
 #define TRAP_PROCESS_CREATE	0x432
+#define TRAP_PROCESS_CREATE_MANY 0x433
+#define TRAP_PROCESS_SPAWN	0x434
 #define TRAP_SHARE_CREATE_PAGE	0x440
 #define TRAP_SHARE_MAP_PAGE	0x441
+#define TRAP_SHARE_CREATE_REGION 0x442
 #define TRAP_SEM_CREATE		0x450
 #define TRAP_SEM_WAIT		0x451
 #define TRAP_SEM_SIGNAL		0x452
@@ -74,6 +77,12 @@
 #define TRAP_COND_WAIT		0x457
 #define TRAP_COND_SIGNAL	0x458
 #define TRAP_COND_BROADCAST	0x459
+#define TRAP_SEM_DESTROY	0x45a
+#define TRAP_LOCK_DESTROY	0x45b
+#define TRAP_COND_DESTROY	0x45c
+#define TRAP_SEM_TIMEDWAIT	0x45d
+#define TRAP_LOCK_TIMEDACQUIRE	0x45e
+#define TRAP_COND_TIMEDWAIT	0x45f
 #define TRAP_MBOX_CREATE        0x460
 #define TRAP_MBOX_OPEN          0x461
 #define TRAP_MBOX_CLOSE         0x462
@@ -81,6 +90,36 @@
 #define TRAP_MBOX_RECV          0x464
 #define TRAP_USER_SLEEP         0x465
 #define TRAP_YIELD              0x466
+#define TRAP_USER_MSLEEP        0x467
+#define TRAP_SCHED_STATS        0x468
+#define TRAP_LINK_STATS         0x469
+#define TRAP_SYNCH_PROFILE      0x46a
+#define TRAP_SYNCH_PROFILE_DUMP 0x46b
+#define TRAP_BARRIER_CREATE     0x46c
+#define TRAP_BARRIER_WAIT       0x46d
+#define TRAP_BARRIER_DESTROY    0x46e
+#define TRAP_LATCH_CREATE       0x46f
+#define TRAP_LATCH_COUNTDOWN    0x470
+#define TRAP_LATCH_WAIT         0x471
+#define TRAP_LATCH_DESTROY      0x472
+#define TRAP_SEM_WAIT_N         0x473
+#define TRAP_SEM_SIGNAL_N       0x474
+#define TRAP_MBOX_SEND_PAGE     0x475
+#define TRAP_MBOX_RECV_PAGE     0x476
+#define TRAP_MBOX_SEND_MANY     0x477
+#define TRAP_MBOX_RECV_MANY     0x478
+#define TRAP_MBOX_TRYSEND       0x479
+#define TRAP_MBOX_TRYRECV       0x47a
+#define TRAP_MBOX_SELECT        0x47b
+#define TRAP_PIPE_CREATE        0x47c
+#define TRAP_PIPE_WRITE         0x47d
+#define TRAP_PIPE_READ          0x47e
+#define TRAP_PIPE_DESTROY       0x47f
+#define TRAP_MBOX_STATS         0x480
+#define TRAP_MBOX_BROADCAST     0x481
+#define TRAP_MBOX_RECV_BROADCAST 0x482
+#define TRAP_CLOCK_READ         0x483
+#define TRAP_MBOX_SEND_PRIO     0x484
 
 #define TRAP_USER_EXIT          0x500
 
@@ -92,6 +131,17 @@
 #define	DLX_KBD_NCHARSIN	0xfff001a0
 #define	DLX_KBD_INTR		0xfff001c0
 
+// Performance counters kept by the simulator: counter n is a 64-bit
+// value at DLX_PERF_BASE + 8*n (low word first).
+#define	DLX_PERF_BASE		0xffff1000
+#define	DLX_PERF_INSTRS		0	// instructions retired
+
+// SMP registers (when the simulator runs with DLXSIM_CPUS > 1): this
+// core's number and how many the simulator has.  Only core 0 runs
+// until the OS writes an entry point to DLX_SMP_START.
+#define	DLX_SMP_CPUID		0xffff2000
+#define	DLX_SMP_NCPUS		0xffff2004
+
 #define	TRAP_STACK_SIZE		0x800	// interrupt stack is 2K words
 
 #endif	/* _dlxtraps_h_ */
@@ -0,0 +1,60 @@
+#ifndef __spsc_h__
+#define __spsc_h__
+
+//---------------------------------------------------------------------
+// Single producer, single consumer rings in a shared page.  One
+// process shmget()s a page, spsc_init()s a ring at its start and
+// passes the shm handle on; the other shmat()s it and uses the same
+// address as its spsc_t.  Exactly one process may put and one get.
+// To use them, add
+//	LIBS+= spsc.o
+// to the application's Makefile.
+//
+// The producer only writes tail and the consumer only writes head,
+// and the two sit on cache lines of their own, so neither side's
+// stores disturb the line the other keeps polling.  Both are free
+// running counters; the slot count is a power of two, so a slot is
+// counter & mask and tail - head is the fill level even after they
+// wrap.  The *_many calls move a whole batch and then publish it
+// with one store.
+//
+// Neither side enters the kernel unless the ring is empty (for the
+// consumer) or full (for the producer).  Then it sets its waiting
+// flag, checks the ring once more and sleeps on its semaphore; the
+// other side signals that semaphore only if it sees the flag.
+//---------------------------------------------------------------------
+
+#define SPSC_LINE_BYTES		32		// Keep head and tail this far apart
+#define SPSC_PAGE_BYTES		(1 << 16)	// One shmget() page
+#define SPSC_FAIL		-1
+
+typedef struct spsc {
+  volatile unsigned int	head;		// Next slot to get; consumer writes
+  volatile int		getWaiting;	// Consumer sleeps on s_items
+  char			pad0[SPSC_LINE_BYTES - 2 * sizeof(int)];
+  volatile unsigned int	tail;		// Next slot to put; producer writes
+  volatile int		putWaiting;	// Producer sleeps on s_space
+  char			pad1[SPSC_LINE_BYTES - 2 * sizeof(int)];
+  unsigned int		mask;		// Slots - 1
+  int			elemsize;	// Bytes per slot
+  sem_t			s_items;
+  sem_t			s_space;
+  int			data;		// First slot; the rest of the page follows
+} spsc_t;
+
+// Builds a ring in the bytes at r (at least sizeof(spsc_t)) with as
+// many elemsize slots as fit; returns the slot count or SPSC_FAIL.
+int spsc_init(spsc_t *r, int bytes, int elemsize);
+void spsc_destroy(spsc_t *r);		// Frees the semaphores
+
+void spsc_put(spsc_t *r, void *elem);	// Waits while full
+void spsc_get(spsc_t *r, void *elem);	// Waits while empty
+int spsc_tryput(spsc_t *r, void *elem);	// 1 if put, 0 if full
+int spsc_tryget(spsc_t *r, void *elem);	// 1 if got, 0 if empty
+
+// Puts all n elements, publishing each run that fits at once.
+void spsc_put_many(spsc_t *r, void *elems, int n);
+// Waits for at least one element, then takes up to max; returns the count.
+int spsc_get_many(spsc_t *r, void *elems, int max);
+
+#endif
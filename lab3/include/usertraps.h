@@ -7,15 +7,80 @@
 typedef int sem_t;
 typedef int lock_t;
 typedef int cond_t;
+typedef int barrier_t;
+typedef int latch_t;
 typedef int mbox_t;
+typedef int pipe_t;
+
+// Scheduler statistics from sched_stats().  Histogram bucket 0 counts
+// zeros and bucket i counts values in [2^(i-1), 2^i); the last one
+// takes the rest.  Latencies are in jiffies.  Must match SchedStats.
+#define SCHED_HIST_BUCKETS 8
+typedef struct sched_stats {
+  int dispatches;     // times switched to
+  int voluntary;      // switches away that slept, blocked, yielded or exited
+  int involuntary;    // switches away that were preempted
+  int wakeups;        // wakeups that have since run
+  int latencySum;     // wakeup to run
+  int latencyMax;
+  int latencyHist[SCHED_HIST_BUCKETS];
+  int schedules;      // scheduler runs (system only)
+  int schedInstrs;    // instructions spent in the scheduler (system only)
+  int qlenSum;        // runnable processes, sampled per scheduler run
+  int qlenMax;
+  int qlenHist[SCHED_HIST_BUCKETS];
+} sched_stats_t;
+
+// A reading of the clock from clock_read().  The time moves a jiffy
+// (1 ms) at a time, so time many operations and divide; the
+// instruction count, kernel included, is exact.  Must match
+// ClockSample.
+typedef struct clock_sample {
+  int jiffies;        // since the clock started
+  int usec;           // the same in microseconds
+  unsigned int instrs; // instructions retired (wraps at 2^32)
+} clock_sample_t;
+
+// Kernel link pool usage from link_stats().  Pools are 0 (scheduler),
+// 1 (synchronization), 2 (mailboxes) and 3 (other).  Must match
+// QueuePoolStats.
+typedef struct link_stats {
+  int size;           // links in the pool
+  int inuse;          // currently allocated
+  int highwater;      // most ever allocated at once
+  int allocs;
+  int failures;       // allocations that found the pool empty
+} link_stats_t;
+
+// Mailbox queue metrics from mbox_stats(), since the mailbox was
+// created.  Times are in jiffies.  Must match MboxStats.
+typedef struct mbox_stats {
+  int depth;          // messages queued now
+  int peakDepth;
+  int bytes;          // ring bytes in use now, headers included
+  int peakBytes;
+  int sends;
+  int recvs;
+  int bytesMoved;     // payload bytes sent (a page counts its length)
+  int sendBlocked;    // time senders waited for room
+  int recvBlocked;    // time receivers waited for messages
+  int highSends;      // of sends, those at MBOX_PRIO_HIGH
+} mbox_stats_t;
 
 //---------------------------------------------------------------------
 // Any #defines from operating system for return values
 //---------------------------------------------------------------------
 #define MBOX_FAIL -1
 #define MBOX_SUCCESS 1
+#define MBOX_WOULDBLOCK 0
+#define MBOX_TIMEOUT -2
+#define MBOX_PRIO_NORMAL 0
+#define MBOX_PRIO_HIGH 1
+#define PIPE_FAIL -1
+#define PIPE_SUCCESS 1
 #define SYNC_FAIL -1
 #define SYNC_SUCCESS 1
+#define SYNC_TIMEOUT 0
 
 //---------------------------------------------------------------------
 // Function declarations for user traps defined in the assembly 
@@ -31,26 +96,54 @@ void Exit();
 // Related to processes
 int getpid();                           //trap 0x431
 void process_create(char *exec_name, int pnice, int pinfo, ...);  //trap 0x432
+int process_create_many(char *exec_name, int count, int pnice, int pinfo,
+                        char **argvs[]); //trap 0x433, argvs[i] ends in NULL
+int process_spawn(char *exec_name, int pnice, int pinfo, void *block,
+                  int len);     //trap 0x434, block from argblock.h; pid or -1
 
 // Related to shared memory
 unsigned int shmget();			//trap 0x440
-void *shmat(unsigned int handle);	//trap 0x441
+void *shmat(unsigned int handle);	//trap 0x441, maps a whole region
+unsigned int shmget_region(int npages);	//trap 0x442, 0 on failure
 
 // Related to semaphores
 sem_t sem_create(int count);		//trap 0x450
 int sem_wait(sem_t sem);		//trap 0x451
 int sem_signal(sem_t sem);		//trap 0x452
+int sem_destroy(sem_t sem);		//trap 0x45a, fails while waited on
+int sem_wait_n(sem_t sem, int n);	//trap 0x473, takes n at once
+int sem_signal_n(sem_t sem, int n);	//trap 0x474, wakes the waiters n covers
 
 // Related to locks
 lock_t lock_create();			//trap 0x453
 int lock_acquire(lock_t lock);		//trap 0x454
 int lock_release(lock_t lock);		//trap 0x455
+int lock_destroy(lock_t lock);		//trap 0x45b, fails while in use
 
 // Related to conditional variables
 cond_t cond_create(lock_t lock);	//trap 0x456
 int cond_wait(cond_t cond);		//trap 0x457
 int cond_signal(cond_t cond);		//trap 0x458
 int cond_broadcast(cond_t cond);	//trap 0x459
+int cond_destroy(cond_t cond);		//trap 0x45c, fails while waited on
+
+// Timed waits: like the calls above, but they give up after timeout
+// milliseconds and return SYNC_TIMEOUT.  cond_timedwait holds the lock
+// again when it returns either way.
+int sem_timedwait(sem_t sem, int timeout);	//trap 0x45d
+int lock_timedacquire(lock_t lock, int timeout);	//trap 0x45e
+int cond_timedwait(cond_t cond, int timeout);	//trap 0x45f
+
+// Related to barriers and latches.  barrier_wait returns once parties
+// processes have arrived; latch_wait returns once latch_countdown has
+// been called count times.
+barrier_t barrier_create(int parties);	//trap 0x46c
+int barrier_wait(barrier_t barrier);	//trap 0x46d
+int barrier_destroy(barrier_t barrier);	//trap 0x46e, fails while waited on
+latch_t latch_create(int count);	//trap 0x46f
+int latch_countdown(latch_t latch);	//trap 0x470
+int latch_wait(latch_t latch);		//trap 0x471
+int latch_destroy(latch_t latch);	//trap 0x472, fails while waited on
 
 // Related to mailboxes
 mbox_t mbox_create();                   //trap 0x460
@@ -58,10 +151,49 @@ int mbox_open(mbox_t handle);           //trap 0x461
 int mbox_close(mbox_t handle);          //trap 0x462
 int mbox_send(mbox_t handle, int length, void *data); // trap 0x463
 int mbox_recv(mbox_t handle, int maxlength, void *data); // trap 0x464
+// Zero-copy: hand a shmget page over instead of copying a message.
+// The sender must not use the page (or exit) until it's received.
+int mbox_send_page(mbox_t handle, unsigned int page, int length); // trap 0x475
+void *mbox_recv_page(mbox_t handle, int *length); // trap 0x476
+// Batches of fixed-size messages, back to back in data.  They must all
+// fit in a mailbox at once (1024 bytes, with 4 more per message); recv
+// returns once it has at least one message, with the number it got.
+int mbox_send_many(mbox_t handle, int count, int length, void *data); // trap 0x477
+int mbox_recv_many(mbox_t handle, int maxcount, int length, void *data); // trap 0x478
+// Non-blocking versions: they return MBOX_WOULDBLOCK instead of waiting
+int mbox_trysend(mbox_t handle, int length, void *data); // trap 0x479
+int mbox_tryrecv(mbox_t handle, int maxlength, void *data); // trap 0x47a
+// Returns whichever of the n mailboxes in handles has a message first,
+// or MBOX_TIMEOUT after timeout milliseconds (never, if it's negative)
+mbox_t mbox_select(mbox_t *handles, int n, int timeout); // trap 0x47b
+int mbox_stats(mbox_t handle, mbox_stats_t *stats); // trap 0x480, needn't be open
+// Broadcast: one copy of data for every other process that has the
+// mailbox open, each of which takes it with mbox_recv_broadcast (not
+// mbox_recv).  Returns how many processes it went to.
+int mbox_broadcast(mbox_t handle, int length, void *data); // trap 0x481
+int mbox_recv_broadcast(mbox_t handle, int maxlength, void *data); // trap 0x482
+// mbox_send at a priority.  MBOX_PRIO_HIGH messages are received before
+// any normal ones and have 256 bytes of the mailbox to themselves, so
+// they don't wait behind (or for room among) queued data.
+int mbox_send_prio(mbox_t handle, int length, void *data, int priority); // trap 0x484
+
+// Related to pipes.  Each pipe holds 4096 bytes; pipe_write writes as
+// many of the n bytes as fit and pipe_read reads as many as are there,
+// blocking only while they can't move any.  Both return the count.
+pipe_t pipe_create();                   //trap 0x47c
+int pipe_write(pipe_t pipe, void *data, int n); //trap 0x47d
+int pipe_read(pipe_t pipe, void *data, int n);  //trap 0x47e
+int pipe_destroy(pipe_t pipe);          //trap 0x47f, fails while in use
 
 // Related to process scheduling
 void sleep(int seconds);                //trap 0x465
 void yield();                           //trap 0x466
+void msleep(int milliseconds);          //trap 0x467
+int sched_stats(int pid, sched_stats_t *stats); //trap 0x468, pid -1 for the system
+int link_stats(int pool, link_stats_t *stats); //trap 0x469
+void synch_profile(int enable);               //trap 0x46a: 1 resets and starts, 0 stops
+void synch_profile_dump();                    //trap 0x46b: prints the counters
+int clock_read(clock_sample_t *sample);       //trap 0x483
 
 #ifndef NULL
 #define NULL (void *)0x0
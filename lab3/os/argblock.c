@@ -0,0 +1,38 @@
+//
+//	argblock.c
+//
+//	Builds argument blocks for process_spawn (see argblock.h).
+//
+//	This is linked into user programs, not the operating system.
+//
+
+#include "usertraps.h"
+#include "misc.h"
+#include "argblock.h"
+
+int argblock_build(void *block, int size, char *argv[]) {
+  int *words = (int *)block;
+  int argc, len, n;
+
+  for (argc = 0; argv[argc] != NULL; argc++);
+  len = (argc + 2) * sizeof(int);
+  if ((argc == 0) || (len > size)) return ARGBLOCK_FAIL;
+  words[0] = argc;
+  for (n = 0; n < argc; n++) {
+    words[n+1] = len;
+    if (len + dstrlen(argv[n]) + 1 > size) return ARGBLOCK_FAIL;
+    dstrcpy((char *)block + len, argv[n]);
+    len += dstrlen(argv[n]) + 1;
+  }
+  words[argc+1] = 0;
+  return len;
+}
+
+int argblock_set_last(void *block, int size, char *arg) {
+  int *words = (int *)block;
+  int start = words[words[0]];
+
+  if (start + dstrlen(arg) + 1 > size) return ARGBLOCK_FAIL;
+  dstrcpy((char *)block + start, arg);
+  return start + dstrlen(arg) + 1;
+}
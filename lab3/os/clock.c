@@ -15,6 +15,7 @@ static int curtime = 0;              // The number of "jiffies" that have passed
 static int clock_resolution = CLOCK_DEFAULT_RESOLUTION;   // Number of microseconds in one "jiffy"
 static int clock_running = 0;        // Flag to enable starting/stopping clock
 static int last_trigger_jiffies = 0; // Keeps track of last time we triggered ProcessSchedule
+static int clock_quantum = CLOCK_PROCESS_JIFFIES; // Jiffies between ProcessSchedule triggers
 
 //-------------------------------------------------------------
 //
@@ -27,6 +28,7 @@ void ClkModuleInit() {
   curtime = 0;
   clock_resolution = CLOCK_DEFAULT_RESOLUTION; // 100 usec per jiffy
   clock_running = 0;
+  clock_quantum = CLOCK_PROCESS_JIFFIES;
 }
 
 //-------------------------------------------------------------
@@ -59,7 +61,7 @@ int ClkInterrupt() {
 
     // Now check to see if enough jiffies have occurred to trigger
     // another ProcessSchedule
-    if (curtime - last_trigger_jiffies > CLOCK_PROCESS_JIFFIES) {
+    if (curtime - last_trigger_jiffies > clock_quantum) {
       last_trigger_jiffies = curtime;
       dbprintf('c', "ClkInterrupt: calling ProcessSchedule\n");
       return 1; // can call ProcessSchedule
@@ -105,6 +107,25 @@ inline int ClkGetCurJiffies() {
   return curtime;
 }
 
+//-------------------------------------------------------------
+// ClkGetSample reads the clock, and the simulator's count of
+// instructions retired, which unlike the clock is exact.
+//-------------------------------------------------------------
+void ClkGetSample(ClockSample *sample) {
+  sample->jiffies = curtime;
+  sample->usec = curtime * clock_resolution;
+  sample->instrs = *((uint32 *)(DLX_PERF_BASE + 8 * DLX_PERF_INSTRS));
+}
+
+//-------------------------------------------------------------
+// ClkSetQuantum sets how many jiffies must pass before the next
+// ClkInterrupt asks for a ProcessSchedule.  ProcessSchedule sets
+// it for each process it picks.
+//-------------------------------------------------------------
+void ClkSetQuantum(int jiffies) {
+  clock_quantum = (jiffies > 0) ? jiffies : 1;
+}
+
 //-------------------------------------------------------------
 // ClkResetProcess resets the process jiffies counter
 //-------------------------------------------------------------
@@ -321,6 +321,52 @@ _CurrentIntrs:
 	nop
 .endproc _CurrentIntrs
 ;;;----------------------------------------------------------------------
+;;; _WaitForInterrupt
+;;;
+;;; Idle until the next interrupt using the simulator's wait instruction
+;;; (opcode 0x2c, which the assembler doesn't know).
+;;;----------------------------------------------------------------------
+.proc _WaitForInterrupt
+.global _WaitForInterrupt
+_WaitForInterrupt:
+	.word	0xb0000000	; wait
+	jr	r31
+	nop
+.endproc _WaitForInterrupt
+;;;----------------------------------------------------------------------
+;;; _FindFirstSet
+;;;
+;;; Return the index of the lowest set bit in the argument, or 32 if
+;;; none is, using the simulator's ffs instruction (R-R function 0x38).
+;;;----------------------------------------------------------------------
+.proc _FindFirstSet
+.global _FindFirstSet
+_FindFirstSet:
+	lw	r1,0(r29)
+	.word	0x00200838	; ffs r1,r1
+	jr	r31
+	nop
+.endproc _FindFirstSet
+;;;----------------------------------------------------------------------
+;;; _TestAndSet
+;;;
+;;; Set the word at the address passed to 1 and return what it was,
+;;; atomically on every core, using the simulator's tas instruction
+;;; (opcode 0x1f), hand-encoded as "tas r1,0(r2)".
+;;;----------------------------------------------------------------------
+.proc _TestAndSet
+.global _TestAndSet
+_TestAndSet:
+	subui	r29,r29,#8
+	sw	4(r29),r2	; save r2
+	lw	r2,8(r29)	; Get the address
+	.word	0x7c410000	; tas r1,0(r2)
+	lw	r2,4(r29)	; restore r2
+	addui	r29,r29,#8
+	jr	r31
+	nop
+.endproc _TestAndSet
+;;;----------------------------------------------------------------------
 ;;; _ProcessSleep
 ;;;
 ;;; If a context switch from elsewhere in the kernel is desired, take a
@@ -335,3 +381,18 @@ _ProcessSleep:
 	nop
 .endproc _ProcessSleep
 
+;;;----------------------------------------------------------------------
+;;; _ProcessContextSwitch
+;;;
+;;; Like _ProcessSleep, but the trap handler only calls ProcessSchedule,
+;;; so the caller decides where (or whether) it waits.
+;;;----------------------------------------------------------------------
+.proc _ProcessContextSwitch
+.global _ProcessContextSwitch
+_ProcessContextSwitch:
+	trap	#0x400		; This is a context switch trap
+	nop
+	jr	r31
+	nop
+.endproc _ProcessContextSwitch
+
@@ -4,9 +4,40 @@
 #include "synch.h"
 #include "queue.h"
 #include "mbox.h"
+#include "share_memory.h"
+#include "clock.h"
 
 static mbox mbox_structs[MBOX_NUM_MBOXES];
-static mbox_message mbox_mess_structs[MBOX_NUM_BUFFERS];
+// Message storage.  Mailbox i owns the MBOX_RING_BYTES starting at
+// i * MBOX_RING_BYTES and keeps its messages there as a ring of
+// records, each an mbox_record followed by msize bytes.  A mailbox
+// holds as many messages as fit, however short they are.
+static char mbox_ring_bytes[MBOX_NUM_MBOXES * MBOX_RING_BYTES];
+// The high priority lanes' rings, laid out the same way
+static char mbox_high_ring_bytes[MBOX_NUM_MBOXES * MBOX_HIGH_RING_BYTES];
+// Broadcast payloads.  Mailbox i owns the MBOX_BCAST_SLOTS starting at
+// i * MBOX_BCAST_SLOTS.
+static mbox_bcast mbox_bcast_slots[MBOX_NUM_MBOXES * MBOX_BCAST_SLOTS];
+
+// Processes blocked in MboxSelect, on their waitLinks.  Anything that
+// can make a mailbox readable wakes them all to look again.
+static Queue mbox_select_waiting;
+
+static int MboxSendCopy(mbox_t handle, PCB *pcb, int length, void* message, int priority, int block);
+static int MboxRecvCopy(mbox_t handle, PCB *pcb, int maxlength, void* message, int block);
+static void MboxWakeSelectors();
+static void MboxUnopen(mbox_t handle, int pid);
+static void MboxStatsSent(mbox *mb, int n, int bytes);
+static void MboxCopy(PCB *pcb, char *ring, char *data, int n, int toRing);
+static void MboxBcastRead(mbox *mb, mbox_bcast *b, int pid);
+
+// Has process pid opened mailbox mb?
+#define MBOX_OPENED(mb, pid) (((mb)->openMask >> (pid)) & 1)
+// Messages, and ring bytes, queued in mb over both lanes
+#define MBOX_DEPTH(mb) ((mb)->lanes[MBOX_PRIO_NORMAL].count + (mb)->lanes[MBOX_PRIO_HIGH].count)
+#define MBOX_BYTES(mb) ((mb)->lanes[MBOX_PRIO_NORMAL].bytes + (mb)->lanes[MBOX_PRIO_HIGH].bytes)
+// The lane the next receive takes from: high, unless it's empty
+#define MBOX_RECV_LANE(mb) (&(mb)->lanes[((mb)->lanes[MBOX_PRIO_HIGH].count > 0) ? MBOX_PRIO_HIGH : MBOX_PRIO_NORMAL])
 
 //-------------------------------------------------------
 //
@@ -25,11 +56,22 @@ void MboxModuleInit() {
 	int i, j;
 	for(i = 0; i < MBOX_NUM_MBOXES; i++) {
 		mbox_structs[i].inuse = 0;
-		mbox_structs[i].used = 0;
-		mbox_structs[i].count = 0;
-		for(j = 0; j < PROCESS_MAX_PROCS; j++) {
-			mbox_structs[i].pids[j] = 0;
+		mbox_structs[i].openMask = 0;
+		mbox_structs[i].lanes[MBOX_PRIO_NORMAL].ring = &mbox_ring_bytes[i * MBOX_RING_BYTES];
+		mbox_structs[i].lanes[MBOX_PRIO_NORMAL].size = MBOX_RING_BYTES;
+		mbox_structs[i].lanes[MBOX_PRIO_HIGH].ring = &mbox_high_ring_bytes[i * MBOX_HIGH_RING_BYTES];
+		mbox_structs[i].lanes[MBOX_PRIO_HIGH].size = MBOX_HIGH_RING_BYTES;
+		for(j = 0; j < MBOX_NUM_LANES; j++) {
+			mbox_structs[i].lanes[j].head = 0;
+			mbox_structs[i].lanes[j].bytes = 0;
+			mbox_structs[i].lanes[j].count = 0;
 		}
+		mbox_structs[i].bcasts = &mbox_bcast_slots[i * MBOX_BCAST_SLOTS];
+		SpinInit(&mbox_structs[i].sl, "mailbox");
+	}
+	if (AQueueInit(&mbox_select_waiting) != QUEUE_SUCCESS) {
+		printf("FATAL ERROR: could not initialize select queue in MboxModuleInit\n");
+		exitsim();
 	}
 
 }
@@ -46,6 +88,8 @@ void MboxModuleInit() {
 //-------------------------------------------------------
 mbox_t MboxCreate() {
 	mbox_t available = 0;
+	mbox_lane *ln;
+	int i;
 	while(mbox_structs[available].inuse == 1) { 
 		available++;
 		if(available > MBOX_NUM_MBOXES - 1) {
@@ -60,9 +104,15 @@ mbox_t MboxCreate() {
     	exitsim();
 	}
 
-	if((mbox_structs[available].s_empty = SemCreate(MBOX_MAX_BUFFERS_PER_MBOX-1)) == SYNC_FAIL) {
-		printf("Bad SemCreate in MboxCreate\n"); 
-		exitsim();
+	for(i = 0; i < MBOX_NUM_LANES; i++) {
+		ln = &mbox_structs[available].lanes[i];
+		if((ln->s_empty = SemCreate(ln->size)) == SYNC_FAIL) {
+			printf("Bad SemCreate in MboxCreate\n"); 
+			exitsim();
+		}
+		ln->head = 0;
+		ln->bytes = 0;
+		ln->count = 0;
 	}
 
 	if((mbox_structs[available].s_full = SemCreate(0)) == SYNC_FAIL) {
@@ -70,10 +120,13 @@ mbox_t MboxCreate() {
 		exitsim();
 	}
 
-	if(AQueueInit(&mbox_structs[available].msg) != QUEUE_SUCCESS) {
-		printf("FATAL ERROR: could not initialize message queue in MboxCreate\n");
+	if(((mbox_structs[available].c_bcastData = CondCreate(mbox_structs[available].l)) == SYNC_FAIL) ||
+	   ((mbox_structs[available].c_bcastSpace = CondCreate(mbox_structs[available].l)) == SYNC_FAIL)) {
+		printf("Bad CondCreate in MboxCreate\n");
 		exitsim();
 	}
+
+	bzero((char *)&mbox_structs[available].stats, sizeof(MboxStats));
   
 	return available;
 }
@@ -104,8 +157,9 @@ int MboxOpen(mbox_t handle) {
 		exitsim();
 	}
 
-	mbox_structs[handle].used++;
-	mbox_structs[handle].pids[GetCurrentPid()] = 1;
+	// Opening it twice is the same as opening it once
+	mbox_structs[handle].openMask |= 1 << GetCurrentPid();
+	currentPCB->mboxesOpen |= 1 << handle;
 
 	if(LockHandleRelease(mbox_structs[handle].l) != SYNC_SUCCESS) {
 		printf("Lock unable to be released in MboxOpen in %d \n", GetCurrentPid());
@@ -129,114 +183,380 @@ int MboxOpen(mbox_t handle) {
 //
 //-------------------------------------------------------
 int MboxClose(mbox_t handle) {
-	Link *l;
-
 	if(handle < 0) return MBOX_FAIL;
 	if(handle > MBOX_NUM_MBOXES) return MBOX_FAIL;
 	if(mbox_structs[handle].inuse == 0) return MBOX_FAIL;
+	if(!MBOX_OPENED(&mbox_structs[handle], GetCurrentPid())) return MBOX_FAIL;
 
-	if(LockHandleAcquire(mbox_structs[handle].l) != SYNC_SUCCESS) {
-		printf("Lock unable to be acquired in MboxOpen in %d \n", GetCurrentPid());
+	MboxUnopen(handle, GetCurrentPid());
+	return MBOX_SUCCESS;
+}
+
+//-------------------------------------------------------
+//
+// static void MboxUnopen(mbox_t handle, int pid);
+//
+// Drop pid from the mailbox's open set and the mailbox from
+// pid's.  Once nobody has it open, the mailbox is returned
+// to the set of available mboxes.
+//
+//-------------------------------------------------------
+static void MboxUnopen(mbox_t handle, int pid) {
+	mbox *mb = &mbox_structs[handle];
+	int i;
+	int intrs;
+
+	if(LockHandleAcquire(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be acquired in MboxUnopen in %d \n", GetCurrentPid());
 		exitsim();
 	}
 
-    mbox_structs[handle].used--;
-    mbox_structs[handle].pids[GetCurrentPid()] = 0;
+	mb->openMask &= ~(1 << pid);
+	ProcessFromPid(pid)->mboxesOpen &= ~(1 << handle);
+	// Broadcasts it hasn't read no longer wait for it
+	for (i = 0; i < MBOX_BCAST_SLOTS; i++) {
+		MboxBcastRead(mb, &mb->bcasts[i], pid);
+	}
 
-    if (mbox_structs[handle].used == 0) {
-    	while(!AQueueEmpty(&mbox_structs[handle].msg)) {
-    		l = AQueueFirst(&mbox_structs[handle].msg);
-    		AQueueRemove(&l);
-    	}
-    	mbox_structs[handle].inuse = 0;
-    }
+	if (mb->openMask == 0) {
+		intrs = SpinLock(&mb->sl);
+		for (i = 0; i < MBOX_NUM_LANES; i++) {
+			mb->lanes[i].head = 0;
+			mb->lanes[i].bytes = 0;
+			mb->lanes[i].count = 0;
+		}
+		mb->inuse = 0;
+		SpinUnlock(&mb->sl, intrs);
+	}
 
-    if(LockHandleRelease(mbox_structs[handle].l) != SYNC_SUCCESS) {
-		printf("Lock unable to be released in MboxOpen in %d \n", GetCurrentPid());
+	if(LockHandleRelease(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be released in MboxUnopen in %d \n", GetCurrentPid());
 		exitsim();
 	}
-    return MBOX_SUCCESS;
 }
 
 //-------------------------------------------------------
 //
-// int MboxSend(mbox_t handle,int length, void* message);
+// static void MboxRingPut(mbox *mb, mbox_lane *ln, PCB *pcb, void *from, int n);
+// static void MboxRingGet(mbox_lane *ln, int offset, PCB *pcb, void *to, int n);
+// static void MboxRingDrop(mbox *mb, mbox_lane *ln, int n);
 //
-// Send a message (pointed to by "message") of length
-// "length" bytes to the specified mailbox.  Messages of
-// length 0 are allowed.  The call 
-// blocks when there is not enough space in the mailbox.
-// Messages cannot be longer than MBOX_MAX_MESSAGE_LENGTH.
-// Note that the calling process must have opened the 
-// mailbox via MboxOpen.
+// Byte ring access, for one of mb's lanes.  MboxRingPut
+// appends n bytes after the last message, MboxRingGet
+// copies n bytes starting offset bytes into the oldest
+// message, and MboxRingDrop removes the first n bytes.  The bytes outside the ring are in
+// pcb's address space, or the kernel's if pcb is NULL, so
+// a message moves between the ring and user memory in one
+// copy.  The caller holds the mailbox lock and has made
+// sure the bytes fit (or are there).
 //
-// Returns MBOX_FAIL on failure.
+//-------------------------------------------------------
+static void MboxCopy(PCB *pcb, char *ring, char *data, int n, int toRing) {
+	if (pcb == NULL) {
+		if (toRing) bcopy(data, ring, n);
+		else bcopy(ring, data, n);
+	} else {
+		// Walks the user pages one at a time
+		if (toRing) MemoryCopyUserToSystem(pcb, data, ring, n);
+		else MemoryCopySystemToUser(pcb, ring, data, n);
+	}
+}
+
+static void MboxRingPut(mbox *mb, mbox_lane *ln, PCB *pcb, void *from, int n) {
+	int tail = (ln->head + ln->bytes) % ln->size;
+	int first = ln->size - tail;	// Room before the ring wraps
+	int intrs;
+
+	if (n <= first) {
+		MboxCopy(pcb, &ln->ring[tail], from, n, true);
+	} else {
+		MboxCopy(pcb, &ln->ring[tail], from, first, true);
+		MboxCopy(pcb, ln->ring, (char *)from + first, n - first, true);
+	}
+	intrs = SpinLock(&mb->sl);
+	ln->bytes += n;
+	SpinUnlock(&mb->sl, intrs);
+}
+
+static void MboxRingGet(mbox_lane *ln, int offset, PCB *pcb, void *to, int n) {
+	int start = (ln->head + offset) % ln->size;
+	int first = ln->size - start;
+
+	if (n <= first) {
+		MboxCopy(pcb, &ln->ring[start], to, n, false);
+	} else {
+		MboxCopy(pcb, &ln->ring[start], to, first, false);
+		MboxCopy(pcb, ln->ring, (char *)to + first, n - first, false);
+	}
+}
+
+static void MboxRingDrop(mbox *mb, mbox_lane *ln, int n) {
+	int intrs = SpinLock(&mb->sl);
+
+	ln->head = (ln->head + n) % ln->size;
+	ln->bytes -= n;
+	SpinUnlock(&mb->sl, intrs);
+}
+
+//-------------------------------------------------------
+//
+// static int MboxClaim(sem_t sem, int n, int block, int *blocked);
+//
+// Takes n units from sem: all of them, waiting if block
+// is true, or none at all if they aren't there now and
+// block is false.  The jiffies spent waiting are added
+// to *blocked.
+//
+// Returns MBOX_WOULDBLOCK if it took none.
 // Returns MBOX_SUCCESS on success.
 //
 //-------------------------------------------------------
-int MboxSend(mbox_t handle, int length, void* message) {
-	int i;
-	Link *l;
+static int MboxClaim(sem_t sem, int n, int block, int *blocked) {
+	int intrs;
+	int ret = MBOX_SUCCESS;
+	int jStart;
+
+	if (block) {
+		jStart = ClkGetCurJiffies();
+		if(SemHandleWaitN(sem, n) == SYNC_FAIL) {
+			printf("Bad sem handle wait in MboxClaim\n");
+			exitsim();
+		}
+		*blocked += ClkGetCurJiffies() - jStart;
+		return MBOX_SUCCESS;
+	}
+	intrs = DisableIntrs();
+	if (SemHandleAvailable(sem) < n) {
+		ret = MBOX_WOULDBLOCK;
+	} else {
+		SemHandleTake(sem, n);
+	}
+	RestoreIntrs(intrs);
+	return ret;
+}
+
+//-------------------------------------------------------
+//
+// static int MboxSendRecord(mbox_t handle, int block, int ispage, int priority,
+//                           PCB *pcb, void *payload, int msize);
+//
+// Queue one record in the lane for priority: an mbox_record
+// saying msize and ispage, then msize bytes from payload,
+// in pcb's address space (or the kernel's if pcb is NULL).
+// Waits for room in that lane's ring unless block is false.  The calling process must
+// have opened the mailbox.
+//
+// Returns MBOX_FAIL on failure, and MBOX_WOULDBLOCK if
+// there is no room and block is false.
+// Returns MBOX_SUCCESS on success.
+//
+//-------------------------------------------------------
+static int MboxSendRecord(mbox_t handle, int block, int ispage, int priority, PCB *pcb, void *payload, int msize) {
+	mbox *mb;
+	mbox_lane *ln;
+	mbox_record r;
+	int ret;
+	int intrs;
 	int cpid = GetCurrentPid();
 
-	if (length <= 0) return MBOX_FAIL;
 	if (handle < 0) return MBOX_FAIL;
 	if (handle > MBOX_NUM_MBOXES) return MBOX_FAIL;
-	if (length > MBOX_MAX_MESSAGE_LENGTH) return MBOX_FAIL;
 
-	if(mbox_structs[handle].pids[cpid] == 0) {
+	if(!MBOX_OPENED(&mbox_structs[handle], cpid)) {
 		return MBOX_FAIL;
 	}
+	mb = &mbox_structs[handle];
+	ln = &mb->lanes[priority];
 
-	if(SemHandleWait(mbox_structs[handle].s_empty) == SYNC_FAIL) {
-		printf("Bad sem handle wait in MboxSend\n");
-		exitsim();
+	// s_empty counts free bytes, so once it lets us through the
+	// record fits after the lane's last message
+	if ((ret = MboxClaim(ln->s_empty, sizeof(mbox_record) + msize, block, &mb->stats.sendBlocked)) != MBOX_SUCCESS) {
+		return ret;
 	}
 
-	if(LockHandleAcquire(mbox_structs[handle].l) != SYNC_SUCCESS) {
+	if(LockHandleAcquire(mb->l) != SYNC_SUCCESS) {
 		printf("Lock unable to be acquired in MboxSend in %d \n", GetCurrentPid());
 		exitsim();
 	}
 
-	for(i=0; i < MBOX_NUM_BUFFERS; i++) {
-		if(mbox_mess_structs[i].inuse == 0) {
-			mbox_mess_structs[i].inuse = 1;
-			break;
-		}
-	}
+	r.msize = msize;
+	r.ispage = ispage;
+	MboxRingPut(mb, ln, NULL, &r, sizeof(mbox_record));
+	MboxRingPut(mb, ln, pcb, payload, msize);
+	intrs = SpinLock(&mb->sl);
+	ln->count++;
+	MboxStatsSent(mb, 1, ispage ? ((mbox_page_record *)payload)->length : msize);
+	if (priority == MBOX_PRIO_HIGH) mb->stats.highSends++;
+	SpinUnlock(&mb->sl, intrs);
 
-	bcopy(message, mbox_mess_structs[i].message, length);
-	mbox_mess_structs[i].msize = length;
-	mbox_mess_structs[i].inuse = 1;
+	if(LockHandleRelease(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be released in MboxSend in %d \n", GetCurrentPid());
+		exitsim();
+	}
 
-	if ((l = AQueueAllocLink(&mbox_mess_structs[i])) == NULL) {
-		printf("ERROR: could not allocate link for message in MboxSend\n");
+	if(SemHandleSignal(mb->s_full) == SYNC_FAIL) {
+		printf("Bad sem signal wait in MboxSend\n");
 		exitsim();
 	}
+	MboxWakeSelectors();
+	return MBOX_SUCCESS;
+}
 
-	AQueueInsertLast(&mbox_structs[handle].msg, l);
+//-------------------------------------------------------
+//
+// static int MboxRecvBegin(mbox_t handle, int block, mbox_record *r, mbox_lane **ln);
+// static void MboxRecvEnd(mbox_t handle, mbox_lane *ln, mbox_record *r, int taken);
+//
+// MboxRecvBegin waits for a message (unless block is
+// false, when it gives up if there is none), locks the
+// mailbox, sets *ln to the lane to take from (the high
+// priority one if it has anything) and copies that lane's
+// oldest message's header into *r; MboxRingGet can then
+// read its bytes.  MboxRecvEnd
+// unlocks the mailbox again, removing that message if
+// taken is true and leaving it for another receiver
+// otherwise.  The calling process must have opened the
+// mailbox.
+//
+// MboxRecvBegin returns MBOX_FAIL on failure, and
+// MBOX_WOULDBLOCK if the mailbox is empty and block is false.
+// Returns MBOX_SUCCESS on success.
+//
+//-------------------------------------------------------
+static int MboxRecvBegin(mbox_t handle, int block, mbox_record *r, mbox_lane **ln) {
+	int ret;
+	int cpid = GetCurrentPid();
 
-	if(LockHandleRelease(mbox_structs[handle].l) != SYNC_SUCCESS) {
-		printf("Lock unable to be released in MboxSend in %d \n", GetCurrentPid());
-		exitsim();
+	if (handle < 0) return MBOX_FAIL;
+	if (handle > MBOX_NUM_MBOXES) return MBOX_FAIL;
+	if (!MBOX_OPENED(&mbox_structs[handle], cpid)) {
+		return MBOX_FAIL;
 	}
 
-	if(SemHandleSignal(mbox_structs[handle].s_full) == SYNC_FAIL) {
-		printf("Bad sem signal wait in MboxSend\n");
+	if ((ret = MboxClaim(mbox_structs[handle].s_full, 1, block, &mbox_structs[handle].stats.recvBlocked)) != MBOX_SUCCESS) {
+		return ret;
+	}
+
+	if(LockHandleAcquire(mbox_structs[handle].l) != SYNC_SUCCESS) {
+		printf("Lock unable to be acquired in MboxRecv in %d \n", GetCurrentPid());
 		exitsim();
 	}
 
+	if(MBOX_DEPTH(&mbox_structs[handle]) == 0) {
+		printf("Que empty\n");
+	}
+
+	*ln = MBOX_RECV_LANE(&mbox_structs[handle]);
+	MboxRingGet(*ln, 0, NULL, r, sizeof(mbox_record));
 	return MBOX_SUCCESS;
 }
 
+static void MboxRecvEnd(mbox_t handle, mbox_lane *ln, mbox_record *r, int taken) {
+	mbox *mb = &mbox_structs[handle];
+	int size = sizeof(mbox_record) + r->msize;
+	int intrs;
+
+	if (taken) {
+		MboxRingDrop(mb, ln, size);
+		intrs = SpinLock(&mb->sl);
+		ln->count--;
+		mb->stats.recvs++;
+		SpinUnlock(&mb->sl, intrs);
+	}
+
+	if(LockHandleRelease(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be released in MboxRecv in %d \n", GetCurrentPid());
+		exitsim();
+	}
+
+	if (taken) {
+		if(SemHandleSignalN(ln->s_empty, size) == SYNC_FAIL) {
+			printf("Bad sem signal wait in MboxRecv\n");
+			exitsim();
+		}
+	} else {
+		if(SemHandleSignal(mb->s_full) == SYNC_FAIL) {
+			printf("Bad sem signal wait in MboxRecv\n");
+			exitsim();
+		}
+		// A message left behind is readable again
+		MboxWakeSelectors();
+	}
+}
+
 //-------------------------------------------------------
 //
-// int MboxRecv(mbox_t handle, int maxlength, void* message);
+// int MboxSend(mbox_t handle, PCB *pcb, int length, void* message);
 //
-// Receive a message from the specified mailbox.  The call 
+// Send a message (pointed to by "message", in pcb's address
+// space, or the kernel's if pcb is NULL) of length "length"
+// bytes to the specified mailbox.  Messages of
+// length 0 are allowed.  The call 
+// blocks when there is not enough space in the mailbox.
+// Messages cannot be longer than MBOX_MAX_MESSAGE_LENGTH.
+// Note that the calling process must have opened the 
+// mailbox via MboxOpen.
+//
+// Returns MBOX_FAIL on failure.
+// Returns MBOX_SUCCESS on success.
+//
+//-------------------------------------------------------
+int MboxSend(mbox_t handle, PCB *pcb, int length, void* message) {
+	return MboxSendCopy(handle, pcb, length, message, MBOX_PRIO_NORMAL, true);
+}
+
+//-------------------------------------------------------
+//
+// int MboxSendPriority(mbox_t handle, PCB *pcb, int length, void* message, int priority);
+//
+// Like MboxSend, but in the lane for priority, one of the
+// MBOX_PRIO_*s.  MboxSendPriority(..., MBOX_PRIO_NORMAL)
+// is MboxSend.  A MBOX_PRIO_HIGH message is received
+// ahead of every normal one already queued, and only
+// waits for room among the MBOX_HIGH_RING_BYTES set aside
+// for high priority messages, however full the mailbox
+// is of normal ones.
+//
+// Returns MBOX_FAIL on failure.
+// Returns MBOX_SUCCESS on success.
+//
+//-------------------------------------------------------
+int MboxSendPriority(mbox_t handle, PCB *pcb, int length, void* message, int priority) {
+	if ((priority < 0) || (priority >= MBOX_NUM_LANES)) return MBOX_FAIL;
+
+	return MboxSendCopy(handle, pcb, length, message, priority, true);
+}
+
+//-------------------------------------------------------
+//
+// int MboxTrySend(mbox_t handle, PCB *pcb, int length, void* message);
+//
+// Like MboxSend, but returns MBOX_WOULDBLOCK at once
+// instead of waiting when the mailbox is full.
+//
+//-------------------------------------------------------
+int MboxTrySend(mbox_t handle, PCB *pcb, int length, void* message) {
+	return MboxSendCopy(handle, pcb, length, message, MBOX_PRIO_NORMAL, false);
+}
+
+static int MboxSendCopy(mbox_t handle, PCB *pcb, int length, void* message, int priority, int block) {
+	if (length <= 0) return MBOX_FAIL;
+	if (length > MBOX_MAX_MESSAGE_LENGTH) return MBOX_FAIL;
+
+	return MboxSendRecord(handle, block, false, priority, pcb, message, length);
+}
+
+//-------------------------------------------------------
+//
+// int MboxRecv(mbox_t handle, PCB *pcb, int maxlength, void* message);
+//
+// Receive a message from the specified mailbox: the oldest
+// high priority one if there is any (see MboxSendPriority),
+// otherwise the oldest.  The call 
 // blocks when there is no message in the buffer.  Maxlength
 // should indicate the maximum number of bytes that can be
-// copied from the buffer into the address of "message".  
+// copied from the buffer into the address of "message",
+// in pcb's address space or the kernel's if pcb is NULL.
 // An error occurs if the message is larger than maxlength.
 // Note that the calling process must have opened the mailbox 
 // via MboxOpen.
@@ -245,100 +565,575 @@ int MboxSend(mbox_t handle, int length, void* message) {
 // Returns number of bytes written into message on success.
 //
 //-------------------------------------------------------
-int MboxRecv(mbox_t handle, int maxlength, void* message) {
-	Link *l;
-	mbox_message *m;
+int MboxRecv(mbox_t handle, PCB *pcb, int maxlength, void* message) {
+	return MboxRecvCopy(handle, pcb, maxlength, message, true);
+}
+
+//-------------------------------------------------------
+//
+// int MboxTryRecv(mbox_t handle, PCB *pcb, int maxlength, void* message);
+//
+// Like MboxRecv, but returns MBOX_WOULDBLOCK at once
+// instead of waiting when the mailbox is empty.
+//
+//-------------------------------------------------------
+int MboxTryRecv(mbox_t handle, PCB *pcb, int maxlength, void* message) {
+	return MboxRecvCopy(handle, pcb, maxlength, message, false);
+}
+
+static int MboxRecvCopy(mbox_t handle, PCB *pcb, int maxlength, void* message, int block) {
+	mbox_record r;
+	mbox_lane *ln;
+	int ret;
+
+	if ((ret = MboxRecvBegin(handle, block, &r, &ln)) != MBOX_SUCCESS) return ret;
+
+	if (r.ispage) {
+		// Leave it for MboxRecvPage
+		MboxRecvEnd(handle, ln, &r, false);
+		return MBOX_FAIL;
+	}
+
+	if(r.msize > maxlength) {
+		printf("ERROR: msize (%d) > maxlength (%d)\n", r.msize, maxlength);
+		// Leave the message for a receiver with room for it
+		MboxRecvEnd(handle, ln, &r, false);
+		return MBOX_FAIL;
+	}
+
+	MboxRingGet(ln, sizeof(mbox_record), pcb, message, r.msize);
+	MboxRecvEnd(handle, ln, &r, true);
+
+	return r.msize;
+}
+
+//-------------------------------------------------------
+//
+// int MboxSendPage(mbox_t handle, uint32 page, int length);
+//
+// Send the first "length" bytes of shared page "page" (a
+// handle from MemoryCreateSharedPage, which the sender has
+// mapped) without copying them.  Only the handle goes in
+// the mailbox; the receiver maps the page, and the sender
+// loses its mapping, when MboxRecvPage takes the message.
+// The sender should not touch the page after this, and must
+// not exit before the message is received, or the page may
+// be freed with the rest of its memory.
+//
+// Returns MBOX_FAIL on failure.
+// Returns MBOX_SUCCESS on success.
+//
+//-------------------------------------------------------
+int MboxSendPage(mbox_t handle, uint32 page, int length) {
+	mbox_page_record p;
+
+	if (length < 0) return MBOX_FAIL;
+	if (length > MEMORY_PAGE_SIZE) return MBOX_FAIL;
+
+	p.page = page;
+	p.length = length;
+	p.sender = GetCurrentPid();
+	return MboxSendRecord(handle, true, true, MBOX_PRIO_NORMAL, NULL, &p, sizeof(p));
+}
+
+//-------------------------------------------------------
+//
+// void *MboxRecvPage(mbox_t handle, int *length);
+//
+// Receive a page sent with MboxSendPage: map it into the
+// receiver, drop the sender's mapping of it, and set
+// *length to the number of bytes the sender put in it.
+// Fails, leaving the message queued, if the oldest
+// message in the mailbox is an ordinary one.
+//
+// Returns NULL on failure.
+// Returns the page's address in the receiver on success.
+//
+//-------------------------------------------------------
+void *MboxRecvPage(mbox_t handle, int *length) {
+	mbox_record r;
+	mbox_lane *ln;
+	mbox_page_record p;
+	void *addr;
+	PCB *sender;
+
+	if (MboxRecvBegin(handle, true, &r, &ln) != MBOX_SUCCESS) return NULL;
+
+	if (!r.ispage) {
+		// Leave it for MboxRecv
+		MboxRecvEnd(handle, ln, &r, false);
+		return NULL;
+	}
+	MboxRingGet(ln, sizeof(mbox_record), NULL, &p, sizeof(p));
+
+	// Map it here before the sender lets go, so that the page always
+	// has an owner
+	if ((addr = mmap(currentPCB, p.page)) == NULL) {
+		printf("MboxRecvPage: could not map shared page 0x%x\n", p.page);
+		MboxRecvEnd(handle, ln, &r, true);
+		return NULL;
+	}
+	if ((sender = ProcessFromPid(p.sender)) != NULL) {
+		MemoryFreeSharedPage(sender, p.page);
+	}
+	*length = p.length;
+	MboxRecvEnd(handle, ln, &r, true);
+
+	return addr;
+}
+
+//-------------------------------------------------------
+//
+// int MboxSendMany(mbox_t handle, PCB *pcb, int count, int length, void *messages);
+//
+// Send "count" messages of "length" bytes each, stored
+// one after another at "messages" (in pcb's address space,
+// or the kernel's if pcb is NULL), as if by that many
+// MboxSends but with one semaphore wait, one hold of the
+// lock and one semaphore signal.  Blocks until there is
+// room for all of them, so they must fit in the mailbox's
+// normal lane together: count * (length + sizeof(mbox_record)) can be
+// at most MBOX_RING_BYTES (checked by division, so that a huge count
+// can't wrap the product).
+//
+// Returns MBOX_FAIL on failure.
+// Returns count on success.
+//
+//-------------------------------------------------------
+int MboxSendMany(mbox_t handle, PCB *pcb, int count, int length, void *messages) {
+	mbox *mb;
+	mbox_lane *ln;
+	mbox_record r;
+	int i;
+	int intrs;
 	int cpid = GetCurrentPid();
 
+	if (count <= 0) return MBOX_FAIL;
+	if (length <= 0) return MBOX_FAIL;
+	if (length > MBOX_MAX_MESSAGE_LENGTH) return MBOX_FAIL;
+	if (count > MBOX_RING_BYTES / (length + sizeof(mbox_record))) return MBOX_FAIL;
 	if (handle < 0) return MBOX_FAIL;
 	if (handle > MBOX_NUM_MBOXES) return MBOX_FAIL;
-	if (mbox_structs[handle].pids[cpid] == 0) {
+	if (!MBOX_OPENED(&mbox_structs[handle], cpid)) {
 		return MBOX_FAIL;
 	}
+	mb = &mbox_structs[handle];
+	ln = &mb->lanes[MBOX_PRIO_NORMAL];
 
-	if(SemHandleWait(mbox_structs[handle].s_full) == SYNC_FAIL) {
-		printf("Bad sem handle wait in MboxSend\n");
+	MboxClaim(ln->s_empty, count * (length + sizeof(mbox_record)), true, &mb->stats.sendBlocked);
+
+	if(LockHandleAcquire(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be acquired in MboxSendMany in %d \n", GetCurrentPid());
 		exitsim();
 	}
 
-	if(LockHandleAcquire(mbox_structs[handle].l) != SYNC_SUCCESS) {
-		printf("Lock unable to be acquired in MboxRecv in %d \n", GetCurrentPid());
+	r.msize = length;
+	r.ispage = false;
+	for (i = 0; i < count; i++) {
+		MboxRingPut(mb, ln, NULL, &r, sizeof(mbox_record));
+		MboxRingPut(mb, ln, pcb, (char *)messages + i * length, length);
+		intrs = SpinLock(&mb->sl);
+		ln->count++;
+		SpinUnlock(&mb->sl, intrs);
+	}
+	intrs = SpinLock(&mb->sl);
+	MboxStatsSent(mb, count, count * length);
+	SpinUnlock(&mb->sl, intrs);
+
+	if(LockHandleRelease(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be released in MboxSendMany in %d \n", GetCurrentPid());
 		exitsim();
 	}
 
-	if(AQueueEmpty(&mbox_structs[handle].msg)) {
-		printf("Que empty\n");
+	if(SemHandleSignalN(mb->s_full, count) == SYNC_FAIL) {
+		printf("Bad sem signal in MboxSendMany\n");
+		exitsim();
 	}
+	MboxWakeSelectors();
 
-	l = AQueueFirst(&mbox_structs[handle].msg);
-	m = (mbox_message *) l->object;
+	return count;
+}
 
-	if(m->msize > maxlength) {
-		printf("ERROR: msize (%d) > maxlength (%d)\n", m->msize, maxlength);
+//-------------------------------------------------------
+//
+// int MboxRecvMany(mbox_t handle, PCB *pcb, int maxcount, int length, void *messages);
+//
+// Receive up to "maxcount" messages into "messages" (in
+// pcb's address space, or the kernel's if pcb is NULL), the
+// i'th at byte i * length.  Blocks until there is at least
+// one message, then takes as many more as are there
+// without waiting again, high priority ones first as with
+// MboxRecv.  Stops early at a message longer
+// than "length" or one sent with MboxSendPage, and leaves
+// it in the mailbox.  Note that the lengths of the
+// individual messages are not returned: this is meant for
+// fixed-size records.
+//
+// Returns MBOX_FAIL on failure.
+// Returns the number of messages received on success.
+//
+//-------------------------------------------------------
+int MboxRecvMany(mbox_t handle, PCB *pcb, int maxcount, int length, void *messages) {
+	mbox *mb;
+	mbox_lane *ln;
+	mbox_record r;
+	int claimed;	// Messages s_full let us have
+	int n;			// Messages received
+	int freed[MBOX_NUM_LANES] = { 0, 0 };	// Bytes they took up, by lane
+	int i;
+	int intrs;
+	int cpid = GetCurrentPid();
+
+	if (maxcount <= 0) return MBOX_FAIL;
+	if (length <= 0) return MBOX_FAIL;
+	if (handle < 0) return MBOX_FAIL;
+	if (handle > MBOX_NUM_MBOXES) return MBOX_FAIL;
+	if (!MBOX_OPENED(&mbox_structs[handle], cpid)) {
 		return MBOX_FAIL;
 	}
+	mb = &mbox_structs[handle];
 
-	bcopy(m->message, message, m->msize);
+	MboxClaim(mb->s_full, 1, true, &mb->stats.recvBlocked);
+	claimed = 1 + SemHandleTake(mb->s_full, maxcount - 1);
 
-	m->inuse = 0;
+	if(LockHandleAcquire(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be acquired in MboxRecvMany in %d \n", GetCurrentPid());
+		exitsim();
+	}
 
-	AQueueRemove(&l);
+	for (n = 0; n < claimed; n++) {
+		ln = MBOX_RECV_LANE(mb);
+		MboxRingGet(ln, 0, NULL, &r, sizeof(mbox_record));
+		if (r.ispage || (r.msize > length)) break;
+		MboxRingGet(ln, sizeof(mbox_record), pcb, (char *)messages + n * length, r.msize);
+		MboxRingDrop(mb, ln, sizeof(mbox_record) + r.msize);
+		freed[ln - mb->lanes] += sizeof(mbox_record) + r.msize;
+		intrs = SpinLock(&mb->sl);
+		ln->count--;
+		SpinUnlock(&mb->sl, intrs);
+	}
+	intrs = SpinLock(&mb->sl);
+	mb->stats.recvs += n;
+	SpinUnlock(&mb->sl, intrs);
 
-	if(LockHandleRelease(mbox_structs[handle].l) != SYNC_SUCCESS) {
-		printf("Lock unable to be released in MboxSend in %d \n", GetCurrentPid());
+	if(LockHandleRelease(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be released in MboxRecvMany in %d \n", GetCurrentPid());
 		exitsim();
 	}
 
-	if(SemHandleSignal(mbox_structs[handle].s_empty) == SYNC_FAIL) {
-		printf("Bad sem signal wait in MboxSend\n");
-		exitsim();
+	// Give back what we left, and make room for what we took
+	if (n < claimed) {
+		if (SemHandleSignalN(mb->s_full, claimed - n) == SYNC_FAIL) {
+			printf("Bad sem signal in MboxRecvMany\n");
+			exitsim();
+		}
+		MboxWakeSelectors();
+	}
+	for (i = 0; i < MBOX_NUM_LANES; i++) {
+		if ((freed[i] > 0) && (SemHandleSignalN(mb->lanes[i].s_empty, freed[i]) == SYNC_FAIL)) {
+			printf("Bad sem signal in MboxRecvMany\n");
+			exitsim();
+		}
 	}
 
-	return m->msize;
+	return (n > 0) ? n : MBOX_FAIL;
+}
+
+//-------------------------------------------------------
+//
+// static void MboxWakeSelectors();
+//
+// Wakes every process blocked in MboxSelect.
+//
+//-------------------------------------------------------
+static void MboxWakeSelectors() {
+	Link *l;
+	PCB *pcb;
+	int intrs;
 
+	intrs = DisableIntrs();
+	while (!AQueueEmpty(&mbox_select_waiting)) {
+		l = AQueueFirst(&mbox_select_waiting);
+		pcb = (PCB *)AQueueObject(l);
+		if (AQueueRemove(&l) != QUEUE_SUCCESS) {
+			printf("FATAL ERROR: could not remove link from select queue in MboxWakeSelectors!\n");
+			exitsim();
+		}
+		ProcessWakeup(pcb);
+	}
+	RestoreIntrs(intrs);
 }
 
-//--------------------------------------------------------------------------------
-// 
-// int MboxCloseAllByPid(int pid);
+//-------------------------------------------------------
+//
+// mbox_t MboxSelect(mbox_t *handles, int n, int timeout);
 //
-// Scans through all mailboxes and removes this pid from their "open procs" list.
-// If this was the only open process, then it makes the mailbox available.  Call
-// this function in ProcessFreeResources in process.c.
+// Wait until one of the n mailboxes in handles has a
+// message that MboxRecv or MboxTryRecv could take without
+// blocking, and return its handle.  The lowest-numbered
+// entry in handles wins a tie.  timeout is in milliseconds:
+// 0 just polls, and a negative timeout waits for ever.
+// The calling process must have opened all of the mailboxes.
 //
 // Returns MBOX_FAIL on failure.
-// Returns MBOX_SUCCESS on success.
+// Returns MBOX_TIMEOUT if nothing arrived in time.
+// Returns a handle from handles on success.
 //
-//--------------------------------------------------------------------------------
-int MboxCloseAllByPid(int pid) {
+//-------------------------------------------------------
+mbox_t MboxSelect(mbox_t *handles, int n, int timeout) {
 	int i;
+	int jDeadline = 0;
+	int intrs;
 	Link *l;
-	if (pid < 0) return MBOX_FAIL;
-	if (pid > MBOX_NUM_MBOXES) return MBOX_FAIL;
+	int cpid = GetCurrentPid();
 
-	for(i=0; i < MBOX_NUM_MBOXES; i++) {
-		if (mbox_structs[i].pids[pid] == 1) {
+	if (n <= 0) return MBOX_FAIL;
+	if (n > MBOX_NUM_MBOXES) return MBOX_FAIL;
+	for (i = 0; i < n; i++) {
+		if (handles[i] < 0) return MBOX_FAIL;
+		if (handles[i] >= MBOX_NUM_MBOXES) return MBOX_FAIL;
+		if (!MBOX_OPENED(&mbox_structs[handles[i]], cpid)) return MBOX_FAIL;
+	}
+	if (timeout > 0) {
+		jDeadline = ClkGetCurJiffies() + timeout * JIFFIES_PER_SECOND / 1000;
+	}
 
-			if(LockHandleAcquire(mbox_structs[i].l) != SYNC_SUCCESS) {
-				printf("Lock unable to be acquired in MboxOpen in %d \n", GetCurrentPid());
-				exitsim();
+	// Interrupts stay off from the check to the sleep, so a send
+	// can't slip in between and leave us asleep
+	intrs = DisableIntrs();
+	while (1) {
+		for (i = 0; i < n; i++) {
+			if (SemHandleAvailable(mbox_structs[handles[i]].s_full) > 0) {
+				RestoreIntrs(intrs);
+				return handles[i];
 			}
+		}
+		if ((timeout == 0) || ((timeout > 0) && (ClkGetCurJiffies() - jDeadline >= 0))) {
+			RestoreIntrs(intrs);
+			return MBOX_TIMEOUT;
+		}
+		l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
+		if (AQueueInsertLast(&mbox_select_waiting, l) != QUEUE_SUCCESS) {
+			printf("FATAL ERROR: could not insert link into select queue in MboxSelect!\n");
+			exitsim();
+		}
+		if (timeout < 0) {
+			ProcessSleep();
+		} else {
+			ProcessSleepUntil(jDeadline);
+		}
+	}
+}
+
+//-------------------------------------------------------
+//
+// static void MboxStatsSent(mbox *mb, int n, int bytes);
+//
+// Counts n messages with bytes of payload just queued in
+// mb, and the depths they took it to.  The caller holds
+// the mailbox lock and its spinlock.
+//
+//-------------------------------------------------------
+static void MboxStatsSent(mbox *mb, int n, int bytes) {
+	mb->stats.sends += n;
+	mb->stats.bytesMoved += bytes;
+	if (MBOX_DEPTH(mb) > mb->stats.peakDepth) mb->stats.peakDepth = MBOX_DEPTH(mb);
+	if (MBOX_BYTES(mb) > mb->stats.peakBytes) mb->stats.peakBytes = MBOX_BYTES(mb);
+}
 
-			mbox_structs[i].pids[pid] = 0;
+//-------------------------------------------------------
+//
+// int MboxGetStats(mbox_t handle, MboxStats *stats);
+//
+// Copies the queue metrics of the mailbox into stats.
+// Any process may read them, whether or not it has the
+// mailbox open.
+//
+// Returns MBOX_FAIL on failure.
+// Returns MBOX_SUCCESS on success.
+//
+//-------------------------------------------------------
+int MboxGetStats(mbox_t handle, MboxStats *stats) {
+	mbox *mb;
+	int intrs;
 
-			if (mbox_structs[i].used == 0) {
-				while(!AQueueEmpty(&mbox_structs[i].msg)) {
-					l = AQueueFirst(&mbox_structs[i].msg);
-					AQueueRemove(&l);
-				}
-				mbox_structs[i].inuse = 0;
-			}
+	if (handle < 0) return MBOX_FAIL;
+	if (handle >= MBOX_NUM_MBOXES) return MBOX_FAIL;
+	mb = &mbox_structs[handle];
+	if (mb->inuse == 0) return MBOX_FAIL;
 
-			if(LockHandleRelease(mbox_structs[i].l) != SYNC_SUCCESS) {
-				printf("Lock unable to be released in MboxOpen in %d \n", GetCurrentPid());
-				exitsim();
-			}
+	// The spinlock rather than l, so a stuck sender can't keep
+	// us from looking
+	intrs = SpinLock(&mb->sl);
+	bcopy((char *)&mb->stats, (char *)stats, sizeof(MboxStats));
+	stats->depth = MBOX_DEPTH(mb);
+	stats->bytes = MBOX_BYTES(mb);
+	SpinUnlock(&mb->sl, intrs);
+	return MBOX_SUCCESS;
+}
+
+//-------------------------------------------------------
+//
+// static void MboxBcastRead(mbox *mb, mbox_bcast *b, int pid);
+//
+// Marks broadcast b as read by pid, freeing its slot if
+// pid was the last opener that hadn't read it.  The
+// caller holds the mailbox lock.
+//
+//-------------------------------------------------------
+static void MboxBcastRead(mbox *mb, mbox_bcast *b, int pid) {
+	if (((b->unread >> pid) & 1) == 0) return;
+	b->unread &= ~(1 << pid);
+	if (b->unread == 0) {
+		CondHandleBroadcast(mb->c_bcastSpace);
+	}
+}
+
+//-------------------------------------------------------
+//
+// int MboxBroadcast(mbox_t handle, PCB *pcb, int length, void* message);
+//
+// Send a message (in pcb's address space, or the kernel's
+// if pcb is NULL) to every process that has the mailbox
+// open, except the sender.  The bytes are copied once, into
+// one of the mailbox's MBOX_BCAST_SLOTS broadcast slots,
+// which is freed when the last of those processes has taken
+// it with MboxRecvBroadcast or closed the mailbox.  Blocks
+// while all the slots are in use.  Broadcasts don't go
+// through the message ring: MboxRecv doesn't see them.
+//
+// Returns MBOX_FAIL on failure.
+// Returns the number of processes it went to on success.
+//
+//-------------------------------------------------------
+int MboxBroadcast(mbox_t handle, PCB *pcb, int length, void* message) {
+	mbox *mb;
+	mbox_bcast *b;
+	int i, n;
+	int intrs;
+	int cpid = GetCurrentPid();
+
+	if (length <= 0) return MBOX_FAIL;
+	if (length > MBOX_MAX_MESSAGE_LENGTH) return MBOX_FAIL;
+	if (handle < 0) return MBOX_FAIL;
+	if (handle >= MBOX_NUM_MBOXES) return MBOX_FAIL;
+	mb = &mbox_structs[handle];
+	if (!MBOX_OPENED(mb, cpid)) return MBOX_FAIL;
+
+	if(LockHandleAcquire(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be acquired in MboxBroadcast in %d \n", GetCurrentPid());
+		exitsim();
+	}
+
+	while (1) {
+		for (i = 0; i < MBOX_BCAST_SLOTS; i++) {
+			if (mb->bcasts[i].unread == 0) break;
 		}
+		if (i < MBOX_BCAST_SLOTS) break;
+		CondHandleWait(mb->c_bcastSpace);
+	}
+	b = &mb->bcasts[i];
+
+	b->unread = mb->openMask & ~(1 << cpid);
+	for (n = 0, i = 0; i < PROCESS_MAX_PROCS; i++) {
+		n += (b->unread >> i) & 1;
+	}
+	if (n > 0) {
+		MboxCopy(pcb, b->data, message, length, true);
+		b->length = length;
+		b->seq = mb->bcastSeq++;
+		intrs = SpinLock(&mb->sl);
+		MboxStatsSent(mb, 1, length);
+		SpinUnlock(&mb->sl, intrs);
+		CondHandleBroadcast(mb->c_bcastData);
+	}
+
+	if(LockHandleRelease(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be released in MboxBroadcast in %d \n", GetCurrentPid());
+		exitsim();
+	}
+	return n;
+}
+
+//-------------------------------------------------------
+//
+// int MboxRecvBroadcast(mbox_t handle, PCB *pcb, int maxlength, void* message);
+//
+// Receive the oldest broadcast on the mailbox that the
+// calling process hasn't read yet, waiting if there is
+// none.  Like MboxRecv, it fails and leaves the broadcast
+// unread if it is longer than maxlength.
+//
+// Returns MBOX_FAIL on failure.
+// Returns number of bytes written into message on success.
+//
+//-------------------------------------------------------
+int MboxRecvBroadcast(mbox_t handle, PCB *pcb, int maxlength, void* message) {
+	mbox *mb;
+	mbox_bcast *b;
+	int i, ret;
+	int intrs;
+	int cpid = GetCurrentPid();
+
+	if (handle < 0) return MBOX_FAIL;
+	if (handle >= MBOX_NUM_MBOXES) return MBOX_FAIL;
+	mb = &mbox_structs[handle];
+	if (!MBOX_OPENED(mb, cpid)) return MBOX_FAIL;
+
+	if(LockHandleAcquire(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be acquired in MboxRecvBroadcast in %d \n", GetCurrentPid());
+		exitsim();
+	}
+
+	while (1) {
+		b = NULL;
+		for (i = 0; i < MBOX_BCAST_SLOTS; i++) {
+			if (((mb->bcasts[i].unread >> cpid) & 1) == 0) continue;
+			if ((b == NULL) || (mb->bcasts[i].seq - b->seq < 0)) b = &mb->bcasts[i];
+		}
+		if (b != NULL) break;
+		CondHandleWait(mb->c_bcastData);
+	}
+
+	if (b->length > maxlength) {
+		ret = MBOX_FAIL;
+	} else {
+		MboxCopy(pcb, b->data, message, b->length, false);
+		ret = b->length;
+		intrs = SpinLock(&mb->sl);
+		mb->stats.recvs++;
+		SpinUnlock(&mb->sl, intrs);
+		MboxBcastRead(mb, b, cpid);
+	}
+
+	if(LockHandleRelease(mb->l) != SYNC_SUCCESS) {
+		printf("Lock unable to be released in MboxRecvBroadcast in %d \n", GetCurrentPid());
+		exitsim();
+	}
+	return ret;
+}
+
+//--------------------------------------------------------------------------------
+// 
+// int MboxCloseAllByPid(int pid);
+//
+// Closes every mailbox this pid has open, going by the PCB's mboxesOpen bits
+// rather than looking at every mailbox.  If this was the only open process, then
+// it makes the mailbox available.  Call this function in ProcessFreeResources in
+// process.c.
+//
+// Returns MBOX_FAIL on failure.
+// Returns MBOX_SUCCESS on success.
+//
+//--------------------------------------------------------------------------------
+int MboxCloseAllByPid(int pid) {
+	PCB *pcb = ProcessFromPid(pid);
+	uint32 open;
+
+	if (pcb == NULL) return MBOX_FAIL;
+
+	while ((open = pcb->mboxesOpen) != 0) {
+		MboxUnopen(FindFirstSet(open), pid);
 	}
 	return MBOX_SUCCESS;
 }
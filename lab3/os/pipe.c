@@ -0,0 +1,203 @@
+//
+//	pipe.c
+//
+//	Kernel pipes.  Readers and writers block on the pipe's condition
+//	variables, and move as many bytes as they can each time they get
+//	the lock, so a stream costs a trap per buffer-full rather than per
+//	byte.
+//
+
+#include "ostraps.h"
+#include "dlxos.h"
+#include "process.h"
+#include "memory.h"
+#include "synch.h"
+#include "pipe.h"
+
+static Pipe pipes[MAX_PIPES];   // All pipes in the system
+
+//----------------------------------------------------------------------
+//	PipeModuleInit
+//
+//	Marks every pipe free.  Called at boot.
+//----------------------------------------------------------------------
+void PipeModuleInit() {
+  int i;
+
+  for (i = 0; i < MAX_PIPES; i++) {
+    pipes[i].inuse = 0;
+  }
+}
+
+//----------------------------------------------------------------------
+//	PipeCreate
+//
+//	Grabs an empty pipe for the calling process.  Returns its handle,
+//	or PIPE_FAIL if there are none left.
+//----------------------------------------------------------------------
+pipe_t PipeCreate() {
+  pipe_t p;
+  uint32 intrval;
+
+  intrval = DisableIntrs();
+  for (p = 0; p < MAX_PIPES; p++) {
+    if (!pipes[p].inuse) {
+      pipes[p].inuse = 1;
+      break;
+    }
+  }
+  RestoreIntrs(intrval);
+  if (p == MAX_PIPES) return PIPE_FAIL;
+
+  if ((pipes[p].lock = LockCreate()) == SYNC_FAIL) {
+    pipes[p].inuse = 0;
+    return PIPE_FAIL;
+  }
+  if ((pipes[p].notEmpty = CondCreate(pipes[p].lock)) == SYNC_FAIL) {
+    LockHandleDestroy(pipes[p].lock);
+    pipes[p].inuse = 0;
+    return PIPE_FAIL;
+  }
+  if ((pipes[p].notFull = CondCreate(pipes[p].lock)) == SYNC_FAIL) {
+    CondHandleDestroy(pipes[p].notEmpty);
+    LockHandleDestroy(pipes[p].lock);
+    pipes[p].inuse = 0;
+    return PIPE_FAIL;
+  }
+  pipes[p].head = 0;
+  pipes[p].used = 0;
+  pipes[p].waiting = 0;
+  pipes[p].owner = GetCurrentPid();
+  return p;
+}
+
+//----------------------------------------------------------------------
+//	PipeDestroy
+//
+//	Frees a pipe, along with anything still in it.  Fails if any
+//	process is blocked on it.
+//----------------------------------------------------------------------
+int PipeDestroy(pipe_t p) {
+  Pipe *pp;
+
+  if ((p < 0) || (p >= MAX_PIPES)) return PIPE_FAIL;
+  pp = &pipes[p];
+  if (!pp->inuse) return PIPE_FAIL;
+
+  if (LockHandleAcquire(pp->lock) != SYNC_SUCCESS) return PIPE_FAIL;
+  if (pp->waiting > 0) {
+    LockHandleRelease(pp->lock);
+    return PIPE_FAIL;
+  }
+  pp->inuse = 0;
+  LockHandleRelease(pp->lock);
+  CondHandleDestroy(pp->notEmpty);
+  CondHandleDestroy(pp->notFull);
+  LockHandleDestroy(pp->lock);
+  return PIPE_SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//	PipeCopy
+//
+//	Copies n bytes between a pipe's buffer and data, which is in
+//	pcb's address space, or the kernel's if pcb is NULL.  toPipe says
+//	which way.
+//----------------------------------------------------------------------
+static void PipeCopy(PCB *pcb, char *buf, char *data, int n, int toPipe) {
+  if (pcb == NULL) {
+    if (toPipe) bcopy(data, buf, n);
+    else bcopy(buf, data, n);
+  } else {
+    if (toPipe) MemoryCopyUserToSystem(pcb, data, buf, n);
+    else MemoryCopySystemToUser(pcb, buf, data, n);
+  }
+}
+
+//----------------------------------------------------------------------
+//	PipeWrite
+//
+//	Writes up to n bytes from data (in pcb's address space, or the
+//	kernel's if pcb is NULL): as many as fit.  Blocks only while the
+//	pipe is full.  Returns the number of bytes written, or PIPE_FAIL.
+//----------------------------------------------------------------------
+int PipeWrite(pipe_t p, PCB *pcb, char *data, int n) {
+  Pipe *pp;
+  int tail, chunk, done;
+
+  if ((p < 0) || (p >= MAX_PIPES)) return PIPE_FAIL;
+  pp = &pipes[p];
+  if (!pp->inuse) return PIPE_FAIL;
+  if (n <= 0) return PIPE_FAIL;
+
+  if (LockHandleAcquire(pp->lock) != SYNC_SUCCESS) return PIPE_FAIL;
+  while (pp->used == PIPE_BUFFER_SIZE) {
+    pp->waiting++;
+    CondHandleWait(pp->notFull);
+    pp->waiting--;
+  }
+  if (n > PIPE_BUFFER_SIZE - pp->used) n = PIPE_BUFFER_SIZE - pp->used;
+  // At most two pieces: up to the end of the buffer, then from the start
+  for (done = 0; done < n; done += chunk) {
+    tail = (pp->head + pp->used) % PIPE_BUFFER_SIZE;
+    chunk = PIPE_BUFFER_SIZE - tail;
+    if (chunk > n - done) chunk = n - done;
+    PipeCopy(pcb, &pp->buffer[tail], data + done, chunk, 1);
+    pp->used += chunk;
+  }
+  CondHandleBroadcast(pp->notEmpty);
+  LockHandleRelease(pp->lock);
+  return n;
+}
+
+//----------------------------------------------------------------------
+//	PipeRead
+//
+//	Reads up to n bytes into data (in pcb's address space, or the
+//	kernel's if pcb is NULL): as many as are in the pipe.  Blocks only
+//	while it's empty.  Returns the number of bytes read, or PIPE_FAIL.
+//----------------------------------------------------------------------
+int PipeRead(pipe_t p, PCB *pcb, char *data, int n) {
+  Pipe *pp;
+  int chunk, done;
+
+  if ((p < 0) || (p >= MAX_PIPES)) return PIPE_FAIL;
+  pp = &pipes[p];
+  if (!pp->inuse) return PIPE_FAIL;
+  if (n <= 0) return PIPE_FAIL;
+
+  if (LockHandleAcquire(pp->lock) != SYNC_SUCCESS) return PIPE_FAIL;
+  while (pp->used == 0) {
+    pp->waiting++;
+    CondHandleWait(pp->notEmpty);
+    pp->waiting--;
+  }
+  if (n > pp->used) n = pp->used;
+  for (done = 0; done < n; done += chunk) {
+    chunk = PIPE_BUFFER_SIZE - pp->head;
+    if (chunk > n - done) chunk = n - done;
+    PipeCopy(pcb, &pp->buffer[pp->head], data + done, chunk, 0);
+    pp->head = (pp->head + chunk) % PIPE_BUFFER_SIZE;
+    pp->used -= chunk;
+  }
+  CondHandleBroadcast(pp->notFull);
+  LockHandleRelease(pp->lock);
+  return n;
+}
+
+//----------------------------------------------------------------------
+//	PipeFreeProcess
+//
+//	Destroys the pipes a dying process created.  One that others are
+//	blocked on stays until someone destroys it.  Called from
+//	ProcessFreeResources.
+//----------------------------------------------------------------------
+void PipeFreeProcess(int pid) {
+  int i;
+
+  for (i = 0; i < MAX_PIPES; i++) {
+    if (pipes[i].inuse && (pipes[i].owner == pid) && (PipeDestroy(i) != PIPE_SUCCESS)) {
+      pipes[i].owner = -1;
+    }
+  }
+}
@@ -9,6 +9,7 @@
 //  done in assembly language elsewhere.
 
 #include "ostraps.h"
+#include "traps.h"
 #include "dlxos.h"
 #include "process.h"
 #include "synch.h"
@@ -16,8 +17,11 @@
 #include "filesys.h"
 #include "share_memory.h"
 #include "mbox.h"
+#include "pipe.h"
 #include "clock.h"
 #include "queue.h"
+#include "sched.h"
+#include "spinlock.h"
 
 // Pointer to the current PCB.  This is used by the assembly language
 // routines for context switches.
@@ -26,20 +30,19 @@ PCB   *currentPCB;
 // List of free PCBs.
 static Queue  freepcbs;
 
-// List of processes that are ready to run (ie, not waiting for something
-// to happen).
-static Queue runQueues[NUM_RUN_QUEUES];
-
 // List of processes that are waiting for something to happen.  There's no
 // reason why this must be a single list; there could be many lists for many
 // different conditions.
 static Queue qWait;
-static Queue qSleep;
+static PQueue qSleep;   // Keyed by jWake, so the next one due is first
 
 // List of processes waiting to be deleted.  See below for a description of
 // the reason that we need a separate queue for processes about to die.
 static Queue  zombieQueue;
 
+// System-wide scheduler statistics; each PCB keeps its own too.
+static SchedStats schedStats;
+
 // Static area for all process control blocks.  This is necessary because
 // we can't use malloc() inside the OS.
 static PCB  pcbs[PROCESS_MAX_PROCS];
@@ -47,8 +50,37 @@ static PCB  pcbs[PROCESS_MAX_PROCS];
 // idle pcb
 static PCB* idlePCB;
 
-// Counter of quanta jiffies
-static int cntQuantaJ;
+// Real time processes (PROCESS_TYPE_REALTIME) are kept here, sorted by
+// their fixed priority, instead of being handed to the scheduler
+// policy; they run whenever one is runnable.  Making one runnable that
+// beats the current process sets rtResched, so the trap or interrupt
+// that did it reschedules on the way out.
+static Queue rtQueue;
+static int rtProcs;
+static int rtResched;
+
+// Guards the run queues (the policy's and rtQueue) and qSleep.  Code
+// that sleeps or switches while it has them, like ProcessReaper, still
+// turns interrupts off instead.
+static Spinlock runQueueLock;
+
+// The reaper process frees zombies; it waits on qReaper (rather than
+// qWait, so it doesn't count as a process that could be woken) while
+// there are none.
+static PCB* reaperPCB;
+static Queue qReaper;
+
+// Between ProcessForkBatchBegin and ProcessForkBatchEnd, the first
+// user process forked from an executable loads it as usual and is
+// remembered here; later ones in the batch from the same executable
+// copy its image bytes [lo, hi) instead of reading the file again.
+static struct {
+  int batch;
+  PCB *pcb;                         // NULL until an image is loaded
+  char name[PROCESS_MAX_NAME_LENGTH];
+  int start;
+  uint32 lo, hi;
+} forkImage;
 
 // String listing debugging options to print out.
 char  debugstr[200];
@@ -57,6 +89,9 @@ int ProcessGetCodeInfo(const char *file, uint32 *startAddr, uint32 *codeStart, u
                        uint32 *dataStart, uint32 *dataSize);
 int ProcessGetFromFile(int fd, unsigned char *buf, uint32 *addr, int max);
 uint32 get_argument(char *string);
+static int ProcessCopyArgBlock(PCB *pcb, ProcessArgBlock *args, uint32 *sp);
+static void SchedStatsClear(SchedStats *st);
+static int ProcessRunnable();
 
 
 //----------------------------------------------------------------------
@@ -72,20 +107,23 @@ void ProcessModuleInit () {
   int   i;
   dbprintf ('p', "ProcessModuleInit: function started\n");
   AQueueInit (&freepcbs);
-  for(i = 0; i < NUM_RUN_QUEUES; i++) {
-    AQueueInit(&runQueues[i]);
-  }
+  SchedModuleInit();
+  SchedStatsClear(&schedStats);
   AQueueInit (&qWait);
-  AQueueInit (&qSleep);
+  PQueueInit (&qSleep);
   AQueueInit (&zombieQueue);
+  AQueueInit (&qReaper);
+  AQueueInit (&rtQueue);
+  rtProcs = 0;
+  rtResched = 0;
+  SpinInit(&runQueueLock, "run queue");
+  reaperPCB = NULL;
   // For each PCB slot in the global pcbs array:
   for (i = 0; i < PROCESS_MAX_PROCS; i++) {
     dbprintf ('p', "Initializing PCB %d @ 0x%x.\n", i, (int)&(pcbs[i]));
-    // First, set the internal PCB link pointer to a newly allocated link
-    if ((pcbs[i].l = AQueueAllocLink(&pcbs[i])) == NULL) {
-      printf("FATAL ERROR: could not allocate link in ProcessModuleInit!\n");
-      exitsim();
-    }
+    // First, set the internal PCB link pointer to its embedded link
+    pcbs[i].l = AQueueLinkInit(&pcbs[i].link, &pcbs[i]);
+    PQueueLinkInit(&pcbs[i].sleepLink, &pcbs[i]);
     // Next, set the pcb to be available
     pcbs[i].jResume = 0;
     pcbs[i].jSleep = 0;
@@ -134,12 +172,11 @@ void ProcessFreeResources (PCB *pcb) {
   // that a dying process might have goes here.
   //-----------------------------------------------------
   MboxCloseAllByPid(GetPidFromAddress(pcb)); 
+  PipeFreeProcess(GetPidFromAddress(pcb));
+  SynchFreeProcess(pcb);
 
-  // Allocate a new link for this pcb on the freepcbs queue
-  if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
-    printf("FATAL ERROR: could not get Queue Link in ProcessFreeResources!\n");
-    exitsim();
-  }
+  // Reuse the pcb's link for the freepcbs queue
+  pcb->l = AQueueLinkInit(&pcb->link, pcb);
   // Set the pcb's status to available
   pcb->flags = PROCESS_STATUS_FREE;
   // Insert the link into the freepcbs queue
@@ -157,9 +194,11 @@ void ProcessFreeResources (PCB *pcb) {
   for (i=0; i<npages; i++) {
     MemoryFreeSharedPte(pcb, i);
   }
-  // Next free the non-shared pages
+  // Next free the non-shared pages (unmapped regions leave 0s)
   for (i = 0; i < pcb->npages; i++) {
-    MemoryFreePte (pcb->pagetable[i]);
+    if (pcb->pagetable[i] & MEMORY_PTE_VALID) {
+      MemoryFreePte (pcb->pagetable[i]);
+    }
   }
   // Free the page allocated for the system stack
   MemoryFreePage (pcb->sysStackArea / MEMORY_PAGE_SIZE);
@@ -183,6 +222,77 @@ void ProcessSetResult (PCB * pcb, uint32 result) {
   pcb->currentSavedFrame[PROCESS_STACK_IREG+1] = result;
 }
 
+//----------------------------------------------------------------------
+//
+//  Scheduler statistics
+//
+//  ProcessSchedule counts switches, wakeup-to-run latency and run
+//  queue length, system wide in schedStats and per process in
+//  pcb->stats; ProcessGetSchedStats hands them out.  "Instructions"
+//  come from the simulator's retired instruction counter.
+//
+//----------------------------------------------------------------------
+static inline uint32 PerfInstrs() {
+  return (*((uint32 *)(DLX_PERF_BASE + 8 * DLX_PERF_INSTRS)));
+}
+
+static int SchedHistBucket(int v) {
+  int i = 0;
+
+  while ((v > 0) && (i < SCHED_HIST_BUCKETS - 1)) {
+    v >>= 1;
+    i++;
+  }
+  return i;
+}
+
+static void SchedStatsClear(SchedStats *st) {
+  int i;
+  int *p = (int *)st;
+
+  for (i = 0; i < sizeof(SchedStats) / sizeof(int); i++) {
+    p[i] = 0;
+  }
+}
+
+static void ProcessNoteQueueLength(int n) {
+  schedStats.qlenSum += n;
+  if (n > schedStats.qlenMax) {
+    schedStats.qlenMax = n;
+  }
+  schedStats.qlenHist[SchedHistBucket(n)]++;
+}
+
+static void ProcessNoteLatency(SchedStats *st, int jiffies) {
+  st->wakeups++;
+  st->latencySum += jiffies;
+  if (jiffies > st->latencyMax) {
+    st->latencyMax = jiffies;
+  }
+  st->latencyHist[SchedHistBucket(jiffies)]++;
+}
+
+// A switch away from a process that can still run is a preemption.
+static void ProcessNoteSwitch(PCB *from, PCB *to) {
+  int latency;
+
+  if (from->flags & PROCESS_STATUS_RUNNABLE) {
+    from->stats.involuntary++;
+    schedStats.involuntary++;
+  } else {
+    from->stats.voluntary++;
+    schedStats.voluntary++;
+  }
+  to->stats.dispatches++;
+  schedStats.dispatches++;
+  if (to->jReady >= 0) {
+    latency = ClkGetCurJiffies() - to->jReady;
+    ProcessNoteLatency(&to->stats, latency);
+    ProcessNoteLatency(&schedStats, latency);
+    to->jReady = -1;
+  }
+}
+
 
 //----------------------------------------------------------------------
 //
@@ -211,6 +321,7 @@ void ProcessSchedule () {
   Link *l=NULL;
   int jProcs;
   int intrs;
+  uint32 instrs = PerfInstrs();
 
   dbprintf ('p', "Now entering ProcessSchedule (cur=0x%x)\n", (int)currentPCB);
 
@@ -239,59 +350,33 @@ void ProcessSchedule () {
     exitsim (); // NEVER RETURNS
   }
   
-  intrs = DisableIntrs ();
-  // Move the front of the queue to the end.  The running process was the one in front.
-  if(currentPCB->flags & PROCESS_STATUS_RUNNABLE) {
-    // The round robin inside queue
-    Queue* q = &runQueues[WhichQueue(currentPCB)];
-    AQueueMoveAfter(q, AQueueLast(q), AQueueFirst(q)); // the round robin
-    if(jProcs >= PROCESS_QUANTUM_JIFFIES) {
-      currentPCB->estcpu += 1.0f;
-    }
-    ProcessRecalcPriority(currentPCB);
-  }
-
-  cntQuantaJ += jProcs;
-  if(cntQuantaJ >= CPU_WINDOWS_BETWEEN_DECAYS * PROCESS_QUANTUM_JIFFIES) { // 10 processes qunatas have passed
-    ProcessDecayAllEstcpus();
-    cntQuantaJ = 0; // reset
+  intrs = SpinLock(&runQueueLock);
+  // Charge the running process for the time it just used.
+  rtResched = 0;
+  if (!(currentPCB->flags & PROCESS_TYPE_REALTIME)) {
+    sched->tick(currentPCB, jProcs);
   }
   ProcessUserWakeup(); // wakeup any sleeping processes that needs to be udpated
-  ProcessFixRunQueues();
+  ProcessNoteQueueLength(ProcessRunnable());
   pcb = ProcessFindHighestPriorityPCB();
-  RestoreIntrs(intrs);
-
-  if (pcb == idlePCB) {
-    // move idle pcb to its proper place
-    pcb->priority = 127;
-    if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
-      printf("FATAL ERROR: could not remove process from run Queue in ProcessFixRunQueues!\n");
-      exitsim();
-    }
-    if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
-      printf("FATAL ERROR: could not get Queue Link in ProcessFixRunQueues!\n");
-      exitsim();
-    }
-    ProcessInsertRunning(pcb);
-    pcb = ProcessFindHighestPriorityPCB();
+  SpinUnlock(&runQueueLock, intrs);
+  if (pcb != currentPCB) {
+    ProcessNoteSwitch(currentPCB, pcb);
   }
   currentPCB = pcb;
   currentPCB->jResume = ClkGetCurJiffies();
+  if (currentPCB->flags & PROCESS_TYPE_REALTIME) {
+    ClkSetQuantum(PROCESS_QUANTUM_JIFFIES);
+  } else {
+    ClkSetQuantum(sched->quantum(currentPCB));
+  }
 
   dbprintf ('p',"About to switch to PCB 0x%x,flags=0x%x @ 0x%x\n",
       (int)pcb, pcb->flags, (int)(pcb->sysStackPtr[PROCESS_STACK_IAR]));
 
-  // Clean up zombie processes here.  This is done at interrupt time
-  // because it can't be done while the process might still be running
-  while (!AQueueEmpty(&zombieQueue)) {
-    pcb = (PCB *)AQueueObject(AQueueFirst(&zombieQueue));
-    dbprintf ('p', "Freeing zombie PCB 0x%x.\n", (int)pcb);
-    if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
-      printf("FATAL ERROR: could not remove zombie process from zombieQueue in ProcessSchedule!\n");
-      exitsim();
-    }
-    ProcessFreeResources(pcb);
-  }
+  // Zombies are freed by ProcessReaper, not here.
+  schedStats.schedules++;
+  schedStats.schedInstrs += PerfInstrs() - instrs;
   dbprintf ('p', "Leaving ProcessSchedule (cur=0x%x)\n", (int)currentPCB);
 }
 
@@ -307,19 +392,20 @@ void ProcessSchedule () {
 //
 //----------------------------------------------------------------------
 void ProcessSuspend (PCB *suspend) {
+  int intrs;
+
   // Make sure it's already a runnable process.
   dbprintf ('p', "ProcessSuspend (%d): function started\n", GetCurrentPid());
   ASSERT (suspend->flags & PROCESS_STATUS_RUNNABLE, "Trying to suspend a non-running process!\n");
   ProcessSetStatus (suspend, PROCESS_STATUS_WAITING);
 
-  if (AQueueRemove(&(suspend->l)) != QUEUE_SUCCESS) {
+  intrs = SpinLock(&runQueueLock);
+  if (ProcessQueueRemove(suspend) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove process from run Queue in ProcessSuspend!\n");
     exitsim();
   }
-  if ((suspend->l = AQueueAllocLink(suspend)) == NULL) {
-    printf("FATAL ERROR: could not get Queue Link in ProcessSuspend!\n");
-    exitsim();
-  }
+  SpinUnlock(&runQueueLock, intrs);
+  suspend->l = AQueueLinkInit(&suspend->link, suspend);
   if (AQueueInsertLast(&qWait, suspend->l) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not insert suspend PCB into qWait!\n");
     exitsim();
@@ -342,26 +428,24 @@ void ProcessSuspend (PCB *suspend) {
 //
 //----------------------------------------------------------------------
 void ProcessWakeup (PCB *wakeup) {
-  int time_asleep_jiffies;
   int intrs;
   dbprintf ('p',"Waking up PID %d.\n", (int)(wakeup - pcbs));
   // Make sure it's not yet a runnable process.
   ASSERT (wakeup->flags & PROCESS_STATUS_WAITING, "Trying to wake up a non-sleeping process!\n");
   ProcessSetStatus (wakeup, PROCESS_STATUS_RUNNABLE);
-  if (AQueueRemove(&(wakeup->l)) != QUEUE_SUCCESS) {
+  intrs = SpinLock(&runQueueLock);
+  // A timed wait sleeps on qSleep rather than qWait
+  if (ProcessQueueRemove(wakeup) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove wakeup PCB from qWait in ProcessWakeup!\n");
     exitsim();
   }
-  if ((wakeup->l = AQueueAllocLink(wakeup)) == NULL) {
-    printf("FATAL ERROR: could not get link for wakeup PCB in ProcessWakeup! \n");
-    exitsim();
+  wakeup->l = AQueueLinkInit(&wakeup->link, wakeup);
+  if (!(wakeup->flags & PROCESS_TYPE_REALTIME)) {
+    sched->wakeup(wakeup);
   }
-  intrs = DisableIntrs();
-  time_asleep_jiffies = ClkGetCurJiffies() - wakeup->jSleep;
-  ProcessDecayEstcpuSleep(wakeup, time_asleep_jiffies);
-  ProcessRecalcPriority(wakeup);
+  wakeup->jReady = ClkGetCurJiffies();
   ProcessInsertRunning(wakeup);
-  RestoreIntrs(intrs);
+  SpinUnlock(&runQueueLock, intrs);
 }
 
 
@@ -380,20 +464,24 @@ void ProcessWakeup (PCB *wakeup) {
 //
 //----------------------------------------------------------------------
 void ProcessDestroy (PCB *pcb) {
+  int intrs;
+
   dbprintf ('p', "ProcessDestroy (%d): function started\n", GetCurrentPid());
   ProcessSetStatus (pcb, PROCESS_STATUS_ZOMBIE);
-  if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
+  intrs = SpinLock(&runQueueLock);
+  if (ProcessQueueRemove(pcb) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove link from queue in ProcessDestroy!\n");
     exitsim();
   }
-  if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
-    printf("FATAL ERROR: could not get link for zombie PCB in ProcessDestroy!\n");
-    exitsim();
-  }
+  SpinUnlock(&runQueueLock, intrs);
+  pcb->l = AQueueLinkInit(&pcb->link, pcb);
   if (AQueueInsertFirst(&zombieQueue, pcb->l) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not insert link into runQueue in ProcessWakeup!\n");
     exitsim();
   }
+  if ((reaperPCB != NULL) && (reaperPCB->flags & PROCESS_STATUS_WAITING)) {
+    ProcessWakeup(reaperPCB);
+  }
   dbprintf ('p', "ProcessDestroy (%d): function complete\n", GetCurrentPid());
 }
 
@@ -434,6 +522,7 @@ int ProcessFork (VoidFunc func, uint32 param, int pnice, int pinfo,char *name, i
   int   intrs;
   unsigned char buf[100];
   uint32 dum[MAX_ARGS+8], count, offset;
+  uint32 sp;
   char *str;
 
   dbprintf ('p', "ProcessFork (%d): function started\n", GetCurrentPid());
@@ -536,7 +625,15 @@ int ProcessFork (VoidFunc func, uint32 param, int pnice, int pinfo,char *name, i
             + (MEMORY_L2_PAGE_SIZE_BITS << 16));
 
 
-  if (isUser) {
+  if (isUser && (forkImage.pcb != NULL) &&
+      (dstrncmp (forkImage.name, name, PROCESS_MAX_NAME_LENGTH) == 0)) {
+    // An earlier process in this batch already loaded the executable
+    dbprintf ('p', "Copying image of %s from PCB 0x%x\n", name, (int)forkImage.pcb);
+    start = forkImage.start;
+    bcopy ((char *)MemoryTranslateUserToSystem (forkImage.pcb, forkImage.lo),
+           (char *)MemoryTranslateUserToSystem (pcb, forkImage.lo),
+           forkImage.hi - forkImage.lo);
+  } else if (isUser) {
     dbprintf ('p', "About to load %s\n", name);
     fd = ProcessGetCodeInfo (name, &start, &codeS, &codeL, &dataS, &dataL);
     if (fd < 0) {
@@ -556,6 +653,28 @@ int ProcessFork (VoidFunc func, uint32 param, int pnice, int pinfo,char *name, i
       MemoryCopySystemToUser (pcb, buf, addr - n, n);
     }
     FsClose (fd);
+    if (forkImage.batch) {
+      forkImage.pcb = pcb;
+      dstrncpy (forkImage.name, name, PROCESS_MAX_NAME_LENGTH);
+      forkImage.start = start;
+      forkImage.lo = (codeS < dataS) ? codeS : dataS;
+      forkImage.hi = (codeS + codeL > dataS + dataL) ? codeS + codeL : dataS + dataL;
+    }
+  }
+  if (isUser == PROCESS_USER_ARGBLOCK) {
+    if (ProcessCopyArgBlock (pcb, (ProcessArgBlock *)param, &sp) < 0) {
+      printf ("ProcessFork: bad argument block for %s\n", name);
+      if (forkImage.pcb == pcb) {
+        forkImage.pcb = NULL;
+      }
+      ProcessFreeResources (pcb);
+      return (-1);
+    }
+    stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
+    stackframe[PROCESS_STACK_IREG+29] = sp;
+    stackframe[PROCESS_STACK_IAR] = (uint32)start;
+    pcb->flags |= PROCESS_TYPE_USER;
+  } else if (isUser) {
     stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
     // Set the initial stack pointer correctly.  Currently, it's just set
     // to the top of the (single) user address space allocated to this
@@ -588,9 +707,6 @@ int ProcessFork (VoidFunc func, uint32 param, int pnice, int pinfo,char *name, i
     stackframe[PROCESS_STACK_IAR] = (uint32)start;
     pcb->flags |= PROCESS_TYPE_USER;
 
-    // Priority
-    pcb->priority = USER_PROCESS_BASE_PRIORITY + 2 * pnice;
-    pcb->estcpu = 0.0;
   } else {
     // Set r31 to ProcessExit().  This will only be called for a system
     // process; user processes do an exit() trap.
@@ -612,25 +728,22 @@ int ProcessFork (VoidFunc func, uint32 param, int pnice, int pinfo,char *name, i
 
     // Mark this as a system process.
     pcb->flags |= PROCESS_TYPE_SYSTEM;
-    
-    // Priority
-    if(func == ProcessIdle) {
-      pcb->priority = 127;
-    }
-    else {
-      pcb->priority = KERNEL_PROCESS_BASE_PRIORITY + 2 * pnice;
-    }
-    pcb->estcpu = 0.0;
   }
 
+  // Let the scheduler set up its priority (or tickets, or ...)
+  sched->fork(pcb);
+  pcb->donor = NULL;
+  pcb->blockedOn = NULL;
+  pcb->waitTimedOut = 0;
+  pcb->mboxesOpen = 0;
+  pcb->jReady = -1;
+  SchedStatsClear(&pcb->stats);
+
   // Place PCB onto run queue
-  intrs = DisableIntrs ();
-  if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
-    printf("FATAL ERROR: could not get link for forked PCB in ProcessFork!\n");
-    exitsim();
-  }
+  intrs = SpinLock(&runQueueLock);
+  pcb->l = AQueueLinkInit(&pcb->link, pcb);
   ProcessInsertRunning(pcb);
-  RestoreIntrs (intrs);
+  SpinUnlock(&runQueueLock, intrs);
 
   // If this is the first process, make it the current one
   if (currentPCB == NULL) {
@@ -646,6 +759,78 @@ int ProcessFork (VoidFunc func, uint32 param, int pnice, int pinfo,char *name, i
   return (pcb - pcbs);
 }
 
+//----------------------------------------------------------------------
+//
+//  ProcessCopyArgBlock
+//
+//  Put the argument block args describes at the top of pcb's stack:
+//  one copy straight from the caller's memory into pcb's page, then
+//  argv's offsets turned into addresses where they lie, one word per
+//  argument.  The strings are never scanned; the block only has to
+//  end in a '\0', so the last one does too.  Sets *sp to the stack
+//  pointer main starts with, at argc and argv.  Returns 0, or -1 if
+//  the block is malformed or too big.
+//
+//----------------------------------------------------------------------
+static int ProcessCopyArgBlock(PCB *pcb, ProcessArgBlock *args, uint32 *sp) {
+  uint32 base, hdr, *block;
+  int argc, i;
+
+  if ((args->len < 3 * sizeof(uint32)) || (args->len > PROCESS_MAX_ARG_BLOCK)) {
+    return (-1);
+  }
+  // Under the top 32 bytes, like the argument buffer of other processes
+  base = (MEMORY_PAGE_SIZE - 32 - args->len) & ~7;
+  block = (uint32 *)MemoryTranslateUserToSystem (pcb, base);
+  if (args->from == NULL) {
+    bcopy ((char *)args->addr, (char *)block, args->len);
+  } else if (MemoryCopyUserToSystem (args->from, (char *)args->addr, (char *)block,
+                                     args->len) != args->len) {
+    return (-1);
+  }
+  argc = block[0];
+  if ((argc < 1) || (argc > args->len / sizeof(uint32))) {
+    return (-1);
+  }
+  hdr = (argc + 2) * sizeof(uint32);
+  if ((hdr >= args->len) || (block[argc+1] != 0) ||
+      (((char *)block)[args->len - 1] != '\0')) {
+    return (-1);
+  }
+  for (i = 1; i <= argc; i++) {
+    if ((block[i] < hdr) || (block[i] >= args->len)) {
+      return (-1);
+    }
+    block[i] += base;
+  }
+  // main (argc, argv) finds them at its initial stack pointer
+  block[-2] = argc;
+  block[-1] = base + sizeof(uint32);
+  *sp = base - 2 * sizeof(uint32);
+  return (0);
+}
+
+//----------------------------------------------------------------------
+//
+//  ProcessForkBatchBegin / ProcessForkBatchEnd
+//
+//  Bracket a series of ProcessFork calls (see process_create_many) so
+//  that an executable is opened and parsed only once: every process
+//  after the first from the same executable gets a copy of the first
+//  one's image.  No process in the batch may run before the batch
+//  ends, since the copies come from the first one's memory.
+//
+//----------------------------------------------------------------------
+void ProcessForkBatchBegin() {
+  forkImage.batch = 1;
+  forkImage.pcb = NULL;
+}
+
+void ProcessForkBatchEnd() {
+  forkImage.batch = 0;
+  forkImage.pcb = NULL;
+}
+
 //----------------------------------------------------------------------
 //
 //  getxvalue
@@ -893,6 +1078,11 @@ void main (int argc, char *argv[])
   close (fd);
   break;
       }
+      case 'S':
+  if (!SchedSelect (argv[++i])) {
+    printf ("Scheduler %s not recognized, using %s.\n", argv[i], sched->name);
+  }
+  break;
       case 'u':
   userprog = argv[++i];
         base = i; // Save the location of the user program's name 
@@ -918,6 +1108,8 @@ void main (int argc, char *argv[])
   dbprintf ('i', "After initializing shared memory.\n");
   SynchModuleInit ();
   dbprintf ('i', "After initializing synchronization tools.\n");
+  PipeModuleInit ();
+  dbprintf ('i', "After initializing pipes.\n");
   KbdModuleInit ();
   dbprintf ('i', "After initializing keyboard.\n");
   ClkModuleInit();
@@ -961,6 +1153,9 @@ void main (int argc, char *argv[])
 
   idle_pcb_id = ProcessFork (&ProcessIdle, 0, 20, 0, "idle", 0);
   idlePCB = &pcbs[idle_pcb_id];
+  reaperPCB = &pcbs[ProcessFork (&ProcessReaper, 0, 0, 0, "reaper", 0)];
+  ProcessMakeRealtime(reaperPCB, PROCESS_RT_PRIO_REAPER);
+  SchedSetIdle(idlePCB);
   // Start the clock which will in turn trigger periodic ProcessSchedule's
   ClkStart();
 
@@ -1037,74 +1232,92 @@ int GetPidFromAddress(PCB *pcb) {
 // followed by a call to ProcessSchedule (in traps.c).
 //--------------------------------------------------------
 void ProcessUserSleep(int seconds) {
+  ProcessUserSleepJiffies(seconds * JIFFIES_PER_SECOND);
+}
+
+//--------------------------------------------------------
+// ProcessUserSleepJiffies puts the current process to
+// sleep for the given number of jiffies.  qSleep is a
+// priority queue keyed by wakeup time (jWake), so
+// ProcessUserWakeup only has to look at its first entry.
+// Like ProcessUserSleep, this must be followed by a call to
+// ProcessSchedule.
+//--------------------------------------------------------
+void ProcessUserSleepJiffies(int jiffies) {
   int intrval;
   // Make sure it's already a runnable process.
-  intrval = DisableIntrs();
+  intrval = SpinLock(&runQueueLock);
   dbprintf ('p', "ProcessUserSleep (%d): function started\n", GetCurrentPid());
   ASSERT (currentPCB->flags & PROCESS_STATUS_RUNNABLE, "Trying to sleep a non-running process!\n");
   ProcessSetStatus (currentPCB, PROCESS_STATUS_WAITING);
 
+  if (jiffies < 0) jiffies = 0;
   currentPCB->jSleep = ClkGetCurJiffies();
-  currentPCB->jWake = seconds * JIFFIES_PER_SECOND;
+  currentPCB->jWake = currentPCB->jSleep + jiffies;
 
-  if (AQueueRemove(&(currentPCB->l)) != QUEUE_SUCCESS) {
+  if (ProcessQueueRemove(currentPCB) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove process from run Queue in ProcessUserSleep!\n");
     exitsim();
   }
-  if ((currentPCB->l = AQueueAllocLink(currentPCB)) == NULL) {
-    printf("FATAL ERROR: could not get Queue Link in ProcessUserSleep!\n");
-    exitsim();
-  }
-  if (AQueueInsertLast(&qSleep, currentPCB->l) != QUEUE_SUCCESS) {
+  currentPCB->l = AQueueLinkInit(&currentPCB->link, currentPCB);
+  // Equal deadlines come out of qSleep in the order they went in.
+  if (PQueueInsert(&qSleep, &currentPCB->sleepLink, currentPCB->jWake) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not insert link into queue in ProcessUserSleep!\n");
     exitsim();
   }
-  RestoreIntrs(intrval);
+  SpinUnlock(&runQueueLock, intrval);
   dbprintf ('p', "ProcessUserSleep (%d): function complete\n", GetCurrentPid());
 }
 
+//--------------------------------------------------------
+// ProcessSleepUntil is the kernel's timed wait: it puts the
+// current process to sleep until ProcessWakeup or jiffy
+// jDeadline, whichever comes first, by sleeping on qSleep
+// rather than qWait.  A caller waiting on a synchronization
+// object has already put currentPCB->waitLink on its queue;
+// SynchTimeout takes it off again if the deadline comes
+// first.  Returns 1 if it timed out, 0 if it was woken.
+// Interrupts must be disabled.
+//--------------------------------------------------------
+int ProcessSleepUntil(int jDeadline) {
+  currentPCB->waitTimedOut = 0;
+  ProcessUserSleepJiffies(jDeadline - ClkGetCurJiffies());
+  ProcessContextSwitch();
+  return currentPCB->waitTimedOut;
+}
+
+// Wakes every sleeper whose jWake has passed.  qSleep is keyed by
+// jWake, so this stops at the first process that isn't due yet.
 void ProcessUserWakeup() {
-  Link* l;
-  Link* tmp_l;
-  int iQueue;
+  PQLink* l;
   PCB* pcb;
-  int slept_time;
+  int now;
 
-  if(AQueueEmpty(&qSleep)) {
-    return;
-  }
-
-  tmp_l = AQueueFirst(&qSleep);
-  while (tmp_l != NULL) {
-    l = tmp_l;
-    tmp_l = AQueueNext(tmp_l);
-    pcb = (PCB*) AQueueObject(l);
-
-    slept_time = ClkGetCurJiffies() - pcb->jSleep;
-    if(slept_time >= pcb->jWake) {
-      dbprintf ('p',"Waking up sleepy PID %d.\n", (int)(pcb - pcbs));
-      // Make sure it's not yet a runnable process.
-      ASSERT (pcb->flags & PROCESS_STATUS_WAITING, "Trying to wake up a non-sleeping process!\n");
-      ProcessSetStatus (pcb, PROCESS_STATUS_RUNNABLE);
-      ProcessDecayEstcpuSleep(pcb, slept_time);
-      ProcessRecalcPriority(pcb);
-      iQueue = WhichQueue(pcb);
+  now = ClkGetCurJiffies();
+  while ((l = PQueueFirst(&qSleep)) != NULL) {
+    pcb = (PCB*) PQueueObject(l);
+    if (now - pcb->jWake < 0) {
+      break;
+    }
+    dbprintf ('p',"Waking up sleepy PID %d.\n", (int)(pcb - pcbs));
+    // Make sure it's not yet a runnable process.
+    ASSERT (pcb->flags & PROCESS_STATUS_WAITING, "Trying to wake up a non-sleeping process!\n");
+    // A timed wait that ran out leaves its object's queue
+    SynchTimeout(pcb);
+    ProcessSetStatus (pcb, PROCESS_STATUS_RUNNABLE);
+    if (!(pcb->flags & PROCESS_TYPE_REALTIME)) {
+      sched->wakeup(pcb);
+    }
+    pcb->jReady = now;
 
-      if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
-        printf("FATAL ERROR: could not remove process from run Queue in ProcessUserWakeup!\n");
-        exitsim();
-      }
-      if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
-        printf("FATAL ERROR: could not get Queue Link in ProcessUserWakeup!\n");
-        exitsim();
-      }
-      if (AQueueInsertLast(&runQueues[iQueue], pcb->l) != QUEUE_SUCCESS) {
-        printf("FATAL ERROR: could not insert link into queue in ProcessUserWakeup!\n");
-        exitsim();
-      }
-      pcb->jWake = 0;
-      pcb->jSleep = 0;
+    if (PQueueRemoveFirst(&qSleep) != l) {
+      printf("FATAL ERROR: could not remove process from run Queue in ProcessUserWakeup!\n");
+      exitsim();
     }
+    pcb->l = AQueueLinkInit(&pcb->link, pcb);
+    ProcessInsertRunning(pcb);
+    pcb->jWake = 0;
+    pcb->jSleep = 0;
   }
   return;
 }
@@ -1119,161 +1332,218 @@ void ProcessYield() {
 }
 
 //-----------------------------------------------------
-// ProcessIdle just an infinite while loop.
+// ProcessIdle waits for interrupts forever.  The wait lets
+// the simulator skip ahead to the next timer or I/O event.
 //-----------------------------------------------------
-void ProcessIdle() {
-  while(1);
-}
+//----------------------------------------------------------------------
+//
+//  ProcessReaper
+//
+//  Kernel process that frees zombie processes.  Freeing can't happen
+//  until a process is no longer running, and doing it in
+//  ProcessSchedule meant freeing every zombie inside the timer
+//  interrupt.  Each zombie is freed with interrupts disabled, but they
+//  are enabled between zombies, and after PROCESS_REAP_BATCH of them
+//  the reaper gives up the CPU.  With no zombies left it waits on
+//  qReaper until ProcessDestroy wakes it.
+//
+//----------------------------------------------------------------------
+void ProcessReaper() {
+  PCB *pcb;
+  int intrs;
+  int n;
 
-inline int WhichQueue(PCB *pcb) {
-  return pcb->priority / PRIORITIES_PER_QUEUE;
-}
+  while(1) {
+    for (n = 0; n < PROCESS_REAP_BATCH; n++) {
+      intrs = DisableIntrs();
+      if (AQueueEmpty(&zombieQueue)) {
+        RestoreIntrs(intrs);
+        break;
+      }
+      pcb = (PCB *)AQueueObject(AQueueLast(&zombieQueue));
+      dbprintf ('p', "Freeing zombie PCB 0x%x.\n", (int)pcb);
+      if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
+        printf("FATAL ERROR: could not remove zombie process from zombieQueue in ProcessReaper!\n");
+        exitsim();
+      }
+      ProcessFreeResources(pcb);
+      RestoreIntrs(intrs);
+    }
 
-void ProcessRecalcPriority(PCB *pcb) {
-  if(pcb->flags & PROCESS_TYPE_USER) {
-    pcb->priority = USER_PROCESS_BASE_PRIORITY + pcb->estcpu / 4 + 2 * pcb->pnice;
-  } else {
-    pcb->priority = KERNEL_PROCESS_BASE_PRIORITY + pcb->estcpu / 4 + 2 * pcb->pnice;
+    intrs = DisableIntrs();
+    if (AQueueEmpty(&zombieQueue)) {
+      ProcessSetStatus (currentPCB, PROCESS_STATUS_WAITING);
+      if (ProcessQueueRemove(currentPCB) != QUEUE_SUCCESS) {
+        printf("FATAL ERROR: could not remove process from run Queue in ProcessReaper!\n");
+        exitsim();
+      }
+      currentPCB->l = AQueueLinkInit(&currentPCB->link, currentPCB);
+      if (AQueueInsertLast(&qReaper, currentPCB->l) != QUEUE_SUCCESS) {
+        printf("FATAL ERROR: could not insert reaper PCB into qReaper!\n");
+        exitsim();
+      }
+    }
+    ProcessContextSwitch();
+    RestoreIntrs(intrs);
   }
-
 }
 
-void ProcessInsertRunning(PCB *pcb) {
-  if (AQueueInsertLast(&runQueues[WhichQueue(pcb)], pcb->l) != QUEUE_SUCCESS) {
-    printf("FATAL ERROR: could not insert link into runQueue in ProcessInsertRunning!\n");
-    exitsim();
+void ProcessIdle() {
+  while(1) {
+    WaitForInterrupt();
   }
 }
 
-PCB *ProcessFindHighestPriorityPCB() {
-  int i;
-  for(i = 0; i < NUM_RUN_QUEUES; i++) {
-    if (!AQueueEmpty(&runQueues[i])) {
-      return (PCB *)AQueueObject(AQueueFirst(&runQueues[i]));
-    }
+int isEmptyqSleep() {
+  if(PQueueEmpty(&qSleep)) {
+    return 0;
   }
-  return NULL;
+  return 1;
 }
 
-// Returns true if useful runnable processes exists
-int runQueIdleProcChk() {
-  PCB* onlyPCB = NULL;
-  int i;
-  for(i = 0; i < NUM_RUN_QUEUES; i++) {
-    if (!AQueueEmpty(&runQueues[i])) {
-      if(AQueueLength(&runQueues[i]) == 1) {
-        onlyPCB = (PCB *)AQueueObject(AQueueFirst(&runQueues[i]));
-        if(onlyPCB != idlePCB) return 1;
-      }
-      else {
-        return 1;
-      }
+// The rest of the process code only gets at the run queues through
+// these, which hand off to the scheduler policy (see sched.c) for
+// everything but real time processes.
+void ProcessInsertRunning(PCB *pcb) {
+  Link *after;
+
+  if (!(pcb->flags & PROCESS_TYPE_REALTIME)) {
+    sched->enqueue(pcb);
+    return;
+  }
+  // After the last one of the same or higher priority
+  after = AQueueLast(&rtQueue);
+  while ((after != NULL) && (((PCB *)AQueueObject(after))->priority > pcb->priority)) {
+    after = AQueuePrev(after);
+  }
+  if (after == NULL) {
+    if (AQueueInsertFirst(&rtQueue, pcb->l) != QUEUE_SUCCESS) {
+      printf("FATAL ERROR: could not insert link into rtQueue in ProcessInsertRunning!\n");
+      exitsim();
     }
+  } else if (AQueueInsertAfter(&rtQueue, after, pcb->l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert link into rtQueue in ProcessInsertRunning!\n");
+    exitsim();
+  }
+  rtProcs++;
+  if ((currentPCB != NULL) && (currentPCB != pcb) &&
+      (!(currentPCB->flags & PROCESS_TYPE_REALTIME) || (currentPCB->priority > pcb->priority))) {
+    rtResched = 1;
   }
-  return 0;
 }
 
-int isEmptyqSleep() {
-  if(AQueueEmpty(&qSleep)) {
-    return 0;
+// Removes pcb's link from whatever queue it's on, as AQueueRemove does.
+int ProcessQueueRemove(PCB *pcb) {
+  if (pcb->sleepLink.queue == &qSleep) {
+    return PQueueRemove(&pcb->sleepLink);
   }
-  return 1;
+  if ((pcb->l != NULL) && (pcb->l->queue == &rtQueue)) {
+    if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
+      return QUEUE_FAIL;
+    }
+    rtProcs--;
+    return QUEUE_SUCCESS;
+  }
+  if (!sched->onRunQueue(pcb)) {
+    return AQueueRemove(&(pcb->l));
+  }
+  return sched->dequeue(pcb);
 }
 
-void ProcessDecayEstcpuSleep(PCB *pcb, int time_asleep_jiffies) {
-  int num_asleep;
-  if (time_asleep_jiffies >= CPU_WINDOWS_BETWEEN_DECAYS * PROCESS_QUANTUM_JIFFIES) {
-    num_asleep = time_asleep_jiffies / (PROCESS_QUANTUM_JIFFIES * CPU_WINDOWS_BETWEEN_DECAYS);
-    pcb->estcpu = pcb->estcpu * pow(((2 * PROCESS_LOAD)/(2 * PROCESS_LOAD + 1)), num_asleep);
+PCB *ProcessFindHighestPriorityPCB() {
+  if (rtProcs > 0) {
+    return (PCB *)AQueueObject(AQueueFirst(&rtQueue));
   }
+  return sched->pickNext();
 }
 
-void ProcessDecayAllEstcpus() {
-  int i;
-  PCB* pcb;
-  Link* l;
-
-  for(i = 0; i < NUM_RUN_QUEUES; i++) {
-    if(AQueueEmpty(&runQueues[i])) {
-      continue;
-    }
-    l = AQueueFirst(&runQueues[i]);
-    while (l != NULL) {
-      pcb = AQueueObject(l);
-      pcb->estcpu = (pcb->estcpu * (2 * PROCESS_LOAD)/(2 * PROCESS_LOAD + 1)) + pcb->pnice;
-      ProcessRecalcPriority(pcb);
-      l = AQueueNext(l);
-    }
-  }
+// Number of runnable processes, not counting idle
+static int ProcessRunnable() {
+  return rtProcs + sched->busy();
 }
 
-void ProcessPrintRunQueues() {
-  int i;
-  Link* l;
-  Link* tmp_l;
-  PCB* pcb;
-  printf("Printing run queues....\n");
-  for(i = 0; i < NUM_RUN_QUEUES; i++) {
-    printf("%d ", i);
-    if(AQueueEmpty(&runQueues[i])) {
-      printf(" | \n");
-      continue;
-    }
-    tmp_l = AQueueFirst(&runQueues[i]);
-    while (tmp_l != NULL) {
-      l = tmp_l;
-      tmp_l = AQueueNext(tmp_l);
-      pcb = AQueueObject(l);
-      printf("%d[%d], ", GetPidFromAddress(pcb), pcb->priority);
+// Moves pcb into the real time class at priority rtprio (0 is the
+// highest).  It keeps that priority for good: no estcpu, no decay.
+void ProcessMakeRealtime(PCB *pcb, int rtprio) {
+  int intrs;
+  int queued;
+
+  if (rtprio < 0) rtprio = 0;
+  if (rtprio >= PROCESS_RT_PRIORITIES) rtprio = PROCESS_RT_PRIORITIES - 1;
+  intrs = SpinLock(&runQueueLock);
+  queued = sched->onRunQueue(pcb);
+  if (queued) {
+    if (ProcessQueueRemove(pcb) != QUEUE_SUCCESS) {
+      printf("FATAL ERROR: could not remove process from run Queue in ProcessMakeRealtime!\n");
+      exitsim();
     }
-    printf("\n");
+    pcb->l = AQueueLinkInit(&pcb->link, pcb);
   }
-  printf("Finished printing run queues.\n");
-
+  pcb->flags |= PROCESS_TYPE_REALTIME;
+  pcb->priority = rtprio;
+  if (queued) {
+    ProcessInsertRunning(pcb);
+  }
+  SpinUnlock(&runQueueLock, intrs);
 }
 
-void ProcessFixRunQueues() {
-  int i, j, length, iQueue;
-  PCB* pcb;
-  Link* l;
-  Link* tmp_l;
+// True if a real time process became runnable that should preempt the
+// current one.  Checked by dointerrupt before it returns.
+int ProcessReschedPending() {
+  return rtResched;
+}
 
-  for(i = 0; i < NUM_RUN_QUEUES; i++) {
-    if(AQueueEmpty(&runQueues[i])) {
-      continue;
-    }
-    length = AQueueLength(&runQueues[i]);
-    tmp_l = AQueueFirst(&runQueues[i]);
-    for(j = 0; j < length; j++) {
-      l = tmp_l;
-      tmp_l = AQueueNext(tmp_l);
-      pcb = AQueueObject(l);
-      iQueue = WhichQueue(pcb);
-      if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
-        printf("FATAL ERROR: could not remove process from run Queue in ProcessFixRunQueues!\n");
-        exitsim();
-      }
-      if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
-        printf("FATAL ERROR: could not get Queue Link in ProcessFixRunQueues!\n");
-        exitsim();
-      }
-      if (AQueueInsertLast(&runQueues[iQueue], pcb->l) != QUEUE_SUCCESS) {
-        printf("FATAL ERROR: could not insert link into queue in ProcessFixRunQueues!\n");
-        exitsim();
-      }
+// Called when the running process's timeslice is up.  Returns 0 if
+// ProcessSchedule would only pick it again: it's the sole runnable
+// process (or the idle one, with nothing else runnable) and no sleeper
+// is due.  With nothing runnable and nobody asleep, ProcessSchedule
+// still has to run so the OS can exit.
+int ProcessPreemptNeeded() {
+  PCB *pcb;
+  int n = ProcessRunnable();
+
+  if (!PQueueEmpty(&qSleep)) {
+    pcb = (PCB *)PQueueObject(PQueueFirst(&qSleep));
+    if (ClkGetCurJiffies() - pcb->jWake >= 0) {
+      return 1;
     }
+  } else if (n == 0) {
+    return 1;
   }
+  if (currentPCB == idlePCB) {
+    return n != 0;
+  }
+  return !((n == 1) && (currentPCB->flags & PROCESS_STATUS_RUNNABLE));
 }
 
+// Returns true if useful runnable processes exists
+int runQueIdleProcChk() {
+  return ProcessRunnable() > 0;
+}
 
+// Copies the scheduler statistics for process pid, or for the whole
+// system if pid is -1, into stats.  Returns PROCESS_FAIL if there's no
+// such process.
+int ProcessGetSchedStats(int pid, SchedStats *stats) {
+  if (pid == -1) {
+    bcopy((char *)&schedStats, (char *)stats, sizeof(SchedStats));
+    return PROCESS_SUCCESS;
+  }
+  if ((pid < 0) || (pid >= PROCESS_MAX_PROCS) || (pcbs[pid].flags & PROCESS_STATUS_FREE)) {
+    return PROCESS_FAIL;
+  }
+  bcopy((char *)&pcbs[pid].stats, (char *)stats, sizeof(SchedStats));
+  return PROCESS_SUCCESS;
+}
 
-int pow(int base, int exp) {
-  int i;
-  int temp = 1;
-
-  for (i = 0; i < exp; ++i) {
-    temp = temp * base;     
+// Returns the PCB of process pid, or NULL if there's no such process.
+PCB *ProcessFromPid(int pid) {
+  if ((pid < 0) || (pid >= PROCESS_MAX_PROCS) || (pcbs[pid].flags & PROCESS_STATUS_FREE)) {
+    return NULL;
   }
+  return &pcbs[pid];
+}
 
-  return temp;
-}
\ No newline at end of file
+void ProcessPrintRunQueues() {
+  SchedPrintRunQueues();
+}
@@ -8,10 +8,33 @@
 #include "ostraps.h"
 #include "dlxos.h"
 #include "queue.h"
+#include "spinlock.h"
 
-Queue		freeLinks;  // Stores all the free links in the system
 static Link	linkpool[QUEUE_MAX_LINKS]; // Memory space for each link, since we can't use malloc()
 
+// The pools are consecutive slices of linkpool, each with its own
+// free links, counters and lock.
+static Queue	freeLinks[QUEUE_NUM_POOLS];
+static Spinlock	poolLocks[QUEUE_NUM_POOLS];
+static QueuePoolStats poolStats[QUEUE_NUM_POOLS];
+static int	poolSizes[QUEUE_NUM_POOLS] = {
+  QUEUE_POOL_SCHED_LINKS, QUEUE_POOL_SYNCH_LINKS,
+  QUEUE_POOL_MBOX_LINKS, QUEUE_POOL_MISC_LINKS
+};
+static int	poolStart[QUEUE_NUM_POOLS + 1];
+
+// Which pool l came from, or -1 if it's embedded in an object
+static int AQueueLinkPool (Link *l) {
+  int pool;
+
+  if ((l < linkpool) || (l >= linkpool + QUEUE_MAX_LINKS)) {
+    return (-1);
+  }
+  for (pool = 0; (l - linkpool) >= poolStart[pool + 1]; pool++) {
+  }
+  return (pool);
+}
+
 //-------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////
@@ -35,19 +58,28 @@ int testfuncint() {
 int retzero();
 
 int AQueueModuleInit() {
-  int i;
-  if (AQueueInit(&freeLinks) != QUEUE_SUCCESS) {
-    printf("FATAL ERROR: could not initialize freeLinks queue in AQueueModuleInit!\n");
-    exitsim();
+  int i, pool = 0;
+
+  poolStart[0] = 0;
+  for (i = 0; i < QUEUE_NUM_POOLS; i++) {
+    if (AQueueInit(&freeLinks[i]) != QUEUE_SUCCESS) {
+      printf("FATAL ERROR: could not initialize freeLinks queue in AQueueModuleInit!\n");
+      exitsim();
+    }
+    poolStart[i + 1] = poolStart[i] + poolSizes[i];
+    bzero((char *)&poolStats[i], sizeof(QueuePoolStats));
+    poolStats[i].size = poolSizes[i];
+    SpinInit(&poolLocks[i], "link pool");
   }
   dbprintf ('q', "Initializing %d links.\n", QUEUE_MAX_LINKS);
   for (i = 0; i < QUEUE_MAX_LINKS; i++) {
+    if (i == poolStart[pool + 1]) pool++;
     // Initialize link structure
     linkpool[i].next = NULL;
     linkpool[i].prev = NULL;
     linkpool[i].object = NULL;
-    // Add link to freeLinks queue
-    if (AQueueInsertLast(&freeLinks, &(linkpool[i])) != QUEUE_SUCCESS) {
+    // Add link to its pool's free links
+    if (AQueueInsertLast(&freeLinks[pool], &(linkpool[i])) != QUEUE_SUCCESS) {
       printf("FATAL ERROR: could not insert link into freeLinks in AQueueModuleInit!\n"); // Adds structure to global queue of free links
       exitsim();
     }
@@ -81,18 +113,28 @@ int AQueueInit (Queue *q) {
 // Gets an empty link structure from the global queue
 // of empty links.
 ///////////////////////////////////////////////////////
-Link *AQueueAllocLink (void *obj_to_store) {
-  extern Queue	freeLinks;
+Link *AQueueAllocLink (int pool, void *obj_to_store) {
   Link	*l=NULL;
+  Queue	*fl;
+  int	intrs;
 
-  dbprintf('q', "AQueueAllocLink: allocating link\n");
-  if (AQueueEmpty(&freeLinks)) {
-    dbprintf('q', "AQueueAllocLink: no free links!\n");
+  dbprintf('q', "AQueueAllocLink: allocating link from pool %d\n", pool);
+  if ((pool < 0) || (pool >= QUEUE_NUM_POOLS)) {
+    dbprintf('q', "AQueueAllocLink: no pool %d!\n", pool);
+    return NULL;
+  }
+  fl = &freeLinks[pool];
+  intrs = SpinLock(&poolLocks[pool]);
+  if (AQueueEmpty(fl)) {
+    dbprintf('q', "AQueueAllocLink: no free links in pool %d!\n", pool);
+    poolStats[pool].failures++;
+    SpinUnlock(&poolLocks[pool], intrs);
     return NULL;
   }
-  l = AQueueFirst(&freeLinks);
+  l = AQueueFirst(fl);
   if (!l) {
     dbprintf('q', "AQueueAllocLink: first link in freeLinks is NULL!\n");
+    SpinUnlock(&poolLocks[pool], intrs);
     return NULL;
   }
 
@@ -101,20 +143,50 @@ Link *AQueueAllocLink (void *obj_to_store) {
   // manually.
   
   // First fix freeLinks structure
-  if (freeLinks.first == l) freeLinks.first = l->next;
-  if (freeLinks.last == l) freeLinks.last = l->prev;
-  freeLinks.nitems--;
+  if (fl->first == l) fl->first = l->next;
+  if (fl->last == l) fl->last = l->prev;
+  fl->nitems--;
 
   // Next, fix list around l
   if (l->prev) l->prev->next = l->next;
   if (l->next) l->next->prev = l->prev;
 
+  poolStats[pool].allocs++;
+  if (++poolStats[pool].inuse > poolStats[pool].highwater) {
+    poolStats[pool].highwater = poolStats[pool].inuse;
+  }
+  SpinUnlock(&poolLocks[pool], intrs);
+
   // Finally, reset l's internal pointers to NULL for safety
   l->next = NULL;
   l->prev = NULL;
   l->queue = NULL;
   l->object = obj_to_store;
+  return l;
+}
+
+/////////////////////////////////////////////////////////////////
+// Copies pool's usage counters into *stats
+/////////////////////////////////////////////////////////////////
+int AQueuePoolStats (int pool, QueuePoolStats *stats) {
+  int intrs;
 
+  if ((pool < 0) || (pool >= QUEUE_NUM_POOLS)) return QUEUE_FAIL;
+  intrs = SpinLock(&poolLocks[pool]);
+  bcopy((char *)&poolStats[pool], (char *)stats, sizeof(QueuePoolStats));
+  SpinUnlock(&poolLocks[pool], intrs);
+  return QUEUE_SUCCESS;
+}
+
+/////////////////////////////////////////////////////////////////
+// Sets up a link embedded in the object it stores.  Such links
+// never come from or go back to linkpool.
+/////////////////////////////////////////////////////////////////
+Link *AQueueLinkInit (Link *l, void *object) {
+  l->next = NULL;
+  l->prev = NULL;
+  l->queue = NULL;
+  l->object = object;
   return l;
 }
 
@@ -123,8 +195,9 @@ Link *AQueueAllocLink (void *obj_to_store) {
 // adds it back to the global queue of free links.
 /////////////////////////////////////////////////////////////////
 int AQueueRemove (Link **pl) {
-  extern Queue freeLinks;
   Link *l = NULL;
+  int pool;
+  int intrs;
 
   dbprintf('q', "AQueueRemove: removing link\n");
 
@@ -145,12 +218,45 @@ int AQueueRemove (Link **pl) {
   l->queue->nitems--;
 
   // Clear the link, and add it back to the link back to the list of free links
-  AQueueInsertLast(&freeLinks, l);
+  // (embedded links aren't the pool's to take back)
+  if ((pool = AQueueLinkPool(l)) >= 0) {
+    intrs = SpinLock(&poolLocks[pool]);
+    AQueueInsertLast(&freeLinks[pool], l);
+    poolStats[pool].inuse--;
+    SpinUnlock(&poolLocks[pool], intrs);
+  } else {
+    l->next = NULL;
+    l->prev = NULL;
+    l->queue = NULL;
+  }
 
   *pl = NULL;
   return QUEUE_SUCCESS;
 }
 
+/////////////////////////////////////////////////////////////////
+// Takes link "l" off the queue that it belongs to but, unlike
+// AQueueRemove, keeps it, so it can be inserted into another
+// queue without freeing and allocating a link.
+/////////////////////////////////////////////////////////////////
+int AQueueUnlink (Link *l) {
+  dbprintf('q', "AQueueUnlink: unlinking link\n");
+
+  if (!l) return QUEUE_FAIL;
+  if (!l->queue) return QUEUE_FAIL;
+
+  if (AQueueFirst(l->queue) == l) l->queue->first = l->next;
+  if (AQueueLast(l->queue) == l)  l->queue->last = l->prev;
+  if (l->prev) l->prev->next = l->next;
+  if (l->next) l->next->prev = l->prev;
+  l->queue->nitems--;
+
+  l->next = NULL;
+  l->prev = NULL;
+  l->queue = NULL;
+  return QUEUE_SUCCESS;
+}
+
 //-------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////
@@ -329,3 +435,202 @@ int AQueueLength(Queue *q) { return q->nitems; }
 int AQueueEmpty (Queue *q) { return (AQueueLength (q) == 0); }
 
 
+
+
+//-------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////
+//
+// Priority queues
+//
+///////////////////////////////////////////////////////
+
+//-------------------------------------------------------------------------
+
+// Whether link "a" comes out of its priority queue before link "b"
+static int PQueueBefore (PQLink *a, PQLink *b) {
+  if (a->key != b->key) return (a->key - b->key < 0);
+  return ((int)(a->seq - b->seq) < 0);
+}
+
+// Melds the heaps rooted at "a" and "b" (either may be NULL) into one
+// and returns its root: the later of the two becomes the first child
+// of the other.  Both must be roots, with no siblings.
+static PQLink *PQueueMeld (PQLink *a, PQLink *b) {
+  PQLink *t;
+
+  if (!a) return b;
+  if (!b) return a;
+  if (PQueueBefore(b, a)) {
+    t = a;
+    a = b;
+    b = t;
+  }
+  b->prev = a;
+  b->next = a->child;
+  if (a->child) a->child->prev = b;
+  a->child = b;
+  a->next = NULL;
+  a->prev = NULL;
+  return a;
+}
+
+// Melds the list of siblings starting at "first" into one heap and
+// returns its root.  This is the pairing heap's two pass merge: meld
+// them in pairs from the left, then meld the pairs into the last one
+// from the right.  Done with a loop rather than by recursion, since
+// the list can be as long as the queue.
+static PQLink *PQueueMergePairs (PQLink *first) {
+  PQLink *a, *b, *h;
+  PQLink *pairs = NULL;   // Melded pairs, the last one first
+
+  while (first) {
+    a = first;
+    b = a->next;
+    first = b ? b->next : NULL;
+    a->next = a->prev = NULL;
+    if (b) {
+      b->next = b->prev = NULL;
+      a = PQueueMeld(a, b);
+    }
+    a->next = pairs;
+    pairs = a;
+  }
+  if (!pairs) return NULL;
+  h = pairs;
+  pairs = h->next;
+  h->next = NULL;
+  while (pairs) {
+    a = pairs;
+    pairs = a->next;
+    a->next = NULL;
+    h = PQueueMeld(h, a);
+  }
+  return h;
+}
+
+// Takes link "l", which isn't the root, and its subtrees out of its
+// parent's list of children
+static void PQueueCut (PQLink *l) {
+  if (l->prev->child == l) l->prev->child = l->next;
+  else                     l->prev->next = l->next;
+  if (l->next) l->next->prev = l->prev;
+  l->next = NULL;
+  l->prev = NULL;
+}
+
+///////////////////////////////////////////////////////
+// Initializes a given priority queue to zero items
+///////////////////////////////////////////////////////
+int PQueueInit (PQueue *q) {
+  if (!q) return QUEUE_FAIL;
+  q->root = NULL;
+  q->nitems = 0;
+  q->seq = 0;
+  return QUEUE_SUCCESS;
+}
+
+/////////////////////////////////////////////////////////////////
+// Sets up a priority queue link embedded in the object it
+// stores
+/////////////////////////////////////////////////////////////////
+PQLink *PQueueLinkInit (PQLink *l, void *object) {
+  l->child = NULL;
+  l->next = NULL;
+  l->prev = NULL;
+  l->queue = NULL;
+  l->key = 0;
+  l->object = object;
+  return l;
+}
+
+/////////////////////////////////////////////////////////////////
+// Inserts link "l" into priority queue "q" with key "key"
+/////////////////////////////////////////////////////////////////
+int PQueueInsert (PQueue *q, PQLink *l, int key) {
+  if (!q) return QUEUE_FAIL;
+  if (!l) return QUEUE_FAIL;
+  if (l->queue) return QUEUE_FAIL; // Already on one
+
+  l->key = key;
+  l->seq = q->seq++;
+  l->child = NULL;
+  l->next = NULL;
+  l->prev = NULL;
+  l->queue = q;
+  q->root = PQueueMeld(q->root, l);
+  q->nitems++;
+  return QUEUE_SUCCESS;
+}
+
+/////////////////////////////////////////////////////////////////
+// Takes link "l" off its priority queue.  Its subtrees are
+// merged, and put back in its place.
+/////////////////////////////////////////////////////////////////
+int PQueueRemove (PQLink *l) {
+  PQueue *q;
+  PQLink *sub;
+
+  if (!l) return QUEUE_FAIL;
+  if (!(q = l->queue)) return QUEUE_FAIL;
+
+  sub = PQueueMergePairs(l->child);
+  if (q->root == l) {
+    q->root = sub;
+  } else {
+    PQueueCut(l);
+    q->root = PQueueMeld(q->root, sub);
+  }
+  q->nitems--;
+
+  l->child = NULL;
+  l->queue = NULL;
+  return QUEUE_SUCCESS;
+}
+
+/////////////////////////////////////////////////////////////////
+// Takes the first link off priority queue "q" and returns it
+/////////////////////////////////////////////////////////////////
+PQLink *PQueueRemoveFirst (PQueue *q) {
+  PQLink *l;
+
+  if (!q) return NULL;
+  if (!(l = q->root)) return NULL;
+  PQueueRemove(l);
+  return l;
+}
+
+/////////////////////////////////////////////////////////////////
+// Gives link "l" key "key".  An earlier key only has to cut l
+// (with its subtrees, which still come after it) loose and meld
+// it with the root; a later one takes it off and puts it back.
+/////////////////////////////////////////////////////////////////
+int PQueueChangeKey (PQLink *l, int key) {
+  PQueue *q;
+
+  if (!l) return QUEUE_FAIL;
+  if (!(q = l->queue)) return QUEUE_FAIL;
+
+  if (key - l->key >= 0) {
+    if (key == l->key) return QUEUE_SUCCESS;
+    PQueueRemove(l);
+    return PQueueInsert(q, l, key);
+  }
+  l->key = key;
+  if (q->root != l) {
+    PQueueCut(l);
+    q->root = PQueueMeld(q->root, l);
+  }
+  return QUEUE_SUCCESS;
+}
+
+// Returns the link with the smallest key in priority queue "q"
+PQLink *PQueueFirst (PQueue *q) { return q->root; }
+// Returns the object pointer in a priority queue link
+void *PQueueObject (PQLink *l) { return l->object; }
+// Returns the key of a priority queue link
+int PQueueKey (PQLink *l) { return l->key; }
+// Returns the number of links in priority queue "q"
+int PQueueLength (PQueue *q) { return q->nitems; }
+// Returns true if priority queue "q" is empty, false otherwise
+int PQueueEmpty (PQueue *q) { return (PQueueLength(q) == 0); }
@@ -0,0 +1,548 @@
+//
+//  sched.c
+//
+//  Scheduler policies.  Each one is a SchedOps table; SchedSelect
+//  picks one by name before SchedModuleInit, and everything in
+//  process.c goes through "sched" from then on.
+//
+//  Both policies keep the PCBs they consider runnable on their own
+//  queues, so pcb->l is handled the same way no matter which one is
+//  in use: it's a fresh link on enqueue and gets freed on dequeue.
+//
+
+#include "ostraps.h"
+#include "dlxos.h"
+#include "process.h"
+#include "queue.h"
+#include "sched.h"
+#include "traps.h"
+
+// The idle process, once SchedSetIdle has been told about it
+static PCB *schedIdle;
+
+//----------------------------------------------------------------------
+//
+//  Multilevel queues
+//
+//  The 4.4BSD scheme: priority comes from estcpu and pnice, and each
+//  run queue holds PRIORITIES_PER_QUEUE priorities.  The best PCB is
+//  at the front of the first non-empty queue.
+//
+//----------------------------------------------------------------------
+
+// List of processes that are ready to run (ie, not waiting for something
+// to happen).
+static Queue runQueues[NUM_RUN_QUEUES];
+
+// Bit i is set when runQueues[i] isn't empty, and runQueueProcs counts
+// the PCBs on all of them, so the scheduler never has to walk the
+// queues to find the best one or to see if anything but the idle
+// process can run.
+static uint32 runQueueBits;
+static int runQueueProcs;
+
+// Counter of quanta jiffies
+static int cntQuantaJ;
+
+// estcpu decays once per epoch (CPU_WINDOWS_BETWEEN_DECAYS quanta), but
+// only gets brought up to date when a PCB is looked at;
+// estcpuDecay[n] is the fixed point factor for n epochs.
+static int decayEpoch;
+static int estcpuDecay[ESTCPU_DECAY_EPOCHS];
+
+// Timeslice, in jiffies, for each band of run queues
+static int mlqBandQuantum[MLQ_QUANTUM_BANDS];
+
+static inline int WhichQueue(PCB *pcb) {
+  return pcb->priority / PRIORITIES_PER_QUEUE;
+}
+
+// Brings a runnable pcb's estcpu up to the current decay epoch.  Each
+// epoch is estcpu = estcpu * 2L/(2L+1) + pnice, so n of them at once
+// are estcpu * f^n + pnice * (1 - f^n)/(1 - f), with 1/(1 - f) = 2L+1.
+static void MlqDecayEstcpu(PCB *pcb) {
+  int n = decayEpoch - pcb->estcpuEpoch;
+  int f;
+
+  if (n <= 0) {
+    return;
+  }
+  f = (n < ESTCPU_DECAY_EPOCHS) ? estcpuDecay[n] : 0;
+  pcb->estcpu = ((pcb->estcpu * f) >> ESTCPU_SHIFT)
+              + pcb->pnice * (2 * PROCESS_LOAD + 1) * (ESTCPU_ONE - f);
+  pcb->estcpuEpoch = decayEpoch;
+}
+
+// Like MlqDecayEstcpu, but for a pcb that has been asleep since it
+// was last brought up to date, so no pnice is added.
+static void MlqDecayEstcpuSleep(PCB *pcb) {
+  int n = decayEpoch - pcb->estcpuEpoch;
+
+  if (n > 0) {
+    pcb->estcpu = (n < ESTCPU_DECAY_EPOCHS) ? ((pcb->estcpu * estcpuDecay[n]) >> ESTCPU_SHIFT) : 0;
+  }
+  pcb->estcpuEpoch = decayEpoch;
+}
+
+// Returns true if pcb is on one of the run queues.
+static int MlqOnRunQueue(PCB *pcb) {
+  Queue *q;
+
+  if ((pcb == NULL) || (pcb->l == NULL)) {
+    return 0;
+  }
+  q = pcb->l->queue;
+  return ((q >= runQueues) && (q < runQueues + NUM_RUN_QUEUES));
+}
+
+// Recomputes pcb's priority.  If it's on a run queue and the new
+// priority belongs in a different one, the PCB's link is moved to the
+// end of that queue; otherwise it stays where it is.
+static void MlqRecalcPriority(PCB *pcb) {
+  int oldq = WhichQueue(pcb);
+  int newq;
+  int cpu;
+
+  if (pcb == schedIdle) {
+    return;
+  }
+  MlqDecayEstcpu(pcb);
+  cpu = (pcb->estcpu >> ESTCPU_SHIFT) / 4;
+  if(pcb->flags & PROCESS_TYPE_USER) {
+    pcb->priority = USER_PROCESS_BASE_PRIORITY + cpu + 2 * pcb->pnice;
+  } else {
+    pcb->priority = KERNEL_PROCESS_BASE_PRIORITY + cpu + 2 * pcb->pnice;
+  }
+  // A lock holder runs at least at its most urgent waiter's priority;
+  // a real time waiter lifts it to the top.
+  if (pcb->donor != NULL) {
+    if (pcb->donor->flags & PROCESS_TYPE_REALTIME) {
+      pcb->priority = 0;
+    } else if (pcb->donor->priority < pcb->priority) {
+      pcb->priority = pcb->donor->priority;
+    }
+  }
+  newq = WhichQueue(pcb);
+  if ((newq == oldq) || !MlqOnRunQueue(pcb)) {
+    return;
+  }
+  if (AQueueUnlink(pcb->l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not unlink process from run Queue in MlqRecalcPriority!\n");
+    exitsim();
+  }
+  if (AQueueEmpty(&runQueues[oldq])) {
+    runQueueBits &= ~(1 << oldq);
+  }
+  if (AQueueInsertLast(&runQueues[newq], pcb->l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert link into runQueue in MlqRecalcPriority!\n");
+    exitsim();
+  }
+  runQueueBits |= 1 << newq;
+}
+
+static void MlqInit() {
+  int i;
+
+  for(i = 0; i < NUM_RUN_QUEUES; i++) {
+    AQueueInit(&runQueues[i]);
+  }
+  runQueueBits = 0;
+  runQueueProcs = 0;
+  cntQuantaJ = 0;
+  decayEpoch = 0;
+  estcpuDecay[0] = ESTCPU_ONE;
+  for(i = 1; i < ESTCPU_DECAY_EPOCHS; i++) {
+    estcpuDecay[i] = estcpuDecay[i-1] * (2 * PROCESS_LOAD) / (2 * PROCESS_LOAD + 1);
+  }
+  mlqBandQuantum[0] = PROCESS_QUANTUM_JIFFIES / 2;
+  if (mlqBandQuantum[0] < 1) {
+    mlqBandQuantum[0] = 1;
+  }
+  for(i = 1; i < MLQ_QUANTUM_BANDS; i++) {
+    mlqBandQuantum[i] = 2 * mlqBandQuantum[i-1];
+  }
+}
+
+static void MlqFork(PCB *pcb) {
+  if (pcb->flags & PROCESS_TYPE_USER) {
+    pcb->priority = USER_PROCESS_BASE_PRIORITY + 2 * pcb->pnice;
+  } else {
+    pcb->priority = KERNEL_PROCESS_BASE_PRIORITY + 2 * pcb->pnice;
+  }
+  pcb->estcpu = 0;
+  pcb->estcpuEpoch = decayEpoch;
+}
+
+static void MlqEnqueue(PCB *pcb) {
+  int i = WhichQueue(pcb);
+
+  if (AQueueInsertLast(&runQueues[i], pcb->l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert link into runQueue in MlqEnqueue!\n");
+    exitsim();
+  }
+  runQueueBits |= 1 << i;
+  runQueueProcs++;
+}
+
+// Removes pcb's link from its run queue, as AQueueRemove does, keeping
+// runQueueBits and runQueueProcs right.  estcpu is brought up to date
+// first, so that time spent off the run queues only decays it.
+static int MlqDequeue(PCB *pcb) {
+  Queue *q = pcb->l->queue;
+
+  MlqDecayEstcpu(pcb);
+  if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
+    return QUEUE_FAIL;
+  }
+  if (AQueueEmpty(q)) {
+    runQueueBits &= ~(1 << (q - runQueues));
+  }
+  runQueueProcs--;
+  return QUEUE_SUCCESS;
+}
+
+static PCB *MlqPickNext() {
+  if (runQueueBits == 0) {
+    return NULL;
+  }
+  return (PCB *)AQueueObject(AQueueFirst(&runQueues[FindFirstSet(runQueueBits)]));
+}
+
+// The running process was the one in front of its queue: move it to
+// the end (the round robin inside a queue), charge it for the part of
+// a PROCESS_QUANTUM_JIFFIES quantum it used (slices vary by band), and
+// start a new decay epoch every CPU_WINDOWS_BETWEEN_DECAYS quanta.
+static void MlqTick(PCB *pcb, int jiffies) {
+  Queue *q;
+
+  if(pcb->flags & PROCESS_STATUS_RUNNABLE) {
+    q = &runQueues[WhichQueue(pcb)];
+    // pcb->l rather than the front: an inherited priority may have
+    // moved pcb to another queue while it ran
+    AQueueMoveAfter(q, AQueueLast(q), pcb->l);
+    pcb->estcpu += (ESTCPU_ONE * jiffies) / PROCESS_QUANTUM_JIFFIES;
+    MlqRecalcPriority(pcb);
+  }
+  cntQuantaJ += jiffies;
+  if(cntQuantaJ >= CPU_WINDOWS_BETWEEN_DECAYS * PROCESS_QUANTUM_JIFFIES) {
+    decayEpoch++;
+    cntQuantaJ = 0;
+  }
+}
+
+static void MlqWakeup(PCB *pcb) {
+  MlqDecayEstcpuSleep(pcb);
+  MlqRecalcPriority(pcb);
+}
+
+// The idle process always sits alone at the lowest priority.
+static void MlqSetIdle(PCB *pcb) {
+  int wasQueued = MlqOnRunQueue(pcb);
+
+  if (wasQueued && (MlqDequeue(pcb) != QUEUE_SUCCESS)) {
+    printf("FATAL ERROR: could not remove idle process from run Queue in MlqSetIdle!\n");
+    exitsim();
+  }
+  pcb->priority = 127;
+  if (wasQueued) {
+    pcb->l = AQueueLinkInit(&pcb->link, pcb);
+    MlqEnqueue(pcb);
+  }
+}
+
+static int MlqBusy() {
+  return runQueueProcs - MlqOnRunQueue(schedIdle);
+}
+
+// The idle process gets the shortest slice so that sleepers coming due
+// are noticed quickly.
+static int MlqQuantum(PCB *pcb) {
+  if (pcb == schedIdle) {
+    return mlqBandQuantum[0];
+  }
+  return mlqBandQuantum[WhichQueue(pcb) * MLQ_QUANTUM_BANDS / NUM_RUN_QUEUES];
+}
+
+static int MlqBefore(PCB *a, PCB *b) {
+  return a->priority < b->priority;
+}
+
+static SchedOps mlqOps = {
+  "mlq", MlqInit, MlqFork, MlqEnqueue, MlqDequeue, MlqPickNext,
+  MlqTick, MlqWakeup, MlqSetIdle, MlqOnRunQueue, MlqBusy, MlqQuantum,
+  MlqRecalcPriority, MlqBefore
+};
+
+//----------------------------------------------------------------------
+//
+//  Stride scheduling
+//
+//  Every runnable PCB has a pass value and the one with the lowest
+//  pass runs next.  Running advances pass by its stride, which is
+//  inversely proportional to its tickets, so CPU time is shared in
+//  proportion to tickets.  Runnable PCBs are kept on strideQueue (for
+//  their links) and in a binary min-heap on pass, so picking is O(1)
+//  and charging is O(log n).  The idle process stays out of the heap
+//  and only runs when the heap is empty.
+//
+//----------------------------------------------------------------------
+
+static Queue strideQueue;
+static PCB *strideHeap[PROCESS_MAX_PROCS];
+static int strideHeapSize;
+
+// Pass of the PCB picked last; PCBs that join the run queue start here
+// so that sleeping doesn't bank CPU time.
+static int strideGlobalPass;
+
+// a runs before b.  Differences keep this right if pass wraps.
+static inline int StrideBefore(PCB *a, PCB *b) {
+  return (a->pass - b->pass) < 0;
+}
+
+static inline void StrideHeapSet(int i, PCB *pcb) {
+  strideHeap[i] = pcb;
+  pcb->heapIndex = i;
+}
+
+static void StrideSiftUp(int i) {
+  PCB *pcb = strideHeap[i];
+
+  while ((i > 0) && StrideBefore(pcb, strideHeap[(i - 1) / 2])) {
+    StrideHeapSet(i, strideHeap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  StrideHeapSet(i, pcb);
+}
+
+static void StrideSiftDown(int i) {
+  PCB *pcb = strideHeap[i];
+  int child;
+
+  while ((child = 2 * i + 1) < strideHeapSize) {
+    if ((child + 1 < strideHeapSize) && StrideBefore(strideHeap[child + 1], strideHeap[child])) {
+      child++;
+    }
+    if (!StrideBefore(strideHeap[child], pcb)) {
+      break;
+    }
+    StrideHeapSet(i, strideHeap[child]);
+    i = child;
+  }
+  StrideHeapSet(i, pcb);
+}
+
+static void StrideHeapRemove(PCB *pcb) {
+  int i = pcb->heapIndex;
+
+  if (i < 0) {
+    return;
+  }
+  pcb->heapIndex = -1;
+  if (--strideHeapSize == i) {
+    return;
+  }
+  StrideHeapSet(i, strideHeap[strideHeapSize]);
+  StrideSiftUp(i);
+  StrideSiftDown(strideHeap[i]->heapIndex);
+}
+
+static void StrideInit() {
+  AQueueInit(&strideQueue);
+  strideHeapSize = 0;
+  strideGlobalPass = 0;
+}
+
+static void StrideFork(PCB *pcb) {
+  pcb->tickets = STRIDE_BASE_TICKETS - STRIDE_TICKETS_PER_NICE * pcb->pnice;
+  if (pcb->tickets < 1) {
+    pcb->tickets = 1;
+  }
+  pcb->stride = STRIDE_ONE / pcb->tickets;
+  pcb->pass = strideGlobalPass;
+  pcb->heapIndex = -1;
+}
+
+static void StrideEnqueue(PCB *pcb) {
+  if (AQueueInsertLast(&strideQueue, pcb->l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert link into strideQueue in StrideEnqueue!\n");
+    exitsim();
+  }
+  if (pcb == schedIdle) {
+    return;
+  }
+  if ((pcb->pass - strideGlobalPass) < 0) {
+    pcb->pass = strideGlobalPass;
+  }
+  StrideHeapSet(strideHeapSize++, pcb);
+  StrideSiftUp(pcb->heapIndex);
+}
+
+static int StrideDequeue(PCB *pcb) {
+  StrideHeapRemove(pcb);
+  return AQueueRemove(&(pcb->l));
+}
+
+static PCB *StridePickNext() {
+  if (strideHeapSize == 0) {
+    return schedIdle;
+  }
+  strideGlobalPass = strideHeap[0]->pass;
+  return strideHeap[0];
+}
+
+// Charges pcb for the part of a quantum it used, at least one jiffy's
+// worth, so a process that keeps giving up the CPU early still moves.
+// A lock holder is charged at its donor's stride if that's smaller.
+static void StrideTick(PCB *pcb, int jiffies) {
+  int charge;
+  int stride = pcb->stride;
+
+  if (!(pcb->flags & PROCESS_STATUS_RUNNABLE) || (pcb->heapIndex < 0)) {
+    return;
+  }
+  if ((pcb->donor != NULL) && !(pcb->donor->flags & PROCESS_TYPE_REALTIME) &&
+      (pcb->donor->stride < stride)) {
+    stride = pcb->donor->stride;
+  }
+  charge = (stride * jiffies) / PROCESS_QUANTUM_JIFFIES;
+  if (charge < 1) {
+    charge = 1;
+  }
+  pcb->pass += charge;
+  StrideSiftDown(pcb->heapIndex);
+}
+
+// Nothing to do: StrideEnqueue brings pass up to strideGlobalPass.
+static void StrideWakeup(PCB *pcb) {
+}
+
+static void StrideSetIdle(PCB *pcb) {
+  StrideHeapRemove(pcb);
+}
+
+static int StrideOnRunQueue(PCB *pcb) {
+  return (pcb != NULL) && (pcb->l != NULL) && (pcb->l->queue == &strideQueue);
+}
+
+static int StrideBusy() {
+  return strideHeapSize;
+}
+
+// Stride charges for the time actually used, so every PCB can get the
+// same slice.
+static int StrideQuantum(PCB *pcb) {
+  return PROCESS_QUANTUM_JIFFIES;
+}
+
+// A lock holder that's runnable takes its donor's pass if that comes
+// sooner (a real time donor's counts as now), so it runs when the donor
+// would have.  The time it runs is charged as usual, so nothing needs
+// undoing when the donation ends.
+static void StrideInherit(PCB *pcb) {
+  PCB *donor = pcb->donor;
+  int pass;
+
+  if ((donor == NULL) || (pcb->heapIndex < 0)) {
+    return;
+  }
+  pass = (donor->flags & PROCESS_TYPE_REALTIME) ? strideGlobalPass : donor->pass;
+  if ((pass - pcb->pass) < 0) {
+    pcb->pass = pass;
+    StrideSiftUp(pcb->heapIndex);
+  }
+}
+
+static SchedOps strideOps = {
+  "stride", StrideInit, StrideFork, StrideEnqueue, StrideDequeue, StridePickNext,
+  StrideTick, StrideWakeup, StrideSetIdle, StrideOnRunQueue, StrideBusy, StrideQuantum,
+  StrideInherit, StrideBefore
+};
+
+//----------------------------------------------------------------------
+//
+//  Policy selection
+//
+//----------------------------------------------------------------------
+
+static SchedOps *schedPolicies[] = { &mlqOps, &strideOps, NULL };
+
+SchedOps *sched = &mlqOps;
+
+int SchedSelect(char *name) {
+  int i;
+
+  for (i = 0; schedPolicies[i] != NULL; i++) {
+    if (dstrncmp(schedPolicies[i]->name, name, 80) == 0) {
+      sched = schedPolicies[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void SchedModuleInit() {
+  dbprintf ('p', "SchedModuleInit: using the %s scheduler\n", sched->name);
+  schedIdle = NULL;
+  sched->init();
+}
+
+// The CPU this is running on
+int SchedCpuId() {
+  return *((volatile uint32 *)DLX_SMP_CPUID);
+}
+
+// Tells the policy which PCB is the idle process.
+void SchedSetIdle(PCB *pcb) {
+  schedIdle = pcb;
+  sched->setIdle(pcb);
+}
+
+// Real time PCBs come before the policy's, and go by priority among
+// themselves.
+int SchedBefore(PCB *a, PCB *b) {
+  int art = a->flags & PROCESS_TYPE_REALTIME;
+  int brt = b->flags & PROCESS_TYPE_REALTIME;
+
+  if (art && brt) {
+    return a->priority < b->priority;
+  }
+  if (art || brt) {
+    return art != 0;
+  }
+  return sched->before(a, b);
+}
+
+// Makes donor (or nobody) pcb's donor and lets the policy re-rank it.
+// Real time PCBs have fixed priorities, so they keep theirs.
+void SchedInherit(PCB *pcb, PCB *donor) {
+  pcb->donor = donor;
+  if (!(pcb->flags & PROCESS_TYPE_REALTIME)) {
+    sched->inherit(pcb);
+  }
+}
+
+void SchedPrintRunQueues() {
+  int i;
+  Link* l;
+  PCB* pcb;
+
+  printf("Printing %s run queues....\n", sched->name);
+  if (sched == &strideOps) {
+    for (i = 0; i < strideHeapSize; i++) {
+      pcb = strideHeap[i];
+      printf("%d[pass %d, tickets %d], ", GetPidFromAddress(pcb), pcb->pass, pcb->tickets);
+    }
+    printf("\n");
+  } else {
+    for(i = 0; i < NUM_RUN_QUEUES; i++) {
+      printf("%d ", i);
+      for (l = AQueueFirst(&runQueues[i]); l != NULL; l = AQueueNext(l)) {
+        pcb = AQueueObject(l);
+        printf("%d[%d], ", GetPidFromAddress(pcb), pcb->priority);
+      }
+      printf("| \n");
+    }
+  }
+  printf("Finished printing run queues.\n");
+}
@@ -0,0 +1,264 @@
+//
+//	share_memory.c
+//
+//	Shared memory regions (see share_memory.h).  A region is one or
+//	more physical pages, mapped at consecutive virtual pages in every
+//	process that has it; its handle is its first physical page, so a
+//	one-page region is exactly the old shared page.  Each region
+//	counts the processes that have it mapped and goes back to the
+//	page allocator when the last one lets go.
+//
+//	A process's pages are pagetable[0..npages-1], so a region is
+//	mapped at the top.  Unmapping one that isn't at the top leaves
+//	invalid entries behind; they stay unused and fault if touched.
+//
+
+#include "ostraps.h"
+#include "dlxos.h"
+#include "process.h"
+#include "memory.h"
+#include "queue.h"
+#include "share_memory.h"
+
+typedef struct shared_region {
+  int		npages;		// 0 if the slot is free
+  int		refs;		// Processes that have it mapped
+  uint32	procs;		// Bit pid set: pid has it mapped (PROCESS_MAX_PROCS <= 32)
+  uint32	pages[PROCESS_MAX_PAGES];	// Physical pages; pages[0] is the handle
+} shared_region;
+
+static shared_region regions[MEMORY_MAX_SHARED_REGIONS];
+static int sharedpages;		// Pages in all regions together
+
+void ShareModuleInit() {
+  int i;
+
+  for (i = 0; i < MEMORY_MAX_SHARED_REGIONS; i++) {
+    regions[i].npages = 0;
+  }
+  sharedpages = 0;
+}
+
+//----------------------------------------------------------------------
+//	SharedFind, SharedFindPage
+//
+//	The region whose handle is handle, or which holds physical page
+//	page (the page's place in it goes in *index), or NULL.
+//----------------------------------------------------------------------
+static shared_region *SharedFind(uint32 handle) {
+  int i;
+
+  if (handle == 0) return NULL;
+  for (i = 0; i < MEMORY_MAX_SHARED_REGIONS; i++) {
+    if ((regions[i].npages > 0) && (regions[i].pages[0] == handle)) {
+      return &regions[i];
+    }
+  }
+  return NULL;
+}
+
+static shared_region *SharedFindPage(uint32 page, int *index) {
+  int i, j;
+
+  for (i = 0; i < MEMORY_MAX_SHARED_REGIONS; i++) {
+    for (j = 0; j < regions[i].npages; j++) {
+      if (regions[i].pages[j] == page) {
+        *index = j;
+        return &regions[i];
+      }
+    }
+  }
+  return NULL;
+}
+
+//----------------------------------------------------------------------
+//	SharedSetPtSize
+//
+//	Make pcb's page table size take effect the next time it returns
+//	to user mode.  That's always through the frame at the top of its
+//	system stack (see ProcessFork).
+//----------------------------------------------------------------------
+static void SharedSetPtSize(PCB *pcb) {
+  uint32 *frame = ((uint32 *)(pcb->sysStackArea + MEMORY_PAGE_SIZE)) -
+    (PROCESS_STACK_FRAME_SIZE + 8);
+
+  frame[PROCESS_STACK_PTSIZE] = pcb->npages;
+}
+
+//----------------------------------------------------------------------
+//	SharedVirtualPage
+//
+//	The virtual page region r starts at in pcb, or -1 if pcb doesn't
+//	have it mapped.
+//----------------------------------------------------------------------
+static int SharedVirtualPage(PCB *pcb, shared_region *r) {
+  int i;
+
+  if (!(r->procs & (1 << GetPidFromAddress(pcb)))) return -1;
+  for (i = 0; i < pcb->npages; i++) {
+    if ((pcb->pagetable[i] & MEMORY_PTE_VALID) &&
+        ((pcb->pagetable[i] & MEMORY_PTE_MASK) == r->pages[0] * MEMORY_PAGE_SIZE)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//----------------------------------------------------------------------
+//	SharedMap, SharedUnmap
+//
+//	Map region r at the top of pcb's address space and return the
+//	first virtual page, or -1 if it doesn't fit; take pcb's mapping
+//	away again, freeing the region if that was the last one.
+//	Interrupts must be disabled.
+//----------------------------------------------------------------------
+static int SharedMap(PCB *pcb, shared_region *r) {
+  int first = pcb->npages;
+  int i;
+
+  if (first + r->npages > PROCESS_MAX_PAGES) return -1;
+  for (i = 0; i < r->npages; i++) {
+    pcb->pagetable[first + i] = MemorySetupPte(r->pages[i]);
+  }
+  pcb->npages += r->npages;
+  SharedSetPtSize(pcb);
+  r->procs |= 1 << GetPidFromAddress(pcb);
+  r->refs++;
+  return first;
+}
+
+static void SharedUnmap(PCB *pcb, shared_region *r, int first) {
+  int i;
+
+  for (i = first; i < first + r->npages; i++) {
+    pcb->pagetable[i] = 0;
+  }
+  while ((pcb->npages > 0) && (pcb->pagetable[pcb->npages - 1] == 0)) {
+    pcb->npages--;
+  }
+  SharedSetPtSize(pcb);
+  r->procs &= ~(1 << GetPidFromAddress(pcb));
+  if (--r->refs == 0) {
+    dbprintf('m', "SharedUnmap: freeing region 0x%x (%d pages)\n", r->pages[0], r->npages);
+    for (i = 0; i < r->npages; i++) {
+      MemoryFreePage(r->pages[i]);
+    }
+    sharedpages -= r->npages;
+    r->npages = 0;
+  }
+}
+
+//----------------------------------------------------------------------
+//	MemoryCreateSharedRegion
+//
+//	Make a region of npages pages and map it into pcb.  Returns its
+//	handle, or 0 if pcb has no room for it or there aren't enough
+//	pages.
+//----------------------------------------------------------------------
+uint32 MemoryCreateSharedRegion(PCB *pcb, int npages) {
+  int intrs = DisableIntrs();
+  shared_region *r = NULL;
+  int i;
+
+  if ((npages <= 0) || (pcb->npages + npages > PROCESS_MAX_PAGES) ||
+      (sharedpages + npages > MEMORY_MAX_SHARED_PAGES)) {
+    RestoreIntrs(intrs);
+    return 0;
+  }
+  for (i = 0; i < MEMORY_MAX_SHARED_REGIONS; i++) {
+    if (regions[i].npages == 0) {
+      r = &regions[i];
+      break;
+    }
+  }
+  if (r == NULL) {
+    RestoreIntrs(intrs);
+    return 0;
+  }
+  for (i = 0; i < npages; i++) {
+    if ((r->pages[i] = MemoryAllocPage()) == 0) {
+      while (--i >= 0) {
+        MemoryFreePage(r->pages[i]);
+      }
+      RestoreIntrs(intrs);
+      return 0;
+    }
+  }
+  r->npages = npages;
+  r->refs = 0;
+  r->procs = 0;
+  sharedpages += npages;
+  SharedMap(pcb, r);
+  dbprintf('m', "MemoryCreateSharedRegion: region 0x%x of %d pages\n", r->pages[0], npages);
+  RestoreIntrs(intrs);
+  return r->pages[0];
+}
+
+uint32 MemoryCreateSharedPage(PCB *pcb) {
+  return MemoryCreateSharedRegion(pcb, 1);
+}
+
+//----------------------------------------------------------------------
+//	mmap
+//
+//	Map the region handle into pcb, if it isn't already, and return
+//	the virtual address it starts at.  Returns NULL if there's no
+//	such region or pcb has no room for it.
+//----------------------------------------------------------------------
+void *mmap(PCB *pcb, uint32 handle) {
+  int intrs = DisableIntrs();
+  shared_region *r = SharedFind(handle);
+  int first = -1;
+
+  if (r != NULL) {
+    if ((first = SharedVirtualPage(pcb, r)) < 0) {
+      first = SharedMap(pcb, r);
+    }
+  }
+  RestoreIntrs(intrs);
+  if (first < 0) return NULL;
+  return (void *)(first * MEMORY_PAGE_SIZE);
+}
+
+//----------------------------------------------------------------------
+//	MemoryFreeSharedPage
+//
+//	Take away pcb's mapping of the region handle.  Returns the number
+//	of processes that still have it, or -1 if pcb didn't.
+//----------------------------------------------------------------------
+int MemoryFreeSharedPage(PCB *pcb, uint32 handle) {
+  int intrs = DisableIntrs();
+  shared_region *r = SharedFind(handle);
+  int first, refs = -1;
+
+  if ((r != NULL) && ((first = SharedVirtualPage(pcb, r)) >= 0)) {
+    SharedUnmap(pcb, r, first);
+    refs = r->refs;
+  }
+  RestoreIntrs(intrs);
+  return refs;
+}
+
+//----------------------------------------------------------------------
+//	MemoryFreeSharedPte
+//
+//	If virtual page pagenumber of pcb is in a shared region, take
+//	away pcb's mapping of the whole region (its entries become 0).
+//	Returns the number of processes that still have the region, or
+//	-1 if the page isn't shared.
+//----------------------------------------------------------------------
+int MemoryFreeSharedPte(PCB *pcb, int pagenumber) {
+  int intrs = DisableIntrs();
+  uint32 pte = pcb->pagetable[pagenumber];
+  shared_region *r;
+  int index, refs = -1;
+
+  if ((pte & MEMORY_PTE_VALID) &&
+      ((r = SharedFindPage((pte & MEMORY_PTE_MASK) / MEMORY_PAGE_SIZE, &index)) != NULL) &&
+      (r->procs & (1 << GetPidFromAddress(pcb)))) {
+    SharedUnmap(pcb, r, pagenumber - index);
+    refs = r->refs;
+  }
+  RestoreIntrs(intrs);
+  return refs;
+}
@@ -0,0 +1,54 @@
+//
+//	spinlock.c
+//
+//	Kernel spinlocks (see spinlock.h).
+//
+
+#include "ostraps.h"
+#include "dlxos.h"
+#include "process.h"
+#include "sched.h"
+#include "spinlock.h"
+
+void SpinInit(Spinlock *l, char *name) {
+  l->held = 0;
+  l->cpu = -1;
+  l->name = name;
+}
+
+//----------------------------------------------------------------------
+//
+//	SpinLock
+//
+//	Turn interrupts off on this CPU and take l, spinning while another
+//	CPU has it.  Returns the interrupt level from before, for
+//	SpinUnlock.  Taking a lock this CPU already holds could only spin
+//	for ever, so it's fatal.
+//
+//----------------------------------------------------------------------
+int SpinLock(Spinlock *l) {
+  int intrs = DisableIntrs();
+  int cpu = SchedCpuId();
+
+  if (l->held && (l->cpu == cpu)) {
+    printf("FATAL ERROR: CPU %d took spinlock %s twice!\n", cpu, l->name);
+    exitsim();
+  }
+  while (TestAndSet(&l->held)) {
+    // Read until it looks free, so the tas isn't retried on every turn
+    while (l->held) {
+    }
+  }
+  l->cpu = cpu;
+  return intrs;
+}
+
+void SpinUnlock(Spinlock *l, int intrs) {
+  l->cpu = -1;
+  l->held = 0;
+  RestoreIntrs(intrs);
+}
+
+int SpinHeld(Spinlock *l) {
+  return l->held && (l->cpu == SchedCpuId());
+}
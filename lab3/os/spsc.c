@@ -0,0 +1,167 @@
+//
+//	spsc.c
+//
+//	Single producer, single consumer rings (see spsc.h).  A sleeper
+//	sets its waiting flag and then looks at the ring again before
+//	sem_wait, so an element published in between is never missed.
+//	If the other side signals although that second look found
+//	something, the semaphore keeps the count, the next sem_wait
+//	returns at once and the loop just checks the ring once more.
+//
+//	This is linked into user programs, not the operating system.
+//
+
+#include "usertraps.h"
+#include "spsc.h"
+
+//----------------------------------------------------------------------
+//	SpscSlot
+//
+//	Returns the address of the slot counter n maps to.
+//----------------------------------------------------------------------
+static char *SpscSlot(spsc_t *r, unsigned int n) {
+  return ((char *)&r->data) + (n & r->mask) * r->elemsize;
+}
+
+static void SpscCopy(char *to, char *from, int n) {
+  while (n-- > 0) *to++ = *from++;
+}
+
+int spsc_init(spsc_t *r, int bytes, int elemsize) {
+  unsigned int slots;
+
+  if ((elemsize <= 0) || (bytes < sizeof(spsc_t))) return SPSC_FAIL;
+  slots = (bytes - ((char *)&r->data - (char *)r)) / elemsize;
+  if (slots == 0) return SPSC_FAIL;
+  // Round down to a power of two
+  while (slots & (slots - 1)) slots &= slots - 1;
+  r->head = r->tail = 0;
+  r->getWaiting = r->putWaiting = 0;
+  r->mask = slots - 1;
+  r->elemsize = elemsize;
+  if ((r->s_items = sem_create(0)) == SYNC_FAIL) return SPSC_FAIL;
+  if ((r->s_space = sem_create(0)) == SYNC_FAIL) {
+    sem_destroy(r->s_items);
+    return SPSC_FAIL;
+  }
+  return slots;
+}
+
+void spsc_destroy(spsc_t *r) {
+  sem_destroy(r->s_items);
+  sem_destroy(r->s_space);
+}
+
+//----------------------------------------------------------------------
+//	SpscFree, SpscReady
+//
+//	Wait until the ring has at least one free (filled) slot, and
+//	return how many.  Only these ever trap, and only when the first
+//	look comes up empty.
+//----------------------------------------------------------------------
+static unsigned int SpscFree(spsc_t *r) {
+  unsigned int n;
+
+  while ((n = r->mask + 1 - (r->tail - r->head)) == 0) {
+    r->putWaiting = 1;
+    if (r->tail - r->head <= r->mask) {
+      r->putWaiting = 0;
+      continue;
+    }
+    sem_wait(r->s_space);
+  }
+  return n;
+}
+
+static unsigned int SpscReady(spsc_t *r) {
+  unsigned int n;
+
+  while ((n = r->tail - r->head) == 0) {
+    r->getWaiting = 1;
+    if (r->tail != r->head) {
+      r->getWaiting = 0;
+      continue;
+    }
+    sem_wait(r->s_items);
+  }
+  return n;
+}
+
+//----------------------------------------------------------------------
+//	SpscPublish, SpscRelease
+//
+//	Make n newly written (read) slots visible to the other side,
+//	waking it only if it said it was going to sleep.
+//----------------------------------------------------------------------
+static void SpscPublish(spsc_t *r, unsigned int n) {
+  r->tail += n;
+  if (r->getWaiting) {
+    r->getWaiting = 0;
+    sem_signal(r->s_items);
+  }
+}
+
+static void SpscRelease(spsc_t *r, unsigned int n) {
+  r->head += n;
+  if (r->putWaiting) {
+    r->putWaiting = 0;
+    sem_signal(r->s_space);
+  }
+}
+
+void spsc_put(spsc_t *r, void *elem) {
+  SpscFree(r);
+  SpscCopy(SpscSlot(r, r->tail), (char *)elem, r->elemsize);
+  SpscPublish(r, 1);
+}
+
+void spsc_get(spsc_t *r, void *elem) {
+  SpscReady(r);
+  SpscCopy((char *)elem, SpscSlot(r, r->head), r->elemsize);
+  SpscRelease(r, 1);
+}
+
+int spsc_tryput(spsc_t *r, void *elem) {
+  if (r->tail - r->head > r->mask) return 0;
+  SpscCopy(SpscSlot(r, r->tail), (char *)elem, r->elemsize);
+  SpscPublish(r, 1);
+  return 1;
+}
+
+int spsc_tryget(spsc_t *r, void *elem) {
+  if (r->tail == r->head) return 0;
+  SpscCopy((char *)elem, SpscSlot(r, r->head), r->elemsize);
+  SpscRelease(r, 1);
+  return 1;
+}
+
+void spsc_put_many(spsc_t *r, void *elems, int n) {
+  char *from = (char *)elems;
+  unsigned int room, i;
+
+  while (n > 0) {
+    room = SpscFree(r);
+    if (room > n) room = n;
+    for (i = 0; i < room; i++) {
+      SpscCopy(SpscSlot(r, r->tail + i), from, r->elemsize);
+      from += r->elemsize;
+    }
+    SpscPublish(r, room);
+    n -= room;
+  }
+}
+
+int spsc_get_many(spsc_t *r, void *elems, int max) {
+  char *to = (char *)elems;
+  unsigned int got, i;
+
+  if (max <= 0) return 0;
+  got = SpscReady(r);
+  if (got > max) got = max;
+  for (i = 0; i < got; i++) {
+    SpscCopy(to, SpscSlot(r, r->head + i), r->elemsize);
+    to += r->elemsize;
+  }
+  SpscRelease(r, got);
+  return got;
+}
@@ -10,12 +10,51 @@
 #include "process.h"
 #include "synch.h"
 #include "queue.h"
+#include "sched.h"
+#include "clock.h"
 
 static Sem sems[MAX_SEMS];      // All semaphores in the system
 static Lock locks[MAX_LOCKS];   // All locks in the system
 static Cond conds[MAX_CONDS];   //All conditional variables in the system
+static Barrier barriers[MAX_BARRIERS];  // All barriers in the system
+static Latch latches[MAX_LATCHES];      // All latches in the system
+
+// Free objects are chained through nextFree, so creating or destroying
+// one never has to scan the arrays.  -1 ends a list.
+static int freeSems, freeLocks, freeConds, freeBarriers, freeLatches;
+
+static int synchProfiling = 0;  // Keep SynchStats? (see SynchProfile)
 
 extern struct PCB *currentPCB; 
+
+//----------------------------------------------------------------------
+//	SynchStatsRecord
+//
+//	Counts an acquire in s.  jStart is the jiffy the caller started
+//	waiting, or -1 if it got in without waiting.  Interrupts must be
+//	disabled.
+//----------------------------------------------------------------------
+static void SynchStatsRecord(SynchStats *s, int jStart) {
+  int waited;
+
+  if (!synchProfiling) return;
+  s->acquires++;
+  if (jStart < 0) return;
+  waited = ClkGetCurJiffies() - jStart;
+  s->contended++;
+  s->waitTotal += waited;
+  if (waited > s->waitMax) s->waitMax = waited;
+  s->lastContender = GetCurrentPid();
+}
+
+static void SynchStatsClear(SynchStats *s) {
+  s->acquires = 0;
+  s->contended = 0;
+  s->waitTotal = 0;
+  s->waitMax = 0;
+  s->holdTotal = 0;
+  s->lastContender = -1;
+}
 //----------------------------------------------------------------------
 //	SynchModuleInit
 //
@@ -26,13 +65,29 @@ int SynchModuleInit() {
   dbprintf ('p', "SynchModuleInit: Entering SynchModuleInit\n");
   for(i=0; i<MAX_SEMS; i++) {
     sems[i].inuse = 0;
+    sems[i].nextFree = (i + 1 < MAX_SEMS) ? i + 1 : -1;
   }
+  freeSems = 0;
   for(i=0; i<MAX_LOCKS; i++) {
-    // Your stuff for initializing locks goes here
+    locks[i].inuse = 0;
+    locks[i].nextFree = (i + 1 < MAX_LOCKS) ? i + 1 : -1;
   }
+  freeLocks = 0;
   for(i=0; i<MAX_CONDS; i++) {
-    // Your stuff for initializing Condition variables goes here
+    conds[i].inuse = 0;
+    conds[i].nextFree = (i + 1 < MAX_CONDS) ? i + 1 : -1;
+  }
+  freeConds = 0;
+  for(i=0; i<MAX_BARRIERS; i++) {
+    barriers[i].inuse = 0;
+    barriers[i].nextFree = (i + 1 < MAX_BARRIERS) ? i + 1 : -1;
+  }
+  freeBarriers = 0;
+  for(i=0; i<MAX_LATCHES; i++) {
+    latches[i].inuse = 0;
+    latches[i].nextFree = (i + 1 < MAX_LATCHES) ? i + 1 : -1;
   }
+  freeLatches = 0;
   dbprintf ('p', "SynchModuleInit: Leaving SynchModuleInit\n");
   return SYNC_SUCCESS;
 }
@@ -52,6 +107,7 @@ int SemInit (Sem *sem, int count) {
     exitsim();
   }
   sem->count = count;
+  SynchStatsClear(&sem->stats);
   return SYNC_SUCCESS;
 }
 
@@ -68,19 +124,53 @@ sem_t SemCreate(int count) {
 
   // grabbing a semaphore should be an atomic operation
   intrval = DisableIntrs();
-  for(sem=0; sem<MAX_SEMS; sem++) {
-    if(sems[sem].inuse==0) {
-      sems[sem].inuse = 1;
-      break;
-    }
+  if ((sem = freeSems) >= 0) {
+    freeSems = sems[sem].nextFree;
+    sems[sem].inuse = 1;
+    sems[sem].owner = -1;
   }
   RestoreIntrs(intrval);
-  if(sem==MAX_SEMS) return SYNC_FAIL;
+  if(sem < 0) return SYNC_FAIL;
 
   if (SemInit(&sems[sem], count) != SYNC_SUCCESS) return SYNC_FAIL;
   return sem;
 }
 
+sem_t SemHandleCreate(int count) {
+  sem_t sem;
+
+  if ((sem = SemCreate(count)) != SYNC_FAIL) sems[sem].owner = GetCurrentPid();
+  return sem;
+}
+
+//----------------------------------------------------------------------
+// 	SemDestroy
+//
+//	Puts a semaphore back on the free list.  Fails if any process is
+//	waiting on it.
+//----------------------------------------------------------------------
+int SemDestroy(Sem *sem) {
+  uint32 intrval;
+
+  if (!sem) return SYNC_FAIL;
+  intrval = DisableIntrs();
+  if (!sem->inuse || !AQueueEmpty(&sem->waiting)) {
+    RestoreIntrs(intrval);
+    return SYNC_FAIL;
+  }
+  sem->inuse = 0;
+  sem->nextFree = freeSems;
+  freeSems = sem - sems;
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int SemHandleDestroy(sem_t sem) {
+  if (sem < 0) return SYNC_FAIL;
+  if (sem >= MAX_SEMS) return SYNC_FAIL;
+  return SemDestroy(&sems[sem]);
+}
+
 
 //----------------------------------------------------------------------
 //
@@ -94,38 +184,111 @@ sem_t SemCreate(int count) {
 //
 //----------------------------------------------------------------------
 int SemWait (Sem *sem) {
+  return SemWaitN(sem, 1);
+}
+
+int SemHandleWait(sem_t sem) {
+  if (sem < 0) return SYNC_FAIL;
+  if (sem >= MAX_SEMS) return SYNC_FAIL;
+  if (!sems[sem].inuse)    return SYNC_FAIL;
+  return SemWait(&sems[sem]);
+}
+
+//----------------------------------------------------------------------
+//
+//	SemWaitN
+//
+//	Takes n units from the semaphore, blocking until all of them are
+//	available at once.  Waiters are served in order: SemSignalN takes
+//	the units for a waiter off the count when it wakes it, so a woken
+//	process has nothing left to do.
+//
+//----------------------------------------------------------------------
+int SemWaitN (Sem *sem, int n) {
   Link	*l;
   int		intrval;
+  int		jStart = -1;
     
   if (!sem) return SYNC_FAIL;
+  if (n <= 0) return SYNC_FAIL;
 
   intrval = DisableIntrs ();
-  dbprintf ('I', "SemWait: Old interrupt value was 0x%x.\n", intrval);
-  dbprintf ('s', "SemWait: Proc %d waiting on sem %d, count=%d.\n", GetCurrentPid(), (int)(sem-sems), sem->count);
-  if (sem->count <= 0) {
-    dbprintf('s', "SemWait: putting process %d to sleep\n", GetCurrentPid());
-    if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
-      printf("FATAL ERROR: could not allocate link for semaphore queue in SemWait!\n");
+  dbprintf ('I', "SemWaitN: Old interrupt value was 0x%x.\n", intrval);
+  dbprintf ('s', "SemWaitN: Proc %d waiting for %d on sem %d, count=%d.\n", GetCurrentPid(), n, (int)(sem-sems), sem->count);
+  if ((sem->count < n) || !AQueueEmpty(&sem->waiting)) {
+    dbprintf('s', "SemWaitN: putting process %d to sleep\n", GetCurrentPid());
+    currentPCB->semWant = n;
+    l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
+    if (AQueueInsertLast (&sem->waiting, l) != QUEUE_SUCCESS) {
+      printf("FATAL ERROR: could not insert new link into semaphore waiting queue in SemWaitN!\n");
       exitsim();
     }
+    jStart = ClkGetCurJiffies();
+    ProcessSleep();
+  } else {
+    dbprintf('s', "SemWaitN: Proc %d granted permission to continue by sem %d\n", GetCurrentPid(), (int)(sem-sems));
+    sem->count -= n; // Decrement intenal counter
+  }
+  SynchStatsRecord(&sem->stats, jStart);
+  RestoreIntrs (intrval);
+  return SYNC_SUCCESS;
+}
+
+int SemHandleWaitN(sem_t sem, int n) {
+  if (sem < 0) return SYNC_FAIL;
+  if (sem >= MAX_SEMS) return SYNC_FAIL;
+  if (!sems[sem].inuse)    return SYNC_FAIL;
+  return SemWaitN(&sems[sem], n);
+}
+
+//----------------------------------------------------------------------
+//
+//	SemTimedWait
+//
+//	Like SemWait, but gives up at jiffy jDeadline: the process sleeps
+//	on qSleep as well as the semaphore's queue, and whichever of
+//	SemSignalN and the deadline comes first wakes it.  Returns
+//	SYNC_TIMEOUT if the deadline did.
+//
+//----------------------------------------------------------------------
+int SemTimedWait (Sem *sem, int jDeadline) {
+  Link	*l;
+  int		intrval;
+  int		jStart = -1;
+
+  if (!sem) return SYNC_FAIL;
+
+  intrval = DisableIntrs ();
+  if ((sem->count <= 0) || !AQueueEmpty(&sem->waiting)) {
+    if (ClkGetCurJiffies() - jDeadline >= 0) {
+      RestoreIntrs (intrval);
+      return SYNC_TIMEOUT;
+    }
+    dbprintf('s', "SemTimedWait: putting process %d to sleep until %d\n", GetCurrentPid(), jDeadline);
+    currentPCB->semWant = 1;
+    l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
     if (AQueueInsertLast (&sem->waiting, l) != QUEUE_SUCCESS) {
-      printf("FATAL ERROR: could not insert new link into semaphore waiting queue in SemWait!\n");
+      printf("FATAL ERROR: could not insert new link into semaphore waiting queue in SemTimedWait!\n");
       exitsim();
     }
-    ProcessSleep();
+    jStart = ClkGetCurJiffies();
+    if (ProcessSleepUntil(jDeadline)) {
+      RestoreIntrs (intrval);
+      return SYNC_TIMEOUT;
+    }
   } else {
-    dbprintf('s', "SemWait: Proc %d granted permission to continue by sem %d\n", GetCurrentPid(), (int)(sem-sems));
+    sem->count--;
   }
-  sem->count--; // Decrement intenal counter
+  SynchStatsRecord(&sem->stats, jStart);
   RestoreIntrs (intrval);
   return SYNC_SUCCESS;
 }
 
-int SemHandleWait(sem_t sem) {
+int SemHandleTimedWait(sem_t sem, int timeout) {
   if (sem < 0) return SYNC_FAIL;
   if (sem >= MAX_SEMS) return SYNC_FAIL;
   if (!sems[sem].inuse)    return SYNC_FAIL;
-  return SemWait(&sems[sem]);
+  return SemTimedWait(&sems[sem], ClkGetCurJiffies() + timeout * JIFFIES_PER_SECOND / 1000);
 }
 
 //----------------------------------------------------------------------
@@ -137,37 +300,144 @@ int SemHandleWait(sem_t sem) {
 //
 //----------------------------------------------------------------------
 int SemSignal (Sem *sem) {
+  return SemSignalN(sem, 1);
+}
+
+//----------------------------------------------------------------------
+//
+//	SemServe
+//
+//	Wakes the waiters at the front of the semaphore's queue that its
+//	count covers, taking each one's units off the count.  Interrupts
+//	must be disabled.
+//
+//----------------------------------------------------------------------
+static void SemServe (Sem *sem) {
   Link *l;
-  int	intrs;
   PCB *pcb;
 
+  while (!AQueueEmpty(&sem->waiting)) { // check if there is a process to wake up
+    l = AQueueFirst(&sem->waiting);
+    pcb = (PCB *)AQueueObject(l);
+    if (pcb->semWant > sem->count) break;
+    if (AQueueRemove(&l) != QUEUE_SUCCESS) { 
+      printf("FATAL ERROR: could not remove link from semaphore queue in SemServe!\n");
+      exitsim();
+    }
+    sem->count -= pcb->semWant;
+    dbprintf ('s', "SemServe: Waking up PID %d.\n", (int)(GetPidFromAddress(pcb)));
+    ProcessWakeup (pcb);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	SemUnwait
+//
+//	Takes pcb off whatever semaphore queue it's on, because it timed
+//	out or died, and lets the waiters behind it have a go.  Interrupts
+//	must be disabled.
+//
+//----------------------------------------------------------------------
+static void SemUnwait (PCB *pcb) {
+  int i;
+
+  for (i = 0; i < MAX_SEMS; i++) {
+    if (pcb->waitLink.queue == &sems[i].waiting) {
+      AQueueUnlink(&pcb->waitLink);
+      SemServe(&sems[i]);
+      return;
+    }
+  }
+}
+
+int SemHandleSignal(sem_t sem) {
+  if (sem < 0) return SYNC_FAIL;
+  if (sem >= MAX_SEMS) return SYNC_FAIL;
+  if (!sems[sem].inuse)    return SYNC_FAIL;
+  return SemSignal(&sems[sem]);
+}
+
+//----------------------------------------------------------------------
+//
+//	SemSignalN
+//
+//	Adds n units to the semaphore and, in one pass over its queue,
+//	wakes the waiters they cover, taking each one's units off the
+//	count.  Stops at the first waiter that wants more than is left,
+//	so that a large SemWaitN isn't starved by smaller ones behind it.
+//
+//----------------------------------------------------------------------
+int SemSignalN (Sem *sem, int n) {
+  int	intrs;
+
   if (!sem) return SYNC_FAIL;
+  if (n <= 0) return SYNC_FAIL;
 
   intrs = DisableIntrs ();
-  dbprintf ('s', "SemSignal: Process %d Signalling on sem %d, count=%d.\n", GetCurrentPid(), (int)(sem-sems), sem->count);
+  dbprintf ('s', "SemSignalN: Process %d Signalling %d on sem %d, count=%d.\n", GetCurrentPid(), n, (int)(sem-sems), sem->count);
   // Increment internal counter before checking value
-  sem->count++;
-  if (sem->count > 0) { // check if there is a process to wake up
-    if (!AQueueEmpty(&sem->waiting)) { // there is a process to wake up
-      l = AQueueFirst(&sem->waiting);
-      pcb = (PCB *)AQueueObject(l);
-      if (AQueueRemove(&l) != QUEUE_SUCCESS) { 
-        printf("FATAL ERROR: could not remove link from semaphore queue in SemSignal!\n");
-        exitsim();
-      }
-      dbprintf ('s', "SemSignal: Waking up PID %d.\n", (int)(GetPidFromAddress(pcb)));
-      ProcessWakeup (pcb);
-    }
-  }
+  sem->count += n;
+  SemServe(sem);
   RestoreIntrs (intrs);
   return SYNC_SUCCESS;
 }
 
-int SemHandleSignal(sem_t sem) {
+int SemHandleSignalN(sem_t sem, int n) {
   if (sem < 0) return SYNC_FAIL;
   if (sem >= MAX_SEMS) return SYNC_FAIL;
   if (!sems[sem].inuse)    return SYNC_FAIL;
-  return SemSignal(&sems[sem]);
+  return SemSignalN(&sems[sem], n);
+}
+
+//----------------------------------------------------------------------
+//
+//	SemTake
+//
+//	Takes as many units as are free, up to max, without blocking.
+//	Nothing is free while processes are waiting.  Returns the number
+//	taken.
+//
+//----------------------------------------------------------------------
+int SemTake (Sem *sem, int max) {
+  int	intrs;
+  int	n = 0;
+
+  if (!sem) return SYNC_FAIL;
+
+  intrs = DisableIntrs ();
+  if ((sem->count > 0) && AQueueEmpty(&sem->waiting)) {
+    n = (sem->count < max) ? sem->count : max;
+    sem->count -= n;
+  }
+  RestoreIntrs (intrs);
+  return n;
+}
+
+//----------------------------------------------------------------------
+//
+//	SemAvailable
+//
+//	How many units SemTake would get now, without taking them.
+//
+//----------------------------------------------------------------------
+int SemAvailable (Sem *sem) {
+  if (!sem) return SYNC_FAIL;
+  return AQueueEmpty(&sem->waiting) ? sem->count : 0;
+}
+
+int SemHandleAvailable(sem_t sem) {
+  if (sem < 0) return SYNC_FAIL;
+  if (sem >= MAX_SEMS) return SYNC_FAIL;
+  if (!sems[sem].inuse)    return SYNC_FAIL;
+  return SemAvailable(&sems[sem]);
+}
+
+int SemHandleTake(sem_t sem, int max) {
+  if (sem < 0) return SYNC_FAIL;
+  if (sem >= MAX_SEMS) return SYNC_FAIL;
+  if (!sems[sem].inuse)    return SYNC_FAIL;
+  return SemTake(&sems[sem], max);
 }
 
 //-----------------------------------------------------------------------
@@ -189,19 +459,57 @@ lock_t LockCreate() {
 
   // grabbing a lock should be an atomic operation
   intrval = DisableIntrs();
-  for(l=0; l<MAX_LOCKS; l++) {
-    if(locks[l].inuse==0) {
-      locks[l].inuse = 1;
-      break;
-    }
+  if ((l = freeLocks) >= 0) {
+    freeLocks = locks[l].nextFree;
+    locks[l].inuse = 1;
+    locks[l].owner = -1;
   }
   RestoreIntrs(intrval);
-  if(l==MAX_LOCKS) return SYNC_FAIL;
+  if(l < 0) return SYNC_FAIL;
 
   if (LockInit(&locks[l]) != SYNC_SUCCESS) return SYNC_FAIL;
   return l;
 }
 
+lock_t LockHandleCreate() {
+  lock_t l;
+
+  if ((l = LockCreate()) != SYNC_FAIL) locks[l].owner = GetCurrentPid();
+  return l;
+}
+
+//---------------------------------------------------------------------------
+//	LockDestroy
+//
+//	Puts a lock back on the free list.  Fails if another process holds
+//	it, if any process waits for it, or if a condition variable still
+//	uses it.
+//---------------------------------------------------------------------------
+int LockDestroy(Lock *k) {
+  uint32 intrval;
+
+  if (!k) return SYNC_FAIL;
+  intrval = DisableIntrs();
+  if (!k->inuse || ((k->pid >= 0) && (k->pid != GetCurrentPid())) ||
+      !AQueueEmpty(&k->waiting) || (k->nconds > 0)) {
+    RestoreIntrs(intrval);
+    return SYNC_FAIL;
+  }
+  k->inuse = 0;
+  k->pid = -1;
+  k->holder = NULL;
+  k->nextFree = freeLocks;
+  freeLocks = k - locks;
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int LockHandleDestroy(lock_t lock) {
+  if (lock < 0) return SYNC_FAIL;
+  if (lock >= MAX_LOCKS) return SYNC_FAIL;
+  return LockDestroy(&locks[lock]);
+}
+
 int LockInit(Lock *l) {
   if (!l) return SYNC_FAIL;
   if (AQueueInit (&l->waiting) != QUEUE_SUCCESS) {
@@ -209,9 +517,47 @@ int LockInit(Lock *l) {
     exitsim();
   }
   l->pid = -1;
+  l->holder = NULL;
+  l->nconds = 0;
+  SynchStatsClear(&l->stats);
   return SYNC_SUCCESS;
 }
 
+//---------------------------------------------------------------------------
+//	LockUpdateDonor
+//
+//	Priority inheritance.  A lock holder runs at least as urgently as
+//	the most urgent process waiting for any lock it holds, its donor,
+//	so that processes in between can't keep it (and so the waiter)
+//	off the CPU.  This finds holder's donor again after a waiter came
+//	or went, then does the same for whoever holds the lock holder is
+//	blocked on, and so on down the chain.  Interrupts must be disabled.
+//---------------------------------------------------------------------------
+static PCB *LockTopWaiter(PCB *holder) {
+  Lock *k;
+  Link *l;
+  PCB *pcb, *best = NULL;
+
+  for (k = locks; k < locks + MAX_LOCKS; k++) {
+    if (!k->inuse || (k->holder != holder)) continue;
+    for (l = AQueueFirst(&k->waiting); l != NULL; l = AQueueNext(l)) {
+      pcb = (PCB *)AQueueObject(l);
+      if ((best == NULL) || SchedBefore(pcb, best)) best = pcb;
+    }
+  }
+  return best;
+}
+
+static void LockUpdateDonor(PCB *holder) {
+  int depth;
+
+  // A chain can't be longer than the number of locks
+  for (depth = 0; (holder != NULL) && (depth < MAX_LOCKS); depth++) {
+    SchedInherit(holder, LockTopWaiter(holder));
+    holder = (holder->blockedOn != NULL) ? holder->blockedOn->holder : NULL;
+  }
+}
+
 //---------------------------------------------------------------------------
 //	LockHandleAcquire
 //
@@ -223,6 +569,7 @@ int LockInit(Lock *l) {
 int LockAcquire(Lock *k) {
   Link	*l;
   int		intrval;
+  int		jStart;
     
   if (!k) return SYNC_FAIL;
 
@@ -240,18 +587,23 @@ int LockAcquire(Lock *k) {
   dbprintf ('s', "LockAcquire: Proc %d asking for lock %d.\n", GetCurrentPid(), (int)(k-locks));
   if (k->pid >= 0) { // Lock is already in use by another process
     dbprintf('s', "LockAcquire: putting process %d to sleep\n", GetCurrentPid());
-    if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
-      printf("FATAL ERROR: could not allocate link for lock queue in LockAcquire!\n");
-      exitsim();
-    }
+    l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
     if (AQueueInsertLast (&k->waiting, l) != QUEUE_SUCCESS) {
       printf("FATAL ERROR: could not insert new link into lock waiting queue in LockAcquire!\n");
       exitsim();
     }
+    // Lend our priority to the holder while we wait
+    currentPCB->blockedOn = k;
+    LockUpdateDonor(k->holder);
+    jStart = ClkGetCurJiffies();
     ProcessSleep();
+    SynchStatsRecord(&k->stats, jStart);
   } else {
     dbprintf('s', "LockAcquire: lock is available, assigning to proc %d\n", GetCurrentPid());
     k->pid = GetCurrentPid();
+    k->holder = currentPCB;
+    k->jAcquired = ClkGetCurJiffies();
+    SynchStatsRecord(&k->stats, -1);
   }
   RestoreIntrs(intrval);
   return SYNC_SUCCESS;
@@ -264,6 +616,99 @@ int LockHandleAcquire(lock_t lock) {
   return LockAcquire(&locks[lock]);
 }
 
+//---------------------------------------------------------------------------
+//	LockTimedAcquire
+//
+//	Like LockAcquire, but gives up at jiffy jDeadline.  While it waits
+//	the holder inherits its priority as usual; SynchTimeout takes that
+//	back if the deadline comes first.  Returns SYNC_TIMEOUT then.
+//---------------------------------------------------------------------------
+int LockTimedAcquire(Lock *k, int jDeadline) {
+  Link	*l;
+  int		intrval;
+  int		jStart;
+
+  if (!k) return SYNC_FAIL;
+
+  intrval = DisableIntrs ();
+  if (k->pid == GetCurrentPid()) {
+    RestoreIntrs(intrval);
+    return SYNC_SUCCESS;
+  }
+  if (k->pid < 0) {
+    k->pid = GetCurrentPid();
+    k->holder = currentPCB;
+    k->jAcquired = ClkGetCurJiffies();
+    SynchStatsRecord(&k->stats, -1);
+    RestoreIntrs(intrval);
+    return SYNC_SUCCESS;
+  }
+  if (ClkGetCurJiffies() - jDeadline >= 0) {
+    RestoreIntrs(intrval);
+    return SYNC_TIMEOUT;
+  }
+  dbprintf('s', "LockTimedAcquire: putting process %d to sleep until %d\n", GetCurrentPid(), jDeadline);
+  l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
+  if (AQueueInsertLast (&k->waiting, l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert new link into lock waiting queue in LockTimedAcquire!\n");
+    exitsim();
+  }
+  currentPCB->blockedOn = k;
+  LockUpdateDonor(k->holder);
+  // LockHandOff makes us the holder if it wakes us
+  jStart = ClkGetCurJiffies();
+  if (ProcessSleepUntil(jDeadline)) {
+    RestoreIntrs(intrval);
+    return SYNC_TIMEOUT;
+  }
+  SynchStatsRecord(&k->stats, jStart);
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int LockHandleTimedAcquire(lock_t lock, int timeout) {
+  if (lock < 0) return SYNC_FAIL;
+  if (lock >= MAX_LOCKS) return SYNC_FAIL;
+  if (!locks[lock].inuse)    return SYNC_FAIL;
+  return LockTimedAcquire(&locks[lock], ClkGetCurJiffies() + timeout * JIFFIES_PER_SECOND / 1000);
+}
+
+//---------------------------------------------------------------------------
+//	LockHandOff
+//
+//	Gives k, which its holder is letting go of, to the first process
+//	waiting for it, or frees it if there is none.  Interrupts must be
+//	disabled.
+//---------------------------------------------------------------------------
+static void LockHandOff(Lock *k) {
+  Link *l;
+  PCB *pcb;
+
+  if (synchProfiling && (k->pid >= 0)) {
+    k->stats.holdTotal += ClkGetCurJiffies() - k->jAcquired;
+  }
+  k->pid = -1;
+  k->holder = NULL;
+  if (!AQueueEmpty(&k->waiting)) { // there is a process to wake up
+    l = AQueueFirst(&k->waiting);
+    pcb = (PCB *)AQueueObject(l);
+    if (AQueueRemove(&l) != QUEUE_SUCCESS) { 
+      printf("FATAL ERROR: could not remove link from lock queue in LockHandOff!\n");
+      exitsim();
+    }
+    dbprintf ('s', "LockHandOff: Waking up PID %d, assigning lock.\n", (int)(GetPidFromAddress(pcb)));
+    k->pid = GetPidFromAddress(pcb);
+    k->holder = pcb;
+    k->jAcquired = ClkGetCurJiffies();
+    pcb->blockedOn = NULL;
+    ProcessWakeup (pcb);
+    // The new holder inherits from the processes still waiting
+    if (!AQueueEmpty(&k->waiting)) {
+      LockUpdateDonor(pcb);
+    }
+  }
+}
+
 //---------------------------------------------------------------------------
 //	LockHandleRelease
 //
@@ -274,9 +719,7 @@ int LockHandleAcquire(lock_t lock) {
 //	releases the lock, and returns SYNC_SUCCESS.
 //---------------------------------------------------------------------------
 int LockRelease(Lock *k) {
-  Link *l;
   int	intrs;
-  PCB *pcb;
 
   if (!k) return SYNC_FAIL;
 
@@ -285,19 +728,13 @@ int LockRelease(Lock *k) {
 
   if (k->pid != GetCurrentPid()) {
     dbprintf('s', "LockRelease: Proc %d does not own lock %d.\n", GetCurrentPid(), (int)(k-locks));
+    RestoreIntrs (intrs);
     return SYNC_FAIL;
   }
-  k->pid = -1;
-  if (!AQueueEmpty(&k->waiting)) { // there is a process to wake up
-    l = AQueueFirst(&k->waiting);
-    pcb = (PCB *)AQueueObject(l);
-    if (AQueueRemove(&l) != QUEUE_SUCCESS) { 
-      printf("FATAL ERROR: could not remove link from lock queue in LockRelease!\n");
-      exitsim();
-    }
-    dbprintf ('s', "LockRelease: Waking up PID %d, assigning lock.\n", (int)(GetPidFromAddress(pcb)));
-    k->pid = GetPidFromAddress(pcb);
-    ProcessWakeup (pcb);
+  LockHandOff(k);
+  // Whatever we inherited through this lock ends here
+  if (currentPCB->donor != NULL) {
+    LockUpdateDonor(currentPCB);
   }
   RestoreIntrs (intrs);
   return SYNC_SUCCESS;
@@ -329,33 +766,70 @@ cond_t CondCreate(lock_t lock) {
   cond_t cond;
   uint32 intrval;
 
+  if ((lock < 0) || (lock >= MAX_LOCKS)) return SYNC_FAIL;
   if (locks[lock].inuse == 0) {
     printf("FATAL ERROR: lock in use when creating conditional variable\n");
     return SYNC_FAIL;
   }
   // grabbing a conditional variable should be an atomic operation
   intrval = DisableIntrs();
-  for(cond=0; cond<MAX_CONDS; cond++) {
-    if(conds[cond].inuse == 0) {
-      conds[cond].lock = lock;
-      conds[cond].inuse = 1;
-      break;
-    }
+  if ((cond = freeConds) >= 0) {
+    freeConds = conds[cond].nextFree;
+    conds[cond].lock = lock;
+    conds[cond].inuse = 1;
+    conds[cond].owner = -1;
+    locks[lock].nconds++;
   }
   RestoreIntrs(intrval);
-  if(cond==MAX_CONDS) return INVALID_COND;
+  if(cond < 0) return INVALID_COND;
 
   if(CondInit(&conds[cond]) != SYNC_SUCCESS) return SYNC_FAIL;
   return cond;
 }
 
+cond_t CondHandleCreate(lock_t lock) {
+  cond_t cond;
+
+  if ((cond = CondCreate(lock)) != INVALID_COND) conds[cond].owner = GetCurrentPid();
+  return cond;
+}
+
+//---------------------------------------------------------------------------
+//	CondDestroy
+//
+//	Puts a condition variable back on the free list, which lets its
+//	lock be destroyed too.  Fails if any process waits on it.
+//---------------------------------------------------------------------------
+int CondDestroy(Cond *cond) {
+  uint32 intrval;
+
+  if (!cond) return SYNC_FAIL;
+  intrval = DisableIntrs();
+  if (!cond->inuse || !AQueueEmpty(&cond->waiting)) {
+    RestoreIntrs(intrval);
+    return SYNC_FAIL;
+  }
+  locks[cond->lock].nconds--;
+  cond->inuse = 0;
+  cond->nextFree = freeConds;
+  freeConds = cond - conds;
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int CondHandleDestroy(cond_t c) {
+  if (c < 0) return SYNC_FAIL;
+  if (c >= MAX_CONDS) return SYNC_FAIL;
+  return CondDestroy(&conds[c]);
+}
+
 int CondInit(Cond *cond) {
   if (!cond) return SYNC_FAIL;
   if (AQueueInit (&cond->waiting) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not initialize condition variable waiting queue in CondInit!\n");
     exitsim();
   }
-  // Extra line needed here??
+  SynchStatsClear(&cond->stats);
   return SYNC_SUCCESS;
 }
 //---------------------------------------------------------------------------
@@ -391,6 +865,7 @@ int CondHandleWait(cond_t c) {
 int CondWait (Cond *cond) {
   Link *l;
   int intrval;
+  int jStart;
 
   if(!cond) return SYNC_FAIL;
 
@@ -400,10 +875,7 @@ int CondWait (Cond *cond) {
   dbprintf ('s', "CondWait: Proc %d waiting on cond %d\n", GetCurrentPid(), (int)(cond-conds));
   dbprintf ('s', "CondWait: putting process %d to sleep\n", GetCurrentPid());
 
-  if ((l = AQueueAllocLink((void *)currentPCB)) == NULL) {
-    printf("FATAL ERROR: could not allocate link for cond queue in CondWait!\n");
-    exitsim();
-  }
+  l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
 
   if (AQueueInsertLast (&cond->waiting, l) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not insert new link into cond waiting queue in CondWait!\n");
@@ -411,12 +883,57 @@ int CondWait (Cond *cond) {
   }
 
   LockHandleRelease(cond->lock);
+  jStart = ClkGetCurJiffies();
   RestoreIntrs(intrval);
   ProcessSleep();
+  SynchStatsRecord(&cond->stats, jStart);
+  // Goes through LockAcquire, so a woken waiter that finds the lock
+  // taken lends its priority to the holder too
   LockHandleAcquire(cond->lock);
   return SYNC_SUCCESS;
 }
 
+//---------------------------------------------------------------------------
+//	CondTimedWait
+//
+//	Like CondWait, but stops waiting for a signal at jiffy jDeadline.
+//	The lock is taken back either way (without a deadline), so the
+//	caller always holds it on return.  Returns SYNC_TIMEOUT if no
+//	signal came in time.
+//---------------------------------------------------------------------------
+int CondHandleTimedWait(cond_t c, int timeout) {
+  if(c < 0) return SYNC_FAIL;
+  if(c >= MAX_CONDS) return SYNC_FAIL;
+  if(!conds[c].inuse) return SYNC_FAIL;
+  return CondTimedWait(&conds[c], ClkGetCurJiffies() + timeout * JIFFIES_PER_SECOND / 1000);
+}
+
+int CondTimedWait (Cond *cond, int jDeadline) {
+  Link *l;
+  int intrval;
+  int timedOut;
+  int jStart;
+
+  if(!cond) return SYNC_FAIL;
+
+  intrval = DisableIntrs();
+  dbprintf ('s', "CondTimedWait: Proc %d waiting on cond %d until %d\n", GetCurrentPid(), (int)(cond-conds), jDeadline);
+
+  l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
+  if (AQueueInsertLast (&cond->waiting, l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert new link into cond waiting queue in CondTimedWait!\n");
+    exitsim();
+  }
+
+  LockHandleRelease(cond->lock);
+  jStart = ClkGetCurJiffies();
+  timedOut = ProcessSleepUntil(jDeadline);
+  if (!timedOut) SynchStatsRecord(&cond->stats, jStart);
+  RestoreIntrs(intrval);
+  LockHandleAcquire(cond->lock);
+  return timedOut ? SYNC_TIMEOUT : SYNC_SUCCESS;
+}
+
 //---------------------------------------------------------------------------
 //	CondHandleSignal
 //
@@ -487,7 +1004,7 @@ int CondSignal (Cond *cond) {
 //---------------------------------------------------------------------------
 int CondHandleBroadcast(cond_t c) {
   if (c < 0) return SYNC_FAIL;
-  if (c <= MAX_CONDS) return SYNC_FAIL;
+  if (c >= MAX_CONDS) return SYNC_FAIL;
   if (!conds[c].inuse) return SYNC_FAIL;
   return CondBroadcast(&conds[c]);;
 }
@@ -514,3 +1031,389 @@ int CondBroadcast(Cond *cond) {
   RestoreIntrs(intrs);
   return SYNC_SUCCESS;
 }
+
+//---------------------------------------------------------------------------
+//	SynchWakeAll
+//
+//	Wakes every process on waiting, emptying it in a single pass.
+//	Interrupts must be disabled.
+//---------------------------------------------------------------------------
+static void SynchWakeAll(Queue *waiting) {
+  Link *l;
+  PCB *pcb;
+
+  while (!AQueueEmpty(waiting)) {
+    l = AQueueFirst(waiting);
+    pcb = (PCB *)AQueueObject(l);
+    if (AQueueRemove(&l) != QUEUE_SUCCESS) {
+      printf("FATAL ERROR: could not remove link from waiting queue in SynchWakeAll!\n");
+      exitsim();
+    }
+    dbprintf ('s', "SynchWakeAll: Waking up PID %d.\n", (int)(GetPidFromAddress(pcb)));
+    ProcessWakeup (pcb);
+  }
+}
+
+//---------------------------------------------------------------------------
+//	BarrierCreate
+//
+//	Grabs a barrier that opens for every parties arrivals.  Returns
+//	its handle, or SYNC_FAIL if parties isn't positive or there are no
+//	barriers left.
+//---------------------------------------------------------------------------
+barrier_t BarrierCreate(int parties) {
+  barrier_t b;
+  uint32 intrval;
+
+  if (parties <= 0) return SYNC_FAIL;
+  intrval = DisableIntrs();
+  if ((b = freeBarriers) >= 0) {
+    freeBarriers = barriers[b].nextFree;
+    barriers[b].inuse = 1;
+    barriers[b].owner = -1;
+  }
+  RestoreIntrs(intrval);
+  if (b < 0) return SYNC_FAIL;
+
+  if (AQueueInit (&barriers[b].waiting) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not initialize barrier waiting queue in BarrierCreate!\n");
+    exitsim();
+  }
+  barriers[b].parties = parties;
+  barriers[b].arrived = 0;
+  return b;
+}
+
+barrier_t BarrierHandleCreate(int parties) {
+  barrier_t b;
+
+  if ((b = BarrierCreate(parties)) != SYNC_FAIL) barriers[b].owner = GetCurrentPid();
+  return b;
+}
+
+//---------------------------------------------------------------------------
+//	BarrierWait
+//
+//	Arrives at the barrier.  Blocks unless this is the last arrival of
+//	the group, in which case every process waiting is woken and the
+//	barrier is ready for the next group.
+//---------------------------------------------------------------------------
+int BarrierWait(Barrier *b) {
+  Link *l;
+  int intrval;
+
+  if (!b) return SYNC_FAIL;
+
+  intrval = DisableIntrs();
+  b->arrived++;
+  dbprintf ('s', "BarrierWait: Proc %d at barrier %d, %d of %d\n", GetCurrentPid(), (int)(b-barriers), b->arrived, b->parties);
+  if (b->arrived < b->parties) {
+    l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
+    if (AQueueInsertLast (&b->waiting, l) != QUEUE_SUCCESS) {
+      printf("FATAL ERROR: could not insert new link into barrier waiting queue in BarrierWait!\n");
+      exitsim();
+    }
+    ProcessSleep();
+  } else {
+    b->arrived = 0;
+    SynchWakeAll(&b->waiting);
+  }
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int BarrierHandleWait(barrier_t b) {
+  if (b < 0) return SYNC_FAIL;
+  if (b >= MAX_BARRIERS) return SYNC_FAIL;
+  if (!barriers[b].inuse) return SYNC_FAIL;
+  return BarrierWait(&barriers[b]);
+}
+
+//---------------------------------------------------------------------------
+//	BarrierDestroy
+//
+//	Puts a barrier back on the free list.  Fails if any process is
+//	waiting at it.
+//---------------------------------------------------------------------------
+int BarrierDestroy(Barrier *b) {
+  uint32 intrval;
+
+  if (!b) return SYNC_FAIL;
+  intrval = DisableIntrs();
+  if (!b->inuse || !AQueueEmpty(&b->waiting)) {
+    RestoreIntrs(intrval);
+    return SYNC_FAIL;
+  }
+  b->inuse = 0;
+  b->nextFree = freeBarriers;
+  freeBarriers = b - barriers;
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int BarrierHandleDestroy(barrier_t b) {
+  if (b < 0) return SYNC_FAIL;
+  if (b >= MAX_BARRIERS) return SYNC_FAIL;
+  return BarrierDestroy(&barriers[b]);
+}
+
+//---------------------------------------------------------------------------
+//	LatchCreate
+//
+//	Grabs a latch that opens after count calls to LatchCountDown.
+//	Returns its handle, or SYNC_FAIL if count is negative or there are
+//	no latches left.
+//---------------------------------------------------------------------------
+latch_t LatchCreate(int count) {
+  latch_t t;
+  uint32 intrval;
+
+  if (count < 0) return SYNC_FAIL;
+  intrval = DisableIntrs();
+  if ((t = freeLatches) >= 0) {
+    freeLatches = latches[t].nextFree;
+    latches[t].inuse = 1;
+    latches[t].owner = -1;
+  }
+  RestoreIntrs(intrval);
+  if (t < 0) return SYNC_FAIL;
+
+  if (AQueueInit (&latches[t].waiting) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not initialize latch waiting queue in LatchCreate!\n");
+    exitsim();
+  }
+  latches[t].count = count;
+  return t;
+}
+
+latch_t LatchHandleCreate(int count) {
+  latch_t t;
+
+  if ((t = LatchCreate(count)) != SYNC_FAIL) latches[t].owner = GetCurrentPid();
+  return t;
+}
+
+//---------------------------------------------------------------------------
+//	LatchCountDown
+//
+//	Takes one off the latch's count.  The call that brings it to zero
+//	wakes every waiter; calls after that do nothing.
+//---------------------------------------------------------------------------
+int LatchCountDown(Latch *t) {
+  int intrval;
+
+  if (!t) return SYNC_FAIL;
+
+  intrval = DisableIntrs();
+  if (t->count > 0) {
+    t->count--;
+    dbprintf ('s', "LatchCountDown: Proc %d counted down latch %d to %d\n", GetCurrentPid(), (int)(t-latches), t->count);
+    if (t->count == 0) SynchWakeAll(&t->waiting);
+  }
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int LatchHandleCountDown(latch_t t) {
+  if (t < 0) return SYNC_FAIL;
+  if (t >= MAX_LATCHES) return SYNC_FAIL;
+  if (!latches[t].inuse) return SYNC_FAIL;
+  return LatchCountDown(&latches[t]);
+}
+
+//---------------------------------------------------------------------------
+//	LatchWait
+//
+//	Blocks until the latch's count reaches zero.  Returns at once if
+//	it already has.
+//---------------------------------------------------------------------------
+int LatchWait(Latch *t) {
+  Link *l;
+  int intrval;
+
+  if (!t) return SYNC_FAIL;
+
+  intrval = DisableIntrs();
+  if (t->count > 0) {
+    dbprintf ('s', "LatchWait: putting process %d to sleep on latch %d\n", GetCurrentPid(), (int)(t-latches));
+    l = AQueueLinkInit(&currentPCB->waitLink, currentPCB);
+    if (AQueueInsertLast (&t->waiting, l) != QUEUE_SUCCESS) {
+      printf("FATAL ERROR: could not insert new link into latch waiting queue in LatchWait!\n");
+      exitsim();
+    }
+    ProcessSleep();
+  }
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int LatchHandleWait(latch_t t) {
+  if (t < 0) return SYNC_FAIL;
+  if (t >= MAX_LATCHES) return SYNC_FAIL;
+  if (!latches[t].inuse) return SYNC_FAIL;
+  return LatchWait(&latches[t]);
+}
+
+//---------------------------------------------------------------------------
+//	LatchDestroy
+//
+//	Puts a latch back on the free list.  Fails if any process is
+//	waiting on it.
+//---------------------------------------------------------------------------
+int LatchDestroy(Latch *t) {
+  uint32 intrval;
+
+  if (!t) return SYNC_FAIL;
+  intrval = DisableIntrs();
+  if (!t->inuse || !AQueueEmpty(&t->waiting)) {
+    RestoreIntrs(intrval);
+    return SYNC_FAIL;
+  }
+  t->inuse = 0;
+  t->nextFree = freeLatches;
+  freeLatches = t - latches;
+  RestoreIntrs(intrval);
+  return SYNC_SUCCESS;
+}
+
+int LatchHandleDestroy(latch_t t) {
+  if (t < 0) return SYNC_FAIL;
+  if (t >= MAX_LATCHES) return SYNC_FAIL;
+  return LatchDestroy(&latches[t]);
+}
+
+//---------------------------------------------------------------------------
+//	SynchFreeProcess
+//
+//	Cleans up after a dying process: takes it off any waiting queue,
+//	hands on the locks it holds, and destroys the objects it created.
+//	An object that other processes are still using stays, and belongs
+//	to the kernel from then on.  Called from ProcessFreeResources.
+//---------------------------------------------------------------------------
+void SynchFreeProcess(PCB *pcb) {
+  int pid = GetPidFromAddress(pcb);
+  int i;
+  uint32 intrval;
+
+  intrval = DisableIntrs();
+  if (pcb->waitLink.queue != NULL) {
+    // A barrier it was waiting at needs one more arrival again
+    for (i = 0; i < MAX_BARRIERS; i++) {
+      if (pcb->waitLink.queue == &barriers[i].waiting) barriers[i].arrived--;
+    }
+    SemUnwait(pcb);
+    if (pcb->waitLink.queue != NULL) AQueueUnlink(&pcb->waitLink);
+    if (pcb->blockedOn != NULL) LockUpdateDonor(pcb->blockedOn->holder);
+  }
+  pcb->blockedOn = NULL;
+  for (i = 0; i < MAX_LOCKS; i++) {
+    if (locks[i].inuse && (locks[i].holder == pcb)) {
+      dbprintf('s', "SynchFreeProcess: passing on lock %d held by %d\n", i, pid);
+      LockHandOff(&locks[i]);
+    }
+  }
+  // Conds first, so that their locks can go too
+  for (i = 0; i < MAX_CONDS; i++) {
+    if (conds[i].inuse && (conds[i].owner == pid) && (CondDestroy(&conds[i]) != SYNC_SUCCESS)) {
+      conds[i].owner = -1;
+    }
+  }
+  for (i = 0; i < MAX_LOCKS; i++) {
+    if (locks[i].inuse && (locks[i].owner == pid) && (LockDestroy(&locks[i]) != SYNC_SUCCESS)) {
+      locks[i].owner = -1;
+    }
+  }
+  for (i = 0; i < MAX_SEMS; i++) {
+    if (sems[i].inuse && (sems[i].owner == pid) && (SemDestroy(&sems[i]) != SYNC_SUCCESS)) {
+      sems[i].owner = -1;
+    }
+  }
+  for (i = 0; i < MAX_BARRIERS; i++) {
+    if (barriers[i].inuse && (barriers[i].owner == pid) && (BarrierDestroy(&barriers[i]) != SYNC_SUCCESS)) {
+      barriers[i].owner = -1;
+    }
+  }
+  for (i = 0; i < MAX_LATCHES; i++) {
+    if (latches[i].inuse && (latches[i].owner == pid) && (LatchDestroy(&latches[i]) != SYNC_SUCCESS)) {
+      latches[i].owner = -1;
+    }
+  }
+  RestoreIntrs(intrval);
+}
+
+//---------------------------------------------------------------------------
+//	SynchTimeout
+//
+//	ProcessUserWakeup is waking pcb because its deadline passed.  If
+//	it was in a timed wait, nothing signalled it in time: take it off
+//	the object's queue (and back the priority it lent a lock holder)
+//	so that nobody hands it the object later.  Interrupts must be
+//	disabled.
+//---------------------------------------------------------------------------
+void SynchTimeout(PCB *pcb) {
+  PCB *holder;
+
+  if (pcb->waitLink.queue == NULL) return; // Just sleeping
+  SemUnwait(pcb);
+  if (pcb->waitLink.queue != NULL) AQueueUnlink(&pcb->waitLink);
+  pcb->waitTimedOut = 1;
+  if (pcb->blockedOn != NULL) {
+    holder = pcb->blockedOn->holder;
+    pcb->blockedOn = NULL;
+    LockUpdateDonor(holder);
+  }
+}
+
+//---------------------------------------------------------------------------
+//	SynchProfile
+//
+//	Turns contention profiling on (enable != 0) or off.  Turning it on
+//	starts every object's SynchStats over from zero.
+//---------------------------------------------------------------------------
+void SynchProfile(int enable) {
+  int i;
+  uint32 intrval;
+
+  intrval = DisableIntrs();
+  if (enable) {
+    for (i = 0; i < MAX_SEMS; i++) SynchStatsClear(&sems[i].stats);
+    for (i = 0; i < MAX_LOCKS; i++) {
+      SynchStatsClear(&locks[i].stats);
+      // A lock held now only counts from here
+      locks[i].jAcquired = ClkGetCurJiffies();
+    }
+    for (i = 0; i < MAX_CONDS; i++) SynchStatsClear(&conds[i].stats);
+  }
+  synchProfiling = enable;
+  RestoreIntrs(intrval);
+}
+
+//---------------------------------------------------------------------------
+//	SynchProfileDump
+//
+//	Prints the SynchStats of every object in use that has been
+//	acquired since profiling was turned on.
+//---------------------------------------------------------------------------
+static void SynchStatsPrint(char *kind, int handle, int owner, SynchStats *s) {
+  printf("%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", kind, handle, owner,
+         s->acquires, s->contended, s->waitTotal, s->waitMax, s->holdTotal, s->lastContender);
+}
+
+void SynchProfileDump() {
+  int i;
+  uint32 intrval;
+
+  intrval = DisableIntrs();
+  printf("Synchronization profile (%s, jiffies; owner -1 is the kernel):\n", synchProfiling ? "on" : "off");
+  printf("kind\t#\towner\tacq\tcontend\twaitTot\twaitMax\tholdTot\tlast\n");
+  for (i = 0; i < MAX_SEMS; i++) {
+    if (sems[i].inuse && sems[i].stats.acquires) SynchStatsPrint("sem", i, sems[i].owner, &sems[i].stats);
+  }
+  for (i = 0; i < MAX_LOCKS; i++) {
+    if (locks[i].inuse && locks[i].stats.acquires) SynchStatsPrint("lock", i, locks[i].owner, &locks[i].stats);
+  }
+  for (i = 0; i < MAX_CONDS; i++) {
+    if (conds[i].inuse && conds[i].stats.acquires) SynchStatsPrint("cond", i, conds[i].owner, &conds[i].stats);
+  }
+  RestoreIntrs(intrval);
+}
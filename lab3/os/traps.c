@@ -12,8 +12,10 @@
 #include "memory.h"
 #include "synch.h"
 #include "mbox.h"
+#include "pipe.h"
 #include "share_memory.h"
 #include "clock.h"
+#include "queue.h"
 
 
 //----------------------------------------------------------------------
@@ -190,6 +192,118 @@ static void TrapProcessCreateHandler(uint32 *trapArgs, int sysmode) {
   ProcessFork(0, (uint32)allargs, pnice, pinfo, name, 1);
 }
 
+//--------------------------------------------------------------------
+// TrapCopyString copies the '\0' terminated string at src (a user
+// address unless sysmode) to dst, which has room for max characters.
+// Returns the length, or -1 if it doesn't fit.
+//--------------------------------------------------------------------
+static int TrapCopyString(char *dst, char *src, int max, int sysmode) {
+  int i;
+
+  for (i = 0; i < max; i++) {
+    if (!sysmode) {
+      MemoryCopyUserToSystem (currentPCB, (src+i), &(dst[i]), sizeof(char));
+    } else {
+      dst[i] = src[i];
+    }
+    if (dst[i] == '\0') return i;
+  }
+  return -1;
+}
+
+//--------------------------------------------------------------------
+//
+// int process_create_many(char *exec_name, int count, int pnice,
+//                         int pinfo, char **argvs[]);
+//
+// Creates count processes running exec_name.  Instance i gets the
+// NULL terminated argument list argvs[i] (not counting argv[0]); argvs
+// may be NULL if none of them take arguments.  The executable is only
+// read once (see ProcessForkBatchBegin).  Returns the number of
+// processes created.
+//
+//--------------------------------------------------------------------
+static int TrapProcessCreateManyHandler(uint32 *trapArgs, int sysmode) {
+  char allargs[SIZE_ARG_BUFF];  // Full string of arguments for one instance
+  char name[PROCESS_MAX_NAME_LENGTH]; // Local copy of name of executable
+  char *username;               // Address of exec_name string
+  char **argvs;                 // Address of the array of argument lists
+  char **uargv;                 // Address of one instance's argument list
+  char *userarg = NULL;         // Address of one argument string
+  int count, pnice, pinfo;
+  int i, j, n, pos;
+  int created = 0;
+
+  username = (char *)GetUintFromTrapArg(trapArgs+0, sysmode);
+  count = GetIntFromTrapArg(trapArgs+1, sysmode);
+  pnice = GetIntFromTrapArg(trapArgs+2, sysmode);
+  pinfo = GetIntFromTrapArg(trapArgs+3, sysmode);
+  argvs = (char **)GetUintFromTrapArg(trapArgs+4, sysmode);
+  if (TrapCopyString(name, username, PROCESS_MAX_NAME_LENGTH, sysmode) < 0) {
+    printf("TrapProcessCreateManyHandler: length of executable filename longer than allowed!\n");
+    return 0;
+  }
+  dbprintf('p', "TrapProcessCreateManyHandler: creating %d of %s\n", count, name);
+
+  ProcessForkBatchBegin();
+  for (i = 0; i < count; i++) {
+    // argv[0] is the program name, then this instance's arguments
+    dstrcpy(allargs, name);
+    pos = dstrlen(name) + 1;
+    uargv = (argvs == NULL) ? NULL : (char **)GetUintFromTrapArg((uint32 *)(argvs+i), sysmode);
+    for (j = 0; uargv != NULL; j++) {
+      if (j == MAX_ARGS - 1) {
+        printf("TrapProcessCreateManyHandler: too many arguments for instance %d\n", i);
+        break;
+      }
+      userarg = (char *)GetUintFromTrapArg((uint32 *)(uargv+j), sysmode);
+      if (userarg == NULL) break;
+      if ((n = TrapCopyString(&(allargs[pos]), userarg, SIZE_ARG_BUFF - pos - 1, sysmode)) < 0) {
+        printf("TrapProcessCreateManyHandler: strlen(all arguments) > maximum length allowed!\n");
+        break;
+      }
+      pos += n + 1;
+    }
+    if ((uargv != NULL) && (userarg != NULL)) break;
+    // get_argument stops at an empty string
+    allargs[pos] = '\0';
+    if (ProcessFork(0, (uint32)allargs, pnice, pinfo, name, 1) < 0) break;
+    created++;
+  }
+  ProcessForkBatchEnd();
+  return created;
+}
+
+//--------------------------------------------------------------------
+//
+// int process_spawn(char *exec_name, int pnice, int pinfo,
+//                   void *block, int len);
+//
+// Creates a process running exec_name with the prebuilt argument
+// block (see argblock.h) of len bytes at block.  Only the name is
+// copied here; ProcessFork copies the block straight into the new
+// process's stack.  Returns the new pid, or -1.
+//
+//--------------------------------------------------------------------
+static int TrapProcessSpawnHandler(uint32 *trapArgs, int sysmode) {
+  char name[PROCESS_MAX_NAME_LENGTH]; // Local copy of name of executable
+  ProcessArgBlock args;
+  char *username;               // Address of exec_name string
+  int pnice, pinfo;
+
+  username = (char *)GetUintFromTrapArg(trapArgs+0, sysmode);
+  pnice = GetIntFromTrapArg(trapArgs+1, sysmode);
+  pinfo = GetIntFromTrapArg(trapArgs+2, sysmode);
+  args.from = sysmode ? NULL : currentPCB;
+  args.addr = GetUintFromTrapArg(trapArgs+3, sysmode);
+  args.len = GetIntFromTrapArg(trapArgs+4, sysmode);
+  if (TrapCopyString(name, username, PROCESS_MAX_NAME_LENGTH, sysmode) < 0) {
+    printf("TrapProcessSpawnHandler: length of executable filename longer than allowed!\n");
+    return -1;
+  }
+  return ProcessFork(0, (uint32)&args, pnice, pinfo, name, PROCESS_USER_ARGBLOCK);
+}
+
 
 //----------------------------------------------------------------------
 //
@@ -335,13 +449,16 @@ static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
 //
 //   handle mbox send trap
 //   mbox_send(mbox_t handle, int num_bytes, void *data)
+//   and, as trap says, mbox_trysend, mbox_broadcast and
+//   mbox_send_prio (with a fourth argument, the priority)
 //----------------------------------------------------------------------
-static int TrapMboxSendHandler (uint32 *trapArgs, int sysMode)
+static int TrapMboxSendHandler (uint32 *trapArgs, int sysMode, int trap)
 {
   mbox_t handle;                      // Holds handle to mailbox
-  char msg[MBOX_MAX_MESSAGE_LENGTH];  // Holds message in kernel space
   char *usermessage = NULL;           // Pointer to user-space message
   int length=-1;                      // Holds length of message (in bytes)
+  int priority = MBOX_PRIO_NORMAL;    // Lane, for mbox_send_prio
+  PCB *pcb = NULL;                    // Whose address space usermessage is in
 
   // If we're not in system mode, we need to copy everything from the
   // user-space virtual address to the kernel space address
@@ -353,15 +470,27 @@ static int TrapMboxSendHandler (uint32 *trapArgs, int sysMode)
     MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &length, sizeof(int));
     // Argument 2: pointer to message data
     MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &usermessage, sizeof(char *));
-    // Now copy message data from user space to kernel space
-    MemoryCopyUserToSystem (currentPCB, usermessage, msg, length);
+    // Argument 3: priority, for mbox_send_prio only
+    if (trap == TRAP_MBOX_SEND_PRIO) {
+      MemoryCopyUserToSystem (currentPCB, (trapArgs+3), &priority, sizeof(int));
+    }
+    // The mailbox copies the message data straight out of user space
+    pcb = currentPCB;
   } else {
     // Already in kernel space, no address translation necessary
     handle = (mbox_t)trapArgs[0];
     length = (int)trapArgs[1];
-    bcopy ((void *)(trapArgs[2]), (void *)msg, length); // Copy message into local variable for simplicity
+    usermessage = (char *)trapArgs[2];
+    if (trap == TRAP_MBOX_SEND_PRIO) {
+      priority = (int)trapArgs[3];
+    }
+  }
+  switch (trap) {
+    case TRAP_MBOX_TRYSEND:   return MboxTrySend(handle, pcb, length, usermessage);
+    case TRAP_MBOX_SEND_PRIO: return MboxSendPriority(handle, pcb, length, usermessage, priority);
+    case TRAP_MBOX_BROADCAST: return MboxBroadcast(handle, pcb, length, usermessage);
+    default:                  return MboxSend(handle, pcb, length, usermessage);
   }
-  return MboxSend(handle, length, msg);
 }
 
 //---------------------------------------------------------------------
@@ -370,12 +499,301 @@ static int TrapMboxSendHandler (uint32 *trapArgs, int sysMode)
 // handle mbox receive trap
 // int mbox_recv(mbox_t handle, int maxlength, void* message);
 //----------------------------------------------------------------------
-static int TrapMboxRecvHandler (uint32 *trapArgs, int sysMode) {
+//--------------------------------------------------------------------
+// int mbox_send_page(mbox_t handle, unsigned int page, int length);
+//
+// Hands shared page page (from shmget) to the mailbox's receiver.
+// Nothing but the handle is copied.
+//--------------------------------------------------------------------
+static int TrapMboxSendPageHandler (uint32 *trapArgs, int sysMode) {
+  mbox_t handle;                      // Holds handle to mailbox
+  uint32 page;                        // Holds shared page handle
+  int length;                         // Holds bytes used in the page
+
+  if (!sysMode) {
+    // Argument 0: handle to mailbox
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(mbox_t));
+    // Argument 1: shared page handle
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &page, sizeof(uint32));
+    // Argument 2: bytes used in the page
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &length, sizeof(int));
+  } else {
+    handle = (mbox_t)trapArgs[0];
+    page = trapArgs[1];
+    length = (int)trapArgs[2];
+  }
+  return MboxSendPage(handle, page, length);
+}
+
+//--------------------------------------------------------------------
+// void *mbox_recv_page(mbox_t handle, int *length);
+//
+// Maps the page from the oldest mbox_send_page message into the
+// caller and returns its address, with the number of bytes the
+// sender used in *length.  Returns NULL on failure.
+//--------------------------------------------------------------------
+static uint32 TrapMboxRecvPageHandler (uint32 *trapArgs, int sysMode) {
+  mbox_t handle;                      // Holds handle to mailbox
+  int *userlength = NULL;             // Pointer to user-space length
+  int length;                         // Holds length in kernel space
+  void *addr;                         // Where the page was mapped
+
+  if (!sysMode) {
+    // Argument 0: handle to mailbox
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(mbox_t));
+    // Argument 1: pointer to length (user space)
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &userlength, sizeof(int *));
+  } else {
+    handle = (mbox_t)trapArgs[0];
+    userlength = (int *)trapArgs[1];
+  }
+  if ((addr = MboxRecvPage(handle, &length)) == NULL) {
+    return (uint32)NULL;
+  }
+  if (!sysMode) {
+    MemoryCopySystemToUser(currentPCB, (char *)&length, (char *)userlength, sizeof(int));
+  } else {
+    *userlength = length;
+  }
+  return (uint32)addr;
+}
+
+//--------------------------------------------------------------------
+// int mbox_send_many(mbox_t handle, int count, int length, void *data);
+// int mbox_recv_many(mbox_t handle, int maxcount, int length, void *data);
+//
+// Several fixed-size messages, stored back to back in data, per trap.
+// Both return the number of messages moved, or MBOX_FAIL.
+//--------------------------------------------------------------------
+static int TrapMboxSendManyHandler (uint32 *trapArgs, int sysMode) {
+  mbox_t handle;                      // Holds handle to mailbox
+  int count, length;                  // Number and size of messages
+  char *usermessages = NULL;          // Pointer to user-space messages
+  PCB *pcb = NULL;                    // Whose address space they're in
+
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(mbox_t));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &count, sizeof(int));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &length, sizeof(int));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+3), &usermessages, sizeof(char *));
+    pcb = currentPCB;
+  } else {
+    handle = (mbox_t)trapArgs[0];
+    count = (int)trapArgs[1];
+    length = (int)trapArgs[2];
+    usermessages = (char *)trapArgs[3];
+  }
+  return MboxSendMany(handle, pcb, count, length, usermessages);
+}
+
+static int TrapMboxRecvManyHandler (uint32 *trapArgs, int sysMode) {
+  mbox_t handle;                      // Holds handle to mailbox
+  int maxcount, length;               // Room for this many messages of this size
+  char *usermessages = NULL;          // Pointer to user-space messages
+  PCB *pcb = NULL;                    // Whose address space they're in
+
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(mbox_t));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &maxcount, sizeof(int));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &length, sizeof(int));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+3), &usermessages, sizeof(char *));
+    pcb = currentPCB;
+  } else {
+    handle = (mbox_t)trapArgs[0];
+    maxcount = (int)trapArgs[1];
+    length = (int)trapArgs[2];
+    usermessages = (char *)trapArgs[3];
+  }
+  return MboxRecvMany(handle, pcb, maxcount, length, usermessages);
+}
+
+//--------------------------------------------------------------------
+// int mbox_stats(mbox_t handle, mbox_stats *stats);
+//
+// Copies the queue metrics of mailbox handle into stats.  Returns
+// MBOX_SUCCESS, or MBOX_FAIL if there's no such mailbox.
+//--------------------------------------------------------------------
+static int TrapMboxStatsHandler (uint32 *trapArgs, int sysMode) {
+  mbox_t handle;                      // Holds handle to mailbox
+  MboxStats stats;                    // Holds metrics in kernel space
+  MboxStats *userstats = NULL;        // Pointer to user-space metrics
+
+  if (!sysMode) {
+    // Argument 0: handle to mailbox
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(mbox_t));
+    // Argument 1: pointer to metrics (user space)
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &userstats, sizeof(MboxStats *));
+  } else {
+    handle = (mbox_t)trapArgs[0];
+    userstats = (MboxStats *)trapArgs[1];
+  }
+  if (MboxGetStats(handle, &stats) != MBOX_SUCCESS) {
+    return MBOX_FAIL;
+  }
+  if (!sysMode) {
+    MemoryCopySystemToUser(currentPCB, (char *)&stats, (char *)userstats, sizeof(MboxStats));
+  } else {
+    bcopy((char *)&stats, (char *)userstats, sizeof(MboxStats));
+  }
+  return MBOX_SUCCESS;
+}
+
+//--------------------------------------------------------------------
+// mbox_t mbox_select(mbox_t *handles, int n, int timeout);
+//
+// Waits up to timeout milliseconds (for ever if it's negative) for
+// one of the n mailboxes in handles to have a message, and returns
+// its handle.
+//--------------------------------------------------------------------
+static int TrapMboxSelectHandler (uint32 *trapArgs, int sysMode) {
+  mbox_t handles[MBOX_NUM_MBOXES];    // Holds handles in kernel space
+  mbox_t *userhandles = NULL;         // Pointer to user-space handles
+  int n, timeout;
+
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &userhandles, sizeof(mbox_t *));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &n, sizeof(int));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &timeout, sizeof(int));
+  } else {
+    userhandles = (mbox_t *)trapArgs[0];
+    n = (int)trapArgs[1];
+    timeout = (int)trapArgs[2];
+  }
+  if ((n <= 0) || (n > MBOX_NUM_MBOXES)) return MBOX_FAIL;
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, userhandles, handles, n * sizeof(mbox_t));
+  } else {
+    bcopy ((char *)userhandles, (char *)handles, n * sizeof(mbox_t));
+  }
+  return MboxSelect(handles, n, timeout);
+}
+
+//--------------------------------------------------------------------
+// int pipe_write(pipe_t pipe, void *data, int n);
+// int pipe_read(pipe_t pipe, void *data, int n);
+//
+// The pipe copies straight to or from the caller's buffer, so there
+// is no kernel copy of the data here.
+//--------------------------------------------------------------------
+static int TrapPipeHandler (uint32 *trapArgs, int sysMode, int write) {
+  pipe_t pipe;                        // Holds handle to pipe
+  char *userdata = NULL;              // Pointer to the user's bytes
+  int n;                              // Holds number of bytes
+
+  if (!sysMode) {
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &pipe, sizeof(pipe_t));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &userdata, sizeof(char *));
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &n, sizeof(int));
+  } else {
+    pipe = (pipe_t)trapArgs[0];
+    userdata = (char *)trapArgs[1];
+    n = (int)trapArgs[2];
+  }
+  if (write) {
+    return PipeWrite(pipe, sysMode ? NULL : currentPCB, userdata, n);
+  }
+  return PipeRead(pipe, sysMode ? NULL : currentPCB, userdata, n);
+}
+
+//--------------------------------------------------------------------
+// int sched_stats(int pid, sched_stats *stats);
+//
+// Copies the scheduler statistics for process pid (or the whole
+// system, for pid -1) into stats.  Returns 1 on success, or 0 if pid
+// isn't a live process.
+//--------------------------------------------------------------------
+static int TrapSchedStatsHandler (uint32 *trapArgs, int sysMode) {
+  int pid;                            // Holds pid, or -1 for the system
+  SchedStats stats;                   // Holds statistics in kernel space
+  SchedStats *userstats = NULL;       // Pointer to user-space statistics
+
+  if (!sysMode) {
+    // Argument 0: pid
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &pid, sizeof(int));
+    // Argument 1: pointer to statistics (user space)
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &userstats, sizeof(SchedStats *));
+  } else {
+    pid = (int)trapArgs[0];
+    userstats = (SchedStats *)trapArgs[1];
+  }
+  if (ProcessGetSchedStats(pid, &stats) != PROCESS_SUCCESS) {
+    return PROCESS_FAIL;
+  }
+  if (!sysMode) {
+    MemoryCopySystemToUser(currentPCB, (char *)&stats, (char *)userstats, sizeof(SchedStats));
+  } else {
+    bcopy((char *)&stats, (char *)userstats, sizeof(SchedStats));
+  }
+  return PROCESS_SUCCESS;
+}
+
+//--------------------------------------------------------------------
+// int clock_read(clock_sample *sample);
+//
+// Copies the time since the clock started and the number of
+// instructions retired into sample, for timing things from user
+// programs.  Returns 1.
+//--------------------------------------------------------------------
+static int TrapClockReadHandler (uint32 *trapArgs, int sysMode) {
+  ClockSample sample;                 // Holds the reading in kernel space
+  ClockSample *usersample = NULL;     // Pointer to user-space reading
+
+  if (!sysMode) {
+    // Argument 0: pointer to reading (user space)
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &usersample, sizeof(ClockSample *));
+  } else {
+    usersample = (ClockSample *)trapArgs[0];
+  }
+  ClkGetSample(&sample);
+  if (!sysMode) {
+    MemoryCopySystemToUser(currentPCB, (char *)&sample, (char *)usersample, sizeof(ClockSample));
+  } else {
+    bcopy((char *)&sample, (char *)usersample, sizeof(ClockSample));
+  }
+  return 1;
+}
+
+//--------------------------------------------------------------------
+// int link_stats(int pool, link_stats *stats);
+//
+// Debugging aid: copies the usage counters of link pool pool
+// (QUEUE_POOL_*) into stats.  Returns 1 on success, or 0 if there's
+// no such pool.
+//--------------------------------------------------------------------
+static int TrapLinkStatsHandler (uint32 *trapArgs, int sysMode) {
+  int pool;                           // Holds pool number
+  QueuePoolStats stats;               // Holds counters in kernel space
+  QueuePoolStats *userstats = NULL;   // Pointer to user-space counters
+
+  if (!sysMode) {
+    // Argument 0: pool
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &pool, sizeof(int));
+    // Argument 1: pointer to counters (user space)
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &userstats, sizeof(QueuePoolStats *));
+  } else {
+    pool = (int)trapArgs[0];
+    userstats = (QueuePoolStats *)trapArgs[1];
+  }
+  if (AQueuePoolStats(pool, &stats) != QUEUE_SUCCESS) {
+    return QUEUE_FAIL;
+  }
+  if (!sysMode) {
+    MemoryCopySystemToUser(currentPCB, (char *)&stats, (char *)userstats, sizeof(QueuePoolStats));
+  } else {
+    bcopy((char *)&stats, (char *)userstats, sizeof(QueuePoolStats));
+  }
+  return QUEUE_SUCCESS;
+}
+
+//--------------------------------------------------------------------
+// int mbox_recv(mbox_t handle, int maxlength, void* message);
+// and, as trap says, mbox_tryrecv and mbox_recv_broadcast
+//--------------------------------------------------------------------
+static int TrapMboxRecvHandler (uint32 *trapArgs, int sysMode, int trap) {
   mbox_t handle;                      // Holds handle to mailbox
-  char msg[MBOX_MAX_MESSAGE_LENGTH];  // Holds message in kernel space
   char *usermessage = NULL;           // Pointer to user-space message
   int maxlength=-1;                   // Holds max length of message (in bytes)
-  int retval;                         // Return value of MBoxReceive call
+  PCB *pcb = NULL;                    // Whose address space usermessage is in
 
   // If we're not in system mode, we need to copy everything from the
   // user-space virtual address to the kernel space address
@@ -387,25 +805,19 @@ static int TrapMboxRecvHandler (uint32 *trapArgs, int sysMode) {
     MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &maxlength, sizeof(int));
     // Argument 2: pointer to message data (user space)
     MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &usermessage, sizeof(char *));
+    // The mailbox copies the message straight into user space
+    pcb = currentPCB;
   } else {
     // Already in kernel space, no address translation necessary
     handle = (mbox_t)trapArgs[0];
     maxlength = (int)trapArgs[1];
     usermessage = (char *)trapArgs[2];
   }
-  retval = MboxRecv(handle, maxlength, msg);
-  if (retval == MBOX_FAIL) {
-    // No copying necessary, user should assume msg is not filled in
-    return retval;
-  } else {
-    // Copy message from msg to user space.  Number of bytes is returned by MboxRecv
-    if (!sysMode) {
-      MemoryCopySystemToUser(currentPCB, msg, usermessage, retval);
-    } else {
-      bcopy(msg, usermessage, retval);
-    }
+  switch (trap) {
+    case TRAP_MBOX_TRYRECV:        return MboxTryRecv(handle, pcb, maxlength, usermessage);
+    case TRAP_MBOX_RECV_BROADCAST: return MboxRecvBroadcast(handle, pcb, maxlength, usermessage);
+    default:                       return MboxRecv(handle, pcb, maxlength, usermessage);
   }
-  return retval;
 }
 
 
@@ -520,10 +932,23 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
     case TRAP_PROCESS_CREATE:
       TrapProcessCreateHandler(trapArgs, isr & DLX_STATUS_SYSMODE);
       break;
+    case TRAP_PROCESS_CREATE_MANY:
+      ihandle = TrapProcessCreateManyHandler(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle);
+      break;
+    case TRAP_PROCESS_SPAWN:
+      ihandle = TrapProcessSpawnHandler(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle);
+      break;
     case TRAP_SHARE_CREATE_PAGE:
       handle = MemoryCreateSharedPage(currentPCB);
       ProcessSetResult(currentPCB, handle);
       break;
+    case TRAP_SHARE_CREATE_REGION:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = MemoryCreateSharedRegion(currentPCB, ihandle);
+      ProcessSetResult(currentPCB, handle);
+      break;
     case TRAP_SHARE_MAP_PAGE:
       handle = GetUintFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
       handle = (uint32)mmap(currentPCB, handle);
@@ -531,7 +956,7 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       break;
     case TRAP_SEM_CREATE:
       ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      ihandle = SemCreate(ihandle);
+      ihandle = SemHandleCreate(ihandle);
       ProcessSetResult(currentPCB, ihandle); //Return handle
       break;
     case TRAP_SEM_WAIT:
@@ -545,7 +970,7 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       ProcessSetResult(currentPCB, handle); //Return 1 or 0
       break;
     case TRAP_LOCK_CREATE:
-      ihandle = LockCreate();
+      ihandle = LockHandleCreate();
       ProcessSetResult(currentPCB, ihandle); //Return handle
       break;
     case TRAP_LOCK_ACQUIRE:
@@ -560,7 +985,7 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       break;
     case TRAP_COND_CREATE:
       ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      ihandle = CondCreate(ihandle);
+      ihandle = CondHandleCreate(ihandle);
       ProcessSetResult(currentPCB, ihandle); //Return handle
       break;
     case TRAP_COND_WAIT:
@@ -578,6 +1003,46 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       ihandle = CondHandleBroadcast(ihandle);
       ProcessSetResult(currentPCB, ihandle); //Return 1 or 0
       break;
+    case TRAP_SEM_DESTROY:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = SemHandleDestroy(ihandle);
+      ProcessSetResult(currentPCB, handle); //Return 1 or 0
+      break;
+    case TRAP_LOCK_DESTROY:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = LockHandleDestroy(ihandle);
+      ProcessSetResult(currentPCB, handle); //Return 1 or 0
+      break;
+    case TRAP_COND_DESTROY:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = CondHandleDestroy(ihandle);
+      ProcessSetResult(currentPCB, handle); //Return 1 or 0
+      break;
+    case TRAP_SEM_WAIT_N:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = SemHandleWaitN(ihandle, GetIntFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE));
+      ProcessSetResult(currentPCB, handle); //Return 1 or -1
+      break;
+    case TRAP_SEM_SIGNAL_N:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = SemHandleSignalN(ihandle, GetIntFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE));
+      ProcessSetResult(currentPCB, handle); //Return 1 or -1
+      break;
+    case TRAP_SEM_TIMEDWAIT:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = SemHandleTimedWait(ihandle, GetIntFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE));
+      ProcessSetResult(currentPCB, handle); //Return 1, 0 on timeout, or -1
+      break;
+    case TRAP_LOCK_TIMEDACQUIRE:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = LockHandleTimedAcquire(ihandle, GetIntFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE));
+      ProcessSetResult(currentPCB, handle); //Return 1, 0 on timeout, or -1
+      break;
+    case TRAP_COND_TIMEDWAIT:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      handle = CondHandleTimedWait(ihandle, GetIntFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE));
+      ProcessSetResult(currentPCB, handle); //Return 1, 0 on timeout, or -1
+      break;
     case TRAP_MBOX_CREATE:
       ihandle = MboxCreate();
       ProcessSetResult(currentPCB, ihandle); //Return 1 or 0
@@ -593,24 +1058,145 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       ProcessSetResult(currentPCB, ihandle); //Return 1 or 0
       break;
     case TRAP_MBOX_SEND:
-      ihandle = TrapMboxSendHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = TrapMboxSendHandler (trapArgs, isr & DLX_STATUS_SYSMODE, TRAP_MBOX_SEND);
       ProcessSetResult(currentPCB, ihandle); //Return 1 or 0
       break;
     case TRAP_MBOX_RECV:
-      ihandle = TrapMboxRecvHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = TrapMboxRecvHandler (trapArgs, isr & DLX_STATUS_SYSMODE, TRAP_MBOX_RECV);
       ProcessSetResult(currentPCB, ihandle); //Return 1 or 0
       break;
+    case TRAP_MBOX_TRYSEND:
+      ihandle = TrapMboxSendHandler (trapArgs, isr & DLX_STATUS_SYSMODE, TRAP_MBOX_TRYSEND);
+      ProcessSetResult(currentPCB, ihandle); //Return 1, 0 if full, or -1
+      break;
+    case TRAP_MBOX_BROADCAST:
+      ihandle = TrapMboxSendHandler (trapArgs, isr & DLX_STATUS_SYSMODE, TRAP_MBOX_BROADCAST);
+      ProcessSetResult(currentPCB, ihandle); //Return receivers, or -1
+      break;
+    case TRAP_MBOX_SEND_PRIO:
+      ihandle = TrapMboxSendHandler (trapArgs, isr & DLX_STATUS_SYSMODE, TRAP_MBOX_SEND_PRIO);
+      ProcessSetResult(currentPCB, ihandle); //Return 1 or -1
+      break;
+    case TRAP_MBOX_TRYRECV:
+      ihandle = TrapMboxRecvHandler (trapArgs, isr & DLX_STATUS_SYSMODE, TRAP_MBOX_TRYRECV);
+      ProcessSetResult(currentPCB, ihandle); //Return length, 0 if empty, or -1
+      break;
+    case TRAP_MBOX_RECV_BROADCAST:
+      ihandle = TrapMboxRecvHandler (trapArgs, isr & DLX_STATUS_SYSMODE, TRAP_MBOX_RECV_BROADCAST);
+      ProcessSetResult(currentPCB, ihandle); //Return length, or -1
+      break;
+    case TRAP_PIPE_CREATE:
+      ihandle = PipeCreate();
+      ProcessSetResult(currentPCB, ihandle); //Return handle
+      break;
+    case TRAP_PIPE_WRITE:
+      ihandle = TrapPipeHandler (trapArgs, isr & DLX_STATUS_SYSMODE, 1);
+      ProcessSetResult(currentPCB, ihandle); //Return bytes or -1
+      break;
+    case TRAP_PIPE_READ:
+      ihandle = TrapPipeHandler (trapArgs, isr & DLX_STATUS_SYSMODE, 0);
+      ProcessSetResult(currentPCB, ihandle); //Return bytes or -1
+      break;
+    case TRAP_PIPE_DESTROY:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = PipeDestroy(ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return 1 or -1
+      break;
+    case TRAP_MBOX_STATS:
+      ihandle = TrapMboxStatsHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle);
+      break;
+    case TRAP_MBOX_SELECT:
+      ihandle = TrapMboxSelectHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle); //Return handle, -2 on timeout, or -1
+      break;
+    case TRAP_MBOX_SEND_PAGE:
+      ihandle = TrapMboxSendPageHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle); //Return 1 or -1
+      break;
+    case TRAP_MBOX_RECV_PAGE:
+      handle = TrapMboxRecvPageHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, handle); //Return address or NULL
+      break;
+    case TRAP_MBOX_SEND_MANY:
+      ihandle = TrapMboxSendManyHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle); //Return count or -1
+      break;
+    case TRAP_MBOX_RECV_MANY:
+      ihandle = TrapMboxRecvManyHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle); //Return count or -1
+      break;
     case TRAP_USER_SLEEP:
       ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
       ProcessUserSleep(ihandle);
       ProcessSchedule();
       ClkResetProcess();
       break;
+    case TRAP_USER_MSLEEP:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessUserSleepJiffies(ihandle * JIFFIES_PER_SECOND / 1000);
+      ProcessSchedule();
+      ClkResetProcess();
+      break;
     case TRAP_YIELD:
       ProcessYield();
       ProcessSchedule(); // this just moves the item on front of the queue to the back
       ClkResetProcess();
       break;
+    case TRAP_SCHED_STATS:
+      ihandle = TrapSchedStatsHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle);
+      break;
+    case TRAP_CLOCK_READ:
+      ihandle = TrapClockReadHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle);
+      break;
+    case TRAP_LINK_STATS:
+      ihandle = TrapLinkStatsHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, ihandle);
+      break;
+    case TRAP_SYNCH_PROFILE:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      SynchProfile(ihandle);
+      break;
+    case TRAP_SYNCH_PROFILE_DUMP:
+      SynchProfileDump();
+      break;
+    case TRAP_BARRIER_CREATE:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = BarrierHandleCreate(ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return handle
+      break;
+    case TRAP_BARRIER_WAIT:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = BarrierHandleWait(ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return 1 or -1
+      break;
+    case TRAP_BARRIER_DESTROY:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = BarrierHandleDestroy(ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return 1 or -1
+      break;
+    case TRAP_LATCH_CREATE:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = LatchHandleCreate(ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return handle
+      break;
+    case TRAP_LATCH_COUNTDOWN:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = LatchHandleCountDown(ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return 1 or -1
+      break;
+    case TRAP_LATCH_WAIT:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = LatchHandleWait(ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return 1 or -1
+      break;
+    case TRAP_LATCH_DESTROY:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = LatchHandleDestroy(ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return 1 or -1
+      break;
 
     default:
       printf ("Got an unrecognized trap (0x%x) - exiting!\n",
@@ -622,9 +1208,10 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
     switch (cause) {
     case TRAP_TIMER:
       dbprintf ('t', "Got a timer interrupt!\n");
-      // ClkInterrupt returns 1 when 1 "process quantum" has passed, meaning
-      // that it's time to call ProcessSchedule again.
-      if (ClkInterrupt()) {
+      // ClkInterrupt returns 1 when the running process's timeslice has
+      // passed, meaning that it's time to call ProcessSchedule again,
+      // unless there's nothing else that could run.
+      if (ClkInterrupt() && ProcessPreemptNeeded()) {
         ProcessSchedule ();
       }
       break;
@@ -663,6 +1250,12 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       break;
     }
   }
+  // A real time process woken above gets the CPU right away rather
+  // than at the next quantum.
+  if (ProcessReschedPending()) {
+    ProcessSchedule ();
+    ClkResetProcess();
+  }
   dbprintf ('t',"About to return from dointerrupt.\n");
   // Note that this return may schedule a new process!
   intrreturn ();
@@ -90,6 +90,22 @@ _process_create:
 	nop
 .endproc _process_create
 
+.proc _process_create_many
+.global _process_create_many
+_process_create_many:
+	trap	#0x433
+	jr	r31
+	nop
+.endproc _process_create_many
+
+.proc _process_spawn
+.global _process_spawn
+_process_spawn:
+	trap	#0x434
+	jr	r31
+	nop
+.endproc _process_spawn
+
 .proc _shmget
 .global _shmget
 _shmget:
@@ -106,6 +122,14 @@ _shmat:
 	nop
 .endproc _shmat
 
+.proc _shmget_region
+.global _shmget_region
+_shmget_region:
+	trap	#0x442
+	jr	r31
+	nop
+.endproc _shmget_region
+
 .proc _sem_create
 .global _sem_create
 _sem_create:
@@ -186,6 +210,54 @@ _cond_broadcast:
 	nop
 .endproc _cond_broadcast
 
+.proc _sem_destroy
+.global _sem_destroy
+_sem_destroy:
+	trap	#0x45a
+	jr	r31
+	nop
+.endproc _sem_destroy
+
+.proc _lock_destroy
+.global _lock_destroy
+_lock_destroy:
+	trap	#0x45b
+	jr	r31
+	nop
+.endproc _lock_destroy
+
+.proc _cond_destroy
+.global _cond_destroy
+_cond_destroy:
+	trap	#0x45c
+	jr	r31
+	nop
+.endproc _cond_destroy
+
+.proc _sem_timedwait
+.global _sem_timedwait
+_sem_timedwait:
+	trap	#0x45d
+	jr	r31
+	nop
+.endproc _sem_timedwait
+
+.proc _lock_timedacquire
+.global _lock_timedacquire
+_lock_timedacquire:
+	trap	#0x45e
+	jr	r31
+	nop
+.endproc _lock_timedacquire
+
+.proc _cond_timedwait
+.global _cond_timedwait
+_cond_timedwait:
+	trap	#0x45f
+	jr	r31
+	nop
+.endproc _cond_timedwait
+
 .proc _mbox_create
 .global _mbox_create
 _mbox_create:
@@ -242,6 +314,246 @@ _yield:
 	nop
 .endproc _yield
 
+.proc _msleep
+.global _msleep
+_msleep:
+	trap	#0x467
+	jr	r31
+	nop
+.endproc _msleep
+
+.proc _sched_stats
+.global _sched_stats
+_sched_stats:
+	trap	#0x468
+	jr	r31
+	nop
+.endproc _sched_stats
+
+.proc _link_stats
+.global _link_stats
+_link_stats:
+	trap	#0x469
+	jr	r31
+	nop
+.endproc _link_stats
+
+.proc _synch_profile
+.global _synch_profile
+_synch_profile:
+	trap	#0x46a
+	jr	r31
+	nop
+.endproc _synch_profile
+
+.proc _synch_profile_dump
+.global _synch_profile_dump
+_synch_profile_dump:
+	trap	#0x46b
+	jr	r31
+	nop
+.endproc _synch_profile_dump
+
+.proc _barrier_create
+.global _barrier_create
+_barrier_create:
+	trap	#0x46c
+	jr	r31
+	nop
+.endproc _barrier_create
+
+.proc _barrier_wait
+.global _barrier_wait
+_barrier_wait:
+	trap	#0x46d
+	jr	r31
+	nop
+.endproc _barrier_wait
+
+.proc _barrier_destroy
+.global _barrier_destroy
+_barrier_destroy:
+	trap	#0x46e
+	jr	r31
+	nop
+.endproc _barrier_destroy
+
+.proc _latch_create
+.global _latch_create
+_latch_create:
+	trap	#0x46f
+	jr	r31
+	nop
+.endproc _latch_create
+
+.proc _latch_countdown
+.global _latch_countdown
+_latch_countdown:
+	trap	#0x470
+	jr	r31
+	nop
+.endproc _latch_countdown
+
+.proc _latch_wait
+.global _latch_wait
+_latch_wait:
+	trap	#0x471
+	jr	r31
+	nop
+.endproc _latch_wait
+
+.proc _latch_destroy
+.global _latch_destroy
+_latch_destroy:
+	trap	#0x472
+	jr	r31
+	nop
+.endproc _latch_destroy
+
+.proc _sem_wait_n
+.global _sem_wait_n
+_sem_wait_n:
+	trap	#0x473
+	jr	r31
+	nop
+.endproc _sem_wait_n
+
+.proc _sem_signal_n
+.global _sem_signal_n
+_sem_signal_n:
+	trap	#0x474
+	jr	r31
+	nop
+.endproc _sem_signal_n
+
+.proc _mbox_send_page
+.global _mbox_send_page
+_mbox_send_page:
+	trap	#0x475
+	jr	r31
+	nop
+.endproc _mbox_send_page
+
+.proc _mbox_recv_page
+.global _mbox_recv_page
+_mbox_recv_page:
+	trap	#0x476
+	jr	r31
+	nop
+.endproc _mbox_recv_page
+
+.proc _mbox_send_many
+.global _mbox_send_many
+_mbox_send_many:
+	trap	#0x477
+	jr	r31
+	nop
+.endproc _mbox_send_many
+
+.proc _mbox_recv_many
+.global _mbox_recv_many
+_mbox_recv_many:
+	trap	#0x478
+	jr	r31
+	nop
+.endproc _mbox_recv_many
+
+.proc _mbox_trysend
+.global _mbox_trysend
+_mbox_trysend:
+	trap	#0x479
+	jr	r31
+	nop
+.endproc _mbox_trysend
+
+.proc _mbox_tryrecv
+.global _mbox_tryrecv
+_mbox_tryrecv:
+	trap	#0x47a
+	jr	r31
+	nop
+.endproc _mbox_tryrecv
+
+.proc _mbox_select
+.global _mbox_select
+_mbox_select:
+	trap	#0x47b
+	jr	r31
+	nop
+.endproc _mbox_select
+
+.proc _pipe_create
+.global _pipe_create
+_pipe_create:
+	trap	#0x47c
+	jr	r31
+	nop
+.endproc _pipe_create
+
+.proc _pipe_write
+.global _pipe_write
+_pipe_write:
+	trap	#0x47d
+	jr	r31
+	nop
+.endproc _pipe_write
+
+.proc _pipe_read
+.global _pipe_read
+_pipe_read:
+	trap	#0x47e
+	jr	r31
+	nop
+.endproc _pipe_read
+
+.proc _pipe_destroy
+.global _pipe_destroy
+_pipe_destroy:
+	trap	#0x47f
+	jr	r31
+	nop
+.endproc _pipe_destroy
+
+.proc _mbox_stats
+.global _mbox_stats
+_mbox_stats:
+	trap	#0x480
+	jr	r31
+	nop
+.endproc _mbox_stats
+
+.proc _mbox_broadcast
+.global _mbox_broadcast
+_mbox_broadcast:
+	trap	#0x481
+	jr	r31
+	nop
+.endproc _mbox_broadcast
+
+.proc _mbox_recv_broadcast
+.global _mbox_recv_broadcast
+_mbox_recv_broadcast:
+	trap	#0x482
+	jr	r31
+	nop
+.endproc _mbox_recv_broadcast
+
+.proc _clock_read
+.global _clock_read
+_clock_read:
+	trap	#0x483
+	jr	r31
+	nop
+.endproc _clock_read
+
+.proc _mbox_send_prio
+.global _mbox_send_prio
+_mbox_send_prio:
+	trap	#0x484
+	jr	r31
+	nop
+.endproc _mbox_send_prio
+
 
 .proc _Exit
 .global _Exit
@@ -0,0 +1,165 @@
+#include "usertraps.h"
+#include "misc.h"
+
+#define BENCH_PAGE_SIZE 4096     // MEM_PAGESIZE in the kernel
+#define BENCH_REGION_PAGES 32    // Pages the parent can touch before forking
+#define BENCH_COW_PAGES 16       // Pages a child writes after the fork
+#define BENCH_STACK_PAGES 48     // New stack pages a child touches
+#define BENCH_ALLOC_PAGES 128    // Pages taken for each allocation measurement
+
+static char region[BENCH_REGION_PAGES * BENCH_PAGE_SIZE];
+static sem_t done;               // Signalled by each child before it exits
+
+static unsigned int instrs()
+{
+  return perf_read(PERF_INSTRS);
+}
+
+// Write one byte of each of the first n pages of region
+static void touch(int n)
+{
+  int i;
+
+  for(i=0; i<n; i++) {
+    region[i * BENCH_PAGE_SIZE] = i;
+  }
+}
+
+// Fork a child that runs func and signals done, and wait for it
+static void run_child(void (*func)())
+{
+  if (fork() == 0) {
+    func();
+    sem_signal(done);
+    Exit();
+  }
+  sem_wait(done);
+}
+
+// Fork latency as the parent's resident set grows
+static void bench_fork(int n)
+{
+  static int pages[] = { 0, 8, 16, BENCH_REGION_PAGES };
+  mem_stats_t stats;
+  unsigned int start, call, round;
+  int i, j;
+
+  Printf("fork (%d times each):\n", n);
+  for(i=0; i<sizeof(pages)/sizeof(pages[0]); i++) {
+    touch(pages[i]);
+    process_memstats(&stats);
+    call = round = 0;
+    for(j=0; j<n; j++) {
+      start = instrs();
+      if (fork() == 0) {
+        sem_signal(done);
+        Exit();
+      }
+      call += instrs() - start;
+      sem_wait(done);
+      round += instrs() - start;
+    }
+    Printf("  %d pages touched, %d resident: fork() %d instructions, until the child has run %d\n",
+           pages[i], stats.resident, call / n, round / n);
+  }
+}
+
+// A child writing pages it shares with its parent: the first write to
+// each one copies it (MemoryRopHandler), the second doesn't fault
+static void cow_child()
+{
+  mem_stats_t before, after;
+  unsigned int first, again;
+  int i;
+
+  process_memstats(&before);
+  first = instrs();
+  for(i=0; i<BENCH_COW_PAGES; i++) {
+    region[i * BENCH_PAGE_SIZE + 1] = i;
+  }
+  again = instrs();
+  first = again - first;
+  for(i=0; i<BENCH_COW_PAGES; i++) {
+    region[i * BENCH_PAGE_SIZE + 1] = i + 1;
+  }
+  again = instrs() - again;
+  process_memstats(&after);
+  Printf("  first write %d instructions per page, again %d; %d pages copied\n",
+         first / BENCH_COW_PAGES, again / BENCH_COW_PAGES,
+         after.cowBreaks - before.cowBreaks);
+}
+
+static void bench_cow()
+{
+  Printf("Copy on write (%d pages, after fork):\n", BENCH_COW_PAGES);
+  touch(BENCH_COW_PAGES);
+  run_child(cow_child);
+}
+
+// A frame big enough to need BENCH_STACK_PAGES more stack pages,
+// touched from the top down as a deep call chain would
+static void stack_child()
+{
+  volatile char frame[BENCH_STACK_PAGES * BENCH_PAGE_SIZE];
+  mem_stats_t before, after;
+  unsigned int start;
+  int i;
+
+  process_memstats(&before);
+  start = instrs();
+  for(i=BENCH_STACK_PAGES-1; i>=0; i--) {
+    frame[i * BENCH_PAGE_SIZE + BENCH_PAGE_SIZE - 1] = i;
+  }
+  start = instrs() - start;
+  process_memstats(&after);
+  Printf("  %d instructions per page; %d growth faults for %d pages\n",
+         start / BENCH_STACK_PAGES, after.growthFaults - before.growthFaults,
+         after.growthPages - before.growthPages);
+}
+
+static void bench_stack()
+{
+  Printf("Stack growth (%d pages):\n", BENCH_STACK_PAGES);
+  run_child(stack_child);
+}
+
+// MemoryAllocPage with the free pages together and scattered
+static void bench_alloc()
+{
+  static int strides[] = { 1, 2, 4, 16 };
+  int i, cost;
+
+  Printf("MemoryAllocPage (%d pages taken, every n-th given back):\n", BENCH_ALLOC_PAGES);
+  for(i=0; i<sizeof(strides)/sizeof(strides[0]); i++) {
+    if ((cost = memory_alloc_cost(BENCH_ALLOC_PAGES, strides[i])) < 0) {
+      Printf("  every %d: not enough free pages\n", strides[i]);
+    } else {
+      Printf("  every %d: %d instructions per page\n", strides[i], cost);
+    }
+  }
+}
+
+void main (int argc, char *argv[])
+{
+  int n = 20;                    // Forks per fork measurement
+
+  if (argc > 2) {
+    Printf("Usage: %s [forks per measurement]\n", argv[0]);
+    Exit();
+  }
+  if (argc == 2) {
+    n = dstrtol(argv[1], NULL, 10);
+  }
+  if (n <= 0) n = 1;
+  if ((done = sem_create(0)) == SYNC_FAIL) {
+    Printf("mem_bench (%d): Bad sem_create\n", getpid());
+    Exit();
+  }
+
+  bench_fork(n);
+  bench_cow();
+  bench_stack();
+  bench_alloc();
+
+  Printf("mem_bench (%d): Done!\n", getpid());
+}
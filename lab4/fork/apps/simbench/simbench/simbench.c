@@ -0,0 +1,123 @@
+#include "usertraps.h"
+#include "misc.h"
+
+#define BENCH_UNIT 10000          // Loop iterations per unit of scale
+#define BENCH_ARRAY_WORDS 4096
+
+static int array[BENCH_ARRAY_WORDS];
+
+static int alu(int n)
+{
+  int a = 1, b = 3, i;
+
+  for(i=0; i<n; i++) {
+    a = ((a << 2) + a + b) ^ (a >> 3);
+    b = (b + (a & 0xff)) | (i << 1);
+  }
+  return a + b;
+}
+
+static int mem(int n)
+{
+  int sum = 0, i, j;
+
+  for(i=0; i<n; i++) {
+    j = (i << 4) & (BENCH_ARRAY_WORDS - 1);
+    array[j] = sum;
+    sum += array[(j + 9) & (BENCH_ARRAY_WORDS - 1)] + i;
+  }
+  return sum;
+}
+
+static int branch(int n)
+{
+  unsigned int x = 2463534242u;
+  int count = 0, i;
+
+  for(i=0; i<n; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    if (x & 1) {
+      count++;
+    } else if (x & 2) {
+      count--;
+    }
+    if ((x & 0x30) == 0x10) {
+      count += 2;
+    }
+  }
+  return count;
+}
+
+static int fp(int n)
+{
+  double s = 0.0, t = 1.0;
+  int i;
+
+  for(i=0; i<n; i++) {
+    s = s * 0.999 + t;
+    t = t / 1.0001 - 0.00001;
+  }
+  return (int)s;
+}
+
+static int fib(int k)
+{
+  return (k < 2) ? k : fib(k - 1) + fib(k - 2);
+}
+
+static int call(int n)
+{
+  int sum = 0;
+
+  // fib(15) makes about 2000 calls
+  for(; n > 0; n -= 2000) {
+    sum += fib(15);
+  }
+  return sum;
+}
+
+static int trap(int n)
+{
+  int sum = 0, i;
+
+  // A trap costs a few hundred instructions, so do fewer
+  for(i=0; i<n/100; i++) {
+    sum += getpid();
+  }
+  return sum;
+}
+
+static struct {
+  char *name;
+  int (*func)(int n);
+} workloads[] = {
+  { "alu", alu },
+  { "mem", mem },
+  { "branch", branch },
+  { "fp", fp },
+  { "call", call },
+  { "trap", trap },
+};
+
+void main (int argc, char *argv[])
+{
+  int scale = 100;
+  int i;
+
+  if ((argc < 2) || (argc > 3)) {
+    Printf("Usage: %s <alu|mem|branch|fp|call|trap> [scale]\n", argv[0]);
+    Exit();
+  }
+  if (argc == 3) {
+    scale = dstrtol(argv[2], NULL, 10);
+  }
+  for(i=0; i<sizeof(workloads)/sizeof(workloads[0]); i++) {
+    if (dstrncmp(argv[1], workloads[i].name, dstrlen(workloads[i].name) + 1) == 0) {
+      Printf("simbench: %s %d\n", workloads[i].name, workloads[i].func(scale * BENCH_UNIT));
+      return;
+    }
+  }
+  Printf("simbench: no workload %s\n", argv[1]);
+}
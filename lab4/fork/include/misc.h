@@ -5,6 +5,9 @@
 #ifndef	_misc_h_
 #define	_misc_h_
 
+// bcopy/bzero sizes (bytes) worth a simulator block operation trap
+#define	MISC_BLOCKOP_MIN	64
+
 extern char*	dstrcpy(char*, const char*);
 extern char*	dstrncpy(char*, const char*, int n);
 extern const char *dstrstr (const char *, const char *);
@@ -17,6 +20,8 @@ extern void ditoa (int n, char *buf);
 char *dstrcat (char *onto, const char *addn);
 int min(int a, int b);
 int max(int a, int b);
+void bzero(char *dst, int count);
+void bcopy(char *src, char *dst, int count);
 
 inline
 int
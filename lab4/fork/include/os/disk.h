@@ -0,0 +1,37 @@
+#ifndef __DISK_H__
+#define __DISK_H__
+
+// Name of file which represents the "hard disk".  It's the one lab5's
+// DFS lives on: the DFS takes the first DISK_DFS_BLOCKS blocks and
+// the swap area (see memory.c) the blocks after it.
+#define DISK_FILENAME "/tmp/ee469g69.img"
+
+// Number of bytes in one physical disk block
+#define DISK_BLOCKSIZE 512
+
+// Total size of this disk, in units of 512-byte blocks
+#define DISK_DFS_BLOCKS 0x8000
+#define DISK_NUMBLOCKS 0x10000
+
+#define DISK_SUCCESS 1
+#define DISK_FAIL -1
+
+// Most blocks moved by one request; the simulator has no limit, this
+// just bounds how long interrupts stay off.
+#define DISK_MAX_REQUEST_BLOCKS 64
+
+int DiskModuleInit();
+void DiskInterrupt();
+int DiskWriteBlocks (uint32 blocknum, int count, void *buf);
+int DiskReadBlocks (uint32 blocknum, int count, void *buf);
+
+// Background writes: DiskStartWrite returns as soon as the request is
+// started, and done(1) (or done(0) if it failed) is called from the
+// disk interrupt once it's on the disk.  Only one can be in flight;
+// DiskStartWrite fails while DiskBusy, and DiskWait waits it out.
+// The other calls wait for it first.
+int DiskStartWrite (uint32 blocknum, int count, void *buf, void (*done)(int ok));
+int DiskBusy();
+void DiskWait();
+
+#endif
@@ -10,5 +10,7 @@
 #define	DLX_STATUS_SYSMODE	0x40	// Set if CPU is in system mode
 #define	DLX_STATUS_PAGE_TABLE	0x100	// Set -> use a page table
 #define	DLX_STATUS_TLB		0x200	// Set -> use a software-loaded TLB
+#define	DLX_STATUS_FPDISABLE	0x1000	// Set -> FP registers trap (TRAP_FPU)
+					//   in user mode
 
 #endif	// _dlx_h_
@@ -29,14 +29,23 @@ extern char  debugstr[];
   (dindex(debugstr,'+')!=(char *)0)) {  \
   printf (format, ## args);    \
     } */
+// Building with -DDLXOS_NODEBUG (see CFLAGS in os/Makefile) compiles
+// them all out, for when even checking debugstr costs too much.
+#ifdef DLXOS_NODEBUG
+#define  dbprintf(flag, format, args...)
+#else
 #define  dbprintf(flag, format, args...) \
          if (dindex(debugstr,flag)!=(char *)0) { printf(format, ## args); }  \
          if (dindex(debugstr,'+')!=(char *)0)  { printf(format, ## args); }
+#endif
 
 
 extern int  CurrentIntrs ();
 extern int  SetIntrs (int);
+extern int  FindFirstSet (uint32);
 extern void  KbdModuleInit ();
+extern uint32  PerfCounterRead (int ctr);
+extern void  PerfCounterReset (int ctr);
 extern void  intrreturn ();
 
 inline int
@@ -5,6 +5,21 @@
 #include "memory_constants.h"
 
 extern int lastosaddress; // Defined in an assembly file
+extern int memoryFaultAround; // Pages per stack growth fault ("-a" sets it)
+extern int memoryShareTables; // Fork shares L2 tables ("-s" sets it)
+
+// What process_memstats() reports, in pages.  Must match mem_stats_t
+// in usertraps.h.
+typedef struct MemStats {
+  int resident;		// Mapped and in memory
+  int shared;		//   of which some other page table maps too
+  int swapped;		// Out in swap
+  int peak;		// Most ever resident
+  int pageFaults;
+  int growthFaults;	// Faults that grew the stack
+  int growthPages;	//   and the pages they added
+  int cowBreaks;	// Writes that copied a shared page
+} MemStats;
 
 //--------------------------------------------------------
 // Existing function prototypes:
@@ -20,6 +35,8 @@ int MemoryPageFaultHandler(PCB *pcb);
 int MemoryAllocPage(void);
 uint32 MemorySetupPte (uint32 page);
 void MemoryFreePage(uint32 page);
+int MemoryAllocPages(int n, int align);
+void MemoryFreePages(uint32 base, int n);
 //---------------------------------------------------------
 // Put your function prototypes here
 //---------------------------------------------------------
@@ -31,5 +48,21 @@ void MemoryEditFreemap(int page, int val);
 void MemoryFreePageTableEntry(uint32 pte);
 void MemoryRopHandler(PCB * pcb);
 void MemorySharePte (uint32 page);
+int MemoryPteRefs (uint32 pte);
+uint32 *MemoryPte (PCB *pcb, int page, int create);
+uint32 *MemoryPrivatePte (PCB *pcb, int page);
+uint32 MemoryGetPte (PCB *pcb, int page);
+int MemorySetPte (PCB *pcb, int page, uint32 pte);
+void MemoryFreePageTables (PCB *pcb);
+int MemoryForkPageTables (PCB *child, PCB *parent);
+void MemoryUnmapPte (uint32 *pte);
+void MemorySwapModuleInit ();
+int MemorySwapIn (PCB *pcb, int page);
+void MemoryPinPage (uint32 page);
+void MemoryUnpinPage (uint32 page);
+void MemoryGetStats (PCB *pcb, MemStats *stats);
+int MemoryAllocZeroedPage (void);
+int MemoryZeroPoolFill (void);
+int MemoryAllocCost(int pages, int stride);
 
 #endif	// _memory_h_
@@ -20,17 +20,23 @@
 
 //--------------------------------------------------------
 
-// Bit position of the least significant bit of the level 1 page number field 
-// in a virtual address.
+// Bit position of the least significant bit of the page number field 
+// in a virtual address (the L2 index, with two-level tables).
 #define MEM_L1FIELD_FIRST_BITNUM 12
 // The maximum allowable address in the virtual address space. Note that this 
 // is not the 4-byte-aligned address, but rather the actual maximum address 
 // (it should end with 0xF).
-#define MEM_MAX_VIRTUAL_ADDRESS 0xFFFFF
+#define MEM_MAX_VIRTUAL_ADDRESS 0xFFFFFFF
 // Use a maximum physical memory size of 2MB
 #define MEM_MAX_SIZE 0x200000
 
 // PTE codes
+// The simulator sets REFERENCED on every access (a bit higher than
+// usual, since READONLY has its place) and DIRTY on writes.  SWAPPED
+// is the OS's own: the PTE is invalid and its page number field holds
+// the swap slot the page was written to.
+#define MEM_PTE_SWAPPED 0x10
+#define MEM_PTE_REFERENCED 0x8
 #define MEM_PTE_READONLY 0x4
 #define MEM_PTE_DIRTY 0x2
 #define MEM_PTE_VALID 0x1
@@ -38,11 +44,46 @@
 // Calculated constants given in "Bitwise tricks" section of the lab 
 #define MEM_PAGESIZE (0x1 << MEM_L1FIELD_FIRST_BITNUM)
 #define MEM_PAGE_OFFSET_MASK (MEM_PAGESIZE - 1)
-#define MEM_L1PAGETABLE_SIZE ((MEM_MAX_VIRTUAL_ADDRESS + 1) >> MEM_L1FIELD_FIRST_BITNUM)
-#define MEM_MASK_PTE2PAGE (~(MEM_PTE_READONLY | MEM_PTE_DIRTY | MEM_PTE_VALID))
+#define MEM_L1PAGETABLE_SIZE ((MEM_MAX_VIRTUAL_ADDRESS + 1) >> MEM_L1_SHIFT)
+#define MEM_MASK_PTE2PAGE (~(MEM_PTE_SWAPPED | MEM_PTE_REFERENCED | MEM_PTE_READONLY | MEM_PTE_DIRTY | MEM_PTE_VALID))
 #define MEM_NUM_PAGES (MEM_MAX_SIZE / MEM_PAGESIZE)
 #define MEM_ADDR_OFFS_MASK (MEM_PAGESIZE - 1)
 
+// Two-level page tables.  The low MEM_L2_INDEX_BITS bits of a virtual
+// page number index an L2 table, which is one page of PTEs, and the
+// rest index the L1 table in the PCB.  An L1 entry holds the physical
+// address of its L2 table, or 0 until a page in its range is mapped.
+#define MEM_L2_INDEX_BITS 10
+#define MEM_L2PAGETABLE_SIZE (1 << MEM_L2_INDEX_BITS)
+#define MEM_L1_SHIFT (MEM_L1FIELD_FIRST_BITNUM + MEM_L2_INDEX_BITS)
+// For the page table bits register: L2 (page) bits above, L1 bits below
+#define MEM_PTBITS ((MEM_L1FIELD_FIRST_BITNUM << 16) | MEM_L1_SHIFT)
+#define MEM_PAGE2L1(page) ((page) >> MEM_L2_INDEX_BITS)
+#define MEM_PAGE2L2(page) ((page) & (MEM_L2PAGETABLE_SIZE - 1))
+
+// A stack growth fault maps up to this many pages, the faulting one
+// and those below it (see memoryFaultAround)
+#define MEM_FAULT_AROUND_PAGES 4
+
+// Once a stack has grown by this many pages, it grows by a "large
+// page" at a time: a naturally aligned run of this many pages, mapped
+// in one fault from physically contiguous memory.  The hardware has no
+// large mappings (an L1 entry always points at an L2 table), so each
+// page still has a PTE of its own and can be paged out on its own.
+// Must be a power of two.
+#define MEM_LARGE_PAGE_PAGES 16
+
+// Pages kept zeroed ahead of time (see MemoryAllocZeroedPage); the
+// zeroing process is woken once the pool is down to MEM_ZERO_POOL_LOW
+#define MEM_ZERO_POOL_PAGES 16
+#define MEM_ZERO_POOL_LOW 8
+
+// Swap area: this many pages' worth of disk after lab5's DFS.  A
+// slot is one page.
+#define MEM_SWAP_SLOTS 4096
+#define MEM_PTE2SLOT(pte) ((pte) >> MEM_L1FIELD_FIRST_BITNUM)
+#define MEM_SLOT2PTE(slot) (((slot) << MEM_L1FIELD_FIRST_BITNUM) | MEM_PTE_SWAPPED)
+
 // Conversions
 #define MEM_ADDR2PAGE(address) ((address) >> MEM_L1FIELD_FIRST_BITNUM)
 #define MEM_ADDR2OFFS(address) ((address) & MEM_ADDR_OFFS_MASK)
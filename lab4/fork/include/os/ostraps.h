@@ -16,6 +16,11 @@ int write(int fd, char *buf, int numbytes);
 int lseek(int fd, int offset, int where);
 int close(int fd);
 void bcopy(char *source, char *destination, int numbytes);
+// Simulator block operations on physical memory; -1 if not usable
+int memmove(void *dst, const void *src, int numbytes);
+int memset(void *dst, int c, int numbytes);
+// Write a formatted buffer to the simulator's console
+int conswrite(const char *buf, int numbytes);
 void exitsim();
 void TimerSet(int us);
 
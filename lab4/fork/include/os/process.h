@@ -19,7 +19,8 @@
 #define	PROCESS_MAX_PROCS	32	// Maximum number of active processes
 
 #define	PROCESS_INIT_ISR_SYS	0x140	// Initial status reg value for system processes
-#define	PROCESS_INIT_ISR_USER	0x100	// Initial status reg value for user processes
+#define	PROCESS_INIT_ISR_USER	0x1100	// Initial status reg value for user processes
+					//   (FP off until first used)
 
 #define	PROCESS_STATUS_FREE	0x1
 #define	PROCESS_STATUS_RUNNABLE	0x2
@@ -39,8 +40,25 @@ typedef struct PCB {
   uint32	sysStackArea;	// System stack area for this process
   unsigned int	flags;
   char		name[80];	// Process name
-  uint32	pagetable[MEM_L1PAGETABLE_SIZE]; // Statically allocated page table
+  uint32	pagetable[MEM_L1PAGETABLE_SIZE]; // L1 table; L2 tables are allocated as needed
   int		npages;		// Number of pages allocated to this process
+  int		imagePages;	// Pages backed by the executable (0: none)
+  uint32	codeStart;	// Segment map of the executable, for
+  uint32	codeSize;	//   ProcessPageIn
+  uint32	dataStart;
+  uint32	dataSize;
+  struct PCB	*mm;		// PCB whose page table this one runs in:
+				//   itself, unless this is a thread
+  uint32	threadSlots;	// Bit k set: thread stack slot k is in use
+  int		threadSlot;	// This thread's stack slot (0: not a thread)
+  int		pageFaults;	// Page faults this PCB took, of which
+  int		growthFaults;	//   this many grew its stack
+  int		growthPages;	//   by this many pages in all
+  int		cowBreaks;	// Shared pages it wrote to and got copies of
+  int		residentPages;	// Pages its page table maps in memory now
+  int		peakPages;	//   and the most it ever did
+  int		fpUsed;		// Its frames hold FP registers (see
+				//   ProcessFpEnable)
   Link		*l;		// Used for keeping PCB in queues
 } PCB;
 
@@ -68,6 +86,21 @@ extern PCB	*currentPCB;
 #define MAX_ARGS	10		// Max number of command-line
 					// arguments
 
+// Binary executable images.  This matches dlximage.h in the simulator
+// source: a header of PROCESS_IMAGE_HEADER_WORDS big-endian words
+// followed by segments of (load address, length, bytes).
+#define PROCESS_IMAGE_MAGIC		0x444c5849	// "DLXI"
+#define PROCESS_IMAGE_VERSION		1
+#define PROCESS_IMAGE_HEADER_WORDS	9
+#define PROCESS_IMAGE_SEGHDR_WORDS	2
+#define PROCESS_IMAGE_MAGIC_WORD	0
+#define PROCESS_IMAGE_VERSION_WORD	1
+#define PROCESS_IMAGE_START_WORD	2
+#define PROCESS_IMAGE_CODESTART_WORD	4
+#define PROCESS_IMAGE_CODESIZE_WORD	5
+#define PROCESS_IMAGE_DATASTART_WORD	6
+#define PROCESS_IMAGE_DATASIZE_WORD	7
+
 // Number of jiffies in a single process quantum (i.e. how often ProcessSchedule is called)
 #define PROCESS_QUANTUM_JIFFIES  CLOCK_PROCESS_JIFFIES
 // Number of jiffies that have to pass before decaying all estcpu's
@@ -80,6 +113,23 @@ extern PCB	*currentPCB;
 //---------------------------------------------------------
 #define PROCESS_FORK_FAIL -1
 #define PROCESS_FORK_SUCCESS 1
+// Executables whose code pages are kept for sharing with later instances
+#define PROCESS_TEXT_CACHE_SIZE 4
+// User pages 0 .. PROCESS_IMAGE_PAGES-1 hold code and data, and are
+// filled from the executable when first touched
+#define PROCESS_IMAGE_PAGES 4
+// Threads (see ProcessThreadCreate) share their creator's page table.
+// Thread k (1 .. PROCESS_MAX_THREADS) gets the PROCESS_THREAD_STACK_PAGES
+// pages ending PROCESS_THREAD_STACK_PAGES * k pages below the top of the
+// address space for its user stack.  A thread function that returns
+// jumps to PROCESS_THREAD_RETURN_ADDR, never mapped, and its page fault
+// ends the thread.
+#define PROCESS_MAX_THREADS 8
+#define PROCESS_THREAD_STACK_PAGES 8
+#define PROCESS_THREAD_RETURN_ADDR (PROCESS_IMAGE_PAGES * MEM_PAGESIZE)
+// A process's own stack may grow to this many pages (past the first
+// PROCESS_THREAD_STACK_PAGES it runs into thread 1's, if there is one)
+#define PROCESS_STACK_MAX_PAGES 256
 
 
 //---------------------------------------------------------
@@ -105,6 +155,15 @@ void ProcessPrintFork(PCB *);
 //-------------------------------------------------------
 
 int ProcessRealFork(PCB * parent);
+int ProcessPageIn (PCB *pcb, int page);
+int ProcessThreadCreate (PCB *parent, uint32 func, uint32 arg);
+int ProcessExec (PCB *pcb, char *name, char *allargs);
+void ProcessFpEnable (PCB *pcb);
+
+void ProcessZeroer ();
+void ProcessWakeZeroer ();
+
+extern int processPinfo;	// Print memory use at exit ("-p" sets it)
 
 
 #endif	/* __process_h__ */
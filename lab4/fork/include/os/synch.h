@@ -25,6 +25,7 @@
 				//This is because condition vars also use
 				//locks from the same pool
 #define MAX_CONDS	32	//Maximum 32 conds allowed in the system
+#define MAX_FUTEXES	32	//Words that can have sleepers at the same time
 
 typedef int sem_t;
 typedef int lock_t;
@@ -78,4 +79,17 @@ int CondHandleWait(cond_t cond);
 int CondHandleSignal(cond_t cond);
 int CondHandleBroadcast(cond_t cond);
 
+// A futex is the kernel half of a user space lock (see ulock.h): just
+// a queue of processes sleeping on one word of memory.  It exists only
+// while something sleeps on the word, and is keyed by the word's
+// physical address so that threads and shared pages find the same one.
+typedef struct Futex {
+  uint32 addr;   // Physical address of the word
+  Queue waiting; // Queue of processes sleeping on the word
+  int inuse;     // Bookkeeping variable for free vs. used structures
+} Futex;
+
+int FutexWait(uint32 uaddr, int val);
+int FutexWake(uint32 uaddr, int count);
+
 #endif	//_synch_h_
@@ -34,10 +34,12 @@
 #define	TRAP_PRIVILEGE		0x6	// Instruction must be executed as sys
 #define	TRAP_FORMAT		0x7	// Instruction is malformed
 #define TRAP_ROP_ACCESS 0x8 // ROP Access
+#define	TRAP_FPU		0x9	// FP register used with DLX_STATUS_FPDISABLE
 #define	TRAP_PAGEFAULT		0x20
 #define	TRAP_TLBFAULT		0x30
 #define	TRAP_TIMER		0x40	// timer interrupt
 #define	TRAP_KBD		0x48	// keyboard interrupt
+#define	TRAP_DISK		0x50	// disk transfer complete
 
 // This bit is set in CAUSE if the interrupt was a trap instruction
 #define	TRAP_TRAP_INSTR		0x08000000
@@ -63,6 +65,9 @@
 #define	TRAP_PROCESS_FORK	0x430
 #define TRAP_PROCESS_GETPID	0x431
 #define TRAP_PROCESS_CREATE	0x432
+#define TRAP_THREAD_CREATE	0x433
+#define TRAP_PROCESS_SPAWN	0x434
+#define TRAP_PROCESS_EXEC	0x435
 #define TRAP_SHARE_CREATE_PAGE	0x440
 #define TRAP_SHARE_MAP_PAGE	0x441
 #define TRAP_SEM_CREATE		0x450
@@ -84,6 +89,11 @@
 #define TRAP_YIELD              0x466
 #define TRAP_MALLOC             0x467
 #define TRAP_MFREE              0x468
+#define TRAP_PERF_READ          0x469
+#define TRAP_FUTEX_WAIT         0x46a
+#define TRAP_FUTEX_WAKE         0x46b
+#define TRAP_PROCESS_MEMSTATS   0x46c
+#define TRAP_MEMORY_ALLOC_COST  0x46d
 
 #define TRAP_USER_EXIT          0x500
 
@@ -95,6 +105,62 @@
 #define	DLX_KBD_NCHARSIN	0xfff001a0
 #define	DLX_KBD_INTR		0xfff001c0
 
+// DMA disk registers.  Program BLOCK, ADDR (physical) and COUNT, then
+// write READ or WRITE to REQUEST; STATUS says when it's done.
+#define	DLX_DMADISK_NAME	0xfff00400	// physical addr of host file name
+#define	DLX_DMADISK_BLOCK	0xfff00404
+#define	DLX_DMADISK_ADDR	0xfff00408
+#define	DLX_DMADISK_COUNT	0xfff0040c
+#define	DLX_DMADISK_REQUEST	0xfff00410
+#define	DLX_DMADISK_STATUS	0xfff00414	// write to acknowledge
+#define	DLX_DMADISK_INTR	0xfff00418	// 1 enables TRAP_DISK
+#define	DLX_DMADISK_LATENCY	0xfff0041c	// us per request
+#define	DLX_DMADISK_BLOCKLAT	0xfff00420	// us per block
+
+#define	DLX_DMADISK_READ	1
+#define	DLX_DMADISK_WRITE	2
+
+#define	DLX_DMADISK_IDLE	0
+#define	DLX_DMADISK_BUSY	1
+#define	DLX_DMADISK_DONE	2
+#define	DLX_DMADISK_ERROR	3
+
+// Performance counters: counter n is a 64-bit value at
+// DLX_PERF_BASE + 8*n (low word first).  Writing the low word sets it.
+#define	DLX_PERF_BASE		0xffff1000
+#define	DLX_PERF_INSTRS		0	// instructions retired
+#define	DLX_PERF_USER_INSTRS	1	// ... in user mode
+#define	DLX_PERF_SYS_INSTRS	2	// ... in system mode
+#define	DLX_PERF_LOADS		3
+#define	DLX_PERF_STORES		4
+#define	DLX_PERF_PT_WALKS	5	// page table walks (TLB misses)
+#define	DLX_PERF_TLB_HITS	6
+#define	DLX_PERF_PAGE_FAULTS	7
+#define	DLX_PERF_EXCEPTIONS	8	// all exceptions, traps included
+#define	DLX_PERF_TRAPS		9
+#define	DLX_PERF_TIMER_INTRS	10
+#define	DLX_PERF_KBD_INTRS	11
+#define	DLX_PERF_CAUSE_BASE	16	// + cause, for causes below 0x80
+#define	DLX_PERF_NUM		(DLX_PERF_CAUSE_BASE + 0x80)
+
+// SMP registers (when the simulator runs with DLXSIM_CPUS > 1).
+// Writing an entry point to DLX_SMP_START starts the idle cores there
+// with interrupts off; writing a core number to DLX_SMP_IPI interrupts
+// it, and reading DLX_SMP_IPI returns the mask of cores that sent one.
+#define	DLX_SMP_CPUID		0xffff2000
+#define	DLX_SMP_NCPUS		0xffff2004
+#define	DLX_SMP_IPI		0xffff2008
+#define	DLX_SMP_START		0xffff200c
+#define	TRAP_IPI		0x51
+
+// Page heatmap (when the simulator runs with DLXSIM_HEATMAP set).
+// Writing DLX_HEAT_DUMP to DLX_HEAT_CMD writes the per-page access
+// counts so far to the heatmap file; DLX_HEAT_DUMP_RESET also zeroes
+// them.  Reading DLX_HEAT_CMD returns the number of dumps written.
+#define	DLX_HEAT_CMD		0xffff3000
+#define	DLX_HEAT_DUMP		1
+#define	DLX_HEAT_DUMP_RESET	2
+
 #define	TRAP_STACK_SIZE		0x800	// interrupt stack is 2K words
 
 #endif	/* _dlxtraps_h_ */
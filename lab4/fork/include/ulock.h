@@ -0,0 +1,35 @@
+#ifndef __ulock_h__
+#define __ulock_h__
+
+//---------------------------------------------------------------------
+// User space locks.  A ulock is one word in memory that every user
+// of the lock can see (a global shared by threads, or a word in a
+// shared page), claimed with an atomic compare-and-swap.  Taking a
+// free lock or releasing one nobody waits for never enters the
+// kernel; only contention does, through futex_wait/futex_wake.  To
+// use them, add
+//	LIBS+= ulock.o
+// to the application's Makefile.
+//
+// A contended acquire first spins ULOCK_SPIN times, which pays off
+// when the holder runs on another core (SMP mode), then sleeps.
+// Unlike lock_acquire, a ulock isn't recursive.
+//---------------------------------------------------------------------
+
+#define ULOCK_FREE	0
+#define ULOCK_HELD	1		// Held, nobody sleeping
+#define ULOCK_WAITERS	2		// Held, maybe with sleepers
+#define ULOCK_SPIN	50
+
+typedef struct ulock {
+  int		state;			// ULOCK_*
+} ulock_t;
+
+#define ULOCK_INITIALIZER	{ ULOCK_FREE }
+
+void ulock_init(ulock_t *l);
+void ulock_acquire(ulock_t *l);
+int ulock_tryacquire(ulock_t *l);	// 1 if taken, 0 if it was held
+void ulock_release(ulock_t *l);
+
+#endif
@@ -67,7 +67,58 @@ void yield();                           //trap 0x466
 void *malloc(int memsize);              //trap 0x467
 int mfree(void *ptr);                   //trap 0x468
 
+//Related to performance counters (low 32 bits; see DLX_PERF_* in traps.h)
+unsigned int perf_read(int counter);    //trap 0x469
+#define PERF_INSTRS       0
+#define PERF_USER_INSTRS  1
+#define PERF_SYS_INSTRS   2
+#define PERF_LOADS        3
+#define PERF_STORES       4
+#define PERF_PT_WALKS     5
+#define PERF_TLB_HITS     6
+#define PERF_PAGE_FAULTS  7
+#define PERF_EXCEPTIONS   8
+#define PERF_TRAPS        9
+
+//Atomic memory operations (simulator instructions, not traps)
+int atomic_swap(int *addr, int val);    //returns the old value
+int test_and_set(int *addr);            //sets *addr to 1, returns old value
+int load_linked(int *addr);
+int store_conditional(int *addr, int val); //1 if stored, 0 if not
+
+//Sleeping on a word of memory (the slow path of ulock.h)
+int futex_wait(int *addr, int val);     //trap 0x46a, sleeps only if *addr == val
+int futex_wake(int *addr, int count);   //trap 0x46b, returns the number woken
+
+//Memory use of the calling process, in pages (must match MemStats in memory.h)
+typedef struct mem_stats {
+  int resident;         //mapped and in memory
+  int shared;           //  of which another process maps too
+  int swapped;          //out in swap
+  int peak;             //most ever resident
+  int pageFaults;
+  int growthFaults;     //faults that grew the stack
+  int growthPages;      //  and the pages they added
+  int cowBreaks;        //writes that copied a shared page
+} mem_stats_t;
+int process_memstats(mem_stats_t *stats);  //trap 0x46c, 1 on success, -1 on failure
+
+//Instructions per physical page allocation after freeing every stride-th
+//of pages pages (see MemoryAllocCost), or -1
+int memory_alloc_cost(int pages, int stride);  //trap 0x46d
+
 int fork();								//trap 0x430
+// Runs func(arg) in a new thread sharing this process's memory; the
+// thread ends when func returns, calls Exit(), or the process exits.
+// Returns the thread's pid, or -1.
+int thread_create(void (*func)(void *), void *arg);	//trap 0x433
+// Start exec_name (arguments as for process_create, NULL-terminated)
+// in a new process loaded straight from the file, without copying
+// this one as fork does.  Returns its pid, or -1.
+int spawn(char *exec_name, ...);			//trap 0x434
+// Replace this process's program with exec_name, keeping its pid.
+// Only returns, with -1, if exec_name can't be loaded.
+int exec(char *exec_name, ...);				//trap 0x435
 
 #ifndef NULL
 #define NULL (void *)0x0
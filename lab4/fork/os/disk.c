@@ -0,0 +1,195 @@
+#include "ostraps.h"
+#include "dlxos.h"
+#include "traps.h"
+#include "queue.h"
+#include "disk.h"
+
+//----------------------------------------------------------------------------
+// DiskModuleInit points the simulator's DMA disk at the file named by
+// DISK_FILENAME and turns on its completion interrupt.  It must be
+// called before any other disk function.  Returns DISK_FAIL if the
+// file can't be opened; the OS then runs without a disk.
+//----------------------------------------------------------------------------
+
+static int disk_ready = 0;
+static int disk_interrupts = 0;
+// The background write in flight, if any
+static void (*disk_done)(int ok) = NULL;
+
+int DiskModuleInit() {
+  char *filename = DISK_FILENAME;
+
+  *((uint32 *)DLX_DMADISK_STATUS) = 0;
+  *((uint32 *)DLX_DMADISK_NAME) = (uint32)filename;
+  if (*((uint32 *)DLX_DMADISK_STATUS) == DLX_DMADISK_ERROR) {
+    printf("DiskModuleInit: disk %s cannot be opened!\n", DISK_FILENAME);
+    return DISK_FAIL;
+  }
+  *((uint32 *)DLX_DMADISK_INTR) = 1;
+  disk_ready = 1;
+  return DISK_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// DiskFinish acknowledges a request that's no longer busy and, if it
+// was a background write, reports how it went.  Interrupts must be
+// disabled.
+//----------------------------------------------------------------------------
+
+static void DiskFinish(uint32 status) {
+  void (*done)(int ok) = disk_done;
+
+  *((uint32 *)DLX_DMADISK_STATUS) = 0;
+  if (done != NULL) {
+    disk_done = NULL;
+    done(status == DLX_DMADISK_DONE);
+  }
+}
+
+//----------------------------------------------------------------------------
+// DiskInterrupt handles TRAP_DISK.  Background writes finish here.
+// Other transfers are waited for by polling the status register in
+// DiskIo, so by the time the interrupt is taken (interrupts are off
+// while polling) the request has already been acknowledged; this
+// just acknowledges anything left over.
+//----------------------------------------------------------------------------
+
+void DiskInterrupt() {
+  uint32 status = *((uint32 *)DLX_DMADISK_STATUS);
+
+  disk_interrupts++;
+  dbprintf('d', "DiskInterrupt: status=%d (%d interrupts)\n", status,
+           disk_interrupts);
+  if (status != DLX_DMADISK_BUSY) {
+    DiskFinish(status);
+  }
+}
+
+int DiskBusy() {
+  return (disk_done != NULL);
+}
+
+//----------------------------------------------------------------------------
+// DiskWait waits for the background write in flight, if there's one.
+//----------------------------------------------------------------------------
+
+void DiskWait() {
+  uint32 intrvals = DisableIntrs();
+  uint32 status;
+
+  if (disk_done != NULL) {
+    while ((status = *((uint32 *)DLX_DMADISK_STATUS)) == DLX_DMADISK_BUSY) {
+    }
+    DiskFinish(status);
+  }
+  RestoreIntrs(intrvals);
+}
+
+//----------------------------------------------------------------------------
+// DiskRequest checks a transfer against the disk and starts it.
+// Returns DISK_FAIL if it's out of range.
+// Interrupts must be disabled.
+//----------------------------------------------------------------------------
+
+static int DiskRequest (int req, uint32 blocknum, int count, void *buf) {
+  if (!disk_ready) {
+    printf("DiskIo: disk used before DiskModuleInit\n");
+    return DISK_FAIL;
+  }
+  if ((count <= 0) || (blocknum >= DISK_NUMBLOCKS) ||
+      (count > DISK_NUMBLOCKS - blocknum)) {
+    printf("DiskIo: blocks %d-%d are outside the disk\n", blocknum,
+           blocknum + count - 1);
+    return DISK_FAIL;
+  }
+  *((uint32 *)DLX_DMADISK_BLOCK) = blocknum;
+  *((uint32 *)DLX_DMADISK_ADDR) = (uint32)buf;
+  *((uint32 *)DLX_DMADISK_COUNT) = count;
+  *((uint32 *)DLX_DMADISK_REQUEST) = req;
+  return DISK_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// DiskIo moves count blocks starting at blocknum between the disk and
+// buf with one DMA request per DISK_MAX_REQUEST_BLOCKS blocks, after
+// any background write.  Returns the number of bytes moved, or
+// DISK_FAIL.
+//----------------------------------------------------------------------------
+
+static int DiskIo (int req, uint32 blocknum, int count, void *buf) {
+  uint32 intrvals = 0;
+  uint32 status;
+  int n;
+  int done = 0;
+
+  DiskWait();
+  intrvals = DisableIntrs();
+  while (done < count) {
+    n = count - done;
+    if (n > DISK_MAX_REQUEST_BLOCKS) {
+      n = DISK_MAX_REQUEST_BLOCKS;
+    }
+    if (DiskRequest(req, blocknum + done, n,
+                    (char *)buf + done * DISK_BLOCKSIZE) == DISK_FAIL) {
+      RestoreIntrs(intrvals);
+      return DISK_FAIL;
+    }
+    while ((status = *((uint32 *)DLX_DMADISK_STATUS)) == DLX_DMADISK_BUSY) {
+    }
+    *((uint32 *)DLX_DMADISK_STATUS) = 0;
+    if (status != DLX_DMADISK_DONE) {
+      printf("DiskIo: transfer of blocks %d-%d failed!\n", blocknum + done,
+             blocknum + done + n - 1);
+      RestoreIntrs(intrvals);
+      return DISK_FAIL;
+    }
+    done += n;
+  }
+  RestoreIntrs(intrvals);
+  return count * DISK_BLOCKSIZE;
+}
+
+//----------------------------------------------------------------------------
+// DiskWriteBlocks writes count consecutive blocks starting at blocknum
+// from buf, and DiskReadBlocks reads them into buf.  buf must hold
+// count * DISK_BLOCKSIZE bytes.  Both return the number of bytes moved
+// on success, or DISK_FAIL on failure.
+//----------------------------------------------------------------------------
+
+int DiskWriteBlocks (uint32 blocknum, int count, void *buf) {
+  return DiskIo(DLX_DMADISK_WRITE, blocknum, count, buf);
+}
+
+int DiskReadBlocks (uint32 blocknum, int count, void *buf) {
+  return DiskIo(DLX_DMADISK_READ, blocknum, count, buf);
+}
+
+//----------------------------------------------------------------------------
+// DiskStartWrite starts writing count blocks (one request's worth at
+// most) from buf and returns; buf must stay put until done is called.
+// Returns DISK_FAIL if a background write is already in flight or the
+// request can't be started.
+//----------------------------------------------------------------------------
+
+int DiskStartWrite (uint32 blocknum, int count, void *buf, void (*done)(int ok)) {
+  uint32 intrvals;
+
+  if (count > DISK_MAX_REQUEST_BLOCKS) {
+    return DISK_FAIL;
+  }
+  intrvals = DisableIntrs();
+  if ((disk_done != NULL) ||
+      (DiskRequest(DLX_DMADISK_WRITE, blocknum, count, buf) == DISK_FAIL)) {
+    RestoreIntrs(intrvals);
+    return DISK_FAIL;
+  }
+  if (*((uint32 *)DLX_DMADISK_STATUS) == DLX_DMADISK_ERROR) {
+    // Refused outright: there won't be an interrupt for it
+    *((uint32 *)DLX_DMADISK_STATUS) = 0;
+    RestoreIntrs(intrvals);
+    return DISK_FAIL;
+  }
+  disk_done = done;
+  RestoreIntrs(intrvals);
+  return DISK_SUCCESS;
+}
@@ -112,7 +112,14 @@ intrSaveReg:
 	;; Load the value of r31 from the special register and then save it
 	movs2i	r3,ir31
 	sw	164(r29),r3
-	;; Store the floating-point registers
+	;; Store the floating-point registers, unless this is a user
+	;; process that hasn't used them yet (DLX_STATUS_FPDISABLE set in
+	;; the ISR; see ProcessFpEnable).  A system context always has
+	;; them saved: the kernel's multiplies and divides use them.
+	movs2i	r3,isr
+	andi	r3,r3,#0x1040	; DLX_STATUS_FPDISABLE | DLX_STATUS_SYSMODE
+	seqi	r3,r3,#0x1000
+	bnez	r3,intrSkipFpSave
 	sd	168(r29),f0
 	sd	176(r29),f2
 	sd	184(r29),f4
@@ -129,6 +136,7 @@ intrSaveReg:
 	sd	272(r29),f26
 	sd	280(r29),f28
 	sd	288(r29),f30
+intrSkipFpSave:
 	;; NOTE: we don't save the interrupt vector register because it
 	;; doesn't change from process to process.
 	;; NOTE: we don't save the status register because most of the flags
@@ -220,7 +228,12 @@ _intrreturn:
 	lw	r3,320(r29)
 	movi2s	ptbits,r3
 
-	;; Reload the floating point registers
+	;; Reload the floating point registers, if the frame has them
+	;; (the same test as in intrhandler, on the ISR we return to)
+	lw	r3,300(r29)
+	andi	r3,r3,#0x1040	; DLX_STATUS_FPDISABLE | DLX_STATUS_SYSMODE
+	seqi	r3,r3,#0x1000
+	bnez	r3,intrSkipFpRestore
 	ld	f0,168(r29)
 	ld	f2,176(r29)
 	ld	f4,184(r29)
@@ -237,6 +250,7 @@ _intrreturn:
 	ld	f26,272(r29)
 	ld	f28,280(r29)
 	ld	f30,288(r29)
+intrSkipFpRestore:
 
 	;; Reload the integer registers.  We don't reload r0 because it's
 	;; always 0.  We won't reload r29 here because we're using it as
@@ -321,6 +335,20 @@ _CurrentIntrs:
 	nop
 .endproc _CurrentIntrs
 ;;;----------------------------------------------------------------------
+;;; _FindFirstSet
+;;;
+;;; Return the index of the lowest set bit in the argument, or 32 if
+;;; none is, using the simulator's ffs instruction (R-R function 0x38).
+;;;----------------------------------------------------------------------
+.proc _FindFirstSet
+.global _FindFirstSet
+_FindFirstSet:
+	lw	r1,0(r29)
+	.word	0x00200838	; ffs r1,r1
+	jr	r31
+	nop
+.endproc _FindFirstSet
+;;;----------------------------------------------------------------------
 ;;; _ProcessSleep
 ;;;
 ;;; If a context switch from elsewhere in the kernel is desired, take a
@@ -8,15 +8,72 @@
 #include "process.h"
 #include "memory.h"
 #include "queue.h"
+#include "disk.h"
+#include "traps.h"
+#include "misc.h"
 
 // num_pages = size_of_memory / size_of_one_page
 // (MEM_MAX_SIZE >> MEM_L1FIELD_FIRST_BITNUM) / 32 = 16
 static uint32 freemap[(MEM_MAX_SIZE >> MEM_L1FIELD_FIRST_BITNUM) / 32];
+// Bit i set: freemap[i] has a free page.  One word covers the 16
+// freemap words, so finding a free page takes two FindFirstSets.
+static uint32 freesummary;
+#if MEM_NUM_PAGES > 32 * 32
+#error "freesummary needs a bit for each freemap word"
+#endif
+// Next fit: the freemap word the last page came from, where the next
+// search starts
+static int freehint;
 static uint32 pagestart;
 static int ref_counters[MEM_MAX_SIZE >> MEM_L1FIELD_FIRST_BITNUM];
 static int nfreepages;
 static int freemapmax;
 
+// Paging out.  A page that exactly one user PTE maps (no other PTE
+// or cache holds it) can be written to a swap slot and reused;
+// pageptes is the address of that PTE, or NULL.  pageslots is the
+// slot holding a copy of the page, or -1.  swaprefs counts the PTEs
+// and pages holding each slot, and swapfree has a bit set for each
+// free one.  pagepins keeps pages in memory regardless.
+#define MEM_SWAP_BLOCKS (MEM_PAGESIZE / DISK_BLOCKSIZE)
+#if DISK_DFS_BLOCKS + MEM_SWAP_SLOTS * MEM_SWAP_BLOCKS > DISK_NUMBLOCKS
+#error "the swap area doesn't fit on the disk"
+#endif
+static uint32 *pageptes[MEM_NUM_PAGES];
+static int pageslots[MEM_NUM_PAGES];
+static unsigned char pagepins[MEM_NUM_PAGES];
+static unsigned char swaprefs[MEM_SWAP_SLOTS];
+static uint32 swapfree[MEM_SWAP_SLOTS / 32];
+static int swaphint;
+static int swapping;		// The swap area is usable
+static int pageend;		// One past the last page of memory
+static int clockhand;		// The next page the CLOCK looks at
+static int writingpage = -1;	// The page being written back, or -1
+// The process each L2 table belongs to (indexed by the table's page),
+// so PTEs changed through a pointer are counted against the right PCB
+static PCB *tableowners[MEM_NUM_PAGES];
+// A page of zeros, mapped read-only for stack pages nothing has
+// written yet; the first store copies it (see MemoryBreakCow).  The
+// kernel holds a reference of its own, so the count never drops to
+// one and the page is never handed out or made writable.
+static int zeropage = -1;
+
+// Free pages zeroed ahead of time by the zeroing process (see
+// ProcessZeroer), for MemoryAllocZeroedPage to hand out.  They're
+// allocated, but MemoryAllocPage takes them back before paging out.
+static int zeropool[MEM_ZERO_POOL_PAGES];
+static int nzeroed;
+
+static int MemoryBreakCow (PCB *pcb, uint32 *pte);
+static int MemoryDropPage (uint32 page);
+static int MemoryUnshareTable (PCB *pcb, int l1);
+
+// Pages a stack growth fault maps (the boot option -a sets it)
+int memoryFaultAround = MEM_FAULT_AROUND_PAGES;
+// Fork shares L2 tables instead of copying them (the boot option -s
+// sets it; see MemoryForkPageTables)
+int memoryShareTables = 0;
+
 //----------------------------------------------------------------------
 //
 //	This silliness is required because the compiler believes that
@@ -73,6 +130,13 @@ void MemoryModuleInit() {
   for(i = 0; i < freemapmax; i++) {
     freemap[i] = 0;
   }
+  freesummary = 0;
+  freehint = 0;
+  for(i = 0; i < MEM_NUM_PAGES; i++) {
+    pageslots[i] = -1;
+  }
+  pageend = maxpage;
+  clockhand = pagestart;
 
   // set reference counter for the os pages
   for(i = 0; i < pagestart; i++) {
@@ -85,6 +149,10 @@ void MemoryModuleInit() {
     MemoryEditFreemap(i, 1);
   }
   dbprintf('m', "Initialized %d free pages.\n", nfreepages);
+
+  zeropage = MemoryAllocPage();
+  bzero((char *)(zeropage * MEM_PAGESIZE), MEM_PAGESIZE);
+  MemoryPinPage(zeropage);
 }
 
 void MemoryEditFreemap(int page, int val) {
@@ -93,6 +161,48 @@ void MemoryEditFreemap(int page, int val) {
   uint32 bit_position = page % 32;
   // set the val
   freemap[index] = (freemap[index] & invert(1 << bit_position)) | (val << bit_position);
+  // keep the summary bit for this word in step
+  if (freemap[index] != 0) {
+    freesummary |= 1 << index;
+  } else {
+    freesummary &= invert(1 << index);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	MemorySwapAlloc, MemorySwapFree
+//
+//	Claim a free swap slot (holding one reference), or MEM_FAIL if
+//	the swap area is full; and drop a reference to one, freeing it
+//	with the last.
+//
+//----------------------------------------------------------------------
+static int MemorySwapAlloc () {
+  int i, index, slot;
+
+  for (i = 0; i < MEM_SWAP_SLOTS / 32; i++) {
+    index = (swaphint + i) % (MEM_SWAP_SLOTS / 32);
+    if (swapfree[index] != 0) {
+      swaphint = index;
+      slot = index * 32 + FindFirstSet(swapfree[index]);
+      swapfree[index] &= invert(1 << (slot % 32));
+      swaprefs[slot] = 1;
+      return slot;
+    }
+  }
+  return MEM_FAIL;
+}
+
+static void MemorySwapFree (int slot) {
+  swaprefs[slot] -= 1;
+  if (swaprefs[slot] == 0) {
+    swapfree[slot / 32] |= 1 << (slot % 32);
+  }
+}
+
+static uint32 MemorySwapBlock (int slot) {
+  return (DISK_DFS_BLOCKS + slot * MEM_SWAP_BLOCKS);
 }
 
 
@@ -108,24 +218,578 @@ uint32 MemoryTranslateUserToSystem (PCB *pcb, uint32 addr) {
   // Grabs the page and offset from the address
   uint32 page = MEM_ADDR2PAGE(addr);
   uint32 offset = MEM_ADDR2OFFS(addr);
+  uint32 pte;
+
+  // Threads translate through their process's page table
+  pcb = pcb->mm;
 
   // Checks validity before returning
-  if (pcb->pagetable[page] & MEM_PTE_VALID) {
-    return ((pcb->pagetable[page] & MEM_MASK_PTE2PAGE) | offset);
+  pte = MemoryGetPte(pcb, page);
+  if (pte & MEM_PTE_VALID) {
+    return ((pte & MEM_MASK_PTE2PAGE) | offset);
+  }
+  return MEM_FAIL;
+}
+
+
+//----------------------------------------------------------------------
+//
+//	MemoryResident
+//
+//	Count n more (or, if n < 0, fewer) pages in memory for the
+//	process whose L2 table holds pte, keeping its peak up to date.
+//	Mappings of the zero page cost no memory and aren't counted
+//	(MemoryPteResident).
+//
+//----------------------------------------------------------------------
+static int MemoryPteResident (uint32 pte) {
+  return ((pte & MEM_PTE_VALID) &&
+          ((pte & MEM_MASK_PTE2PAGE) != zeropage * MEM_PAGESIZE));
+}
+
+static void MemoryResident (uint32 *pte, int n) {
+  PCB *pcb = tableowners[(uint32)pte / MEM_PAGESIZE];
+
+  if (pcb == NULL) {
+    return;
+  }
+  pcb->residentPages += n;
+  if (pcb->residentPages > pcb->peakPages) {
+    pcb->peakPages = pcb->residentPages;
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryPte
+//
+//	Return a pointer to the PTE for virtual page "page" in pcb's
+//	page table (pcb's own: callers pick pcb->mm for threads).  If
+//	the L2 table that would hold it doesn't exist yet, create says
+//	whether to allocate one (zeroed, so every entry is invalid).
+//	Returns NULL if there's no table, or no page for a new one.
+//
+//----------------------------------------------------------------------
+uint32 *MemoryPte (PCB *pcb, int page, int create) {
+  uint32 *l1;
+  int tablePage;
+
+  if ((page < 0) || (MEM_PAGE2L1(page) >= MEM_L1PAGETABLE_SIZE)) {
+    return NULL;
+  }
+  l1 = &pcb->pagetable[MEM_PAGE2L1(page)];
+  if (*l1 == 0) {
+    if (!create) {
+      return NULL;
+    }
+    if ((tablePage = MemoryAllocZeroedPage()) == MEM_FAIL) {
+      return NULL;
+    }
+    *l1 = tablePage * MEM_PAGESIZE;
+    tableowners[tablePage] = pcb;
+    dbprintf('m', "MemoryPte: L2 table for pages %d+ in page %d\n",
+	     MEM_PAGE2L1(page) << MEM_L2_INDEX_BITS, tablePage);
+  }
+  return &((uint32 *)(*l1))[MEM_PAGE2L2(page)];
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryGetPte, MemorySetPte
+//
+//	Read the PTE for a virtual page (0 if its L2 table was never
+//	needed), or store one, allocating the L2 table first if need
+//	be.  MemorySetPte returns MEM_FAIL if that allocation fails.
+//
+//----------------------------------------------------------------------
+uint32 MemoryGetPte (PCB *pcb, int page) {
+  uint32 *pte = MemoryPte(pcb, page, 0);
+
+  return (pte == NULL) ? 0 : *pte;
+}
+
+int MemorySetPte (PCB *pcb, int page, uint32 pte) {
+  uint32 *p = MemoryPte(pcb, page, 1);
+  uint32 old;
+
+  if ((p == NULL) || (MemoryUnshareTable(pcb, MEM_PAGE2L1(page)) != MEM_SUCCESS)) {
+    return MEM_FAIL;
+  }
+  p = MemoryPte(pcb, page, 0);
+  old = *p;
+  *p = pte;
+  MemoryResident(p, MemoryPteResident(pte) - MemoryPteResident(old));
+  if (pte & MEM_PTE_VALID) {
+    pageptes[(pte & MEM_MASK_PTE2PAGE) / MEM_PAGESIZE] = p;
+  }
+  return MEM_SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryUnshareTable, MemoryPrivatePte
+//
+//	An L2 table fork shared (its page's reference count is above one)
+//	belongs to every process holding it, so a PTE in it may only
+//	change in ways they should all see: paging out and back in.
+//	MemoryUnshareTable gives pcb a copy of L1 entry l1's table first,
+//	sharing each page and swap slot in it as a copying fork would.
+//	MemoryPrivatePte is MemoryPte for a PTE that's about to change
+//	otherwise.  They fail (MEM_FAIL, NULL) if there's no page for
+//	the copy.
+//
+//----------------------------------------------------------------------
+static int MemoryUnshareTable (PCB *pcb, int l1) {
+  uint32 *from = (uint32 *)pcb->pagetable[l1];
+  uint32 *to;
+  int old = (uint32)from / MEM_PAGESIZE;
+  int j, tablePage;
+
+  if ((from == NULL) || (ref_counters[old] <= 1)) {
+    return MEM_SUCCESS;
+  }
+  if ((tablePage = MemoryAllocPage()) == MEM_FAIL) {
+    return MEM_FAIL;
+  }
+  to = (uint32 *)(tablePage * MEM_PAGESIZE);
+  for (j = 0; j < MEM_L2PAGETABLE_SIZE; j++) {
+    if (from[j] & MEM_PTE_VALID) {
+      MemorySharePte(from[j]);
+    } else if (from[j] & MEM_PTE_SWAPPED) {
+      swaprefs[MEM_PTE2SLOT(from[j])] += 1;
+    }
+    to[j] = from[j];
+  }
+  // Page-outs in the old table now count against nobody, if they did
+  // against pcb (the processes that keep it aren't known)
+  ref_counters[old] -= 1;
+  if (tableowners[old] == pcb) {
+    tableowners[old] = NULL;
+  }
+  tableowners[tablePage] = pcb;
+  pcb->pagetable[l1] = tablePage * MEM_PAGESIZE;
+  dbprintf('m', "MemoryUnshareTable (%d): copied L2 table %d to page %d\n",
+	   GetPidFromAddress(pcb), l1, tablePage);
+  return MEM_SUCCESS;
+}
+
+uint32 *MemoryPrivatePte (PCB *pcb, int page) {
+  if ((MemoryPte(pcb, page, 0) == NULL) ||
+      (MemoryUnshareTable(pcb, MEM_PAGE2L1(page)) != MEM_SUCCESS)) {
+    return NULL;
+  }
+  return MemoryPte(pcb, page, 0);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryUnmapPte
+//
+//	Drop whatever the PTE at pte holds (a page, or a swap slot) and
+//	clear it.
+//
+//----------------------------------------------------------------------
+void MemoryUnmapPte (uint32 *pte) {
+  int page;
+
+  if (*pte & MEM_PTE_VALID) {
+    page = (*pte & MEM_MASK_PTE2PAGE) / MEM_PAGESIZE;
+    if (pageptes[page] == pte) {
+      pageptes[page] = NULL;
+    }
+    MemoryFreePage(page);
+    MemoryResident(pte, -MemoryPteResident(*pte));
+  } else if (*pte & MEM_PTE_SWAPPED) {
+    MemorySwapFree(MEM_PTE2SLOT(*pte));
+  }
+  *pte = 0;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryFreePageTables
+//
+//	Drop every page pcb maps, then the L2 tables themselves (or just
+//	pcb's reference to a table fork shared).  Pages that end up
+//	unused are collected a freemap word at a time and marked free
+//	together at the end.
+//
+//----------------------------------------------------------------------
+void MemoryFreePageTables (PCB *pcb) {
+  uint32 freed[sizeof(freemap) / sizeof(freemap[0])];
+  uint32 *l2, bits;
+  int i, j, page, n = 0;
+
+  for (i = 0; i < sizeof(freemap) / sizeof(freemap[0]); i++) {
+    freed[i] = 0;
+  }
+  for (i = 0; i < MEM_L1PAGETABLE_SIZE; i++) {
+    if (pcb->pagetable[i] == 0) {
+      continue;
+    }
+    page = pcb->pagetable[i] / MEM_PAGESIZE;
+    if (ref_counters[page] > 1) {
+      // Shared: the others keep the table and what it maps
+      ref_counters[page] -= 1;
+      if (tableowners[page] == pcb) {
+        tableowners[page] = NULL;
+      }
+      pcb->pagetable[i] = 0;
+      continue;
+    }
+    l2 = (uint32 *)pcb->pagetable[i];
+    for (j = 0; j < MEM_L2PAGETABLE_SIZE; j++) {
+      if (l2[j] & MEM_PTE_VALID) {
+        page = (l2[j] & MEM_MASK_PTE2PAGE) / MEM_PAGESIZE;
+        if (pageptes[page] == &l2[j]) {
+          pageptes[page] = NULL;
+        }
+        MemoryResident(&l2[j], -MemoryPteResident(l2[j]));
+        if (MemoryDropPage(page)) {
+          freed[page / 32] |= 1 << (page % 32);
+        }
+      } else if (l2[j] & MEM_PTE_SWAPPED) {
+        MemorySwapFree(MEM_PTE2SLOT(l2[j]));
+      }
+      l2[j] = 0;
+    }
+    page = pcb->pagetable[i] / MEM_PAGESIZE;
+    tableowners[page] = NULL;
+    if (MemoryDropPage(page)) {
+      freed[page / 32] |= 1 << (page % 32);
+    }
+    pcb->pagetable[i] = 0;
+  }
+  // Mark the freed pages a freemap word at a time
+  for (i = 0; i < sizeof(freemap) / sizeof(freemap[0]); i++) {
+    if (freed[i] == 0) {
+      continue;
+    }
+    freemap[i] |= freed[i];
+    freesummary |= 1 << i;
+    for (bits = freed[i]; bits != 0; bits &= bits - 1) {
+      n++;
+    }
+  }
+  nfreepages += n;
+  dbprintf('m', "MemoryFreePageTables: freed %d pages, %d free\n", n, nfreepages);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryForkPageTables
+//
+//	Give child (whose L1 table is still a copy of parent's) L2 tables
+//	of its own holding parent's mappings.  Every valid page becomes
+//	read-only and shared in both, to be copied on the first write
+//	(see MemoryRopHandler), and pages out on swap are shared until
+//	they're read back.  Returns MEM_FAIL if it runs out of
+//	pages for tables; child then maps whatever was copied so far, so
+//	freeing it undoes the sharing.
+//
+//	With memoryShareTables set, child gets parent's L2 tables
+//	themselves instead: only each table's reference count goes up,
+//	and the first process to change a PTE in one other than by
+//	paging gets a copy of it then (MemoryUnshareTable).  Its valid
+//	PTEs still have to be made read-only, since the hardware has no
+//	read-only bit for a whole table.
+//
+//----------------------------------------------------------------------
+int MemoryForkPageTables (PCB *child, PCB *parent) {
+  uint32 *from, *to;
+  int i, j, tablePage, valid;
+
+  for (i = 0; i < MEM_L1PAGETABLE_SIZE; i++) {
+    child->pagetable[i] = 0;
+  }
+  for (i = 0; i < MEM_L1PAGETABLE_SIZE; i++) {
+    if (parent->pagetable[i] == 0) {
+      continue;
+    }
+    if (memoryShareTables) {
+      from = (uint32 *)parent->pagetable[i];
+      for (j = 0; j < MEM_L2PAGETABLE_SIZE; j++) {
+        if (from[j] & MEM_PTE_VALID) {
+          from[j] |= MEM_PTE_READONLY;
+          child->residentPages += MemoryPteResident(from[j]);
+        }
+      }
+      ref_counters[(uint32)from / MEM_PAGESIZE] += 1;
+      child->pagetable[i] = (uint32)from;
+      continue;
+    }
+    if ((tablePage = MemoryAllocPage()) == MEM_FAIL) {
+      return MEM_FAIL;
+    }
+    from = (uint32 *)parent->pagetable[i];
+    to = (uint32 *)(tablePage * MEM_PAGESIZE);
+    tableowners[tablePage] = child;
+    valid = 0;
+    for (j = 0; j < MEM_L2PAGETABLE_SIZE; j++) {
+      if (from[j] & MEM_PTE_VALID) {
+        from[j] |= MEM_PTE_READONLY;
+        MemorySharePte(from[j]);
+        valid += MemoryPteResident(from[j]);
+      } else if (from[j] & MEM_PTE_SWAPPED) {
+        swaprefs[MEM_PTE2SLOT(from[j])] += 1;
+      }
+      to[j] = from[j];
+    }
+    MemoryResident(to, valid);
+    child->pagetable[i] = tablePage * MEM_PAGESIZE;
+  }
+  child->peakPages = child->residentPages;
+  return MEM_SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemorySwapModuleInit
+//
+//	Turn on paging out, once the disk is up.  Every swap slot starts
+//	out free: nothing in the swap area outlives the OS.
+//
+//----------------------------------------------------------------------
+void MemorySwapModuleInit () {
+  int i;
+
+  for (i = 0; i < MEM_SWAP_SLOTS / 32; i++) {
+    swapfree[i] = negativeone;
+  }
+  swaphint = 0;
+  swapping = 1;
+  dbprintf('m', "MemorySwapModuleInit: %d swap slots\n", MEM_SWAP_SLOTS);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryPinPage, MemoryUnpinPage
+//
+//	Keep a page in memory while it's pinned at least once (futexes,
+//	for instance, are found by physical address).
+//
+//----------------------------------------------------------------------
+void MemoryPinPage (uint32 page) {
+  pagepins[page] += 1;
+}
+
+void MemoryUnpinPage (uint32 page) {
+  if (pagepins[page] > 0) {
+    pagepins[page] -= 1;
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryEvictable
+//
+//	The PTE mapping page if it could be paged out, else NULL.
+//
+//----------------------------------------------------------------------
+static uint32 *MemoryEvictable (int page) {
+  uint32 *pte = pageptes[page];
+
+  if ((pte == NULL) || (ref_counters[page] != 1) || pagepins[page] ||
+      (page == writingpage)) {
+    return NULL;
+  }
+  if (!(*pte & MEM_PTE_VALID) || ((*pte & MEM_MASK_PTE2PAGE) != page * MEM_PAGESIZE)) {
+    return NULL;
+  }
+  return pte;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryWriteBack, MemoryWriteBackDone
+//
+//	Start writing page (mapped by pte) to its swap slot in the
+//	background, giving it a slot of its own first, if the disk is
+//	free.  DIRTY is cleared before the write starts, so a store that
+//	lands after it sets it again.  MemoryWriteBackDone runs when the
+//	write is on the disk; if it failed the slot is dropped, and the
+//	page will be written again.
+//
+//----------------------------------------------------------------------
+static void MemoryWriteBackDone (int ok) {
+  int page = writingpage;
+
+  writingpage = -1;
+  // (page is -1 if it was freed meanwhile; so was its slot)
+  if ((page >= 0) && !ok) {
+    printf("MemoryWriteBackDone: could not write page %d to swap\n", page);
+    MemorySwapFree(pageslots[page]);
+    pageslots[page] = -1;
+  }
+}
+
+static void MemoryWriteBack (int page, uint32 *pte) {
+  int slot = pageslots[page];
+
+  if (DiskBusy()) {
+    return;
   }
+  if ((slot >= 0) && (swaprefs[slot] > 1)) {
+    // A forked PTE still holds the old contents
+    MemorySwapFree(slot);
+    slot = pageslots[page] = -1;
+  }
+  if (slot < 0) {
+    if ((slot = MemorySwapAlloc()) == MEM_FAIL) {
+      dbprintf('m', "MemoryWriteBack: swap is full\n");
+      return;
+    }
+    pageslots[page] = slot;
+  }
+  *pte &= invert(MEM_PTE_DIRTY);
+  if (DiskStartWrite(MemorySwapBlock(slot), MEM_SWAP_BLOCKS,
+		     (void *)(page * MEM_PAGESIZE), MemoryWriteBackDone) == DISK_FAIL) {
+    *pte |= MEM_PTE_DIRTY;
+    return;
+  }
+  writingpage = page;
+  dbprintf('m', "MemoryWriteBack: writing page %d to slot %d\n", page, slot);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryPageOut
+//
+//	Find a page to reuse with the CLOCK (second chance) algorithm.
+//	The hand clears the REFERENCED bit of each page it passes that
+//	has it, and takes the first one that hasn't been used since the
+//	last time round, is clean and has a copy in swap; its PTE then
+//	points at the copy (see MemorySwapIn).  An unused page that must
+//	be written first gets a background write, if none is in flight,
+//	and is passed over.  Only when a whole sweep finds nothing does
+//	this wait for the disk, and it gives up after three.  Returns the
+//	page (still with a reference count of 1), or MEM_FAIL.
+//
+//----------------------------------------------------------------------
+static int MemoryPageOut () {
+  int sweep, n, page;
+  uint32 *pte;
+  int intrs = DisableIntrs();
+
+  for (sweep = 0; sweep < 3; sweep++) {
+    for (n = pagestart; n < pageend; n++) {
+      page = clockhand;
+      if (++clockhand >= pageend) {
+        clockhand = pagestart;
+      }
+      if ((pte = MemoryEvictable(page)) == NULL) {
+        continue;
+      }
+      if (*pte & MEM_PTE_REFERENCED) {
+        *pte &= invert(MEM_PTE_REFERENCED);
+        continue;
+      }
+      if ((*pte & MEM_PTE_DIRTY) || (pageslots[page] < 0)) {
+        MemoryWriteBack(page, pte);
+        continue;
+      }
+      // The PTE takes over the page's reference to the slot
+      *pte = MEM_SLOT2PTE(pageslots[page]);
+      MemoryResident(pte, -1);
+      dbprintf('m', "MemoryPageOut: reusing page %d (in slot %d)\n", page, pageslots[page]);
+      pageslots[page] = -1;
+      pageptes[page] = NULL;
+      RestoreIntrs(intrs);
+      return page;
+    }
+    // The page being written is clean once it's done
+    DiskWait();
+  }
+  RestoreIntrs(intrs);
   return MEM_FAIL;
 }
 
+//----------------------------------------------------------------------
+//
+//	MemorySwapIn
+//
+//	Read virtual page "page" of pcb (a process, not a thread) back
+//	from its swap slot into a new page.  The page keeps the slot, so
+//	until it's written to, paging it out again needs no disk write.
+//	Returns MEM_FAIL if there's no page for it or the read fails.
+//
+//----------------------------------------------------------------------
+int MemorySwapIn (PCB *pcb, int page) {
+  uint32 *pte = MemoryPte(pcb, page, 0);
+  int slot, genPage;
+
+  if ((pte == NULL) || !(*pte & MEM_PTE_SWAPPED)) {
+    return MEM_FAIL;
+  }
+  slot = MEM_PTE2SLOT(*pte);
+  if ((genPage = MemoryAllocPage()) == MEM_FAIL) {
+    return MEM_FAIL;
+  }
+  if (DiskReadBlocks(MemorySwapBlock(slot), MEM_SWAP_BLOCKS,
+		     (void *)(genPage * MEM_PAGESIZE)) == DISK_FAIL) {
+    MemoryFreePage(genPage);
+    return MEM_FAIL;
+  }
+  // The page takes over the PTE's reference to the slot
+  pageslots[genPage] = slot;
+  *pte = MemorySetupPte(genPage);
+  if (ref_counters[(uint32)pte / MEM_PAGESIZE] > 1) {
+    // Back into a table fork shared: writes must still copy it
+    *pte |= MEM_PTE_READONLY;
+  }
+  pageptes[genPage] = pte;
+  MemoryResident(pte, 1);
+  dbprintf('m', "MemorySwapIn: page %d from slot %d into page %d\n", page, slot, genPage);
+  return MEM_SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryFaultIn
+//
+//	Load a page that isn't mapped but has contents somewhere: in swap,
+//	or (for image pages not touched yet) in the executable.
+//
+//----------------------------------------------------------------------
+static int MemoryFaultIn (PCB *pcb, int page) {
+  if (MemoryGetPte(pcb->mm, page) & MEM_PTE_SWAPPED) {
+    return MemorySwapIn(pcb->mm, page);
+  }
+  return ProcessPageIn(pcb, page);
+}
+
+
+//----------------------------------------------------------------------
+//
+//	MemoryCopyRun
+//
+//	Copy n bytes between system and the physically contiguous run
+//	of user bytes at phys, in the direction MemoryMoveBetweenSpaces
+//	was given.  Returns n.
+//
+//----------------------------------------------------------------------
+static int MemoryCopyRun (unsigned char *system, unsigned char *phys, int n, int dir) {
+  if (n > 0) {
+    if (dir >= 0) {
+      bcopy ((char *)system, (char *)phys, n);
+    } else {
+      bcopy ((char *)phys, (char *)system, n);
+    }
+  }
+  return n;
+}
 
 //----------------------------------------------------------------------
 //
 //	MemoryMoveBetweenSpaces
 //
-//	Copy data between user and system spaces.  This is done page by
-//	page by:
-//	* Translating the user address into system space.
-//	* Copying all of the data in that page
-//	* Repeating until all of the data is copied.
+//	Copy data between user and system spaces.  The range is clipped
+//	to the address space first; then each user page is translated
+//	once, and pages that turn out to be physically contiguous are
+//	copied together by one bcopy (which hands big copies to the
+//	simulator).  A page that isn't mapped is loaded from swap or the
+//	image after the pages before it have been copied, since loading
+//	it may evict one of them.
 //	A positive direction means the copy goes from system to user
 //	space; negative direction means the copy goes from user to system
 //	space.
@@ -137,49 +801,65 @@ uint32 MemoryTranslateUserToSystem (PCB *pcb, uint32 addr) {
 //
 //----------------------------------------------------------------------
 int MemoryMoveBetweenSpaces (PCB *pcb, unsigned char *system, unsigned char *user, int n, int dir) {
-  unsigned char *curUser;         // Holds current physical address representing user-space virtual address
+  unsigned char *run = NULL;      // Physical start of the bytes not copied yet
+  int		runBytes = 0;     // How many there are
   int		bytesCopied = 0;  // Running counter
-  int		bytesToCopy;      // Used to compute number of bytes left in page to be copied
+  int		bytesToCopy;      // Bytes of the current page in the range
+  int		page;
+  uint32	*pte;
+  unsigned char *phys;
 
+  if ((n <= 0) || ((uint32)user > MEM_MAX_VIRTUAL_ADDRESS)) {
+    return 0;
+  }
+  if (n > MEM_MAX_VIRTUAL_ADDRESS + 1 - (uint32)user) {
+    n = MEM_MAX_VIRTUAL_ADDRESS + 1 - (uint32)user;
+  }
   while (n > 0) {
-    // Translate current user page to system address.  If this fails, return
-    // the number of bytes copied so far.
-    curUser = (unsigned char *)MemoryTranslateUserToSystem (pcb, (uint32)user);
-
-    // If we could not translate address, exit now
-    if (curUser == (unsigned char *)0) break;
-
-    // Calculate the number of bytes to copy this time.  If we have more bytes
-    // to copy than there are left in the current page, we'll have to just copy to the
-    // end of the page and then go through the loop again with the next page.
-    // In other words, "bytesToCopy" is the minimum of the bytes left on this page 
-    // and the total number of bytes left to copy ("n").
-
-    // First, compute number of bytes left in this page.  This is just
-    // the total size of a page minus the current offset part of the physical
-    // address.  MEM_PAGESIZE should be the size (in bytes) of 1 page of memory.
-    // MEM_ADDRESS_OFFSET_MASK should be the bit mask required to get just the
-    // "offset" portion of an address.
-    bytesToCopy = MEM_PAGESIZE - ((uint32)curUser & MEM_ADDR_OFFS_MASK);
-    
-    // Now find minimum of bytes in this page vs. total bytes left to copy
+    page = MEM_ADDR2PAGE((uint32)user);
+    pte = MemoryPte (pcb->mm, page, 0);
+    if ((pte == NULL) || !(*pte & MEM_PTE_VALID)) {
+      runBytes = MemoryCopyRun (system, run, runBytes, dir);
+      system += runBytes;
+      bytesCopied += runBytes;
+      runBytes = 0;
+      // Pages out on swap, and image pages that haven't been touched
+      // yet, are loaded now
+      if (MemoryFaultIn (pcb, page) != MEM_SUCCESS) break;
+      pte = MemoryPte (pcb->mm, page, 0);
+      if ((pte == NULL) || !(*pte & MEM_PTE_VALID)) break;
+    }
+    phys = (unsigned char *)((*pte & MEM_MASK_PTE2PAGE) | MEM_ADDR2OFFS((uint32)user));
+    bytesToCopy = MEM_PAGESIZE - MEM_ADDR2OFFS((uint32)user);
     if (bytesToCopy > n) {
       bytesToCopy = n;
     }
-
-    // Perform the copy.
+    if ((dir >= 0) && (*pte & MEM_PTE_READONLY)) {
+      // Shared (or the zero page): get a copy of our own first
+      runBytes = MemoryCopyRun (system, run, runBytes, dir);
+      system += runBytes;
+      bytesCopied += runBytes;
+      runBytes = 0;
+      if (((pte = MemoryPrivatePte (pcb->mm, page)) == NULL) ||
+          (MemoryBreakCow (pcb, pte) != MEM_SUCCESS)) break;
+      phys = (unsigned char *)((*pte & MEM_MASK_PTE2PAGE) | MEM_ADDR2OFFS((uint32)user));
+    }
     if (dir >= 0) {
-      bcopy (system, curUser, bytesToCopy);
-    } else {
-      bcopy (curUser, system, bytesToCopy);
+      // The simulator only marks pages the user program writes
+      *pte |= MEM_PTE_DIRTY;
     }
-
-    // Keep track of bytes copied and adjust addresses appropriately.
-    n -= bytesToCopy;           // Total number of bytes left to copy
-    bytesCopied += bytesToCopy; // Total number of bytes copied thus far
-    system += bytesToCopy;      // Current address in system space to copy next bytes from/into
-    user += bytesToCopy;        // Current virtual address in user space to copy next bytes from/into
+    if (phys != run + runBytes) {
+      runBytes = MemoryCopyRun (system, run, runBytes, dir);
+      system += runBytes;
+      bytesCopied += runBytes;
+      runBytes = 0;
+      run = phys;
+    }
+    runBytes += bytesToCopy;
+    user += bytesToCopy;
+    n -= bytesToCopy;
   }
+  bytesCopied += MemoryCopyRun (system, run, runBytes, dir);
   return (bytesCopied);
 }
 
@@ -199,11 +879,53 @@ int MemoryCopyUserToSystem (PCB *pcb, unsigned char *from,unsigned char *to, int
   return (MemoryMoveBetweenSpaces (pcb, to, from, n, -1));
 }
 
+//---------------------------------------------------------------------
+// MemoryGrowLarge maps the whole large page (MEM_LARGE_PAGE_PAGES
+// pages) ending at virtual page "page" from one aligned run of
+// contiguous physical pages, if "page" ends a large page, none of it
+// is mapped or below limit, and there's such a run.  Returns the
+// pages mapped, or 0 to fall back to growing by single pages.
+//---------------------------------------------------------------------
+static int MemoryGrowLarge(PCB *pcb, int page, int limit) {
+  int first = page - (MEM_LARGE_PAGE_PAGES - 1);
+  int base, i;
+
+  if(((page + 1) % MEM_LARGE_PAGE_PAGES != 0) || (first < limit)) {
+    return 0;
+  }
+  for(i = first; i <= page; i++) {
+    if(MemoryGetPte(pcb->mm, i) != 0) {
+      return 0;
+    }
+  }
+  if((base = MemoryAllocPages(MEM_LARGE_PAGE_PAGES, MEM_LARGE_PAGE_PAGES)) == MEM_FAIL) {
+    return 0;
+  }
+  bzero((char *)(base * MEM_PAGESIZE), MEM_LARGE_PAGE_PAGES * MEM_PAGESIZE);
+  for(i = 0; i < MEM_LARGE_PAGE_PAGES; i++) {
+    if(MemorySetPte(pcb->mm, first + i, MemorySetupPte(base + i)) != MEM_SUCCESS) {
+      // Only the first can need a new L2 table: a large page never
+      // straddles two (MEM_L2PAGETABLE_SIZE is a multiple)
+      MemoryFreePages(base, MEM_LARGE_PAGE_PAGES);
+      return 0;
+    }
+  }
+  dbprintf('z', "MemoryPageFaultHandler PID (%d): large page %d-%d at page %d\n",
+	   GetPidFromAddress(pcb), first, page, base);
+  pcb->mm->npages += MEM_LARGE_PAGE_PAGES;
+  return MEM_LARGE_PAGE_PAGES;
+}
+
 //---------------------------------------------------------------------
 // MemoryPageFaultHandler is called in traps.c whenever a page fault 
-// (better known as a "seg fault" occurs.  If the address that was
+// (better known as a "seg fault" occurs.  If the address is in the
+// process's executable image, the page is loaded from the executable
+// (see ProcessPageIn).  If the address that was
 // being accessed is on the stack, we need to allocate a new page 
-// for the stack.  If it is not on the stack, then this is a legitimate
+// for the stack, and map up to memoryFaultAround - 1 more below it
+// to the zero page, so a growing stack doesn't fault on every page
+// and pages it never writes cost no memory.  The stack can't grow past its thread slot (or, for the
+// process itself, PROCESS_STACK_MAX_PAGES).  Anything else is a legitimate
 // seg fault and we should kill the process.  Returns MEM_SUCCESS
 // on success, and kills the current process on failure.  Note that
 // fault_address is the beginning of the page of the virtual address that 
@@ -220,33 +942,94 @@ int MemoryPageFaultHandler(PCB *pcb) {
   // corresponding pages for the addresses
   int pg_fault_address = MEM_ADDR2PAGE(fault_address);
   int genPage;
+  // lowest page the stack may grow to
+  int limit = MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS) + 1 -
+              ((pcb->mm != pcb) ? (pcb->threadSlot + 1) * PROCESS_THREAD_STACK_PAGES : PROCESS_STACK_MAX_PAGES);
+  int i;
 
-  user_stack_ptr &= 0x1FF000;
+  user_stack_ptr &= invert(MEM_ADDR_OFFS_MASK);
+  pcb->pageFaults += 1;
 
   dbprintf('m', "MemoryPageFaultHandler (%d): Begin1\n", GetPidFromAddress(pcb));
 
+  // A thread returning from its function: just end it
+  if((pcb->mm != pcb) && (pg_fault_address == MEM_ADDR2PAGE(PROCESS_THREAD_RETURN_ADDR))) {
+    dbprintf('m', "MemoryPageFaultHandler (%d): thread returned\n", GetPidFromAddress(pcb));
+    ProcessKill();
+    return MEM_SUCCESS;
+  }
+
+  // Paged out: read it back
+  if(MemoryGetPte(pcb->mm, pg_fault_address) & MEM_PTE_SWAPPED) {
+    if(MemorySwapIn(pcb->mm, pg_fault_address) == MEM_SUCCESS) {
+      dbprintf('z', "MemoryPageFaultHandler PID (%d): swapped in page (%d)\n", GetPidFromAddress(pcb), pg_fault_address);
+      return MEM_SUCCESS;
+    }
+    printf("Exiting PID %d: MemoryPageFaultHandler could not swap in page %d\n", GetPidFromAddress(pcb), pg_fault_address);
+    ProcessKill();
+    return MEM_FAIL;
+  }
+
+  // Executable backed page: load it
+  if(pg_fault_address < pcb->mm->imagePages) {
+    if(ProcessPageIn(pcb, pg_fault_address) == MEM_SUCCESS) {
+      dbprintf('z', "MemoryPageFaultHandler PID (%d): paged in image page (%d)\n", GetPidFromAddress(pcb), pg_fault_address);
+      return MEM_SUCCESS;
+    }
+    printf("Exiting PID %d: MemoryPageFaultHandler could not load page %d\n", GetPidFromAddress(pcb), pg_fault_address);
+    ProcessKill();
+    return MEM_FAIL;
+  }
+
   // Compare fault address and user stack pointer
-  if(fault_address < user_stack_ptr) {
-    // True seg fault
+  if((fault_address < user_stack_ptr) || (pg_fault_address < limit)) {
+    // True seg fault (or a stack overflow)
     printf("Exiting PID %d: MemoryPageFaultHandler seg fault\n", GetPidFromAddress(pcb));
     dbprintf ('m', "MemoryPageFaultHandler (%d): seg fault addr=0x%x\n", GetPidFromAddress(pcb), fault_address);
     ProcessKill();
     return MEM_FAIL;
-  } else {
-    // Not a seg fault
-    // Allocate a new page to use
-    genPage = MemoryAllocPage();
-    if(genPage == MEM_FAIL) {
-      printf("FATAL: not enough free pages for %d\n", GetPidFromAddress(pcb));
-      ProcessKill();
-    }
-    // Use the setup pte function
-    pcb->pagetable[pg_fault_address] = MemorySetupPte(genPage);
-    // Used to show a debug message that a new page has been allocated from the memorypagefault handler for part5
-    dbprintf('z', "MemoryPageFaultHandler PID (%d): allocating new page (%d)\n", GetPidFromAddress(pcb), genPage);
-    pcb->npages += 1;
+  }
+  // Not a seg fault.  A stack that's already big grows a large page
+  // at a time
+  if((pcb->growthPages >= MEM_LARGE_PAGE_PAGES) &&
+     ((i = MemoryGrowLarge(pcb, pg_fault_address, limit)) > 0)) {
+    pcb->growthFaults += 1;
+    pcb->growthPages += i;
     return MEM_SUCCESS;
   }
+  // Otherwise grow the stack by the faulting page, then by the
+  // unmapped pages right below it (stopping at one that's in use).
+  // The faulting page is almost always being pushed to (the fault
+  // doesn't say), so it gets a page of its own; the others haven't
+  // been touched yet, and map the zero page until they're written to.
+  genPage = MemoryAllocZeroedPage();
+  if(genPage == MEM_FAIL) {
+    printf("FATAL: not enough free pages for %d\n", GetPidFromAddress(pcb));
+    ProcessKill();
+    return MEM_FAIL;
+  }
+  // Use the setup pte function (threads grow their stacks in the
+  // process's page table)
+  if(MemorySetPte(pcb->mm, pg_fault_address, MemorySetupPte(genPage)) != MEM_SUCCESS) {
+    MemoryFreePage(genPage);
+    printf("FATAL: no page for a page table for %d\n", GetPidFromAddress(pcb));
+    ProcessKill();
+    return MEM_FAIL;
+  }
+  // Used to show a debug message that a new page has been allocated from the memorypagefault handler for part5
+  dbprintf('z', "MemoryPageFaultHandler PID (%d): allocating new page (%d)\n", GetPidFromAddress(pcb), genPage);
+  pcb->mm->npages += 1;
+  for(i = 1; (i < memoryFaultAround) && (pg_fault_address - i >= limit); i++) {
+    if((MemoryGetPte(pcb->mm, pg_fault_address - i) != 0) ||
+       (MemorySetPte(pcb->mm, pg_fault_address - i, MemorySetupPte(zeropage) | MEM_PTE_READONLY) != MEM_SUCCESS)) {
+      break;
+    }
+    MemorySharePte(MemorySetupPte(zeropage));
+    pcb->mm->npages += 1;
+  }
+  pcb->growthFaults += 1;
+  pcb->growthPages += i;
+  return MEM_SUCCESS;
 }
 
 
@@ -260,27 +1043,36 @@ int MemoryAllocPage(void) {
   int index = 0;
   uint32 bit_position;
   uint32 fm_segment;
+  uint32 words;
 
   dbprintf('m', "MemoryAllocPage: function started\n");
-  // If there are no freepages available return a memfail
+  // If there are no freepages available page one out, or return a
+  // memfail if that's not possible
   if(nfreepages == 0) {
+    if(nzeroed > 0) {
+      return zeropool[--nzeroed];
+    }
+    if(swapping && ((fm_segment = MemoryPageOut()) != MEM_FAIL)) {
+      return fm_segment;
+    }
     dbprintf('m', "MemoryAllocPage: no available pages\n");
     return MEM_FAIL;
   }
 
-  // loop through the freemaps until you find one with available slots
-  while(freemap[index] == 0) {
-    index += 1;
-    if(index >= freemapmax) {
-      index = 0;
-    }
+  // pick the first word with a free page at or after the hint,
+  // wrapping around to the start if there's none
+  words = freesummary & invert((1 << freehint) - 1);
+  if (words == 0) {
+    words = freesummary;
+  }
+  index = FindFirstSet(words);
+  freehint = index;
+  bit_position = FindFirstSet(freemap[index]);
+  // mark it in use, and the word full if that was its last page
+  freemap[index] &= invert(1 << bit_position);
+  if (freemap[index] == 0) {
+    freesummary &= invert(1 << index);
   }
-  // grab the freemap segment (32 bits of freemap)
-  fm_segment = freemap[index];
-  // loop to find the first available position in that segment
-  for(bit_position = 0; (fm_segment & (1 << bit_position)) == 0; bit_position++){ }
-  // set the specific value in that segment
-  freemap[index]  &= invert(1 << bit_position);
   // grab the page number
   fm_segment = (index * 32) + bit_position; 
   dbprintf('m', "MemoryAllocPage: allocated memory from map=%d, page=%d\n", index, fm_segment);
@@ -291,8 +1083,69 @@ int MemoryAllocPage(void) {
   return fm_segment; // page number on memory space
 }
 
+//----------------------------------------------------------------------
+//
+//	MemoryAllocZeroedPage
+//
+//	MemoryAllocPage, for a page that must start out all zeros.  It
+//	comes from the pool if there's one there, and is zeroed here if
+//	not; a pool getting low wakes the zeroing process to refill it.
+//
+//----------------------------------------------------------------------
+int MemoryAllocZeroedPage(void) {
+  int page;
+  int intrs = DisableIntrs();
+
+  if(nzeroed > 0) {
+    page = zeropool[--nzeroed];
+    if(nzeroed <= MEM_ZERO_POOL_LOW) {
+      ProcessWakeZeroer();
+    }
+    RestoreIntrs(intrs);
+    return page;
+  }
+  ProcessWakeZeroer();
+  RestoreIntrs(intrs);
+  if((page = MemoryAllocPage()) != MEM_FAIL) {
+    bzero((char *)(page * MEM_PAGESIZE), MEM_PAGESIZE);
+  }
+  return page;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryZeroPoolFill
+//
+//	Zero one more free page for the pool.  Only free pages are used:
+//	nothing is paged out for it.  The zeroing itself runs with
+//	interrupts enabled.  Returns MEM_FAIL if the pool is full or
+//	there's no free page.
+//
+//----------------------------------------------------------------------
+int MemoryZeroPoolFill(void) {
+  int page;
+  int intrs = DisableIntrs();
+
+  if((nzeroed >= MEM_ZERO_POOL_PAGES) || (nfreepages == 0) ||
+     ((page = MemoryAllocPage()) == MEM_FAIL)) {
+    RestoreIntrs(intrs);
+    return MEM_FAIL;
+  }
+  RestoreIntrs(intrs);
+  bzero((char *)(page * MEM_PAGESIZE), MEM_PAGESIZE);
+  intrs = DisableIntrs();
+  if(nzeroed < MEM_ZERO_POOL_PAGES) {
+    zeropool[nzeroed++] = page;
+  } else {
+    MemoryFreePage(page);
+  }
+  RestoreIntrs(intrs);
+  return MEM_SUCCESS;
+}
+
 uint32 MemorySetupPte (uint32 page) {
-  return ((page * MEM_PAGESIZE) | MEM_PTE_VALID);
+  // A new mapping is about to be used: it starts out referenced
+  return ((page * MEM_PAGESIZE) | MEM_PTE_REFERENCED | MEM_PTE_VALID);
 }
 
 void MemoryFreePageTableEntry(uint32 pte) {
@@ -309,13 +1162,44 @@ void MemorySharePte (uint32 pte) {
   dbprintf('m', "MemorySharePte: page=%d count=%d\n", page, ref_counters[page]);
 }
 
-void MemoryFreePage(uint32 page) {
+int MemoryPteRefs (uint32 pte) {
+  // number of page tables (and caches) holding the page behind pte
+  return (ref_counters[(pte & MEM_MASK_PTE2PAGE) / MEM_PAGESIZE]);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryDropPage, MemoryFreePage
+//
+//	Drop a reference to page.  MemoryDropPage lets go of everything
+//	that goes with the last one (its PTE, its copy in swap) and
+//	returns 1 if the page is now unused, leaving the caller to mark it
+//	free; MemoryFreePage does that too.
+//
+//----------------------------------------------------------------------
+static int MemoryDropPage (uint32 page) {
   // Now since multiple forks we need to check the ref_counters
   ref_counters[page] -= 1;
   if(ref_counters[page] > 0) {
     // if the ref_counters[page] isn't 0 yet, it's still used
     dbprintf('m', "MemoryFreePage: decrementing ref_counters[%d] to %d\n", page, ref_counters[page]);
-  } else { // if the ref_counters is 0 we can actually free the page fully
+    return 0;
+  }
+  // if the ref_counters is 0 we can actually free the page fully
+  // along with its copy in swap
+  pageptes[page] = NULL;
+  if(pageslots[page] >= 0) {
+    MemorySwapFree(pageslots[page]);
+    pageslots[page] = -1;
+  }
+  if(page == writingpage) {
+    writingpage = -1;
+  }
+  return 1;
+}
+
+void MemoryFreePage(uint32 page) {
+  if(MemoryDropPage(page)) {
     // flip the freemap bit to set the position to available
     MemoryEditFreemap(page, 1);
     // free page now open
@@ -324,33 +1208,236 @@ void MemoryFreePage(uint32 page) {
   }
 }
 
+//----------------------------------------------------------------------
+//
+//	MemoryAllocCost
+//
+//	Measure MemoryAllocPage: take pages pages (at most half of what's
+//	free), give back every stride-th one so the free pages are
+//	scattered among used ones (stride 1 gives them all back), then
+//	allocate that many again.  Everything is freed at the end.
+//	Returns the instructions each of those allocations took, or
+//	MEM_FAIL.
+//
+//----------------------------------------------------------------------
+int MemoryAllocCost(int pages, int stride) {
+  static int taken[MEM_NUM_PAGES];
+  uint32 instrs;
+  int intrs = DisableIntrs();
+  int i, n;
+
+  if((stride < 1) || (pages < stride)) {
+    RestoreIntrs(intrs);
+    return MEM_FAIL;
+  }
+  pages = min(pages, nfreepages / 2);
+  for(i = 0; i < pages; i++) {
+    taken[i] = MemoryAllocPage();
+  }
+  for(i = n = 0; i < pages; i += stride, n++) {
+    MemoryFreePage(taken[i]);
+  }
+  instrs = PerfCounterRead(DLX_PERF_INSTRS);
+  for(i = 0; i < pages; i += stride) {
+    taken[i] = MemoryAllocPage();
+  }
+  instrs = PerfCounterRead(DLX_PERF_INSTRS) - instrs;
+  for(i = 0; i < pages; i++) {
+    MemoryFreePage(taken[i]);
+  }
+  RestoreIntrs(intrs);
+  return (n > 0) ? instrs / n : MEM_FAIL;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryRunMask
+//
+//	The bits for pages first..first+count-1 of one freemap word.
+//
+//----------------------------------------------------------------------
+static uint32 MemoryRunMask(int first, int count) {
+  if (count >= 32) return negativeone;
+  return ((1 << count) - 1) << first;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryAllocPages
+//
+//	Allocate n physically contiguous pages whose first page number
+//	is a multiple of align (a power of two).  An align of 0 asks for
+//	buddy alignment: n rounded up to a power of two, so that runs of
+//	one size never straddle the natural boundaries of a larger one.
+//	The runs are found in the freemap itself, a word at a time, so
+//	this mixes freely with MemoryAllocPage, and each page gets a
+//	reference count of 1 and can be freed on its own.  Returns the
+//	first page, or MEM_FAIL if there's no such run.
+//
+//----------------------------------------------------------------------
+int MemoryAllocPages(int n, int align) {
+  int base, page, index, count;
+  uint32 mask;
+
+  if ((n <= 0) || (n > nfreepages)) return MEM_FAIL;
+  if (align == 0) {
+    for (align = 1; align < n; align <<= 1) { }
+  }
+  if ((align < 0) || (align & (align - 1))) return MEM_FAIL;
+
+  base = ((pagestart + align - 1) / align) * align;
+  while (base + n <= freemapmax * 32) {
+    // Check the run a word at a time; page ends at the first
+    // allocated page found, or at base + n if there's none
+    for (page = base; page < base + n; page += count) {
+      index = page / 32;
+      count = min(32 - page % 32, base + n - page);
+      mask = MemoryRunMask(page % 32, count);
+      if ((freemap[index] & mask) != mask) break;
+    }
+    if (page >= base + n) break;
+    // No run starting before the next aligned page past the used one
+    base = ((page / align) + 1) * align;
+  }
+  if (base + n > freemapmax * 32) {
+    dbprintf('m', "MemoryAllocPages: no run of %d pages\n", n);
+    return MEM_FAIL;
+  }
+
+  for (page = base; page < base + n; page += count) {
+    index = page / 32;
+    count = min(32 - page % 32, base + n - page);
+    freemap[index] &= invert(MemoryRunMask(page % 32, count));
+    if (freemap[index] == 0) {
+      freesummary &= invert(1 << index);
+    }
+  }
+  for (page = base; page < base + n; page++) {
+    ref_counters[page] = 1;
+  }
+  nfreepages -= n;
+  dbprintf('m', "MemoryAllocPages: allocated pages %d-%d\n", base, base + n - 1);
+  return base;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryFreePages
+//
+//	Drop a reference to each of the n pages from base on (usually a
+//	run from MemoryAllocPages).  Pages still shared stay allocated.
+//
+//----------------------------------------------------------------------
+void MemoryFreePages(uint32 base, int n) {
+  int i;
+
+  for (i = 0; i < n; i++) {
+    MemoryFreePage(base + i);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryBreakCow
+//
+//	Make the read-only page pte maps (in pcb's process) writable.  If
+//	another page table, the text cache or the kernel still holds it,
+//	pte gets a copy of its own in a new page (a new page of zeros, for
+//	the zero page); otherwise it just loses READONLY.  Returns
+//	MEM_FAIL if there's no page for the copy.
+//
+//----------------------------------------------------------------------
+static int MemoryBreakCow (PCB *pcb, uint32 *pte) {
+  int parent_page = MEM_ADDR2PAGE(*pte & MEM_MASK_PTE2PAGE);
+  int genPage;
+
+  if(ref_counters[parent_page] > 1) {
+    dbprintf('m', "MemoryBreakCow: copying page %d\n", parent_page);
+    // generate and setup a page, and do the copying (from the shared
+    // physical page: the kernel doesn't run in the user's address space)
+    if(parent_page == zeropage) {
+      if((genPage = MemoryAllocZeroedPage()) == MEM_FAIL) {
+        return MEM_FAIL;
+      }
+      MemoryResident(pte, 1);
+    } else {
+      if((genPage = MemoryAllocPage()) == MEM_FAIL) {
+        return MEM_FAIL;
+      }
+      bcopy((char *)(parent_page * MEM_PAGESIZE), (char *)(genPage * MEM_PAGESIZE), MEM_PAGESIZE);
+    }
+    *pte = MemorySetupPte (genPage);
+    pageptes[genPage] = pte;
+    // decrement reference counter since one has its own
+    ref_counters[parent_page] -= 1;
+    pcb->cowBreaks += 1;
+  } else {
+    dbprintf('m', "MemoryBreakCow: Ref count is 1, inverting read only.\n");
+    // Reference counter is only one, so reset the readonly (and
+    // this PTE is the one that maps it now)
+    *pte &= invert(MEM_PTE_READONLY);
+    pageptes[parent_page] = pte;
+  }
+  return MEM_SUCCESS;
+}
+
 void MemoryRopHandler(PCB * pcb) {
   // addresses to use
   uint32 fault_address = pcb->currentSavedFrame[PROCESS_STACK_FAULT];
   // corresponding pages for the addresses
   int pg_fault_address = MEM_ADDR2PAGE(fault_address);
-  int parent_page = MEM_ADDR2PAGE(pcb->pagetable[pg_fault_address] & MEM_MASK_PTE2PAGE);
-  int genPage;
+  // (a thread writes to its process's pages; the L2 table must
+  // exist, since the page is mapped)
+  uint32 *pte = MemoryPrivatePte(pcb->mm, pg_fault_address);
 
   dbprintf('m', "MemoryRopHandler: Begin.\n");
-
-  if(ref_counters[parent_page] > 1) {
-    dbprintf('m', "Copying page %d to page %d\n", parent_page, pg_fault_address);
-    // generate and setup a page
-    genPage = MemoryAllocPage();
-    pcb->pagetable[pg_fault_address] = MemorySetupPte (genPage);
-    // do the copying
-    bcopy((char *)(fault_address), (char *)(genPage * MEM_PAGESIZE), MEM_PAGESIZE);
-    // decrement reference counter since one has its own
-    ref_counters[parent_page] -= 1;
-  } else {
-    dbprintf('m', "MemoryRopHandler: Ref coutn is 1, inverting read only.\n");
-    // Reference counter is only one, so reset the readonly
-    pcb->pagetable[pg_fault_address] &= invert(MEM_PTE_READONLY);
+  if((pte == NULL) || (MemoryBreakCow(pcb, pte) != MEM_SUCCESS)) {
+    printf("FATAL: not enough free pages for %d\n", GetPidFromAddress(pcb));
+    ProcessKill();
+    return;
   }
   dbprintf('m', "MemoryRopHandler: End.\n");
 }
 
+//----------------------------------------------------------------------
+//
+//	MemoryGetStats
+//
+//	Fill in stats for pcb.  The fault counts are pcb's own; the page
+//	counts are those of the page table it runs in, which a thread
+//	shares with its process.  Shared pages are the resident ones
+//	some other page table (or the text cache) maps too.
+//
+//----------------------------------------------------------------------
+void MemoryGetStats (PCB *pcb, MemStats *stats) {
+  PCB *mm = pcb->mm;
+  uint32 *l2;
+  int i, j;
+
+  stats->shared = stats->swapped = 0;
+  for (i = 0; i < MEM_L1PAGETABLE_SIZE; i++) {
+    if (mm->pagetable[i] == 0) {
+      continue;
+    }
+    l2 = (uint32 *)mm->pagetable[i];
+    for (j = 0; j < MEM_L2PAGETABLE_SIZE; j++) {
+      if (MemoryPteResident(l2[j])) {
+        if (MemoryPteRefs(l2[j]) > 1) {
+          stats->shared++;
+        }
+      } else if (l2[j] & MEM_PTE_SWAPPED) {
+        stats->swapped++;
+      }
+    }
+  }
+  stats->resident = mm->residentPages;
+  stats->peak = mm->peakPages;
+  stats->pageFaults = pcb->pageFaults;
+  stats->growthFaults = pcb->growthFaults;
+  stats->growthPages = pcb->growthPages;
+  stats->cowBreaks = pcb->cowBreaks;
+}
+
 // Empty functions to get compile to work, referenced from piazza question
 void* malloc(PCB* pcb, int memsize) {
   return NULL;
@@ -6,6 +6,7 @@
 //
 
 #include "misc.h"
+#include "ostraps.h"
 
 //----------------------------------------------------------------------
 //
@@ -240,10 +241,23 @@ dstrtol (char *c,  char **newpos, int base)
 //	bcopy: Copy bytes from one location to another.
 //	bzero: Set all the bytes in a region to zero.
 //
+//	Anything bigger than MISC_BLOCKOP_MIN is handed to the simulator,
+//	which does it at host speed.  It refuses (returns -1) in user mode
+//	and when the addresses aren't physical, and then we do it here, a
+//	word at a time if both ends are word aligned.
+//
 //----------------------------------------------------------------------
 void
 bcopy (char *src, char *dst, int count)
 {
+  if ((count >= MISC_BLOCKOP_MIN) && (memmove (dst, src, count) != -1)) {
+    return;
+  }
+  if ((((unsigned int)src | (unsigned int)dst) & 3) == 0) {
+    for (; count >= 4; count -= 4, src += 4, dst += 4) {
+      *(int *)dst = *(int *)src;
+    }
+  }
   while (count-- > 0) {
     *(dst++) = *(src++);
   }
@@ -252,6 +266,9 @@ bcopy (char *src, char *dst, int count)
 void
 bzero (char *dst, int count)
 {
+  if ((count >= MISC_BLOCKOP_MIN) && (memset (dst, 0, count) != -1)) {
+    return;
+  }
   while (count-- > 0) {
     *(dst++) = 0;
   }
@@ -9,12 +9,14 @@
 //	done in assembly language elsewhere.
 
 #include "ostraps.h"
+#include "dlx.h"
 #include "dlxos.h"
 #include "process.h"
 #include "synch.h"
 #include "memory.h"
 #include "filesys.h"
 #include "clock.h"
+#include "disk.h"
 
 // Pointer to the current PCB.  This is used by the assembly language
 // routines for context switches.
@@ -45,12 +47,38 @@ static PCB	pcbs[PROCESS_MAX_PROCS];
 // the timer trap handler....
 static processQuantum = DLX_PROCESS_QUANTUM;
 
+// Print each process's memory use when it exits (boot option -p)
+int processPinfo = 0;
+
+// The kernel process that keeps the zeroed page pool full, and
+// whether it's asleep on waitQueue (see ProcessZeroer)
+static PCB	*zeroPCB = NULL;
+static int	zeroWaiting = 0;
+
+// Code pages of recently run executables.  Each entry holds its own
+// reference on the pages, so a new instance of the same executable can
+// map them read-only instead of loading another copy; npages == 0 marks
+// an unused entry.
+static struct {
+  char		name[PROCESS_MAX_NAME_LENGTH];
+  int		first;		// first shared page
+  int		npages;
+  uint32	pte[PROCESS_IMAGE_PAGES];
+} textCache[PROCESS_TEXT_CACHE_SIZE];
+
 // String listing debugging options to print out.
 char	debugstr[200];
 
 int ProcessGetCodeInfo(const char *file, uint32 *startAddr, uint32 *codeStart, uint32 *codeSize,
                        uint32 *dataStart, uint32 *dataSize);
 int ProcessGetFromFile(int fd, unsigned char *buf, uint32 *addr, int max);
+static int ProcessLoadImagePage (int fd, uint32 page, uint32 paddr);
+static int ProcessTextPages (uint32 codeS, uint32 codeL, uint32 dataS, int *first);
+static int ProcessTextFind (char *name, int first, int npages);
+static int ProcessTextShare (PCB *pcb, uint32 codeS, uint32 codeL, uint32 dataS);
+static void ProcessTextRemember (PCB *pcb, uint32 codeS, uint32 codeL, uint32 dataS);
+static void ProcessSetupImage (PCB *pcb, uint32 *stackframe, uint32 start, uint32 codeS,
+			       uint32 codeL, uint32 dataS, uint32 dataL, uint32 param);
 uint32 get_argument(char *string);
 
 
@@ -88,6 +116,7 @@ void ProcessModuleInit () {
     //-------------------------------------------------------
 
     pcbs[i].npages = 0;
+    pcbs[i].mm = &pcbs[i];
     for (j = 0; j < MEM_L1PAGETABLE_SIZE; j++) {
       pcbs[i].pagetable[j] = 0;
     }
@@ -125,7 +154,9 @@ void ProcessSetStatus (PCB *pcb, int status) {
 //----------------------------------------------------------------------
 void ProcessFreeResources (PCB *pcb) {
   int i = 0;
-  int user_stack_pg = MEM_ADDR2PAGE(pcb->currentSavedFrame[PROCESS_STACK_USER_STACKPOINTER]);
+  int top;
+  uint32 *pte;
+  MemStats stats;
   // Allocate a new link for this pcb on the freepcbs queue
   if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
     printf("FATAL ERROR: could not get Queue Link in ProcessFreeResources!\n");
@@ -142,19 +173,44 @@ void ProcessFreeResources (PCB *pcb) {
   //------------------------------------------------------------
   // STUDENT: Free any memory resources on process death here.
   //------------------------------------------------------------
+  if (processPinfo) {
+    MemoryGetStats(pcb, &stats);
+    printf("Process %d: %d pages resident (%d shared), %d swapped, peak %d\n",
+	   GetPidFromAddress(pcb), stats.resident, stats.shared, stats.swapped, stats.peak);
+    printf("Process %d: %d page faults, %d grew the stack by %d pages, %d copy-on-write breaks\n",
+	   GetPidFromAddress(pcb), stats.pageFaults, stats.growthFaults, stats.growthPages,
+	   stats.cowBreaks);
+    if (pcb->fpUsed) {
+      printf("Process %d: used the FP registers\n", GetPidFromAddress(pcb));
+    }
+  }
   
-  // Free the original four page table entries
-  for(i = 0; i < 4; i++) {
-    MemoryFreePageTableEntry(pcb->pagetable[i]);
+  if (pcb->mm != pcb) {
+    // A thread only owns its user stack slot.  If the process it
+    // belongs to is dying too, that frees the whole page table.
+    if (((pcb->mm->flags & PROCESS_STATUS_MASK) != PROCESS_STATUS_ZOMBIE) &&
+        ((pcb->mm->flags & PROCESS_STATUS_MASK) != PROCESS_STATUS_FREE)) {
+      top = MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS) - pcb->threadSlot * PROCESS_THREAD_STACK_PAGES;
+      for(i = top - PROCESS_THREAD_STACK_PAGES + 1; i <= top; i++) {
+        pte = MemoryPrivatePte(pcb->mm, i);
+        if (pte != NULL) {
+          MemoryUnmapPte(pte);
+        }
+      }
+      pcb->mm->threadSlots &= ~(1 << pcb->threadSlot);
+    }
+    pcb->mm = pcb;
+    pcb->threadSlot = 0;
+  } else {
+    // Free every page that's mapped: image pages that were touched, the
+    // user stack and any thread stacks, and the L2 tables they're in
+    MemoryFreePageTables(pcb);
   }
 
-  // Free the user stack (start at current and go to max)
-  for(i = user_stack_pg; i <= MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS); i++) {
-    MemoryFreePageTableEntry(pcb->pagetable[i]);
+  // Free the system stack, unless a failed fork never gave it one
+  if (pcb->sysStackArea != 0) {
+    MemoryFreePage (pcb->sysStackArea / MEM_PAGESIZE);
   }
-
-  // Free the system stack
-  MemoryFreePage (pcb->sysStackArea / MEM_PAGESIZE);
   ProcessSetStatus (pcb, PROCESS_STATUS_FREE);
   dbprintf ('p', "ProcessFreeResources: function complete\n");
 }
@@ -209,7 +265,8 @@ void ProcessSchedule () {
   // bug.  An easy solution to allowing no runnable "user" processes is to
   // have an "idle" process that's simply an infinite loop.
   if (AQueueEmpty(&runQueue)) {
-    if (!AQueueEmpty(&waitQueue)) {
+    // (the zeroing process waits forever once everyone's gone)
+    if (AQueueLength(&waitQueue) > (zeroWaiting ? 1 : 0)) {
       printf("FATAL ERROR: no runnable processes, but there are sleeping processes waiting!\n");
       l = AQueueFirst(&waitQueue);
       while (l != NULL) {
@@ -329,7 +386,17 @@ void ProcessWakeup (PCB *wakeup) {
 //
 //----------------------------------------------------------------------
 void ProcessDestroy (PCB *pcb) {
+  int i;
+
   dbprintf('p', "Entering ProcessDestroy for 0x%x.\n", (int)pcb);
+  // A process takes its threads with it
+  for (i = 0; (pcb->threadSlots != 0) && (i < PROCESS_MAX_PROCS); i++) {
+    if ((pcbs[i].mm == pcb) && (&pcbs[i] != pcb) &&
+        ((pcbs[i].flags & PROCESS_STATUS_MASK) != PROCESS_STATUS_ZOMBIE) &&
+        ((pcbs[i].flags & PROCESS_STATUS_MASK) != PROCESS_STATUS_FREE)) {
+      ProcessDestroy (&pcbs[i]);
+    }
+  }
   ProcessSetStatus (pcb, PROCESS_STATUS_ZOMBIE);
   if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove link from queue in ProcessDestroy!\n");
@@ -365,11 +432,19 @@ int ProcessRealFork(PCB * parent) {
   PCB * child; //child PCB
   uint32 *stackframe;
   uint32 GrabPg;
-  int intrs, i;
+  int intrs;
 
   dbprintf ('I', "Old interrupt value was 0x%x.\n", intrs);
   dbprintf ('p', "Entering Process Real Fork, forking process: %d\n", GetPidFromAddress(parent));
 
+  // Copying a page table other threads are running in (or a thread's
+  // view of one) isn't supported
+  if ((parent->mm != parent) || (parent->threadSlots != 0)) {
+    printf("ProcessRealFork: can't fork a process that has threads\n");
+    ProcessSetResult(parent, PROCESS_FORK_FAIL);
+    return PROCESS_FORK_FAIL;
+  }
+
   intrs = DisableIntrs();
 
   // acquire pcb
@@ -386,18 +461,24 @@ int ProcessRealFork(PCB * parent) {
   // This prevents someone else from grabbing this process
   ProcessSetStatus (child, PROCESS_STATUS_RUNNABLE);
 
-  //Mark the parent PCB's page table entries as read only
-  for (i = 0; i < 4; i++) {
-    parent->pagetable[i] |= MEM_PTE_READONLY;
-    MemorySharePte(parent->pagetable[i]);
-  }
-
-  // user stack is also shared at first
-  parent->pagetable[MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS)] |= MEM_PTE_READONLY; 
-  MemorySharePte(parent->pagetable[MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS)]);
-
   //Copy parent to child
   bcopy((char *)parent, (char *)child, sizeof(PCB));
+  child->mm = child;
+  // Not the parent's: freeing the child before it has its own system
+  // stack mustn't free the parent's
+  child->sysStackArea = 0;
+  child->pageFaults = child->growthFaults = child->growthPages = child->cowBreaks = 0;
+  child->residentPages = child->peakPages = 0;
+
+  // The child gets its own L2 tables (or, with -s, shares the
+  // parent's); every page in them (and in the parent's) starts out
+  // read only and shared
+  if (MemoryForkPageTables(child, parent) != MEM_SUCCESS) {
+    RestoreIntrs(intrs);
+    printf("Error Could not allocate page tables \n");
+    ProcessFreeResources(child);
+    return PROCESS_FORK_FAIL;
+  }
   RestoreIntrs(intrs);
 
   //System Stack:
@@ -445,23 +526,336 @@ int ProcessRealFork(PCB * parent) {
   return PROCESS_FORK_SUCCESS;
 }
 
+//----------------------------------------------------------------------
+//
+//	ProcessThreadCreate
+//
+//	Start a thread in parent's process: a PCB that runs func(arg) in
+//	the process's page table, with its own system stack and a user
+//	stack in a free thread slot (see PROCESS_MAX_THREADS).  No image
+//	is loaded; the thread sees the process's code and data directly.
+//	It ends with Exit() or by returning from func, and goes away when
+//	the process exits.  Returns the new thread's pid, or -1.
+//
+//----------------------------------------------------------------------
+int ProcessThreadCreate (PCB *parent, uint32 func, uint32 arg) {
+  PCB		*pcb;
+  PCB		*mm = parent->mm;
+  uint32	*stackframe;
+  uint32	sp;
+  int		intrs, slot, page, GrabPg, sysPg;
+
+  intrs = DisableIntrs ();
+  for (slot = 1; slot <= PROCESS_MAX_THREADS; slot++) {
+    if (!(mm->threadSlots & (1 << slot))) {
+      break;
+    }
+  }
+  if (slot > PROCESS_MAX_THREADS) {
+    RestoreIntrs (intrs);
+    printf ("ProcessThreadCreate: process %d already has %d threads\n",
+	    GetPidFromAddress(mm), PROCESS_MAX_THREADS);
+    return (-1);
+  }
+  if (AQueueEmpty(&freepcbs)) {
+    RestoreIntrs (intrs);
+    printf ("ProcessThreadCreate: no free PCBs\n");
+    return (-1);
+  }
+
+  // Top page of the slot for the user stack (ones below it are added
+  // by MemoryPageFaultHandler as the stack grows), and a system stack
+  page = MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS) - slot * PROCESS_THREAD_STACK_PAGES;
+  if ((GrabPg = MemoryAllocPage ()) == MEM_FAIL) {
+    RestoreIntrs (intrs);
+    printf ("ProcessThreadCreate: no free pages\n");
+    return (-1);
+  }
+  if ((sysPg = MemoryAllocPage ()) == MEM_FAIL) {
+    MemoryFreePage (GrabPg);
+    RestoreIntrs (intrs);
+    printf ("ProcessThreadCreate: no free pages\n");
+    return (-1);
+  }
+  if (MemorySetPte (mm, page, MemorySetupPte (GrabPg)) != MEM_SUCCESS) {
+    MemoryFreePage (GrabPg);
+    MemoryFreePage (sysPg);
+    RestoreIntrs (intrs);
+    printf ("ProcessThreadCreate: no free pages\n");
+    return (-1);
+  }
+  mm->threadSlots |= (1 << slot);
+
+  pcb = (PCB *)AQueueObject(AQueueFirst (&freepcbs));
+  if (AQueueRemove (&(pcb->l)) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not remove link from freepcbsQueue in ProcessThreadCreate!\n");
+    exitsim();
+  }
+  ProcessSetStatus (pcb, PROCESS_STATUS_RUNNABLE);
+  RestoreIntrs (intrs);
+
+  dstrcpy (pcb->name, mm->name);
+  pcb->mm = mm;
+  pcb->threadSlot = slot;
+  pcb->threadSlots = 0;
+  pcb->imagePages = 0;
+  pcb->npages = 1;
+  pcb->pageFaults = pcb->growthFaults = pcb->growthPages = pcb->cowBreaks = 0;
+  pcb->residentPages = pcb->peakPages = 0;
+  pcb->fpUsed = 0;
+  pcb->sysStackArea = sysPg * MEM_PAGESIZE;
+  stackframe = (uint32 *)(pcb->sysStackArea + MEM_PAGESIZE - 4);
+  stackframe -= PROCESS_STACK_FRAME_SIZE;
+  pcb->sysStackPtr = stackframe;
+  pcb->currentSavedFrame = stackframe;
+
+  stackframe[PROCESS_STACK_PREV_FRAME] = 0;
+  stackframe[PROCESS_STACK_PTBASE] = (uint32)&mm->pagetable[0];
+  stackframe[PROCESS_STACK_PTBITS] = MEM_PTBITS;
+  stackframe[PROCESS_STACK_PTSIZE] = MEM_L1PAGETABLE_SIZE;
+  stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
+  stackframe[PROCESS_STACK_IAR] = func;
+  stackframe[PROCESS_STACK_IREG+31] = PROCESS_THREAD_RETURN_ADDR;
+
+  // func's argument goes at its initial stack pointer, where a caller
+  // would have put it
+  sp = ((page + 1) * MEM_PAGESIZE) - 8;
+  stackframe[PROCESS_STACK_USER_STACKPOINTER] = sp;
+  MemoryCopySystemToUser (pcb, (unsigned char *)&arg, (unsigned char *)sp, sizeof(arg));
+  pcb->flags |= PROCESS_TYPE_USER;
+
+  intrs = DisableIntrs ();
+  if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
+    printf("FATAL ERROR: could not get link for thread PCB in ProcessThreadCreate!\n");
+    exitsim();
+  }
+  if (AQueueInsertLast(&runQueue, pcb->l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert link into runQueue in ProcessThreadCreate!\n");
+    exitsim();
+  }
+  RestoreIntrs (intrs);
+  dbprintf ('p', "ProcessThreadCreate: thread %d in process %d, slot %d\n",
+	    GetPidFromAddress(pcb), GetPidFromAddress(mm), slot);
+  return (GetPidFromAddress(pcb));
+}
+
 //Test Prints for Process Fork:
 void ProcessPrintFork(PCB * pcb) {
-  int i;
+  int i, j;
+  uint32 *l2;
   int numprint = 0;
   printf("Valid PTE's for process after fork (PID): %d\n\t", GetPidFromAddress(pcb));
   for (i = 0; i < MEM_L1PAGETABLE_SIZE; i++) {
-    if (pcb->pagetable[i] & MEM_PTE_VALID) {
-      if((numprint % 2 == 0) && numprint > 0) {
-        printf("\n\t");
+    if (pcb->pagetable[i] == 0) {
+      continue;
+    }
+    l2 = (uint32 *)pcb->pagetable[i];
+    for (j = 0; j < MEM_L2PAGETABLE_SIZE; j++) {
+      if (l2[j] & MEM_PTE_VALID) {
+        if((numprint % 2 == 0) && numprint > 0) {
+          printf("\n\t");
+        }
+        numprint++;
+        printf("PTE: %d | INDEX: %d \t\t", l2[j], (i << MEM_L2_INDEX_BITS) + j);
       }
-      numprint++;
-      printf("PTE: %d | INDEX: %d \t\t", pcb->pagetable[i], i);
     }
   }
   printf("\n");
 }
 
+//----------------------------------------------------------------------
+//
+//	ProcessSetupImage
+//
+//	Set pcb up to run the executable pcb->name from its start, with
+//	the segment map ProcessGetCodeInfo gave: the image pages, its user
+//	stack holding argc and argv from the argument strings at param,
+//	and the registers in stackframe that differ for a user process.
+//	The user stack page must already be mapped.  Used by ProcessFork
+//	for a new process and by ProcessExec for one replacing its image.
+//
+//----------------------------------------------------------------------
+static void ProcessSetupImage (PCB *pcb, uint32 *stackframe, uint32 start,
+			       uint32 codeS, uint32 codeL, uint32 dataS,
+			       uint32 dataL, uint32 param) {
+  uint32  initial_user_params[MAX_ARGS+2]; // Initial memory for user parameters (argc, argv)
+                                           // initial_user_params[0] = argc
+                                           // initial_user_params[1] = argv, points to initial_user_params[2]
+                                           // initial_user_params[2] = address of string for argv[0]
+                                           // initial_user_params[3] = address of string for argv[1]
+                                           //                           ...
+  uint32 argc=0;           // running counter for number of arguments
+  uint32 offset;           // Used in parsing command line argument strings, holds offset (in bytes) from 
+                           // beginning of the string to the current argument.
+  uint32 initial_user_params_bytes;  // total number of bytes in initial user parameters array
+
+  dbprintf ('p', "File %s -> start=0x%08x\n", pcb->name, start);
+  dbprintf ('p', "File %s -> code @ 0x%08x (size=0x%08x)\n", pcb->name, codeS,
+	      codeL);
+  dbprintf ('p', "File %s -> data @ 0x%08x (size=0x%08x)\n", pcb->name, dataS,
+	      dataL);
+
+  // Nothing is loaded yet: remember where the segments go so
+  // ProcessPageIn can fill the image pages on demand.
+  pcb->codeStart = codeS;
+  pcb->codeSize = codeL;
+  pcb->dataStart = dataS;
+  pcb->dataSize = dataL;
+  pcb->imagePages = PROCESS_IMAGE_PAGES;
+
+  // Code pages another instance already loaded are mapped read-only
+  // now; otherwise claim a textCache entry for ProcessPageIn to fill.
+  if (!ProcessTextShare (pcb, codeS, codeL, dataS)) {
+    ProcessTextRemember (pcb, codeS, codeL, dataS);
+  }
+  stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
+
+  //----------------------------------------------------------------------
+  // STUDENT: setup the initial user stack pointer here as the top
+  // of the process's virtual address space (4-byte aligned).
+  //----------------------------------------------------------------------
+  stackframe[PROCESS_STACK_USER_STACKPOINTER] = MEM_MAX_VIRTUAL_ADDRESS - 3;
+
+  //--------------------------------------------------------------------
+  // This part is setting up the initial user stack with argc and argv.
+  //--------------------------------------------------------------------
+
+  // Copy the entire set of strings of command line parameters onto the user stack.
+  // The "param" variable is a pointer to the start of a sequenial set of strings,
+  // each ending with its own '\0' character.  The final "string" of the sequence
+  // must be an empty string to indicate that the sequence is done.  Since we
+  // can't figure out how long the set of strings actually is in this scenario,
+  // we have to copy the maximum possible string length and parse things manually.
+  stackframe[PROCESS_STACK_USER_STACKPOINTER] -= SIZE_ARG_BUFF;
+  MemoryCopySystemToUser (pcb, (char *)param, (char *)stackframe[PROCESS_STACK_USER_STACKPOINTER], SIZE_ARG_BUFF);
+
+  // Now that the main string is copied into the user space, we need to setup
+  // argv as an array of pointers into that string, and argc as the total
+  // number of arguments found in the string.  The first call to get_argument
+  // should return 0 as the offset of the first string.
+  offset = get_argument((char *)param);
+ 
+  // Compute the addresses in user space of where each string for the command line arguments
+  // begins.  These addresses make up the argv array.
+  for(argc=0; argc < MAX_ARGS; argc++) {
+    // The "+2" is because initial_user_params[0] is argc, and initial_user_params[1] is argv.
+    // The address can be found as the current stack pointer (which points to the start of
+    // the params list) plus the byte offset of the parameter from the beginning of
+    // the list of parameters.
+    initial_user_params[argc+2] = stackframe[PROCESS_STACK_USER_STACKPOINTER] + offset;
+    offset = get_argument(NULL);
+    if (offset == 0) {
+      initial_user_params[argc+2+1] = 0; // last entry should be a null value
+      break;
+    }
+  }
+  // argc is currently the index of the last command line argument.  We need it to instead
+  // be the number of command line arguments, so we increment it by 1.
+  argc++;
+
+  // Now argc can be stored properly
+  initial_user_params[0] = argc;
+
+  // Compute where initial_user_params[3] will be copied in user space as the 
+  // base of the array of string addresses.  The entire initial_user_params array
+  // of uint32's will be copied onto the stack.  We'll move the stack pointer by
+  // the necessary amount, then start copying the array.  Therefore, initial_user_params[3]
+  // will reside at the current stack pointer value minus the number of command line
+  // arguments (argc).
+  initial_user_params[1] = stackframe[PROCESS_STACK_USER_STACKPOINTER] - (argc*sizeof(uint32));
+
+  // Now copy the actual memory.  Remember that stacks grow down from the top of memory, so 
+  // we need to move the stack pointer first, then do the copy.  The "+2", as before, is 
+  // because initial_user_params[0] is argc, and initial_user_params[1] is argv.
+  initial_user_params_bytes = (argc + 2) * sizeof(uint32);
+
+  stackframe[PROCESS_STACK_USER_STACKPOINTER] -= initial_user_params_bytes;
+  MemoryCopySystemToUser (pcb, (char *)initial_user_params, (char *)(stackframe[PROCESS_STACK_USER_STACKPOINTER]), initial_user_params_bytes);
+
+  // Set the correct address at which to execute a user process.
+  stackframe[PROCESS_STACK_IAR] = (uint32)start;
+
+  // Flag this as a user process
+  pcb->flags |= PROCESS_TYPE_USER;
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessExec
+//
+//	Replace pcb's image with the executable name, keeping the PCB
+//	(so the pid, system stack and queue links stay), and start it
+//	with the argument strings at allargs, which must be in system
+//	space.  The old mappings, copy-on-write sharing included, go in
+//	one MemoryFreePageTables pass, as at exit.  Called from the exec
+//	trap, so the new registers go in the frame the trap returns
+//	through.  Returns -1, with the old image untouched, if name can't
+//	be opened or pcb has threads.
+//
+//----------------------------------------------------------------------
+int ProcessExec (PCB *pcb, char *name, char *allargs) {
+  uint32	*stackframe = pcb->currentSavedFrame;
+  uint32	start, codeS, codeL, dataS, dataL;
+  int		fd, GrabPg, intrs;
+
+  if ((pcb->mm != pcb) || (pcb->threadSlots != 0)) {
+    printf ("ProcessExec: can't replace the image of a process with threads\n");
+    return (-1);
+  }
+  if ((fd = ProcessGetCodeInfo (name, &start, &codeS, &codeL, &dataS, &dataL)) < 0) {
+    return (-1);
+  }
+  FsClose (fd);
+
+  intrs = DisableIntrs ();
+  MemoryFreePageTables (pcb);
+  RestoreIntrs (intrs);
+  dstrncpy (pcb->name, name, sizeof (pcb->name));
+  pcb->npages = 0;
+  pcb->imagePages = 0;
+  pcb->pageFaults = pcb->growthFaults = pcb->growthPages = pcb->cowBreaks = 0;
+  pcb->residentPages = pcb->peakPages = 0;
+  pcb->fpUsed = 0;
+
+  // A fresh user stack page, as in ProcessFork
+  if (((GrabPg = MemoryAllocPage ()) == MEM_FAIL) ||
+      (MemorySetPte (pcb, MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS), MemorySetupPte (GrabPg)) != MEM_SUCCESS)) {
+    printf("Error Could not allocate page \n");
+    exitsim();
+  }
+  pcb->npages += 1;
+  ProcessSetupImage (pcb, stackframe, start, codeS, codeL, dataS, dataL, (uint32)allargs);
+  dbprintf ('p', "ProcessExec (%d): now running %s\n", GetPidFromAddress(pcb), name);
+  return (GetPidFromAddress(pcb));
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessFpEnable
+//
+//	Called on TRAP_FPU, the first time pcb touches an FP register.
+//	User processes start with DLX_STATUS_FPDISABLE set, and while it
+//	is set in a frame's ISR, intrhandler and intrreturn skip the FP
+//	registers for that frame, since the process has nothing in them.
+//	Turn it off in the frame the trap returns through, with zeroed FP
+//	registers for intrreturn to load (whatever is in them now belongs
+//	to someone else), so the instruction runs again and from now on
+//	pcb's FP state is saved like the rest.
+//
+//----------------------------------------------------------------------
+void ProcessFpEnable (PCB *pcb) {
+  uint32 *frame = pcb->currentSavedFrame;
+  int i;
+
+  dbprintf ('p', "ProcessFpEnable: process %d uses the FP registers\n",
+	    GetPidFromAddress(pcb));
+  for (i = 0; i < 32; i++) {
+    frame[PROCESS_STACK_FREG + i] = 0;
+  }
+  frame[PROCESS_STACK_ISR] &= ~DLX_STATUS_FPDISABLE;
+  pcb->fpUsed = 1;
+}
+
 //----------------------------------------------------------------------
 //
 //	ProcessFork
@@ -478,24 +872,12 @@ void ProcessPrintFork(PCB * pcb) {
 //----------------------------------------------------------------------
 int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   int i;                   // Loop index variable
-  int fd, n;               // Used for reading code from files.
+  int fd;                  // Used for reading code from files.
   int start, codeS, codeL; // Used for reading code from files.
   int dataS, dataL;        // Used for reading code from files.
-  int addr = 0;            // Used for reading code from files.
-  unsigned char buf[100];  // Used for reading code from files.
   uint32 *stackframe;      // Stores address of current stack frame.
   PCB *pcb;                // Holds pcb while we build it for this process.
   int intrs;               // Stores previous interrupt settings.
-  uint32  initial_user_params[MAX_ARGS+2]; // Initial memory for user parameters (argc, argv)
-                                           // initial_user_params[0] = argc
-                                           // initial_user_params[1] = argv, points to initial_user_params[2]
-                                           // initial_user_params[2] = address of string for argv[0]
-                                           // initial_user_params[3] = address of string for argv[1]
-                                           //                           ...
-  uint32 argc=0;           // running counter for number of arguments
-  uint32 offset;           // Used in parsing command line argument strings, holds offset (in bytes) from 
-                           // beginning of the string to the current argument.
-  uint32 initial_user_params_bytes;  // total number of bytes in initial user parameters array
   uint32 GrabPg;
 
 
@@ -528,8 +910,10 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   //----------------------------------------------------------------------
   // This section initializes the memory for this process
   //----------------------------------------------------------------------
-  // Allocate 1 page for system stack, 1 page for user stack (at top of
-  // virtual address space), and 4 pages for user code and global data.
+  // Allocate 1 page for system stack and 1 page for user stack (at top
+  // of virtual address space).  The PROCESS_IMAGE_PAGES pages for user
+  // code and global data start out invalid; ProcessPageIn fills each
+  // from the executable the first time it's touched.
 
   //---------------------------------------------------------
   // STUDENT: allocate pages for a new process here.  The
@@ -538,16 +922,18 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   // for the system stack.
   //---------------------------------------------------------
 
-  pcb->npages = 4;
-  //user and global data:
-  for (i = 0; i < 4; i++) {
-    GrabPg = MemoryAllocPage();
-    if (GrabPg == MEM_FAIL) {
-      printf("Error could not allocate page \n");
-      exitsim();
-    }
-    pcb->pagetable[i] = MemorySetupPte(GrabPg);
+  // A freed PCB can still hold stale L1 entries
+  for (i = 0; i < MEM_L1PAGETABLE_SIZE; i++) {
+    pcb->pagetable[i] = 0;
   }
+  pcb->npages = 0;
+  pcb->imagePages = 0;
+  pcb->mm = pcb;
+  pcb->threadSlots = 0;
+  pcb->threadSlot = 0;
+  pcb->pageFaults = pcb->growthFaults = pcb->growthPages = pcb->cowBreaks = 0;
+  pcb->residentPages = pcb->peakPages = 0;
+  pcb->fpUsed = 0;
 
   //User stack frame
   pcb->npages += 1;
@@ -556,7 +942,10 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
     printf("Error Could not allocate page \n");
     exitsim();
   }
-  pcb->pagetable[MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS)] = MemorySetupPte(GrabPg);
+  if (MemorySetPte(pcb, MEM_ADDR2PAGE(MEM_MAX_VIRTUAL_ADDRESS), MemorySetupPte(GrabPg)) != MEM_SUCCESS) {
+    printf("Error Could not allocate page \n");
+    exitsim();
+  }
 
   //System Stak Frame
   GrabPg = MemoryAllocPage();
@@ -600,7 +989,7 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   //----------------------------------------------------------------------
 
   stackframe[PROCESS_STACK_PTBASE] = (uint32)&pcb->pagetable[0];
-  stackframe[PROCESS_STACK_PTBITS] = (MEM_L1FIELD_FIRST_BITNUM << 16) | MEM_L1FIELD_FIRST_BITNUM;
+  stackframe[PROCESS_STACK_PTBITS] = MEM_PTBITS;
   stackframe[PROCESS_STACK_PTSIZE] = MEM_L1PAGETABLE_SIZE; 
 
   if (isUser) {
@@ -611,89 +1000,8 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
       ProcessFreeResources (pcb);
       return (-1);
     }
-
-    dbprintf ('p', "File %s -> start=0x%08x\n", name, start);
-    dbprintf ('p', "File %s -> code @ 0x%08x (size=0x%08x)\n", name, codeS,
-	      codeL);
-    dbprintf ('p', "File %s -> data @ 0x%08x (size=0x%08x)\n", name, dataS,
-	      dataL);
-
-    while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
-      dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
-      // Copy the data to user memory.  Note that the user memory needs to
-      // have enough space so that this copy will succeed!
-      MemoryCopySystemToUser (pcb, buf, (char *)(addr - n), n);
-    }
     FsClose (fd);
-    stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
-
-    //----------------------------------------------------------------------
-    // STUDENT: setup the initial user stack pointer here as the top
-    // of the process's virtual address space (4-byte aligned).
-    //----------------------------------------------------------------------
-    pcb->currentSavedFrame[PROCESS_STACK_USER_STACKPOINTER] = MEM_MAX_VIRTUAL_ADDRESS - 3;
-
-    //--------------------------------------------------------------------
-    // This part is setting up the initial user stack with argc and argv.
-    //--------------------------------------------------------------------
-
-    // Copy the entire set of strings of command line parameters onto the user stack.
-    // The "param" variable is a pointer to the start of a sequenial set of strings,
-    // each ending with its own '\0' character.  The final "string" of the sequence
-    // must be an empty string to indicate that the sequence is done.  Since we
-    // can't figure out how long the set of strings actually is in this scenario,
-    // we have to copy the maximum possible string length and parse things manually.
-    stackframe[PROCESS_STACK_USER_STACKPOINTER] -= SIZE_ARG_BUFF;
-    MemoryCopySystemToUser (pcb, (char *)param, (char *)stackframe[PROCESS_STACK_USER_STACKPOINTER], SIZE_ARG_BUFF);
-
-    // Now that the main string is copied into the user space, we need to setup
-    // argv as an array of pointers into that string, and argc as the total
-    // number of arguments found in the string.  The first call to get_argument
-    // should return 0 as the offset of the first string.
-    offset = get_argument((char *)param);
-   
-    // Compute the addresses in user space of where each string for the command line arguments
-    // begins.  These addresses make up the argv array.
-    for(argc=0; argc < MAX_ARGS; argc++) {
-      // The "+2" is because initial_user_params[0] is argc, and initial_user_params[1] is argv.
-      // The address can be found as the current stack pointer (which points to the start of
-      // the params list) plus the byte offset of the parameter from the beginning of
-      // the list of parameters.
-      initial_user_params[argc+2] = stackframe[PROCESS_STACK_USER_STACKPOINTER] + offset;
-      offset = get_argument(NULL);
-      if (offset == 0) {
-        initial_user_params[argc+2+1] = 0; // last entry should be a null value
-        break;
-      }
-    }
-    // argc is currently the index of the last command line argument.  We need it to instead
-    // be the number of command line arguments, so we increment it by 1.
-    argc++;
-
-    // Now argc can be stored properly
-    initial_user_params[0] = argc;
-
-    // Compute where initial_user_params[3] will be copied in user space as the 
-    // base of the array of string addresses.  The entire initial_user_params array
-    // of uint32's will be copied onto the stack.  We'll move the stack pointer by
-    // the necessary amount, then start copying the array.  Therefore, initial_user_params[3]
-    // will reside at the current stack pointer value minus the number of command line
-    // arguments (argc).
-    initial_user_params[1] = stackframe[PROCESS_STACK_USER_STACKPOINTER] - (argc*sizeof(uint32));
-
-    // Now copy the actual memory.  Remember that stacks grow down from the top of memory, so 
-    // we need to move the stack pointer first, then do the copy.  The "+2", as before, is 
-    // because initial_user_params[0] is argc, and initial_user_params[1] is argv.
-    initial_user_params_bytes = (argc + 2) * sizeof(uint32);
-
-    stackframe[PROCESS_STACK_USER_STACKPOINTER] -= initial_user_params_bytes;
-    MemoryCopySystemToUser (pcb, (char *)initial_user_params, (char *)(stackframe[PROCESS_STACK_USER_STACKPOINTER]), initial_user_params_bytes);
-
-    // Set the correct address at which to execute a user process.
-    stackframe[PROCESS_STACK_IAR] = (uint32)start;
-
-    // Flag this as a user process
-    pcb->flags |= PROCESS_TYPE_USER;
+    ProcessSetupImage (pcb, stackframe, start, codeS, codeL, dataS, dataL, param);
   } else {
     // Don't worry about messing with any code here for kernel processes because
     // there aren't any kernel processes in DLXOS.
@@ -764,6 +1072,333 @@ static inline int getxvalue (int x) {
   }
 }
 
+//----------------------------------------------------------------------
+//
+//	Binary image support
+//
+//	Executables may be either the hex text format written by dlxasm
+//	or a binary image (see PROCESS_IMAGE_MAGIC in process.h).  Only
+//	one executable is ever being loaded at a time, so the state for the
+//	binary image being read is kept here rather than in the caller.
+//
+//----------------------------------------------------------------------
+static struct {
+  int		fd;		// descriptor of the open image, or -1
+  uint32	segleft;	// bytes left in the current segment
+} processImage = { -1, 0 };
+
+static uint32 ProcessImageWord (unsigned char *p, int word) {
+  p += word * 4;
+  return ((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+static int ProcessGetImageInfo (int fd, unsigned char *hdr, uint32 *startAddr,
+				uint32 *codeStart, uint32 *codeSize,
+				uint32 *dataStart, uint32 *dataSize) {
+  if (ProcessImageWord (hdr, PROCESS_IMAGE_VERSION_WORD) != PROCESS_IMAGE_VERSION) {
+    dbprintf ('f', "ProcessGetImageInfo: unsupported image version %d\n",
+	      (int)ProcessImageWord (hdr, PROCESS_IMAGE_VERSION_WORD));
+    FsClose (fd);
+    return (-1);
+  }
+  *startAddr = ProcessImageWord (hdr, PROCESS_IMAGE_START_WORD);
+  *codeStart = ProcessImageWord (hdr, PROCESS_IMAGE_CODESTART_WORD);
+  *codeSize = ProcessImageWord (hdr, PROCESS_IMAGE_CODESIZE_WORD);
+  *dataStart = ProcessImageWord (hdr, PROCESS_IMAGE_DATASTART_WORD);
+  *dataSize = ProcessImageWord (hdr, PROCESS_IMAGE_DATASIZE_WORD);
+  processImage.fd = fd;
+  processImage.segleft = 0;
+  // Seek to the first segment header
+  FsSeek (fd, PROCESS_IMAGE_HEADER_WORDS * 4, FS_SEEK_SET);
+  return (fd);
+}
+
+// Same contract as ProcessGetFromFile, for binary images: data never
+// spans two segments, so *addr is only reset at a segment boundary.
+static int ProcessGetFromImage (int fd, unsigned char *buf, uint32 *addr, int max) {
+  unsigned char	seghdr[PROCESS_IMAGE_SEGHDR_WORDS * 4];
+  int		nbytes;
+
+  while (processImage.segleft == 0) {
+    if (FsRead (fd, (char *)seghdr, sizeof (seghdr)) != sizeof (seghdr)) {
+      return (0);
+    }
+    *addr = ProcessImageWord (seghdr, 0);
+    processImage.segleft = ProcessImageWord (seghdr, 1);
+    dbprintf ('f', "Image segment at 0x%x (%d bytes).\n", (int)(*addr),
+	      (int)processImage.segleft);
+  }
+  if (max > processImage.segleft) {
+    max = processImage.segleft;
+  }
+  if ((nbytes = FsRead (fd, (char *)buf, max)) <= 0) {
+    return (0);
+  }
+  processImage.segleft -= nbytes;
+  *addr += nbytes;
+  return (nbytes);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessLoadImagePage
+//
+//	If fd is a binary image, read the parts of its segments that fall
+//	in user page "page" straight into the physical page at paddr,
+//	seeking over everything else.  Returns 1 once the page is loaded,
+//	0 if fd isn't a binary image, or -1 if a segment is truncated.
+//
+//----------------------------------------------------------------------
+static int ProcessLoadImagePage (int fd, uint32 page, uint32 paddr) {
+  unsigned char	seghdr[PROCESS_IMAGE_SEGHDR_WORDS * 4];
+  uint32	vaddr, left, lo, hi;
+  uint32	pstart = page * MEM_PAGESIZE;
+  uint32	pend = pstart + MEM_PAGESIZE;
+
+  if (fd != processImage.fd) {
+    return (0);
+  }
+  processImage.fd = -1;
+  while (FsRead (fd, (char *)seghdr, sizeof (seghdr)) == sizeof (seghdr)) {
+    vaddr = ProcessImageWord (seghdr, 0);
+    left = ProcessImageWord (seghdr, 1);
+    lo = (vaddr > pstart) ? vaddr : pstart;
+    hi = (vaddr + left < pend) ? vaddr + left : pend;
+    if (lo >= hi) {
+      FsSeek (fd, left, FS_SEEK_CUR);
+      continue;
+    }
+    FsSeek (fd, lo - vaddr, FS_SEEK_CUR);
+    dbprintf ('p', "Reading %d bytes to vaddr %08x (paddr %08x).\n", (int)(hi - lo),
+	      (int)lo, (int)(paddr + lo - pstart));
+    if (FsRead (fd, (char *)(paddr + lo - pstart), hi - lo) != hi - lo) {
+      printf ("ProcessLoadImagePage: image truncated at vaddr 0x%x\n", (int)lo);
+      return (-1);
+    }
+    FsSeek (fd, vaddr + left - hi, FS_SEEK_CUR);
+  }
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessPageIn
+//
+//	Give pcb a valid user page "page" filled from its executable (the
+//	parts no segment covers are zero).  Code pages come from textCache
+//	when another instance already loaded them, and freshly loaded ones
+//	are put there for the next instance.  Called from the page fault
+//	handler and from the user/system copy routines.  Returns
+//	MEM_SUCCESS, or MEM_FAIL if the page isn't part of pcb's image or
+//	can't be loaded.
+//
+//----------------------------------------------------------------------
+int ProcessPageIn (PCB *pcb, int page) {
+  unsigned char	buf[100];
+  uint32	start, codeS, codeL, dataS, dataL;
+  uint32	addr = 0, paddr, lo, hi;
+  uint32	pstart = page * MEM_PAGESIZE;
+  int		fd, n, genPage, first, ntext, entry;
+  uint32	pte;
+
+  pcb = pcb->mm;		// Threads page into their process
+  if ((page < 0) || (page >= pcb->imagePages)) {
+    return (MEM_FAIL);
+  }
+  if (MemoryGetPte (pcb, page) & MEM_PTE_VALID) {
+    return (MEM_SUCCESS);
+  }
+  if (MemoryGetPte (pcb, page) & MEM_PTE_SWAPPED) {
+    // Touched before: the executable's copy is out of date
+    return (MemorySwapIn (pcb, page));
+  }
+  ntext = ProcessTextPages (pcb->codeStart, pcb->codeSize, pcb->dataStart, &first);
+  entry = -1;
+  if ((page >= first) && (page < first + ntext)) {
+    entry = ProcessTextFind (pcb->name, first, ntext);
+  }
+  if ((entry >= 0) && (textCache[entry].pte[page - first] & MEM_PTE_VALID)) {
+    if (MemorySetPte (pcb, page, textCache[entry].pte[page - first]) != MEM_SUCCESS) {
+      return (MEM_FAIL);
+    }
+    MemorySharePte (textCache[entry].pte[page - first]);
+    pcb->npages += 1;
+    dbprintf ('p', "ProcessPageIn (%d): page %d shared from textCache\n",
+	      GetPidFromAddress(pcb), page);
+    return (MEM_SUCCESS);
+  }
+
+  if ((fd = ProcessGetCodeInfo (pcb->name, &start, &codeS, &codeL, &dataS, &dataL)) < 0) {
+    printf ("ProcessPageIn: can't reopen %s\n", pcb->name);
+    return (MEM_FAIL);
+  }
+  if ((genPage = MemoryAllocZeroedPage ()) == MEM_FAIL) {
+    FsClose (fd);
+    return (MEM_FAIL);
+  }
+  paddr = genPage * MEM_PAGESIZE;
+  n = ProcessLoadImagePage (fd, page, paddr);
+  if (n == 0) {
+    // Hex file: scan all of it and keep what lands on this page
+    while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
+      lo = (addr - n > pstart) ? addr - n : pstart;
+      hi = (addr < pstart + MEM_PAGESIZE) ? addr : pstart + MEM_PAGESIZE;
+      if (lo < hi) {
+	bcopy ((char *)buf + (lo - (addr - n)), (char *)(paddr + lo - pstart), hi - lo);
+      }
+    }
+  }
+  FsClose (fd);
+  if (n < 0) {
+    MemoryFreePage (genPage);
+    return (MEM_FAIL);
+  }
+  pte = MemorySetupPte (genPage);
+  if (entry >= 0) {
+    pte |= MEM_PTE_READONLY;
+  }
+  if (MemorySetPte (pcb, page, pte) != MEM_SUCCESS) {
+    MemoryFreePage (genPage);
+    return (MEM_FAIL);
+  }
+  pcb->npages += 1;
+  if (entry >= 0) {
+    textCache[entry].pte[page - first] = pte;
+    MemorySharePte (pte);
+  }
+  dbprintf ('p', "ProcessPageIn (%d): loaded page %d of %s\n",
+	    GetPidFromAddress(pcb), page, pcb->name);
+  return (MEM_SUCCESS);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessTextPages
+//
+//	Work out which pages hold nothing but code: those entirely inside
+//	[codeS, codeS+codeL) and below dataS.  A page code shares with data
+//	is writable, so it's never shared.  Returns the number of pages and
+//	sets *first to the first of them.
+//
+//----------------------------------------------------------------------
+static int ProcessTextPages (uint32 codeS, uint32 codeL, uint32 dataS, int *first) {
+  uint32	end = codeS + codeL;
+  int		last;
+
+  if (dataS > codeS && dataS < end) {
+    end = dataS;
+  }
+  *first = MEM_ADDR2PAGE(codeS + MEM_PAGESIZE - 1);
+  last = MEM_ADDR2PAGE(end);	// first page that isn't all code
+  if (last > PROCESS_IMAGE_PAGES) {
+    last = PROCESS_IMAGE_PAGES;
+  }
+  return ((last > *first) ? last - *first : 0);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessTextFind
+//
+//	Return the textCache entry for executable "name" whose code is
+//	npages pages from page first, or -1 if there isn't one.
+//
+//----------------------------------------------------------------------
+static int ProcessTextFind (char *name, int first, int npages) {
+  int	i;
+
+  for (i = 0; i < PROCESS_TEXT_CACHE_SIZE; i++) {
+    if ((textCache[i].npages == npages) && (textCache[i].first == first) &&
+	(dstrncmp (textCache[i].name, name, PROCESS_MAX_NAME_LENGTH) == 0)) {
+      return (i);
+    }
+  }
+  return (-1);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessTextShare
+//
+//	If an earlier instance of pcb's executable left its code pages in
+//	textCache, map the ones it loaded read-only into pcb; the rest
+//	are shared as ProcessPageIn loads them.  A write to one of them
+//	goes through MemoryRopHandler and gets a private copy like any
+//	other shared page.  Returns 1 if there's an entry, 0 otherwise.
+//
+//----------------------------------------------------------------------
+static int ProcessTextShare (PCB *pcb, uint32 codeS, uint32 codeL, uint32 dataS) {
+  int	i, j, first, npages;
+
+  npages = ProcessTextPages (codeS, codeL, dataS, &first);
+  if (npages == 0) {
+    return (0);
+  }
+  if ((i = ProcessTextFind (pcb->name, first, npages)) < 0) {
+    return (0);
+  }
+  for (j = 0; j < npages; j++) {
+    if (textCache[i].pte[j] & MEM_PTE_VALID) {
+      if (MemorySetPte (pcb, first + j, textCache[i].pte[j]) != MEM_SUCCESS) {
+	break;		// The rest are shared as they're paged in
+      }
+      MemorySharePte (textCache[i].pte[j]);
+      pcb->npages += 1;
+    }
+  }
+  dbprintf ('p', "ProcessTextShare: %s shares code pages from page %d\n",
+	    pcb->name, first);
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessTextRemember
+//
+//	Claim a textCache entry for pcb's executable; ProcessPageIn puts
+//	each code page in it as it's loaded.  An entry is only reused when
+//	no process maps any of its pages, so a cache full of running
+//	executables just doesn't take the new one.
+//
+//----------------------------------------------------------------------
+static void ProcessTextRemember (PCB *pcb, uint32 codeS, uint32 codeL, uint32 dataS) {
+  int	i, j, first, npages;
+
+  npages = ProcessTextPages (codeS, codeL, dataS, &first);
+  if (npages == 0) {
+    return;
+  }
+  for (i = 0; i < PROCESS_TEXT_CACHE_SIZE; i++) {
+    if (textCache[i].npages == 0) {
+      break;
+    }
+    for (j = 0; j < textCache[i].npages; j++) {
+      if ((textCache[i].pte[j] & MEM_PTE_VALID) && (MemoryPteRefs (textCache[i].pte[j]) > 1)) {
+	break;
+      }
+    }
+    if (j == textCache[i].npages) {
+      // Only the cache holds this one; let its pages go
+      for (j = 0; j < textCache[i].npages; j++) {
+	if (textCache[i].pte[j] & MEM_PTE_VALID) {
+	  MemoryFreePageTableEntry (textCache[i].pte[j]);
+	}
+      }
+      textCache[i].npages = 0;
+      break;
+    }
+  }
+  if (i == PROCESS_TEXT_CACHE_SIZE) {
+    return;
+  }
+  dstrncpy (textCache[i].name, pcb->name, PROCESS_MAX_NAME_LENGTH);
+  textCache[i].first = first;
+  textCache[i].npages = npages;
+  for (j = 0; j < npages; j++) {
+    textCache[i].pte[j] = 0;
+  }
+}
+
 //----------------------------------------------------------------------
 //
 //	ProcessGetCodeSizes
@@ -797,6 +1432,11 @@ ProcessGetCodeInfo (const char *file, uint32 *startAddr,
     FsClose (fd);
     return (-1);
   }
+  processImage.fd = -1;
+  if (ProcessImageWord ((unsigned char *)buf, PROCESS_IMAGE_MAGIC_WORD) == PROCESS_IMAGE_MAGIC) {
+    return (ProcessGetImageInfo (fd, (unsigned char *)buf, startAddr, codeStart,
+				 codeSize, dataStart, dataSize));
+  }
   if (dstrstr (buf, "start:") == NULL) {
     dbprintf ('f', "ProcessGetCodeInfo: %s missing start line (not a DLX executable?)\n", file);
     return (-1);
@@ -851,6 +1491,9 @@ ProcessGetFromFile (int fd, unsigned char *buf, uint32 *addr, int max)
   unsigned char *pos = buf;
   char	*lpos = localbuf;
 
+  if (fd == processImage.fd) {
+    return (ProcessGetFromImage (fd, buf, addr, max));
+  }
   // Remember our position at the start of the routine so we can adjust
   // it later.
   seekpos = FsSeek (fd, 0, FS_SEEK_CUR);
@@ -988,6 +1631,17 @@ void main (int argc, char *argv[])
 	close (fd);
 	break;
       }
+      case 'a':
+	if ((memoryFaultAround = dstrtol (argv[++i], (void *)0, 0)) < 1) {
+	  memoryFaultAround = 1;
+	}
+	break;
+      case 'p':
+	processPinfo = 1;
+	break;
+      case 's':
+	memoryShareTables = 1;
+	break;
       case 'u':
 	userprog = argv[++i];
         base = i; // Save the location of the user program's name 
@@ -1005,6 +1659,12 @@ void main (int argc, char *argv[])
   dbprintf ('i', "After initializing queues.\n");
   MemoryModuleInit ();
   dbprintf ('i', "After initializing memory.\n");
+  // Pages can go out to swap if there's a disk to put them on
+  if (DiskModuleInit () == DISK_SUCCESS) {
+    MemorySwapModuleInit ();
+  } else {
+    printf ("No disk: running without swap.\n");
+  }
 
   ProcessModuleInit ();
   dbprintf ('i', "After initializing processes.\n");
@@ -1041,6 +1701,8 @@ void main (int argc, char *argv[])
   } else {
     dbprintf('i', "No user program passed!\n");
   }
+  // After the user program, so it still gets the first pid
+  zeroPCB = &pcbs[ProcessFork (&ProcessZeroer, 0, "zeroer", 0)];
   ClkStart();
   dbprintf ('i', "Set timer quantum to %d, about to run first process.\n",
 	    processQuantum);
@@ -1050,6 +1712,45 @@ void main (int argc, char *argv[])
   exitsim();	// NEVER RETURNS!
 }
 
+//----------------------------------------------------------------------
+//
+//	ProcessZeroer
+//
+//	Kernel process that zeroes free pages ahead of time so that page
+//	faults and fork can take them from MemoryAllocZeroedPage's pool
+//	instead of clearing them on the spot.  Once the pool is full (or
+//	there are no free pages) it sleeps until MemoryAllocZeroedPage
+//	runs it low.  It's scheduled like any other process, but only
+//	runs until the pool is full again.
+//
+//----------------------------------------------------------------------
+void ProcessZeroer () {
+  int intrs;
+
+  while (1) {
+    while (MemoryZeroPoolFill () == MEM_SUCCESS) { }
+    intrs = DisableIntrs ();
+    zeroWaiting = 1;
+    ProcessSleep ();
+    RestoreIntrs (intrs);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessWakeZeroer
+//
+//	Make the zeroing process runnable, if it's asleep.  Interrupts
+//	must be disabled.
+//
+//----------------------------------------------------------------------
+void ProcessWakeZeroer () {
+  if (zeroWaiting) {
+    zeroWaiting = 0;
+    ProcessWakeup (zeroPCB);
+  }
+}
+
 unsigned GetCurrentPid()
 {
   return (unsigned)(currentPCB - pcbs);
@@ -10,10 +10,12 @@
 #include "process.h"
 #include "synch.h"
 #include "queue.h"
+#include "memory.h"
 
 static Sem sems[MAX_SEMS]; 	// All semaphores in the system
 static Lock locks[MAX_LOCKS];   // All locks in the system
 static Cond conds[MAX_LOCKS];   // All conds in the system
+static Futex futexes[MAX_FUTEXES];  // Words that have sleepers
 
 extern struct PCB *currentPCB; 
 //----------------------------------------------------------------------
@@ -34,6 +36,9 @@ int SynchModuleInit() {
   for(i=0; i<MAX_CONDS; i++) {
     conds[i].inuse = 0;
   }
+  for(i=0; i<MAX_FUTEXES; i++) {
+    futexes[i].inuse = 0;
+  }
   dbprintf ('p', "SynchModuleInit: Leaving SynchModuleInit\n");
   return SYNC_SUCCESS;
 }
@@ -533,3 +538,114 @@ int CondHandleBroadcast(cond_t cond) {
   if (!conds[cond].inuse)  return SYNC_FAIL;
   return CondSignal(&conds[cond]);
 }
+
+//---------------------------------------------------------------------------
+//	FutexFind
+//
+//	Returns the futex for physical address paddr, setting up a free
+//	one if there isn't one yet and create is set.  Returns NULL if
+//	there's none (or none left).  Interrupts must be disabled.
+//---------------------------------------------------------------------------
+static Futex *FutexFind(uint32 paddr, int create) {
+  Futex *f, *spare = NULL;
+
+  for (f = futexes; f < futexes + MAX_FUTEXES; f++) {
+    if (!f->inuse) {
+      if (!spare) spare = f;
+    } else if (f->addr == paddr) {
+      return f;
+    }
+  }
+  if (!create || !spare) return NULL;
+  if (AQueueInit (&spare->waiting) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not initialize futex waiting queue in FutexFind!\n");
+    exitsim();
+  }
+  spare->addr = paddr;
+  spare->inuse = 1;
+  // Its waiters are found by paddr: keep the page where it is
+  MemoryPinPage (paddr / MEM_PAGESIZE);
+  return spare;
+}
+
+//---------------------------------------------------------------------------
+//	FutexWait
+//
+//	Puts the current process to sleep on the word at user address
+//	uaddr, but only if the word still holds val.  The check and the
+//	sleep happen with interrupts off, so a FutexWake that follows a
+//	change to the word can't be missed.  Returns SYNC_SUCCESS after
+//	sleeping, or SYNC_FAIL if the word had changed (the caller should
+//	look at it again) or the address isn't mapped.
+//---------------------------------------------------------------------------
+int FutexWait(uint32 uaddr, int val) {
+  Link *l;
+  Futex *f;
+  uint32 paddr;
+  int intrval;
+
+  if (uaddr & 0x3) return SYNC_FAIL;
+
+  intrval = DisableIntrs ();
+  paddr = MemoryTranslateUserToSystem (currentPCB, uaddr);
+  if ((paddr == MEM_FAIL) || (*((int *)paddr) != val)) {
+    RestoreIntrs (intrval);
+    return SYNC_FAIL;
+  }
+  if ((f = FutexFind (paddr, 1)) == NULL) {
+    // Out of futexes: make the caller spin through the kernel instead
+    dbprintf('s', "FutexWait: no free futex for 0x%x\n", paddr);
+    RestoreIntrs (intrval);
+    return SYNC_FAIL;
+  }
+  dbprintf('s', "FutexWait: putting process %d to sleep on 0x%x\n", GetCurrentPid(), paddr);
+  if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
+    printf("FATAL ERROR: could not allocate link for futex queue in FutexWait!\n");
+    exitsim();
+  }
+  if (AQueueInsertLast (&f->waiting, l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert new link into futex waiting queue in FutexWait!\n");
+    exitsim();
+  }
+  ProcessSleep();
+  RestoreIntrs (intrval);
+  return SYNC_SUCCESS;
+}
+
+//---------------------------------------------------------------------------
+//	FutexWake
+//
+//	Wakes up to count processes sleeping on the word at user address
+//	uaddr.  Returns the number woken.
+//---------------------------------------------------------------------------
+int FutexWake(uint32 uaddr, int count) {
+  Link *l;
+  Futex *f;
+  PCB *pcb;
+  uint32 paddr;
+  int intrval, woken = 0;
+
+  intrval = DisableIntrs ();
+  paddr = MemoryTranslateUserToSystem (currentPCB, uaddr);
+  if ((paddr == MEM_FAIL) || ((f = FutexFind (paddr, 0)) == NULL)) {
+    RestoreIntrs (intrval);
+    return 0;
+  }
+  while ((woken < count) && !AQueueEmpty(&f->waiting)) {
+    l = AQueueFirst(&f->waiting);
+    pcb = (PCB *)AQueueObject(l);
+    if (AQueueRemove(&l) != QUEUE_SUCCESS) {
+      printf("FATAL ERROR: could not remove link from futex queue in FutexWake!\n");
+      exitsim();
+    }
+    dbprintf ('s', "FutexWake: Waking up PID %d on 0x%x.\n", (int)(GetPidFromAddress(pcb)), paddr);
+    ProcessWakeup (pcb);
+    woken++;
+  }
+  if (AQueueEmpty(&f->waiting)) {
+    f->inuse = 0;
+    MemoryUnpinPage (paddr / MEM_PAGESIZE);
+  }
+  RestoreIntrs (intrval);
+  return woken;
+}
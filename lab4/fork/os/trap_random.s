@@ -21,3 +21,30 @@ _srandom:
 	nop
 .endproc _srandom
 
+
+;;; Host-speed memmove/memset on physical memory (simulator service).
+;;; Returns dst, or -1 if it can't be used (see misc.c).
+.proc _memmove
+.global _memmove
+_memmove:
+	trap	#0x2044
+	jr	r31
+	nop
+.endproc _memmove
+
+.proc _memset
+.global _memset
+_memset:
+	trap	#0x2045
+	jr	r31
+	nop
+.endproc _memset
+
+;;; Write an already formatted buffer to the simulator console.
+.proc _conswrite
+.global _conswrite
+_conswrite:
+	trap	#0x2046
+	jr	r31
+	nop
+.endproc _conswrite
@@ -12,6 +12,7 @@
 #include "memory.h"
 #include "synch.h"
 #include "clock.h"
+#include "disk.h"
 
 
 //----------------------------------------------------------------------
@@ -28,6 +29,33 @@ KbdModuleInit ()
   *((uint32 *)DLX_KBD_INTR) = 1;
 }
 
+//----------------------------------------------------------------------
+//
+//	PerfCounterRead
+//	PerfCounterReset
+//
+//	Read the low word of a simulator performance counter, or zero
+//	it.  Returns 0 for counters that don't exist.
+//
+//----------------------------------------------------------------------
+uint32
+PerfCounterRead (int ctr)
+{
+  if ((ctr < 0) || (ctr >= DLX_PERF_NUM)) {
+    return (0);
+  }
+  return (*((uint32 *)(DLX_PERF_BASE + 8 * ctr)));
+}
+
+void
+PerfCounterReset (int ctr)
+{
+  if ((ctr < 0) || (ctr >= DLX_PERF_NUM)) {
+    return;
+  }
+  *((uint32 *)(DLX_PERF_BASE + 8 * ctr)) = 0;
+}
+
 //--------------------------------------------------------------------
 // GetUintFromTrapArg(uint32 *trapArgs, int sysmode)
 //--------------------------------------------------------------------
@@ -65,17 +93,18 @@ static int GetIntFromTrapArg(uint32 *trapArgs, int sysmode)
 }
 //--------------------------------------------------------------------
 //
-// int process_create(char *exec_name, ...);
+// TrapGetProcessArgs
 //
+// Copy the (char *exec_name, ...) arguments of process_create, spawn
+// and exec into name (PROCESS_MAX_NAME_LENGTH bytes) and allargs
+// (SIZE_ARG_BUFF bytes), the argument strings one after another.
 // Here we support reading command-line arguments.  Maximum MAX_ARGS 
 // command-line arguments are allowed.  Also the total length of the 
 // arguments including the terminating '\0' should be less than or 
 // equal to SIZE_ARG_BUFF.
 //
 //--------------------------------------------------------------------
-static void TrapProcessCreateHandler(uint32 *trapArgs, int sysmode) {
-  char allargs[SIZE_ARG_BUFF];  // Stores full string of arguments (unparsed)
-  char name[PROCESS_MAX_NAME_LENGTH]; // Local copy of name of executable (100 chars or less)
+static void TrapGetProcessArgs(uint32 *trapArgs, int sysmode, char *name, char *allargs) {
   char *username=NULL;          // Pointer to user-space address of exec_name string
   int i=0, j=0;                 // Loop index variables
   char *args[MAX_ARGS];         // All parsed arguments (char *'s)
@@ -174,11 +203,65 @@ static void TrapProcessCreateHandler(uint32 *trapArgs, int sysmode) {
     }
     numargs = i+1;
   }
+}
 
-  ProcessFork(0, (uint32)allargs, name, 1);
+//--------------------------------------------------------------------
+//
+// int process_create(char *exec_name, ...);
+// int spawn(char *exec_name, ...);
+//
+// Start exec_name in a new process built straight from the file; the
+// caller's memory isn't copied.  spawn returns the new pid, or -1.
+//
+//--------------------------------------------------------------------
+static int TrapProcessCreateHandler(uint32 *trapArgs, int sysmode) {
+  char allargs[SIZE_ARG_BUFF];  // Stores full string of arguments (unparsed)
+  char name[PROCESS_MAX_NAME_LENGTH]; // Local copy of name of executable (100 chars or less)
+
+  TrapGetProcessArgs(trapArgs, sysmode, name, allargs);
+  return ProcessFork(0, (uint32)allargs, name, 1);
+}
+
+//--------------------------------------------------------------------
+//
+// int exec(char *exec_name, ...);
+//
+// Replace the calling process's image with exec_name (see
+// ProcessExec).  Only returns, with -1, if that fails.
+//
+//--------------------------------------------------------------------
+static int TrapProcessExecHandler(uint32 *trapArgs, int sysmode) {
+  char allargs[SIZE_ARG_BUFF];  // Stores full string of arguments (unparsed)
+  char name[PROCESS_MAX_NAME_LENGTH]; // Local copy of name of executable (100 chars or less)
+
+  TrapGetProcessArgs(trapArgs, sysmode, name, allargs);
+  return ProcessExec(currentPCB, name, allargs);
 }
 
 
+//----------------------------------------------------------------------
+//
+//	TrapProcessMemStatsHandler
+//
+//	Handle a process_memstats trap: copy the calling process's
+//	MemStats to the mem_stats_t its argument points to.  Returns
+//	MEM_SUCCESS, or MEM_FAIL if that address isn't mapped.
+//
+//----------------------------------------------------------------------
+static int TrapProcessMemStatsHandler(uint32 *trapArgs, int sysMode) {
+  MemStats stats;
+  char *userstats = (char *)GetUintFromTrapArg(trapArgs, sysMode);
+
+  MemoryGetStats(currentPCB, &stats);
+  if (sysMode) {
+    bcopy((char *)&stats, userstats, sizeof(stats));
+  } else if (MemoryCopySystemToUser(currentPCB, (unsigned char *)&stats, (unsigned char *)userstats, sizeof(stats)) != sizeof(stats)) {
+    return MEM_FAIL;
+  }
+  return MEM_SUCCESS;
+}
+
+
 //----------------------------------------------------------------------
 //
 //	TrapPrintfHandler
@@ -217,6 +300,12 @@ static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
     dstrncpy(formatstr, (char *)(trapArgs+0), PRINTF_MAX_FORMAT_LENGTH);
   }
 
+  // Nothing to format: hand the string to the console as it is.
+  if (dindex(formatstr, '%') == NULL) {
+    conswrite(formatstr, dstrlen(formatstr));
+    return;
+  }
+
   // Now read format string to find all the %'s
   numargs = 0;
   string_argnum = 0;
@@ -427,12 +516,28 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       ProcessSetResult (currentPCB, -1);
       RestoreIntrs (intrs);
       break;
+    case TRAP_THREAD_CREATE:
+      dbprintf ('t', "Got a thread create trap!\n");
+      ProcessSetResult(currentPCB,
+                       ProcessThreadCreate(currentPCB,
+                                           GetUintFromTrapArg(trapArgs+0, isr & DLX_STATUS_SYSMODE),
+                                           GetUintFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE)));
+      break;
     case TRAP_PROCESS_GETPID:
       ProcessSetResult(currentPCB, GetCurrentPid()); 
       break;
     case TRAP_PROCESS_CREATE:
       TrapProcessCreateHandler(trapArgs, isr & DLX_STATUS_SYSMODE);
       break;
+    case TRAP_PROCESS_SPAWN:
+      ProcessSetResult(currentPCB, TrapProcessCreateHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_PROCESS_EXEC:
+      dbprintf ('t', "Got an exec trap!\n");
+      if (TrapProcessExecHandler(trapArgs, isr & DLX_STATUS_SYSMODE) < 0) {
+        ProcessSetResult(currentPCB, -1);
+      }
+      break;
     case TRAP_SEM_CREATE:
       ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
       ihandle = SemCreate(ihandle);
@@ -458,6 +563,10 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       ihandle = mfree(currentPCB, (void*)ihandle);
       ProcessSetResult(currentPCB, ihandle); //Return handle
       break;
+    case TRAP_PERF_READ:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, PerfCounterRead(ihandle));
+      break;
     case TRAP_LOCK_CREATE:
       ihandle = LockCreate();
       ProcessSetResult(currentPCB, ihandle); //Return handle
@@ -472,6 +581,24 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       handle = LockHandleRelease(ihandle);
       ProcessSetResult(currentPCB, handle); //Return 1 or 0
       break;
+    case TRAP_FUTEX_WAIT:
+      ProcessSetResult(currentPCB,
+                       FutexWait(GetUintFromTrapArg(trapArgs+0, isr & DLX_STATUS_SYSMODE),
+                                 GetIntFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE)));
+      break;
+    case TRAP_FUTEX_WAKE:
+      ProcessSetResult(currentPCB,
+                       FutexWake(GetUintFromTrapArg(trapArgs+0, isr & DLX_STATUS_SYSMODE),
+                                 GetIntFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE)));
+      break;
+    case TRAP_PROCESS_MEMSTATS:
+      ProcessSetResult(currentPCB, TrapProcessMemStatsHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
+      break;
+    case TRAP_MEMORY_ALLOC_COST:
+      ProcessSetResult(currentPCB,
+                       MemoryAllocCost(GetIntFromTrapArg(trapArgs+0, isr & DLX_STATUS_SYSMODE),
+                                       GetIntFromTrapArg(trapArgs+1, isr & DLX_STATUS_SYSMODE)));
+      break;
     case TRAP_COND_CREATE:
       ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
       ihandle = CondCreate(ihandle);
@@ -536,6 +663,12 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
     case TRAP_ROP_ACCESS:
       MemoryRopHandler(currentPCB);
       break;
+    case TRAP_FPU:
+      ProcessFpEnable(currentPCB);
+      break;
+    case TRAP_DISK:
+      DiskInterrupt();
+      break;
     default:
       printf ("Got an unrecognized system interrupt (0x%x) - exiting!\n",
 	      cause);
@@ -0,0 +1,73 @@
+//
+//	ulock.c
+//
+//	User space locks (see ulock.h).  The lock word goes from
+//	ULOCK_FREE to ULOCK_HELD on an uncontended acquire.  A process
+//	that has to sleep first makes it ULOCK_WAITERS, so that whoever
+//	releases it knows to call futex_wake; a woken process takes the
+//	lock as ULOCK_WAITERS too, since it can't tell whether others
+//	still sleep.  That costs at most one needless futex_wake.
+//
+//	This is linked into user programs, not the operating system.
+//
+
+#include "usertraps.h"
+#include "ulock.h"
+
+//----------------------------------------------------------------------
+//	UlockCas
+//
+//	Sets *addr to new if it holds old, atomically, with load linked
+//	and store conditional.  Returns what *addr held, so the swap
+//	happened if that's old.
+//----------------------------------------------------------------------
+static int UlockCas(int *addr, int old, int new) {
+  int cur;
+
+  do {
+    if ((cur = load_linked(addr)) != old) return cur;
+  } while (!store_conditional(addr, new));
+  return old;
+}
+
+void ulock_init(ulock_t *l) {
+  l->state = ULOCK_FREE;
+}
+
+int ulock_tryacquire(ulock_t *l) {
+  return (UlockCas(&l->state, ULOCK_FREE, ULOCK_HELD) == ULOCK_FREE);
+}
+
+//----------------------------------------------------------------------
+//	ulock_acquire
+//
+//	Takes the lock, spinning for a while and then sleeping in the
+//	kernel if it's held.
+//----------------------------------------------------------------------
+void ulock_acquire(ulock_t *l) {
+  int c, i;
+
+  // Fast path: a free lock costs one ll/sc pair and no trap
+  if ((c = UlockCas(&l->state, ULOCK_FREE, ULOCK_HELD)) == ULOCK_FREE) return;
+
+  // Spin in case the holder is about to let go
+  for (i = 0; (i < ULOCK_SPIN) && (c != ULOCK_WAITERS); i++) {
+    if (l->state == ULOCK_FREE) {
+      if ((c = UlockCas(&l->state, ULOCK_FREE, ULOCK_HELD)) == ULOCK_FREE) return;
+    }
+  }
+
+  // Sleep until the word goes back to ULOCK_FREE.  futex_wait returns
+  // at once if the word changed under us, so there's no lost wakeup.
+  if (c != ULOCK_WAITERS) c = atomic_swap(&l->state, ULOCK_WAITERS);
+  while (c != ULOCK_FREE) {
+    futex_wait(&l->state, ULOCK_WAITERS);
+    c = atomic_swap(&l->state, ULOCK_WAITERS);
+  }
+}
+
+void ulock_release(ulock_t *l) {
+  if (atomic_swap(&l->state, ULOCK_FREE) == ULOCK_WAITERS) {
+    futex_wake(&l->state, 1);
+  }
+}
@@ -268,9 +268,155 @@ _mfree:
 .endproc _mfree
 
 
+.proc _perf_read
+.global _perf_read
+_perf_read:
+        trap    #0x469
+        jr      r31
+        nop
+.endproc _perf_read
+
+.proc _futex_wait
+.global _futex_wait
+_futex_wait:
+        trap    #0x46a
+        jr      r31
+        nop
+.endproc _futex_wait
+
+.proc _futex_wake
+.global _futex_wake
+_futex_wake:
+        trap    #0x46b
+        jr      r31
+        nop
+.endproc _futex_wake
+
+.proc _process_memstats
+.global _process_memstats
+_process_memstats:
+        trap    #0x46c
+        jr      r31
+        nop
+.endproc _process_memstats
+
+.proc _memory_alloc_cost
+.global _memory_alloc_cost
+_memory_alloc_cost:
+        trap    #0x46d
+        jr      r31
+        nop
+.endproc _memory_alloc_cost
+
+
 .proc _fork
 .global _fork
 _fork:
 		trap	#0x430
 		jr		r31
 .endproc _fork
+
+.proc _thread_create
+.global _thread_create
+_thread_create:
+	trap	#0x433
+	jr	r31
+	nop
+.endproc _thread_create
+
+.proc _spawn
+.global _spawn
+_spawn:
+	trap	#0x434
+	jr	r31
+	nop
+.endproc _spawn
+
+.proc _exec
+.global _exec
+_exec:
+	trap	#0x435
+	jr	r31
+	nop
+.endproc _exec
+
+;;; Atomic memory operations.  These aren't traps: they use the
+;;; simulator's swap (0x1e), tas (0x1f), ll (0x22) and sc (0x2a)
+;;; instructions, which the assembler doesn't know, so each one is
+;;; hand-encoded as "op r1,0(r2)".  r2 is saved as in _SetIntrs.
+;;;
+;;; int atomic_swap(int *addr, int val);	returns the old value
+;;; int test_and_set(int *addr);		returns the old value
+;;; int load_linked(int *addr);
+;;; int store_conditional(int *addr, int val);	returns 1 on success
+.proc _atomic_swap
+.global _atomic_swap
+_atomic_swap:
+	subui	r29,r29,#8
+	sw	4(r29),r2
+	lw	r2,8(r29)
+	lw	r1,12(r29)
+	.word	0x78410000	; swap r1,0(r2)
+	lw	r2,4(r29)
+	addui	r29,r29,#8
+	jr	r31
+	nop
+.endproc _atomic_swap
+
+.proc _test_and_set
+.global _test_and_set
+_test_and_set:
+	subui	r29,r29,#8
+	sw	4(r29),r2
+	lw	r2,8(r29)
+	.word	0x7c410000	; tas r1,0(r2)
+	lw	r2,4(r29)
+	addui	r29,r29,#8
+	jr	r31
+	nop
+.endproc _test_and_set
+
+.proc _load_linked
+.global _load_linked
+_load_linked:
+	subui	r29,r29,#8
+	sw	4(r29),r2
+	lw	r2,8(r29)
+	.word	0x88410000	; ll r1,0(r2)
+	lw	r2,4(r29)
+	addui	r29,r29,#8
+	jr	r31
+	nop
+.endproc _load_linked
+
+.proc _store_conditional
+.global _store_conditional
+_store_conditional:
+	subui	r29,r29,#8
+	sw	4(r29),r2
+	lw	r2,8(r29)
+	lw	r1,12(r29)
+	.word	0xa8410000	; sc r1,0(r2)
+	lw	r2,4(r29)
+	addui	r29,r29,#8
+	jr	r31
+	nop
+.endproc _store_conditional
+
+;;; Host-speed memmove/memset on physical memory (simulator service).
+;;; Returns dst, or -1 if it can't be used (see misc.c).
+.proc _memmove
+.global _memmove
+_memmove:
+	trap	#0x2044
+	jr	r31
+	nop
+.endproc _memmove
+
+.proc _memset
+.global _memset
+_memset:
+	trap	#0x2045
+	jr	r31
+	nop
+.endproc _memset
@@ -0,0 +1,118 @@
+#include "usertraps.h"
+#include "misc.h"
+#include "umalloc.h"
+
+#define BENCH_MAX_BLOCKS 64      // Most blocks held at once
+#define BENCH_FRAG_SIZE 32       // Size the fragmentation test fills with
+
+typedef struct allocator {
+  char *name;
+  void *(*alloc)(int bytes);
+  int (*free)(void *ptr);
+} allocator;
+
+static void *blocks[BENCH_MAX_BLOCKS];
+
+// Take up to max blocks of size bytes, returning how many a gave
+static int fill(allocator *a, int size, int max)
+{
+  int n;
+
+  for(n=0; n<max; n++) {
+    if ((blocks[n] = a->alloc(size)) == NULL) break;
+  }
+  return n;
+}
+
+// Free blocks first, first + step, ... below n
+static void release(allocator *a, int first, int step, int n)
+{
+  int i;
+
+  for(i=first; i<n; i+=step) {
+    a->free(blocks[i]);
+    blocks[i] = NULL;
+  }
+}
+
+// Allocation and freeing at each size, rounds times over
+static void bench_sizes(allocator *a, int rounds)
+{
+  static int sizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+  unsigned int start, alloc_instrs, free_instrs;
+  int i, j, n, total;
+
+  Printf("%s by size (%d rounds):\n", a->name, rounds);
+  for(i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+    alloc_instrs = free_instrs = 0;
+    total = 0;
+    for(j=0; j<rounds; j++) {
+      start = perf_read(PERF_INSTRS);
+      n = fill(a, sizes[i], BENCH_MAX_BLOCKS);
+      alloc_instrs += perf_read(PERF_INSTRS) - start;
+      start = perf_read(PERF_INSTRS);
+      release(a, 0, 1, n);
+      free_instrs += perf_read(PERF_INSTRS) - start;
+      total += n;
+    }
+    if (total == 0) {
+      Printf("  %d bytes: no blocks\n", sizes[i]);
+      continue;
+    }
+    Printf("  %d bytes: %d blocks, %d instructions per alloc, %d per free\n",
+           sizes[i], total / rounds, alloc_instrs / total, free_instrs / total);
+  }
+}
+
+// Allocation from a heap where every other small block is free
+static void bench_fragmented(allocator *a)
+{
+  static int sizes[] = { BENCH_FRAG_SIZE, 2 * BENCH_FRAG_SIZE, 8 * BENCH_FRAG_SIZE };
+  unsigned int start;
+  void *got[BENCH_MAX_BLOCKS / 2];
+  int i, j, n, holes, tries;
+
+  Printf("%s fragmented (every other %d-byte block free):\n", a->name, BENCH_FRAG_SIZE);
+  for(i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) {
+    n = fill(a, BENCH_FRAG_SIZE, BENCH_MAX_BLOCKS);
+    release(a, 0, 2, n);
+    holes = (n + 1) / 2;
+    start = perf_read(PERF_INSTRS);
+    for(j=0; j<holes; j++) {
+      if ((got[j] = a->alloc(sizes[i])) == NULL) break;
+    }
+    start = perf_read(PERF_INSTRS) - start;
+    tries = (j < holes) ? j + 1 : j;   // The one that failed counts too
+    Printf("  %d bytes: %d of %d found, %d instructions per alloc\n", sizes[i], j, holes,
+           start / ((tries > 0) ? tries : 1));
+    while (j-- > 0) {
+      a->free(got[j]);
+    }
+    release(a, 1, 2, n);
+  }
+}
+
+void main (int argc, char *argv[])
+{
+  static allocator allocators[] = {
+    { "malloc/mfree", malloc, mfree },
+    { "umalloc/ufree", umalloc, ufree },
+  };
+  int rounds = 10;
+  int i;
+
+  if (argc > 2) {
+    Printf("Usage: %s [rounds]\n", argv[0]);
+    Exit();
+  }
+  if (argc == 2) {
+    rounds = dstrtol(argv[1], NULL, 10);
+  }
+  if (rounds <= 0) rounds = 1;
+
+  for(i=0; i<sizeof(allocators)/sizeof(allocators[0]); i++) {
+    bench_sizes(&allocators[i], rounds);
+    bench_fragmented(&allocators[i]);
+  }
+  Printf("heap_bench (%d): Done!\n", getpid());
+}
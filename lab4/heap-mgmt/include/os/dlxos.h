@@ -36,7 +36,9 @@ extern char  debugstr[];
 
 extern int  CurrentIntrs ();
 extern int  SetIntrs (int);
+extern int  FindFirstSet (uint32);
 extern void  KbdModuleInit ();
+extern uint32  PerfCounterRead (int ctr);
 extern void  intrreturn ();
 
 inline int
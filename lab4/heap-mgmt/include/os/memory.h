@@ -29,8 +29,8 @@ void* malloc(PCB* pcb, int memsize);
 int mfree(PCB* pcb, void* ptr);
 void MemoryEditFreemap(int page, int val);
 void MemoryFreePageTableEntry(uint32 pte);
-void MemoryCoalescing(Node * node);
-int MemorySplitNode(Node * node, PCB* pcb, int memsize);
-int MemoryNodeSearch(Node * node, int memsize);
+void MemoryHeapInit(PCB *pcb);
+int MemorySbrk(PCB *pcb, int increment);
+void MemoryBrkFree(PCB *pcb);
 
 #endif	// _memory_h_
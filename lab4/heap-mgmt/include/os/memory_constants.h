@@ -42,21 +42,51 @@
 #define MEM_MASK_PTE2PAGE (~(MEM_PTE_READONLY | MEM_PTE_DIRTY | MEM_PTE_VALID))
 #define MEM_NUM_PAGES (MEM_MAX_SIZE / MEM_PAGESIZE)
 #define MEM_ADDR_OFFS_MASK (MEM_PAGESIZE - 1)
-#define MEM_NUM_NODES 255
+// The heap is the page after the 4 code and data pages
+#define MEM_HEAP_BASE (4 * MEM_PAGESIZE)
+// sbrk grows a region of whole pages up from the page after the heap,
+// no further than MEM_BRK_LIMIT (the user stack grows down to it)
+#define MEM_BRK_BASE (MEM_HEAP_BASE + MEM_PAGESIZE)
+#define MEM_BRK_LIMIT ((MEM_MAX_VIRTUAL_ADDRESS + 1) / 2)
+#define MEM_ROUNDUP2PAGE(address) (((address) + MEM_PAGESIZE - 1) & ~MEM_ADDR_OFFS_MASK)
 
 // Conversions
 #define MEM_ADDR2PAGE(address) ((address) >> MEM_L1FIELD_FIRST_BITNUM)
 #define MEM_ADDR2OFFS(address) ((address) & MEM_ADDR_OFFS_MASK)
 
-typedef struct Node {
-	struct Node *parent;
-	struct Node *left;
-	struct Node *right;
-	int size;
-	int index;
+// The buddy heap.  A block of order k is 1 << (MEM_HEAP_MIN_SHIFT + k)
+// bytes, so the heap page is one block of order MEM_HEAP_ORDERS - 1.
+// Each MEM_HEAP_MIN_SHIFT unit of the heap has a HeapBlock, used when
+// a block starts there; a block's buddy is at its offset ^ its size.
+#define MEM_HEAP_MIN_SHIFT 5
+#define MEM_HEAP_ORDERS 8
+#define MEM_HEAP_UNITS (MEM_PAGESIZE >> MEM_HEAP_MIN_SHIFT)
+
+typedef struct HeapBlock {
+	int order;	// Order of the block starting here, or -1
 	int inuse;
-	int order;
-	int address;
-} Node;
+	int prev;	// Neighbours on the order's free list (units), or -1
+	int next;
+} HeapBlock;
+
+// Size-class slabs.  malloc rounds requests up to MEM_SLAB_MAX_BYTES
+// to a power of two no smaller than 1 << MEM_SLAB_MIN_SHIFT and takes
+// them from slabs: buddy blocks of MEM_SLAB_BYTES (or of two objects,
+// if that's more) cut into objects of one size.  Slab descriptor k
+// covers heap bytes k * MEM_SLAB_BYTES on.
+#define MEM_SLAB_MIN_SHIFT 4
+#define MEM_SLAB_CLASSES 6
+#define MEM_SLAB_MAX_BYTES (1 << (MEM_SLAB_MIN_SHIFT + MEM_SLAB_CLASSES - 1))
+#define MEM_SLAB_BYTES 512
+#define MEM_HEAP_SLABS (MEM_PAGESIZE / MEM_SLAB_BYTES)
+
+typedef struct Slab {
+	int head;	// Descriptor of the slab holding these bytes, or -1
+	// The rest is only used in a slab's first descriptor
+	int class;	// Objects are 1 << (MEM_SLAB_MIN_SHIFT + class) bytes
+	int prev;	// Neighbours on the class's list of slabs with
+	int next;	//   free objects, or -1
+	uint32 freemask;	// Bit i set: object i is free
+} Slab;
 
 #endif	// _memory_constants_h_
@@ -32,17 +32,34 @@
 
 typedef	void (*VoidFunc)();
 
-// Process control block
+// A process's name and address space
+typedef struct ProcessMem {
+  char		name[80];	// Process name
+  uint32	pagetable[MEM_L1PAGETABLE_SIZE]; // Statically allocated page table
+  int		npages;		// Number of pages allocated to this process
+} ProcessMem;
+
+// A process's heap (see malloc and sbrk)
+typedef struct ProcessHeap {
+  HeapBlock heapblocks[MEM_HEAP_UNITS];	// Buddy heap (see malloc)
+  int heapfree[MEM_HEAP_ORDERS];	// Per order: a free block's unit, or -1
+  Slab slabs[MEM_HEAP_SLABS];	// Small objects (see malloc)
+  int slabfree[MEM_SLAB_CLASSES];	// Per class: a slab with free objects, or -1
+  uint32 brk;			// End of the sbrk region
+} ProcessHeap;
+
+// Process control block.  Only what switching and the queues use is
+// here, so the pcbs array stays a few cache lines; the rest is in the
+// mem and heap descriptors, which sit in arrays of their own and are
+// only touched by the calls that need them.
 typedef struct PCB {
   uint32	*currentSavedFrame; // -> current saved frame.  MUST BE 1ST!
   uint32	*sysStackPtr;	// Current system stack pointer.  MUST BE 2ND!
   uint32	sysStackArea;	// System stack area for this process
   unsigned int	flags;
-  char		name[80];	// Process name
-  uint32	pagetable[MEM_L1PAGETABLE_SIZE]; // Statically allocated page table
-  int		npages;		// Number of pages allocated to this process
   Link		*l;		// Used for keeping PCB in queues
-  Node heap_array[MEM_NUM_NODES + 1];
+  ProcessMem	*mem;		// Name, page table and page count
+  ProcessHeap	*heap;		// Heap allocator state
 } PCB;
 
 extern PCB	*currentPCB;
@@ -69,6 +86,21 @@ extern PCB	*currentPCB;
 #define MAX_ARGS	10		// Max number of command-line
 					// arguments
 
+// Binary executable images.  This matches dlximage.h in the simulator
+// source: a header of PROCESS_IMAGE_HEADER_WORDS big-endian words
+// followed by segments of (load address, length, bytes).
+#define PROCESS_IMAGE_MAGIC		0x444c5849	// "DLXI"
+#define PROCESS_IMAGE_VERSION		1
+#define PROCESS_IMAGE_HEADER_WORDS	9
+#define PROCESS_IMAGE_SEGHDR_WORDS	2
+#define PROCESS_IMAGE_MAGIC_WORD	0
+#define PROCESS_IMAGE_VERSION_WORD	1
+#define PROCESS_IMAGE_START_WORD	2
+#define PROCESS_IMAGE_CODESTART_WORD	4
+#define PROCESS_IMAGE_CODESIZE_WORD	5
+#define PROCESS_IMAGE_DATASTART_WORD	6
+#define PROCESS_IMAGE_DATASIZE_WORD	7
+
 // Number of jiffies in a single process quantum (i.e. how often ProcessSchedule is called)
 #define PROCESS_QUANTUM_JIFFIES  CLOCK_PROCESS_JIFFIES
 // Number of jiffies that have to pass before decaying all estcpu's
@@ -83,6 +83,8 @@
 #define TRAP_YIELD              0x466
 #define TRAP_MALLOC             0x467
 #define TRAP_MFREE              0x468
+#define TRAP_SBRK               0x469
+#define TRAP_PERF_READ          0x46a
 
 #define TRAP_USER_EXIT          0x500
 
@@ -94,6 +96,24 @@
 #define	DLX_KBD_NCHARSIN	0xfff001a0
 #define	DLX_KBD_INTR		0xfff001c0
 
+// Performance counters: counter n is a 64-bit value at
+// DLX_PERF_BASE + 8*n (low word first).  Writing the low word sets it.
+#define	DLX_PERF_BASE		0xffff1000
+#define	DLX_PERF_INSTRS		0	// instructions retired
+#define	DLX_PERF_USER_INSTRS	1	// ... in user mode
+#define	DLX_PERF_SYS_INSTRS	2	// ... in system mode
+#define	DLX_PERF_LOADS		3
+#define	DLX_PERF_STORES		4
+#define	DLX_PERF_PT_WALKS	5	// page table walks (TLB misses)
+#define	DLX_PERF_TLB_HITS	6
+#define	DLX_PERF_PAGE_FAULTS	7
+#define	DLX_PERF_EXCEPTIONS	8	// all exceptions, traps included
+#define	DLX_PERF_TRAPS		9
+#define	DLX_PERF_TIMER_INTRS	10
+#define	DLX_PERF_KBD_INTRS	11
+#define	DLX_PERF_CAUSE_BASE	16	// + cause, for causes below 0x80
+#define	DLX_PERF_NUM		(DLX_PERF_CAUSE_BASE + 0x80)
+
 #define	TRAP_STACK_SIZE		0x800	// interrupt stack is 2K words
 
 #endif	/* _dlxtraps_h_ */
@@ -0,0 +1,26 @@
+#ifndef __umalloc_h__
+#define __umalloc_h__
+
+//---------------------------------------------------------------------
+// A user-space allocator on top of sbrk().  Blocks are carved out of
+// the sbrk region without entering the kernel; umalloc only traps to
+// grow the region, UMALLOC_GROW_BYTES or more at a time.  Unlike the
+// kernel's malloc/mfree traps it isn't limited to the one heap page.
+// To use it, add
+//	LIBS+= umalloc.o
+// to the application's Makefile.
+//
+// Every block starts with a header holding its size.  Free blocks
+// are kept on one list in address order, so ufree merges a block with
+// both neighbours as it puts it back; umalloc takes the first block
+// that's big enough and splits off the rest.
+//---------------------------------------------------------------------
+
+#define UMALLOC_ALIGN		8		// Bytes; also the header size
+#define UMALLOC_GROW_BYTES	(1 << 12)	// One page
+#define UMALLOC_FAIL		-1
+
+void *umalloc(int bytes);	// NULL if bytes <= 0 or sbrk() fails
+int ufree(void *ptr);		// Bytes freed, or UMALLOC_FAIL
+
+#endif
@@ -66,6 +66,20 @@ void yield();                           //trap 0x466
 //Related to heap management
 void *malloc(int memsize);              //trap 0x467
 int mfree(void *ptr);                   //trap 0x468
+void *sbrk(int increment);              //trap 0x469
+
+//Related to performance counters (low 32 bits; see DLX_PERF_* in traps.h)
+unsigned int perf_read(int counter);    //trap 0x46a
+#define PERF_INSTRS       0
+#define PERF_USER_INSTRS  1
+#define PERF_SYS_INSTRS   2
+#define PERF_LOADS        3
+#define PERF_STORES       4
+#define PERF_PT_WALKS     5
+#define PERF_TLB_HITS     6
+#define PERF_PAGE_FAULTS  7
+#define PERF_EXCEPTIONS   8
+#define PERF_TRAPS        9
 
 
 #ifndef NULL
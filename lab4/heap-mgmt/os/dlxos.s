@@ -321,6 +321,20 @@ _CurrentIntrs:
 	nop
 .endproc _CurrentIntrs
 ;;;----------------------------------------------------------------------
+;;; _FindFirstSet
+;;;
+;;; Return the index of the lowest set bit in the argument, or 32 if
+;;; none is, using the simulator's ffs instruction (R-R function 0x38).
+;;;----------------------------------------------------------------------
+.proc _FindFirstSet
+.global _FindFirstSet
+_FindFirstSet:
+	lw	r1,0(r29)
+	.word	0x00200838	; ffs r1,r1
+	jr	r31
+	nop
+.endproc _FindFirstSet
+;;;----------------------------------------------------------------------
 ;;; _ProcessSleep
 ;;;
 ;;; If a context switch from elsewhere in the kernel is desired, take a
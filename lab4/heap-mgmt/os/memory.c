@@ -12,6 +12,15 @@
 // num_pages = size_of_memory / size_of_one_page
 static int freemapmax;
 static uint32 freemap[16];
+// Bit i set: freemap[i] has a free page.  One word covers the 16
+// freemap words, so finding a free page takes two FindFirstSets.
+static uint32 freesummary;
+#if MEM_NUM_PAGES > 32 * 32
+#error "freesummary needs a bit for each freemap word"
+#endif
+// Next fit: the freemap word the last page came from, where the next
+// search starts
+static int freehint;
 static uint32 pagestart;
 static int nfreepages;
 
@@ -70,6 +79,8 @@ void MemoryModuleInit() {
   for(i = 0; i < freemapmax; i++) {
     freemap[i] = 0;
   }
+  freesummary = 0;
+  freehint = 0;
 
   // Go from the page start to the maxpage
   for(i = pagestart; i < maxpage; i++) {
@@ -85,6 +96,12 @@ void MemoryEditFreemap(int page, int val) {
   uint32 bit_position = page % 32;
   // set the val
   freemap[index] = (freemap[index] & invert(1 << bit_position)) | (val << bit_position);
+  // keep the summary bit for this word in step
+  if (freemap[index] != 0) {
+    freesummary |= 1 << index;
+  } else {
+    freesummary &= invert(1 << index);
+  }
 }
 
 
@@ -102,8 +119,8 @@ uint32 MemoryTranslateUserToSystem (PCB *pcb, uint32 addr) {
   uint32 offset = MEM_ADDR2OFFS(addr);
 
   // Checks validity before returning
-  if (pcb->pagetable[page] & MEM_PTE_VALID) {
-    return ((pcb->pagetable[page] & MEM_MASK_PTE2PAGE) | offset);
+  if (pcb->mem->pagetable[page] & MEM_PTE_VALID) {
+    return ((pcb->mem->pagetable[page] & MEM_MASK_PTE2PAGE) | offset);
   }
   return MEM_FAIL;
 }
@@ -233,10 +250,10 @@ int MemoryPageFaultHandler(PCB *pcb) {
       ProcessKill();
     }
     // Use the setup pte function
-    pcb->pagetable[pg_fault_addr] = MemorySetupPte(genPage);
+    pcb->mem->pagetable[pg_fault_addr] = MemorySetupPte(genPage);
     // Used to show a debug message that a new page has been allocated from the memorypagefault handler for part5
     dbprintf('z', "MemoryPageFaultHandler PID (%d): allocating new page (%d)\n", GetPidFromAddress(pcb), genPage);
-    pcb->npages += 1;
+    pcb->mem->npages += 1;
     return MEM_SUCCESS;
   }
 }
@@ -252,6 +269,7 @@ int MemoryAllocPage(void) {
   int index = 0;
   uint32 bit_position;
   uint32 fm_segment;
+  uint32 words;
 
   dbprintf('m', "MemoryAllocPage: function started\n");
   // If there are no freepages available return a memfail
@@ -260,19 +278,20 @@ int MemoryAllocPage(void) {
     return MEM_FAIL;
   }
 
-  // loop through the freemaps until you find one with available slots
-  while(freemap[index] == 0) {
-    index += 1;
-    if(index >= freemapmax) {
-      index = 0;
-    }
+  // pick the first word with a free page at or after the hint,
+  // wrapping around to the start if there's none
+  words = freesummary & invert((1 << freehint) - 1);
+  if (words == 0) {
+    words = freesummary;
+  }
+  index = FindFirstSet(words);
+  freehint = index;
+  bit_position = FindFirstSet(freemap[index]);
+  // mark it in use, and the word full if that was its last page
+  freemap[index] &= invert(1 << bit_position);
+  if (freemap[index] == 0) {
+    freesummary &= invert(1 << index);
   }
-  // grab the freemap segment (32 bits of freemap)
-  fm_segment = freemap[index];
-  // loop to find the first available position in that segment
-  for(bit_position = 0; (fm_segment & (1 << bit_position)) == 0; bit_position++){ }
-  // set the specific value in that segment
-  freemap[index]  &= invert(1 << bit_position);
   // grab the page number
   fm_segment = (index * 32) + bit_position; 
   dbprintf('m', "MemoryAllocPage: allocated memory from map=%d, page=%d\n", index, fm_segment);
@@ -298,175 +317,404 @@ void MemoryFreePage(uint32 page) {
   //dbprintf ('m',"Freeing page 0x%x, %d remaining.\n", page, nfreepages);
 }
 
-void* malloc(PCB* pcb, int memsize) {
-  int block, size, virtual_address, physical_address;
+//----------------------------------------------------------------------
+//
+//	MemoryBuddyLink, MemoryBuddyUnlink
+//
+//	Make the block at unit u a free block of the given order at the
+//	head of that order's free list (take it off its list).
+//
+//----------------------------------------------------------------------
+static void MemoryBuddyLink(PCB *pcb, int u, int order) {
+  HeapBlock *block = &(pcb->heap->heapblocks[u]);
+
+  block->order = order;
+  block->inuse = 0;
+  block->prev = -1;
+  block->next = pcb->heap->heapfree[order];
+  if (block->next >= 0) {
+    pcb->heap->heapblocks[block->next].prev = u;
+  }
+  pcb->heap->heapfree[order] = u;
+}
 
-  dbprintf('m', "malloc: function started\n");
+static void MemoryBuddyUnlink(PCB *pcb, int u) {
+  HeapBlock *block = &(pcb->heap->heapblocks[u]);
 
-  if ((memsize <= 0) || (memsize > MEM_PAGESIZE)) {
-    return NULL;
+  if (block->prev >= 0) {
+    pcb->heap->heapblocks[block->prev].next = block->next;
+  } else {
+    pcb->heap->heapfree[block->order] = block->next;
+  }
+  if (block->next >= 0) {
+    pcb->heap->heapblocks[block->next].prev = block->prev;
   }
-  // First try and find a suitable node
-  block = MemoryNodeSearch(&(pcb->heap_array[1]), memsize);
-  if (block >= 0) {
-    // We have a good node, send it home
-    size = pcb->heap_array[block].size;
-    virtual_address = ((MEM_PAGESIZE * 4) | block);
-    physical_address = MemoryTranslateUserToSystem(pcb, virtual_address);
-    printf("Created a heap block of size %d bytes: virtual address %d, physical address %d\n", size, virtual_address, physical_address);
-    return (void *) virtual_address;
-  }
-  // Second try and split to get a suitable node
-  block = MemorySplitNode(&(pcb->heap_array[1]), pcb, memsize);
-  if (block >= 0) {
-    // We have a good node, send it home
-    size = pcb->heap_array[block].size;
-    virtual_address = ((MEM_PAGESIZE * 4) | block);
-    physical_address = MemoryTranslateUserToSystem(pcb, virtual_address);
-    printf("Created a heap block of size %d bytes: virtual address %d, physical address %d\n", size, virtual_address, physical_address);
-    return (void *) virtual_address;
-  } 
-  return NULL;
 }
 
-int MemoryNodeSearch(Node * node, int memsize) {
-  int temp_node;
+//----------------------------------------------------------------------
+//
+//	MemoryBuddyOrder
+//
+//	The order of the smallest block that holds bytes bytes.
+//
+//----------------------------------------------------------------------
+static int MemoryBuddyOrder(int bytes) {
+  int order;
+
+  for (order = 0; (1 << (MEM_HEAP_MIN_SHIFT + order)) < bytes; order++) { }
+  return order;
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryBuddyAlloc
+//
+//	Take a block of the given order from the first non-empty free
+//	list at or above it, putting the halves split off on the way down
+//	on their lists.  Returns the block's heap offset, or -1.
+//
+//----------------------------------------------------------------------
+static int MemoryBuddyAlloc(PCB *pcb, int order) {
+  int o, u;
 
-  dbprintf('m', "MemoryNodeSearch: function started\n");
+  for (o = order; (o < MEM_HEAP_ORDERS) && (pcb->heap->heapfree[o] < 0); o++) { }
+  if (o == MEM_HEAP_ORDERS) {
+    return -1;
+  }
+  u = pcb->heap->heapfree[o];
+  MemoryBuddyUnlink(pcb, u);
+  while (o > order) {
+    o--;
+    MemoryBuddyLink(pcb, u + (1 << o), o);
+    dbprintf('h', "MemoryBuddyAlloc: split off block (order = %d, addr = %d)\n",
+	     o, (u + (1 << o)) << MEM_HEAP_MIN_SHIFT);
+  }
+  pcb->heap->heapblocks[u].order = order;
+  pcb->heap->heapblocks[u].inuse = 1;
+  dbprintf('h', "Allocated the block: order = %d, addr = %d, block size = %d\n",
+	   order, u << MEM_HEAP_MIN_SHIFT, 1 << (MEM_HEAP_MIN_SHIFT + order));
+  return u << MEM_HEAP_MIN_SHIFT;
+}
 
-  // Sanity check
-  if (node == NULL) return -1;
-  // Check which nodes are in use
-  if ((node->left == NULL) && (node->inuse == 0)) {
-    if ((memsize <= node->size) && (memsize > (node->size / 2))) {
-      // Hey we got a good one, send her home
-      node->inuse = 1;
-      printf("Allocated the block: order = %d, addr = %d, requested mem size = %d, block size = %d\n", node->order, node->address, memsize, node->size);
-      return node->address;
+//----------------------------------------------------------------------
+//
+//	MemoryBuddyFree
+//
+//	Free the allocated block at heap offset address, merging it with
+//	its buddy for as long as the buddy is a free block of the same
+//	order.
+//
+//----------------------------------------------------------------------
+static void MemoryBuddyFree(PCB *pcb, int address) {
+  int u = address >> MEM_HEAP_MIN_SHIFT;
+  int order = pcb->heap->heapblocks[u].order;
+  int buddy;
+
+  while (order < MEM_HEAP_ORDERS - 1) {
+    buddy = u ^ (1 << order);
+    if ((pcb->heap->heapblocks[buddy].order != order) || pcb->heap->heapblocks[buddy].inuse) {
+      break;
+    }
+    dbprintf('h', "Coalesced buddy blocks (order = %d) at addr %d & %d\n", order,
+	     u << MEM_HEAP_MIN_SHIFT, buddy << MEM_HEAP_MIN_SHIFT);
+    MemoryBuddyUnlink(pcb, buddy);
+    // Only the lower half starts a block now
+    if (buddy < u) {
+      pcb->heap->heapblocks[u].order = -1;
+      u = buddy;
     } else {
-      return -1;
+      pcb->heap->heapblocks[buddy].order = -1;
     }
+    order++;
   }
-  // Recurse to get through the tree
-  temp_node = MemoryNodeSearch(node->left, memsize);
-  if (temp_node >= 0) {
-    return temp_node;
-  } else {
-    return MemoryNodeSearch(node->right, memsize);
+  MemoryBuddyLink(pcb, u, order);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryHeapInit
+//
+//	Set up pcb's heap: one free buddy block covering the heap page,
+//	no slabs, and an empty sbrk region.
+//
+//----------------------------------------------------------------------
+void MemoryHeapInit(PCB *pcb) {
+  int i;
+
+  for (i = 0; i < MEM_HEAP_UNITS; i++) {
+    pcb->heap->heapblocks[i].order = -1;
+    pcb->heap->heapblocks[i].inuse = 0;
   }
+  for (i = 0; i < MEM_HEAP_ORDERS; i++) {
+    pcb->heap->heapfree[i] = -1;
+  }
+  MemoryBuddyLink(pcb, 0, MEM_HEAP_ORDERS - 1);
+
+  for (i = 0; i < MEM_HEAP_SLABS; i++) {
+    pcb->heap->slabs[i].head = -1;
+  }
+  for (i = 0; i < MEM_SLAB_CLASSES; i++) {
+    pcb->heap->slabfree[i] = -1;
+  }
+  pcb->heap->brk = MEM_BRK_BASE;
 }
 
-int MemorySplitNode(Node * node, PCB* pcb, int memsize) {
-  int temp_node;
-  Node * left, right;
-
-  dbprintf('m', "MemorySplitNode: function started\n");
-
-  // Check for a valid node
-  if (node == NULL) return -1;
-  // Make sure it's not in use 
-  if ((node->left == NULL) && (node->inuse == 0)) {
-    // Check node size
-    if ((memsize <= node->size) && (memsize > (node->size / 2))) {
-      // We got a good node, send it home
-      node->inuse = 1;    
-      printf("Allocated the block: order = %d, address = %d, requested mem size = %d, block size = %d\n", node->order, node->address, memsize, node->size);
-      return node->address;
-    } 
-    if ((node->size / 2) < memsize) {
-      return -1;
-    } else {
-      if (node->order == 0) {
-        return -1;
-      } else {
-        // Create left child
-        left = &(pcb->heap_array[2*node->index]);
-        left->parent = node;
-        left->left = NULL;
-        left->right = NULL;           
-        left->size = node->size / 2;
-        left->order = node->order - 1;
-        left->address = node->address;  
-        printf("Created a left child node (order = %d, address = %d, size = %d) of parent (order = %d, address = %d, size = %d)\n", left->order, left->address, left->size, node->order, node->address, node->size);
-        // Create right child
-        right = &(pcb->heap_array[2*node->index+1]);
-        right->parent = node;
-        right->left = NULL;
-        right->right = NULL;
-        right->size = node->size / 2;
-        right->order = node->order - 1;
-        right->address = node->address + right->size; 
-        printf("Created a right child node (order = %d, address = %d, size = %d) of parent (order = %d, address = %d, size = %d)\n", right->order, right->address, right->size, node->order, node->address, node->size);
-        // Set the nodes
-        node->left = left;
-        node->right = right;
+//----------------------------------------------------------------------
+//
+//	MemorySbrk
+//
+//	Move the end of pcb's sbrk region by increment bytes, mapping the
+//	pages it grows onto and freeing the ones it leaves.  Returns the
+//	old end, or MEM_FAIL (with nothing changed) if the new end would
+//	be outside the region or there aren't enough free pages.
+//
+//----------------------------------------------------------------------
+int MemorySbrk(PCB *pcb, int increment) {
+  uint32 oldbrk = pcb->heap->brk;
+  uint32 newbrk = oldbrk + increment;
+  int oldend = MEM_ADDR2PAGE(MEM_ROUNDUP2PAGE(oldbrk));
+  int newend, i, page;
+
+  // A shrink past the base wraps around to above the limit
+  if ((newbrk < MEM_BRK_BASE) || (newbrk > MEM_BRK_LIMIT)) {
+    return MEM_FAIL;
+  }
+  newend = MEM_ADDR2PAGE(MEM_ROUNDUP2PAGE(newbrk));
+  for (i = oldend; i < newend; i++) {
+    if ((page = MemoryAllocPage()) == MEM_FAIL) {
+      // Give back what this call took
+      while (--i >= oldend) {
+        MemoryFreePageTableEntry(pcb->mem->pagetable[i]);
+        pcb->mem->pagetable[i] = 0;
+        pcb->mem->npages -= 1;
       }
+      return MEM_FAIL;
     }
+    pcb->mem->pagetable[i] = MemorySetupPte(page);
+    pcb->mem->npages += 1;
   }
-  // Recurse through to get the correct piece
-  temp_node = MemorySplitNode(node->left, pcb, memsize);
-  if (temp_node >= 0) {
-    return temp_node;
-  } else {
-    return MemorySplitNode(node->right, pcb, memsize);
+  for (i = newend; i < oldend; i++) {
+    MemoryFreePageTableEntry(pcb->mem->pagetable[i]);
+    pcb->mem->pagetable[i] = 0;
+    pcb->mem->npages -= 1;
   }
+  pcb->heap->brk = newbrk;
+  dbprintf('h', "MemorySbrk (%d): break moved from 0x%x to 0x%x\n",
+	   GetPidFromAddress(pcb), oldbrk, newbrk);
+  return oldbrk;
 }
 
-int mfree(PCB* pcb, void* ptr) {
-  int heap_address, i, size;
-  Node * node;
+//----------------------------------------------------------------------
+//
+//	MemoryBrkFree
+//
+//	Free every page of pcb's sbrk region.
+//
+//----------------------------------------------------------------------
+void MemoryBrkFree(PCB *pcb) {
+  int i;
 
-  dbprintf('m', "mfree: function started\n");
+  for (i = MEM_ADDR2PAGE(MEM_BRK_BASE); i < MEM_ADDR2PAGE(MEM_ROUNDUP2PAGE(pcb->heap->brk)); i++) {
+    MemoryFreePageTableEntry(pcb->mem->pagetable[i]);
+    pcb->mem->pagetable[i] = 0;
+  }
+  pcb->heap->brk = MEM_BRK_BASE;
+}
 
-  // Couple of sanity checks
-  if (ptr == NULL) return MEM_FAIL;
-  if ((((int)ptr >= (5 * MEM_PAGESIZE)) || ((int)ptr < (4 * MEM_PAGESIZE)))) return MEM_FAIL;
+//----------------------------------------------------------------------
+//
+//	MemorySlabBytes, MemorySlabFull
+//
+//	The size of a slab of class c, and its freemask with every object
+//	free.
+//
+//----------------------------------------------------------------------
+static int MemorySlabBytes(int c) {
+  int objsize = 1 << (MEM_SLAB_MIN_SHIFT + c);
 
-  // Grab the heap address
-  heap_address = ((int)ptr & (MEM_PAGE_OFFSET_MASK));
+  return (2 * objsize > MEM_SLAB_BYTES) ? 2 * objsize : MEM_SLAB_BYTES;
+}
 
-  // Find the matching node in the heap array
-  for(i = 1; i < MEM_NUM_NODES; i++) {
-    if (pcb->heap_array[i].address == heap_address) {
-      node = &(pcb->heap_array[i]);
-      size = pcb->heap_array[i].size;
-    }
+static uint32 MemorySlabFull(int c) {
+  int n = MemorySlabBytes(c) >> (MEM_SLAB_MIN_SHIFT + c);
+
+  return (n >= 32) ? 0xFFFFFFFF : ((1 << n) - 1);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemorySlabLink, MemorySlabUnlink
+//
+//	Put slab s on (take it off) its class's list of slabs with free
+//	objects.
+//
+//----------------------------------------------------------------------
+static void MemorySlabLink(PCB *pcb, int s) {
+  Slab *slab = &(pcb->heap->slabs[s]);
+
+  slab->prev = -1;
+  slab->next = pcb->heap->slabfree[slab->class];
+  if (slab->next >= 0) {
+    pcb->heap->slabs[slab->next].prev = s;
   }
+  pcb->heap->slabfree[slab->class] = s;
+}
+
+static void MemorySlabUnlink(PCB *pcb, int s) {
+  Slab *slab = &(pcb->heap->slabs[s]);
 
-  // Start the coalescing function to bring buddies together
-  MemoryCoalescing(node);
-  printf("Freeing heap block of size %d bytes: virtual address %d, physical address %d.\n", size, (int)ptr, MemoryTranslateUserToSystem(pcb, (int)ptr));
-  return node->size;
+  if (slab->prev >= 0) {
+    pcb->heap->slabs[slab->prev].next = slab->next;
+  } else {
+    pcb->heap->slabfree[slab->class] = slab->next;
+  }
+  if (slab->next >= 0) {
+    pcb->heap->slabs[slab->next].prev = slab->prev;
+  }
 }
 
-void MemoryCoalescing(Node * node) {
-  if (node == NULL) return;
+//----------------------------------------------------------------------
+//
+//	MemorySlabAlloc
+//
+//	Take an object of class c from the first slab on the class's
+//	list, cutting a new slab from the buddy heap if the list is
+//	empty.  Returns the object's heap offset, or -1.
+//
+//----------------------------------------------------------------------
+static int MemorySlabAlloc(PCB *pcb, int c) {
+  int s = pcb->heap->slabfree[c];
+  int address, bytes, i, bit;
+  Slab *slab;
+
+  if (s < 0) {
+    bytes = MemorySlabBytes(c);
+    if ((address = MemoryBuddyAlloc(pcb, MemoryBuddyOrder(bytes))) < 0) {
+      return -1;
+    }
+    s = address / MEM_SLAB_BYTES;
+    for (i = s; i < s + bytes / MEM_SLAB_BYTES; i++) {
+      pcb->heap->slabs[i].head = s;
+    }
+    slab = &(pcb->heap->slabs[s]);
+    slab->class = c;
+    slab->freemask = MemorySlabFull(c);
+    MemorySlabLink(pcb, s);
+    dbprintf('h', "MemorySlabAlloc: new slab of %d byte objects at %d\n",
+	     1 << (MEM_SLAB_MIN_SHIFT + c), address);
+  }
+  slab = &(pcb->heap->slabs[s]);
+  bit = FindFirstSet(slab->freemask);
+  slab->freemask &= ~(1 << bit);
+  if (slab->freemask == 0) {
+    MemorySlabUnlink(pcb, s);
+  }
+  return s * MEM_SLAB_BYTES + (bit << (MEM_SLAB_MIN_SHIFT + c));
+}
+
+//----------------------------------------------------------------------
+//
+//	MemorySlabFree
+//
+//	Return the object at heap offset address to the slab holding it,
+//	and the slab to the buddy heap once all of it is free.  Returns
+//	the object's size, or MEM_FAIL if address isn't an allocated
+//	object.
+//
+//----------------------------------------------------------------------
+static int MemorySlabFree(PCB *pcb, int address) {
+  int s = pcb->heap->slabs[address / MEM_SLAB_BYTES].head;
+  Slab *slab = &(pcb->heap->slabs[s]);
+  int shift = MEM_SLAB_MIN_SHIFT + slab->class;
+  int offset = address - s * MEM_SLAB_BYTES;
+  int i;
+
+  if ((offset & ((1 << shift) - 1)) || (slab->freemask & (1 << (offset >> shift)))) {
+    return MEM_FAIL;
+  }
+  if (slab->freemask == 0) {
+    MemorySlabLink(pcb, s);
+  }
+  slab->freemask |= 1 << (offset >> shift);
+  if (slab->freemask == MemorySlabFull(slab->class)) {
+    dbprintf('h', "MemorySlabFree: slab at %d is empty\n", s * MEM_SLAB_BYTES);
+    MemorySlabUnlink(pcb, s);
+    for (i = s; i < s + MemorySlabBytes(slab->class) / MEM_SLAB_BYTES; i++) {
+      pcb->heap->slabs[i].head = -1;
+    }
+    MemoryBuddyFree(pcb, s * MEM_SLAB_BYTES);
+  }
+  return (1 << shift);
+}
 
-  // Reset items
-  node->inuse = 0;
-  node->left = NULL;
-  node->right = NULL;
+//----------------------------------------------------------------------
+//
+//	malloc
+//
+//	Allocate memsize bytes of pcb's heap and return their virtual
+//	address, or NULL.  Requests up to MEM_SLAB_MAX_BYTES come from
+//	size-class slabs in constant time; bigger ones get a buddy block
+//	of their own.
+//
+//----------------------------------------------------------------------
+void* malloc(PCB* pcb, int memsize) {
+  int block, c;
 
-  dbprintf('m', "MemoryCoalescing: function started\n");
+  dbprintf('m', "malloc: function started\n");
 
-  if (node->parent != NULL) {
-    // Check for child nodes
-    if (node->parent->left == node) {
-      // Check for right side buddy
-      if (node->parent->right->inuse == 0) {
-        printf("Coalesced buddy nodes (order = %d, addr = %d, size = %d) & (order = %d, addr = %d, size = %d)\n", node->order, node->address, node->size, node->parent->right->order, node->parent->right->address, node->parent->right->size);
-        printf("into the parent node (order = %d, addr = %d, size = %d)\n", node->parent->order, node->parent->address, node->parent->size);
-        MemoryCoalescing(node->parent);
-      }
-    } else {
-      // Check for left side buddy
-      if (node->parent->left->inuse == 0) {
-        printf("Coalesced buddy nodes (order = %d, addr = %d, size = %d) & (order = %d, addr = %d, size = %d)\n", node->parent->left->order, node->parent->left->address, node->parent->left->size, node->order, node->address, node->size);
-        printf("into the parent node (order = %d, addr = %d, size = %d)\n", node->parent->order, node->parent->address, node->parent->size);
-        MemoryCoalescing(node->parent);
-      }
+  if ((memsize <= 0) || (memsize > MEM_PAGESIZE)) {
+    return NULL;
+  }
+  if (memsize <= MEM_SLAB_MAX_BYTES) {
+    for (c = 0; (1 << (MEM_SLAB_MIN_SHIFT + c)) < memsize; c++) { }
+    if ((block = MemorySlabAlloc(pcb, c)) < 0) {
+      return NULL;
     }
+    dbprintf('h', "Created a heap object of size %d bytes: virtual address %d\n",
+	     1 << (MEM_SLAB_MIN_SHIFT + c), MEM_HEAP_BASE | block);
+    return (void *)(MEM_HEAP_BASE | block);
   }
+  if ((block = MemoryBuddyAlloc(pcb, MemoryBuddyOrder(memsize))) < 0) {
+    return NULL;
+  }
+  dbprintf('h', "Created a heap block of size %d bytes: virtual address %d, physical address %d\n",
+	   memsize, MEM_HEAP_BASE | block,
+	   MemoryTranslateUserToSystem(pcb, MEM_HEAP_BASE | block));
+  return (void *)(MEM_HEAP_BASE | block);
 }
 
+//----------------------------------------------------------------------
+//
+//	mfree
+//
+//	Free what malloc returned at ptr.  Returns the number of bytes
+//	freed, or MEM_FAIL if ptr isn't allocated.
+//
+//----------------------------------------------------------------------
+int mfree(PCB* pcb, void* ptr) {
+  int heap_address, size;
+  HeapBlock *block;
+
+  dbprintf('m', "mfree: function started\n");
 
+  // Couple of sanity checks
+  if (ptr == NULL) return MEM_FAIL;
+  if ((((int)ptr >= (MEM_HEAP_BASE + MEM_PAGESIZE)) || ((int)ptr < MEM_HEAP_BASE))) return MEM_FAIL;
+
+  // Grab the heap address
+  heap_address = ((int)ptr & (MEM_PAGE_OFFSET_MASK));
+
+  if (pcb->heap->slabs[heap_address / MEM_SLAB_BYTES].head >= 0) {
+    return MemorySlabFree(pcb, heap_address);
+  }
+
+  // It must be the start of an allocated block
+  if (heap_address & ((1 << MEM_HEAP_MIN_SHIFT) - 1)) return MEM_FAIL;
+  block = &(pcb->heap->heapblocks[heap_address >> MEM_HEAP_MIN_SHIFT]);
+  if ((block->order < 0) || !block->inuse) return MEM_FAIL;
+  size = 1 << (MEM_HEAP_MIN_SHIFT + block->order);
+
+  MemoryBuddyFree(pcb, heap_address);
+  dbprintf('h', "Freeing heap block of size %d bytes: virtual address %d, physical address %d.\n", size, (int)ptr, MemoryTranslateUserToSystem(pcb, (int)ptr));
+  return size;
+}
@@ -28,6 +28,23 @@ KbdModuleInit ()
   *((uint32 *)DLX_KBD_INTR) = 1;
 }
 
+//----------------------------------------------------------------------
+//
+//	PerfCounterRead
+//
+//	Read the low word of a simulator performance counter.  Returns 0
+//	for counters that don't exist.
+//
+//----------------------------------------------------------------------
+uint32
+PerfCounterRead (int ctr)
+{
+  if ((ctr < 0) || (ctr >= DLX_PERF_NUM)) {
+    return (0);
+  }
+  return (*((uint32 *)(DLX_PERF_BASE + 8 * ctr)));
+}
+
 //--------------------------------------------------------------------
 // GetUintFromTrapArg(uint32 *trapArgs, int sysmode)
 //--------------------------------------------------------------------
@@ -457,6 +474,15 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       ihandle = mfree(currentPCB, (void*)ihandle);
       ProcessSetResult(currentPCB, ihandle); //Return handle
       break;
+    case TRAP_SBRK:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ihandle = MemorySbrk(currentPCB, ihandle);
+      ProcessSetResult(currentPCB, ihandle); //Return the old break
+      break;
+    case TRAP_PERF_READ:
+      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
+      ProcessSetResult(currentPCB, PerfCounterRead(ihandle));
+      break;
     case TRAP_LOCK_CREATE:
       ihandle = LockCreate();
       ProcessSetResult(currentPCB, ihandle); //Return handle
@@ -0,0 +1,107 @@
+//
+//	umalloc.c
+//
+//	First-fit allocator over the sbrk region (see umalloc.h).  An
+//	allocated block's next pointer holds UMALLOC_INUSE, which lets
+//	ufree turn away pointers umalloc didn't hand out.
+//
+//	This is linked into user programs, not the operating system.
+//
+
+#include "usertraps.h"
+#include "umalloc.h"
+
+#define UMALLOC_INUSE ((ublock *)0x0b10c)
+
+typedef struct ublock {
+  struct ublock	*next;		// Next free block up, or UMALLOC_INUSE
+  unsigned int	size;		// Bytes, this header included
+} ublock;
+
+static ublock *ufreelist = NULL;
+
+//----------------------------------------------------------------------
+//	UmallocInsert
+//
+//	Put b on the free list, merging it with the free blocks right
+//	below and above it.
+//----------------------------------------------------------------------
+static void UmallocInsert(ublock *b) {
+  ublock *prev = NULL;
+  ublock *next = ufreelist;
+
+  while ((next != NULL) && (next < b)) {
+    prev = next;
+    next = next->next;
+  }
+  if ((next != NULL) && ((char *)b + b->size == (char *)next)) {
+    b->size += next->size;
+    next = next->next;
+  }
+  b->next = next;
+  if (prev == NULL) {
+    ufreelist = b;
+  } else if ((char *)prev + prev->size == (char *)b) {
+    prev->size += b->size;
+    prev->next = next;
+  } else {
+    prev->next = b;
+  }
+}
+
+//----------------------------------------------------------------------
+//	UmallocGrow
+//
+//	Ask sbrk for at least size more bytes and free them.  Returns 0
+//	if it refuses.
+//----------------------------------------------------------------------
+static int UmallocGrow(unsigned int size) {
+  ublock *b;
+
+  size = (size + UMALLOC_GROW_BYTES - 1) & ~(UMALLOC_GROW_BYTES - 1);
+  b = (ublock *)sbrk(size);
+  if ((int)b == -1) return 0;
+  b->size = size;
+  UmallocInsert(b);
+  return 1;
+}
+
+void *umalloc(int bytes) {
+  ublock *prev, *b, *rest;
+  unsigned int size;
+
+  if (bytes <= 0) return NULL;
+  size = (bytes + sizeof(ublock) + UMALLOC_ALIGN - 1) & ~(UMALLOC_ALIGN - 1);
+  do {
+    for (prev = NULL, b = ufreelist; b != NULL; prev = b, b = b->next) {
+      if (b->size < size) continue;
+      if (b->size - size >= 2 * sizeof(ublock)) {
+        // Keep the top part free
+        rest = (ublock *)((char *)b + size);
+        rest->size = b->size - size;
+        rest->next = b->next;
+        b->size = size;
+      } else {
+        rest = b->next;
+      }
+      if (prev == NULL) {
+        ufreelist = rest;
+      } else {
+        prev->next = rest;
+      }
+      b->next = UMALLOC_INUSE;
+      return (void *)(b + 1);
+    }
+  } while (UmallocGrow(size));
+  return NULL;
+}
+
+int ufree(void *ptr) {
+  ublock *b = (ublock *)ptr - 1;
+  int freed;
+
+  if ((ptr == NULL) || (b->next != UMALLOC_INUSE)) return UMALLOC_FAIL;
+  freed = b->size - sizeof(ublock);
+  UmallocInsert(b);
+  return freed;
+}
@@ -266,3 +266,19 @@ _mfree:
         trap    #0x468
         jr      r31
 .endproc _mfree
+
+
+.proc _sbrk
+.global _sbrk
+_sbrk:
+        trap    #0x469
+        jr      r31
+.endproc _sbrk
+
+.proc _perf_read
+.global _perf_read
+_perf_read:
+        trap    #0x46a
+        jr      r31
+        nop
+.endproc _perf_read
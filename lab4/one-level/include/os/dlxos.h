@@ -36,6 +36,7 @@ extern char  debugstr[];
 
 extern int  CurrentIntrs ();
 extern int  SetIntrs (int);
+extern int  FindFirstSet (uint32);
 extern void  KbdModuleInit ();
 extern void  intrreturn ();
 
@@ -12,6 +12,15 @@
 // num_pages = size_of_memory / size_of_one_page
 static int freemapmax;
 static uint32 freemap[16];
+// Bit i set: freemap[i] has a free page.  One word covers the 16
+// freemap words, so finding a free page takes two FindFirstSets.
+static uint32 freesummary;
+#if MEM_NUM_PAGES > 32 * 32
+#error "freesummary needs a bit for each freemap word"
+#endif
+// Next fit: the freemap word the last page came from, where the next
+// search starts
+static int freehint;
 static uint32 pagestart;
 static int nfreepages;
 
@@ -70,6 +79,8 @@ void MemoryModuleInit() {
   for(i = 0; i < freemapmax; i++) {
     freemap[i] = 0;
   }
+  freesummary = 0;
+  freehint = 0;
 
   // Go from the page start to the maxpage
   for(i = pagestart; i < maxpage; i++) {
@@ -85,6 +96,12 @@ void MemoryEditFreemap(int page, int val) {
   uint32 bit_position = page % 32;
   // set the val
   freemap[index] = (freemap[index] & invert(1 << bit_position)) | (val << bit_position);
+  // keep the summary bit for this word in step
+  if (freemap[index] != 0) {
+    freesummary |= 1 << index;
+  } else {
+    freesummary &= invert(1 << index);
+  }
 }
 
 
@@ -252,6 +269,7 @@ int MemoryAllocPage(void) {
   int index = 0;
   uint32 bit_position;
   uint32 fm_segment;
+  uint32 words;
 
   dbprintf('m', "MemoryAllocPage: function started\n");
   // If there are no freepages available return a memfail
@@ -260,19 +278,20 @@ int MemoryAllocPage(void) {
     return MEM_FAIL;
   }
 
-  // loop through the freemaps until you find one with available slots
-  while(freemap[index] == 0) {
-    index += 1;
-    if(index >= freemapmax) {
-      index = 0;
-    }
+  // pick the first word with a free page at or after the hint,
+  // wrapping around to the start if there's none
+  words = freesummary & invert((1 << freehint) - 1);
+  if (words == 0) {
+    words = freesummary;
+  }
+  index = FindFirstSet(words);
+  freehint = index;
+  bit_position = FindFirstSet(freemap[index]);
+  // mark it in use, and the word full if that was its last page
+  freemap[index] &= invert(1 << bit_position);
+  if (freemap[index] == 0) {
+    freesummary &= invert(1 << index);
   }
-  // grab the freemap segment (32 bits of freemap)
-  fm_segment = freemap[index];
-  // loop to find the first available position in that segment
-  for(bit_position = 0; (fm_segment & (1 << bit_position)) == 0; bit_position++){ }
-  // set the specific value in that segment
-  freemap[index]  &= invert(1 << bit_position);
   // grab the page number
   fm_segment = (index * 32) + bit_position; 
   dbprintf('m', "MemoryAllocPage: allocated memory from map=%d, page=%d\n", index, fm_segment);
@@ -51,6 +51,7 @@ char	debugstr[200];
 int ProcessGetCodeInfo(const char *file, uint32 *startAddr, uint32 *codeStart, uint32 *codeSize,
                        uint32 *dataStart, uint32 *dataSize);
 int ProcessGetFromFile(int fd, unsigned char *buf, uint32 *addr, int max);
+static int ProcessLoadImage (PCB *pcb, int fd);
 uint32 get_argument(char *string);
 
 
@@ -516,11 +517,21 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
     dbprintf ('p', "File %s -> data @ 0x%08x (size=0x%08x)\n", name, dataS,
 	      dataL);
 
-    while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
-      dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
-      // Copy the data to user memory.  Note that the user memory needs to
-      // have enough space so that this copy will succeed!
-      MemoryCopySystemToUser (pcb, buf, (char *)(addr - n), n);
+    // Binary images are read straight into the new pages; hex files
+    // still go through ProcessGetFromFile a buffer at a time.
+    n = ProcessLoadImage (pcb, fd);
+    if (n < 0) {
+      FsClose (fd);
+      ProcessFreeResources (pcb);
+      return (-1);
+    }
+    if (n == 0) {
+      while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
+        dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
+        // Copy the data to user memory.  Note that the user memory needs to
+        // have enough space so that this copy will succeed!
+        MemoryCopySystemToUser (pcb, buf, (char *)(addr - n), n);
+      }
     }
     FsClose (fd);
     stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
@@ -662,6 +673,120 @@ static inline int getxvalue (int x) {
   }
 }
 
+//----------------------------------------------------------------------
+//
+//	Binary image support
+//
+//	Executables may be either the hex text format written by dlxasm
+//	or a binary image (see PROCESS_IMAGE_MAGIC in process.h).  Only
+//	one executable is ever being loaded at a time, so the state for the
+//	binary image being read is kept here rather than in the caller.
+//
+//----------------------------------------------------------------------
+static struct {
+  int		fd;		// descriptor of the open image, or -1
+  uint32	segleft;	// bytes left in the current segment
+} processImage = { -1, 0 };
+
+static uint32 ProcessImageWord (unsigned char *p, int word) {
+  p += word * 4;
+  return ((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+static int ProcessGetImageInfo (int fd, unsigned char *hdr, uint32 *startAddr,
+				uint32 *codeStart, uint32 *codeSize,
+				uint32 *dataStart, uint32 *dataSize) {
+  if (ProcessImageWord (hdr, PROCESS_IMAGE_VERSION_WORD) != PROCESS_IMAGE_VERSION) {
+    dbprintf ('f', "ProcessGetImageInfo: unsupported image version %d\n",
+	      (int)ProcessImageWord (hdr, PROCESS_IMAGE_VERSION_WORD));
+    FsClose (fd);
+    return (-1);
+  }
+  *startAddr = ProcessImageWord (hdr, PROCESS_IMAGE_START_WORD);
+  *codeStart = ProcessImageWord (hdr, PROCESS_IMAGE_CODESTART_WORD);
+  *codeSize = ProcessImageWord (hdr, PROCESS_IMAGE_CODESIZE_WORD);
+  *dataStart = ProcessImageWord (hdr, PROCESS_IMAGE_DATASTART_WORD);
+  *dataSize = ProcessImageWord (hdr, PROCESS_IMAGE_DATASIZE_WORD);
+  processImage.fd = fd;
+  processImage.segleft = 0;
+  // Seek to the first segment header
+  FsSeek (fd, PROCESS_IMAGE_HEADER_WORDS * 4, FS_SEEK_SET);
+  return (fd);
+}
+
+// Same contract as ProcessGetFromFile, for binary images: data never
+// spans two segments, so *addr is only reset at a segment boundary.
+static int ProcessGetFromImage (int fd, unsigned char *buf, uint32 *addr, int max) {
+  unsigned char	seghdr[PROCESS_IMAGE_SEGHDR_WORDS * 4];
+  int		nbytes;
+
+  while (processImage.segleft == 0) {
+    if (FsRead (fd, (char *)seghdr, sizeof (seghdr)) != sizeof (seghdr)) {
+      return (0);
+    }
+    *addr = ProcessImageWord (seghdr, 0);
+    processImage.segleft = ProcessImageWord (seghdr, 1);
+    dbprintf ('f', "Image segment at 0x%x (%d bytes).\n", (int)(*addr),
+	      (int)processImage.segleft);
+  }
+  if (max > processImage.segleft) {
+    max = processImage.segleft;
+  }
+  if ((nbytes = FsRead (fd, (char *)buf, max)) <= 0) {
+    return (0);
+  }
+  processImage.segleft -= nbytes;
+  *addr += nbytes;
+  return (nbytes);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessLoadImage
+//
+//	If fd is a binary image, load all of its segments into pcb's
+//	memory, reading each page's worth straight into the physical page
+//	it maps to: one FsRead per page and no copying through a buffer.
+//	The pages must already be mapped.  Returns 1 once the image is
+//	loaded, 0 if fd isn't a binary image, or -1 if a segment is
+//	truncated or lands on an unmapped page.
+//
+//----------------------------------------------------------------------
+static int ProcessLoadImage (PCB *pcb, int fd) {
+  unsigned char	seghdr[PROCESS_IMAGE_SEGHDR_WORDS * 4];
+  uint32	vaddr, paddr, left;
+  int		n;
+
+  if (fd != processImage.fd) {
+    return (0);
+  }
+  processImage.fd = -1;
+  while (FsRead (fd, (char *)seghdr, sizeof (seghdr)) == sizeof (seghdr)) {
+    vaddr = ProcessImageWord (seghdr, 0);
+    left = ProcessImageWord (seghdr, 1);
+    while (left > 0) {
+      // Up to the end of vaddr's page
+      n = MEM_PAGESIZE - (vaddr % MEM_PAGESIZE);
+      if (n > left) {
+	n = left;
+      }
+      paddr = MemoryTranslateUserToSystem (pcb, vaddr);
+      if (paddr == MEM_FAIL) {
+	printf ("ProcessLoadImage: image segment at unmapped address 0x%x\n", (int)vaddr);
+	return (-1);
+      }
+      dbprintf ('p', "Reading %d bytes to vaddr %08x (paddr %08x).\n", n, (int)vaddr, (int)paddr);
+      if (FsRead (fd, (char *)paddr, n) != n) {
+	printf ("ProcessLoadImage: image truncated at vaddr 0x%x\n", (int)vaddr);
+	return (-1);
+      }
+      vaddr += n;
+      left -= n;
+    }
+  }
+  return (1);
+}
+
 //----------------------------------------------------------------------
 //
 //	ProcessGetCodeSizes
@@ -695,6 +820,11 @@ ProcessGetCodeInfo (const char *file, uint32 *startAddr,
     FsClose (fd);
     return (-1);
   }
+  processImage.fd = -1;
+  if (ProcessImageWord ((unsigned char *)buf, PROCESS_IMAGE_MAGIC_WORD) == PROCESS_IMAGE_MAGIC) {
+    return (ProcessGetImageInfo (fd, (unsigned char *)buf, startAddr, codeStart,
+				 codeSize, dataStart, dataSize));
+  }
   if (dstrstr (buf, "start:") == NULL) {
     dbprintf ('f', "ProcessGetCodeInfo: %s missing start line (not a DLX executable?)\n", file);
     return (-1);
@@ -749,6 +879,9 @@ ProcessGetFromFile (int fd, unsigned char *buf, uint32 *addr, int max)
   unsigned char *pos = buf;
   char	*lpos = localbuf;
 
+  if (fd == processImage.fd) {
+    return (ProcessGetFromImage (fd, buf, addr, max));
+  }
   // Remember our position at the start of the routine so we can adjust
   // it later.
   seekpos = FsSeek (fd, 0, FS_SEEK_CUR);
@@ -0,0 +1,752 @@
+//
+//	dfsimage.cc
+//
+//	Build, fill and read lab5 (flat) DFS disk images on the host,
+//	without booting DLXOS.  The layout is the one fdisk writes and
+//	lab5/flat/os/dfs.c reads (see lab5/flat/include/dfs_shared.h):
+//	boot record and superblock in the first two disk blocks, then the
+//	inodes, the free block vector, the metadata journal and the data.
+//	Like everything else the DLX puts on its disk, all words are
+//	big-endian.
+//
+//	Usage:	dfsimage format image [blocksize [diskblocks]]
+//		dfsimage ls image
+//		dfsimage put image hostfile [name]
+//		dfsimage import image hostdir
+//		dfsimage get image name hostfile
+//
+//	import copies every regular file under hostdir, named by its path
+//	relative to hostdir.  A metadata journal the OS left behind is
+//	replayed before the image is used, as DfsOpenFileSystem would.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "dlximage.h"
+
+// These must match lab5/flat (disk.h, dfs_shared.h, dfs.h and fdisk.h)
+#define	DISK_BLOCKSIZE		512
+#define	DISK_NUMBLOCKS		0x8000
+#define	DFS_BLOCKSIZE		1024
+#define	DFS_MAX_BLOCKSIZE	4096
+#define	DFS_NUM_INODES		192
+#define	DFS_BLOCKS_PER_INODE	128
+#define	DFS_INODE_SIZE		96
+#define	DFS_MAX_FILENAME_SIZE	44
+#define	DFS_INODE_EXTENTS	5
+#define	DFS_INODE_INLINE	2
+#define	DFS_INODE_INLINE_BYTES	(DFS_INODE_EXTENTS * 8)
+#define	DFS_EXTENT_BLOCK_EXTENTS (DFS_MAX_BLOCKSIZE / 8)
+#define	DFS_MAX_EXTENTS		(DFS_INODE_EXTENTS + DFS_EXTENT_BLOCK_EXTENTS)
+#define	DFS_JOURNAL_BLOCKS	16
+#define	DFS_JOURNAL_MAGIC	0x4a524e4c
+
+// Word offsets of the superblock fields.  valid is a char, so it's
+// the first byte of word 0.
+#define	SB_BLOCKSIZE		1
+#define	SB_NUMBLOCKS		2
+#define	SB_START_INODES		3
+#define	SB_NUM_INODES		4
+#define	SB_START_FBV		5
+#define	SB_START_JOURNAL	6
+#define	SB_START_DATA		7
+#define	SB_FREE_BLOCKS		8
+#define	SB_INODES_USED		9
+#define	SB_WORDS		10
+
+// Word offsets in an inode; the filename is bytes 8 to 51
+#define	INODE_INUSE		0
+#define	INODE_FILESIZE		1
+#define	INODE_FILENAME_BYTE	8
+#define	INODE_EXTENTS		13	// start, length pairs
+#define	INODE_EXTENT_BLOCK	23
+
+typedef struct Extent {
+  unsigned int	start;		// 0 for a hole
+  unsigned int	length;
+} Extent;
+
+static FILE		*imgFile = NULL;
+static unsigned char	*img = NULL;	// The whole file system
+static char		*dirty = NULL;	// A flag per file system block
+static unsigned int	sb[SB_WORDS];
+static unsigned int	bs;		// File system block size
+static unsigned int	perBlock;	// Extents an extent block holds
+
+static
+unsigned char *
+Block (unsigned int b)
+{
+  return (img + b * bs);
+}
+
+static
+unsigned char *
+Inode (unsigned int i)
+{
+  return (Block (sb[SB_START_INODES]) + i * DFS_INODE_SIZE);
+}
+
+// Returns inode i like Inode(), for changing it
+static
+unsigned char *
+InodeDirty (unsigned int i)
+{
+  dirty[sb[SB_START_INODES] + (i * DFS_INODE_SIZE) / bs] = 1;
+  return (Inode (i));
+}
+
+static
+int
+IsFree (unsigned int b)
+{
+  return ((DlxImageGetWord (Block (sb[SB_START_FBV]), b / 32) >> (b % 32)) & 1);
+}
+
+static
+void
+SetFree (unsigned int b, int isfree)
+{
+  unsigned char	*fbv = Block (sb[SB_START_FBV]);
+  unsigned int	v = DlxImageGetWord (fbv, b / 32);
+
+  if (isfree) {
+    v |= (1 << (b % 32));
+    sb[SB_FREE_BLOCKS]++;
+  } else {
+    v &= ~(1 << (b % 32));
+    sb[SB_FREE_BLOCKS]--;
+  }
+  DlxImagePutWord (fbv, b / 32, v);
+  dirty[sb[SB_START_FBV] + (b / 32 * 4) / bs] = 1;
+  dirty[DISK_BLOCKSIZE / bs] = 1;	// The superblock's
+}
+
+//----------------------------------------------------------------------
+//
+//	LoadSuperblock
+//
+//	Check the superblock in img and copy it into sb.  Returns 0 if it
+//	isn't a file system the OS would open.
+//
+//----------------------------------------------------------------------
+static
+int
+LoadSuperblock (unsigned int imgBlocks)
+{
+  unsigned char	*p = img + DISK_BLOCKSIZE;
+  int		i;
+
+  for (i = 0; i < SB_WORDS; i++) {
+    sb[i] = DlxImageGetWord (p, i);
+  }
+  bs = sb[SB_BLOCKSIZE];
+  if ((p[0] == 0) || (bs < DISK_BLOCKSIZE) || (bs > DFS_MAX_BLOCKSIZE) ||
+      (bs % DISK_BLOCKSIZE) || (sb[SB_NUMBLOCKS] > imgBlocks / (bs / DISK_BLOCKSIZE)) ||
+      (sb[SB_START_INODES] * bs < 2 * DISK_BLOCKSIZE) || (sb[SB_START_FBV] < sb[SB_START_INODES]) ||
+      (sb[SB_START_JOURNAL] < sb[SB_START_FBV]) ||
+      (sb[SB_START_DATA] < sb[SB_START_JOURNAL] + DFS_JOURNAL_BLOCKS) ||
+      (sb[SB_START_DATA] > sb[SB_NUMBLOCKS])) {
+    return (0);
+  }
+  perBlock = bs / 8;
+  return (1);
+}
+
+static
+void
+StoreSuperblock ()
+{
+  unsigned char	*p = img + DISK_BLOCKSIZE;
+  int		i;
+
+  for (i = 1; i < SB_WORDS; i++) {
+    DlxImagePutWord (p, i, sb[i]);
+  }
+  dirty[DISK_BLOCKSIZE / bs] = 1;	// The superblock's
+}
+
+//----------------------------------------------------------------------
+//
+//	ReplayJournal
+//
+//	Finish a metadata flush the OS was cut off in, the same way
+//	DfsJournalReplay does, and clear the journal.
+//
+//----------------------------------------------------------------------
+static
+void
+ReplayJournal ()
+{
+  unsigned char	*h = Block (sb[SB_START_JOURNAL]);
+  unsigned int	count = DlxImageGetWord (h, 2);
+  unsigned int	sum = 0;
+  unsigned int	k, w, target;
+
+  if ((DlxImageGetWord (h, 0) != DFS_JOURNAL_MAGIC) || (count == 0)) {
+    return;
+  }
+  if (count <= DFS_JOURNAL_BLOCKS - 1) {
+    for (k = 0; k < count; k++) {
+      for (w = 0; w < bs / 4; w++) {
+	sum += DlxImageGetWord (Block (sb[SB_START_JOURNAL] + 1 + k), w);
+      }
+    }
+  }
+  if ((count <= DFS_JOURNAL_BLOCKS - 1) && (sum == DlxImageGetWord (h, 3))) {
+    for (k = 0; k < count; k++) {
+      target = DlxImageGetWord (h, 4 + k);
+      if ((target >= sb[SB_START_INODES]) && (target < sb[SB_START_JOURNAL])) {
+	memcpy (Block (target), Block (sb[SB_START_JOURNAL] + 1 + k), bs);
+	dirty[target] = 1;
+      }
+    }
+    printf ("Replayed %d metadata blocks from the journal.\n", count);
+  }
+  memset (h, 0, bs);
+  dirty[sb[SB_START_JOURNAL]] = 1;
+}
+
+//----------------------------------------------------------------------
+//
+//	OpenImage
+//
+//	Read the whole image into memory.  Holes in a sparse image and
+//	anything past its end read as zeros.
+//
+//----------------------------------------------------------------------
+static
+int
+OpenImage (const char *name, const char *mode)
+{
+  long		size;
+  unsigned int	imgBlocks;
+
+  if ((imgFile = fopen (name, mode)) == NULL) {
+    perror (name);
+    return (0);
+  }
+  fseek (imgFile, 0, SEEK_END);
+  size = ftell (imgFile);
+  fseek (imgFile, 0, SEEK_SET);
+  imgBlocks = (size < DISK_NUMBLOCKS * DISK_BLOCKSIZE) ? DISK_NUMBLOCKS :
+	      (size + DISK_BLOCKSIZE - 1) / DISK_BLOCKSIZE;
+  img = (unsigned char *)calloc (imgBlocks, DISK_BLOCKSIZE);
+  bs = DISK_BLOCKSIZE;		// Until the superblock says otherwise
+  if ((img == NULL) || (fread (img, 1, size, imgFile) != (size_t)size)) {
+    fprintf (stderr, "%s: can't read the image\n", name);
+    return (0);
+  }
+  if (!LoadSuperblock (imgBlocks)) {
+    fprintf (stderr, "%s: no valid DFS file system\n", name);
+    return (0);
+  }
+  dirty = (char *)calloc (sb[SB_NUMBLOCKS], 1);
+  ReplayJournal ();
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	CloseImage
+//
+//	Write back the file system blocks that changed, and nothing else,
+//	so a sparse image stays sparse.
+//
+//----------------------------------------------------------------------
+static
+int
+CloseImage ()
+{
+  unsigned int	b;
+  int		ok = 1;
+
+  for (b = 0; b < sb[SB_NUMBLOCKS]; b++) {
+    if (dirty[b]) {
+      if ((fseek (imgFile, (long)b * bs, SEEK_SET) != 0) ||
+	  (fwrite (Block (b), 1, bs, imgFile) != bs)) {
+	ok = 0;
+      }
+    }
+  }
+  if (fclose (imgFile) != 0) {
+    ok = 0;
+  }
+  if (!ok) {
+    fprintf (stderr, "Error writing the image back.\n");
+  }
+  return (ok);
+}
+
+//----------------------------------------------------------------------
+//
+//	LoadExtents
+//
+//	Copy inode i's extents, the ones in its extent block included, to
+//	ext and return how many there are.
+//
+//----------------------------------------------------------------------
+static
+int
+LoadExtents (unsigned int i, Extent *ext)
+{
+  unsigned char	*ino = Inode (i);
+  unsigned char	*more;
+  unsigned int	n, k;
+
+  if (DlxImageGetWord (ino, INODE_INUSE) & DFS_INODE_INLINE) {
+    return (0);
+  }
+  for (n = 0; n < DFS_INODE_EXTENTS; n++) {
+    ext[n].start = DlxImageGetWord (ino, INODE_EXTENTS + 2 * n);
+    if ((ext[n].length = DlxImageGetWord (ino, INODE_EXTENTS + 2 * n + 1)) == 0) {
+      return (n);
+    }
+  }
+  if ((k = DlxImageGetWord (ino, INODE_EXTENT_BLOCK)) == 0) {
+    return (n);
+  }
+  more = Block (k);
+  for (k = 0; k < perBlock; k++) {
+    ext[n].start = DlxImageGetWord (more, 2 * k);
+    if ((ext[n].length = DlxImageGetWord (more, 2 * k + 1)) == 0) {
+      break;
+    }
+    n++;
+  }
+  return (n);
+}
+
+static
+int
+FindInode (const char *name)
+{
+  unsigned int	i;
+  unsigned char	*ino;
+
+  for (i = 0; i < sb[SB_INODES_USED]; i++) {
+    ino = Inode (i);
+    if (DlxImageGetWord (ino, INODE_INUSE) &&
+	(strncmp ((char *)ino + INODE_FILENAME_BYTE, name, DFS_MAX_FILENAME_SIZE) == 0)) {
+      return (i);
+    }
+  }
+  return (-1);
+}
+
+//----------------------------------------------------------------------
+//
+//	DeleteInode
+//
+//	Free inode i and every block it has.
+//
+//----------------------------------------------------------------------
+static
+void
+DeleteInode (unsigned int i)
+{
+  Extent	ext[DFS_MAX_EXTENTS];
+  unsigned char	*ino = InodeDirty (i);
+  unsigned int	j, b;
+  int		n, k;
+
+  n = LoadExtents (i, ext);
+  for (k = 0; k < n; k++) {
+    for (j = 0; (ext[k].start != 0) && (j < ext[k].length); j++) {
+      SetFree (ext[k].start + j, 1);
+    }
+  }
+  if ((b = DlxImageGetWord (ino, INODE_EXTENT_BLOCK)) != 0) {
+    SetFree (b, 1);
+  }
+  memset (ino, 0, DFS_INODE_SIZE);
+}
+
+//----------------------------------------------------------------------
+//
+//	AllocateExtents
+//
+//	Find count free data blocks as a few runs as possible: the first
+//	free run long enough for all of them, or failing that, runs in
+//	disk order.  Fills in ext and returns how many runs, or 0 if there
+//	isn't room for them in max extents.
+//
+//----------------------------------------------------------------------
+static
+int
+AllocateExtents (unsigned int count, Extent *ext, int max)
+{
+  unsigned int	b, run, j;
+  int		n = 0, k;
+
+  for (b = sb[SB_START_DATA]; b < sb[SB_NUMBLOCKS]; b += run + 1) {
+    for (run = 0; (b + run < sb[SB_NUMBLOCKS]) && IsFree (b + run) && (run < count); run++) {
+    }
+    if (run == count) {
+      ext[0].start = b;
+      ext[0].length = count;
+      n = 1;
+      break;
+    }
+  }
+  if (n == 0) {
+    for (b = sb[SB_START_DATA]; (b < sb[SB_NUMBLOCKS]) && (count > 0); b += run + 1) {
+      for (run = 0; (b + run < sb[SB_NUMBLOCKS]) && IsFree (b + run) && (run < count); run++) {
+      }
+      if (run == 0) {
+	continue;
+      }
+      if (n == max) {
+	return (0);
+      }
+      ext[n].start = b;
+      ext[n].length = run;
+      count -= run;
+      n++;
+    }
+    if (count > 0) {
+      return (0);
+    }
+  }
+  for (k = 0; k < n; k++) {
+    for (j = 0; j < ext[k].length; j++) {
+      SetFree (ext[k].start + j, 0);
+    }
+  }
+  return (n);
+}
+
+//----------------------------------------------------------------------
+//
+//	PutFile
+//
+//	Store len bytes of data as file name, replacing any file of that
+//	name.  Files small enough go in the inode, the way the OS keeps
+//	them.  Returns 0 if there's no room.
+//
+//----------------------------------------------------------------------
+static
+int
+PutFile (const char *name, const unsigned char *data, unsigned int len)
+{
+  Extent	ext[DFS_MAX_EXTENTS];
+  unsigned char	*ino, *more;
+  unsigned int	i, blocks, v = 0, eb = 0;
+  int		n, k;
+
+  if (strlen (name) >= DFS_MAX_FILENAME_SIZE) {
+    fprintf (stderr, "%s: name longer than %d characters, skipped\n", name,
+	     DFS_MAX_FILENAME_SIZE - 1);
+    return (0);
+  }
+  if ((k = FindInode (name)) >= 0) {
+    DeleteInode (k);
+  }
+  for (i = 0; i < sb[SB_NUM_INODES]; i++) {
+    if ((i >= sb[SB_INODES_USED]) || !DlxImageGetWord (Inode (i), INODE_INUSE)) {
+      break;
+    }
+  }
+  if (i == sb[SB_NUM_INODES]) {
+    fprintf (stderr, "%s: no free inode\n", name);
+    return (0);
+  }
+  ino = InodeDirty (i);
+  memset (ino, 0, DFS_INODE_SIZE);
+  strcpy ((char *)ino + INODE_FILENAME_BYTE, name);
+  DlxImagePutWord (ino, INODE_FILESIZE, len);
+  if (len <= DFS_INODE_INLINE_BYTES) {
+    DlxImagePutWord (ino, INODE_INUSE, 1 | DFS_INODE_INLINE);
+    memcpy (ino + INODE_EXTENTS * 4, data, len);
+  } else {
+    blocks = (len + bs - 1) / bs;
+    if ((n = AllocateExtents (blocks, ext, DFS_INODE_EXTENTS + perBlock)) == 0) {
+      fprintf (stderr, "%s: no room for %d blocks\n", name, blocks);
+      return (0);
+    }
+    if (n > DFS_INODE_EXTENTS) {
+      if (AllocateExtents (1, &ext[n], 1) == 0) {
+	fprintf (stderr, "%s: no room for an extent block\n", name);
+	for (k = 0; k < n; k++) {
+	  for (v = 0; v < ext[k].length; v++) {
+	    SetFree (ext[k].start + v, 1);
+	  }
+	}
+	return (0);
+      }
+      eb = ext[n].start;
+    }
+    DlxImagePutWord (ino, INODE_INUSE, 1);
+    for (k = 0; k < n; k++) {
+      if (k < DFS_INODE_EXTENTS) {
+	DlxImagePutWord (ino, INODE_EXTENTS + 2 * k, ext[k].start);
+	DlxImagePutWord (ino, INODE_EXTENTS + 2 * k + 1, ext[k].length);
+      } else {
+	more = Block (eb);
+	DlxImagePutWord (more, 2 * (k - DFS_INODE_EXTENTS), ext[k].start);
+	DlxImagePutWord (more, 2 * (k - DFS_INODE_EXTENTS) + 1, ext[k].length);
+      }
+      // The last block's tail is zeroed, as a fresh block is by the OS
+      memset (Block (ext[k].start), 0, ext[k].length * bs);
+      memcpy (Block (ext[k].start), data + v * bs,
+	      (len - v * bs < ext[k].length * bs) ? len - v * bs : ext[k].length * bs);
+      memset (dirty + ext[k].start, 1, ext[k].length);
+      v += ext[k].length;
+    }
+    if (eb != 0) {
+      memset (Block (eb) + 8 * (n - DFS_INODE_EXTENTS), 0, bs - 8 * (n - DFS_INODE_EXTENTS));
+      DlxImagePutWord (ino, INODE_EXTENT_BLOCK, eb);
+      dirty[eb] = 1;
+    }
+  }
+  if (i >= sb[SB_INODES_USED]) {
+    sb[SB_INODES_USED] = i + 1;
+  }
+  return (1);
+}
+
+static
+int
+PutHostFile (const char *path, const char *name)
+{
+  FILE		*f;
+  unsigned char	*data;
+  long		len;
+  int		ok;
+
+  if ((f = fopen (path, "rb")) == NULL) {
+    perror (path);
+    return (0);
+  }
+  fseek (f, 0, SEEK_END);
+  len = ftell (f);
+  fseek (f, 0, SEEK_SET);
+  data = (unsigned char *)malloc (len + 1);
+  ok = (data != NULL) && (fread (data, 1, len, f) == (size_t)len) &&
+       PutFile (name, data, len);
+  fclose (f);
+  free (data);
+  return (ok);
+}
+
+//----------------------------------------------------------------------
+//
+//	ImportTree
+//
+//	Put every regular file under dir, named prefix followed by its
+//	path below dir.  Returns the number of files imported.
+//
+//----------------------------------------------------------------------
+static
+int
+ImportTree (const char *dir, const char *prefix)
+{
+  DIR		*d;
+  struct dirent	*e;
+  struct stat	st;
+  char		path[4096], name[4096];
+  int		count = 0;
+
+  if ((d = opendir (dir)) == NULL) {
+    perror (dir);
+    return (0);
+  }
+  while ((e = readdir (d)) != NULL) {
+    if ((strcmp (e->d_name, ".") == 0) || (strcmp (e->d_name, "..") == 0)) {
+      continue;
+    }
+    snprintf (path, sizeof (path), "%s/%s", dir, e->d_name);
+    snprintf (name, sizeof (name), "%s%s", prefix, e->d_name);
+    if (stat (path, &st) != 0) {
+      continue;
+    }
+    if (S_ISDIR (st.st_mode)) {
+      strcat (name, "/");
+      count += ImportTree (path, name);
+    } else if (S_ISREG (st.st_mode) && PutHostFile (path, name)) {
+      count++;
+    }
+  }
+  closedir (d);
+  return (count);
+}
+
+//----------------------------------------------------------------------
+//
+//	GetFile
+//
+//	Copy file name out to the host file path.  Holes come out as zeros.
+//
+//----------------------------------------------------------------------
+static
+int
+GetFile (const char *name, const char *path)
+{
+  Extent	ext[DFS_MAX_EXTENTS];
+  static unsigned char zeros[DFS_MAX_BLOCKSIZE];
+  unsigned char	*ino;
+  unsigned int	left, n, j;
+  int		i, k, count;
+  FILE		*f;
+
+  if ((i = FindInode (name)) < 0) {
+    fprintf (stderr, "%s: no such file\n", name);
+    return (0);
+  }
+  if ((f = fopen (path, "wb")) == NULL) {
+    perror (path);
+    return (0);
+  }
+  ino = Inode (i);
+  left = DlxImageGetWord (ino, INODE_FILESIZE);
+  if (DlxImageGetWord (ino, INODE_INUSE) & DFS_INODE_INLINE) {
+    fwrite (ino + INODE_EXTENTS * 4, 1, left, f);
+    left = 0;
+  }
+  count = LoadExtents (i, ext);
+  for (k = 0; (k < count) && (left > 0); k++) {
+    for (j = 0; (j < ext[k].length) && (left > 0); j++) {
+      n = (left < bs) ? left : bs;
+      fwrite ((ext[k].start == 0) ? zeros : Block (ext[k].start + j), 1, n, f);
+      left -= n;
+    }
+  }
+  // Past the last extent the file is one hole
+  for (; left > 0; left -= n) {
+    n = (left < bs) ? left : bs;
+    fwrite (zeros, 1, n, f);
+  }
+  return (fclose (f) == 0);
+}
+
+static
+void
+ListFiles ()
+{
+  Extent	ext[DFS_MAX_EXTENTS];
+  unsigned char	*ino;
+  unsigned int	i, inuse;
+  int		files = 0;
+
+  for (i = 0; i < sb[SB_INODES_USED]; i++) {
+    ino = Inode (i);
+    if ((inuse = DlxImageGetWord (ino, INODE_INUSE)) != 0) {
+      printf ("%4d %10u %3d%s %s\n", i, DlxImageGetWord (ino, INODE_FILESIZE),
+	      LoadExtents (i, ext), (inuse & DFS_INODE_INLINE) ? "i" : " ",
+	      (char *)ino + INODE_FILENAME_BYTE);
+      files++;
+    }
+  }
+  printf ("%d files, %d of %d blocks free, %d byte blocks.\n", files,
+	  sb[SB_FREE_BLOCKS], sb[SB_NUMBLOCKS], bs);
+}
+
+//----------------------------------------------------------------------
+//
+//	FormatImage
+//
+//	Lay out an empty file system the way fdisk does and write just its
+//	metadata, leaving the data blocks a hole.
+//
+//----------------------------------------------------------------------
+static
+int
+FormatImage (const char *name, unsigned int blocksize, unsigned int diskBlocks)
+{
+  unsigned int	inodeBlocks, fbvBlocks, b;
+  unsigned char	*p;
+
+  if ((blocksize < DISK_BLOCKSIZE) || (blocksize > DFS_MAX_BLOCKSIZE) || (blocksize % DISK_BLOCKSIZE)) {
+    fprintf (stderr, "Block size %d isn't a multiple of %d up to %d.\n", blocksize,
+	     DISK_BLOCKSIZE, DFS_MAX_BLOCKSIZE);
+    return (0);
+  }
+  bs = blocksize;
+  memset (sb, 0, sizeof (sb));
+  sb[SB_BLOCKSIZE] = bs;
+  sb[SB_NUMBLOCKS] = diskBlocks / (bs / DISK_BLOCKSIZE);
+  sb[SB_NUM_INODES] = sb[SB_NUMBLOCKS] / DFS_BLOCKS_PER_INODE;
+  if (sb[SB_NUM_INODES] < DFS_NUM_INODES) {
+    sb[SB_NUM_INODES] = DFS_NUM_INODES;
+  }
+  inodeBlocks = (sb[SB_NUM_INODES] * DFS_INODE_SIZE + bs - 1) / bs;
+  fbvBlocks = ((sb[SB_NUMBLOCKS] + 31) / 32 * 4 + bs - 1) / bs;
+  sb[SB_START_INODES] = (2 * DISK_BLOCKSIZE + bs - 1) / bs;	// After the superblock
+  sb[SB_START_FBV] = sb[SB_START_INODES] + inodeBlocks;
+  sb[SB_START_JOURNAL] = sb[SB_START_FBV] + fbvBlocks;
+  sb[SB_START_DATA] = sb[SB_START_JOURNAL] + DFS_JOURNAL_BLOCKS;
+  if (sb[SB_START_DATA] >= sb[SB_NUMBLOCKS]) {
+    fprintf (stderr, "%d disk blocks is too small for a file system.\n", diskBlocks);
+    return (0);
+  }
+  if ((imgFile = fopen (name, "wb")) == NULL) {
+    perror (name);
+    return (0);
+  }
+  img = (unsigned char *)calloc (sb[SB_START_DATA], bs);
+  dirty = (char *)calloc (sb[SB_NUMBLOCKS], 1);
+  for (b = sb[SB_START_DATA]; b < sb[SB_NUMBLOCKS]; b++) {
+    // Mark the data blocks free
+    DlxImagePutWord (Block (sb[SB_START_FBV]), b / 32,
+		     DlxImageGetWord (Block (sb[SB_START_FBV]), b / 32) | (1 << (b % 32)));
+  }
+  sb[SB_FREE_BLOCKS] = sb[SB_NUMBLOCKS] - sb[SB_START_DATA];
+  p = img + DISK_BLOCKSIZE;
+  p[0] = 1;			// valid
+  StoreSuperblock ();
+  memset (dirty, 1, sb[SB_START_DATA] - DFS_JOURNAL_BLOCKS + 1);
+  // The disk is as big as the OS will be told it is
+  fseek (imgFile, (long)diskBlocks * DISK_BLOCKSIZE - 1, SEEK_SET);
+  fputc (0, imgFile);
+  printf ("%d blocks of %d bytes, %d inodes, data from block %d.\n", sb[SB_NUMBLOCKS], bs,
+	  sb[SB_NUM_INODES], sb[SB_START_DATA]);
+  return (CloseImage ());
+}
+
+int
+main (int argc, char *argv[])
+{
+  int	n, ok;
+
+  if ((argc >= 3) && (strcmp (argv[1], "format") == 0) && (argc <= 5)) {
+    return (FormatImage (argv[2], (argc > 3) ? atoi (argv[3]) : DFS_BLOCKSIZE,
+			 (argc > 4) ? strtoul (argv[4], NULL, 0) : DISK_NUMBLOCKS) ? 0 : 1);
+  }
+  if ((argc == 3) && (strcmp (argv[1], "ls") == 0)) {
+    if (!OpenImage (argv[2], "rb")) {
+      return (1);
+    }
+    ListFiles ();
+    return (0);
+  }
+  if ((argc == 5) && (strcmp (argv[1], "get") == 0)) {
+    return ((OpenImage (argv[2], "rb") && GetFile (argv[3], argv[4])) ? 0 : 1);
+  }
+  if (((argc == 4) || (argc == 5)) && (strcmp (argv[1], "put") == 0)) {
+    if (!OpenImage (argv[2], "r+b")) {
+      return (1);
+    }
+    ok = PutHostFile (argv[3], (argc == 5) ? argv[4] : argv[3]);
+    StoreSuperblock ();
+    return ((CloseImage () && ok) ? 0 : 1);
+  }
+  if ((argc == 4) && (strcmp (argv[1], "import") == 0)) {
+    if (!OpenImage (argv[2], "r+b")) {
+      return (1);
+    }
+    n = ImportTree (argv[3], "");
+    StoreSuperblock ();
+    printf ("Imported %d files.\n", n);
+    return (CloseImage () ? 0 : 1);
+  }
+  fprintf (stderr, "Usage: %s format image [blocksize [diskblocks]]\n"
+	   "       %s ls image\n"
+	   "       %s put image hostfile [name]\n"
+	   "       %s import image hostdir\n"
+	   "       %s get image name hostfile\n",
+	   argv[0], argv[0], argv[0], argv[0], argv[0]);
+  return (1);
+}
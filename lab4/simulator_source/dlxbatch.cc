@@ -0,0 +1,436 @@
+//
+//	dlxbatch.cc
+//
+//	Run a list of independent dlxsim jobs, several at a time, and
+//	summarize the results.  Each job runs in its own directory under
+//	the output directory (-o, default "batch.out"), with its console
+//	output in console.log there.  Files given with -l are symlinked
+//	into every job directory, so all jobs share one copy of the OS
+//	and program images; files given with -c (normally disk images)
+//	are copied, so each job writes its own.  If the shared OS image
+//	is a snapshot (see DLX_TRAP_SNAPSHOT in dlxsim) every job maps
+//	its memory copy-on-write, so the boot is done once and only the
+//	pages a job touches are read or copied.
+//
+//	The job file has one job per line: a name (which must be unique
+//	and is used for the job's directory) followed by the dlxsim
+//	arguments, split on white space.  Blank lines and lines starting
+//	with '#' are ignored.  For example:
+//
+//	    prio3	-x os.dlx.obj -a -u makeprocs.dlx.obj 3
+//	    ostests	-x os.dlx.obj -a -D F -u ostests.dlx.obj
+//
+//	A job passes if dlxsim exits with status 0 and, when -p is given,
+//	its console output contains the -p string.  Jobs still running
+//	after -t seconds are killed and fail.  The exit status is the
+//	number of failed jobs (at most 255).
+//
+//	Usage: dlxbatch [-j jobs] [-s dlxsim] [-o dir] [-t secs] [-p string]
+//			[-l file]... [-c file]... jobfile
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define	MAX_FILES	64
+#define	MAX_ARGS	64
+#define	MAX_PATH	1024
+
+typedef struct Job {
+  char		*name;
+  char		*argv[MAX_ARGS + 2];	// dlxsim, arguments, NULL
+  pid_t		pid;			// 0 if not running
+  double	start;			// wall clock seconds
+  double	elapsed;
+  int		status;			// from waitpid
+  int		killed;			// ran past the time limit
+  int		passed;
+  double	instrs;			// from dlxsim's exit statistics
+  double	simSecs;
+} Job;
+
+static Job	*jobs = NULL;
+static int	njobs = 0, maxjobs = 0;
+static const char	*linkFiles[MAX_FILES], *copyFiles[MAX_FILES];
+static int	nlinks = 0, ncopies = 0;
+static const char	*outDir = "batch.out";
+static const char	*passString = NULL;
+
+static
+double
+Now ()
+{
+  struct timeval	tv;
+
+  gettimeofday (&tv, NULL);
+  return (tv.tv_sec + tv.tv_usec / 1e6);
+}
+
+//----------------------------------------------------------------------
+//
+//	Absolute
+//
+//	Return an absolute version of a path, since jobs run in their
+//	own directories.
+//
+//----------------------------------------------------------------------
+static
+char *
+Absolute (const char *path)
+{
+  char		cwd[MAX_PATH], *p;
+
+  if (path[0] == '/') {
+    return (strdup (path));
+  }
+  if (getcwd (cwd, sizeof (cwd)) == NULL) {
+    perror ("getcwd");
+    exit (1);
+  }
+  p = (char *)malloc (strlen (cwd) + strlen (path) + 2);
+  sprintf (p, "%s/%s", cwd, path);
+  return (p);
+}
+
+static
+const char *
+BaseName (const char *path)
+{
+  const char	*p = strrchr (path, '/');
+
+  return ((p == NULL) ? path : p + 1);
+}
+
+//----------------------------------------------------------------------
+//
+//	ReadJobs
+//
+//	Read the job file.  Each job's argument vector starts with the
+//	simulator to run.
+//
+//----------------------------------------------------------------------
+static
+void
+ReadJobs (const char *file, const char *sim)
+{
+  FILE		*in;
+  char		line[2048], *tok;
+  Job		*j;
+  int		i, n, lineno = 0;
+
+  if ((in = fopen (file, "r")) == NULL) {
+    perror (file);
+    exit (1);
+  }
+  while (fgets (line, sizeof (line), in) != NULL) {
+    lineno++;
+    tok = strtok (line, " \t\r\n");
+    if ((tok == NULL) || (tok[0] == '#')) {
+      continue;
+    }
+    if ((strchr (tok, '/') != NULL) || !strcmp (tok, ".") ||
+	!strcmp (tok, "..")) {
+      fprintf (stderr, "%s:%d: bad job name %s\n", file, lineno, tok);
+      exit (1);
+    }
+    for (i = 0; i < njobs; i++) {
+      if (!strcmp (jobs[i].name, tok)) {
+	fprintf (stderr, "%s:%d: duplicate job name %s\n", file, lineno, tok);
+	exit (1);
+      }
+    }
+    if (njobs == maxjobs) {
+      maxjobs = (maxjobs == 0) ? 64 : maxjobs * 2;
+      jobs = (Job *)realloc (jobs, maxjobs * sizeof (Job));
+    }
+    j = &jobs[njobs++];
+    memset (j, 0, sizeof (*j));
+    j->name = strdup (tok);
+    j->argv[0] = (char *)sim;
+    for (n = 1; (tok = strtok (NULL, " \t\r\n")) != NULL; n++) {
+      if (n > MAX_ARGS) {
+	fprintf (stderr, "%s:%d: too many arguments\n", file, lineno);
+	exit (1);
+      }
+      j->argv[n] = strdup (tok);
+    }
+    j->argv[n] = NULL;
+  }
+  fclose (in);
+}
+
+//----------------------------------------------------------------------
+//
+//	CopyFile
+//
+//	Copy a file into a job directory.  Returns 0 on success.
+//
+//----------------------------------------------------------------------
+static
+int
+CopyFile (const char *from, const char *to)
+{
+  char		buf[65536];
+  int		in, out;
+  ssize_t	n;
+
+  if ((in = open (from, O_RDONLY)) < 0) {
+    return (-1);
+  }
+  if ((out = open (to, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+    close (in);
+    return (-1);
+  }
+  while ((n = read (in, buf, sizeof (buf))) > 0) {
+    if (write (out, buf, n) != n) {
+      n = -1;
+      break;
+    }
+  }
+  close (in);
+  close (out);
+  return ((n < 0) ? -1 : 0);
+}
+
+//----------------------------------------------------------------------
+//
+//	JobPath
+//
+//	Put dir/name in path, which holds MAX_PATH bytes.  A path that
+//	doesn't fit is an error rather than being cut short.
+//
+//----------------------------------------------------------------------
+static
+void
+JobPath (char *path, const char *dir, const char *name)
+{
+  int		n = snprintf (path, MAX_PATH, "%s/%s", dir, name);
+
+  if ((n < 0) || (n >= MAX_PATH)) {
+    fprintf (stderr, "dlxbatch: path %s/%s is too long\n", dir, name);
+    exit (1);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	StartJob
+//
+//	Set up a job's directory and start dlxsim in it, with stdout
+//	and stderr going to console.log and stdin from /dev/null.
+//
+//----------------------------------------------------------------------
+static
+void
+StartJob (Job *j)
+{
+  char		dir[MAX_PATH], path[MAX_PATH];
+  int		i, fd;
+
+  JobPath (dir, outDir, j->name);
+  if ((mkdir (dir, 0755) < 0) && (errno != EEXIST)) {
+    perror (dir);
+    exit (1);
+  }
+  for (i = 0; i < nlinks; i++) {
+    JobPath (path, dir, BaseName (linkFiles[i]));
+    unlink (path);
+    if (symlink (linkFiles[i], path) < 0) {
+      perror (path);
+      exit (1);
+    }
+  }
+  for (i = 0; i < ncopies; i++) {
+    JobPath (path, dir, BaseName (copyFiles[i]));
+    unlink (path);
+    if (CopyFile (copyFiles[i], path) < 0) {
+      perror (path);
+      exit (1);
+    }
+  }
+  fflush (stdout);
+  j->start = Now ();
+  if ((j->pid = fork ()) < 0) {
+    perror ("fork");
+    exit (1);
+  }
+  if (j->pid == 0) {
+    if (chdir (dir) < 0) {
+      perror (dir);
+      _exit (127);
+    }
+    if (((fd = open ("console.log", O_WRONLY | O_CREAT | O_TRUNC,
+		     0644)) < 0) ||
+	(dup2 (fd, 1) < 0) || (dup2 (fd, 2) < 0)) {
+      _exit (127);
+    }
+    close (fd);
+    if ((fd = open ("/dev/null", O_RDONLY)) >= 0) {
+      dup2 (fd, 0);
+      close (fd);
+    }
+    execvp (j->argv[0], j->argv);
+    perror (j->argv[0]);
+    _exit (127);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	FinishJob
+//
+//	Record how a job ended and pull its statistics out of its
+//	console log.
+//
+//----------------------------------------------------------------------
+static
+void
+FinishJob (Job *j, int status)
+{
+  FILE		*in;
+  char		path[MAX_PATH], line[1024];
+  int		found = (passString == NULL);
+
+  j->pid = 0;
+  j->status = status;
+  j->elapsed = Now () - j->start;
+  snprintf (path, sizeof (path), "%s/%s/console.log", outDir, j->name);
+  if ((in = fopen (path, "r")) != NULL) {
+    while (fgets (line, sizeof (line), in) != NULL) {
+      sscanf (line, "Instructions executed: %lf", &j->instrs);
+      sscanf (line, "Time simulated: %lf", &j->simSecs);
+      if (!found && (strstr (line, passString) != NULL)) {
+	found = 1;
+      }
+    }
+    fclose (in);
+  }
+  j->passed = !j->killed && WIFEXITED (status) &&
+    (WEXITSTATUS (status) == 0) && found;
+}
+
+static
+const char *
+JobResult (Job *j)
+{
+  static char	buf[32];
+
+  if (j->passed) {
+    return ("pass");
+  } else if (j->killed) {
+    return ("timeout");
+  } else if (WIFSIGNALED (j->status)) {
+    sprintf (buf, "signal %d", WTERMSIG (j->status));
+  } else if (WEXITSTATUS (j->status) != 0) {
+    sprintf (buf, "exit %d", WEXITSTATUS (j->status));
+  } else {
+    return ("no match");
+  }
+  return (buf);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char	*sim = "dlxsim";
+  int		parallel, timeLimit = 0, running = 0, next = 0;
+  int		i, status, failed = 0;
+  double	total = 0.0, instrs = 0.0, start;
+  long		ncpus;
+  pid_t		pid;
+
+  ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+  parallel = (ncpus > 0) ? (int)ncpus : 1;
+  for (i = 1; (i < argc - 1) && (argv[i][0] == '-'); i++) {
+    if (!strcmp (argv[i], "-j") && (i + 1 < argc - 1)) {
+      parallel = atoi (argv[++i]);
+    } else if (!strcmp (argv[i], "-s") && (i + 1 < argc - 1)) {
+      sim = argv[++i];
+    } else if (!strcmp (argv[i], "-o") && (i + 1 < argc - 1)) {
+      outDir = argv[++i];
+    } else if (!strcmp (argv[i], "-t") && (i + 1 < argc - 1)) {
+      timeLimit = atoi (argv[++i]);
+    } else if (!strcmp (argv[i], "-p") && (i + 1 < argc - 1)) {
+      passString = argv[++i];
+    } else if (!strcmp (argv[i], "-l") && (i + 1 < argc - 1) &&
+	       (nlinks < MAX_FILES)) {
+      linkFiles[nlinks++] = Absolute (argv[++i]);
+    } else if (!strcmp (argv[i], "-c") && (i + 1 < argc - 1) &&
+	       (ncopies < MAX_FILES)) {
+      copyFiles[ncopies++] = Absolute (argv[++i]);
+    } else {
+      break;
+    }
+  }
+  if ((i != argc - 1) || (parallel < 1)) {
+    fprintf (stderr, "Usage: %s [-j jobs] [-s dlxsim] [-o dir] [-t secs] "
+	     "[-p string]\n\t\t[-l file]... [-c file]... jobfile\n", argv[0]);
+    exit (1);
+  }
+  // A simulator named by a relative path must still be found from
+  // inside the job directories.
+  if (strchr (sim, '/') != NULL) {
+    sim = Absolute (sim);
+  }
+  ReadJobs (argv[i], sim);
+  if ((mkdir (outDir, 0755) < 0) && (errno != EEXIST)) {
+    perror (outDir);
+    exit (1);
+  }
+
+  start = Now ();
+  while ((next < njobs) || (running > 0)) {
+    while ((next < njobs) && (running < parallel)) {
+      StartJob (&jobs[next++]);
+      running++;
+    }
+    pid = waitpid (-1, &status, WNOHANG);
+    if (pid > 0) {
+      for (i = 0; i < next; i++) {
+	if (jobs[i].pid == pid) {
+	  FinishJob (&jobs[i], status);
+	  printf ("%-24s %s\n", jobs[i].name, JobResult (&jobs[i]));
+	  running--;
+	  break;
+	}
+      }
+      continue;
+    }
+    if (timeLimit > 0) {
+      for (i = 0; i < next; i++) {
+	if ((jobs[i].pid != 0) && !jobs[i].killed &&
+	    (Now () - jobs[i].start > timeLimit)) {
+	  jobs[i].killed = 1;
+	  kill (jobs[i].pid, SIGKILL);
+	}
+      }
+    }
+    usleep (10000);
+  }
+
+  printf ("\n%-24s %-10s %10s %14s %10s\n", "job", "result", "real secs",
+	  "instructions", "sim secs");
+  for (i = 0; i < njobs; i++) {
+    printf ("%-24s %-10s %10.2lf %14.0lf %10.3lf\n", jobs[i].name,
+	    JobResult (&jobs[i]), jobs[i].elapsed, jobs[i].instrs,
+	    jobs[i].simSecs);
+    total += jobs[i].elapsed;
+    instrs += jobs[i].instrs;
+    failed += !jobs[i].passed;
+  }
+  printf ("%d jobs, %d passed, %d failed; %.2lf job secs in "
+	  "%.2lf secs real (%d at a time), %.2lfM instructions per second.\n",
+	  njobs, njobs - failed, failed, total, Now () - start, parallel,
+	  instrs / 1e6 / (Now () - start));
+  return ((failed > 255) ? 255 : failed);
+}
@@ -0,0 +1,199 @@
+//
+//	dlxbench.cc
+//
+//	Measure how fast dlxsim interprets.  Runs the simbench program
+//	(apps/simbench in the fork tree) once for each of its workloads
+//	under each execution tier (DLXSIM_TIER; see "Interpreter
+//	policies" in dlxsim.cc) and prints a table of millions of
+//	simulated instructions per real second, from the statistics
+//	dlxsim prints as it exits.  Each measurement is the best of -r
+//	runs (default 3), and runs are one at a time so they don't compete
+//	for the host.  The "all" row is every instruction over every
+//	second for that tier.
+//
+//	The numbers include booting the OS, which is small next to the
+//	default scale (-n, passed on to simbench).  -w and -t pick a
+//	comma-separated subset of the workloads and tiers.
+//
+//	Usage: dlxbench [-s dlxsim] [-r runs] [-n scale] [-w workloads]
+//			[-t tiers] os.dlx.obj simbench.dlx.obj
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define	MAX_NAMES	16
+
+static const char	*workloads[MAX_NAMES] = {
+  "alu", "mem", "branch", "fp", "call", "trap"
+};
+static int	nworkloads = 6;
+static const char	*tiers[MAX_NAMES] = {
+  "plain", "decode", "block", "hot"
+};
+static int	ntiers = 4;
+
+//----------------------------------------------------------------------
+//
+//	SplitList
+//
+//	Split a comma-separated list into names.  Returns how many.
+//
+//----------------------------------------------------------------------
+static
+int
+SplitList (char *list, const char **names)
+{
+  char		*tok;
+  int		n = 0;
+
+  for (tok = strtok (list, ","); (tok != NULL) && (n < MAX_NAMES);
+       tok = strtok (NULL, ",")) {
+    names[n++] = tok;
+  }
+  return (n);
+}
+
+//----------------------------------------------------------------------
+//
+//	RunOnce
+//
+//	Run dlxsim with DLXSIM_TIER set to tier, reading its output for
+//	the instruction count and real time.  Returns 0 on success.
+//
+//----------------------------------------------------------------------
+static
+int
+RunOnce (char **argv, const char *tier, double *instrs, double *secs)
+{
+  FILE		*in;
+  char		line[1024];
+  int		fds[2], fd, status;
+  pid_t		pid;
+
+  *instrs = *secs = 0.0;
+  if (pipe (fds) < 0) {
+    perror ("pipe");
+    exit (1);
+  }
+  fflush (stdout);
+  if ((pid = fork ()) < 0) {
+    perror ("fork");
+    exit (1);
+  }
+  if (pid == 0) {
+    close (fds[0]);
+    if ((dup2 (fds[1], 1) < 0) || (dup2 (fds[1], 2) < 0)) {
+      _exit (127);
+    }
+    close (fds[1]);
+    if ((fd = open ("/dev/null", O_RDONLY)) >= 0) {
+      dup2 (fd, 0);
+      close (fd);
+    }
+    setenv ("DLXSIM_TIER", tier, 1);
+    execvp (argv[0], argv);
+    perror (argv[0]);
+    _exit (127);
+  }
+  close (fds[1]);
+  in = fdopen (fds[0], "r");
+  while (fgets (line, sizeof (line), in) != NULL) {
+    sscanf (line, "Instructions executed: %lf", instrs);
+    sscanf (line, "Real time elapsed: %lf", secs);
+  }
+  fclose (in);
+  waitpid (pid, &status, 0);
+  if (!WIFEXITED (status) || (WEXITSTATUS (status) != 0) ||
+      (*instrs <= 0.0) || (*secs <= 0.0)) {
+    return (-1);
+  }
+  return (0);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char	*sim = "dlxsim", *scale = "100";
+  char		*simArgv[16];
+  double	instrs, secs, best, bestInstrs;
+  double	tierInstrs[MAX_NAMES], tierSecs[MAX_NAMES];
+  int		runs = 3;
+  int		i, w, t, r;
+
+  for (i = 1; (i < argc - 2) && (argv[i][0] == '-'); i++) {
+    if (!strcmp (argv[i], "-s") && (i + 1 < argc - 2)) {
+      sim = argv[++i];
+    } else if (!strcmp (argv[i], "-r") && (i + 1 < argc - 2)) {
+      runs = atoi (argv[++i]);
+    } else if (!strcmp (argv[i], "-n") && (i + 1 < argc - 2)) {
+      scale = argv[++i];
+    } else if (!strcmp (argv[i], "-w") && (i + 1 < argc - 2)) {
+      nworkloads = SplitList (argv[++i], workloads);
+    } else if (!strcmp (argv[i], "-t") && (i + 1 < argc - 2)) {
+      ntiers = SplitList (argv[++i], tiers);
+    } else {
+      break;
+    }
+  }
+  if ((i != argc - 2) || (runs < 1) || (nworkloads < 1) || (ntiers < 1)) {
+    fprintf (stderr, "Usage: %s [-s dlxsim] [-r runs] [-n scale] "
+	     "[-w workloads]\n\t\t[-t tiers] os.dlx.obj simbench.dlx.obj\n",
+	     argv[0]);
+    exit (1);
+  }
+  simArgv[0] = (char *)sim;
+  simArgv[1] = (char *)"-x";
+  simArgv[2] = argv[i];
+  simArgv[3] = (char *)"-a";
+  simArgv[4] = (char *)"-u";
+  simArgv[5] = argv[i + 1];
+  simArgv[6] = NULL;		// the workload
+  simArgv[7] = (char *)scale;
+  simArgv[8] = NULL;
+
+  printf ("%-10s", "MIPS");
+  for (t = 0; t < ntiers; t++) {
+    printf (" %10s", tiers[t]);
+    tierInstrs[t] = tierSecs[t] = 0.0;
+  }
+  printf ("\n");
+  for (w = 0; w < nworkloads; w++) {
+    simArgv[6] = (char *)workloads[w];
+    printf ("%-10s", workloads[w]);
+    for (t = 0; t < ntiers; t++) {
+      best = bestInstrs = 0.0;
+      for (r = 0; r < runs; r++) {
+	if ((RunOnce (simArgv, tiers[t], &instrs, &secs) == 0) &&
+	    ((best == 0.0) || (secs < best))) {
+	  best = secs;
+	  bestInstrs = instrs;
+	}
+      }
+      if (best == 0.0) {
+	printf (" %10s", "failed");
+      } else {
+	printf (" %10.2lf", bestInstrs / 1e6 / best);
+	tierInstrs[t] += bestInstrs;
+	tierSecs[t] += best;
+      }
+      fflush (stdout);
+    }
+    printf ("\n");
+  }
+  printf ("%-10s", "all");
+  for (t = 0; t < ntiers; t++) {
+    if (tierSecs[t] > 0.0) {
+      printf (" %10.2lf", tierInstrs[t] / 1e6 / tierSecs[t]);
+    } else {
+      printf (" %10s", "-");
+    }
+  }
+  printf ("\n");
+  return (0);
+}
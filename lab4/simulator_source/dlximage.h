@@ -0,0 +1,70 @@
+//
+//	dlximage.h
+//
+//	Definitions for the binary DLX image format.  This is the same
+//	information as the hex text ".dlx.obj" format produced by dlxasm,
+//	but laid out so that a loader can fread each segment straight into
+//	memory instead of parsing two characters per byte.
+//
+//	All header words are stored big-endian (DLX byte order), so the
+//	OS can read them from a buffer without swapping.  The layout is:
+//
+//	word 0	DLX_IMAGE_MAGIC
+//	word 1	DLX_IMAGE_VERSION
+//	word 2	start address
+//	word 3	total size
+//	word 4	code start
+//	word 5	code size
+//	word 6	data start
+//	word 7	data size
+//	word 8	number of segments
+//
+//	followed by that many segments, each of which is a two word
+//	header (load address, length in bytes) followed by the bytes
+//	themselves.
+//
+
+#ifndef	_dlximage_h_
+#define	_dlximage_h_
+
+#define	DLX_IMAGE_MAGIC		0x444c5849	// "DLXI"
+#define	DLX_IMAGE_VERSION	1
+#define	DLX_IMAGE_HEADER_WORDS	9
+#define	DLX_IMAGE_HEADER_SIZE	(DLX_IMAGE_HEADER_WORDS * 4)
+#define	DLX_IMAGE_SEGHDR_WORDS	2
+#define	DLX_IMAGE_SEGHDR_SIZE	(DLX_IMAGE_SEGHDR_WORDS * 4)
+
+// Offsets (in words) of the header fields
+#define	DLX_IMAGE_MAGIC_WORD	0
+#define	DLX_IMAGE_VERSION_WORD	1
+#define	DLX_IMAGE_START_WORD	2
+#define	DLX_IMAGE_TOTAL_WORD	3
+#define	DLX_IMAGE_CODESTART_WORD 4
+#define	DLX_IMAGE_CODESIZE_WORD	5
+#define	DLX_IMAGE_DATASTART_WORD 6
+#define	DLX_IMAGE_DATASIZE_WORD	7
+#define	DLX_IMAGE_NSEGS_WORD	8
+
+static
+inline
+unsigned int
+DlxImageGetWord (const unsigned char *p, int word)
+{
+  p += word * 4;
+  return (((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+	  ((unsigned int)p[2] << 8) | (unsigned int)p[3]);
+}
+
+static
+inline
+void
+DlxImagePutWord (unsigned char *p, int word, unsigned int v)
+{
+  p += word * 4;
+  p[0] = (v >> 24) & 0xff;
+  p[1] = (v >> 16) & 0xff;
+  p[2] = (v >> 8) & 0xff;
+  p[3] = v & 0xff;
+}
+
+#endif	// _dlximage_h_
@@ -0,0 +1,160 @@
+//
+//	dlxobj2img.cc
+//
+//	Convert a hex text DLX executable (the ".dlx.obj" files written by
+//	dlxasm) into the binary image format described in dlximage.h.
+//	Both the simulator and the OS loader accept either format, so this
+//	is purely a speed optimization for loading.
+//
+//	Usage: dlxobj2img input.dlx.obj output.dlx.img
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include "dlximage.h"
+
+typedef struct Segment {
+  unsigned int	addr;		// load address of first byte
+  unsigned int	len;		// bytes currently in data
+  unsigned int	max;		// bytes allocated for data
+  unsigned char	*data;
+} Segment;
+
+static Segment	*segs = NULL;
+static int	nsegs = 0;
+static int	maxsegs = 0;
+
+static
+int
+getxvalue (int x)
+{
+  if ((x >= '0') && (x <= '9')) {
+    return (x - '0');
+  } else if ((x >= 'a') && (x <= 'f')) {
+    return (x + 10 - 'a');
+  } else if ((x >= 'A') && (x <= 'F')) {
+    return (x + 10 - 'A');
+  } else {
+    return (0);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	AddByte
+//
+//	Append a byte at the given address.  Consecutive addresses are
+//	kept in the same segment; any jump starts a new one.
+//
+//----------------------------------------------------------------------
+static
+void
+AddByte (unsigned int addr, unsigned char b)
+{
+  Segment	*s;
+
+  if ((nsegs == 0) || (segs[nsegs-1].addr + segs[nsegs-1].len != addr)) {
+    if (nsegs == maxsegs) {
+      maxsegs = (maxsegs == 0) ? 16 : maxsegs * 2;
+      segs = (Segment *)realloc (segs, maxsegs * sizeof (Segment));
+    }
+    s = &segs[nsegs++];
+    s->addr = addr;
+    s->len = 0;
+    s->max = 0;
+    s->data = NULL;
+  }
+  s = &segs[nsegs-1];
+  if (s->len == s->max) {
+    s->max = (s->max == 0) ? 4096 : s->max * 2;
+    s->data = (unsigned char *)realloc (s->data, s->max);
+  }
+  s->data[s->len++] = b;
+}
+
+int
+main (int argc, char *argv[])
+{
+  FILE		*in, *out;
+  char		buffer[200];
+  char		*pos;
+  unsigned int	addr = 0;
+  unsigned int	hdrvals[6];
+  unsigned char	hdr[DLX_IMAGE_HEADER_SIZE];
+  unsigned char	seghdr[DLX_IMAGE_SEGHDR_SIZE];
+  int		i;
+
+  if (argc != 3) {
+    fprintf (stderr, "Usage: %s input.dlx.obj output.dlx.img\n", argv[0]);
+    exit (1);
+  }
+  if ((in = fopen (argv[1], "r")) == NULL) {
+    perror (argv[1]);
+    exit (1);
+  }
+  if ((fgets (buffer, sizeof (buffer) - 1, in) == NULL) ||
+      (strstr (buffer, "start:") == NULL)) {
+    fprintf (stderr, "%s: missing start line (not a DLX executable?)\n",
+	     argv[1]);
+    exit (1);
+  }
+  // The start line holds the start address, total size, and the
+  // start & size of the code and data sections.  Older files may
+  // only have the start address.
+  pos = index (buffer, ':') + 1;
+  for (i = 0; i < 6; i++) {
+    hdrvals[i] = strtoul (pos, &pos, 16);
+  }
+  while (fgets (buffer, sizeof (buffer) - 1, in) != NULL) {
+    pos = buffer;
+    if (index (buffer, ':') == NULL) {
+      continue;
+    }
+    if (*pos != ':') {
+      addr = strtoul (pos, &pos, 16);
+    }
+    if (*pos != ':') {
+      fprintf (stderr, "Error reading data file near:\n%s\n", buffer);
+      exit (1);
+    }
+    pos++;	// skip past colon
+    while (1) {
+      while (isspace (*pos)) {
+	pos++;
+      }
+      if (!(isxdigit (*pos) && isxdigit (*(pos+1)))) {
+	break;
+      }
+      AddByte (addr, (getxvalue(*pos) * 16) + getxvalue(*(pos+1)));
+      pos += 2;
+      addr++;
+    }
+  }
+  fclose (in);
+
+  if ((out = fopen (argv[2], "wb")) == NULL) {
+    perror (argv[2]);
+    exit (1);
+  }
+  DlxImagePutWord (hdr, DLX_IMAGE_MAGIC_WORD, DLX_IMAGE_MAGIC);
+  DlxImagePutWord (hdr, DLX_IMAGE_VERSION_WORD, DLX_IMAGE_VERSION);
+  for (i = 0; i < 6; i++) {
+    DlxImagePutWord (hdr, DLX_IMAGE_START_WORD + i, hdrvals[i]);
+  }
+  DlxImagePutWord (hdr, DLX_IMAGE_NSEGS_WORD, nsegs);
+  fwrite (hdr, 1, sizeof (hdr), out);
+  for (i = 0; i < nsegs; i++) {
+    DlxImagePutWord (seghdr, 0, segs[i].addr);
+    DlxImagePutWord (seghdr, 1, segs[i].len);
+    fwrite (seghdr, 1, sizeof (seghdr), out);
+    fwrite (segs[i].data, 1, segs[i].len, out);
+  }
+  if (fclose (out) != 0) {
+    perror (argv[2]);
+    exit (1);
+  }
+  printf ("%s: %d segments\n", argv[2], nsegs);
+  return (0);
+}
@@ -0,0 +1,276 @@
+//
+//	dlxprof.cc
+//
+//	Turn a dlxsim PC profile (written when DLXSIM_PROFILE is set) into
+//	a flat profile by function, or into collapsed stacks for flame
+//	graph tools.  System mode samples are looked up in the symbols
+//	given with -k (normally the OS's .lst file) and user mode samples
+//	in those given with -u.  Only the sampled PC is known, so each
+//	collapsed "stack" is just the mode (and, for user code, the process'
+//	page table base) and the function.
+//
+//	Symbol files are read loosely so that assembler listings, symbol
+//	tables and nm output all work: any line holding a hex address
+//	(optionally 0x-prefixed) and a name that starts with '_' or ends
+//	in ':' defines a symbol.  A leading '_' is dropped from C names.
+//
+//	Usage: dlxprof [-c] [-n count] [-k os.lst] [-u prog.lst] profile
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+typedef struct Symbol {
+  unsigned int	addr;
+  char		*name;
+} Symbol;
+
+typedef struct SymTab {
+  Symbol	*syms;
+  int		nsyms;
+  int		max;
+} SymTab;
+
+typedef struct Bucket {
+  char		*key;		// "mode function"
+  double	count;
+} Bucket;
+
+static SymTab	osSyms, userSyms;
+static Bucket	*buckets = NULL;
+static int	nbuckets = 0, maxbuckets = 0;
+
+static
+int
+IsHex (const char *s, unsigned int *v)
+{
+  const char	*p = s;
+
+  if ((p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X'))) {
+    p += 2;
+  }
+  if (*p == '\0') {
+    return (0);
+  }
+  for (s = p; *s != '\0'; s++) {
+    if (!isxdigit (*s)) {
+      return (0);
+    }
+  }
+  // Short tokens are line numbers and counts, not addresses.
+  if (strlen (p) < 4) {
+    return (0);
+  }
+  *v = strtoul (p, NULL, 16);
+  return (1);
+}
+
+static
+void
+SymAdd (SymTab *t, unsigned int addr, const char *name)
+{
+  if (t->nsyms == t->max) {
+    t->max = (t->max == 0) ? 256 : t->max * 2;
+    t->syms = (Symbol *)realloc (t->syms, t->max * sizeof (Symbol));
+  }
+  t->syms[t->nsyms].addr = addr;
+  t->syms[t->nsyms].name = strdup (name);
+  t->nsyms++;
+}
+
+static
+int
+SymCompare (const void *a, const void *b)
+{
+  const Symbol	*sa = (const Symbol *)a;
+  const Symbol	*sb = (const Symbol *)b;
+
+  return ((sa->addr < sb->addr) ? -1 : (sa->addr > sb->addr));
+}
+
+//----------------------------------------------------------------------
+//
+//	SymLoad
+//
+//	Read the symbols in a listing or symbol table file.
+//
+//----------------------------------------------------------------------
+static
+void
+SymLoad (SymTab *t, const char *file)
+{
+  FILE		*in;
+  char		line[1024], name[256];
+  char		*tok;
+  unsigned int	addr, v;
+  int		haveAddr, len;
+
+  if ((in = fopen (file, "r")) == NULL) {
+    perror (file);
+    exit (1);
+  }
+  while (fgets (line, sizeof (line), in) != NULL) {
+    haveAddr = 0;
+    name[0] = '\0';
+    addr = 0;
+    for (tok = strtok (line, " \t\r\n"); tok != NULL;
+	 tok = strtok (NULL, " \t\r\n")) {
+      len = strlen (tok);
+      if ((name[0] == '\0') && (len < (int)sizeof (name)) &&
+	  ((tok[0] == '_') || ((len > 1) && (tok[len-1] == ':') &&
+			       !IsHex (tok, &v)))) {
+	strcpy (name, tok);
+	if (name[len-1] == ':') {
+	  name[len-1] = '\0';
+	}
+      } else if (!haveAddr && IsHex (tok, &v)) {
+	addr = v;
+	haveAddr = 1;
+      }
+    }
+    if (haveAddr && (name[0] != '\0')) {
+      SymAdd (t, addr, (name[0] == '_') ? name + 1 : name);
+    }
+  }
+  fclose (in);
+  qsort (t->syms, t->nsyms, sizeof (Symbol), SymCompare);
+}
+
+//----------------------------------------------------------------------
+//
+//	SymLookup
+//
+//	Return the name of the function containing addr: the symbol with
+//	the highest address not above it.
+//
+//----------------------------------------------------------------------
+static
+const char *
+SymLookup (SymTab *t, unsigned int addr)
+{
+  int		lo = 0, hi = t->nsyms - 1, mid;
+
+  if ((t->nsyms == 0) || (addr < t->syms[0].addr)) {
+    return (NULL);
+  }
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (t->syms[mid].addr <= addr) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return (t->syms[lo].name);
+}
+
+static
+void
+BucketAdd (const char *key, double count)
+{
+  int		i;
+
+  for (i = 0; i < nbuckets; i++) {
+    if (!strcmp (buckets[i].key, key)) {
+      buckets[i].count += count;
+      return;
+    }
+  }
+  if (nbuckets == maxbuckets) {
+    maxbuckets = (maxbuckets == 0) ? 256 : maxbuckets * 2;
+    buckets = (Bucket *)realloc (buckets, maxbuckets * sizeof (Bucket));
+  }
+  buckets[nbuckets].key = strdup (key);
+  buckets[nbuckets].count = count;
+  nbuckets++;
+}
+
+static
+int
+BucketCompare (const void *a, const void *b)
+{
+  const Bucket	*ba = (const Bucket *)a;
+  const Bucket	*bb = (const Bucket *)b;
+
+  if (ba->count != bb->count) {
+    return ((ba->count > bb->count) ? -1 : 1);
+  }
+  return (strcmp (ba->key, bb->key));
+}
+
+int
+main (int argc, char *argv[])
+{
+  FILE		*in;
+  char		line[256], key[512], unknown[32];
+  const char	*fn;
+  unsigned int	count, pgtbl, pc;
+  char		mode;
+  int		collapsed = 0, top = 40, i;
+  double	total = 0.0, usr = 0.0;
+
+  for (i = 1; (i < argc - 1) && (argv[i][0] == '-'); i++) {
+    if (!strcmp (argv[i], "-c")) {
+      collapsed = 1;
+    } else if (!strcmp (argv[i], "-n") && (i + 1 < argc - 1)) {
+      top = atoi (argv[++i]);
+    } else if (!strcmp (argv[i], "-k") && (i + 1 < argc - 1)) {
+      SymLoad (&osSyms, argv[++i]);
+    } else if (!strcmp (argv[i], "-u") && (i + 1 < argc - 1)) {
+      SymLoad (&userSyms, argv[++i]);
+    } else {
+      break;
+    }
+  }
+  if (i != argc - 1) {
+    fprintf (stderr, "Usage: %s [-c] [-n count] [-k os.lst] [-u prog.lst] "
+	     "profile\n", argv[0]);
+    exit (1);
+  }
+  if ((in = fopen (argv[i], "r")) == NULL) {
+    perror (argv[i]);
+    exit (1);
+  }
+  while (fgets (line, sizeof (line), in) != NULL) {
+    if ((line[0] == '#') ||
+	(sscanf (line, "%u %c %x %x", &count, &mode, &pgtbl, &pc) != 4)) {
+      continue;
+    }
+    fn = SymLookup ((mode == 'u') ? &userSyms : &osSyms, pc);
+    if (fn == NULL) {
+      sprintf (unknown, "0x%08x", pc);
+      fn = unknown;
+    }
+    if (mode == 'u') {
+      sprintf (key, collapsed ? "user-%x;%s" : "u:%x %s", pgtbl, fn);
+      usr += count;
+    } else {
+      sprintf (key, collapsed ? "os;%s" : "s %s", fn);
+    }
+    BucketAdd (key, count);
+    total += count;
+  }
+  fclose (in);
+
+  qsort (buckets, nbuckets, sizeof (Bucket), BucketCompare);
+  if (collapsed) {
+    for (i = 0; i < nbuckets; i++) {
+      printf ("%s %.0lf\n", buckets[i].key, buckets[i].count);
+    }
+    return (0);
+  }
+  if (total == 0.0) {
+    printf ("No samples.\n");
+    return (0);
+  }
+  printf ("%.0lf samples, %.1lf%% user, %.1lf%% system\n", total,
+	  100.0 * usr / total, 100.0 * (total - usr) / total);
+  printf ("%10s %7s  %s\n", "samples", "%", "mode function");
+  for (i = 0; (i < nbuckets) && (i < top); i++) {
+    printf ("%10.0lf %6.2lf%%  %s\n", buckets[i].count,
+	    100.0 * buckets[i].count / total, buckets[i].key);
+  }
+  return (0);
+}
@@ -18,1716 +18,2914 @@ static char rcsid[] = "$Id: dlxsim.cc,v 1.2 2000/09/20 22:16:34 elm Exp elm $";
 #include <ctype.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "dlx.h"
+#include "dlximage.h"
+#include "dlxtrace.h"
 
 extern int errno;
 char	debug[100];
 
+static void DecodeCacheFlush ();
+static void ProfileInit ();
+static void BlockCacheFlush ();
+static void PerfSetMode (int user);
+static uint32 DiskRegRead (uint32 paddr);
+static void DiskRegWrite (uint32 paddr, uint32 val, unsigned char *mem,
+			  uint32 memsize, double usPerInst);
+static void TlbFlush ();
+static void TlbNoteSregWrite (uint32 sreg, uint32 oldval, uint32 newval);
+static void XlateModeUpdate (uint32 status);
+static uint32 *SmpSharedMemory ();
+static void CacheInit (uint32 memsize);
+static void CostInit ();
+static void HeatInit (uint32 memsize);
+static void MmioInit ();
+
 //----------------------------------------------------------------------
 //
-//	Cpu::Cpu
+//	Interpreter policies
 //
-//	Create a new CPU.
+//	The instruction fetch path (ExecOne and VaddrToPaddr) is written
+//	once as a template and instantiated twice.  DlxFastPolicy is what
+//	normal runs use: every debug print and trace test in it is a
+//	compile-time constant false and disappears.  DlxTracePolicy is
+//	picked instead, once, on the first instruction, if a debug string
+//	was given (-D) or tracing was turned on.
 //
-//----------------------------------------------------------------------
-Cpu::Cpu (int msize)
-{
-  int		i;
-  struct timeval t;
-
-  flags = 0;
-  usElapsed = 0.0;
-  instrsExecuted = 0.0;
-  usPerInst = 1.0;
-  for (i = 0; i < 32; i++) {
-    sreg[i] = 0;
-    ireg[i] = 0;
-    freg[i] = 0;
-  }
-  SetStatusBit (DLX_STATUS_PAGE_TABLE);
-  SetStatusBit (DLX_STATUS_SYSMODE);
-  EnableInterrupts ();
-  timerInterrupt = DLX_TIMER_NOT_ACTIVE;
-  memSize = msize;
-  memory = new uint32[msize/sizeof(uint32)];
-  basicBlockStart = 1;	// basic block can never start at address 1!
-  // Initialize the keyboard I/O stuff.
-  kbdbufferedchars = 0;
-  kbdrpos = kbdwpos = 0;
-  kbdcounter = 0;
-  SetupRawIo ();
-  //Zheng, add (timezone *)
-  //gettimeofday (&t, (timezone*)(void *)0);
-  gettimeofday (&t, (void *)0);
-  realElapsed = (double)t.tv_sec + ((double)t.tv_usec) * 1e-6;
-}
-
-//----------------------------------------------------------------------
+//	DLXSIM_TIER caps how much of that machinery a run may use, so the
+//	tiers can be timed against each other (dlxbench does this):
 //
-//	TraceFile
+//	  plain   DlxTracePolicy, decoding every instruction it fetches
+//	  decode  DlxTracePolicy with the predecoded instruction cache
+//	  block   DlxFastPolicy, running cached blocks but never hot ops
+//	  hot     everything (the default)
 //
-//	Open the passed file name for tracing.  If the file is NULL,
-//	open stdout.
+//	Anything that needs DlxTracePolicy still gets it, whatever the
+//	tier.
 //
 //----------------------------------------------------------------------
-int
-Cpu::TraceFile (char *name)
-{
-  if ((name == NULL) || (!strcmp (name, "-"))) {
-    tracefp = stdout;
-    return (1);
-  } else if ((tracefp = fopen (name, "w")) == NULL) {
-    return (0);
-  } else {
-    return (1);
-  }
-}
-
+struct DlxFastPolicy {
+  enum { instrumented = 0 };
+};
+
+struct DlxTracePolicy {
+  enum { instrumented = 1 };
+};
+
+#define	DLX_EXEC_UNDECIDED	0
+#define	DLX_EXEC_FAST		1
+#define	DLX_EXEC_INSTRUMENTED	2
+
+static int	dlxExecMode = DLX_EXEC_UNDECIDED;
+
+#define	DLX_TIER_PLAIN		0
+#define	DLX_TIER_DECODE		1
+#define	DLX_TIER_BLOCK		2
+#define	DLX_TIER_HOT		3
+
+static const char *dlxTierNames[] = { "plain", "decode", "block", "hot" };
+static int	dlxTier = DLX_TIER_HOT;
+
+// DBPRINTF for code templated on a policy; the test is resolved at
+// compile time.
+#define	PDBPRINTF(args...)	\
+  do { if (Policy::instrumented) { DBPRINTF (args); } } while (0)
+
 //----------------------------------------------------------------------
 //
-//	Instruction parsing functions
+//	Event queue
 //
-//	These functions take an instruction and return the relevant fields.
+//	Rather than polling the keyboard counter and comparing the timer
+//	against a double on every instruction, each source of interrupts
+//	schedules an event at an instruction count.  ExecOne only does an
+//	integer compare against the earliest pending event and handles
+//	the devices when it is reached; everything else runs straight
+//	through.  An event that is due while interrupts are masked stays
+//	due, so it is looked at again on each instruction until the
+//	interrupt level drops, exactly as before.
+//
+//	usElapsed and instrsExecuted are brought up to date from the
+//	instruction count (DLX_SYNC_TIME) at event boundaries and whenever
+//	someone needs to read them.
+//
+//	The count is really of cycles: the cache and cost models can add
+//	stall cycles, in which no instruction runs, with CycleStall.  Those
+//	move time and the events along with it, but instrsExecuted only
+//	gets the cycles that weren't stalls.
 //
 //----------------------------------------------------------------------
-inline
+typedef unsigned long long DlxCycle;
+
+#define	DLX_EVENT_KBD		0	// keyboard poll
+#define	DLX_EVENT_TIMER		1	// timer interrupt
+#define	DLX_EVENT_DISK		2	// disk I/O completion
+#define	DLX_EVENT_PROFILE	3	// PC sample
+#define	DLX_EVENT_IPI		4	// inter-processor interrupt
+#define	DLX_EVENT_SMP		5	// end of this core's quantum
+#define	DLX_EVENT_CONSOLE	6	// console output flush
+#define	DLX_NUM_EVENTS		7
+#define	DLX_EVENT_NEVER		(~(DlxCycle)0)
+
+static DlxCycle	dlxCycle = 0;		// cycles (instructions + stalls) so far
+static DlxCycle	dlxCycleSynced = 0;	// dlxCycle at last DLX_SYNC_TIME
+static DlxCycle	dlxStalls = 0;		// stall cycles in dlxCycle
+static DlxCycle	dlxStallsSynced = 0;	// dlxStalls at last DLX_SYNC_TIME
+static DlxCycle	eventWhen[DLX_NUM_EVENTS];
+static DlxCycle	eventNext = 0;		// min over eventWhen[]
+
+static
 void
-Cpu::GetRFields (uint32 inst, uint32& src1, uint32& src2, uint32& dst)
+EventRecalcNext ()
 {
-  src1 = (inst >> DLX_RFMT_SRC1_SHIFT) & DLX_REG_MASK;
-  src2 = (inst >> DLX_RFMT_SRC2_SHIFT) & DLX_REG_MASK;
-  dst = (inst >> DLX_RFMT_DST_SHIFT) & DLX_REG_MASK;
+  int		i;
+
+  eventNext = DLX_EVENT_NEVER;
+  for (i = 0; i < DLX_NUM_EVENTS; i++) {
+    if (eventWhen[i] < eventNext) {
+      eventNext = eventWhen[i];
+    }
+  }
 }
 
-inline
+static
 void
-Cpu::GetIFields (uint32 inst, uint32& src, uint32& imm, uint32& dst)
+EventSchedule (int ev, DlxCycle when)
 {
-  src = (inst >> DLX_IFMT_SRC_SHIFT) & DLX_REG_MASK;
-  dst = (inst >> DLX_IFMT_DST_SHIFT) & DLX_REG_MASK;
-  imm = (inst >> DLX_IFMT_IMM_SHIFT) & 0xffff;
+  eventWhen[ev] = when;
+  if (when < eventNext) {
+    eventNext = when;
+  } else {
+    EventRecalcNext ();
+  }
 }
 
+static
 inline
 void
-Cpu::GetJFields (uint32 inst, uint32& jaddr)
+EventCancel (int ev)
 {
-  jaddr = inst & 0x1ffffff;
-  if (jaddr & 0x1000000) {
-    jaddr |= 0xfe000000;
-  }
+  EventSchedule (ev, DLX_EVENT_NEVER);
 }
 
+static
 inline
+int
+EventDue (int ev)
+{
+  return (eventWhen[ev] <= dlxCycle);
+}
+
+static
 void
-Cpu::SignExtend16 (uint32& v)
+EventInit ()
 {
-  if (v & 0x8000) {
-    v |= 0xffff0000;
+  int		i;
+
+  for (i = 0; i < DLX_NUM_EVENTS; i++) {
+    eventWhen[i] = DLX_EVENT_NEVER;
   }
+  // The old code polled once every DLX_KBD_FREQUENCY+2 instructions.
+  eventWhen[DLX_EVENT_KBD] = dlxCycle + DLX_KBD_FREQUENCY + 2;
+  EventRecalcNext ();
 }
 
+static
 inline
 void
-Cpu::SignExtend8 (uint32& v)
+CycleStall (DlxCycle n)
 {
-  if (v & 0x80) {
-    v |= 0xffffff00;
-  }
+  dlxCycle += n;
+  dlxStalls += n;
 }
-
+
+// Member functions only: fold cycles run since the last sync into the
+// floating point counters.
+#define	DLX_SYNC_TIME()							\
+  do {									\
+    double	_n = (double)(dlxCycle - dlxCycleSynced);		\
+    instrsExecuted += _n - (double)(dlxStalls - dlxStallsSynced);	\
+    usElapsed += _n * usPerInst;					\
+    dlxCycleSynced = dlxCycle;						\
+    dlxStallsSynced = dlxStalls;					\
+  } while (0)
+
 //----------------------------------------------------------------------
 //
-//	Cpu::Jump
+//	PC profiler
 //
-//	Jump to a particular location after dealing with the delay
-//	slot.  Checks to ensure that the jump address could be valid
-//	(ie, is on a word boundary).  It doesn't check to ensure that
-//	the jump destination is valid; that's done on the first instruction
-//	fetch to follow.
+//	If DLXSIM_PROFILE is set to "file" or "file,interval", the PC is
+//	sampled every interval instructions (default 1000) by the
+//	DLX_EVENT_PROFILE event, along with the mode and the page table
+//	base, which tells processes apart.  Samples are counted in a hash
+//	table and written to the file at exit as lines of
+//	"count mode pgtbl pc", mode being u or s.  dlxprof turns that into
+//	flat and collapsed profiles using the assembler's symbol listings.
 //
 //----------------------------------------------------------------------
-inline
-int
-Cpu::Jump (uint32 jmpDst)
+#define	DLX_PROF_TABLE_SIZE	(1 << 16)	// must be a power of 2
+#define	DLX_PROF_DEFAULT_INTERVAL 1000
+
+typedef struct DlxProfEntry {
+  uint32	pc;
+  uint32	pgtbl;
+  uint32	user;
+  uint32	count;			// 0 if the slot is empty
+} DlxProfEntry;
+
+static DlxProfEntry	*profTable = NULL;
+static DlxCycle		profInterval = 0;	// 0 if not profiling
+static char		profFile[256];
+static double		profDropped = 0.0;	// samples that didn't fit
+
+static
+void
+ProfileWrite ()
 {
-  if ((jmpDst & 0x3) == 0) {
-    DBPRINTF ('j', "Jump from 0x%x to 0x%x.\n", PC(), jmpDst);
-    OutputBasicBlock (jmpDst);
-    SetPC (jmpDst);
-  } else {
-    CauseException (DLX_EXC_ADDRESS);
+  FILE		*out;
+  int		i;
+
+  if ((out = fopen (profFile, "w")) == NULL) {
+    perror (profFile);
+    return;
   }
-  return (1);
+  fprintf (out, "# dlxsim profile interval %llu dropped %.0lf\n",
+	   profInterval, profDropped);
+  for (i = 0; i < DLX_PROF_TABLE_SIZE; i++) {
+    if (profTable[i].count != 0) {
+      fprintf (out, "%u %c %x %x\n", profTable[i].count,
+	       profTable[i].user ? 'u' : 's', profTable[i].pgtbl,
+	       profTable[i].pc);
+    }
+  }
+  fclose (out);
+}
+
+static
+void
+ProfileInit ()
+{
+  const char	*env = getenv ("DLXSIM_PROFILE");
+  char		*comma;
+
+  if ((env == NULL) || (env[0] == '\0') || (profTable != NULL)) {
+    return;
+  }
+  strncpy (profFile, env, sizeof (profFile) - 1);
+  profInterval = DLX_PROF_DEFAULT_INTERVAL;
+  if ((comma = strchr (profFile, ',')) != NULL) {
+    *comma = '\0';
+    profInterval = strtoul (comma + 1, NULL, 0);
+    if (profInterval == 0) {
+      profInterval = DLX_PROF_DEFAULT_INTERVAL;
+    }
+  }
+  profTable = (DlxProfEntry *)calloc (DLX_PROF_TABLE_SIZE,
+				      sizeof (DlxProfEntry));
+  if (profTable == NULL) {
+    printf ("FATAL ERROR: no memory for the profiler.\n");
+    exit (1);
+  }
+  EventSchedule (DLX_EVENT_PROFILE, dlxCycle + profInterval);
+  atexit (ProfileWrite);
+}
+
+static
+void
+ProfileSample (uint32 pc, uint32 user, uint32 pgtbl)
+{
+  uint32	h = ((pc >> 2) ^ (pgtbl >> 8) ^ (user << 15)) * 2654435761u;
+  int		i, slot;
+
+  for (i = 0; i < 8; i++) {
+    slot = (h + i) & (DLX_PROF_TABLE_SIZE - 1);
+    if (profTable[slot].count == 0) {
+      profTable[slot].pc = pc;
+      profTable[slot].pgtbl = pgtbl;
+      profTable[slot].user = user;
+      profTable[slot].count = 1;
+      return;
+    }
+    if ((profTable[slot].pc == pc) && (profTable[slot].pgtbl == pgtbl) &&
+	(profTable[slot].user == user)) {
+      profTable[slot].count++;
+      return;
+    }
+  }
+  profDropped += 1.0;
 }
 
-
 //----------------------------------------------------------------------
 //
-//	Instruction functions
-//
-//	These functions implement individual instructions.  They return
-//	the number of instructions executed, which will either be 1 if the
-//	instruction completed successfully or 0 if the instruction caused
-//	an exception.
+//	Host I/O thread
 //
-//	Since the instructions are pretty simple (and similar), they won't
-//	be documented extensively except for the more complex ones.
-//----------------------------------------------------------------------
-
-//----------------------------------------------------------------------
+//	Host file I/O for the device backends (the DMA disk's image and
+//	a console file) runs on a thread of its own, so a slow read or
+//	write never stalls the interpreter.  A device posts an IoJob when
+//	the guest starts an operation and collects it with IoWait when
+//	the operation's simulated completion comes due; the interpreter
+//	only waits if the host took longer than the modelled latency.
+//	Jobs run one at a time in the order they were posted, and each
+//	job is posted again only after IoWait, so the queue never holds
+//	more than one of each.  DLXSIM_IOTHREAD=0 runs every job in
+//	place when it's posted instead.
 //
-//	Generic ALU R-R instructions
+//	The thread is only built with USE_IO_THREAD set to 1 (compile
+//	with -DUSE_IO_THREAD=1 -pthread).  Otherwise every job runs in
+//	place, as with DLXSIM_IOTHREAD=0, and dlxsim links without
+//	pthreads as it always has.
 //
 //----------------------------------------------------------------------
+#ifndef	USE_IO_THREAD
+#define	USE_IO_THREAD	0
+#endif
+
+typedef struct IoJob {
+  void		(*run) (struct IoJob *job);
+  int		busy;		// posted and not finished
+  int		ok;		// what run left, once finished
+} IoJob;
+
+#if USE_IO_THREAD
+#include <pthread.h>
+
+#define	DLX_IO_MAXJOBS	4
+
+static pthread_mutex_t	ioLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	ioWork = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	ioDone = PTHREAD_COND_INITIALIZER;
+static IoJob		*ioQueue[DLX_IO_MAXJOBS];
+static int		ioHead = 0;
+static int		ioCount = 0;	// queued, including the one running
+static int		ioThreaded = -1;	// -1 until IoInit
+
 static
-int
-InstAdd (uint32 inst, Cpu *cpu)
+void *
+IoThread (void *arg)
 {
-  uint32	src1, src2, dst;
-  uint32	v1, v2, result;
+  IoJob		*job;
 
-  cpu->GetRFields (inst, src1, src2, dst);
-  v1 = cpu->GetIreg(src1);
-  v2 = cpu->GetIreg(src2);
-  result = v1 + v2;
-  cpu->PutIreg (dst, result);
-  // Overflow if sign of result isn't the same as sign of operands
-  if (((v1 & 0x80000000) == (v2 & 0x80000000)) &&
-      ((v1 & 0x80000000) != (result & 0x80000000))) {
-    cpu->CauseException (DLX_EXC_OVERFLOW);
+  pthread_mutex_lock (&ioLock);
+  while (1) {
+    while (ioCount == 0) {
+      pthread_cond_wait (&ioWork, &ioLock);
+    }
+    job = ioQueue[ioHead];
+    pthread_mutex_unlock (&ioLock);
+    (job->run) (job);
+    pthread_mutex_lock (&ioLock);
+    ioHead = (ioHead + 1) % DLX_IO_MAXJOBS;
+    ioCount--;
+    job->busy = 0;
+    pthread_cond_broadcast (&ioDone);
   }
-  // Instruction isn't redone after exception
-  return (1);
+  return (NULL);
 }
 
 static
-int
-InstSub (uint32 inst, Cpu *cpu)
+void
+IoInit ()
 {
-  uint32	src1, src2, dst;
-  uint32	v1, v2, result;
+  const char	*env = getenv ("DLXSIM_IOTHREAD");
+  pthread_t	tid;
 
-  cpu->GetRFields (inst, src1, src2, dst);
-  v1 = cpu->GetIreg(src1);
-  v2 = cpu->GetIreg(src2);
-  result = v1 - v2;
-  cpu->PutIreg (dst, result);
-  // Overflow if sign of result isn't the same as sign of first operand,
-  // and if second operand has the opposite sign.
-  if (((v1 & 0x80000000) != (v2 & 0x80000000)) &&
-      ((v1 & 0x80000000) != (result & 0x80000000))) {
-    cpu->CauseException (DLX_EXC_OVERFLOW);
+  if (ioThreaded >= 0) {
+    return;
+  }
+  ioThreaded = (env == NULL) || (atoi (env) != 0);
+  if (ioThreaded && (pthread_create (&tid, NULL, IoThread, NULL) != 0)) {
+    fprintf (stderr, "Couldn't start the host I/O thread; doing I/O inline.\n");
+    ioThreaded = 0;
+  }
+  if (ioThreaded) {
+    pthread_detach (tid);
   }
-  // Instruction isn't redone after exception
-  return (1);
 }
 
 static
-int
-InstAddu (uint32 inst, Cpu *cpu)
+void
+IoPost (IoJob *job)
 {
-  uint32	src1, src2, dst;
-  uint32	v1, v2, result;
-
-  cpu->GetRFields (inst, src1, src2, dst);
-  v1 = cpu->GetIreg(src1);
-  v2 = cpu->GetIreg(src2);
-  result = v1 + v2;
-  cpu->PutIreg (dst, result);
-  return (1);
+  IoInit ();
+  if (!ioThreaded) {
+    (job->run) (job);
+    return;
+  }
+  pthread_mutex_lock (&ioLock);
+  job->busy = 1;
+  ioQueue[(ioHead + ioCount) % DLX_IO_MAXJOBS] = job;
+  ioCount++;
+  pthread_cond_signal (&ioWork);
+  pthread_mutex_unlock (&ioLock);
 }
 
+// Waits for job, if it was posted, to finish.
 static
-int
-InstSubu (uint32 inst, Cpu *cpu)
+void
+IoWait (IoJob *job)
 {
-  uint32	src1, src2, dst;
-  uint32	v1, v2, result;
+  if (ioThreaded <= 0) {
+    return;
+  }
+  pthread_mutex_lock (&ioLock);
+  while (job->busy) {
+    pthread_cond_wait (&ioDone, &ioLock);
+  }
+  pthread_mutex_unlock (&ioLock);
+}
+#else	// !USE_IO_THREAD
+static
+void
+IoPost (IoJob *job)
+{
+  (job->run) (job);
+}
 
-  cpu->GetRFields (inst, src1, src2, dst);
-  v1 = cpu->GetIreg(src1);
-  v2 = cpu->GetIreg(src2);
-  result = v1 - v2;
-  cpu->PutIreg (dst, result);
-  return (1);
+static
+void
+IoWait (IoJob *job)
+{
 }
-
+#endif	// USE_IO_THREAD
+
 //----------------------------------------------------------------------
 //
-//	Immediate arithmetic functions
+//	Console output
+//
+//	Output from the printf trap (and pre-formatted buffers the OS
+//	sends with DLX_TRAP_CONSWRITE) collects in consBuf instead of
+//	going out with an fflush per call.  The buffer is written when it
+//	fills, on a newline if the console is a terminal, at exit, and
+//	from DLX_EVENT_CONSOLE so output never sits for more than
+//	DLX_CONS_FLUSH_CYCLES instructions.  With debugging output on,
+//	everything goes straight out so the two stay in order.
+//
+//	If DLXSIM_CONSOLE names a file, console output goes there rather
+//	than to stdout, and the buffer is written by the host I/O thread.
+//	Output to stdout is still written in place, so it stays in order
+//	with the simulator's own messages.  ConsSync waits for whatever
+//	the thread hasn't written yet.
 //
 //----------------------------------------------------------------------
+#define	DLX_CONS_BUFSIZE	8192
+#define	DLX_CONS_FLUSH_CYCLES	1000000
+
+typedef struct ConsIo {
+  IoJob		job;		// must be first
+  char		buf[DLX_CONS_BUFSIZE];
+  int		n;
+} ConsIo;
+
+static char	consBuf[DLX_CONS_BUFSIZE];
+static int	consUsed = 0;
+static FILE	*consFp = NULL;
+static int	consLineMode = 0;	// flush at each newline
+static int	consAsync = 0;		// written by the host I/O thread
+static ConsIo	consIo;
+
 static
-int
-InstAddi (uint32 inst, Cpu *cpu)
+void
+ConsIoRun (IoJob *job)
 {
-  uint32	src1, dst, imm;
-  uint32	v1, result;
+  ConsIo	*c = (ConsIo *)job;
 
-  cpu->GetIFields (inst, src1, imm, dst);
-  cpu->SignExtend16 (imm);
-  v1 = cpu->GetIreg(src1);
-  result = v1 + imm;
-  cpu->PutIreg (dst, result);
-  // Overflow if sign of result isn't the same as sign of operands
-  if (((v1 & 0x80000000) == (imm & 0x80000000)) &&
-      ((v1 & 0x80000000) != (result & 0x80000000))) {
-    cpu->CauseException (DLX_EXC_OVERFLOW);
-  }
-  // Instruction isn't redone after exception
-  return (1);
+  job->ok = (fwrite (c->buf, 1, c->n, consFp) == (size_t)c->n) &&
+    (fflush (consFp) == 0);
 }
 
 static
-int
-InstSubi (uint32 inst, Cpu *cpu)
+void
+ConsFlush ()
 {
-  uint32	src1, dst, imm;
-  uint32	v1, result;
-
-  cpu->GetIFields (inst, src1, imm, dst);
-  cpu->SignExtend16 (imm);
-  v1 = cpu->GetIreg(src1);
-  result = v1 - imm;
-  cpu->PutIreg (dst, result);
-  // Overflow if sign of result isn't the same as sign of first operand,
-  // and if second operand has the opposite sign.
-  if (((v1 & 0x80000000) != (imm & 0x80000000)) &&
-      ((v1 & 0x80000000) != (result & 0x80000000))) {
-    cpu->CauseException (DLX_EXC_OVERFLOW);
+  if (consAsync) {
+    if (consUsed > 0) {
+      IoWait (&consIo.job);
+      memcpy (consIo.buf, consBuf, consUsed);
+      consIo.n = consUsed;
+      consUsed = 0;
+      IoPost (&consIo.job);
+    }
+  } else {
+    if (consUsed > 0) {
+      fwrite (consBuf, 1, consUsed, consFp);
+      consUsed = 0;
+    }
+    fflush (consFp);
   }
-  // Instruction isn't redone after exception
-  return (1);
+  EventCancel (DLX_EVENT_CONSOLE);
 }
 
+// Flushes the console and waits until it's all written.
 static
-int
-InstAddui (uint32 inst, Cpu *cpu)
+void
+ConsSync ()
 {
-  uint32	src1, imm, dst;
-  uint32	v1, result;
-
-  cpu->GetIFields (inst, src1, imm, dst);
-  // XXX: do we sign extend values for addui?
-  // cpu->SignExtend16 (imm);
-  v1 = cpu->GetIreg(src1);
-  result = v1 + imm;
-  cpu->PutIreg (dst, result);
-  return (1);
+  ConsFlush ();
+  IoWait (&consIo.job);
 }
 
 static
-int
-InstSubui (uint32 inst, Cpu *cpu)
+void
+ConsInit ()
 {
-  uint32	src1, imm, dst;
-  uint32	v1, result;
+  const char	*env = getenv ("DLXSIM_CONSOLE");
 
-  cpu->GetIFields (inst, src1, imm, dst);
-  // XXX: do we sign extend values for subui?
-  // cpu->SignExtend16 (imm);
-  v1 = cpu->GetIreg(src1);
-  result = v1 - imm;
-  cpu->PutIreg (dst, result);
-  return (1);
+  if (consFp != NULL) {
+    return;
+  }
+  consFp = stdout;
+  if ((env != NULL) && (env[0] != '\0')) {
+    if ((consFp = fopen (env, "w")) == NULL) {
+      printf ("FATAL ERROR: couldn't open console file %s.\n", env);
+      exit (1);
+    }
+  }
+  consLineMode = isatty (fileno (consFp));
+  consAsync = (consFp != stdout);
+  consIo.job.run = ConsIoRun;
+  atexit (ConsSync);
 }
-
-//----------------------------------------------------------------------
-//
-//	R-R logical functions
-//
-//----------------------------------------------------------------------
 
 static
-int
-InstAnd (uint32 inst, Cpu *cpu)
+void
+ConsWrite (const char *s, int n)
 {
-  uint32	src1, src2, dst;
-
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, cpu->GetIreg(src1) & cpu->GetIreg(src2));
-  return (1);
+  const char	*nl;
+
+  if (n > DLX_CONS_BUFSIZE - consUsed) {
+    ConsSync ();
+    if (n > DLX_CONS_BUFSIZE) {
+      fwrite (s, 1, n, consFp);
+      fflush (consFp);
+      return;
+    }
+  }
+  if ((consUsed == 0) && (n > 0)) {
+    EventSchedule (DLX_EVENT_CONSOLE, dlxCycle + DLX_CONS_FLUSH_CYCLES);
+  }
+  memcpy (consBuf + consUsed, s, n);
+  consUsed += n;
+  nl = (const char *)memchr (s, '\n', n);
+  if ((debug[0] != '\0') || (consLineMode && (nl != NULL))) {
+    ConsFlush ();
+  }
 }
 
-static
-int
-InstOr (uint32 inst, Cpu *cpu)
-{
-  uint32	src1, src2, dst;
-
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, cpu->GetIreg(src1) | cpu->GetIreg(src2));
-  return (1);
-}
+//----------------------------------------------------------------------
+//
+//	Event record and replay
+//
+//	Everything the simulator does is a function of the instruction
+//	count except keyboard input, which depends on when the host
+//	delivers it.  If DLXSIM_RECORD names a file, every keyboard poll
+//	that finds input is logged there as
+//
+//		K <cycle> <pc> <result> [<byte> ...]
+//
+//	(all hex but the cycle), giving the instruction count, the PC it
+//	was taken at, what the poll returned and the characters it read.
+//	If DLXSIM_REPLAY names such a log, the host keyboard is ignored
+//	and each logged poll is replayed at the same instruction count,
+//	so timer, disk and keyboard interrupts all land exactly where
+//	they did before.  If the PC doesn't match (a different kernel
+//	build, say), the input is still delivered at the same count and
+//	a warning is printed once.
+//
+//----------------------------------------------------------------------
+#define	DLX_REPLAY_MAXCHARS	64
+
+typedef struct DlxReplayRec {
+  DlxCycle	cycle;
+  uint32	pc;
+  int		result;
+  int		nchars;
+  unsigned char	chars[DLX_REPLAY_MAXCHARS];
+} DlxReplayRec;
+
+static FILE		*recordFp = NULL;
+static FILE		*replayFp = NULL;
+static DlxReplayRec	replayNext;
+static int		replayDone = 1;		// no more records
+static int		replayWarned = 0;
 
 static
-int
-InstXor (uint32 inst, Cpu *cpu)
+void
+ReplayRead ()
 {
-  uint32	src1, src2, dst;
+  char		line[512], *p, *end;
 
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, cpu->GetIreg(src1) ^ cpu->GetIreg(src2));
-  return (1);
+  replayDone = 1;
+  while (fgets (line, sizeof (line), replayFp) != NULL) {
+    if (line[0] != 'K') {
+      continue;
+    }
+    replayNext.cycle = strtoull (line + 1, &p, 10);
+    replayNext.pc = strtoul (p, &p, 16);
+    replayNext.result = strtol (p, &p, 16);
+    for (replayNext.nchars = 0; replayNext.nchars < DLX_REPLAY_MAXCHARS;
+	 replayNext.nchars++) {
+      replayNext.chars[replayNext.nchars] = strtoul (p, &end, 16);
+      if (end == p) {
+	break;
+      }
+      p = end;
+    }
+    replayDone = 0;
+    return;
+  }
 }
 
 static
-int
-InstSll (uint32 inst, Cpu *cpu)
+void
+ReplayInit ()
 {
-  uint32	src1, src2, dst;
-  uint32	v1, v2;
+  const char	*rec = getenv ("DLXSIM_RECORD");
+  const char	*rep = getenv ("DLXSIM_REPLAY");
 
-  cpu->GetRFields (inst, src1, src2, dst);
-  v1 = cpu->GetIreg(src1);
-  v2 = cpu->GetIreg(src2) & 0x1f;
-  cpu->PutIreg (dst, v1 << v2);
-  return (1);
+  if ((recordFp != NULL) || (replayFp != NULL)) {
+    return;
+  }
+  if ((rec != NULL) && (rec[0] != '\0')) {
+    if ((recordFp = fopen (rec, "w")) == NULL) {
+      printf ("FATAL ERROR: couldn't open event record file %s.\n", rec);
+      exit (1);
+    }
+    fprintf (recordFp, "# dlxsim event log\n");
+  }
+  if ((rep != NULL) && (rep[0] != '\0')) {
+    if ((replayFp = fopen (rep, "r")) == NULL) {
+      printf ("FATAL ERROR: couldn't open event replay file %s.\n", rep);
+      exit (1);
+    }
+    ReplayRead ();
+  }
 }
 
-static
+//----------------------------------------------------------------------
+//
+//	Cpu::KbdPoll
+//
+//	Check for keyboard input, logging or replaying it as above.
+//	Returns what GetCharIfAvail would.
+//
+//----------------------------------------------------------------------
 int
-InstSra (uint32 inst, Cpu *cpu)
+Cpu::KbdPoll ()
 {
-  uint32	src1, src2, dst;
-  uint32	v1, v2, result;
+  int		r, w, i;
 
-  cpu->GetRFields (inst, src1, src2, dst);
-  v1 = cpu->GetIreg(src1);
-  v2 = cpu->GetIreg(src2) & 0x1f;
-  result = v1 >> v2;
-  // stick in sign bits if operand is negative
-  if (v1 & 0x80000000) {
-    result |= ((1 << v2) - 1) << (32 - v2);
+  if (replayFp != NULL) {
+    if (replayDone || (replayNext.cycle > dlxCycle)) {
+      return (0);
+    }
+    if (((replayNext.cycle != dlxCycle) || (replayNext.pc != PC()-4)) &&
+	!replayWarned) {
+      printf ("Warning: replay diverged at instruction %llu (pc 0x%x, "
+	      "logged %llu at 0x%x).\n", dlxCycle, PC()-4, replayNext.cycle,
+	      replayNext.pc);
+      replayWarned = 1;
+    }
+    for (i = 0; (i < replayNext.nchars) &&
+	   (kbdbufferedchars < DLX_KBD_BUFFER_SIZE); i++) {
+      kbdbuffer[kbdwpos++] = replayNext.chars[i];
+      kbdwpos %= DLX_KBD_BUFFER_SIZE;
+      kbdbufferedchars++;
+    }
+    r = replayNext.result;
+    ReplayRead ();
+    return (r);
   }
-  cpu->PutIreg (dst, result);
-  return (1);
+  w = kbdwpos;
+  r = GetCharIfAvail ();
+  if ((recordFp != NULL) && (r || (kbdwpos != w))) {
+    fprintf (recordFp, "K %llu %x %x", dlxCycle, PC()-4, r);
+    for (i = 0; (w != kbdwpos) && (i < DLX_REPLAY_MAXCHARS); i++) {
+      fprintf (recordFp, " %02x", kbdbuffer[w]);
+      w = (w + 1) % DLX_KBD_BUFFER_SIZE;
+    }
+    fprintf (recordFp, "\n");
+  }
+  return (r);
 }
 
-static
-int
-InstSrl (uint32 inst, Cpu *cpu)
+//----------------------------------------------------------------------
+//
+//	Cpu::Cpu
+//
+//	Create a new CPU.
+//
+//----------------------------------------------------------------------
+Cpu::Cpu (int msize)
 {
-  uint32	src1, src2, dst;
-  uint32	v1, v2;
+  int		i, secondary;
+  struct timeval t;
 
-  cpu->GetRFields (inst, src1, src2, dst);
-  v1 = cpu->GetIreg(src1);
-  v2 = cpu->GetIreg(src2) & 0x1f;
-  cpu->PutIreg (dst, v1 >> v2);
-  return (1);
+  flags = 0;
+  usElapsed = 0.0;
+  instrsExecuted = 0.0;
+  usPerInst = 1.0;
+  for (i = 0; i < 32; i++) {
+    sreg[i] = 0;
+    ireg[i] = 0;
+    freg[i] = 0;
+  }
+  SetStatusBit (DLX_STATUS_PAGE_TABLE);
+  SetStatusBit (DLX_STATUS_SYSMODE);
+  EnableInterrupts ();
+  timerInterrupt = DLX_TIMER_NOT_ACTIVE;
+  memSize = msize;
+  // Secondary SMP cores share the boot core's memory.
+  memory = SmpSharedMemory ();
+  secondary = (memory != NULL);
+  if (!secondary) {
+    memory = new uint32[msize/sizeof(uint32)];
+  }
+  basicBlockStart = 1;	// basic block can never start at address 1!
+  DecodeCacheFlush ();
+  BlockCacheFlush ();
+  TlbFlush ();
+  // Initialize the keyboard I/O stuff.
+  kbdbufferedchars = 0;
+  kbdrpos = kbdwpos = 0;
+  kbdcounter = 0;
+  EventInit ();
+  ProfileInit ();
+  ConsInit ();
+  ReplayInit ();
+  CacheInit (msize);
+  CostInit ();
+  HeatInit (msize);
+  MmioInit ();
+  if (!secondary) {
+    SetupRawIo ();
+  }
+  //Zheng, add (timezone *)
+  //gettimeofday (&t, (timezone*)(void *)0);
+  gettimeofday (&t, (void *)0);
+  realElapsed = (double)t.tv_sec + ((double)t.tv_usec) * 1e-6;
 }
 
 //----------------------------------------------------------------------
 //
-//	Immediate logical functions
+//	Binary trace writer
+//
+//	When the trace file is a binary trace (see dlxtrace.h), records
+//	are collected in traceBuf and written out a buffer at a time.
+//	The buffer is flushed (and a gzip pipe closed) at exit.
 //
 //----------------------------------------------------------------------
+#define	DLX_TRACE_BUFSIZE	(1 << 20)
+
+static int		traceBinary = 0;
+static int		tracePiped = 0;
+static FILE		*traceBinFp = NULL;
+static unsigned char	traceBuf[DLX_TRACE_BUFSIZE];
+static int		traceBufUsed = 0;
+static uint32		tracePrevBlock = 0;
+static uint32		tracePrevAddr = 0;
+
 static
-int
-InstAndi (uint32 inst, Cpu *cpu)
+void
+TraceBinFlush ()
 {
-  uint32	src1, imm, dst;
-
-  cpu->GetIFields (inst, src1, imm, dst);
-  cpu->PutIreg (dst, cpu->GetIreg(src1) & imm);
-  return (1);
+  if (traceBufUsed > 0) {
+    if (fwrite (traceBuf, 1, traceBufUsed, traceBinFp) !=
+	(size_t)traceBufUsed) {
+      printf ("FATAL ERROR: failed writing binary trace.\n");
+      exit (1);
+    }
+    traceBufUsed = 0;
+  }
 }
 
 static
-int
-InstOri (uint32 inst, Cpu *cpu)
+void
+TraceBinClose ()
 {
-  uint32	src1, imm, dst;
-
-  cpu->GetIFields (inst, src1, imm, dst);
-  cpu->PutIreg (dst, cpu->GetIreg(src1) | imm);
-  return (1);
+  if (traceBinFp == NULL) {
+    return;
+  }
+  TraceBinFlush ();
+  if (tracePiped) {
+    pclose (traceBinFp);
+  } else if (traceBinFp != stdout) {
+    fclose (traceBinFp);
+  } else {
+    fflush (traceBinFp);
+  }
+  traceBinFp = NULL;
+  traceBinary = 0;
 }
 
 static
-int
-InstXori (uint32 inst, Cpu *cpu)
+inline
+void
+TraceBinRecord (int type, int op, int reg, uint32 a, uint32 b)
 {
-  uint32	src1, imm, dst;
+  unsigned char	*r;
 
-  cpu->GetIFields (inst, src1, imm, dst);
-  cpu->PutIreg (dst, cpu->GetIreg(src1) ^ imm);
-  return (1);
+  if (traceBufUsed + DLX_TRACE_RECSIZE > DLX_TRACE_BUFSIZE) {
+    TraceBinFlush ();
+  }
+  r = traceBuf + traceBufUsed;
+  r[0] = type;
+  r[1] = op;
+  r[2] = reg;
+  r[3] = 0;
+  DlxTracePutWord (r, 1, a);
+  DlxTracePutWord (r, 2, b);
+  traceBufUsed += DLX_TRACE_RECSIZE;
 }
 
+// Access names are string literals, so remembering which pointer
+// matched which entry avoids the strcmp on all but the first use.
 static
 int
-InstSlli (uint32 inst, Cpu *cpu)
+TraceOpIndex (const char *name)
 {
-  uint32	src1, imm, dst;
-  uint32	v1;
+  static const char	*seen[DLX_TRACE_NUM_OPS];
+  int			i;
 
-  cpu->GetIFields (inst, src1, imm, dst);
-  v1 = cpu->GetIreg(src1);
-  imm &= 0x1f;
-  cpu->PutIreg (dst, v1 << imm);
-  return (1);
+  for (i = 1; i < DLX_TRACE_NUM_OPS; i++) {
+    if (seen[i] == name) {
+      return (i);
+    }
+  }
+  for (i = 1; i < DLX_TRACE_NUM_OPS; i++) {
+    if (!strcmp (dlxTraceOps[i], name)) {
+      seen[i] = name;
+      return (i);
+    }
+  }
+  return (0);
 }
 
+//----------------------------------------------------------------------
+//
+//	TraceControl
+//
+//	Write a trap, rfe or exception record in whichever format the
+//	trace is in.
+//
+//----------------------------------------------------------------------
 static
-int
-InstSrai (uint32 inst, Cpu *cpu)
+void
+TraceControl (FILE *fp, int type, uint32 a, uint32 b)
 {
-  uint32	src1, imm, dst;
-  uint32	v1, result;
-
-  cpu->GetIFields (inst, src1, imm, dst);
-  v1 = cpu->GetIreg(src1);
-  imm &= 0x1f;
-  result = v1 >> imm;
-  // stick in sign bits if operand is negative
-  if (v1 & 0x80000000) {
-    result |= ((1 << imm) - 1) << (32 - imm);
+  if (traceBinary) {
+    TraceBinRecord (type, 0, 0, a, b);
+  } else {
+    fprintf (fp, "%c %x %x\n", type, a, b);
   }
-  cpu->PutIreg (dst, result);
-  return (1);
 }
 
-static
+//----------------------------------------------------------------------
+//
+//	TraceFile
+//
+//	Open the passed file name for tracing.  If the file is NULL,
+//	open stdout.  Names ending in DLX_TRACE_BINARY_SUFFIX get a
+//	binary trace, and names ending in DLX_TRACE_BINARY_SUFFIX ".gz"
+//	get one compressed through gzip.
+//
+//----------------------------------------------------------------------
 int
-InstSrli (uint32 inst, Cpu *cpu)
+Cpu::TraceFile (char *name)
 {
-  uint32	src1, imm, dst;
-  uint32	v1;
-
-  cpu->GetIFields (inst, src1, imm, dst);
-  v1 = cpu->GetIreg(src1);
-  imm &= 0x1f;
-  cpu->PutIreg (dst, v1 >> imm);
+  static int	registered = 0;
+  unsigned char	hdr[DLX_TRACE_HEADER_SIZE];
+  char		cmd[1024];
+  int		len, slen;
+
+  // Tracing needs the instrumented interpreter; let ExecOne decide
+  // again on the next instruction.
+  dlxExecMode = DLX_EXEC_UNDECIDED;
+  TraceBinClose ();
+  if ((name == NULL) || (!strcmp (name, "-"))) {
+    tracefp = stdout;
+    return (1);
+  }
+  len = strlen (name);
+  slen = strlen (DLX_TRACE_BINARY_SUFFIX);
+  tracePiped = 0;
+  if ((len > slen + 3) && !strcmp (name + len - 3, ".gz") &&
+      !strncmp (name + len - 3 - slen, DLX_TRACE_BINARY_SUFFIX, slen)) {
+    if (len + 32 > (int)sizeof (cmd)) {
+      return (0);
+    }
+    sprintf (cmd, "gzip -c > '%s'", name);
+    if ((tracefp = popen (cmd, "w")) == NULL) {
+      return (0);
+    }
+    tracePiped = 1;
+  } else if ((tracefp = fopen (name, "w")) == NULL) {
+    return (0);
+  } else if ((len <= slen) || strcmp (name + len - slen,
+					DLX_TRACE_BINARY_SUFFIX)) {
+    return (1);
+  }
+  traceBinary = 1;
+  traceBinFp = tracefp;
+  traceBufUsed = 0;
+  tracePrevBlock = tracePrevAddr = 0;
+  DlxTracePutWord (hdr, 0, DLX_TRACE_MAGIC);
+  DlxTracePutWord (hdr, 1, DLX_TRACE_VERSION);
+  DlxTracePutWord (hdr, 2, DLX_TRACE_RECSIZE);
+  DlxTracePutWord (hdr, 3, 0);
+  memcpy (traceBuf, hdr, sizeof (hdr));
+  traceBufUsed = sizeof (hdr);
+  if (!registered) {
+    atexit (TraceBinClose);
+    registered = 1;
+  }
   return (1);
 }
+
+//----------------------------------------------------------------------
+//
+//	Instruction parsing functions
+//
+//	These functions take an instruction and return the relevant fields.
+//
+//----------------------------------------------------------------------
+inline
+void
+Cpu::GetRFields (uint32 inst, uint32& src1, uint32& src2, uint32& dst)
+{
+  src1 = (inst >> DLX_RFMT_SRC1_SHIFT) & DLX_REG_MASK;
+  src2 = (inst >> DLX_RFMT_SRC2_SHIFT) & DLX_REG_MASK;
+  dst = (inst >> DLX_RFMT_DST_SHIFT) & DLX_REG_MASK;
+}
 
-static
-int
-InstLhi (uint32 inst, Cpu *cpu)
+inline
+void
+Cpu::GetIFields (uint32 inst, uint32& src, uint32& imm, uint32& dst)
 {
-  uint32	src, dst, imm;
+  src = (inst >> DLX_IFMT_SRC_SHIFT) & DLX_REG_MASK;
+  dst = (inst >> DLX_IFMT_DST_SHIFT) & DLX_REG_MASK;
+  imm = (inst >> DLX_IFMT_IMM_SHIFT) & 0xffff;
+}
 
-  cpu->GetIFields (inst, src, imm, dst);
-  cpu->PutIreg (dst, imm << 16);
-  return (1);
+inline
+void
+Cpu::GetJFields (uint32 inst, uint32& jaddr)
+{
+  jaddr = inst & 0x1ffffff;
+  if (jaddr & 0x1000000) {
+    jaddr |= 0xfe000000;
+  }
+}
+
+inline
+void
+Cpu::SignExtend16 (uint32& v)
+{
+  if (v & 0x8000) {
+    v |= 0xffff0000;
+  }
+}
+
+inline
+void
+Cpu::SignExtend8 (uint32& v)
+{
+  if (v & 0x80) {
+    v |= 0xffffff00;
+  }
 }
 
 //----------------------------------------------------------------------
 //
-//	R-R set instructions
+//	Cpu::Jump
+//
+//	Jump to a particular location after dealing with the delay
+//	slot.  Checks to ensure that the jump address could be valid
+//	(ie, is on a word boundary).  It doesn't check to ensure that
+//	the jump destination is valid; that's done on the first instruction
+//	fetch to follow.
 //
 //----------------------------------------------------------------------
-static
+inline
 int
-InstSeq (uint32 inst, Cpu *cpu)
+Cpu::Jump (uint32 jmpDst)
 {
-  uint32	src1, src2, dst;
-
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, (cpu->GetIreg(src1) == cpu->GetIreg(src2)) ? 1 : 0);
+  if ((jmpDst & 0x3) == 0) {
+    DBPRINTF ('j', "Jump from 0x%x to 0x%x.\n", PC(), jmpDst);
+    OutputBasicBlock (jmpDst);
+    SetPC (jmpDst);
+  } else {
+    CauseException (DLX_EXC_ADDRESS);
+  }
   return (1);
 }
 
+
+//----------------------------------------------------------------------
+//
+//	Instruction functions
+//
+//	These functions implement individual instructions.  They return
+//	the number of instructions executed, which will either be 1 if the
+//	instruction completed successfully or 0 if the instruction caused
+//	an exception.
+//
+//	Since the instructions are pretty simple (and similar), they won't
+//	be documented extensively except for the more complex ones.
+//----------------------------------------------------------------------
+
+//----------------------------------------------------------------------
+//
+//	Generic ALU R-R instructions
+//
+//----------------------------------------------------------------------
 static
 int
-InstSne (uint32 inst, Cpu *cpu)
+InstAdd (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+  uint32	v1, v2, result;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, (cpu->GetIreg(src1) != cpu->GetIreg(src2)) ? 1 : 0);
+  v1 = cpu->GetIreg(src1);
+  v2 = cpu->GetIreg(src2);
+  result = v1 + v2;
+  cpu->PutIreg (dst, result);
+  // Overflow if sign of result isn't the same as sign of operands
+  if (((v1 & 0x80000000) == (v2 & 0x80000000)) &&
+      ((v1 & 0x80000000) != (result & 0x80000000))) {
+    cpu->CauseException (DLX_EXC_OVERFLOW);
+  }
+  // Instruction isn't redone after exception
   return (1);
 }
 
 static
 int
-InstSlt (uint32 inst, Cpu *cpu)
+InstSub (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+  uint32	v1, v2, result;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) < (int)cpu->GetIreg(src2))
-		? 1 : 0);
+  v1 = cpu->GetIreg(src1);
+  v2 = cpu->GetIreg(src2);
+  result = v1 - v2;
+  cpu->PutIreg (dst, result);
+  // Overflow if sign of result isn't the same as sign of first operand,
+  // and if second operand has the opposite sign.
+  if (((v1 & 0x80000000) != (v2 & 0x80000000)) &&
+      ((v1 & 0x80000000) != (result & 0x80000000))) {
+    cpu->CauseException (DLX_EXC_OVERFLOW);
+  }
+  // Instruction isn't redone after exception
   return (1);
 }
-static
-int
-InstSgt (uint32 inst, Cpu *cpu)
-{
-  uint32	src1, src2, dst;
 
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) > (int)cpu->GetIreg(src2))
-		? 1 : 0);
-  return (1);
-}
 static
 int
-InstSle (uint32 inst, Cpu *cpu)
+InstAddu (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+  uint32	v1, v2, result;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) <= (int)cpu->GetIreg(src2))
-		? 1 : 0);
+  v1 = cpu->GetIreg(src1);
+  v2 = cpu->GetIreg(src2);
+  result = v1 + v2;
+  cpu->PutIreg (dst, result);
   return (1);
 }
+
 static
 int
-InstSge (uint32 inst, Cpu *cpu)
+InstSubu (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+  uint32	v1, v2, result;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) >= (int)cpu->GetIreg(src2))
-		? 1 : 0);
+  v1 = cpu->GetIreg(src1);
+  v2 = cpu->GetIreg(src2);
+  result = v1 - v2;
+  cpu->PutIreg (dst, result);
   return (1);
 }
 
 //----------------------------------------------------------------------
 //
-//	Immediate set instructions
+//	Immediate arithmetic functions
 //
 //----------------------------------------------------------------------
 static
 int
-InstSeqi (uint32 inst, Cpu *cpu)
+InstAddi (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, imm, dst;
+  uint32	src1, dst, imm;
+  uint32	v1, result;
 
   cpu->GetIFields (inst, src1, imm, dst);
   cpu->SignExtend16 (imm);
-  cpu->PutIreg (dst, (cpu->GetIreg(src1) == imm) ? 1 : 0);
+  v1 = cpu->GetIreg(src1);
+  result = v1 + imm;
+  cpu->PutIreg (dst, result);
+  // Overflow if sign of result isn't the same as sign of operands
+  if (((v1 & 0x80000000) == (imm & 0x80000000)) &&
+      ((v1 & 0x80000000) != (result & 0x80000000))) {
+    cpu->CauseException (DLX_EXC_OVERFLOW);
+  }
+  // Instruction isn't redone after exception
   return (1);
 }
 
 static
 int
-InstSnei (uint32 inst, Cpu *cpu)
+InstSubi (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, imm, dst;
+  uint32	src1, dst, imm;
+  uint32	v1, result;
 
   cpu->GetIFields (inst, src1, imm, dst);
   cpu->SignExtend16 (imm);
-  cpu->PutIreg (dst, (cpu->GetIreg(src1) != imm) ? 1 : 0);
+  v1 = cpu->GetIreg(src1);
+  result = v1 - imm;
+  cpu->PutIreg (dst, result);
+  // Overflow if sign of result isn't the same as sign of first operand,
+  // and if second operand has the opposite sign.
+  if (((v1 & 0x80000000) != (imm & 0x80000000)) &&
+      ((v1 & 0x80000000) != (result & 0x80000000))) {
+    cpu->CauseException (DLX_EXC_OVERFLOW);
+  }
+  // Instruction isn't redone after exception
   return (1);
 }
 
 static
 int
-InstSlti (uint32 inst, Cpu *cpu)
+InstAddui (uint32 inst, Cpu *cpu)
 {
   uint32	src1, imm, dst;
+  uint32	v1, result;
 
   cpu->GetIFields (inst, src1, imm, dst);
-  cpu->SignExtend16 (imm);
-  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) < (int)imm) ? 1 : 0);
+  // XXX: do we sign extend values for addui?
+  // cpu->SignExtend16 (imm);
+  v1 = cpu->GetIreg(src1);
+  result = v1 + imm;
+  cpu->PutIreg (dst, result);
   return (1);
 }
 
 static
 int
-InstSgti (uint32 inst, Cpu *cpu)
+InstSubui (uint32 inst, Cpu *cpu)
 {
   uint32	src1, imm, dst;
+  uint32	v1, result;
 
   cpu->GetIFields (inst, src1, imm, dst);
-  cpu->SignExtend16 (imm);
-  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) > (int)imm) ? 1 : 0);
+  // XXX: do we sign extend values for subui?
+  // cpu->SignExtend16 (imm);
+  v1 = cpu->GetIreg(src1);
+  result = v1 - imm;
+  cpu->PutIreg (dst, result);
   return (1);
 }
+
+//----------------------------------------------------------------------
+//
+//	R-R logical functions
+//
+//----------------------------------------------------------------------
 
 static
 int
-InstSlei (uint32 inst, Cpu *cpu)
+InstAnd (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, imm, dst;
+  uint32	src1, src2, dst;
 
-  cpu->GetIFields (inst, src1, imm, dst);
-  cpu->SignExtend16 (imm);
-  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) <= (int)imm) ? 1 : 0);
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutIreg (dst, cpu->GetIreg(src1) & cpu->GetIreg(src2));
   return (1);
 }
 
 static
 int
-InstSgei (uint32 inst, Cpu *cpu)
-{
-  uint32	src1, imm, dst;
-
-  cpu->GetIFields (inst, src1, imm, dst);
-  cpu->SignExtend16 (imm);
-  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) >= (int)imm) ? 1 : 0);
-  return (1);
-}
-
-//----------------------------------------------------------------------
-//
-//	Load instructions
-//
-//----------------------------------------------------------------------
-static
-int
-InstLw (uint32 inst, Cpu *cpu)
+InstOr (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val;
+  uint32	src1, src2, dst;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->ReadWord (addr, val)) {
-    return (0);
-  }
-  DBPRINTF ('l', "Loading word 0x%08x from location 0x%x.\n", val, addr);
-  cpu->TraceAccess("lw", dst, addr, val);
-  cpu->PutIreg (dst, val);
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutIreg (dst, cpu->GetIreg(src1) | cpu->GetIreg(src2));
   return (1);
 }
 
 static
 int
-InstLh (uint32 inst, Cpu *cpu)
+InstXor (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val;
-  static int	shiftcount[4] = {16, 16, 0, 0};
+  uint32	src1, src2, dst;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // Half-word accesses must be 2-byte aligned
-  if ((addr & 0x1) == 1) {
-    cpu->CauseException (DLX_EXC_ADDRESS);
-    return (0);
-  }
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
-    return (0);
-  }
-  val >>= shiftcount[addr & 0x3];
-  DBPRINTF ('l',"Loading signed half 0x%04x from location 0x%x.\n", val, addr);
-  cpu->TraceAccess("lh", dst, addr, val);
-  cpu->SignExtend16 (val);
-  cpu->PutIreg (dst, val);
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutIreg (dst, cpu->GetIreg(src1) ^ cpu->GetIreg(src2));
   return (1);
 }
 
 static
 int
-InstLhu (uint32 inst, Cpu *cpu)
+InstSll (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val;
-  static int	shiftcount[4] = {16, 16, 0, 0};
+  uint32	src1, src2, dst;
+  uint32	v1, v2;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // Half-word accesses must be 2-byte aligned
-  if ((addr & 0x1) == 1) {
-    cpu->CauseException (DLX_EXC_ADDRESS);
-    return (0);
-  }
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
-    return (0);
-  }
-  val >>= shiftcount[addr & 0x3];
-  val &= 0xffff;
-  DBPRINTF ('l',"Loading unsigned half 0x%04x from location 0x%x.\n",val,addr);
-  cpu->TraceAccess("lhu", dst, addr, val);
-  cpu->PutIreg (dst, val);
+  cpu->GetRFields (inst, src1, src2, dst);
+  v1 = cpu->GetIreg(src1);
+  v2 = cpu->GetIreg(src2) & 0x1f;
+  cpu->PutIreg (dst, v1 << v2);
   return (1);
 }
 
 static
 int
-InstLb (uint32 inst, Cpu *cpu)
+InstSra (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val;
-  static int	shiftcount[4] = {24, 16, 8, 0};
+  uint32	src1, src2, dst;
+  uint32	v1, v2, result;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
-    return (0);
+  cpu->GetRFields (inst, src1, src2, dst);
+  v1 = cpu->GetIreg(src1);
+  v2 = cpu->GetIreg(src2) & 0x1f;
+  result = v1 >> v2;
+  // stick in sign bits if operand is negative
+  if (v1 & 0x80000000) {
+    result |= ((1 << v2) - 1) << (32 - v2);
   }
-  val >>= shiftcount[addr & 0x3];
-  val &= 0xff;
-  DBPRINTF ('l',"Loading signed byte 0x%02x from location 0x%x.\n", val, addr);
-  cpu->TraceAccess("lb", dst, addr, val);
-  cpu->SignExtend8 (val);
-  cpu->PutIreg (dst, val);
+  cpu->PutIreg (dst, result);
   return (1);
 }
 
 static
 int
-InstLbu (uint32 inst, Cpu *cpu)
+InstSrl (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val;
-  static int	shiftcount[4] = {24, 16, 8, 0};
+  uint32	src1, src2, dst;
+  uint32	v1, v2;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
-    return (0);
-  }
-  val >>= shiftcount[addr & 0x3];
-  val &= 0xff;
-  DBPRINTF ('l',"Loading unsigned byte 0x%02x from location 0x%x.\n",val,addr);
-  cpu->TraceAccess("lbu", dst, addr, val);
-  cpu->PutIreg (dst, val);
+  cpu->GetRFields (inst, src1, src2, dst);
+  v1 = cpu->GetIreg(src1);
+  v2 = cpu->GetIreg(src2) & 0x1f;
+  cpu->PutIreg (dst, v1 >> v2);
   return (1);
 }
 
 //----------------------------------------------------------------------
 //
-//	Store instructions
+//	Immediate logical functions
 //
 //----------------------------------------------------------------------
 static
 int
-InstSh (uint32 inst, Cpu *cpu)
+InstAndi (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val, kval, regval, shiftamt;
-  static int	shiftcount[4] = {16, 16, 0, 0};
+  uint32	src1, imm, dst;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // If access fails, this instruction isn't considered completed
-  // ReadWord checks for misaligned accesses.
-  if (! cpu->ReadWord (addr & 0xfffffffe, val)) {
-    return (0);
-  }
-  kval = val;
-  shiftamt = shiftcount[addr & 0x3];
-  regval = (cpu->GetIreg (dst) & 0xffff);
-  val &= ~(0xffff << shiftamt);
-  val |= regval << shiftamt;
-  DBPRINTF ('s',"Storing half 0x%04x (0x%08x -> 0x%08x) to location 0x%x.\n",
-	    regval, kval, val, addr);
-  // This should never fail (if ReadWord worked), but just in case...
-  if (! cpu->WriteWord (addr & 0xfffffffc, val)) {
-    return (0);
-  }
-  cpu->TraceAccess("sh", dst, addr, regval);
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->PutIreg (dst, cpu->GetIreg(src1) & imm);
   return (1);
 }
 
 static
 int
-InstSb (uint32 inst, Cpu *cpu)
+InstOri (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val, kval, regval, shiftamt;
-  static int	shiftcount[4] = {24, 16, 8, 0};
+  uint32	src1, imm, dst;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
-    return (0);
-  }
-  kval = val;
-  shiftamt = shiftcount[addr & 0x3];
-  regval = (cpu->GetIreg (dst) & 0xff);
-  val &= ~(0xff << shiftamt);
-  val |= regval << shiftamt;
-  DBPRINTF ('s',"Storing byte 0x%02x (0x%08x -> 0x%08x) to location 0x%x.\n",
-	    regval, kval, val, addr);
-  // This should never fail (if ReadWord worked), but just in case...
-  if (! cpu->WriteWord (addr & 0xfffffffc, val)) {
-    return (0);
-  }
-  cpu->TraceAccess("sb", dst, addr, regval);
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->PutIreg (dst, cpu->GetIreg(src1) | imm);
   return (1);
 }
 
 static
 int
-InstSw (uint32 inst, Cpu *cpu)
+InstXori (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val;
+  uint32	src1, imm, dst;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  val = cpu->GetIreg (dst);
-  DBPRINTF ('s',"Storing word 0x%08x to location 0x%x.\n", val, addr);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->WriteWord (addr, val)) {
-    return (0);
-  }
-  cpu->TraceAccess("sw", dst, addr, val);
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->PutIreg (dst, cpu->GetIreg(src1) ^ imm);
   return (1);
 }
-
-//----------------------------------------------------------------------
-//
-//	FP load/store instructions
-//
-//----------------------------------------------------------------------
+
 static
 int
-InstLf (uint32 inst, Cpu *cpu)
+InstSlli (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val;
+  uint32	src1, imm, dst;
+  uint32	v1;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->ReadWord (addr, val)) {
-    return (0);
-  }
-  cpu->PutFreg (dst, val);
-  cpu->TraceAccess("lf", dst, addr, val);
+  cpu->GetIFields (inst, src1, imm, dst);
+  v1 = cpu->GetIreg(src1);
+  imm &= 0x1f;
+  cpu->PutIreg (dst, v1 << imm);
   return (1);
 }
 
 static
 int
-InstLd (uint32 inst, Cpu *cpu)
+InstSrai (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val1, val2;
+  uint32	src1, imm, dst;
+  uint32	v1, result;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  if ((dst & 0x1) == 1) {
-    cpu->CauseException (DLX_EXC_FORMAT);
-    return (1);
-  }
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->ReadWord (addr, val1)) {
-    return (0);
-  }
-  if (! cpu->ReadWord (addr+4, val2)) {
-    return (0);
+  cpu->GetIFields (inst, src1, imm, dst);
+  v1 = cpu->GetIreg(src1);
+  imm &= 0x1f;
+  result = v1 >> imm;
+  // stick in sign bits if operand is negative
+  if (v1 & 0x80000000) {
+    result |= ((1 << imm) - 1) << (32 - imm);
   }
-#if	(DLX_NATIVE_ENDIAN == DLX_BIG_ENDIAN)
-  cpu->PutFreg (dst, val1);
-  cpu->PutFreg (dst+1,val2);
-#else
-  cpu->PutFreg (dst,val2);
-  cpu->PutFreg (dst+1, val1);
-#endif
-  DBPRINTF ('f',"Read double %lf from address %08x\n", cpu->GetFregD (dst),
-	    addr);
-  cpu->TraceAccess("ld0", dst, addr, val1);
-  cpu->TraceAccess("ld1", dst, addr+4, val2);
+  cpu->PutIreg (dst, result);
   return (1);
 }
 
 static
 int
-InstSf (uint32 inst, Cpu *cpu)
+InstSrli (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val;
+  uint32	src1, imm, dst;
+  uint32	v1;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  val = cpu->GetFreg (dst);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->WriteWord (addr, val)) {
-    return (0);
-  }
-  cpu->TraceAccess("sf", dst, addr, val);
+  cpu->GetIFields (inst, src1, imm, dst);
+  v1 = cpu->GetIreg(src1);
+  imm &= 0x1f;
+  cpu->PutIreg (dst, v1 >> imm);
   return (1);
 }
 
 static
 int
-InstSd (uint32 inst, Cpu *cpu)
+InstLhi (uint32 inst, Cpu *cpu)
 {
-  uint32	addrReg, offset, dst, addr, val1, val2;
+  uint32	src, dst, imm;
 
-  cpu->GetIFields (inst, addrReg, offset, dst);
-  addr = cpu->EffectiveAddress (addrReg, offset);
-  // If access fails, this instruction isn't considered completed
-  if (! cpu->TestWriteWord (addr+4)) {
-    return (0);
-  }
-#if	(DLX_NATIVE_ENDIAN == DLX_BIG_ENDIAN)
-  val1 = cpu->GetFreg (dst);
-  val2 = cpu->GetFreg (dst+1);
-#else
-  val1 = cpu->GetFreg (dst+1);
-  val2 = cpu->GetFreg (dst);
-#endif
-  if (! cpu->WriteWord (addr, val1)) {
-    return (0);
-  }
-  // Should never fail, since write was tested earlier
-  if (! cpu->WriteWord (addr+4, val2)) {
-    return (0);
-  }
-  cpu->TraceAccess("sd0", dst, addr, val1);
-  cpu->TraceAccess("sd1", dst, addr+4, val2);
+  cpu->GetIFields (inst, src, imm, dst);
+  cpu->PutIreg (dst, imm << 16);
   return (1);
 }
 
 //----------------------------------------------------------------------
 //
-//	Miscellaneous FP move instructions
+//	R-R set instructions
 //
 //----------------------------------------------------------------------
 static
 int
-InstMovf (uint32 inst, Cpu *cpu)
+InstSeq (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFreg (dst, cpu->GetFreg (src1));
+  cpu->PutIreg (dst, (cpu->GetIreg(src1) == cpu->GetIreg(src2)) ? 1 : 0);
   return (1);
 }
 
 static
 int
-InstMovd (uint32 inst, Cpu *cpu)
+InstSne (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  if ((dst & 0x1) || (src1 & 0x1)) {
-    cpu->CauseException (DLX_EXC_FORMAT);
-    return (1);
-  }
-  cpu->PutFreg (dst, cpu->GetFreg (src1));
-  cpu->PutFreg (dst+1, cpu->GetFreg (src1+1));
+  cpu->PutIreg (dst, (cpu->GetIreg(src1) != cpu->GetIreg(src2)) ? 1 : 0);
   return (1);
 }
 
 static
 int
-InstMovfp2i (uint32 inst, Cpu *cpu)
+InstSlt (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (dst, cpu->GetFreg (src1));
+  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) < (int)cpu->GetIreg(src2))
+		? 1 : 0);
+  return (1);
+}
+static
+int
+InstSgt (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) > (int)cpu->GetIreg(src2))
+		? 1 : 0);
   return (1);
 }
+static
+int
+InstSle (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
 
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) <= (int)cpu->GetIreg(src2))
+		? 1 : 0);
+  return (1);
+}
 static
 int
-InstMovi2fp (uint32 inst, Cpu *cpu)
+InstSge (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFreg (dst, cpu->GetIreg (src1));
+  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) >= (int)cpu->GetIreg(src2))
+		? 1 : 0);
   return (1);
 }
 
 //----------------------------------------------------------------------
 //
-//	Unconditional jumps & subroutine calls
+//	Bit and byte instructions
+//
+//	Extensions for the kernel's bitmap and string loops, all R-R
+//	format (src2 is ignored by the single-operand ones):
+//
+//	ffs rd,rs1	index of the lowest set bit of rs1, or 32 if none
+//	popc rd,rs1	number of set bits in rs1
+//	cmpb rd,rs1,rs2	bit i set if byte i of rs1 equals byte i of rs2
+//	zbyte rd,rs1	index of the first zero byte of rs1, or 4 if none
+//
+//	Bytes are numbered in memory order, so byte 0 is the most
+//	significant; cmpb of equal words gives 0xf.
 //
 //----------------------------------------------------------------------
 static
 int
-InstJmp (uint32 inst, Cpu *cpu)
+InstFfs (uint32 inst, Cpu *cpu)
 {
-  uint32	joffset;
+  uint32	src1, src2, dst;
+  uint32	v, n;
 
-  cpu->GetJFields (inst, joffset);
-  return (cpu->Jump (cpu->PC() + (int)joffset));
+  cpu->GetRFields (inst, src1, src2, dst);
+  v = cpu->GetIreg (src1);
+  if (v == 0) {
+    n = 32;
+  } else {
+    for (n = 0; (v & 1) == 0; n++) {
+      v >>= 1;
+    }
+  }
+  cpu->PutIreg (dst, n);
+  return (1);
 }
 
 static
 int
-InstJr (uint32 inst, Cpu *cpu)
+InstPopc (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+  uint32	v;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  return (cpu->Jump (cpu->GetIreg(src1)));
+  v = cpu->GetIreg (src1);
+  v = v - ((v >> 1) & 0x55555555);
+  v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+  v = (v + (v >> 4)) & 0x0f0f0f0f;
+  cpu->PutIreg (dst, (v * 0x01010101) >> 24);
+  return (1);
 }
 
 static
 int
-InstJal (uint32 inst, Cpu *cpu)
+InstCmpb (uint32 inst, Cpu *cpu)
 {
-  uint32	joffset;
+  uint32	src1, src2, dst;
+  uint32	v1, v2, mask = 0;
+  int		i;
 
-  cpu->GetJFields (inst, joffset);
-  cpu->PutIreg (31, cpu->PC());
-  DBPRINTF ('j', "jal from 0x%x to 0x%x.\n", cpu->PC(),
-	    cpu->PC() + (int)joffset);
-  return (cpu->Jump (cpu->PC() + (int)joffset));
+  cpu->GetRFields (inst, src1, src2, dst);
+  v1 = cpu->GetIreg (src1);
+  v2 = cpu->GetIreg (src2);
+  for (i = 0; i < 4; i++) {
+    if (((v1 >> (24 - 8 * i)) & 0xff) == ((v2 >> (24 - 8 * i)) & 0xff)) {
+      mask |= 1 << i;
+    }
+  }
+  cpu->PutIreg (dst, mask);
+  return (1);
 }
 
 static
 int
-InstJalr (uint32 inst, Cpu *cpu)
+InstZbyte (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+  uint32	v;
+  int		i;
 
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutIreg (31, cpu->PC());
-  return (cpu->Jump (cpu->GetIreg(src1)));
+  v = cpu->GetIreg (src1);
+  for (i = 0; (i < 4) && (((v >> (24 - 8 * i)) & 0xff) != 0); i++) {
+  }
+  cpu->PutIreg (dst, i);
+  return (1);
 }
-
+
 //----------------------------------------------------------------------
 //
-//	Conditional branches
+//	Immediate set instructions
 //
 //----------------------------------------------------------------------
 static
 int
-InstBeqz (uint32 inst, Cpu *cpu)
+InstSeqi (uint32 inst, Cpu *cpu)
 {
-  uint32	src, offset, dst;
+  uint32	src1, imm, dst;
 
-  cpu->GetIFields (inst, src, offset, dst);
-  cpu->SignExtend16 (offset);
-  if (cpu->GetIreg (src) == 0) {
-    return (cpu->Jump (cpu->PC () + (int)offset));
-  } else {
-    return (1);
-  }
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->SignExtend16 (imm);
+  cpu->PutIreg (dst, (cpu->GetIreg(src1) == imm) ? 1 : 0);
+  return (1);
 }
 
 static
 int
-InstBnez (uint32 inst, Cpu *cpu)
+InstSnei (uint32 inst, Cpu *cpu)
 {
-  uint32	src, offset, dst;
+  uint32	src1, imm, dst;
 
-  cpu->GetIFields (inst, src, offset, dst);
-  cpu->SignExtend16 (offset);
-  if (cpu->GetIreg (src) != 0) {
-    return (cpu->Jump (cpu->PC () + (int)offset));
-  } else {
-    return (1);
-  }
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->SignExtend16 (imm);
+  cpu->PutIreg (dst, (cpu->GetIreg(src1) != imm) ? 1 : 0);
+  return (1);
 }
 
 static
 int
-InstBfpt (uint32 inst, Cpu *cpu)
+InstSlti (uint32 inst, Cpu *cpu)
 {
-  uint32	src, offset, dst;
+  uint32	src1, imm, dst;
 
-  cpu->GetIFields (inst, src, offset, dst);
-  cpu->SignExtend16 (offset);
-  if (cpu->StatusBit (DLX_STATUS_FPTRUE)) {
-    return (cpu->Jump (cpu->PC () + (int)offset));
-  } else {
-    return (1);
-  }
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->SignExtend16 (imm);
+  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) < (int)imm) ? 1 : 0);
+  return (1);
 }
 
 static
 int
-InstBfpf (uint32 inst, Cpu *cpu)
+InstSgti (uint32 inst, Cpu *cpu)
 {
-  uint32	src, offset, dst;
+  uint32	src1, imm, dst;
 
-  cpu->GetIFields (inst, src, offset, dst);
-  cpu->SignExtend16 (offset);
-  if (! cpu->StatusBit (DLX_STATUS_FPTRUE)) {
-    return (cpu->Jump (cpu->PC () + (int)offset));
-  } else {
-    return (1);
-  }
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->SignExtend16 (imm);
+  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) > (int)imm) ? 1 : 0);
+  return (1);
 }
-
-//----------------------------------------------------------------------
-//
-//	Integer multiply and divide (done by FP unit).  Note that
-//	multiplication overflows are NOT caught, and results are
-//	unpredictable (may depend on machine on which simulator is
-//	run).
-//
-//----------------------------------------------------------------------
+
 static
 int
-InstMult (uint32 inst, Cpu *cpu)
+InstSlei (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFreg (dst, (int)cpu->GetFreg (src1) * (int)cpu->GetFreg (src2));
+  uint32	src1, imm, dst;
+
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->SignExtend16 (imm);
+  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) <= (int)imm) ? 1 : 0);
   return (1);
 }
 
 static
 int
-InstMultu (uint32 inst, Cpu *cpu)
+InstSgei (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFreg (dst, cpu->GetFreg (src1) * cpu->GetFreg (src2));
+  uint32	src1, imm, dst;
+
+  cpu->GetIFields (inst, src1, imm, dst);
+  cpu->SignExtend16 (imm);
+  cpu->PutIreg (dst, ((int)cpu->GetIreg(src1) >= (int)imm) ? 1 : 0);
   return (1);
 }
-
+
+//----------------------------------------------------------------------
+//
+//	Load instructions
+//
+//----------------------------------------------------------------------
 static
 int
-InstDiv (uint32 inst, Cpu *cpu)
+InstLw (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst, denom;
-  cpu->GetRFields (inst, src1, src2, dst);
-  denom = cpu->GetFreg (src2);
-  if (denom == 0) {
-    cpu->CauseException(DLX_EXC_DIV0);
-  } else {
-    cpu->PutFreg (dst, (int)cpu->GetFreg (src1) / (int)denom);
+  uint32	addrReg, offset, dst, addr, val;
+
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->ReadWord (addr, val)) {
+    return (0);
   }
+  DBPRINTF ('l', "Loading word 0x%08x from location 0x%x.\n", val, addr);
+  cpu->TraceAccess("lw", dst, addr, val);
+  cpu->PutIreg (dst, val);
   return (1);
 }
 
 static
 int
-InstDivu (uint32 inst, Cpu *cpu)
+InstLh (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst, denom;
-  cpu->GetRFields (inst, src1, src2, dst);
-  denom = cpu->GetFreg (src2);
-  if (denom == 0) {
-    cpu->CauseException(DLX_EXC_DIV0);
-  } else {
-    cpu->PutFreg (dst, cpu->GetFreg (src1) / denom);
+  uint32	addrReg, offset, dst, addr, val;
+  static int	shiftcount[4] = {16, 16, 0, 0};
+
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // Half-word accesses must be 2-byte aligned
+  if ((addr & 0x1) == 1) {
+    cpu->CauseException (DLX_EXC_ADDRESS);
+    return (0);
+  }
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
+    return (0);
   }
+  val >>= shiftcount[addr & 0x3];
+  DBPRINTF ('l',"Loading signed half 0x%04x from location 0x%x.\n", val, addr);
+  cpu->TraceAccess("lh", dst, addr, val);
+  cpu->SignExtend16 (val);
+  cpu->PutIreg (dst, val);
   return (1);
 }
-
-//----------------------------------------------------------------------
-//	trap
-//
-//	NOTE: different from the description in the DLX handbook.
-//
-//	The trap in DLX is unvectored; it's up to the interrupt handler
-//	to do the vectoring.  However, the cause register is loaded with
-//	the trap argument with the top 5 bits set to 00001.  This makes
-//	it easy to identify traps and to vector them properly.
-//
-//	The trap instruction is also a way to access services from the
-//	underlying machine.  In particular, we can do such things as
-//	file access and printing.  Note that character access is handled
-//	separately.
-//----------------------------------------------------------------------
+
 static
 int
-InstTrap (uint32 inst, Cpu *cpu)
+InstLhu (uint32 inst, Cpu *cpu)
 {
-  uint32	trapVector;
+  uint32	addrReg, offset, dst, addr, val;
+  static int	shiftcount[4] = {16, 16, 0, 0};
 
-  cpu->GetJFields (inst, trapVector);
-  trapVector &= 0x0fffffff;
-  DBPRINTF ('t',"Got a trap, inst=%08x, vector=%x\n", inst, trapVector);
-  if ((trapVector == DLX_TRAP_EXIT) && ! cpu->IgnoreExit()) {
-    cpu->Exit ();
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // Half-word accesses must be 2-byte aligned
+  if ((addr & 0x1) == 1) {
+    cpu->CauseException (DLX_EXC_ADDRESS);
+    return (0);
   }
-  if (trapVector < 0x2000) {
-    // Increment the PC so the address in the IAR is that of the
-    // following instruction.
-    cpu->SetPC (cpu->PC()+4);
-    cpu->CauseException (trapVector | 0x08000000);
-  } else {
-    cpu->OutputBasicBlock (cpu->PC()+4);
-    if (cpu->Flags() & (DLX_TRACE_INSTRUCTIONS | DLX_TRACE_MEMORY)) {
-      fprintf (cpu->TraceFp(), "T %x %x\n", trapVector, cpu->PC());
-    }
-    // Handle simulator services here.  This isn't so performance
-    // critical, so we can use a switch statement.
-    // Parameters are passed on the stack.
-    // Return values go into r1
-    switch (trapVector) {
-    case DLX_TRAP_EXITSIM:
-      cpu->Exit ();
-      break;
-    case DLX_TRAP_PRINTF:
-      cpu->Printf ();
-      break;
-    case DLX_TRAP_OPEN:
-      cpu->Open ();
-      break;
-    case DLX_TRAP_READ:
-      cpu->Read ();
-      break;
-    case DLX_TRAP_WRITE:
-      cpu->Write ();
-      break;
-    case DLX_TRAP_LSEEK:
-      cpu->Seek ();
-      break;
-    case DLX_TRAP_CLOSE:
-      cpu->Close ();
-      break;
-    case DLX_TRAP_RANDOM:
-      cpu->Random ();
-      break;
-    case DLX_TRAP_SRANDOM:
-      cpu->Srandom ();
-      break;
-    case DLX_TRAP_TIMERGET:
-      cpu->Timerget();
-      break;
-    }
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
+    return (0);
   }
+  val >>= shiftcount[addr & 0x3];
+  val &= 0xffff;
+  DBPRINTF ('l',"Loading unsigned half 0x%04x from location 0x%x.\n",val,addr);
+  cpu->TraceAccess("lhu", dst, addr, val);
+  cpu->PutIreg (dst, val);
   return (1);
 }
-
-//----------------------------------------------------------------------
-//	rfe
-//
-//	When returning from an exception, jump to the IAR.  To avoid
-//	illegal addresses, mask off the low two bits.  Also, turn
-//	interrupts on.
-//----------------------------------------------------------------------
+
 static
 int
-InstRfe (uint32 inst, Cpu *cpu)
+InstLb (uint32 inst, Cpu *cpu)
 {
-  return (cpu->DoRfe (inst));
+  uint32	addrReg, offset, dst, addr, val;
+  static int	shiftcount[4] = {24, 16, 8, 0};
+
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
+    return (0);
+  }
+  val >>= shiftcount[addr & 0x3];
+  val &= 0xff;
+  DBPRINTF ('l',"Loading signed byte 0x%02x from location 0x%x.\n", val, addr);
+  cpu->TraceAccess("lb", dst, addr, val);
+  cpu->SignExtend8 (val);
+  cpu->PutIreg (dst, val);
+  return (1);
 }
 
+static
 int
-Cpu::DoRfe (uint32 inst)
+InstLbu (uint32 inst, Cpu *cpu)
 {
-  uint32	iar;
-  uint32	isr;
+  uint32	addrReg, offset, dst, addr, val;
+  static int	shiftcount[4] = {24, 16, 8, 0};
 
-  if (UserMode ()) {
-    CauseException (DLX_EXC_PRIVILEGE);
-    return (1);
-  }
-  iar = GetSreg (DLX_SREG_IAR) & ~0x3;
-  OutputBasicBlock (iar);
-  if (flags & (DLX_TRACE_INSTRUCTIONS | DLX_TRACE_MEMORY)) {
-    fprintf (tracefp, "R %x %x\n", PC()-4, iar);
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
+    return (0);
   }
-  isr = GetSreg (DLX_SREG_ISR);
-  PutSreg (DLX_SREG_STATUS, isr);
-  SetPC (iar);
+  val >>= shiftcount[addr & 0x3];
+  val &= 0xff;
+  DBPRINTF ('l',"Loading unsigned byte 0x%02x from location 0x%x.\n",val,addr);
+  cpu->TraceAccess("lbu", dst, addr, val);
+  cpu->PutIreg (dst, val);
   return (1);
 }
 
 //----------------------------------------------------------------------
 //
-//	Miscellaneous instructions
+//	Store instructions
 //
 //----------------------------------------------------------------------
 static
 int
-InstMovi2s (uint32 inst, Cpu *cpu)
+InstSh (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
+  uint32	addrReg, offset, dst, addr, val, kval, regval, shiftamt;
+  static int	shiftcount[4] = {16, 16, 0, 0};
 
-  if (cpu->UserMode ()) {
-    cpu->CauseException (DLX_EXC_PRIVILEGE);
-    return (1);
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // If access fails, this instruction isn't considered completed
+  // ReadWord checks for misaligned accesses.
+  if (! cpu->ReadWord (addr & 0xfffffffe, val)) {
+    return (0);
   }
-  cpu->GetRFields (inst, src1, src2, dst);
-  DBPRINTF ('S',"Moving integer reg %d (0x%x) to special reg %d.\n",
-	    src1, cpu->GetIreg(src1), dst);
-  cpu->PutSreg (dst, cpu->GetIreg (src1));
+  kval = val;
+  shiftamt = shiftcount[addr & 0x3];
+  regval = (cpu->GetIreg (dst) & 0xffff);
+  val &= ~(0xffff << shiftamt);
+  val |= regval << shiftamt;
+  DBPRINTF ('s',"Storing half 0x%04x (0x%08x -> 0x%08x) to location 0x%x.\n",
+	    regval, kval, val, addr);
+  // This should never fail (if ReadWord worked), but just in case...
+  if (! cpu->WriteWord (addr & 0xfffffffc, val)) {
+    return (0);
+  }
+  cpu->TraceAccess("sh", dst, addr, regval);
   return (1);
 }
 
 static
 int
-InstMovs2i (uint32 inst, Cpu *cpu)
+InstSb (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
+  uint32	addrReg, offset, dst, addr, val, kval, regval, shiftamt;
+  static int	shiftcount[4] = {24, 16, 8, 0};
 
-  if (cpu->UserMode ()) {
-    cpu->CauseException (DLX_EXC_PRIVILEGE);
-    return (1);
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->ReadWord (addr & 0xfffffffc, val)) {
+    return (0);
   }
-  cpu->GetRFields (inst, src1, src2, dst);
-  DBPRINTF ('S',"Moving special reg %d (0x%x) to integer reg %d.\n",
-	    src1, cpu->GetSreg(src1), dst);
-  cpu->PutIreg (dst, cpu->GetSreg (src1));
+  kval = val;
+  shiftamt = shiftcount[addr & 0x3];
+  regval = (cpu->GetIreg (dst) & 0xff);
+  val &= ~(0xff << shiftamt);
+  val |= regval << shiftamt;
+  DBPRINTF ('s',"Storing byte 0x%02x (0x%08x -> 0x%08x) to location 0x%x.\n",
+	    regval, kval, val, addr);
+  // This should never fail (if ReadWord worked), but just in case...
+  if (! cpu->WriteWord (addr & 0xfffffffc, val)) {
+    return (0);
+  }
+  cpu->TraceAccess("sb", dst, addr, regval);
   return (1);
 }
 
 static
 int
-InstIllegal (uint32 inst, Cpu *cpu)
+InstSw (uint32 inst, Cpu *cpu)
 {
-  cpu->CauseException (DLX_EXC_ILLEGALINST);
-  return (1);
-}
+  uint32	addrReg, offset, dst, addr, val;
 
-static
-int
-InstNop (uint32, Cpu *cpu)
-{
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  val = cpu->GetIreg (dst);
+  DBPRINTF ('s',"Storing word 0x%08x to location 0x%x.\n", val, addr);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->WriteWord (addr, val)) {
+    return (0);
+  }
+  cpu->TraceAccess("sw", dst, addr, val);
   return (1);
 }
 
-
 //----------------------------------------------------------------------
 //
-//	Single precision FP math instructions.
+//	Atomic memory instructions (see Cpu::Atomic)
 //
 //----------------------------------------------------------------------
+#define	DLX_ATOMIC_SWAP		0
+#define	DLX_ATOMIC_TAS		1
+#define	DLX_ATOMIC_LL		2
+#define	DLX_ATOMIC_SC		3
+
 static
 int
-InstAddf (uint32 inst, Cpu *cpu)
+InstSwap (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregF (dst, cpu->GetFregF (src1) + cpu->GetFregF (src2));
-  return (1);
+  return (cpu->Atomic (inst, DLX_ATOMIC_SWAP));
 }
 
 static
 int
-InstSubf (uint32 inst, Cpu *cpu)
+InstTas (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregF (dst, cpu->GetFregF (src1) - cpu->GetFregF (src2));
-  return (1);
+  return (cpu->Atomic (inst, DLX_ATOMIC_TAS));
 }
 
 static
 int
-InstMultf (uint32 inst, Cpu *cpu)
+InstLl (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregF (dst, cpu->GetFregF (src1) * cpu->GetFregF (src2));
-  return (1);
+  return (cpu->Atomic (inst, DLX_ATOMIC_LL));
 }
 
 static
 int
-InstDivf (uint32 inst, Cpu *cpu)
+InstSc (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  float	denom;
-  cpu->GetRFields (inst, src1, src2, dst);
-  denom = cpu->GetFregF (src2);
-  if (denom == (float)0.0) {
-    cpu->CauseException (DLX_EXC_DIV0);
-  } else {
-    cpu->PutFregF (dst, cpu->GetFregF (src1) / denom);
-  }
-  return (1);
+  return (cpu->Atomic (inst, DLX_ATOMIC_SC));
 }
 
 //----------------------------------------------------------------------
 //
-//	Single precision FP comparison instructions
+//	FpUnavailable
+//
+//	The OS can leave a user process's FP registers out of its saved
+//	state until the process first uses them: with DLX_STATUS_FPDISABLE
+//	set, the first instruction that reads or writes an FP register in
+//	user mode raises DLX_FPU_EXC instead of running.  The OS clears
+//	the bit in the ISR it returns to and the instruction runs again.
+//	System mode is never stopped, since the kernel's own integer
+//	multiplies and divides go through the FP registers.  Returns 1 if
+//	the instruction must do nothing more.
 //
 //----------------------------------------------------------------------
-static
-int
-InstEqf (uint32 inst, Cpu *cpu)
-{
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregF (src1) == cpu->GetFregF (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
-  return (1);
-}
+#define	DLX_STATUS_FPDISABLE	0x1000	// FP registers off in user mode
+#define	DLX_FPU_EXC		0x9	// FP register used while off
 
 static
+inline
 int
-InstNef (uint32 inst, Cpu *cpu)
+FpUnavailable (Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregF (src1) != cpu->GetFregF (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
-  return (1);
+  if (cpu->StatusBit (DLX_STATUS_FPDISABLE) && cpu->UserMode ()) {
+    cpu->CauseException (DLX_FPU_EXC);
+    return (1);
+  }
+  return (0);
 }
+
+//----------------------------------------------------------------------
+//
+//	FP load/store instructions
+//
+//----------------------------------------------------------------------
 static
 int
-InstLtf (uint32 inst, Cpu *cpu)
+InstLf (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregF (src1) < cpu->GetFregF (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
+  uint32	addrReg, offset, dst, addr, val;
+
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->ReadWord (addr, val)) {
+    return (0);
+  }
+  cpu->PutFreg (dst, val);
+  cpu->TraceAccess("lf", dst, addr, val);
   return (1);
 }
 
 static
 int
-InstGtf (uint32 inst, Cpu *cpu)
+InstLd (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregF (src1) > cpu->GetFregF (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
+  uint32	addrReg, offset, dst, addr, val1, val2;
+
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  if ((dst & 0x1) == 1) {
+    cpu->CauseException (DLX_EXC_FORMAT);
+    return (1);
+  }
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->ReadWord (addr, val1)) {
+    return (0);
+  }
+  if (! cpu->ReadWord (addr+4, val2)) {
+    return (0);
+  }
+#if	(DLX_NATIVE_ENDIAN == DLX_BIG_ENDIAN)
+  cpu->PutFreg (dst, val1);
+  cpu->PutFreg (dst+1,val2);
+#else
+  cpu->PutFreg (dst,val2);
+  cpu->PutFreg (dst+1, val1);
+#endif
+  DBPRINTF ('f',"Read double %lf from address %08x\n", cpu->GetFregD (dst),
+	    addr);
+  cpu->TraceAccess("ld0", dst, addr, val1);
+  cpu->TraceAccess("ld1", dst, addr+4, val2);
   return (1);
 }
 
 static
 int
-InstLef (uint32 inst, Cpu *cpu)
+InstSf (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregF (src1) <= cpu->GetFregF (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
+  uint32	addrReg, offset, dst, addr, val;
+
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  val = cpu->GetFreg (dst);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->WriteWord (addr, val)) {
+    return (0);
+  }
+  cpu->TraceAccess("sf", dst, addr, val);
   return (1);
 }
 
 static
 int
-InstGef (uint32 inst, Cpu *cpu)
+InstSd (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregF (src1) >= cpu->GetFregF (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
+  uint32	addrReg, offset, dst, addr, val1, val2;
+
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetIFields (inst, addrReg, offset, dst);
+  addr = cpu->EffectiveAddress (addrReg, offset);
+  // If access fails, this instruction isn't considered completed
+  if (! cpu->TestWriteWord (addr+4)) {
+    return (0);
+  }
+#if	(DLX_NATIVE_ENDIAN == DLX_BIG_ENDIAN)
+  val1 = cpu->GetFreg (dst);
+  val2 = cpu->GetFreg (dst+1);
+#else
+  val1 = cpu->GetFreg (dst+1);
+  val2 = cpu->GetFreg (dst);
+#endif
+  if (! cpu->WriteWord (addr, val1)) {
+    return (0);
+  }
+  // Should never fail, since write was tested earlier
+  if (! cpu->WriteWord (addr+4, val2)) {
+    return (0);
+  }
+  cpu->TraceAccess("sd0", dst, addr, val1);
+  cpu->TraceAccess("sd1", dst, addr+4, val2);
   return (1);
 }
 
 //----------------------------------------------------------------------
 //
-//	Double precision FP math instructions.
+//	Miscellaneous FP move instructions
 //
 //----------------------------------------------------------------------
 static
 int
-InstAddd (uint32 inst, Cpu *cpu)
+InstMovf (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregD (dst, cpu->GetFregD (src1) + cpu->GetFregD (src2));
+  cpu->PutFreg (dst, cpu->GetFreg (src1));
   return (1);
 }
 
 static
 int
-InstSubd (uint32 inst, Cpu *cpu)
+InstMovd (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregD (dst, cpu->GetFregD (src1) - cpu->GetFregD (src2));
+  if ((dst & 0x1) || (src1 & 0x1)) {
+    cpu->CauseException (DLX_EXC_FORMAT);
+    return (1);
+  }
+  cpu->PutFreg (dst, cpu->GetFreg (src1));
+  cpu->PutFreg (dst+1, cpu->GetFreg (src1+1));
   return (1);
 }
 
 static
 int
-InstMultd (uint32 inst, Cpu *cpu)
+InstMovfp2i (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregD (dst, cpu->GetFregD (src1) * cpu->GetFregD (src2));
+  cpu->PutIreg (dst, cpu->GetFreg (src1));
   return (1);
 }
 
 static
 int
-InstDivd (uint32 inst, Cpu *cpu)
+InstMovi2fp (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
-  double	denom;
-  cpu->GetRFields (inst, src1, src2, dst);
-  denom = cpu->GetFregD (src2);
-  if (denom == (double)0.0) {
-    cpu->CauseException (DLX_EXC_DIV0);
-  } else {
-    cpu->PutFregD (dst, cpu->GetFregD(src1) / denom);
+
+  if (FpUnavailable (cpu)) {
+    return (1);
   }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFreg (dst, cpu->GetIreg (src1));
   return (1);
 }
 
 //----------------------------------------------------------------------
 //
-//	Double precision FP comparison instructions
+//	Unconditional jumps & subroutine calls
 //
 //----------------------------------------------------------------------
 static
 int
-InstEqd (uint32 inst, Cpu *cpu)
+InstJmp (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregD (src1) == cpu->GetFregD (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
-  return (1);
+  uint32	joffset;
+
+  cpu->GetJFields (inst, joffset);
+  return (cpu->Jump (cpu->PC() + (int)joffset));
 }
 
 static
 int
-InstNed (uint32 inst, Cpu *cpu)
+InstJr (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+
   cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregD (src1) != cpu->GetFregD (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
-  return (1);
+  return (cpu->Jump (cpu->GetIreg(src1)));
 }
 
 static
 int
-InstLtd (uint32 inst, Cpu *cpu)
+InstJal (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregD (src1) < cpu->GetFregD (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
-  } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
-  return (1);
+  uint32	joffset;
+
+  cpu->GetJFields (inst, joffset);
+  cpu->PutIreg (31, cpu->PC());
+  DBPRINTF ('j', "jal from 0x%x to 0x%x.\n", cpu->PC(),
+	    cpu->PC() + (int)joffset);
+  return (cpu->Jump (cpu->PC() + (int)joffset));
 }
 
 static
 int
-InstGtd (uint32 inst, Cpu *cpu)
+InstJalr (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+
   cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregD (src1) > cpu->GetFregD (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  cpu->PutIreg (31, cpu->PC());
+  return (cpu->Jump (cpu->GetIreg(src1)));
+}
+
+//----------------------------------------------------------------------
+//
+//	Conditional branches
+//
+//----------------------------------------------------------------------
+static
+int
+InstBeqz (uint32 inst, Cpu *cpu)
+{
+  uint32	src, offset, dst;
+
+  cpu->GetIFields (inst, src, offset, dst);
+  cpu->SignExtend16 (offset);
+  if (cpu->GetIreg (src) == 0) {
+    return (cpu->Jump (cpu->PC () + (int)offset));
   } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
-  return (1);
+    return (1);
+  }
 }
 
 static
 int
-InstLed (uint32 inst, Cpu *cpu)
+InstBnez (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregD (src1) <= cpu->GetFregD (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  uint32	src, offset, dst;
+
+  cpu->GetIFields (inst, src, offset, dst);
+  cpu->SignExtend16 (offset);
+  if (cpu->GetIreg (src) != 0) {
+    return (cpu->Jump (cpu->PC () + (int)offset));
   } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
-  return (1);
+    return (1);
+  }
 }
 
 static
 int
-InstGed (uint32 inst, Cpu *cpu)
+InstBfpt (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  if (cpu->GetFregD (src1) >= cpu->GetFregD (src2)) {
-    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  uint32	src, offset, dst;
+
+  cpu->GetIFields (inst, src, offset, dst);
+  cpu->SignExtend16 (offset);
+  if (cpu->StatusBit (DLX_STATUS_FPTRUE)) {
+    return (cpu->Jump (cpu->PC () + (int)offset));
   } else {
-    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
-  }	
-  return (1);
+    return (1);
+  }
+}
+
+static
+int
+InstBfpf (uint32 inst, Cpu *cpu)
+{
+  uint32	src, offset, dst;
+
+  cpu->GetIFields (inst, src, offset, dst);
+  cpu->SignExtend16 (offset);
+  if (! cpu->StatusBit (DLX_STATUS_FPTRUE)) {
+    return (cpu->Jump (cpu->PC () + (int)offset));
+  } else {
+    return (1);
+  }
 }
 
 //----------------------------------------------------------------------
 //
-//	Conversion instructions
+//	Integer multiply and divide (done by FP unit).  Note that
+//	multiplication overflows are NOT caught, and results are
+//	unpredictable (may depend on machine on which simulator is
+//	run).
 //
 //----------------------------------------------------------------------
 static
 int
-InstCvtf2d (uint32 inst, Cpu *cpu)
+InstMult (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregD (dst, (double)cpu->GetFregF(src1));
+  cpu->PutFreg (dst, (int)cpu->GetFreg (src1) * (int)cpu->GetFreg (src2));
   return (1);
 }
 
 static
 int
-InstCvtf2i (uint32 inst, Cpu *cpu)
+InstMultu (uint32 inst, Cpu *cpu)
 {
   uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFreg (dst, (int)cpu->GetFregF(src1));
+  cpu->PutFreg (dst, cpu->GetFreg (src1) * cpu->GetFreg (src2));
   return (1);
 }
 
 static
 int
-InstCvtd2f (uint32 inst, Cpu *cpu)
+InstDiv (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
+  uint32	src1, src2, dst, denom;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregF (dst, (float)cpu->GetFregD(src1));
+  denom = cpu->GetFreg (src2);
+  if (denom == 0) {
+    cpu->CauseException(DLX_EXC_DIV0);
+  } else {
+    cpu->PutFreg (dst, (int)cpu->GetFreg (src1) / (int)denom);
+  }
   return (1);
 }
 
 static
 int
-InstCvtd2i (uint32 inst, Cpu *cpu)
+InstDivu (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
+  uint32	src1, src2, dst, denom;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
   cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFreg (dst, (int)cpu->GetFregD(src1));
+  denom = cpu->GetFreg (src2);
+  if (denom == 0) {
+    cpu->CauseException(DLX_EXC_DIV0);
+  } else {
+    cpu->PutFreg (dst, cpu->GetFreg (src1) / denom);
+  }
   return (1);
 }
+
+//----------------------------------------------------------------------
+//	trap
+//
+//	NOTE: different from the description in the DLX handbook.
+//
+//	The trap in DLX is unvectored; it's up to the interrupt handler
+//	to do the vectoring.  However, the cause register is loaded with
+//	the trap argument with the top 5 bits set to 00001.  This makes
+//	it easy to identify traps and to vector them properly.
+//
+//	The trap instruction is also a way to access services from the
+//	underlying machine.  In particular, we can do such things as
+//	file access and printing.  Note that character access is handled
+//	separately.
+//----------------------------------------------------------------------
+
+// Simulator services added here rather than in the standard trap
+// library, so the numbers live here rather than in dlx.h with the
+// others.  Vectored host I/O is served by Cpu::FileIoVec.
+#define	DLX_TRAP_PREADV		0x2040
+#define	DLX_TRAP_PWRITEV	0x2041
+#define	DLX_TRAP_SNAPSHOT	0x2042	// Cpu::Snapshot
+#define	DLX_TRAP_RESUMEARGS	0x2043	// Cpu::ResumeArgs
+#define	DLX_TRAP_MEMMOVE	0x2044	// Cpu::MemOp
+#define	DLX_TRAP_MEMSET		0x2045
+#define	DLX_TRAP_CONSWRITE	0x2046	// Cpu::ConsoleWrite
 
 static
 int
-InstCvti2f (uint32 inst, Cpu *cpu)
+InstTrap (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  cpu->PutFregF (dst, (float)cpu->GetFreg(src1));
+  uint32	trapVector;
+
+  cpu->GetJFields (inst, trapVector);
+  trapVector &= 0x0fffffff;
+  DBPRINTF ('t',"Got a trap, inst=%08x, vector=%x\n", inst, trapVector);
+  if ((trapVector == DLX_TRAP_EXIT) && ! cpu->IgnoreExit()) {
+    cpu->Exit ();
+  }
+  if (trapVector < 0x2000) {
+    // Increment the PC so the address in the IAR is that of the
+    // following instruction.
+    cpu->SetPC (cpu->PC()+4);
+    cpu->CauseException (trapVector | 0x08000000);
+  } else {
+    cpu->OutputBasicBlock (cpu->PC()+4);
+    if (cpu->Flags() & (DLX_TRACE_INSTRUCTIONS | DLX_TRACE_MEMORY)) {
+      TraceControl (cpu->TraceFp(), DLX_TRACE_REC_TRAP, trapVector, cpu->PC());
+    }
+    // Handle simulator services here.  This isn't so performance
+    // critical, so we can use a switch statement.
+    // Parameters are passed on the stack.
+    // Return values go into r1
+    switch (trapVector) {
+    case DLX_TRAP_EXITSIM:
+      cpu->Exit ();
+      break;
+    case DLX_TRAP_PRINTF:
+      cpu->Printf ();
+      break;
+    case DLX_TRAP_OPEN:
+      cpu->Open ();
+      break;
+    case DLX_TRAP_READ:
+      cpu->Read ();
+      break;
+    case DLX_TRAP_WRITE:
+      cpu->Write ();
+      break;
+    case DLX_TRAP_LSEEK:
+      cpu->Seek ();
+      break;
+    case DLX_TRAP_CLOSE:
+      cpu->Close ();
+      break;
+    case DLX_TRAP_RANDOM:
+      cpu->Random ();
+      break;
+    case DLX_TRAP_SRANDOM:
+      cpu->Srandom ();
+      break;
+    case DLX_TRAP_TIMERGET:
+      cpu->Timerget();
+      break;
+    case DLX_TRAP_PREADV:
+      cpu->FileIoVec (DLX_FILE_READ);
+      break;
+    case DLX_TRAP_PWRITEV:
+      cpu->FileIoVec (DLX_FILE_WRITE);
+      break;
+    case DLX_TRAP_SNAPSHOT:
+      cpu->Snapshot ();
+      break;
+    case DLX_TRAP_RESUMEARGS:
+      cpu->ResumeArgs ();
+      break;
+    case DLX_TRAP_MEMMOVE:
+    case DLX_TRAP_MEMSET:
+      cpu->MemOp (trapVector);
+      break;
+    case DLX_TRAP_CONSWRITE:
+      cpu->ConsoleWrite ();
+      break;
+    }
+  }
   return (1);
 }
-
+
+//----------------------------------------------------------------------
+//	rfe
+//
+//	When returning from an exception, jump to the IAR.  To avoid
+//	illegal addresses, mask off the low two bits.  Also, turn
+//	interrupts on.
+//----------------------------------------------------------------------
 static
 int
-InstCvti2d (uint32 inst, Cpu *cpu)
+InstRfe (uint32 inst, Cpu *cpu)
 {
-  uint32	src1, src2, dst;
-  cpu->GetRFields (inst, src1, src2, dst);
-  DBPRINTF ('f',"Converting f%d (%08x) to DFP (%lf) in f%d\n",
-	    src1, cpu->GetFreg(src1), (double)cpu->GetFreg(src1), dst);
-  cpu->PutFregD (dst, (double)cpu->GetFreg(src1));
+  return (cpu->DoRfe (inst));
+}
+
+int
+Cpu::DoRfe (uint32 inst)
+{
+  uint32	iar;
+  uint32	isr;
+
+  if (UserMode ()) {
+    CauseException (DLX_EXC_PRIVILEGE);
+    return (1);
+  }
+  iar = GetSreg (DLX_SREG_IAR) & ~0x3;
+  OutputBasicBlock (iar);
+  if (flags & (DLX_TRACE_INSTRUCTIONS | DLX_TRACE_MEMORY)) {
+    TraceControl (tracefp, DLX_TRACE_REC_RFE, PC()-4, iar);
+  }
+  isr = GetSreg (DLX_SREG_ISR);
+  PerfSetMode (!(isr & DLX_STATUS_SYSMODE));
+  PutSreg (DLX_SREG_STATUS, isr);
+  XlateModeUpdate (isr);
+  SetPC (iar);
   return (1);
 }
 
 //----------------------------------------------------------------------
 //
-//	RR Instruction Table
+//	Miscellaneous instructions
 //
 //----------------------------------------------------------------------
-Instruction Cpu::rrrInstrs[64] = {
-  {0x00, DLX_FMT_RFMT, InstIllegal},
-  {0x01, DLX_FMT_RFMT, InstIllegal},
-  {0x02, DLX_FMT_RFMT, InstIllegal},
-  {0x03, DLX_FMT_RFMT, InstIllegal},
-  {0x04, DLX_FMT_RFMT, InstSll},
-  {0x05, DLX_FMT_RFMT, InstIllegal},
-  {0x06, DLX_FMT_RFMT, InstSrl},
-  {0x07, DLX_FMT_RFMT, InstSra},
-  {0x08, DLX_FMT_RFMT, InstIllegal},
-  {0x09, DLX_FMT_RFMT, InstIllegal},
-  {0x0a, DLX_FMT_RFMT, InstIllegal},
-  {0x0b, DLX_FMT_RFMT, InstIllegal},
-  {0x0c, DLX_FMT_RFMT, InstIllegal},		// ALU TRAP instruction
-  {0x0d, DLX_FMT_RFMT, InstIllegal},
-  {0x0e, DLX_FMT_RFMT, InstIllegal},
-  {0x0f, DLX_FMT_RFMT, InstIllegal},
-  {0x10, DLX_FMT_RFMT, InstIllegal},
-  {0x11, DLX_FMT_RFMT, InstIllegal},
+static
+int
+InstMovi2s (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+
+  if (cpu->UserMode ()) {
+    cpu->CauseException (DLX_EXC_PRIVILEGE);
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  DBPRINTF ('S',"Moving integer reg %d (0x%x) to special reg %d.\n",
+	    src1, cpu->GetIreg(src1), dst);
+  TlbNoteSregWrite (dst, cpu->GetSreg (dst), cpu->GetIreg (src1));
+  if (dst == DLX_SREG_STATUS) {
+    PerfSetMode (!(cpu->GetIreg (src1) & DLX_STATUS_SYSMODE));
+  }
+  cpu->PutSreg (dst, cpu->GetIreg (src1));
+  if (dst == DLX_SREG_STATUS) {
+    XlateModeUpdate (cpu->GetSreg (DLX_SREG_STATUS));
+  }
+  return (1);
+}
+
+static
+int
+InstMovs2i (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+
+  if (cpu->UserMode ()) {
+    cpu->CauseException (DLX_EXC_PRIVILEGE);
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  DBPRINTF ('S',"Moving special reg %d (0x%x) to integer reg %d.\n",
+	    src1, cpu->GetSreg(src1), dst);
+  cpu->PutIreg (dst, cpu->GetSreg (src1));
+  return (1);
+}
+
+static
+int
+InstIllegal (uint32 inst, Cpu *cpu)
+{
+  cpu->CauseException (DLX_EXC_ILLEGALINST);
+  return (1);
+}
+
+static
+int
+InstNop (uint32, Cpu *cpu)
+{
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	wait: idle until the next interrupt (system mode only).
+//
+//	Nothing can happen before the next event, so rather than spinning
+//	until then, the instruction count (and with it simulated time)
+//	jumps to just before it.  The next instruction then finds the
+//	event due.  Skipped instructions are reported at exit; they still
+//	count as time, and so as instructions, everywhere else.
+//
+//----------------------------------------------------------------------
+static double	waitSkipped = 0.0;
+
+static
+int
+InstWait (uint32 inst, Cpu *cpu)
+{
+  if (cpu->UserMode ()) {
+    cpu->CauseException (DLX_EXC_PRIVILEGE);
+    return (1);
+  }
+  if ((eventNext != DLX_EVENT_NEVER) && (eventNext > dlxCycle + 1)) {
+    DBPRINTF ('t', "Waiting %llu instructions for the next event.\n",
+	      eventNext - dlxCycle - 1);
+    waitSkipped += (double)(eventNext - dlxCycle - 1);
+    dlxCycle = eventNext - 1;
+  }
+  return (1);
+}
+
+
+//----------------------------------------------------------------------
+//
+//	Single precision FP math instructions.
+//
+//----------------------------------------------------------------------
+static
+int
+InstAddf (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregF (dst, cpu->GetFregF (src1) + cpu->GetFregF (src2));
+  return (1);
+}
+
+static
+int
+InstSubf (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregF (dst, cpu->GetFregF (src1) - cpu->GetFregF (src2));
+  return (1);
+}
+
+static
+int
+InstMultf (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregF (dst, cpu->GetFregF (src1) * cpu->GetFregF (src2));
+  return (1);
+}
+
+static
+int
+InstDivf (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  float	denom;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  denom = cpu->GetFregF (src2);
+  if (denom == (float)0.0) {
+    cpu->CauseException (DLX_EXC_DIV0);
+  } else {
+    cpu->PutFregF (dst, cpu->GetFregF (src1) / denom);
+  }
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	Single precision FP comparison instructions
+//
+//----------------------------------------------------------------------
+static
+int
+InstEqf (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregF (src1) == cpu->GetFregF (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstNef (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregF (src1) != cpu->GetFregF (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+static
+int
+InstLtf (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregF (src1) < cpu->GetFregF (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstGtf (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregF (src1) > cpu->GetFregF (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstLef (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregF (src1) <= cpu->GetFregF (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstGef (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregF (src1) >= cpu->GetFregF (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	Double precision FP math instructions.
+//
+//----------------------------------------------------------------------
+static
+int
+InstAddd (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregD (dst, cpu->GetFregD (src1) + cpu->GetFregD (src2));
+  return (1);
+}
+
+static
+int
+InstSubd (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregD (dst, cpu->GetFregD (src1) - cpu->GetFregD (src2));
+  return (1);
+}
+
+static
+int
+InstMultd (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregD (dst, cpu->GetFregD (src1) * cpu->GetFregD (src2));
+  return (1);
+}
+
+static
+int
+InstDivd (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  double	denom;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  denom = cpu->GetFregD (src2);
+  if (denom == (double)0.0) {
+    cpu->CauseException (DLX_EXC_DIV0);
+  } else {
+    cpu->PutFregD (dst, cpu->GetFregD(src1) / denom);
+  }
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	Double precision FP comparison instructions
+//
+//----------------------------------------------------------------------
+static
+int
+InstEqd (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregD (src1) == cpu->GetFregD (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstNed (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregD (src1) != cpu->GetFregD (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstLtd (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregD (src1) < cpu->GetFregD (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstGtd (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregD (src1) > cpu->GetFregD (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstLed (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregD (src1) <= cpu->GetFregD (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+static
+int
+InstGed (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  if (cpu->GetFregD (src1) >= cpu->GetFregD (src2)) {
+    cpu->SetStatusBit (DLX_STATUS_FPTRUE);
+  } else {
+    cpu->ClrStatusBit (DLX_STATUS_FPTRUE);
+  }	
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	Conversion instructions
+//
+//----------------------------------------------------------------------
+static
+int
+InstCvtf2d (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregD (dst, (double)cpu->GetFregF(src1));
+  return (1);
+}
+
+static
+int
+InstCvtf2i (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFreg (dst, (int)cpu->GetFregF(src1));
+  return (1);
+}
+
+static
+int
+InstCvtd2f (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregF (dst, (float)cpu->GetFregD(src1));
+  return (1);
+}
+
+static
+int
+InstCvtd2i (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFreg (dst, (int)cpu->GetFregD(src1));
+  return (1);
+}
+
+static
+int
+InstCvti2f (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  cpu->PutFregF (dst, (float)cpu->GetFreg(src1));
+  return (1);
+}
+
+static
+int
+InstCvti2d (uint32 inst, Cpu *cpu)
+{
+  uint32	src1, src2, dst;
+  if (FpUnavailable (cpu)) {
+    return (1);
+  }
+  cpu->GetRFields (inst, src1, src2, dst);
+  DBPRINTF ('f',"Converting f%d (%08x) to DFP (%lf) in f%d\n",
+	    src1, cpu->GetFreg(src1), (double)cpu->GetFreg(src1), dst);
+  cpu->PutFregD (dst, (double)cpu->GetFreg(src1));
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	RR Instruction Table
+//
+//----------------------------------------------------------------------
+Instruction Cpu::rrrInstrs[64] = {
+  {0x00, DLX_FMT_RFMT, InstIllegal},
+  {0x01, DLX_FMT_RFMT, InstIllegal},
+  {0x02, DLX_FMT_RFMT, InstIllegal},
+  {0x03, DLX_FMT_RFMT, InstIllegal},
+  {0x04, DLX_FMT_RFMT, InstSll},
+  {0x05, DLX_FMT_RFMT, InstIllegal},
+  {0x06, DLX_FMT_RFMT, InstSrl},
+  {0x07, DLX_FMT_RFMT, InstSra},
+  {0x08, DLX_FMT_RFMT, InstIllegal},
+  {0x09, DLX_FMT_RFMT, InstIllegal},
+  {0x0a, DLX_FMT_RFMT, InstIllegal},
+  {0x0b, DLX_FMT_RFMT, InstIllegal},
+  {0x0c, DLX_FMT_RFMT, InstIllegal},		// ALU TRAP instruction
+  {0x0d, DLX_FMT_RFMT, InstIllegal},
+  {0x0e, DLX_FMT_RFMT, InstIllegal},
+  {0x0f, DLX_FMT_RFMT, InstIllegal},
+  {0x10, DLX_FMT_RFMT, InstIllegal},
+  {0x11, DLX_FMT_RFMT, InstIllegal},
   {0x12, DLX_FMT_RFMT, InstIllegal},
   {0x13, DLX_FMT_RFMT, InstIllegal},
   {0x14, DLX_FMT_RFMT, InstIllegal},
@@ -1766,10 +2964,10 @@ Instruction Cpu::rrrInstrs[64] = {
   {0x35, DLX_FMT_RFMT, InstMovi2fp},
   {0x36, DLX_FMT_RFMT, InstIllegal},
   {0x37, DLX_FMT_RFMT, InstIllegal},
-  {0x38, DLX_FMT_RFMT, InstIllegal},
-  {0x39, DLX_FMT_RFMT, InstIllegal},
-  {0x3a, DLX_FMT_RFMT, InstIllegal},
-  {0x3b, DLX_FMT_RFMT, InstIllegal},
+  {0x38, DLX_FMT_RFMT, InstFfs},
+  {0x39, DLX_FMT_RFMT, InstPopc},
+  {0x3a, DLX_FMT_RFMT, InstCmpb},
+  {0x3b, DLX_FMT_RFMT, InstZbyte},
   {0x3c, DLX_FMT_RFMT, InstIllegal},
   {0x3d, DLX_FMT_RFMT, InstIllegal},
   {0x3e, DLX_FMT_RFMT, InstIllegal},
@@ -1778,812 +2976,4061 @@ Instruction Cpu::rrrInstrs[64] = {
 
 //----------------------------------------------------------------------
 //
-//	Table of "regular" instructions
+//	Table of "regular" instructions
+//
+//----------------------------------------------------------------------
+Instruction Cpu::regInstrs[64] = {
+  {0x00, DLX_FMT_RFMT, InstIllegal},		// R-format instructions
+  {0x01, DLX_FMT_RFMT, InstIllegal},		// FP instructions
+  {0x02, DLX_FMT_JFMT, InstJmp},
+  {0x03, DLX_FMT_JFMT, InstJal},
+  {0x04, DLX_FMT_IFMT, InstBeqz},
+  {0x05, DLX_FMT_IFMT, InstBnez},
+  {0x06, DLX_FMT_IFMT, InstBfpt},
+  {0x07, DLX_FMT_IFMT, InstBfpf},
+  {0x08, DLX_FMT_IFMT, InstAddi},
+  {0x09, DLX_FMT_IFMT, InstAddui},
+  {0x0a, DLX_FMT_IFMT, InstSubi},
+  {0x0b, DLX_FMT_IFMT, InstSubui},
+  {0x0c, DLX_FMT_IFMT, InstAndi},
+  {0x0d, DLX_FMT_IFMT, InstOri},
+  {0x0e, DLX_FMT_IFMT, InstXori},
+  {0x0f, DLX_FMT_IFMT, InstLhi},
+  {0x10, DLX_FMT_JFMT, InstRfe},
+  {0x11, DLX_FMT_JFMT, InstTrap},
+  {0x12, DLX_FMT_JFMT, InstJr},
+  {0x13, DLX_FMT_JFMT, InstJalr},
+  {0x14, DLX_FMT_IFMT, InstSlli},
+  {0x15, DLX_FMT_IFMT, InstNop},
+  {0x16, DLX_FMT_IFMT, InstSrli},
+  {0x17, DLX_FMT_IFMT, InstSrai},
+  {0x18, DLX_FMT_IFMT, InstSeqi},
+  {0x19, DLX_FMT_IFMT, InstSnei},
+  {0x1a, DLX_FMT_IFMT, InstSlti},
+  {0x1b, DLX_FMT_IFMT, InstSgti},
+  {0x1c, DLX_FMT_IFMT, InstSlei},
+  {0x1d, DLX_FMT_IFMT, InstSgei},
+  {0x1e, DLX_FMT_IFMT, InstSwap},
+  {0x1f, DLX_FMT_IFMT, InstTas},
+  {0x20, DLX_FMT_IFMT, InstLb},
+  {0x21, DLX_FMT_IFMT, InstLh},
+  {0x22, DLX_FMT_IFMT, InstLl},
+  {0x23, DLX_FMT_IFMT, InstLw},
+  {0x24, DLX_FMT_IFMT, InstLbu},
+  {0x25, DLX_FMT_IFMT, InstLhu},
+  {0x26, DLX_FMT_IFMT, InstLf},
+  {0x27, DLX_FMT_IFMT, InstLd},
+  {0x28, DLX_FMT_IFMT, InstSb},
+  {0x29, DLX_FMT_IFMT, InstSh},
+  {0x2a, DLX_FMT_IFMT, InstSc},
+  {0x2b, DLX_FMT_IFMT, InstSw},
+  {0x2c, DLX_FMT_IFMT, InstWait},
+  {0x2d, DLX_FMT_IFMT, InstIllegal},
+  {0x2e, DLX_FMT_IFMT, InstSf},
+  {0x2f, DLX_FMT_IFMT, InstSd},
+  {0x30, DLX_FMT_IFMT, InstIllegal},
+  {0x31, DLX_FMT_IFMT, InstIllegal},
+  {0x32, DLX_FMT_IFMT, InstIllegal},
+  {0x33, DLX_FMT_IFMT, InstIllegal},
+  {0x34, DLX_FMT_IFMT, InstIllegal},
+  {0x35, DLX_FMT_IFMT, InstIllegal},
+  {0x36, DLX_FMT_IFMT, InstIllegal},
+  {0x37, DLX_FMT_IFMT, InstIllegal},
+  {0x38, DLX_FMT_IFMT, InstIllegal},
+  {0x39, DLX_FMT_IFMT, InstIllegal},
+  {0x3a, DLX_FMT_IFMT, InstIllegal},
+  {0x3b, DLX_FMT_IFMT, InstIllegal},
+  {0x3c, DLX_FMT_IFMT, InstIllegal},
+  {0x3d, DLX_FMT_IFMT, InstIllegal},
+  {0x3e, DLX_FMT_IFMT, InstIllegal},
+  {0x3f, DLX_FMT_IFMT, InstIllegal},
+};
+
+//----------------------------------------------------------------------
+//
+//	Table of FP instructions
+//
+//----------------------------------------------------------------------
+Instruction Cpu::fpInstrs[32] = {
+  {0x00, DLX_FMT_RFMT, InstAddf},
+  {0x01, DLX_FMT_RFMT, InstSubf},
+  {0x02, DLX_FMT_RFMT, InstMultf},
+  {0x03, DLX_FMT_RFMT, InstDivf},
+  {0x04, DLX_FMT_RFMT, InstAddd},
+  {0x05, DLX_FMT_RFMT, InstSubd},
+  {0x06, DLX_FMT_RFMT, InstMultd},
+  {0x07, DLX_FMT_RFMT, InstDivd},
+  {0x08, DLX_FMT_RFMT, InstCvtf2d},
+  {0x09, DLX_FMT_RFMT, InstCvtf2i},
+  {0x0a, DLX_FMT_RFMT, InstCvtd2f},
+  {0x0b, DLX_FMT_RFMT, InstCvtd2i},
+  {0x0c, DLX_FMT_RFMT, InstCvti2f},
+  {0x0d, DLX_FMT_RFMT, InstCvti2d},
+  {0x0e, DLX_FMT_RFMT, InstMult},
+  {0x0f, DLX_FMT_RFMT, InstDiv},
+  {0x10, DLX_FMT_RFMT, InstEqf},
+  {0x11, DLX_FMT_RFMT, InstNef},
+  {0x12, DLX_FMT_RFMT, InstLtf},
+  {0x13, DLX_FMT_RFMT, InstGtf},
+  {0x14, DLX_FMT_RFMT, InstLef},
+  {0x15, DLX_FMT_RFMT, InstGef},
+  {0x16, DLX_FMT_RFMT, InstMultu},
+  {0x17, DLX_FMT_RFMT, InstDivu},
+  {0x18, DLX_FMT_RFMT, InstEqd},
+  {0x19, DLX_FMT_RFMT, InstNed},
+  {0x1a, DLX_FMT_RFMT, InstLtd},
+  {0x1b, DLX_FMT_RFMT, InstGtd},
+  {0x1c, DLX_FMT_RFMT, InstLed},
+  {0x1d, DLX_FMT_RFMT, InstGed},
+  {0x1e, DLX_FMT_RFMT, InstIllegal},
+  {0x1f, DLX_FMT_RFMT, InstIllegal},
+};
+
+//----------------------------------------------------------------------
+//
+//	Predecoded instruction cache
+//
+//	Decoding an instruction means picking the right table (regular,
+//	R-R, or FP) and the right entry in it.  Since the same code is
+//	run over and over (idle loop, bcopy, queue walks), ExecOne keeps
+//	the resolved handler for each instruction word it has run in a
+//	direct-mapped cache indexed by physical address.  The raw
+//	instruction word is kept too so handlers get the same argument
+//	they always did.
+//
+//	Any write to simulated memory that could change a cached word
+//	must invalidate it: WriteWord does this for each word it stores,
+//	FileIo does it for the destination of a read, and LoadMemory
+//	flushes the whole cache.
+//
+//----------------------------------------------------------------------
+#define	DLX_DECODE_CACHE_BITS	14
+#define	DLX_DECODE_CACHE_SIZE	(1 << DLX_DECODE_CACHE_BITS)
+#define	DLX_DECODE_CACHE_MASK	(DLX_DECODE_CACHE_SIZE - 1)
+#define	DLX_DECODE_CACHE_EMPTY	0x1	// never a legal word address
+
+typedef int (*DecodedHandler)(uint32, Cpu *);
+
+typedef struct DecodedInst {
+  uint32		paddr;		// physical address of this word
+  uint32		inst;		// raw instruction word
+  DecodedHandler	handler;	// resolved table entry
+} DecodedInst;
+
+static DecodedInst	decodeCache[DLX_DECODE_CACHE_SIZE];
+static double		decodeCacheHits = 0.0;
+static double		decodeCacheMisses = 0.0;
+
+static
+inline
+DecodedInst *
+DecodeCacheSlot (uint32 paddr)
+{
+  return (&decodeCache[(paddr >> 2) & DLX_DECODE_CACHE_MASK]);
+}
+
+static
+void
+DecodeCacheFlush ()
+{
+  int		i;
+
+  for (i = 0; i < DLX_DECODE_CACHE_SIZE; i++) {
+    decodeCache[i].paddr = DLX_DECODE_CACHE_EMPTY;
+  }
+}
+
+static
+inline
+void
+DecodeCacheInvalidate (uint32 paddr)
+{
+  DecodedInst	*dc = DecodeCacheSlot (paddr & ~0x3);
+
+  if (dc->paddr == (paddr & ~0x3)) {
+    dc->paddr = DLX_DECODE_CACHE_EMPTY;
+  }
+}
+
+static
+void
+DecodeCacheInvalidateRange (uint32 paddr, uint32 nbytes)
+{
+  uint32	a, end;
+
+  if (nbytes >= (DLX_DECODE_CACHE_SIZE << 2)) {
+    DecodeCacheFlush ();
+    return;
+  }
+  end = paddr + nbytes;
+  for (a = paddr & ~0x3; a < end; a += 4) {
+    DecodeCacheInvalidate (a);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	Block cache
+//
+//	In the uninstrumented interpreter, straight-line runs of code are
+//	decoded once into a DlxBlock: an array of handlers and raw words
+//	that ExecOne runs back to back without fetching, translating or
+//	decoding each instruction.  A block ends after the first
+//	instruction that can change the flow of control or the address
+//	space (jumps, branches, traps, rfe and movi2s), after
+//	DLX_BLOCK_MAX_INSTRS instructions, or at the end of a
+//	DLX_BLOCK_REGION_SIZE region.  Since no page is smaller than a
+//	region, the whole block shares the translation of its first
+//	instruction.
+//
+//	Each block remembers the block that ran after it last time, so a
+//	loop or a call/return pair chains directly from block to block as
+//	long as the translation of the target still ends up at the same
+//	physical address.
+//
+//	A write into a region that holds code bumps that region's
+//	generation number, which invalidates every block built from it.
+//
+//	A block that runs DLX_HOT_THRESHOLD times is also translated into
+//	DlxHotOps (see "Hot blocks" below).
+//
+//----------------------------------------------------------------------
+#define	DLX_BLOCK_MAX_INSTRS	32
+#define	DLX_BLOCK_REGION_BITS	8
+#define	DLX_BLOCK_REGION_SIZE	(1 << DLX_BLOCK_REGION_BITS)
+#define	DLX_BLOCK_CACHE_BITS	12
+#define	DLX_BLOCK_CACHE_SIZE	(1 << DLX_BLOCK_CACHE_BITS)
+#define	DLX_BLOCK_CACHE_MASK	(DLX_BLOCK_CACHE_SIZE - 1)
+#define	DLX_BLOCK_EMPTY		0x1	// never a legal word address
+
+// A pre-decoded instruction for a hot block: operands are pulled out
+// and immediates extended ahead of time.
+typedef struct DlxHotOp {
+  unsigned char	kind;		// DLX_HOT_*
+  unsigned char	rd, rs1, rs2;
+  uint32	imm;
+} DlxHotOp;
+
+typedef struct DlxBlock {
+  uint32		paddr;		// physical address of first instruction
+  uint32		gen;		// region generation when built
+  int			ninstrs;
+  uint32		chainVaddr;	// where control went last time ...
+  struct DlxBlock	*chain;		// ... and the block found there
+  DecodedHandler	handler[DLX_BLOCK_MAX_INSTRS];
+  uint32		inst[DLX_BLOCK_MAX_INSTRS];
+  uint32		runs;		// times entered since built
+  int			hot;		// hotOp[] is filled in
+  DlxHotOp		hotOp[DLX_BLOCK_MAX_INSTRS];
+} DlxBlock;
+
+static DlxBlock	blockCache[DLX_BLOCK_CACHE_SIZE];
+static uint32	*regionGen = NULL;	// one per region of memory
+static unsigned char *regionHasCode = NULL;
+static uint32	nRegions = 0;
+
+static
+inline
+DlxBlock *
+BlockSlot (uint32 paddr)
+{
+  return (&blockCache[(paddr >> 2) & DLX_BLOCK_CACHE_MASK]);
+}
+
+static
+inline
+int
+BlockValid (DlxBlock *b, uint32 paddr)
+{
+  return ((b->paddr == paddr) &&
+	  (b->gen == regionGen[paddr >> DLX_BLOCK_REGION_BITS]));
+}
+
+static
+void
+BlockCacheFlush ()
+{
+  int		i;
+
+  for (i = 0; i < DLX_BLOCK_CACHE_SIZE; i++) {
+    blockCache[i].paddr = DLX_BLOCK_EMPTY;
+    blockCache[i].chain = NULL;
+  }
+}
+
+static
+void
+BlockStart (DlxBlock *b, uint32 paddr, uint32 memsize)
+{
+  uint32	r;
+
+  if (regionGen == NULL) {
+    nRegions = (memsize >> DLX_BLOCK_REGION_BITS) + 1;
+    regionGen = new uint32[nRegions];
+    regionHasCode = new unsigned char[nRegions];
+    memset (regionGen, 0, nRegions * sizeof (uint32));
+    memset (regionHasCode, 0, nRegions);
+  }
+  r = paddr >> DLX_BLOCK_REGION_BITS;
+  regionHasCode[r] = 1;
+  b->paddr = paddr;
+  b->gen = regionGen[r];
+  b->ninstrs = 0;
+  b->chain = NULL;
+  b->runs = 0;
+  b->hot = 0;
+}
+
+static
+inline
+void
+BlockNoteWrite (uint32 paddr)
+{
+  uint32	r = paddr >> DLX_BLOCK_REGION_BITS;
+
+  if ((r < nRegions) && regionHasCode[r]) {
+    regionGen[r] += 1;
+    regionHasCode[r] = 0;
+  }
+}
+
+static
+void
+BlockNoteWriteRange (uint32 paddr, uint32 nbytes)
+{
+  uint32	a;
+
+  for (a = paddr & ~(DLX_BLOCK_REGION_SIZE - 1); a < paddr + nbytes;
+       a += DLX_BLOCK_REGION_SIZE) {
+    BlockNoteWrite (a);
+  }
+}
+
+// Returns nonzero if a block must end after this instruction.
+static
+int
+BlockEndsWith (uint32 inst)
+{
+  switch ((inst >> DLX_OPCODE_SHIFT) & DLX_OPCODE_MASK) {
+  case 0x00:
+    // movi2s may change the status register or the page table
+    return (((inst >> DLX_ALU_FUNC_CODE_SHIFT) & DLX_ALU_FUNC_CODE_MASK)
+	    == 0x30);
+  case 0x02: case 0x03:			// j, jal
+  case 0x04: case 0x05:			// beqz, bnez
+  case 0x06: case 0x07:			// bfpt, bfpf
+  case 0x10: case 0x11:			// rfe, trap
+  case 0x12: case 0x13:			// jr, jalr
+    return (1);
+  default:
+    return (0);
+  }
+}
+
+static
+inline
+DecodedHandler
+DecodeHandler (uint32 inst, Instruction *rrr, Instruction *fp,
+	       Instruction *reg)
+{
+  uint32	curOp;
+
+  curOp = (inst >> DLX_OPCODE_SHIFT) & DLX_OPCODE_MASK;
+  switch (curOp) {
+  case 0x00:		// ALU and other R-R operations
+    return (rrr[(inst >> DLX_ALU_FUNC_CODE_SHIFT) &
+		DLX_ALU_FUNC_CODE_MASK].handler);
+  case 0x01:		// FP operations
+    return (fp[(inst >> DLX_FPU_FUNC_CODE_SHIFT) &
+	       DLX_FPU_FUNC_CODE_MASK].handler);
+  default:
+    return (reg[curOp].handler);
+  }
+}
+
+//Zheng{
+#if USE_ROP
+// The read-only bit takes DLX_PTE_REFERENCED's place, so references
+// are recorded one bit higher for the OS's page replacement.
+#define	DLX_ROP_PTE_REFERENCED	0x8
+#define	DLX_FETCH_PTEFLAGS	DLX_ROP_PTE_REFERENCED
+#else
+//}Zheng
+#define	DLX_FETCH_PTEFLAGS	DLX_PTE_REFERENCED
+#endif
+
+//----------------------------------------------------------------------
+//
+//	Translation cache (TLB)
+//
+//	VaddrToPaddr keeps the last leaf PTE it used for each virtual page
+//	in a small direct-mapped table, tagged by the page table base so
+//	that processes don't have to flush each other out on a context
+//	switch.  Only valid PTEs are cached.
+//
+//	The OS changes translations by storing to page tables, so every
+//	memory word that a cached entry was read from (the leaf PTE and,
+//	for two-level tables, the L1 entry) is marked in a bitmap.  A
+//	store to a marked word flushes the TLB.  Writes to the page table
+//	size or bits registers flush it too, since they change how every
+//	address is split.
+//
+//----------------------------------------------------------------------
+#define	DLX_TLB_BITS		6
+#define	DLX_TLB_SIZE		(1 << DLX_TLB_BITS)
+#define	DLX_TLB_MASK		(DLX_TLB_SIZE - 1)
+#define	DLX_TLB_EMPTY		0x1	// never a page-aligned address
+
+typedef struct TlbEntry {
+  uint32	base;		// DLX_SREG_PGTBL_BASE this came from
+  uint32	vpage;		// virtual address with the offset masked off
+  uint32	pte;		// copy of the leaf PTE
+  uint32	pteaddr;	// physical address of the leaf PTE
+  uint32	l1addr;		// physical address of the L1 entry used
+} TlbEntry;
+
+static TlbEntry	tlb[DLX_TLB_SIZE];
+static uint32	*tlbPteWords = NULL;	// 1 bit per word of memory
+static uint32	tlbPteWordsMax = 0;	// number of words covered
+static double	tlbHits = 0.0;
+static double	tlbMisses = 0.0;
+
+static
+inline
+TlbEntry *
+TlbSlot (uint32 base, uint32 vpn)
+{
+  return (&tlb[(vpn ^ (base >> 8)) & DLX_TLB_MASK]);
+}
+
+static
+inline
+void
+TlbMarkWord (uint32 paddr)
+{
+  uint32	w = paddr >> 2;
+
+  if (w < tlbPteWordsMax) {
+    tlbPteWords[w >> 5] |= (1 << (w & 0x1f));
+  }
+}
+
+static
+inline
+void
+TlbUnmarkWord (uint32 paddr)
+{
+  uint32	w = paddr >> 2;
+
+  if (w < tlbPteWordsMax) {
+    tlbPteWords[w >> 5] &= ~(1 << (w & 0x1f));
+  }
+}
+
+static
+void
+TlbFlush ()
+{
+  int		i;
+
+  for (i = 0; i < DLX_TLB_SIZE; i++) {
+    if (tlb[i].vpage != DLX_TLB_EMPTY) {
+      TlbUnmarkWord (tlb[i].pteaddr);
+      TlbUnmarkWord (tlb[i].l1addr);
+      tlb[i].vpage = DLX_TLB_EMPTY;
+    }
+  }
+}
+
+static
+void
+TlbFill (TlbEntry *te, uint32 base, uint32 vpage, uint32 l1addr,
+	 uint32 pteaddr, uint32 pte, uint32 memsize)
+{
+  if (tlbPteWords == NULL) {
+    tlbPteWordsMax = memsize >> 2;
+    tlbPteWords = new uint32[(tlbPteWordsMax >> 5) + 1];
+    memset (tlbPteWords, 0, ((tlbPteWordsMax >> 5) + 1) * sizeof (uint32));
+  }
+  // The bits of the entry being replaced may be shared with other
+  // entries, so leave them set.  The worst that happens is a spurious
+  // flush later on.
+  te->base = base;
+  te->vpage = vpage;
+  te->pte = pte;
+  te->pteaddr = pteaddr;
+  te->l1addr = l1addr;
+  TlbMarkWord (pteaddr);
+  TlbMarkWord (l1addr);
+}
+
+static
+inline
+void
+TlbNoteWrite (uint32 paddr)
+{
+  uint32	w = paddr >> 2;
+
+  if ((w < tlbPteWordsMax) && (tlbPteWords[w >> 5] & (1 << (w & 0x1f)))) {
+    DBPRINTF ('m', "Store to cached PTE at 0x%x, flushing TLB.\n", paddr);
+    TlbFlush ();
+    TlbUnmarkWord (paddr);
+  }
+}
+
+// Bulk version of TlbNoteWrite for a run of nbytes bytes.
+static
+void
+TlbNoteWriteRange (uint32 paddr, uint32 nbytes)
+{
+  uint32	w, wend;
+
+  if ((nbytes == 0) || ((paddr >> 2) >= tlbPteWordsMax)) {
+    return;
+  }
+  wend = (paddr + nbytes - 1) >> 2;
+  if (wend >= tlbPteWordsMax) {
+    wend = tlbPteWordsMax - 1;
+  }
+  for (w = paddr >> 2; w <= wend; w++) {
+    if ((w & 0x1f) == 0) {
+      while ((w + 32 <= wend) && (tlbPteWords[w >> 5] == 0)) {
+	w += 32;
+      }
+    }
+    if (tlbPteWords[w >> 5] & (1 << (w & 0x1f))) {
+      DBPRINTF ('m', "Block write over cached PTE at 0x%x, flushing TLB.\n",
+		w << 2);
+      TlbFlush ();
+      memset (tlbPteWords + ((paddr >> 2) >> 5), 0,
+	      ((wend >> 5) - ((paddr >> 2) >> 5) + 1) * sizeof (uint32));
+      return;
+    }
+  }
+}
+
+static
+void
+TlbNoteSregWrite (uint32 sreg, uint32 oldval, uint32 newval)
+{
+  if ((oldval != newval) &&
+      ((sreg == DLX_SREG_PGTBL_SIZE) || (sreg == DLX_SREG_PGTBL_BITS))) {
+    TlbFlush ();
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	Performance counters
+//
+//	A read-only bank of 64-bit counters the OS can read through the
+//	I/O space.  Counter i is at DLX_PERF_BASE + 8*i (low word) and
+//	DLX_PERF_BASE + 8*i + 4 (high word); writing the low word sets
+//	the counter, so writing 0 resets it.  Exceptions are also counted
+//	by cause: counter DLX_PERF_CAUSE_BASE + cause for every cause
+//	below DLX_PERF_NUM_CAUSES.
+//
+//	Counters that would cost something on every instruction are
+//	derived instead: instructions retired is the event-queue
+//	instruction count, and user-mode instructions are accumulated at
+//	mode switches (exceptions and rfe).
+//
+//----------------------------------------------------------------------
+#define	DLX_PERF_BASE		0xffff1000
+#define	DLX_PERF_INSTRS		0	// instructions retired
+#define	DLX_PERF_USER_INSTRS	1	// ... in user mode
+#define	DLX_PERF_SYS_INSTRS	2	// ... in system mode
+#define	DLX_PERF_LOADS		3	// data reads (incl. sb/sh read half)
+#define	DLX_PERF_STORES		4	// data writes
+#define	DLX_PERF_PT_WALKS	5	// page table walks (TLB misses)
+#define	DLX_PERF_TLB_HITS	6	// translations served by the TLB
+#define	DLX_PERF_PAGE_FAULTS	7
+#define	DLX_PERF_EXCEPTIONS	8	// all exceptions, traps included
+#define	DLX_PERF_TRAPS		9	// trap instructions sent to the OS
+#define	DLX_PERF_TIMER_INTRS	10
+#define	DLX_PERF_KBD_INTRS	11
+#define	DLX_PERF_CAUSE_BASE	16
+#define	DLX_PERF_NUM_CAUSES	0x80
+#define	DLX_PERF_NUM		(DLX_PERF_CAUSE_BASE + DLX_PERF_NUM_CAUSES)
+#define	DLX_PERF_SIZE		(DLX_PERF_NUM * 8)
+
+static DlxCycle	perfCounters[DLX_PERF_NUM];
+static int	perfUserMode = 0;	// mode since perfModeSince
+static DlxCycle	perfModeSince = 0;
+
+static
+inline
+void
+PerfCount (int ctr)
+{
+  perfCounters[ctr] += 1;
+}
+
+static
+void
+PerfSetMode (int user)
+{
+  if (perfUserMode) {
+    perfCounters[DLX_PERF_USER_INSTRS] += dlxCycle - perfModeSince;
+  }
+  perfUserMode = user;
+  perfModeSince = dlxCycle;
+}
+
+static
+void
+PerfNoteException (int excType)
+{
+  perfCounters[DLX_PERF_EXCEPTIONS] += 1;
+  if (excType & 0x08000000) {
+    perfCounters[DLX_PERF_TRAPS] += 1;
+  } else if (excType < DLX_PERF_NUM_CAUSES) {
+    perfCounters[DLX_PERF_CAUSE_BASE + excType] += 1;
+  }
+}
+
+static
+DlxCycle
+PerfValue (int ctr)
+{
+  DlxCycle	user;
+
+  user = perfCounters[DLX_PERF_USER_INSTRS];
+  if (perfUserMode) {
+    user += dlxCycle - perfModeSince;
+  }
+  switch (ctr) {
+  case DLX_PERF_INSTRS:
+    return (dlxCycle - perfCounters[DLX_PERF_INSTRS]);
+  case DLX_PERF_USER_INSTRS:
+    return (user);
+  case DLX_PERF_SYS_INSTRS:
+    return (dlxCycle - perfCounters[DLX_PERF_INSTRS] - user);
+  case DLX_PERF_PT_WALKS:
+    return ((DlxCycle)tlbMisses - perfCounters[ctr]);
+  case DLX_PERF_TLB_HITS:
+    return ((DlxCycle)tlbHits - perfCounters[ctr]);
+  case DLX_PERF_PAGE_FAULTS:
+    return (perfCounters[DLX_PERF_CAUSE_BASE + DLX_EXC_PAGEFAULT]);
+  case DLX_PERF_TIMER_INTRS:
+    return (perfCounters[DLX_PERF_CAUSE_BASE + DLX_EXC_TIMER]);
+  case DLX_PERF_KBD_INTRS:
+    return (perfCounters[DLX_PERF_CAUSE_BASE + DLX_EXC_KBD]);
+  default:
+    return (perfCounters[ctr]);
+  }
+}
+
+static
+uint32
+PerfRead (uint32 paddr)
+{
+  DlxCycle	v = PerfValue ((paddr - DLX_PERF_BASE) >> 3);
+
+  return ((paddr & 0x4) ? (uint32)(v >> 32) : (uint32)v);
+}
+
+// Derived counters keep their base in perfCounters[] so that writing
+// one sets what subsequent reads return.
+static
+void
+PerfWrite (uint32 paddr, uint32 val)
+{
+  int		ctr = (paddr - DLX_PERF_BASE) >> 3;
+
+  if (paddr & 0x4) {
+    return;
+  }
+  switch (ctr) {
+  case DLX_PERF_INSTRS:
+    perfCounters[ctr] = dlxCycle - val;
+    break;
+  case DLX_PERF_USER_INSTRS:
+    perfCounters[ctr] = val;
+    perfModeSince = dlxCycle;
+    break;
+  case DLX_PERF_PT_WALKS:
+    perfCounters[ctr] = (DlxCycle)tlbMisses - val;
+    break;
+  case DLX_PERF_TLB_HITS:
+    perfCounters[ctr] = (DlxCycle)tlbHits - val;
+    break;
+  case DLX_PERF_SYS_INSTRS:
+    break;
+  case DLX_PERF_PAGE_FAULTS:
+    perfCounters[DLX_PERF_CAUSE_BASE + DLX_EXC_PAGEFAULT] = val;
+    break;
+  case DLX_PERF_TIMER_INTRS:
+    perfCounters[DLX_PERF_CAUSE_BASE + DLX_EXC_TIMER] = val;
+    break;
+  case DLX_PERF_KBD_INTRS:
+    perfCounters[DLX_PERF_CAUSE_BASE + DLX_EXC_KBD] = val;
+    break;
+  default:
+    perfCounters[ctr] = val;
+    break;
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	Cache model
+//
+//	If DLXSIM_CACHE is set, instruction fetches and data accesses to
+//	memory run through a model of split L1 caches:
+//
+//	DLXSIM_CACHE="isize:iassoc:iline,dsize:dassoc:dline,penalty[,time]"
+//
+//	Sizes are in bytes and must be powers of 2, as must the line
+//	sizes; replacement is LRU.  Each miss costs penalty cycles, and
+//	the run's cycle count (instructions plus miss stalls) is
+//	reported at exit.  With "time", the stalls are also added to the
+//	cycle count the event queue runs on (see CycleStall), so
+//	simulated time, and thus the timer, sees the memory latency.
+//
+//	Hits and misses are also counted per DLX_CACHE_REGION_SIZE region
+//	of physical memory, and the regions with the most misses are
+//	listed at exit (to DLXSIM_CACHE_REPORT if set, else stdout).
+//
+//	The model forces the instrumented interpreter, since the block
+//	cache's hot loads and stores don't go through ReadWord.  With
+//	DLXSIM_CACHE unset the fast interpreter is untouched, and
+//	ReadWord and WriteWord only test cacheOn.
+//
+//----------------------------------------------------------------------
+#define	DLX_CACHE_REGION_BITS	12
+#define	DLX_CACHE_REGION_SIZE	(1 << DLX_CACHE_REGION_BITS)
+#define	DLX_CACHE_REPORT_TOP	20
+
+typedef struct DlxCache {
+  const char	*name;
+  uint32	nsets;
+  uint32	assoc;
+  uint32	lineBits;
+  uint32	*tags;		// nsets * assoc, ~0 if empty
+  uint32	*age;		// last use, for LRU
+  uint32	clock;
+  double	hits;
+  double	misses;
+} DlxCache;
+
+typedef struct DlxCacheRegion {
+  double	hits;
+  double	misses;
+} DlxCacheRegion;
+
+static int		cacheOn = 0;
+static int		cacheTime = 0;	// stalls advance dlxCycle
+static uint32		cachePenalty = 0;
+static DlxCache		icache, dcache;
+static DlxCacheRegion	*cacheRegions = NULL;
+static uint32		cacheNRegions = 0;
+static double		cacheStalls = 0.0;
+
+static
+int
+CacheIsPow2 (uint32 v)
+{
+  return ((v != 0) && ((v & (v - 1)) == 0));
+}
+
+static
+void
+CacheSetup (DlxCache *c, const char *name, uint32 size, uint32 assoc,
+	    uint32 line)
+{
+  uint32	i;
+
+  if (!CacheIsPow2 (size) || !CacheIsPow2 (line) || (assoc == 0) ||
+      (size < assoc * line) || ((size / line) % assoc != 0)) {
+    printf ("FATAL ERROR: bad %s cache geometry %u:%u:%u.\n", name, size,
+	    assoc, line);
+    exit (1);
+  }
+  c->name = name;
+  c->assoc = assoc;
+  c->nsets = size / line / assoc;
+  for (c->lineBits = 0; (1u << c->lineBits) < line; c->lineBits++) {
+  }
+  c->tags = new uint32[c->nsets * assoc];
+  c->age = new uint32[c->nsets * assoc];
+  for (i = 0; i < c->nsets * assoc; i++) {
+    c->tags[i] = 0xffffffff;
+    c->age[i] = 0;
+  }
+  c->clock = 0;
+  c->hits = c->misses = 0.0;
+}
+
+//----------------------------------------------------------------------
+//
+//	CacheAccess
+//
+//	Look up physical address paddr in a cache, filling the line on a
+//	miss, and charge the miss penalty.
+//
+//----------------------------------------------------------------------
+static
+void
+CacheAccess (DlxCache *c, uint32 paddr)
+{
+  uint32	line = paddr >> c->lineBits;
+  uint32	set = (line % c->nsets) * c->assoc;
+  uint32	i, victim;
+  DlxCacheRegion *r = &cacheRegions[paddr >> DLX_CACHE_REGION_BITS];
+
+  c->clock++;
+  victim = set;
+  for (i = set; i < set + c->assoc; i++) {
+    if (c->tags[i] == line) {
+      c->age[i] = c->clock;
+      c->hits += 1.0;
+      r->hits += 1.0;
+      return;
+    }
+    if (c->age[i] < c->age[victim]) {
+      victim = i;
+    }
+  }
+  c->tags[victim] = line;
+  c->age[victim] = c->clock;
+  c->misses += 1.0;
+  r->misses += 1.0;
+  cacheStalls += cachePenalty;
+  if (cacheTime) {
+    CycleStall (cachePenalty);
+  }
+}
+
+static
+int
+CacheRegionCompare (const void *a, const void *b)
+{
+  double	ma = cacheRegions[*(const uint32 *)a].misses;
+  double	mb = cacheRegions[*(const uint32 *)b].misses;
+
+  return ((ma > mb) ? -1 : (ma < mb));
+}
+
+static
+void
+CacheReport ()
+{
+  const char	*file = getenv ("DLXSIM_CACHE_REPORT");
+  FILE		*out = stdout;
+  DlxCache	*c;
+  uint32	*order, i, n;
+  double	refs;
+
+  if ((file != NULL) && (file[0] != '\0') &&
+      ((out = fopen (file, "w")) == NULL)) {
+    out = stdout;
+  }
+  for (c = &icache; c != NULL; c = (c == &icache) ? &dcache : NULL) {
+    refs = c->hits + c->misses;
+    fprintf (out, "%s cache: %u sets x %u ways x %u bytes: %.0lf hits, "
+	     "%.0lf misses (%.2lf%% miss rate)\n", c->name, c->nsets, c->assoc,
+	     1u << c->lineBits, c->hits, c->misses,
+	     (refs > 0.0) ? 100.0 * c->misses / refs : 0.0);
+  }
+  fprintf (out, "Cycles: %.0lf (%llu instructions + %.0lf stall cycles)\n",
+	   (double)(dlxCycle - dlxStalls) + cacheStalls, dlxCycle - dlxStalls,
+	   cacheStalls);
+  order = new uint32[cacheNRegions];
+  for (i = n = 0; i < cacheNRegions; i++) {
+    if (cacheRegions[i].misses > 0.0) {
+      order[n++] = i;
+    }
+  }
+  qsort (order, n, sizeof (uint32), CacheRegionCompare);
+  fprintf (out, "Regions by misses (%d bytes each):\n", DLX_CACHE_REGION_SIZE);
+  for (i = 0; (i < n) && (i < DLX_CACHE_REPORT_TOP); i++) {
+    fprintf (out, "  0x%08x %12.0lf misses %12.0lf hits\n",
+	     order[i] << DLX_CACHE_REGION_BITS, cacheRegions[order[i]].misses,
+	     cacheRegions[order[i]].hits);
+  }
+  delete [] order;
+  if (out != stdout) {
+    fclose (out);
+  }
+}
+
+static
+void
+CacheInit (uint32 memsize)
+{
+  const char	*env = getenv ("DLXSIM_CACHE");
+  uint32	is, ia, il, ds, da, dl;
+  char		flag[16];
+  int		n;
+
+  if ((env == NULL) || (env[0] == '\0') || cacheOn) {
+    return;
+  }
+  flag[0] = '\0';
+  n = sscanf (env, "%u:%u:%u,%u:%u:%u,%u,%15s", &is, &ia, &il, &ds, &da, &dl,
+	      &cachePenalty, flag);
+  if (n < 7) {
+    printf ("FATAL ERROR: DLXSIM_CACHE should be "
+	    "isize:iassoc:iline,dsize:dassoc:dline,penalty[,time].\n");
+    exit (1);
+  }
+  cacheTime = !strcmp (flag, "time");
+  CacheSetup (&icache, "L1 I", is, ia, il);
+  CacheSetup (&dcache, "L1 D", ds, da, dl);
+  cacheNRegions = (memsize >> DLX_CACHE_REGION_BITS) + 1;
+  cacheRegions = (DlxCacheRegion *)calloc (cacheNRegions,
+					  sizeof (DlxCacheRegion));
+  cacheOn = 1;
+  atexit (CacheReport);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cost model
+//
+//	Without it every instruction takes one cycle, so a divide, a
+//	trap and a page table walk all cost the same simulated time.  If
+//	DLXSIM_COST is set, they cost extra cycles by class:
+//
+//	DLXSIM_COST="default" or "class=cycles[,class=cycles...]"
+//
+//	The classes are alu, load, store, branch, jump, mult, div (the
+//	integer ones), fp, fpdiv and trap (rfe and trap) for instructions,
+//	walk for each page table walk (TLB miss) and exception for each
+//	exception or interrupt taken, traps included.  Each is extra on
+//	top of the cycle every instruction takes.  "default" is the
+//	costDefault table below; classes not given cost nothing extra.
+//	A "default," prefix then overrides classes of the default table.
+//
+//	The extra cycles are stalls (see CycleStall): simulated time, and
+//	the timer with it, runs on cycles, while the instruction count
+//	stays a count of instructions.  The cycles each class added are
+//	reported at exit.  Like the cache model, the cost model forces
+//	the instrumented interpreter.
+//
+//----------------------------------------------------------------------
+#define	DLX_COST_ALU		0
+#define	DLX_COST_LOAD		1
+#define	DLX_COST_STORE		2
+#define	DLX_COST_BRANCH		3
+#define	DLX_COST_JUMP		4
+#define	DLX_COST_MULT		5
+#define	DLX_COST_DIV		6
+#define	DLX_COST_FP		7
+#define	DLX_COST_FPDIV		8
+#define	DLX_COST_TRAP		9
+#define	DLX_COST_WALK		10
+#define	DLX_COST_EXCEPTION	11
+#define	DLX_COST_NUM		12
+
+static const char	*costNames[DLX_COST_NUM] = {
+  "alu", "load", "store", "branch", "jump", "mult", "div", "fp", "fpdiv",
+  "trap", "walk", "exception"
+};
+static const uint32	costDefault[DLX_COST_NUM] = {
+  0, 1, 1, 1, 1, 4, 20, 3, 15, 10, 10, 20
+};
+
+static int		costOn = 0;
+static uint32		costCycles[DLX_COST_NUM];	// extra per event
+static DlxCycle		costCharged[DLX_COST_NUM];	// extra so far
+static unsigned char	costOpClass[DLX_OPCODE_MASK + 1];
+static unsigned char	costFpClass[DLX_FPU_FUNC_CODE_MASK + 1];
+
+static
+inline
+void
+CostCharge (int cls)
+{
+  CycleStall (costCycles[cls]);
+  costCharged[cls] += costCycles[cls];
+}
+
+static
+inline
+void
+CostInstr (uint32 inst)
+{
+  uint32	op = (inst >> DLX_OPCODE_SHIFT) & DLX_OPCODE_MASK;
+
+  CostCharge ((op == 0x01) ?
+	      costFpClass[(inst >> DLX_FPU_FUNC_CODE_SHIFT) &
+			  DLX_FPU_FUNC_CODE_MASK] : costOpClass[op]);
+}
+
+static
+void
+CostReport ()
+{
+  int		i;
+
+  printf ("Cost model: %llu cycles (%llu instructions + %llu stall "
+	  "cycles)\n", dlxCycle, dlxCycle - dlxStalls, dlxStalls);
+  for (i = 0; i < DLX_COST_NUM; i++) {
+    if (costCharged[i] != 0) {
+      printf ("  %-10s %12llu cycles\n", costNames[i], costCharged[i]);
+    }
+  }
+}
+
+static
+void
+CostInit ()
+{
+  const char	*env = getenv ("DLXSIM_COST");
+  char		name[16];
+  uint32	op, cycles;
+  int		i, n;
+
+  if ((env == NULL) || (env[0] == '\0') || costOn) {
+    return;
+  }
+  if (!strncmp (env, "default", 7) &&
+      ((env[7] == '\0') || (env[7] == ','))) {
+    memcpy (costCycles, costDefault, sizeof (costCycles));
+    env += (env[7] == ',') ? 8 : 7;
+  }
+  while (*env != '\0') {
+    if ((sscanf (env, "%15[a-z]=%u%n", name, &cycles, &n) < 2)) {
+      n = -1;
+    }
+    for (i = 0; (n > 0) && (i < DLX_COST_NUM); i++) {
+      if (!strcmp (name, costNames[i])) {
+	costCycles[i] = cycles;
+	break;
+      }
+    }
+    if ((n <= 0) || (i == DLX_COST_NUM) ||
+	((env[n] != '\0') && (env[n] != ','))) {
+      printf ("FATAL ERROR: DLXSIM_COST should be \"default\" or "
+	      "class=cycles,... with classes\n  alu load store branch jump "
+	      "mult div fp fpdiv trap walk exception.\n");
+      exit (1);
+    }
+    env += (env[n] == ',') ? n + 1 : n;
+  }
+
+  for (op = 0; op <= DLX_OPCODE_MASK; op++) {
+    if ((op == 0x02) || (op == 0x03) || (op == 0x12) || (op == 0x13)) {
+      costOpClass[op] = DLX_COST_JUMP;		// j, jal, jr, jalr
+    } else if ((op >= 0x04) && (op <= 0x07)) {
+      costOpClass[op] = DLX_COST_BRANCH;	// beqz, bnez, bfpt, bfpf
+    } else if ((op == 0x10) || (op == 0x11)) {
+      costOpClass[op] = DLX_COST_TRAP;		// rfe, trap
+    } else if (((op >= 0x20) && (op <= 0x27)) || (op == 0x1e) ||
+	       (op == 0x1f)) {
+      costOpClass[op] = DLX_COST_LOAD;		// loads, swap, tas
+    } else if ((op >= 0x28) && (op <= 0x2f) && (op != 0x2c)) {
+      costOpClass[op] = DLX_COST_STORE;		// stores (not wait)
+    } else {
+      costOpClass[op] = DLX_COST_ALU;
+    }
+  }
+  for (op = 0; op <= DLX_FPU_FUNC_CODE_MASK; op++) {
+    switch (op) {
+    case 0x0e: case 0x16:			// mult, multu
+      costFpClass[op] = DLX_COST_MULT;
+      break;
+    case 0x0f: case 0x17:			// div, divu
+      costFpClass[op] = DLX_COST_DIV;
+      break;
+    case 0x03: case 0x07:			// divf, divd
+      costFpClass[op] = DLX_COST_FPDIV;
+      break;
+    default:
+      costFpClass[op] = DLX_COST_FP;
+      break;
+    }
+  }
+  costOn = 1;
+  atexit (CostReport);
+}
+
+//----------------------------------------------------------------------
+//
+//	Page heatmap
+//
+//	If DLXSIM_HEATMAP names a file, every data read, data write and
+//	instruction fetch from memory is counted against its physical
+//	page (DLX_HEAT_PAGE_SIZE bytes) and, when the access was
+//	translated, against its virtual page under the page table base
+//	it was translated with, so each process' working set can be told
+//	apart.  A heatmap is written to the file at exit and whenever the
+//	OS writes to DLX_HEAT_CMD:
+//
+//	# heatmap n at instructions
+//	P paddr reads writes fetches
+//	V pgtblbase vaddr reads writes fetches
+//
+//	Writing DLX_HEAT_DUMP dumps the counts; DLX_HEAT_DUMP_RESET
+//	dumps and then zeroes them, so a run can be split into phases.
+//	Reading DLX_HEAT_CMD returns the number of heatmaps written so
+//	far.  Without DLXSIM_HEATMAP the register reads 0 and writes are
+//	ignored, so the OS needn't know whether counting is on.
+//
+//	Like the cache model, counting forces the instrumented
+//	interpreter.
+//
+//----------------------------------------------------------------------
+#define	DLX_HEAT_BASE		0xffff3000
+#define	DLX_HEAT_CMD		(DLX_HEAT_BASE + 0x00)
+#define	DLX_HEAT_SIZE		0x4
+#define	DLX_HEAT_DUMP		1
+#define	DLX_HEAT_DUMP_RESET	2
+
+#define	DLX_HEAT_PAGE_BITS	12
+#define	DLX_HEAT_PAGE_SIZE	(1 << DLX_HEAT_PAGE_BITS)
+#define	DLX_HEAT_HASH_SIZE	(1 << 14)	// must be a power of 2
+
+#define	DLX_HEAT_READ		0
+#define	DLX_HEAT_WRITE		1
+#define	DLX_HEAT_FETCH		2
+#define	DLX_HEAT_KINDS		3
+
+typedef struct DlxHeatVpage {
+  uint32	base;		// page table base
+  uint32	vaddr;		// start of the virtual page
+  double	count[DLX_HEAT_KINDS];
+  struct DlxHeatVpage	*next;
+} DlxHeatVpage;
+
+static int		heatOn = 0;
+static FILE		*heatFp = NULL;
+static uint32		heatDumps = 0;
+static double		(*heatPhys)[DLX_HEAT_KINDS] = NULL;
+static uint32		heatNPages = 0;
+static DlxHeatVpage	*heatHash[DLX_HEAT_HASH_SIZE];
+// Set by VaddrToPaddr for the access it just translated.
+static int		heatXlated = 0;
+static uint32		heatBase, heatVaddr;
+
+static
+inline
+void
+HeatNoteXlate (int xlated, uint32 base, uint32 vaddr)
+{
+  heatXlated = xlated;
+  heatBase = base;
+  heatVaddr = vaddr;
+}
+
+//----------------------------------------------------------------------
+//
+//	HeatCount
+//
+//	Count an access of the given kind to physical address paddr,
+//	and to the virtual page VaddrToPaddr last translated, if any.
+//
+//----------------------------------------------------------------------
+static
+void
+HeatCount (int kind, uint32 paddr)
+{
+  uint32	h;
+  DlxHeatVpage	*v;
+
+  heatPhys[paddr >> DLX_HEAT_PAGE_BITS][kind] += 1.0;
+  if (!heatXlated) {
+    return;
+  }
+  h = ((heatBase ^ heatVaddr) * 2654435761u) >> 18 & (DLX_HEAT_HASH_SIZE - 1);
+  for (v = heatHash[h]; v != NULL; v = v->next) {
+    if ((v->vaddr == heatVaddr) && (v->base == heatBase)) {
+      break;
+    }
+  }
+  if (v == NULL) {
+    v = (DlxHeatVpage *)calloc (1, sizeof (DlxHeatVpage));
+    v->base = heatBase;
+    v->vaddr = heatVaddr;
+    v->next = heatHash[h];
+    heatHash[h] = v;
+  }
+  v->count[kind] += 1.0;
+}
+
+static
+void
+HeatDump (int reset)
+{
+  uint32	i;
+  DlxHeatVpage	*v;
+  double	*c;
+
+  fprintf (heatFp, "# heatmap %u at %llu instructions\n", heatDumps++,
+	   dlxCycle);
+  for (i = 0; i < heatNPages; i++) {
+    c = heatPhys[i];
+    if ((c[DLX_HEAT_READ] + c[DLX_HEAT_WRITE] + c[DLX_HEAT_FETCH]) > 0.0) {
+      fprintf (heatFp, "P 0x%08x %.0lf %.0lf %.0lf\n",
+	       i << DLX_HEAT_PAGE_BITS, c[DLX_HEAT_READ], c[DLX_HEAT_WRITE],
+	       c[DLX_HEAT_FETCH]);
+    }
+    if (reset) {
+      c[DLX_HEAT_READ] = c[DLX_HEAT_WRITE] = c[DLX_HEAT_FETCH] = 0.0;
+    }
+  }
+  for (i = 0; i < DLX_HEAT_HASH_SIZE; i++) {
+    for (v = heatHash[i]; v != NULL; v = v->next) {
+      c = v->count;
+      if ((c[DLX_HEAT_READ] + c[DLX_HEAT_WRITE] + c[DLX_HEAT_FETCH]) > 0.0) {
+	fprintf (heatFp, "V 0x%08x 0x%08x %.0lf %.0lf %.0lf\n", v->base,
+		 v->vaddr, c[DLX_HEAT_READ], c[DLX_HEAT_WRITE],
+		 c[DLX_HEAT_FETCH]);
+      }
+      if (reset) {
+	c[DLX_HEAT_READ] = c[DLX_HEAT_WRITE] = c[DLX_HEAT_FETCH] = 0.0;
+      }
+    }
+  }
+  fflush (heatFp);
+}
+
+static
+uint32
+HeatRegRead (uint32 paddr)
+{
+  return (heatDumps);
+}
+
+static
+void
+HeatRegWrite (uint32 paddr, uint32 val)
+{
+  if (heatOn && ((val == DLX_HEAT_DUMP) || (val == DLX_HEAT_DUMP_RESET))) {
+    HeatDump (val == DLX_HEAT_DUMP_RESET);
+  }
+}
+
+static
+void
+HeatExit ()
+{
+  HeatDump (0);
+  fclose (heatFp);
+}
+
+static
+void
+HeatInit (uint32 memsize)
+{
+  const char	*file = getenv ("DLXSIM_HEATMAP");
+
+  if ((file == NULL) || (file[0] == '\0') || heatOn) {
+    return;
+  }
+  if ((heatFp = fopen (file, "w")) == NULL) {
+    printf ("FATAL ERROR: can't open heatmap file %s.\n", file);
+    exit (1);
+  }
+  heatNPages = (memsize >> DLX_HEAT_PAGE_BITS) + 1;
+  heatPhys = (double (*)[DLX_HEAT_KINDS])calloc (heatNPages,
+						 sizeof (*heatPhys));
+  heatOn = 1;
+  atexit (HeatExit);
+}
+
+//----------------------------------------------------------------------
+//
+//	SMP
+//
+//	If DLXSIM_CPUS is set to "n" or "n,quantum", the simulator runs n
+//	cores over one physical memory.  Each core has its own registers,
+//	timer, event queue and performance counters; devices, the caches
+//	and the TLB are shared (they're all keyed by physical address or
+//	page table base, so they stay valid from core to core).  Cores
+//	take turns of DLX_EVENT_SMP instructions on the host thread, so a
+//	run is deterministic and a single instruction is always atomic
+//	with respect to the other cores.
+//
+//	Only core 0 runs at first.  The OS starts the others by writing
+//	an entry point to DLX_SMP_START: every core that isn't running
+//	begins there with a copy of the writer's special registers and
+//	interrupts off.  Reading DLX_SMP_START gives the mask of cores
+//	that are running.  Writing a core number to DLX_SMP_IPI raises a
+//	DLX_SMP_IPI_EXC interrupt on that core; reading it returns (and
+//	clears) the mask of cores that have sent this core an IPI since
+//	the last read.  Keyboard interrupts go to core 0, and disk
+//	interrupts to the core that started the request.
+//
+//----------------------------------------------------------------------
+#define	DLX_SMP_BASE		0xffff2000
+#define	DLX_SMP_CPUID		(DLX_SMP_BASE + 0x00)	// this core's number
+#define	DLX_SMP_NCPUS		(DLX_SMP_BASE + 0x04)
+#define	DLX_SMP_IPI		(DLX_SMP_BASE + 0x08)
+#define	DLX_SMP_START		(DLX_SMP_BASE + 0x0c)
+#define	DLX_SMP_SIZE		0x10
+
+#define	DLX_SMP_IPI_EXC		0x51	// inter-processor interrupt cause
+#define	DLX_SMP_MAX_CPUS	16
+#define	DLX_SMP_DEFAULT_QUANTUM	1000
+
+// Per-core copies of the file-level state that belongs to a core.
+typedef struct SmpCore {
+  DlxCycle	cycle;
+  DlxCycle	cycleSynced;
+  DlxCycle	stalls;
+  DlxCycle	stallsSynced;
+  DlxCycle	eventWhen[DLX_NUM_EVENTS];
+  DlxCycle	eventNext;
+  DlxCycle	perfCounters[DLX_PERF_NUM];
+  int		perfUserMode;
+  DlxCycle	perfModeSince;
+} SmpCore;
+
+static Cpu	*smpCpus[DLX_SMP_MAX_CPUS];
+static SmpCore	smpCores[DLX_SMP_MAX_CPUS];
+static uint32	smpIpiFrom[DLX_SMP_MAX_CPUS];	// senders since last read
+static uint32	smpRunning = 1;		// mask of started cores
+static int	smpNumCpus = 1;
+static int	smpCur = 0;		// the core whose state is loaded
+static int	smpSwitchDue = 0;
+static DlxCycle	smpQuantum = DLX_SMP_DEFAULT_QUANTUM;
+static uint32	*smpMemory = NULL;	// set while creating secondaries
+
+static
+uint32 *
+SmpSharedMemory ()
+{
+  return (smpMemory);
+}
+
+static
+void
+SmpSave (int n)
+{
+  SmpCore	*c = &smpCores[n];
+
+  c->cycle = dlxCycle;
+  c->cycleSynced = dlxCycleSynced;
+  c->stalls = dlxStalls;
+  c->stallsSynced = dlxStallsSynced;
+  memcpy (c->eventWhen, eventWhen, sizeof (eventWhen));
+  c->eventNext = eventNext;
+  memcpy (c->perfCounters, perfCounters, sizeof (perfCounters));
+  c->perfUserMode = perfUserMode;
+  c->perfModeSince = perfModeSince;
+}
+
+static
+void
+SmpLoad (int n)
+{
+  SmpCore	*c = &smpCores[n];
+
+  dlxCycle = c->cycle;
+  dlxCycleSynced = c->cycleSynced;
+  dlxStalls = c->stalls;
+  dlxStallsSynced = c->stallsSynced;
+  memcpy (eventWhen, c->eventWhen, sizeof (eventWhen));
+  eventNext = c->eventNext;
+  memcpy (perfCounters, c->perfCounters, sizeof (perfCounters));
+  perfUserMode = c->perfUserMode;
+  perfModeSince = c->perfModeSince;
+}
+
+//----------------------------------------------------------------------
+//
+//	SmpSwitch
+//
+//	Called between instructions when the current core's quantum is
+//	up: hand the host thread to the next running core.
+//
+//----------------------------------------------------------------------
+static
+void
+SmpSwitch ()
+{
+  int		next = smpCur;
+
+  smpSwitchDue = 0;
+  do {
+    next = (next + 1) % smpNumCpus;
+  } while (!(smpRunning & (1 << next)));
+  if (next != smpCur) {
+    SmpSave (smpCur);
+    SmpLoad (next);
+    smpCur = next;
+  }
+  EventSchedule (DLX_EVENT_SMP, dlxCycle + smpQuantum);
+}
+
+static
+void
+SmpSendIpi (uint32 target)
+{
+  SmpCore	*c;
+
+  if (target >= (uint32)smpNumCpus) {
+    return;
+  }
+  smpIpiFrom[target] |= 1 << smpCur;
+  if ((int)target == smpCur) {
+    EventSchedule (DLX_EVENT_IPI, dlxCycle);
+  } else {
+    c = &smpCores[target];
+    c->eventWhen[DLX_EVENT_IPI] = c->cycle;
+    if (c->cycle < c->eventNext) {
+      c->eventNext = c->cycle;
+    }
+  }
+}
+
+static
+uint32
+SmpRegRead (uint32 paddr)
+{
+  uint32	v;
+
+  switch (paddr) {
+  case DLX_SMP_CPUID:
+    return (smpCur);
+  case DLX_SMP_NCPUS:
+    return (smpNumCpus);
+  case DLX_SMP_IPI:
+    v = smpIpiFrom[smpCur];
+    smpIpiFrom[smpCur] = 0;
+    return (v);
+  case DLX_SMP_START:
+    return (smpRunning);
+  }
+  return (0);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::SmpRegWrite
+//
+//	Handle a store to one of the SMP registers.
+//
+//----------------------------------------------------------------------
+void
+Cpu::SmpRegWrite (uint32 paddr, uint32 val)
+{
+  Cpu		*c;
+  int		i, j;
+
+  switch (paddr) {
+  case DLX_SMP_IPI:
+    SmpSendIpi (val);
+    break;
+  case DLX_SMP_START:
+    for (i = 1; i < smpNumCpus; i++) {
+      if (smpRunning & (1 << i)) {
+	continue;
+      }
+      c = smpCpus[i];
+      for (j = 0; j < 32; j++) {
+	c->PutSreg (j, GetSreg (j));
+      }
+      c->DisableInterrupts ();
+      c->SetPC (val);
+      smpRunning |= 1 << i;
+    }
+    break;
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::SmpInit
+//
+//	Create the secondary cores if DLXSIM_CPUS asks for them.  Called
+//	on the boot core before its first instruction, once the options
+//	have been parsed.
+//
+//----------------------------------------------------------------------
+void
+Cpu::SmpInit ()
+{
+  const char	*env = getenv ("DLXSIM_CPUS");
+  char		*end;
+  int		i, n;
+
+  smpCpus[0] = this;
+  if ((env == NULL) || (env[0] == '\0')) {
+    return;
+  }
+  n = strtol (env, &end, 0);
+  if (*end == ',') {
+    smpQuantum = strtoul (end + 1, NULL, 0);
+    if (smpQuantum == 0) {
+      smpQuantum = DLX_SMP_DEFAULT_QUANTUM;
+    }
+  }
+  if ((n < 1) || (n > DLX_SMP_MAX_CPUS)) {
+    printf ("FATAL ERROR: DLXSIM_CPUS must be between 1 and %d.\n",
+	    DLX_SMP_MAX_CPUS);
+    exit (1);
+  }
+  if (n == 1) {
+    return;
+  }
+  SmpSave (0);
+  smpMemory = memory;
+  for (i = 1; i < n; i++) {
+    dlxCycle = dlxCycleSynced = 0;
+    dlxStalls = dlxStallsSynced = 0;
+    eventNext = 0;
+    memset (perfCounters, 0, sizeof (perfCounters));
+    perfUserMode = 0;
+    perfModeSince = 0;
+    smpCpus[i] = new Cpu (memSize);
+    smpCpus[i]->flags = flags;
+    smpCpus[i]->tracefp = tracefp;
+    smpCpus[i]->usPerInst = usPerInst;
+    // Only the boot core polls the keyboard.
+    EventCancel (DLX_EVENT_KBD);
+    SmpSave (i);
+  }
+  smpMemory = NULL;
+  smpNumCpus = n;
+  SmpLoad (0);
+  EventSchedule (DLX_EVENT_SMP, dlxCycle + smpQuantum);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Atomic
+//
+//	The atomic memory instructions, all I-format with the address in
+//	src + imm and the data register in dst:
+//
+//	swap	dst <-> M[addr]
+//	tas	dst = M[addr], M[addr] = 1
+//	ll	dst = M[addr], and reserve the word (load linked)
+//	sc	if the word is still reserved, M[addr] = dst and dst = 1;
+//		otherwise dst = 0 (store conditional)
+//
+//	Cores only switch between instructions, so swap and tas are
+//	atomic on every core without any locking.  A reservation is per
+//	core and is lost when any core stores to the word or when this core
+//	takes an exception, so an ll/sc pair that straddles a context
+//	switch fails rather than succeeding on stale data.  The address
+//	must be word aligned and in memory (not I/O space).  swap, tas and
+//	sc check that the word is writable before touching it, so a fault
+//	leaves both the register and memory untouched.
+//
+//----------------------------------------------------------------------
+static uint32	llAddr[DLX_SMP_MAX_CPUS];	// reserved physical address
+static uint32	llValid = 0;			// mask of cores holding one
+
+static
+void
+AtomicNoteWriteRange (uint32 paddr, uint32 nbytes)
+{
+  int		i;
+
+  for (i = 0; (llValid != 0) && (i < smpNumCpus); i++) {
+    if ((llValid & (1 << i)) && (llAddr[i] >= (paddr & ~0x3)) &&
+	(llAddr[i] < paddr + nbytes)) {
+      llValid &= ~(1 << i);
+    }
+  }
+}
+
+static
+inline
+void
+AtomicNoteWrite (uint32 paddr)
+{
+  int		i;
+
+  if (llValid == 0) {
+    return;
+  }
+  for (i = 0; i < smpNumCpus; i++) {
+    if ((llValid & (1 << i)) && (llAddr[i] == (paddr & ~0x3))) {
+      llValid &= ~(1 << i);
+    }
+  }
+}
+
+int
+Cpu::Atomic (uint32 inst, int op)
+{
+  uint32	addrReg, offset, dst, addr, paddr, val, old;
+
+  GetIFields (inst, addrReg, offset, dst);
+  addr = EffectiveAddress (addrReg, offset);
+  if (addr & 0x3) {
+    CauseException (DLX_EXC_ADDRESS);
+    return (0);
+  }
+  if (!VaddrToPaddr (addr, paddr, (op == DLX_ATOMIC_LL) ? DLX_MEM_READ :
+		     DLX_MEM_WRITE)) {
+    return (0);
+  }
+  if (paddr >= memSize) {
+    CauseException (DLX_EXC_ACCESS);
+    return (0);
+  }
+  if (op == DLX_ATOMIC_SC) {
+    if (!(llValid & (1 << smpCur)) || (llAddr[smpCur] != paddr)) {
+      llValid &= ~(1 << smpCur);
+      PutIreg (dst, 0);
+      return (1);
+    }
+    val = GetIreg (dst);
+    DBPRINTF ('s', "Store conditional 0x%08x to location 0x%x.\n", val, addr);
+    if (!WriteWord (addr, val)) {
+      return (0);
+    }
+    TraceAccess ("sw", dst, addr, val);
+    PutIreg (dst, 1);
+    return (1);
+  }
+  if (!ReadWord (addr, old)) {
+    return (0);
+  }
+  TraceAccess ("lw", dst, addr, old);
+  if (op == DLX_ATOMIC_LL) {
+    DBPRINTF ('l', "Load linked 0x%08x from location 0x%x.\n", old, addr);
+    llAddr[smpCur] = paddr;
+    llValid |= 1 << smpCur;
+    PutIreg (dst, old);
+    return (1);
+  }
+  val = (op == DLX_ATOMIC_SWAP) ? GetIreg (dst) : 1;
+  DBPRINTF ('s', "Atomic %s 0x%08x -> 0x%08x at location 0x%x.\n",
+	    (op == DLX_ATOMIC_SWAP) ? "swap" : "tas", old, val, addr);
+  if (!WriteWord (addr, val)) {
+    return (0);
+  }
+  TraceAccess ("sw", dst, addr, val);
+  PutIreg (dst, old);
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::CauseException
+//
+//	Cause an exception.  This loads the CAUSE register with the
+//	exception cause, loads the IAR with the proper pointer, and
+//	sets things up so that the exception will be taken after the
+//	current instruction completes.
+//
+//----------------------------------------------------------------------
+int
+Cpu::CauseException (int excType)
+{
+  uint32	ivec;
+
+  DBPRINTF ('t',"Exception being done (cause=0x%x @ pc=0x%x).\n",excType,
+	    PC()-4);
+  ivec = GetSreg (DLX_SREG_INTRVEC);
+  OutputBasicBlock (ivec);
+  if (flags & (DLX_TRACE_INSTRUCTIONS | DLX_TRACE_MEMORY)) {
+    TraceControl (tracefp, DLX_TRACE_REC_EXC, excType, PC()-4);
+  }
+  PerfNoteException (excType);
+  PerfSetMode (0);
+  if (costOn) {
+    CostCharge (DLX_COST_EXCEPTION);
+  }
+  llValid &= ~(1 << smpCur);
+  PutSreg(DLX_SREG_CAUSE, excType);
+  // PC has already been incremented, so decrement it first.  If this
+  // is a trap or interrupt, the PC will have already been incremented
+  // (if necessary) so the IAR points to the next instruction to
+  // execute.
+  PutSreg(DLX_SREG_IAR, PC()-4);
+  // Save the current status register
+  PutSreg(DLX_SREG_ISR, GetSreg (DLX_SREG_STATUS));
+  // Save the current value of register 31.  This is necessary to give
+  // the interrupt handler a temporary register that can be used to
+  // switch to a system stack (rather than user stack)
+  PutSreg(DLX_SREG_IR31, GetIreg (31));
+  // Set the next instruction to be run to be the interrupt vector.
+  SetPC (ivec);
+  // Set the status register to be system mode
+  PutSreg(DLX_SREG_STATUS, GetSreg (DLX_SREG_STATUS) | DLX_STATUS_SYSMODE);
+  // Turn off interrupts
+  DisableInterrupts ();
+  XlateModeUpdate (GetSreg (DLX_SREG_STATUS));
+  return (1);
+}
+
+
+
+//----------------------------------------------------------------------
+//
+//	Translation modes
+//
+//	Whether an access is translated depends only on a few status
+//	bits and on whether it's a read, write or fetch, so the answer
+//	for each kind of access is worked out once per status change
+//	(in DoRfe, CauseException and Movi2s) rather than on every
+//	access.  VaddrToPaddr then switches on the mode for its kind of
+//	access instead of re-testing the bits.  The modes are keyed on the
+//	status bits they came from and recomputed if those don't match,
+//	so a status write anywhere else (loading a snapshot, starting an
+//	SMP core) can't leave a stale mode behind.  As the modes are a
+//	function of the status bits alone, cores can share them.
+//
+//----------------------------------------------------------------------
+#define	DLX_XLATE_PHYS		0	// no page table: address is physical
+#define	DLX_XLATE_TLB		1	// software TLB mode (not modeled)
+#define	DLX_XLATE_SYS		2	// untranslated system access
+#define	DLX_XLATE_PAGED		3	// through the page table
+#define	DLX_XLATE_BITS		(DLX_STATUS_PAGE_TABLE | DLX_STATUS_TLB | \
+				 DLX_STATUS_SYSMODE | DLX_STATUS_XLATE_RD | \
+				 DLX_STATUS_XLATE_WR)
+
+static uint32	xlateStatus = 0xffffffff;	// DLX_XLATE_BITS of status
+static int	xlateRead, xlateWrite, xlateFetch;
+
+static
+void
+XlateModeUpdate (uint32 status)
+{
+  status &= DLX_XLATE_BITS;
+  if (!(status & DLX_STATUS_PAGE_TABLE)) {
+    xlateRead = xlateWrite = xlateFetch =
+      (status & DLX_STATUS_TLB) ? DLX_XLATE_TLB : DLX_XLATE_PHYS;
+  } else if (!(status & DLX_STATUS_SYSMODE)) {
+    xlateRead = xlateWrite = xlateFetch = DLX_XLATE_PAGED;
+  } else {
+    // System mode translates data accesses only if asked to, and
+    // never fetches.
+    xlateRead = (status & DLX_STATUS_XLATE_RD) ? DLX_XLATE_PAGED :
+      DLX_XLATE_SYS;
+    xlateWrite = (status & DLX_STATUS_XLATE_WR) ? DLX_XLATE_PAGED :
+      DLX_XLATE_SYS;
+    xlateFetch = DLX_XLATE_SYS;
+  }
+  xlateStatus = status;
+}
+
+static
+inline
+int
+XlateMode (uint32 status, uint32 op)
+{
+  if ((status & DLX_XLATE_BITS) != xlateStatus) {
+    XlateModeUpdate (status);
+  }
+  if (op == DLX_MEM_READ) {
+    return (xlateRead);
+  } else if (op == DLX_MEM_WRITE) {
+    return (xlateWrite);
+  }
+  return (xlateFetch);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::VaddrToPaddr
+//
+//	Read a single word from memory.  This involves translating
+//	the virtual address to a physical address, checking that the
+//	access is allowed, and ensuring that the address itself is
+//	valid (ie, aligned).  An exception is caused (and 0 returned)
+//	if the access fails for any reason.
+//
+//----------------------------------------------------------------------
+template <class Policy>
+inline
+int
+Cpu::VaddrToPaddrWith (uint32 vaddr, uint32& paddr, uint32 op,
+		       uint32 pteflags)
+{
+  uint32	pt1base, pt2base, pt1pagebits, pt2pagebits;
+  uint32	pteaddr, l1addr;
+  uint32	offsetinpage, entrynum;
+  uint32	pagemask;
+  uint32	newflags;
+  TlbEntry	*te;
+
+  if ((vaddr & 0x3) != 0) {
+    CauseException (DLX_EXC_ADDRESS);
+    return (0);
+  }
+  if (Policy::instrumented && heatOn) {
+    HeatNoteXlate (0, 0, 0);
+  }
+  // Only accesses that go through the page table get past this; see
+  // "Translation modes" above.
+  switch (XlateMode (GetSreg (DLX_SREG_STATUS), op)) {
+  case DLX_XLATE_PHYS:
+    paddr = vaddr;
+    return (1);
+  case DLX_XLATE_TLB:
+    return (1);
+  case DLX_XLATE_SYS:
+    // For system references, physical address is the same
+    // as virtual address.
+    paddr = vaddr;
+    if ((vaddr <= memSize) || ((vaddr >= DLX_IO_BASE) &&
+			       (vaddr <= (DLX_IO_BASE+DLX_IO_SIZE)))) {
+      return (1);
+    }
+    PDBPRINTF ('t',"Illegal system address: 0x%x.\n", vaddr);
+    CauseException (DLX_EXC_ACCESS);
+    return (0);
+  }
+  PDBPRINTF ('m', "Translating 0x%x\n", vaddr);
+  pt1base = GetSreg (DLX_SREG_PGTBL_BASE);
+  pt1pagebits = GetSreg (DLX_SREG_PGTBL_BITS);
+  pt2pagebits = (pt1pagebits >> 16) & 0xffff;
+  pt1pagebits &= 0xffff;
+  pagemask = (1 << pt2pagebits) - 1;
+  offsetinpage = vaddr & pagemask;
+  // Mask off the low bits
+  vaddr &= ~pagemask;
+  entrynum = vaddr >> pt1pagebits;
+  te = TlbSlot (pt1base, vaddr >> pt2pagebits);
+  if ((te->vpage == vaddr) && (te->base == pt1base)) {
+    // TLB hit: the PTE is known to be valid and nobody has written
+    // to it (or to the L1 entry that led to it) since it was cached.
+    tlbHits += 1.0;
+    pteaddr = te->pteaddr;
+    paddr = te->pte;
+    PDBPRINTF ('M', "TLB hit, using PTE 0x%08x\n", paddr);
+  } else {
+    tlbMisses += 1.0;
+    if (costOn) {
+      CostCharge (DLX_COST_WALK);
+    }
+    if (entrynum >= GetSreg (DLX_SREG_PGTBL_SIZE)) {
+      PDBPRINTF ('m', "Out of range (L1 = %db, L2 = %db size=%d entry=%d)\n",
+		pt1pagebits, pt2pagebits, GetSreg(DLX_SREG_PGTBL_SIZE),
+		entrynum);
+      CauseException (DLX_EXC_ACCESS);
+      return (0);
+    }
+    l1addr = pteaddr = pt1base + 4 * entrynum;
+    paddr = Memory (pteaddr);
+    // If the L2 page size is the same as the L1 page size, there's
+    // no L2 page table!
+    if (pt1pagebits != pt2pagebits) {
+      pt2base = paddr;
+      if (pt2base == 0) {
+	PDBPRINTF ('m', "No L2 table at entry %d! (base = 0x%x)\n",
+		  entrynum, pt1base);
+	PutSreg (DLX_SREG_FAULT_ADDR, vaddr);
+	CauseException (DLX_EXC_PAGEFAULT);
+	return (0);
+      }
+      pteaddr = pt2base + 4 * ((vaddr >> pt2pagebits) &
+			       ((1 << (pt1pagebits-pt2pagebits))-1));
+      paddr = Memory (pteaddr);
+    }
+    PDBPRINTF ('M', "Using PTE 0x%08x\n", paddr);
+    if (!(paddr & DLX_PTE_VALID)) {
+      PDBPRINTF ('m', "PTE invalid (0x%08x)\n", paddr);
+      PutSreg (DLX_SREG_FAULT_ADDR, vaddr);
+      CauseException (DLX_EXC_PAGEFAULT);
+      return (0);
+    }
+    TlbFill (te, pt1base, vaddr, l1addr, pteaddr, paddr, memSize);
+  }
+
+  //Zheng{
+#if USE_ROP
+  if ((op == DLX_MEM_WRITE) && (paddr & DLX_PTE_RW)) {
+#if USE_ROP_DEBUG
+    printf("Cpu: writing a read-only page, vaddr=0x%x\n", vaddr);
+#endif
+    PutSreg (DLX_SREG_FAULT_ADDR, vaddr);
+    CauseException(DLX_ROP_ACCESS);
+    return (0);
+  }
+#endif
+  //}Zheng
+
+  // Only write the PTE back if this access sets a bit that isn't
+  // already set; the cached copy is updated to match.
+  //Zheng{
+#if USE_ROP
+  newflags = pteflags & (DLX_PTE_DIRTY | DLX_ROP_PTE_REFERENCED) & ~paddr;
+#else
+  //}Zheng
+  newflags = pteflags & (DLX_PTE_DIRTY | DLX_PTE_REFERENCED) & ~paddr;
+  //Zheng
+#endif
+  if (newflags) {
+    paddr |= newflags;
+    SetMemory (pteaddr, paddr);
+    te->pte = paddr;
+  }
+
+  if (Policy::instrumented && heatOn) {
+    HeatNoteXlate (1, pt1base, vaddr);
+  }
+  paddr &= ~(pagemask | DLX_PTE_MASK);
+  paddr |= offsetinpage;
+  PDBPRINTF ('m',
+	    "0x%x => 0x%x (=%08x) using base1=0x%x/%d, entry %d\n",
+	    vaddr | offsetinpage, paddr,
+	    Memory (paddr),
+	    pt1base, pt1pagebits, entrynum);
+  return (1);
+}
+
+inline
+int
+Cpu::VaddrToPaddr (uint32 vaddr, uint32& paddr, uint32 op, uint32 pteflags)
+{
+  if (dlxExecMode == DLX_EXEC_FAST) {
+    return (VaddrToPaddrWith<DlxFastPolicy> (vaddr, paddr, op, pteflags));
+  } else {
+    return (VaddrToPaddrWith<DlxTracePolicy> (vaddr, paddr, op, pteflags));
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	MMIO devices
+//
+//	Devices register their register block with MmioRegister, and
+//	ReadWord and WriteWord find them through mmioPages, which maps
+//	each DLX_MMIO_PAGE_SIZE page from DLX_MMIO_BASE to the top of the
+//	address space to the device in it (NULL if none).  That's one
+//	index and one compare past the memory check, however many
+//	devices there are.  A device owns every page its block touches,
+//	but only addresses inside the block go to it; the rest of the
+//	page, and pages nobody registered, fall through to the fixed
+//	keyboard, timer and memory size registers in ReadWord and
+//	WriteWord, and anything else there raises an access exception.
+//
+//	Callbacks get a DlxMmioAccess describing the CPU doing the
+//	access, so devices that move data (like the DMA disk) can reach
+//	memory.
+//
+//----------------------------------------------------------------------
+#define	DLX_MMIO_BASE		0xfff00000
+#define	DLX_MMIO_PAGE_BITS	8
+#define	DLX_MMIO_PAGE_SIZE	(1 << DLX_MMIO_PAGE_BITS)
+#define	DLX_MMIO_NPAGES		((0xffffffff - DLX_MMIO_BASE + 1) >> \
+				 DLX_MMIO_PAGE_BITS)
+
+typedef struct DlxMmioAccess {
+  Cpu		*cpu;
+  unsigned char	*mem;
+  uint32	memSize;
+  double	usPerInst;
+} DlxMmioAccess;
+
+typedef uint32 (*DlxMmioRead) (DlxMmioAccess *a, uint32 paddr);
+typedef void (*DlxMmioWrite) (DlxMmioAccess *a, uint32 paddr, uint32 val);
+
+typedef struct DlxMmioDevice {
+  const char	*name;
+  uint32	base;
+  uint32	size;
+  DlxMmioRead	read;
+  DlxMmioWrite	write;
+} DlxMmioDevice;
+
+static DlxMmioDevice	*mmioPages[DLX_MMIO_NPAGES];
+
+//----------------------------------------------------------------------
+//
+//	MmioRegister
+//
+//	Claim size bytes of I/O space at base for a device.  Overlapping
+//	another device's pages is a fatal error.
+//
+//----------------------------------------------------------------------
+static
+void
+MmioRegister (const char *name, uint32 base, uint32 size, DlxMmioRead read,
+	      DlxMmioWrite write)
+{
+  DlxMmioDevice	*d;
+  uint32	first, last, i;
+
+  if ((base < DLX_MMIO_BASE) || (size == 0) ||
+      (size - 1 > 0xffffffff - base)) {
+    printf ("FATAL ERROR: %s registers at 0x%x+0x%x aren't in I/O space.\n",
+	    name, base, size);
+    exit (1);
+  }
+  first = (base - DLX_MMIO_BASE) >> DLX_MMIO_PAGE_BITS;
+  last = (base + size - 1 - DLX_MMIO_BASE) >> DLX_MMIO_PAGE_BITS;
+  for (i = first; i <= last; i++) {
+    if (mmioPages[i] != NULL) {
+      printf ("FATAL ERROR: %s registers at 0x%x overlap %s.\n", name, base,
+	      mmioPages[i]->name);
+      exit (1);
+    }
+  }
+  d = new DlxMmioDevice;
+  d->name = name;
+  d->base = base;
+  d->size = size;
+  d->read = read;
+  d->write = write;
+  for (i = first; i <= last; i++) {
+    mmioPages[i] = d;
+  }
+}
+
+static
+inline
+DlxMmioDevice *
+MmioLookup (uint32 paddr)
+{
+  DlxMmioDevice	*d;
+
+  if (paddr < DLX_MMIO_BASE) {
+    return (NULL);
+  }
+  d = mmioPages[(paddr - DLX_MMIO_BASE) >> DLX_MMIO_PAGE_BITS];
+  if ((d == NULL) || (paddr - d->base >= d->size)) {
+    return (NULL);
+  }
+  return (d);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::ReadWord
+//
+//	Read a word from memory.  This can either be a regular memory
+//	address or an I/O address.
+//
+//----------------------------------------------------------------------
+int
+Cpu::ReadWord (uint32 vaddr, uint32 &val, uint32 op)
+{
+  uint32	paddr;
+  DlxMmioDevice	*dev;
+  DlxMmioAccess	access;
+
+  DBPRINTF ('l',"Trying to read virtual address: 0x%x.\n", vaddr);
+//Zheng{
+#if USE_ROP
+  if (!VaddrToPaddr (vaddr, paddr, op, DLX_ROP_PTE_REFERENCED)) {
+#else
+//}Zheng
+  if (!VaddrToPaddr (vaddr, paddr, op, DLX_PTE_REFERENCED)) {
+#endif
+    return (0);
+  }
+  if (paddr <= memSize) {
+    val = Memory(paddr);
+    if (op != DLX_MEM_INSTR) {
+      PerfCount (DLX_PERF_LOADS);
+      if (cacheOn) {
+	CacheAccess (&dcache, paddr);
+      }
+      if (heatOn) {
+	HeatCount (DLX_HEAT_READ, paddr);
+      }
+    }
+  } else if ((dev = MmioLookup (paddr)) != NULL) {
+    access.cpu = this;
+    access.mem = (unsigned char *)memory;
+    access.memSize = memSize;
+    access.usPerInst = usPerInst;
+    val = (dev->read) (&access, paddr);
+  } else {
+    DBPRINTF ('l',"Trying to load special address: 0x%x.\n", paddr);
+    switch (paddr) {
+    case DLX_KBD_NCHARSIN:
+      val = KbdNumInChars ();
+      break;
+    case DLX_KBD_NCHARSOUT:
+      val = KbdNumOutChars ();
+      break;
+    case DLX_KBD_GETCHAR:
+      val = KbdGetChar ();
+      break;
+    case DLX_DISK_STATUS:
+      break;
+    case DLX_GETMEMSIZE:
+      val = memSize;
+      break;
+    default:
+      CauseException (DLX_EXC_ACCESS);
+      break;
+    }
+  }
+  return (1);
+}
+
+int
+Cpu::WriteWord (uint32 vaddr, uint32 val)
+{
+  uint32	paddr;
+  DlxMmioDevice	*dev;
+  DlxMmioAccess	access;
+  //Zheng{
+#if USE_ROP
+  if (!VaddrToPaddr (vaddr, paddr, DLX_MEM_WRITE,
+		     DLX_PTE_DIRTY | DLX_ROP_PTE_REFERENCED)) {
+#else
+  //}Zheng
+  if (!VaddrToPaddr (vaddr, paddr, DLX_MEM_WRITE,
+		     DLX_PTE_DIRTY | DLX_PTE_REFERENCED)) {
+#endif
+    return (0);
+  }
+
+  if (paddr <= memSize) {
+    SetMemory(paddr, val);
+    PerfCount (DLX_PERF_STORES);
+    if (cacheOn) {
+      CacheAccess (&dcache, paddr);
+    }
+    if (heatOn) {
+      HeatCount (DLX_HEAT_WRITE, paddr);
+    }
+    AtomicNoteWrite (paddr);
+    DecodeCacheInvalidate (paddr);
+    TlbNoteWrite (paddr);
+    BlockNoteWrite (paddr);
+  } else if ((dev = MmioLookup (paddr)) != NULL) {
+    access.cpu = this;
+    access.mem = (unsigned char *)memory;
+    access.memSize = memSize;
+    access.usPerInst = usPerInst;
+    (dev->write) (&access, paddr, val);
+  } else {
+    switch (paddr) {
+    case DLX_KBD_PUTCHAR:
+      // Keep console and keyboard output in order.
+      ConsSync ();
+      KbdPutChar (val);
+      break;
+    case DLX_KBD_INTR:
+      if (val == 0) {
+	flags &= ~DLX_FLAG_KBD_INTERRUPT;
+      } else {
+	flags |= DLX_FLAG_KBD_INTERRUPT;
+      }
+      break;
+    case DLX_TIMER_SETTIMER:
+      DBPRINTF ('o',"Setting timer to %d us.\n", val);
+      SetTimer (val);
+      break;
+    default:
+      CauseException (DLX_EXC_ACCESS);
+      break;
+    }
+  }
+  return (1);
+}
+
+int
+Cpu::TestWriteWord (uint32 vaddr)
+{
+  uint32	paddr;
+  if (!VaddrToPaddr (vaddr, paddr, DLX_MEM_WRITE)) {
+    return (0);
+  } else {
+    return (1);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Open
+//
+//	Open a file in the "real" file system.  All parameters (in
+//	particular, the file name) must be passed by physical address in
+//	the simulator's address space.
+//	accessType = 1 for read, 2 for write, 3 for both.
+//
+//	The trap is called as:
+//	Open (name, accesstype)
+//
+//----------------------------------------------------------------------
+// Name and mode of each host file the OS has open, so a snapshot can
+// reopen them.
+#define	DLX_SNAP_NAMELEN	100
+
+static char	hostFileName[DLX_MAX_FILES][DLX_SNAP_NAMELEN];
+static int	hostFileMode[DLX_MAX_FILES];
+
+void
+Cpu::Open ()
+{
+  uint32	name;
+  char	nameBuf[100];
+  char	*tp;
+  int		accessType;
+  int		i;
+
+  name = GetParam(0);
+  accessType = GetParam(1);
+  DBPRINTF ('F', "Opening file %s (mode=%d).\n", (char *)memory + name,
+	    accessType);
+  switch (accessType) {
+  case 1:
+    tp = "r";
+    break;
+  case 2:
+    tp = "w";
+    break;
+  case 3:
+    tp = "r+";
+    break;
+  default:
+    SetResult (0xffffffff);
+    return;
+    break;
+  }
+  for (i = 0; i < DLX_MAX_FILES; i++) {
+    if (fp[i] == NULL) {
+      if (!CheckAddr (name)) {
+	SetResult (0xffffffff);
+	return;
+      }
+      strncpy (nameBuf, (char *)memory + name, 98);
+      // If fopen fails, it returns NULL, so it looks like no open
+      // was done.
+      fp[i] = fopen (nameBuf, tp);
+      if (fp[i] != NULL) {
+	strcpy (hostFileName[i], nameBuf);
+	hostFileMode[i] = accessType;
+      }
+      break;
+    }
+  }
+  if (i >= DLX_MAX_FILES) {
+    i = -1;
+  } else if (fp[i] == NULL) {
+    i = -errno;
+  }
+  DBPRINTF ('F', "Open returns file descriptor %d\n", i);
+  SetResult (i);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Read
+//	Cpu::Write
+//
+//	Read data from a previously opened file in the real world.
+//	Called as:
+//	Read (int desc, void* buf, int size)
+//	Write (int desc, void* buf, int size)
+//	Returns number of bytes read if there were more than 0, 0 on
+//	end of file, and -1 otherwise.
+//
+//----------------------------------------------------------------------
+void
+Cpu::Read ()
+{
+  FileIo (DLX_FILE_READ);
+}
+
+void
+Cpu::Write ()
+{
+  FileIo (DLX_FILE_WRITE);
+}
+
+void
+Cpu::FileIo (int kind)
+{
+  int		fd;
+  uint32	buf;
+  int		size;
+  int		n;
+
+  fd = GetParam (0);
+  buf = GetParam (1);
+  size = GetParam (2);
+  DBPRINTF ('F', "FileIo (%s) on fd %d, size %d, buffer=0x%x\n",
+	    (kind == DLX_FILE_WRITE) ? "write" : "read",
+	    fd, size, buf);
+  if (! CheckAddr (buf) || (! CheckFd (fd))) {
+    SetResult (0xffffffff);
+    return;
+  }
+  if (kind == DLX_FILE_WRITE) {
+    n = fwrite ((unsigned char *)memory + buf, 1, size, fp[fd]);
+  } else {
+    n = fread ((unsigned char *)memory + buf, 1, size, fp[fd]);
+    if (n > 0) {
+      DecodeCacheInvalidateRange (buf, n);
+      TlbFlush ();
+      BlockNoteWriteRange (buf, n);
+    }
+  }
+  if (n > 0) {
+    SetResult (n);
+  } else if (feof (fp[fd])) {
+    SetResult (0);
+  } else {
+    SetResult (-errno);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::FileIoVec
+//
+//	Read or write a list of segments of a previously opened file in
+//	one trap.  Called as:
+//	preadv (int desc, struct iovec *iov, int iovcnt)
+//	pwritev (int desc, struct iovec *iov, int iovcnt)
+//	iov is the physical address of iovcnt three-word entries, each
+//	holding a physical buffer address, a length in bytes and the file
+//	offset for that segment.  The segments are done in order and the
+//	file position is left after the last one, so a fd can be kept
+//	open and used for any mix of these and plain Read/Write.
+//	Returns the total number of bytes moved; a short segment (end of
+//	file) ends the request early.  Returns -1 for a bad argument and
+//	-errno if the first segment fails.
+//
+//----------------------------------------------------------------------
+#define	DLX_IOVEC_WORDS		3
+#define	DLX_IOVEC_MAX		256
+
+void
+Cpu::FileIoVec (int kind)
+{
+  int		fd;
+  uint32	iov;
+  int		iovcnt;
+  uint32	addr, len, offset;
+  int		i;
+  size_t	n;
+  uint32	total = 0;
+
+  fd = GetParam (0);
+  iov = GetParam (1);
+  iovcnt = GetParam (2);
+  DBPRINTF ('F', "FileIoVec (%s) on fd %d, %d segments at 0x%x\n",
+	    (kind == DLX_FILE_WRITE) ? "write" : "read", fd, iovcnt, iov);
+  if (!CheckFd (fd) || (iovcnt < 0) || (iovcnt > DLX_IOVEC_MAX) ||
+      (iov > memSize) ||
+      ((uint32)iovcnt * DLX_IOVEC_WORDS * 4 > memSize - iov)) {
+    SetResult (0xffffffff);
+    return;
+  }
+  for (i = 0; i < iovcnt; i++) {
+    addr = Memory (iov + (i * DLX_IOVEC_WORDS) * 4);
+    len = Memory (iov + (i * DLX_IOVEC_WORDS + 1) * 4);
+    offset = Memory (iov + (i * DLX_IOVEC_WORDS + 2) * 4);
+    if ((addr > memSize) || (len > memSize - addr)) {
+      SetResult (0xffffffff);
+      return;
+    }
+    if (fseek (fp[fd], offset, SEEK_SET) < 0) {
+      break;
+    }
+    if (kind == DLX_FILE_WRITE) {
+      n = fwrite ((unsigned char *)memory + addr, 1, len, fp[fd]);
+    } else {
+      n = fread ((unsigned char *)memory + addr, 1, len, fp[fd]);
+      if (n > 0) {
+	DecodeCacheInvalidateRange (addr, n);
+	BlockNoteWriteRange (addr, n);
+      }
+    }
+    total += n;
+    if (n < len) {
+      break;
+    }
+  }
+  if ((kind == DLX_FILE_READ) && (total > 0)) {
+    TlbFlush ();
+  }
+  if ((total == 0) && (iovcnt > 0) && ferror (fp[fd])) {
+    SetResult (-errno);
+  } else {
+    SetResult (total);
+  }
+  clearerr (fp[fd]);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::MemOp
+//
+//	memmove (dst, src, n) and memset (dst, c, n) on physical memory,
+//	done at host speed so the OS doesn't spend an instruction per
+//	byte on page copies and buffer moves.  Both ranges must lie
+//	entirely in memory.  Returns dst, or -1 for a bad range.  The
+//	addresses are physical, so callers in user mode or with system
+//	translation on also get -1 and have to copy for themselves.
+//
+//----------------------------------------------------------------------
+void
+Cpu::MemOp (int kind)
+{
+  uint32	dst = GetParam (0);
+  uint32	src = GetParam (1);
+  uint32	n = GetParam (2);
+
+  if (UserMode () ||
+      (GetSreg (DLX_SREG_STATUS) & (DLX_STATUS_XLATE_RD|DLX_STATUS_XLATE_WR)) ||
+      (n > memSize) || (dst > memSize - n) ||
+      ((kind == DLX_TRAP_MEMMOVE) && (src > memSize - n))) {
+    SetResult (0xffffffff);
+    return;
+  }
+  if (n == 0) {
+    SetResult (dst);
+    return;
+  }
+  if (kind == DLX_TRAP_MEMMOVE) {
+    memmove ((unsigned char *)memory + dst, (unsigned char *)memory + src, n);
+  } else {
+    memset ((unsigned char *)memory + dst, src & 0xff, n);
+  }
+  DecodeCacheInvalidateRange (dst, n);
+  BlockNoteWriteRange (dst, n);
+  TlbNoteWriteRange (dst, n);
+  AtomicNoteWriteRange (dst, n);
+  SetResult (dst);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Seek
+//
+//	Seek to a position in the file.  Call it like:
+//	Seek (int fd, int offset, int from)
+//	Returns the new file position, or -1 if it fails.
+//
+//----------------------------------------------------------------------
+void
+Cpu::Seek ()
+{
+  int		fd;
+  int		offset;
+  int		whence;
+  int		rv;
+
+  fd = GetParam(0);
+  offset = GetParam(1);
+  whence = GetParam(2);
+  if (! CheckFd (fd)) {
+    SetResult (0xffffffff);
+    return;
+  }
+  if ((rv = fseek (fp[fd], offset, whence)) < 0) {
+    SetResult (rv);
+  } else {
+    SetResult (ftell (fp[fd]));
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Close
+//
+//	Close a file and release its resources.
+//
+//----------------------------------------------------------------------
+void
+Cpu::Close ()
+{
+  int		fd;
+  uint32	retval;
+
+  fd = GetParam(0);
+  if (!CheckFd (fd)) {
+    retval = 0xffffffff;
+  } else {
+    retval = fclose (fp[fd]);
+    hostFileMode[fd] = 0;
+  }
+  DBPRINTF ('F', "Closing file %d.\n", fd);
+  fp[fd] = NULL;
+  SetResult (retval);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Random
+//
+//	Return a random number using the underlying random() function
+//	call.
 //
 //----------------------------------------------------------------------
-Instruction Cpu::regInstrs[64] = {
-  {0x00, DLX_FMT_RFMT, InstIllegal},		// R-format instructions
-  {0x01, DLX_FMT_RFMT, InstIllegal},		// FP instructions
-  {0x02, DLX_FMT_JFMT, InstJmp},
-  {0x03, DLX_FMT_JFMT, InstJal},
-  {0x04, DLX_FMT_IFMT, InstBeqz},
-  {0x05, DLX_FMT_IFMT, InstBnez},
-  {0x06, DLX_FMT_IFMT, InstBfpt},
-  {0x07, DLX_FMT_IFMT, InstBfpf},
-  {0x08, DLX_FMT_IFMT, InstAddi},
-  {0x09, DLX_FMT_IFMT, InstAddui},
-  {0x0a, DLX_FMT_IFMT, InstSubi},
-  {0x0b, DLX_FMT_IFMT, InstSubui},
-  {0x0c, DLX_FMT_IFMT, InstAndi},
-  {0x0d, DLX_FMT_IFMT, InstOri},
-  {0x0e, DLX_FMT_IFMT, InstXori},
-  {0x0f, DLX_FMT_IFMT, InstLhi},
-  {0x10, DLX_FMT_JFMT, InstRfe},
-  {0x11, DLX_FMT_JFMT, InstTrap},
-  {0x12, DLX_FMT_JFMT, InstJr},
-  {0x13, DLX_FMT_JFMT, InstJalr},
-  {0x14, DLX_FMT_IFMT, InstSlli},
-  {0x15, DLX_FMT_IFMT, InstNop},
-  {0x16, DLX_FMT_IFMT, InstSrli},
-  {0x17, DLX_FMT_IFMT, InstSrai},
-  {0x18, DLX_FMT_IFMT, InstSeqi},
-  {0x19, DLX_FMT_IFMT, InstSnei},
-  {0x1a, DLX_FMT_IFMT, InstSlti},
-  {0x1b, DLX_FMT_IFMT, InstSgti},
-  {0x1c, DLX_FMT_IFMT, InstSlei},
-  {0x1d, DLX_FMT_IFMT, InstSgei},
-  {0x1e, DLX_FMT_IFMT, InstIllegal},
-  {0x1f, DLX_FMT_IFMT, InstIllegal},
-  {0x20, DLX_FMT_IFMT, InstLb},
-  {0x21, DLX_FMT_IFMT, InstLh},
-  {0x22, DLX_FMT_IFMT, InstIllegal},
-  {0x23, DLX_FMT_IFMT, InstLw},
-  {0x24, DLX_FMT_IFMT, InstLbu},
-  {0x25, DLX_FMT_IFMT, InstLhu},
-  {0x26, DLX_FMT_IFMT, InstLf},
-  {0x27, DLX_FMT_IFMT, InstLd},
-  {0x28, DLX_FMT_IFMT, InstSb},
-  {0x29, DLX_FMT_IFMT, InstSh},
-  {0x2a, DLX_FMT_IFMT, InstIllegal},
-  {0x2b, DLX_FMT_IFMT, InstSw},
-  {0x2c, DLX_FMT_IFMT, InstIllegal},
-  {0x2d, DLX_FMT_IFMT, InstIllegal},
-  {0x2e, DLX_FMT_IFMT, InstSf},
-  {0x2f, DLX_FMT_IFMT, InstSd},
-  {0x30, DLX_FMT_IFMT, InstIllegal},
-  {0x31, DLX_FMT_IFMT, InstIllegal},
-  {0x32, DLX_FMT_IFMT, InstIllegal},
-  {0x33, DLX_FMT_IFMT, InstIllegal},
-  {0x34, DLX_FMT_IFMT, InstIllegal},
-  {0x35, DLX_FMT_IFMT, InstIllegal},
-  {0x36, DLX_FMT_IFMT, InstIllegal},
-  {0x37, DLX_FMT_IFMT, InstIllegal},
-  {0x38, DLX_FMT_IFMT, InstIllegal},
-  {0x39, DLX_FMT_IFMT, InstIllegal},
-  {0x3a, DLX_FMT_IFMT, InstIllegal},
-  {0x3b, DLX_FMT_IFMT, InstIllegal},
-  {0x3c, DLX_FMT_IFMT, InstIllegal},
-  {0x3d, DLX_FMT_IFMT, InstIllegal},
-  {0x3e, DLX_FMT_IFMT, InstIllegal},
-  {0x3f, DLX_FMT_IFMT, InstIllegal},
-};
+void
+Cpu::Random ()
+{
+  int		n;
+
+  n = random ();
+  SetResult (n);
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Srandom
+//
+//	Set the random number generator to the number passed.
+//
+//----------------------------------------------------------------------
+void
+Cpu::Srandom ()
+{
+  uint32	seed;
+
+  seed = GetParam (0);
+  srandom (seed);
+  SetResult (0);
+}
 
 //----------------------------------------------------------------------
 //
-//	Table of FP instructions
+//	Cpu::GetParam
+//
+//	Parameters are stored on the stack (r29), with the first parameter
+//	stored at [r29].  Other parameters are stored at [r29+4], [r29+8],
+//	etc.  Parameters are passed on word boundaries.
 //
 //----------------------------------------------------------------------
-Instruction Cpu::fpInstrs[32] = {
-  {0x00, DLX_FMT_RFMT, InstAddf},
-  {0x01, DLX_FMT_RFMT, InstSubf},
-  {0x02, DLX_FMT_RFMT, InstMultf},
-  {0x03, DLX_FMT_RFMT, InstDivf},
-  {0x04, DLX_FMT_RFMT, InstAddd},
-  {0x05, DLX_FMT_RFMT, InstSubd},
-  {0x06, DLX_FMT_RFMT, InstMultd},
-  {0x07, DLX_FMT_RFMT, InstDivd},
-  {0x08, DLX_FMT_RFMT, InstCvtf2d},
-  {0x09, DLX_FMT_RFMT, InstCvtf2i},
-  {0x0a, DLX_FMT_RFMT, InstCvtd2f},
-  {0x0b, DLX_FMT_RFMT, InstCvtd2i},
-  {0x0c, DLX_FMT_RFMT, InstCvti2f},
-  {0x0d, DLX_FMT_RFMT, InstCvti2d},
-  {0x0e, DLX_FMT_RFMT, InstMult},
-  {0x0f, DLX_FMT_RFMT, InstDiv},
-  {0x10, DLX_FMT_RFMT, InstEqf},
-  {0x11, DLX_FMT_RFMT, InstNef},
-  {0x12, DLX_FMT_RFMT, InstLtf},
-  {0x13, DLX_FMT_RFMT, InstGtf},
-  {0x14, DLX_FMT_RFMT, InstLef},
-  {0x15, DLX_FMT_RFMT, InstGef},
-  {0x16, DLX_FMT_RFMT, InstMultu},
-  {0x17, DLX_FMT_RFMT, InstDivu},
-  {0x18, DLX_FMT_RFMT, InstEqd},
-  {0x19, DLX_FMT_RFMT, InstNed},
-  {0x1a, DLX_FMT_RFMT, InstLtd},
-  {0x1b, DLX_FMT_RFMT, InstGtd},
-  {0x1c, DLX_FMT_RFMT, InstLed},
-  {0x1d, DLX_FMT_RFMT, InstGed},
-  {0x1e, DLX_FMT_RFMT, InstIllegal},
-  {0x1f, DLX_FMT_RFMT, InstIllegal},
-};
+uint32
+Cpu::GetParam (int p)
+{
+  uint32	stackPtr;
+
+  stackPtr = GetIreg (29);
+  return (Memory(stackPtr + (p << 2)));
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::SetResult
+//
+//	Results are stored in register 1.
+//
+//----------------------------------------------------------------------
+void
+Cpu::SetResult (uint32 r)
+{
+  PutIreg (1, r);
+}
 
 //----------------------------------------------------------------------
 //
-//	Cpu::CauseException
+//	Cpu::Printf
+//
+//	This is the actual printf routine because we have to handle strings
+//	differently because of the pointers involved.  Everything else works
+//	as would be expected.
+//
+//	IMPORTANT: floating point numbers aren't supported.
+//
+//	IMPORTANT: all pointers must be passed as addresses in physical
+//	simulated memory, not as virtual addresses.  This basically means
+//	that you don't want to call printf from user level because the
+//	format string itself is in user space.  Of course, you can always
+//	copy it into kernel space, but it's harder to copy the other string
+//	arguments.
+//
+//----------------------------------------------------------------------
+void
+Cpu::Printf ()
+{
+  uint32	fmtaddr;
+  char	*c;
+  uint32	args[10];
+  int		nargs = 0, n;
+  char		out[1024];
+
+  fmtaddr = GetParam(0);
+  // 
+  for (c = fmtaddr + (char *)memory; *c != '\0'; c++) {
+    if (*c == '%') {
+      // if this is a %%, skip past second %
+      if (*(c+1) == '%') {
+	c++;
+	continue;
+      }
+      // Get the current argument off the stack
+      args[nargs] = GetParam(nargs+1);
+      DBPRINTF ('p', "Argument %d at 0x%x is %d (0x%x).\n", nargs,
+		args[nargs], args[nargs]);
+      while (1) {
+	c++;
+	if (*c == 's') {
+	  // If it's a string, the address is relative to the
+	  // start of emulated memory.
+	  args[nargs] += (uint32)memory;
+	  break;
+	} else if (*c == 'l') {
+	  continue;
+	} else if ((*c == 'f') || (*c == 'g') || (*c == 'e')) {
+	  // If it's a floating point number, it'll be passed as
+	  // a double, so grab the second word also.
+	  nargs += 1;
+	  args[nargs] = GetParam(nargs+1);
+	  break;
+	} else if ((*c >= 'a') && (*c <= 'z')) {
+	  // If it's another formatting character, it's not
+	  // a string, but we can leave the loop anyway.
+	  break;
+	}
+      }
+      nargs += 1;
+    }
+  }
+  n = snprintf (out, sizeof (out), fmtaddr + (char *)memory,
+		args[0], args[1], args[2], args[3],
+		args[4], args[5], args[6], args[7]);
+  if (n >= (int)sizeof (out)) {
+    ConsSync ();
+    fprintf (consFp, fmtaddr + (char *)memory,
+	     args[0], args[1], args[2], args[3],
+	     args[4], args[5], args[6], args[7]);
+    fflush (consFp);
+  } else if (n > 0) {
+    ConsWrite (out, n);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	Cpu::ConsoleWrite
 //
-//	Cause an exception.  This loads the CAUSE register with the
-//	exception cause, loads the IAR with the proper pointer, and
-//	sets things up so that the exception will be taken after the
-//	current instruction completes.
+//	Send len bytes at buf (physical address), already formatted, to
+//	the console.  Returns the number of bytes written.
 //
 //----------------------------------------------------------------------
-int
-Cpu::CauseException (int excType)
+void
+Cpu::ConsoleWrite ()
 {
-  uint32	ivec;
+  uint32	buf = GetParam (0);
+  uint32	len = GetParam (1);
 
-  DBPRINTF ('t',"Exception being done (cause=0x%x @ pc=0x%x).\n",excType,
-	    PC()-4);
-  ivec = GetSreg (DLX_SREG_INTRVEC);
-  OutputBasicBlock (ivec);
-  if (flags & (DLX_TRACE_INSTRUCTIONS | DLX_TRACE_MEMORY)) {
-    fprintf (tracefp, "X %x %x\n",excType, PC()-4);
+  if ((buf > memSize) || (len > memSize - buf)) {
+    SetResult (0xffffffff);
+    return;
   }
-  PutSreg(DLX_SREG_CAUSE, excType);
-  // PC has already been incremented, so decrement it first.  If this
-  // is a trap or interrupt, the PC will have already been incremented
-  // (if necessary) so the IAR points to the next instruction to
-  // execute.
-  PutSreg(DLX_SREG_IAR, PC()-4);
-  // Save the current status register
-  PutSreg(DLX_SREG_ISR, GetSreg (DLX_SREG_STATUS));
-  // Save the current value of register 31.  This is necessary to give
-  // the interrupt handler a temporary register that can be used to
-  // switch to a system stack (rather than user stack)
-  PutSreg(DLX_SREG_IR31, GetIreg (31));
-  // Set the next instruction to be run to be the interrupt vector.
-  SetPC (ivec);
-  // Set the status register to be system mode
-  PutSreg(DLX_SREG_STATUS, GetSreg (DLX_SREG_STATUS) | DLX_STATUS_SYSMODE);
-  // Turn off interrupts
-  DisableInterrupts ();
-  return (1);
+  ConsWrite ((char *)memory + buf, len);
+  SetResult (len);
 }
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Exit
+//
+//	Exit the CPU altogether.  Before doing so, print statistics on
+//	instructions executed and time taken.
+//
+//----------------------------------------------------------------------
+void
+Cpu::Exit ()
+{
+  struct timeval	t;
 
+  ConsFlush ();
+  printf ("Exiting at program request.\n");
+  DLX_SYNC_TIME ();
+  printf ("Instructions executed: %.0lf\n", instrsExecuted);
+  printf ("Time simulated: %.03lf secs\n", usElapsed / 1e6);
+  //Zheng add timezone*
+  //gettimeofday (&t, (timezone*)(void *)0);
+  gettimeofday (&t, (void *)0);
+  realElapsed = ((double)t.tv_sec + ((double)t.tv_usec)*1e-6) - realElapsed;
+  printf ("Real time elapsed: %.03lf secs\n", realElapsed);
+  printf ("Execution rate: %.2lfM simulated instructions per real second.\n",
+	  instrsExecuted * 1e-6 / realElapsed);
+  if (dlxTier != DLX_TIER_HOT) {
+    printf ("Execution tier: %s\n", dlxTierNames[dlxTier]);
+  }
+  if ((tlbHits + tlbMisses) > 0.0) {
+    printf ("TLB: %.0lf hits, %.0lf misses (%.2lf%% hit rate)\n",
+	    tlbHits, tlbMisses, 100.0 * tlbHits / (tlbHits + tlbMisses));
+  }
+  if (waitSkipped > 0.0) {
+    printf ("Idle (wait): %.0lf instructions skipped\n", waitSkipped);
+  }
+  if ((decodeCacheHits + decodeCacheMisses) > 0.0) {
+    printf ("Decode cache: %.0lf hits, %.0lf misses (%.2lf%% hit rate)\n",
+	    decodeCacheHits, decodeCacheMisses,
+	    100.0 * decodeCacheHits / (decodeCacheHits + decodeCacheMisses));
+  }
+  exit (0);
+}
 
 
 //----------------------------------------------------------------------
 //
-//	Cpu::VaddrToPaddr
+//	DMA disk
+//
+//	A block device backed by a host file.  The OS writes the
+//	physical address of the file name to DLX_DMADISK_NAME once, then
+//	for each transfer programs the starting block, a physical buffer
+//	address and a block count and writes DLX_DMADISK_READ or
+//	DLX_DMADISK_WRITE to DLX_DMADISK_REQUEST.  The status goes to
+//	BUSY and, after a simulated latency of diskLatency us plus
+//	diskBlockLatency us per block, the data is moved directly
+//	between the file and memory, the status goes to DONE (or ERROR)
+//	and, if enabled, a DLX_DMADISK_EXC interrupt is raised.  Writing
+//	the status register acknowledges a completed request.  A request
+//	that can't be started sets ERROR immediately without an
+//	interrupt.  Blocks past the end of the file read as zeros.
+//
+//	The host side of a transfer runs on the host I/O thread from
+//	the moment the request starts, into or out of a buffer of its
+//	own: a write takes the data from memory then, as a controller
+//	that fetches ahead would, and a read's data lands in memory at
+//	completion.
+//
+//	If DLXSIM_DISK_OVERLAY names a file, the disk file is only read
+//	(it needn't even exist) and writes go to the overlay instead, so
+//	one prepared image can back any number of runs at once.  See
+//	"Disk overlays" below.
 //
-//	Read a single word from memory.  This involves translating
-//	the virtual address to a physical address, checking that the
-//	access is allowed, and ensuring that the address itself is
-//	valid (ie, aligned).  An exception is caused (and 0 returned)
-//	if the access fails for any reason.
+//----------------------------------------------------------------------
+#define	DLX_DMADISK_BASE	0xfff00400
+#define	DLX_DMADISK_NAME	(DLX_DMADISK_BASE + 0x00)
+#define	DLX_DMADISK_BLOCK	(DLX_DMADISK_BASE + 0x04)
+#define	DLX_DMADISK_ADDR	(DLX_DMADISK_BASE + 0x08)
+#define	DLX_DMADISK_COUNT	(DLX_DMADISK_BASE + 0x0c)
+#define	DLX_DMADISK_REQUEST	(DLX_DMADISK_BASE + 0x10)
+#define	DLX_DMADISK_STATUS	(DLX_DMADISK_BASE + 0x14)
+#define	DLX_DMADISK_INTR	(DLX_DMADISK_BASE + 0x18)
+#define	DLX_DMADISK_LATENCY	(DLX_DMADISK_BASE + 0x1c)
+#define	DLX_DMADISK_BLOCKLAT	(DLX_DMADISK_BASE + 0x20)
+#define	DLX_DMADISK_SIZE	0x24
+
+#define	DLX_DMADISK_READ	1	// request codes
+#define	DLX_DMADISK_WRITE	2
+
+#define	DLX_DMADISK_IDLE	0	// status values
+#define	DLX_DMADISK_BUSY	1
+#define	DLX_DMADISK_DONE	2
+#define	DLX_DMADISK_ERROR	3
+
+#define	DLX_DMADISK_EXC		0x50	// completion interrupt cause
+#define	DLX_DMADISK_BLOCKSIZE	512
+
+static FILE	*diskFp = NULL;
+static char	diskName[DLX_SNAP_NAMELEN];
+static uint32	diskBlock, diskAddr, diskCount, diskReq;
+static uint32	diskStatus = DLX_DMADISK_IDLE;
+static int	diskIntrEnabled = 0;
+static uint32	diskLatency = 2000;	// us per request (seek + rotation)
+static uint32	diskBlockLatency = 20;	// us per block transferred
+
+static FILE	*diskOvlFp = NULL;	// overlay, if there is one
+
+// The request in progress, as the host I/O thread sees it
+typedef struct DiskIo {
+  IoJob		job;		// must be first
+  unsigned char	*buf;
+  uint32	size;		// of buf
+  uint32	block, addr, count, req;
+} DiskIo;
+
+static DiskIo	diskIo;
+
+static void DiskStart (unsigned char *mem);
+static int DiskOverlayOpen (const char *name);
+static int DiskOverlayRead (unsigned char *buf, uint32 block, uint32 count);
+static int DiskOverlayWrite (const unsigned char *buf, uint32 block,
+			     uint32 count);
+
+static
+uint32
+DiskRegRead (uint32 paddr)
+{
+  switch (paddr) {
+  case DLX_DMADISK_BLOCK:
+    return (diskBlock);
+  case DLX_DMADISK_ADDR:
+    return (diskAddr);
+  case DLX_DMADISK_COUNT:
+    return (diskCount);
+  case DLX_DMADISK_STATUS:
+    return (diskStatus);
+  case DLX_DMADISK_INTR:
+    return (diskIntrEnabled);
+  case DLX_DMADISK_LATENCY:
+    return (diskLatency);
+  case DLX_DMADISK_BLOCKLAT:
+    return (diskBlockLatency);
+  default:
+    return (0);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	DiskOpen
+//
+//	Open the backing file whose name is at physical address addr
+//	(or, for DiskOpenName, in the simulator), creating it if needed.
+//	Returns 0 if the name isn't a string within memory or the file
+//	can't be opened.
 //
 //----------------------------------------------------------------------
-inline
+static
 int
-Cpu::VaddrToPaddr (uint32 vaddr, uint32& paddr, uint32 op, uint32 pteflags)
+DiskOpenName (const char *name)
 {
-  uint32	pt1base, pt2base, pt1pagebits, pt2pagebits;
-  uint32	pteaddr;
-  uint32	offsetinpage, entrynum;
-  uint32	pagemask;
-
-  if ((vaddr & 0x3) != 0) {
-    CauseException (DLX_EXC_ADDRESS);
+  if (strlen (name) >= sizeof (diskName)) {
     return (0);
   }
-  if (StatusBit (DLX_STATUS_PAGE_TABLE)) {
-    // Translate if in user mode or if in system mode and the appropriate
-    // translation bit is set in the status register.
-    if (UserMode () ||
-	((op == DLX_MEM_READ) &&
-	 (GetSreg (DLX_SREG_STATUS) & DLX_STATUS_XLATE_RD)) ||
-	((op == DLX_MEM_WRITE) &&
-	 (GetSreg (DLX_SREG_STATUS) & DLX_STATUS_XLATE_WR))) {
-      DBPRINTF ('m', "Translating 0x%x\n", vaddr);
-      pt1base = GetSreg (DLX_SREG_PGTBL_BASE);
-      pt1pagebits = GetSreg (DLX_SREG_PGTBL_BITS);
-      pt2pagebits = (pt1pagebits >> 16) & 0xffff;
-      pt1pagebits &= 0xffff;
-      pagemask = (1 << pt2pagebits) - 1;
-      offsetinpage = vaddr & pagemask;
-      // Mask off the low bits
-      vaddr &= ~pagemask;
-      if ((entrynum = (vaddr >> pt1pagebits)) >=
-	  GetSreg (DLX_SREG_PGTBL_SIZE)) {
-	DBPRINTF ('m', "Out of range (L1 = %db, L2 = %db size=%d entry=%d)\n",
-		  pt1pagebits, pt2pagebits, GetSreg(DLX_SREG_PGTBL_SIZE),
-		  entrynum);
-	CauseException (DLX_EXC_ACCESS);
-	return (0);
-      }
-      pteaddr = pt1base + 4 * entrynum;
-      paddr = Memory (pteaddr);
-      // If the L2 page size is the same as the L1 page size, there's
-      // no L2 page table!
-      if (pt1pagebits != pt2pagebits) {
-	pt2base = paddr;
-	if (pt2base == 0) {
-	  DBPRINTF ('m', "No L2 table at entry %d! (base = 0x%x)\n",
-		    entrynum, pt1base);
-          PutSreg (DLX_SREG_FAULT_ADDR, vaddr);
-	  CauseException (DLX_EXC_PAGEFAULT);
-	  return (0);
-	}
-	pteaddr = pt2base + 4 * ((vaddr >> pt2pagebits) &
-				 ((1 << (pt1pagebits-pt2pagebits))-1));
-	paddr = Memory (pteaddr);
-      }
-      DBPRINTF ('M', "Using PTE 0x%08x\n", paddr);
-      if (!(paddr & DLX_PTE_VALID)) {
-	DBPRINTF ('m', "PTE invalid (0x%08x)\n", paddr);
-	PutSreg (DLX_SREG_FAULT_ADDR, vaddr);
-	CauseException (DLX_EXC_PAGEFAULT);
-	return (0);
-      }
+  IoWait (&diskIo.job);
+  if (diskFp != NULL) {
+    fclose (diskFp);
+    diskFp = NULL;
+  }
+  diskName[0] = '\0';
+  if (getenv ("DLXSIM_DISK_OVERLAY") != NULL) {
+    if (!DiskOverlayOpen (name)) {
+      return (0);
+    }
+  } else {
+    if ((diskFp = fopen (name, "r+")) == NULL) {
+      diskFp = fopen (name, "w+");
+    }
+    if (diskFp == NULL) {
+      return (0);
+    }
+  }
+  strcpy (diskName, name);
+  return (1);
+}
 
-      //Zheng{
-#if USE_ROP
-      if ((op == DLX_MEM_WRITE) && (paddr & DLX_PTE_RW)) {
-#if USE_ROP_DEBUG
-        printf("Cpu: writing a read-only page, vaddr=0x%x\n", vaddr);
-#endif
-        PutSreg (DLX_SREG_FAULT_ADDR, vaddr);
-        CauseException(DLX_ROP_ACCESS);
-        return (0);
-      }
-#endif
-      //}Zheng
+static
+int
+DiskOpen (const unsigned char *mem, uint32 memsize, uint32 addr)
+{
+  uint32	n;
 
-      //Zheng{
-#if USE_ROP
-      if (pteflags & DLX_PTE_DIRTY) {
-	SetMemory (pteaddr,
-		   paddr | (pteflags & DLX_PTE_DIRTY));
-      }
-#else
-      //}Zheng
-      if (pteflags & (DLX_PTE_DIRTY | DLX_PTE_REFERENCED)) {
-	SetMemory (pteaddr,
-		   paddr | (pteflags & (DLX_PTE_DIRTY | DLX_PTE_REFERENCED)));
-      }
-      //Zheng
-#endif
+  for (n = addr; (n < memsize) && (mem[n] != '\0'); n++) {
+  }
+  if (n >= memsize) {
+    return (0);
+  }
+  return (DiskOpenName ((const char *)mem + addr));
+}
 
-      paddr &= ~(pagemask | DLX_PTE_MASK);
-      paddr |= offsetinpage;
-      DBPRINTF ('m',
-		"0x%x => 0x%x (=%08x) using base1=0x%x/%d, entry %d\n",
-		vaddr | offsetinpage, paddr,
-		Memory (paddr),
-		pt1base, pt1pagebits, entrynum);
-      return (1);
-    } else {
-      // For system references, physical address is the same
-      // as virtual address.
-      paddr = vaddr;
-      if ((vaddr <= memSize) || ((vaddr >= DLX_IO_BASE) &&
-				 (vaddr <= (DLX_IO_BASE+DLX_IO_SIZE)))) {
-	return (1);
-      } else {
-	DBPRINTF ('t',"Illegal system address: 0x%x.\n", vaddr);
-	CauseException (DLX_EXC_ACCESS);
-	return (0);
-      }
+static
+void
+DiskRegWrite (uint32 paddr, uint32 val, unsigned char *mem, uint32 memsize,
+	      double usPerInst)
+{
+  uint32	bytes;
+  double	us;
+
+  switch (paddr) {
+  case DLX_DMADISK_NAME:
+    if (!DiskOpen (mem, memsize, val)) {
+      diskStatus = DLX_DMADISK_ERROR;
     }
-  } else if (StatusBit (DLX_STATUS_TLB)) {
-    // DLX_STATUS_TLB
-    return (1);
-  } else {
-    paddr = vaddr;
-    return (1);
+    break;
+  case DLX_DMADISK_BLOCK:
+    diskBlock = val;
+    break;
+  case DLX_DMADISK_ADDR:
+    diskAddr = val;
+    break;
+  case DLX_DMADISK_COUNT:
+    diskCount = val;
+    break;
+  case DLX_DMADISK_REQUEST:
+    bytes = diskCount * DLX_DMADISK_BLOCKSIZE;
+    if ((diskStatus == DLX_DMADISK_BUSY) ||
+	((diskFp == NULL) && (diskOvlFp == NULL)) ||
+	((val != DLX_DMADISK_READ) && (val != DLX_DMADISK_WRITE)) ||
+	(diskCount == 0) || (bytes / DLX_DMADISK_BLOCKSIZE != diskCount) ||
+	(diskAddr > memsize) || (bytes > memsize - diskAddr)) {
+      diskStatus = DLX_DMADISK_ERROR;
+      break;
+    }
+    diskReq = val;
+    diskStatus = DLX_DMADISK_BUSY;
+    us = (double)diskLatency + (double)diskBlockLatency * diskCount;
+    EventSchedule (DLX_EVENT_DISK, dlxCycle + (DlxCycle)(us / usPerInst) + 1);
+    DiskStart (mem);
+    break;
+  case DLX_DMADISK_STATUS:
+    if (diskStatus != DLX_DMADISK_BUSY) {
+      diskStatus = DLX_DMADISK_IDLE;
+    }
+    break;
+  case DLX_DMADISK_INTR:
+    diskIntrEnabled = (val != 0);
+    break;
+  case DLX_DMADISK_LATENCY:
+    diskLatency = val;
+    break;
+  case DLX_DMADISK_BLOCKLAT:
+    diskBlockLatency = val;
+    break;
   }
 }
-
+
 //----------------------------------------------------------------------
 //
-//	Cpu::ReadWord
+//	DiskStart
 //
-//	Read a word from memory.  This can either be a regular memory
-//	address or an I/O address.
+//	Hand the request just started to the host I/O thread.  A write's
+//	data is copied out of memory now.  Also called on resuming a
+//	snapshot taken with a request in progress.
 //
 //----------------------------------------------------------------------
-int
-Cpu::ReadWord (uint32 vaddr, uint32 &val, uint32 op)
+static
+void
+DiskIoRun (IoJob *job)
 {
-  uint32	paddr;
-
-  DBPRINTF ('l',"Trying to read virtual address: 0x%x.\n", vaddr);
-//Zheng{
-#if USE_ROP
-  if (!VaddrToPaddr (vaddr, paddr, op, 0)) {
-#else
-//}Zheng
-  if (!VaddrToPaddr (vaddr, paddr, op, DLX_PTE_REFERENCED)) {
-#endif
-    return (0);
-  }
-  if (paddr <= memSize) {
-    val = Memory(paddr);
+  DiskIo	*d = (DiskIo *)job;
+  uint32	bytes = d->count * DLX_DMADISK_BLOCKSIZE;
+  size_t	n;
+  int		ok;
+
+  if (diskOvlFp != NULL) {
+    ok = (d->req == DLX_DMADISK_READ) ?
+      DiskOverlayRead (d->buf, d->block, d->count) :
+      DiskOverlayWrite (d->buf, d->block, d->count);
   } else {
-    DBPRINTF ('l',"Trying to load special address: 0x%x.\n", paddr);
-    switch (paddr) {
-    case DLX_KBD_NCHARSIN:
-      val = KbdNumInChars ();
-      break;
-    case DLX_KBD_NCHARSOUT:
-      val = KbdNumOutChars ();
-      break;
-    case DLX_KBD_GETCHAR:
-      val = KbdGetChar ();
-      break;
-    case DLX_DISK_STATUS:
-      break;
-    case DLX_GETMEMSIZE:
-      val = memSize;
-      break;
-    default:
-      CauseException (DLX_EXC_ACCESS);
-      break;
+    ok = (fseek (diskFp, (long)d->block * DLX_DMADISK_BLOCKSIZE,
+		 SEEK_SET) == 0);
+    if (d->req == DLX_DMADISK_READ) {
+      // Seeking past the end is fine; the short read is zero filled.
+      n = ok ? fread (d->buf, 1, bytes, diskFp) : 0;
+      if (n < bytes) {
+	memset (d->buf + n, 0, bytes - n);
+      }
+      clearerr (diskFp);
+    } else {
+      ok = ok && (fwrite (d->buf, 1, bytes, diskFp) == bytes) &&
+	(fflush (diskFp) == 0);
     }
   }
-  return (1);
+  job->ok = ok;
+}
+
+static
+void
+DiskStart (unsigned char *mem)
+{
+  uint32	bytes = diskCount * DLX_DMADISK_BLOCKSIZE;
+
+  IoWait (&diskIo.job);
+  if (diskIo.size < bytes) {
+    delete[] diskIo.buf;
+    diskIo.buf = new unsigned char[bytes];
+    diskIo.size = bytes;
+  }
+  diskIo.job.run = DiskIoRun;
+  diskIo.block = diskBlock;
+  diskIo.addr = diskAddr;
+  diskIo.count = diskCount;
+  diskIo.req = diskReq;
+  if (diskReq == DLX_DMADISK_WRITE) {
+    memcpy (diskIo.buf, mem + diskAddr, bytes);
+  }
+  IoPost (&diskIo.job);
+}
+
+//----------------------------------------------------------------------
+//
+//	DiskTransfer
+//
+//	Finish the request in progress, called when its completion
+//	event comes due: wait for the host I/O thread if it's still at
+//	it, and move a read's data into memory.
+//
+//----------------------------------------------------------------------
+static
+void
+DiskTransfer (unsigned char *mem)
+{
+  uint32	bytes = diskIo.count * DLX_DMADISK_BLOCKSIZE;
+
+  IoWait (&diskIo.job);
+  if (diskIo.req == DLX_DMADISK_READ) {
+    memcpy (mem + diskIo.addr, diskIo.buf, bytes);
+    DecodeCacheInvalidateRange (diskIo.addr, bytes);
+    TlbFlush ();
+    BlockNoteWriteRange (diskIo.addr, bytes);
+  }
+  diskStatus = diskIo.job.ok ? DLX_DMADISK_DONE : DLX_DMADISK_ERROR;
 }
 
+//----------------------------------------------------------------------
+//
+//	Disk overlays
+//
+//	With DLXSIM_DISK_OVERLAY set, the disk file the OS names is a
+//	read-only base image (a missing one reads as zeros) and every
+//	block written goes to the overlay file, created if it doesn't
+//	exist.  The overlay starts with a header block, then a bitmap of
+//	which blocks it holds, then block n at DLX_OVL_DATA + n blocks.
+//	It's left sparse, so it only takes the space of what was written.
+//	A read takes each block from the overlay if its bit is set and
+//	from the base otherwise.  A write puts the data in place before
+//	setting the bit, so an interrupted run never maps a block that
+//	wasn't written.
+//
+//	An overlay can be kept to carry a disk from one run to the next,
+//	or removed (or pointed somewhere new) for a fresh copy of the
+//	base.  Parallel runs with their own overlays share one base.
+//
+//----------------------------------------------------------------------
+#define	DLX_OVL_MAGIC		0x444c584f	// "DLXO"
+#define	DLX_OVL_MAX_BLOCKS	(1 << 22)	// 2 GB of 512 byte blocks
+#define	DLX_OVL_MAP_BYTES	(DLX_OVL_MAX_BLOCKS / 8)
+#define	DLX_OVL_MAP		DLX_DMADISK_BLOCKSIZE
+#define	DLX_OVL_DATA		(DLX_OVL_MAP + DLX_OVL_MAP_BYTES)
+
+typedef struct DlxOvlHeader {
+  uint32	magic;
+  uint32	maxBlocks;
+} DlxOvlHeader;
+
+static unsigned char	*diskOvlMap = NULL;	// DLX_OVL_MAP_BYTES
+
+static
+inline
 int
-Cpu::WriteWord (uint32 vaddr, uint32 val)
+DiskOverlayHas (uint32 block)
 {
-  uint32	paddr;
-  //Zheng{
-#if USE_ROP
-  if (!VaddrToPaddr (vaddr, paddr, DLX_MEM_WRITE,
-		     DLX_PTE_DIRTY)) {
-#else
-  //}Zheng
-  if (!VaddrToPaddr (vaddr, paddr, DLX_MEM_WRITE,
-		     DLX_PTE_DIRTY | DLX_PTE_REFERENCED)) {
-#endif
+  return ((block < DLX_OVL_MAX_BLOCKS) &&
+	  (diskOvlMap[block >> 3] & (1 << (block & 7))));
+}
+
+//----------------------------------------------------------------------
+//
+//	DiskOverlayOpen
+//
+//	Open name as the base and DLXSIM_DISK_OVERLAY as the overlay,
+//	reading in the overlay's bitmap.  Returns 0 if the overlay can't
+//	be opened or created, or isn't an overlay.
+//
+//----------------------------------------------------------------------
+static
+int
+DiskOverlayOpen (const char *name)
+{
+  const char	*ovl = getenv ("DLXSIM_DISK_OVERLAY");
+  DlxOvlHeader	h;
+  size_t	n;
+
+  if (diskOvlFp != NULL) {
+    fclose (diskOvlFp);
+    diskOvlFp = NULL;
+  }
+  if (diskOvlMap == NULL) {
+    diskOvlMap = new unsigned char[DLX_OVL_MAP_BYTES];
+  }
+  memset (diskOvlMap, 0, DLX_OVL_MAP_BYTES);
+  if ((diskOvlFp = fopen (ovl, "r+")) == NULL) {
+    diskOvlFp = fopen (ovl, "w+");
+  }
+  if (diskOvlFp == NULL) {
     return (0);
   }
-
-  if (paddr <= memSize) {
-    SetMemory(paddr, val);
-  } else {
-    switch (paddr) {
-    case DLX_KBD_PUTCHAR:
-      KbdPutChar (val);
-      break;
-    case DLX_KBD_INTR:
-      if (val == 0) {
-	flags &= ~DLX_FLAG_KBD_INTERRUPT;
-      } else {
-	flags |= DLX_FLAG_KBD_INTERRUPT;
-      }
-      break;
-    case DLX_TIMER_SETTIMER:
-      DBPRINTF ('o',"Setting timer to %d us.\n", val);
-      SetTimer (val);
-      break;
-#if 0
-    case DLX_DISK_REQUEST:
-      diskReq = val;
-      StartDiskIo ();
-      break;
-    case DLX_DISK_BLOCK:
-      diskBlock = val;
-      break;
-    case DLX_DISK_ADDR:
-      diskAddr = val;
-      break;
-#endif
-    default:
-      CauseException (DLX_EXC_ACCESS);
-      break;
+  n = fread (&h, 1, sizeof (h), diskOvlFp);
+  if (n == 0) {
+    h.magic = DLX_OVL_MAGIC;
+    h.maxBlocks = DLX_OVL_MAX_BLOCKS;
+    rewind (diskOvlFp);
+    if ((fwrite (&h, 1, sizeof (h), diskOvlFp) != sizeof (h)) ||
+	(fflush (diskOvlFp) != 0)) {
+      fclose (diskOvlFp);
+      diskOvlFp = NULL;
+      return (0);
     }
+  } else if ((n != sizeof (h)) || (h.magic != DLX_OVL_MAGIC) ||
+	     (h.maxBlocks != DLX_OVL_MAX_BLOCKS)) {
+    fprintf (stderr, "Disk overlay %s is not an overlay.\n", ovl);
+    fclose (diskOvlFp);
+    diskOvlFp = NULL;
+    return (0);
+  } else if (fseek (diskOvlFp, DLX_OVL_MAP, SEEK_SET) == 0) {
+    // A short read is a bitmap whose end was never written.
+    fread (diskOvlMap, 1, DLX_OVL_MAP_BYTES, diskOvlFp);
   }
+  clearerr (diskOvlFp);
+  diskFp = fopen (name, "r");
   return (1);
 }
 
+//----------------------------------------------------------------------
+//
+//	DiskOverlayRead
+//
+//	Read count blocks starting at block into buf, each from the
+//	overlay or the base.  Returns 0 on a host error.
+//
+//----------------------------------------------------------------------
+static
 int
-Cpu::TestWriteWord (uint32 vaddr)
+DiskOverlayRead (unsigned char *buf, uint32 block, uint32 count)
 {
-  uint32	paddr;
-  if (!VaddrToPaddr (vaddr, paddr, DLX_MEM_WRITE)) {
-    return (0);
-  } else {
-    return (1);
+  FILE		*f;
+  long		off;
+  size_t	n;
+  uint32	i;
+
+  for (i = 0; i < count; i++, block++, buf += DLX_DMADISK_BLOCKSIZE) {
+    if (DiskOverlayHas (block)) {
+      f = diskOvlFp;
+      off = DLX_OVL_DATA + (long)block * DLX_DMADISK_BLOCKSIZE;
+    } else {
+      f = diskFp;
+      off = (long)block * DLX_DMADISK_BLOCKSIZE;
+    }
+    n = 0;
+    if (f != NULL) {
+      if (fseek (f, off, SEEK_SET) != 0) {
+	return (0);
+      }
+      n = fread (buf, 1, DLX_DMADISK_BLOCKSIZE, f);
+      clearerr (f);
+    }
+    if (n < DLX_DMADISK_BLOCKSIZE) {
+      memset (buf + n, 0, DLX_DMADISK_BLOCKSIZE - n);
+    }
   }
+  return (1);
 }
-
+
 //----------------------------------------------------------------------
 //
-//	Cpu::Open
-//
-//	Open a file in the "real" file system.  All parameters (in
-//	particular, the file name) must be passed by physical address in
-//	the simulator's address space.
-//	accessType = 1 for read, 2 for write, 3 for both.
+//	DiskOverlayWrite
 //
-//	The trap is called as:
-//	Open (name, accesstype)
+//	Write count blocks starting at block from buf to the overlay,
+//	then mark them in the bitmap on disk.  Returns 0 on a host error
+//	or a block past DLX_OVL_MAX_BLOCKS.
 //
 //----------------------------------------------------------------------
-void
-Cpu::Open ()
+static
+int
+DiskOverlayWrite (const unsigned char *buf, uint32 block, uint32 count)
 {
-  uint32	name;
-  char	nameBuf[100];
-  char	*tp;
-  int		accessType;
-  int		i;
+  uint32	i, first, last;
 
-  name = GetParam(0);
-  accessType = GetParam(1);
-  DBPRINTF ('F', "Opening file %s (mode=%d).\n", (char *)memory + name,
-	    accessType);
-  switch (accessType) {
-  case 1:
-    tp = "r";
-    break;
-  case 2:
-    tp = "w";
-    break;
-  case 3:
-    tp = "r+";
-    break;
-  default:
-    SetResult (0xffffffff);
-    return;
-    break;
+  if ((block >= DLX_OVL_MAX_BLOCKS) ||
+      (count > DLX_OVL_MAX_BLOCKS - block)) {
+    return (0);
   }
-  for (i = 0; i < DLX_MAX_FILES; i++) {
-    if (fp[i] == NULL) {
-      if (!CheckAddr (name)) {
-	SetResult (0xffffffff);
-	return;
-      }
-      strncpy (nameBuf, (char *)memory + name, 98);
-      // If fopen fails, it returns NULL, so it looks like no open
-      // was done.
-      fp[i] = fopen (nameBuf, tp);
-      break;
-    }
+  if ((fseek (diskOvlFp, DLX_OVL_DATA + (long)block * DLX_DMADISK_BLOCKSIZE,
+	      SEEK_SET) != 0) ||
+      (fwrite (buf, DLX_DMADISK_BLOCKSIZE, count, diskOvlFp) != count) ||
+      (fflush (diskOvlFp) != 0)) {
+    return (0);
   }
-  if (i >= DLX_MAX_FILES) {
-    i = -1;
-  } else if (fp[i] == NULL) {
-    i = -errno;
+  for (i = block; i < block + count; i++) {
+    diskOvlMap[i >> 3] |= 1 << (i & 7);
   }
-  DBPRINTF ('F', "Open returns file descriptor %d\n", i);
-  SetResult (i);
+  first = block >> 3;
+  last = (block + count - 1) >> 3;
+  return ((fseek (diskOvlFp, DLX_OVL_MAP + first, SEEK_SET) == 0) &&
+	  (fwrite (diskOvlMap + first, 1, last - first + 1, diskOvlFp) ==
+	   last - first + 1) &&
+	  (fflush (diskOvlFp) == 0));
 }
-
+
 //----------------------------------------------------------------------
 //
-//	Cpu::Read
-//	Cpu::Write
+//	MmioInit
 //
-//	Read data from a previously opened file in the real world.
-//	Called as:
-//	Read (int desc, void* buf, int size)
-//	Write (int desc, void* buf, int size)
-//	Returns number of bytes read if there were more than 0, 0 on
-//	end of file, and -1 otherwise.
+//	Register the built-in devices (see "MMIO devices" above).
+//	Called by every Cpu, but the table is shared, so only the first
+//	call does anything.
 //
 //----------------------------------------------------------------------
+static
+uint32
+MmioPerfRead (DlxMmioAccess *a, uint32 paddr)
+{
+  return (PerfRead (paddr));
+}
+
+static
 void
-Cpu::Read ()
+MmioPerfWrite (DlxMmioAccess *a, uint32 paddr, uint32 val)
 {
-  FileIo (DLX_FILE_READ);
+  PerfWrite (paddr, val);
 }
 
+static
+uint32
+MmioDiskRead (DlxMmioAccess *a, uint32 paddr)
+{
+  return (DiskRegRead (paddr));
+}
+
+static
 void
-Cpu::Write ()
+MmioDiskWrite (DlxMmioAccess *a, uint32 paddr, uint32 val)
 {
-  FileIo (DLX_FILE_WRITE);
+  DiskRegWrite (paddr, val, a->mem, a->memSize, a->usPerInst);
 }
 
+static
+uint32
+MmioSmpRead (DlxMmioAccess *a, uint32 paddr)
+{
+  return (SmpRegRead (paddr));
+}
+
+static
 void
-Cpu::FileIo (int kind)
+MmioSmpWrite (DlxMmioAccess *a, uint32 paddr, uint32 val)
 {
-  int		fd;
-  uint32	buf;
-  int		size;
-  int		n;
+  a->cpu->SmpRegWrite (paddr, val);
+}
 
-  fd = GetParam (0);
-  buf = GetParam (1);
-  size = GetParam (2);
-  DBPRINTF ('F', "FileIo (%s) on fd %d, size %d, buffer=0x%x\n",
-	    (kind == DLX_FILE_WRITE) ? "write" : "read",
-	    fd, size, buf);
-  if (! CheckAddr (buf) || (! CheckFd (fd))) {
-    SetResult (0xffffffff);
+static
+uint32
+MmioHeatRead (DlxMmioAccess *a, uint32 paddr)
+{
+  return (HeatRegRead (paddr));
+}
+
+static
+void
+MmioHeatWrite (DlxMmioAccess *a, uint32 paddr, uint32 val)
+{
+  HeatRegWrite (paddr, val);
+}
+
+static
+void
+MmioInit ()
+{
+  static int	done = 0;
+
+  if (done) {
     return;
   }
-  if (kind == DLX_FILE_WRITE) {
-    n = fwrite ((unsigned char *)memory + buf, 1, size, fp[fd]);
-  } else {
-    n = fread ((unsigned char *)memory + buf, 1, size, fp[fd]);
-  }
-  if (n > 0) {
-    SetResult (n);
-  } else if (feof (fp[fd])) {
-    SetResult (0);
-  } else {
-    SetResult (-errno);
-  }
+  done = 1;
+  MmioRegister ("DMA disk", DLX_DMADISK_BASE, DLX_DMADISK_SIZE,
+		MmioDiskRead, MmioDiskWrite);
+  MmioRegister ("performance counters", DLX_PERF_BASE, DLX_PERF_SIZE,
+		MmioPerfRead, MmioPerfWrite);
+  MmioRegister ("SMP", DLX_SMP_BASE, DLX_SMP_SIZE, MmioSmpRead, MmioSmpWrite);
+  MmioRegister ("heatmap", DLX_HEAT_BASE, DLX_HEAT_SIZE, MmioHeatRead,
+		MmioHeatWrite);
 }
-
+
 //----------------------------------------------------------------------
 //
-//	Cpu::Seek
+//	Snapshots
 //
-//	Seek to a position in the file.  Call it like:
-//	Seek (int fd, int offset, int from)
-//	Returns the new file position, or -1 if it fails.
+//	Cpu::Snapshot (the DLX_TRAP_SNAPSHOT service) writes the whole
+//	machine to a file: registers, PC, time and pending events, the
+//	performance counters, the disk device, the host files the OS has
+//	open (by name, mode and position) and all of physical memory.
+//	LoadMemory recognizes such a file and resumes from it instead of
+//	loading a program, so an OS can boot once, snapshot itself, and
+//	then have every later run start where the snapshot was taken.
+//
+//	Memory sits at a DLX_SNAP_ALIGN aligned offset in the file and is
+//	mapped copy-on-write on restore, so pages are only read as the
+//	program touches them and the snapshot itself never changes.  The
+//	header is in host byte order; snapshots aren't portable between
+//	hosts, only between runs.
+//
+//	The snapshot trap returns 0 when the snapshot is taken and 1 when
+//	execution resumes from it.  Keyboard input pending at snapshot
+//	time is dropped.
+//
+//----------------------------------------------------------------------
+#define	DLX_SNAP_MAGIC		0x444c5853	// "DLXS"
+#define	DLX_SNAP_VERSION	5
+#define	DLX_SNAP_ALIGN		0x10000		// >= host page size
+
+typedef struct DlxSnapFile {
+  int		mode;			// 0 if not open, else Open's mode
+  long		pos;
+  char		name[DLX_SNAP_NAMELEN];
+} DlxSnapFile;
+
+typedef struct DlxSnapHeader {
+  uint32	magic;
+  uint32	version;
+  uint32	memSize;
+  uint32	memOffset;
+  uint32	pc;
+  uint32	ireg[32];
+  uint32	freg[32];
+  uint32	sreg[32];
+  double	usElapsed;
+  double	instrsExecuted;
+  double	timerInterrupt;
+  DlxCycle	cycle;
+  DlxCycle	stalls;
+  DlxCycle	eventWhen[DLX_NUM_EVENTS];
+  DlxCycle	perf[DLX_PERF_NUM];
+  int		perfUserMode;
+  DlxCycle	perfModeSince;
+  char		diskName[DLX_SNAP_NAMELEN];
+  uint32	disk[7];		// block, addr, count, req, status,
+					// latency, block latency
+  int		diskIntrEnabled;
+  DlxSnapFile	files[DLX_MAX_FILES];
+} DlxSnapHeader;
+
+static int	memoryMapped = 0;	// memory came from mmap, not new
+
+static const char *snapModes[] = {NULL, "r", "w", "r+"};
+
+//----------------------------------------------------------------------
+//
+//	Cpu::Snapshot
+//
+//	Called as:
+//	snapshot (char *name)
+//	with name a physical address.  Returns 0 after writing the
+//	snapshot, -1 if it can't be written, and 1 when resumed.
 //
 //----------------------------------------------------------------------
 void
-Cpu::Seek ()
+Cpu::Snapshot ()
 {
-  int		fd;
-  int		offset;
-  int		whence;
-  int		rv;
-
-  fd = GetParam(0);
-  offset = GetParam(1);
-  whence = GetParam(2);
-  if (! CheckFd (fd)) {
+  static DlxSnapHeader	h;
+  char			name[DLX_SNAP_NAMELEN];
+  FILE			*out;
+  int			i;
+  uint32		pad;
+
+  // A snapshot only holds one core.
+  if (!CheckAddr (GetParam (0)) || (smpNumCpus > 1)) {
     SetResult (0xffffffff);
     return;
   }
-  if ((rv = fseek (fp[fd], offset, whence)) < 0) {
-    SetResult (rv);
-  } else {
-    SetResult (ftell (fp[fd]));
+  strncpy (name, (char *)memory + GetParam (0), sizeof (name) - 1);
+  name[sizeof (name) - 1] = '\0';
+  DLX_SYNC_TIME ();
+  memset (&h, 0, sizeof (h));
+  h.magic = DLX_SNAP_MAGIC;
+  h.version = DLX_SNAP_VERSION;
+  h.memSize = memSize;
+  h.memOffset = (sizeof (h) + DLX_SNAP_ALIGN - 1) & ~(DLX_SNAP_ALIGN - 1);
+  h.pc = PC ();
+  for (i = 0; i < 32; i++) {
+    h.ireg[i] = GetIreg (i);
+    h.freg[i] = GetFreg (i);
+    h.sreg[i] = GetSreg (i);
+  }
+  h.ireg[1] = 1;			// what the trap returns on resume
+  h.usElapsed = usElapsed;
+  h.instrsExecuted = instrsExecuted;
+  h.timerInterrupt = timerInterrupt;
+  h.cycle = dlxCycle;
+  h.stalls = dlxStalls;
+  memcpy (h.eventWhen, eventWhen, sizeof (h.eventWhen));
+  memcpy (h.perf, perfCounters, sizeof (h.perf));
+  h.perfUserMode = perfUserMode;
+  h.perfModeSince = perfModeSince;
+  strcpy (h.diskName, diskName);
+  h.disk[0] = diskBlock;
+  h.disk[1] = diskAddr;
+  h.disk[2] = diskCount;
+  h.disk[3] = diskReq;
+  h.disk[4] = diskStatus;
+  h.disk[5] = diskLatency;
+  h.disk[6] = diskBlockLatency;
+  h.diskIntrEnabled = diskIntrEnabled;
+  for (i = 0; i < DLX_MAX_FILES; i++) {
+    if ((fp[i] != NULL) && (hostFileMode[i] != 0)) {
+      fflush (fp[i]);
+      h.files[i].mode = hostFileMode[i];
+      h.files[i].pos = ftell (fp[i]);
+      strcpy (h.files[i].name, hostFileName[i]);
+    }
+  }
+  if ((out = fopen (name, "w")) == NULL) {
+    SetResult (0xffffffff);
+    return;
+  }
+  fwrite (&h, 1, sizeof (h), out);
+  for (pad = sizeof (h); pad < h.memOffset; pad++) {
+    putc (0, out);
+  }
+  fwrite (memory, 1, memSize, out);
+  if (fclose (out) != 0) {
+    SetResult (0xffffffff);
+    return;
   }
+  printf ("Snapshot of %d bytes written to %s at %.0lf instructions.\n",
+	  memSize, name, instrsExecuted);
+  SetResult (0);
 }
 
 //----------------------------------------------------------------------
 //
-//	Cpu::Close
+//	Cpu::RestoreSnapshot
 //
-//	Close a file and release its resources.
+//	Resume from the snapshot open as in.  Writes the PC to resume at into startAt.  Returns the number of
+//	bytes of memory restored, or 0 if the snapshot can't be used.
 //
 //----------------------------------------------------------------------
-void
-Cpu::Close ()
+int
+Cpu::RestoreSnapshot (FILE *in, uint32 &startAt)
 {
-  int		fd;
-  uint32	retval;
+  static DlxSnapHeader	h;
+  void			*m;
+  int			i;
 
-  fd = GetParam(0);
-  if (!CheckFd (fd)) {
-    retval = 0xffffffff;
+  rewind (in);
+  if (fread (&h, 1, sizeof (h), in) != sizeof (h)) {
+    fprintf (stderr, "Snapshot header is truncated\n");
+    return (0);
+  }
+  if ((h.version != DLX_SNAP_VERSION) || (h.memOffset < sizeof (h))) {
+    fprintf (stderr, "Snapshot has unsupported version %d\n", h.version);
+    return (0);
+  }
+  m = mmap (NULL, h.memSize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+	    fileno (in), h.memOffset);
+  if (m == MAP_FAILED) {
+    perror ("mmap snapshot");
+    return (0);
+  }
+  if (memoryMapped) {
+    munmap (memory, memSize);
   } else {
-    retval = fclose (fp[fd]);
+    delete[] memory;
+  }
+  memory = (uint32 *)m;
+  memoryMapped = 1;
+  memSize = h.memSize;
+  DecodeCacheFlush ();
+  BlockCacheFlush ();
+  TlbFlush ();
+
+  for (i = 0; i < 32; i++) {
+    PutIreg (i, h.ireg[i]);
+    PutFreg (i, h.freg[i]);
+    PutSreg (i, h.sreg[i]);
+  }
+  SetPC (h.pc);
+  startAt = h.pc;
+  usElapsed = h.usElapsed;
+  instrsExecuted = h.instrsExecuted;
+  timerInterrupt = h.timerInterrupt;
+  dlxCycle = dlxCycleSynced = h.cycle;
+  dlxStalls = dlxStallsSynced = h.stalls;
+  memcpy (eventWhen, h.eventWhen, sizeof (eventWhen));
+  // Profiling is a property of this run, not of the snapshot.
+  eventWhen[DLX_EVENT_PROFILE] = (profInterval != 0) ?
+    dlxCycle + profInterval : DLX_EVENT_NEVER;
+  EventRecalcNext ();
+  memcpy (perfCounters, h.perf, sizeof (perfCounters));
+  perfUserMode = h.perfUserMode;
+  perfModeSince = h.perfModeSince;
+  kbdbufferedchars = 0;
+  kbdrpos = kbdwpos = 0;
+
+  diskBlock = h.disk[0];
+  diskAddr = h.disk[1];
+  diskCount = h.disk[2];
+  diskReq = h.disk[3];
+  diskStatus = h.disk[4];
+  diskLatency = h.disk[5];
+  diskBlockLatency = h.disk[6];
+  diskIntrEnabled = h.diskIntrEnabled;
+  if (h.diskName[0] != '\0') {
+    if (!DiskOpenName (h.diskName)) {
+      fprintf (stderr, "Snapshot: can't reopen disk %s\n", h.diskName);
+      return (0);
+    }
+    // The request in progress was lost with the old process.
+    if (diskStatus == DLX_DMADISK_BUSY) {
+      DiskStart ((unsigned char *)memory);
+    }
+  }
+
+  for (i = 0; i < DLX_MAX_FILES; i++) {
+    if (h.files[i].mode == 0) {
+      continue;
+    }
+    // Reopening for writing mustn't truncate what was written so far.
+    fp[i] = fopen (h.files[i].name,
+		   snapModes[(h.files[i].mode == 2) ? 3 : h.files[i].mode]);
+    if (fp[i] == NULL) {
+      fprintf (stderr, "Snapshot: can't reopen %s\n", h.files[i].name);
+      return (0);
+    }
+    fseek (fp[i], h.files[i].pos, SEEK_SET);
+    hostFileMode[i] = h.files[i].mode;
+    strcpy (hostFileName[i], h.files[i].name);
   }
-  DBPRINTF ('F', "Closing file %d.\n", fd);
-  fp[fd] = NULL;
-  SetResult (retval);
+  printf ("Resumed from snapshot at %.0lf instructions, PC=0x%x.\n",
+	  instrsExecuted, h.pc);
+  return (memSize);
 }
-
+
 //----------------------------------------------------------------------
 //
-//	Cpu::Random
+//	Cpu::ResumeArgs
 //
-//	Return a random number using the underlying random() function
-//	call.
+//	Called as:
+//	resumeargs (char *buf, int size)
+//	Copies the DLXSIM_RESUME_ARGS environment variable (arguments
+//	for a run resumed from a snapshot) to buf, truncated to size
+//	bytes including the terminating null.  Returns its length, or
+//	-1 if it isn't set.
 //
 //----------------------------------------------------------------------
 void
-Cpu::Random ()
+Cpu::ResumeArgs ()
 {
+  uint32	buf = GetParam (0);
+  int		size = GetParam (1);
+  const char	*args = getenv ("DLXSIM_RESUME_ARGS");
   int		n;
 
-  n = random ();
-  SetResult (n);
+  if (args == NULL) {
+    SetResult (0xffffffff);
+    return;
+  }
+  if ((size <= 0) || !CheckAddr (buf) || ((uint32)size > memSize - buf)) {
+    SetResult (0xffffffff);
+    return;
+  }
+  n = strlen (args);
+  if (n >= size) {
+    n = size - 1;
+  }
+  memcpy ((char *)memory + buf, args, n);
+  ((char *)memory)[buf + n] = '\0';
+  DecodeCacheInvalidateRange (buf, n + 1);
+  TlbFlush ();
+  BlockNoteWriteRange (buf, n + 1);
+  SetResult (strlen (args));
 }
 
 //----------------------------------------------------------------------
 //
-//	Cpu::Srandom
+//	Hot blocks
 //
-//	Set the random number generator to the number passed.
+//	Once a block has run DLX_HOT_THRESHOLD times, each of its
+//	instructions is translated into a DlxHotOp, keyed off the handler
+//	the decoder picked.  The common integer instructions (ALU, set,
+//	lw and sw) then run from a switch on pre-extracted operands
+//	instead of a call through the handler that re-decodes the word.
+//	Anything else, and anything that could raise an exception, keeps
+//	DLX_HOT_CALL and goes through its handler as before.
+//
+//	lw and sw translate inline when the address is untranslated or
+//	the page is in the TLB with its referenced (and dirty) bits
+//	already set, so nothing about the PTE would change; otherwise,
+//	and for I/O addresses, they fall back to the handler, which does
+//	the full VaddrToPaddr and raises any exception.  Hot ops live in
+//	the block, so a write to the code invalidates them with it.
 //
 //----------------------------------------------------------------------
+#define	DLX_HOT_THRESHOLD	16
+
+#define	DLX_HOT_CALL	0	// use the handler
+#define	DLX_HOT_ADDU	1
+#define	DLX_HOT_SUBU	2
+#define	DLX_HOT_AND	3
+#define	DLX_HOT_OR	4
+#define	DLX_HOT_XOR	5
+#define	DLX_HOT_SLL	6
+#define	DLX_HOT_SRL	7
+#define	DLX_HOT_SRA	8
+#define	DLX_HOT_SEQ	9
+#define	DLX_HOT_SNE	10
+#define	DLX_HOT_SLT	11
+#define	DLX_HOT_SGT	12
+#define	DLX_HOT_SLE	13
+#define	DLX_HOT_SGE	14
+#define	DLX_HOT_ADDUI	15	// rs1 op imm, imm already extended
+#define	DLX_HOT_SUBUI	16
+#define	DLX_HOT_ANDI	17
+#define	DLX_HOT_ORI	18
+#define	DLX_HOT_XORI	19
+#define	DLX_HOT_SLLI	20
+#define	DLX_HOT_SRLI	21
+#define	DLX_HOT_SRAI	22
+#define	DLX_HOT_SEQI	23
+#define	DLX_HOT_SNEI	24
+#define	DLX_HOT_SLTI	25
+#define	DLX_HOT_SGTI	26
+#define	DLX_HOT_SLEI	27
+#define	DLX_HOT_SGEI	28
+#define	DLX_HOT_LHI	29
+#define	DLX_HOT_LW	30	// imm is the raw offset
+#define	DLX_HOT_SW	31
+#define	DLX_HOT_NOP	32
+
+typedef struct DlxHotMap {
+  DecodedHandler	handler;
+  unsigned char		kind;
+  unsigned char		rfmt;	// R-format (else I-format)
+  unsigned char		sext;	// sign extend the immediate
+} DlxHotMap;
+
+static const DlxHotMap	hotMap[] = {
+  {InstAddu, DLX_HOT_ADDU, 1, 0},	{InstSubu, DLX_HOT_SUBU, 1, 0},
+  {InstAnd, DLX_HOT_AND, 1, 0},		{InstOr, DLX_HOT_OR, 1, 0},
+  {InstXor, DLX_HOT_XOR, 1, 0},		{InstSll, DLX_HOT_SLL, 1, 0},
+  {InstSrl, DLX_HOT_SRL, 1, 0},		{InstSra, DLX_HOT_SRA, 1, 0},
+  {InstSeq, DLX_HOT_SEQ, 1, 0},		{InstSne, DLX_HOT_SNE, 1, 0},
+  {InstSlt, DLX_HOT_SLT, 1, 0},		{InstSgt, DLX_HOT_SGT, 1, 0},
+  {InstSle, DLX_HOT_SLE, 1, 0},		{InstSge, DLX_HOT_SGE, 1, 0},
+  {InstAddui, DLX_HOT_ADDUI, 0, 0},	{InstSubui, DLX_HOT_SUBUI, 0, 0},
+  {InstAndi, DLX_HOT_ANDI, 0, 0},	{InstOri, DLX_HOT_ORI, 0, 0},
+  {InstXori, DLX_HOT_XORI, 0, 0},	{InstSlli, DLX_HOT_SLLI, 0, 0},
+  {InstSrli, DLX_HOT_SRLI, 0, 0},	{InstSrai, DLX_HOT_SRAI, 0, 0},
+  {InstSeqi, DLX_HOT_SEQI, 0, 1},	{InstSnei, DLX_HOT_SNEI, 0, 1},
+  {InstSlti, DLX_HOT_SLTI, 0, 1},	{InstSgti, DLX_HOT_SGTI, 0, 1},
+  {InstSlei, DLX_HOT_SLEI, 0, 1},	{InstSgei, DLX_HOT_SGEI, 0, 1},
+  {InstLhi, DLX_HOT_LHI, 0, 0},		{InstLw, DLX_HOT_LW, 0, 0},
+  {InstSw, DLX_HOT_SW, 0, 0},		{InstNop, DLX_HOT_NOP, 0, 0},
+};
+#define	DLX_HOT_NMAP	((int)(sizeof (hotMap) / sizeof (hotMap[0])))
+
+static
 void
-Cpu::Srandom ()
+HotTranslate (DlxBlock *b)
 {
-  uint32	seed;
-
-  seed = GetParam (0);
-  srandom (seed);
-  SetResult (0);
+  DlxHotOp	*op;
+  uint32	inst;
+  int		i, j;
+
+  for (i = 0; i < b->ninstrs; i++) {
+    op = &b->hotOp[i];
+    inst = b->inst[i];
+    op->kind = DLX_HOT_CALL;
+    for (j = 0; j < DLX_HOT_NMAP; j++) {
+      if (hotMap[j].handler == b->handler[i]) {
+	break;
+      }
+    }
+    if (j == DLX_HOT_NMAP) {
+      continue;
+    }
+    op->kind = hotMap[j].kind;
+    if (hotMap[j].rfmt) {
+      op->rs1 = (inst >> DLX_RFMT_SRC1_SHIFT) & DLX_REG_MASK;
+      op->rs2 = (inst >> DLX_RFMT_SRC2_SHIFT) & DLX_REG_MASK;
+      op->rd = (inst >> DLX_RFMT_DST_SHIFT) & DLX_REG_MASK;
+      op->imm = 0;
+    } else {
+      op->rs1 = (inst >> DLX_IFMT_SRC_SHIFT) & DLX_REG_MASK;
+      op->rd = (inst >> DLX_IFMT_DST_SHIFT) & DLX_REG_MASK;
+      op->rs2 = 0;
+      op->imm = (inst >> DLX_IFMT_IMM_SHIFT) & 0xffff;
+      if (hotMap[j].sext && (op->imm & 0x8000)) {
+	op->imm |= 0xffff0000;
+      }
+      if ((op->kind == DLX_HOT_SLLI) || (op->kind == DLX_HOT_SRLI) ||
+	  (op->kind == DLX_HOT_SRAI)) {
+	op->imm &= 0x1f;
+      } else if (op->kind == DLX_HOT_LHI) {
+	op->imm <<= 16;
+      }
+    }
+  }
+  b->hot = 1;
 }
-
+
 //----------------------------------------------------------------------
 //
-//	Cpu::GetParam
+//	HotXlate
 //
-//	Parameters are stored on the stack (r29), with the first parameter
-//	stored at [r29].  Other parameters are stored at [r29+4], [r29+8],
-//	etc.  Parameters are passed on word boundaries.
+//	The inline part of VaddrToPaddr for hot loads and stores.  Returns
+//	1 with paddr set if the access can go straight to memory without
+//	any side effects on the page table; 0 means use the slow path.
 //
 //----------------------------------------------------------------------
-uint32
-Cpu::GetParam (int p)
+static
+inline
+int
+HotXlate (Cpu *cpu, uint32 vaddr, uint32 &paddr, int write)
 {
-  uint32	stackPtr;
+  uint32	base, l2bits, pagemask, need;
+  TlbEntry	*te;
 
-  stackPtr = GetIreg (29);
-  return (Memory(stackPtr + (p << 2)));
+  if (vaddr & 0x3) {
+    return (0);
+  }
+  switch (XlateMode (cpu->GetSreg (DLX_SREG_STATUS),
+		     write ? DLX_MEM_WRITE : DLX_MEM_READ)) {
+  case DLX_XLATE_TLB:
+    return (0);
+  case DLX_XLATE_PHYS:
+  case DLX_XLATE_SYS:
+    paddr = vaddr;
+    return (cpu->CheckAddr (paddr));
+  }
+  base = cpu->GetSreg (DLX_SREG_PGTBL_BASE);
+  l2bits = (cpu->GetSreg (DLX_SREG_PGTBL_BITS) >> 16) & 0xffff;
+  pagemask = (1 << l2bits) - 1;
+  te = TlbSlot (base, vaddr >> l2bits);
+  if ((te->vpage != (vaddr & ~pagemask)) || (te->base != base)) {
+    return (0);
+  }
+#if USE_ROP
+  if (write && (te->pte & DLX_PTE_RW)) {
+    return (0);
+  }
+  need = write ? (DLX_PTE_DIRTY | DLX_ROP_PTE_REFERENCED) : DLX_ROP_PTE_REFERENCED;
+#else
+  need = write ? (DLX_PTE_DIRTY | DLX_PTE_REFERENCED) : DLX_PTE_REFERENCED;
+#endif
+  if ((te->pte & need) != need) {
+    return (0);
+  }
+  tlbHits += 1.0;
+  paddr = (te->pte & ~(pagemask | DLX_PTE_MASK)) | (vaddr & pagemask);
+  return (cpu->CheckAddr (paddr));
 }
 
 //----------------------------------------------------------------------
 //
-//	Cpu::SetResult
+//	HotExec
 //
-//	Results are stored in register 1.
+//	Run one hot op.  Returns what the instruction's handler would.
 //
 //----------------------------------------------------------------------
-void
-Cpu::SetResult (uint32 r)
+static
+inline
+int
+HotExec (Cpu *cpu, const DlxHotOp *op, uint32 inst, DecodedHandler handler)
 {
-  PutIreg (1, r);
+  uint32	a, b, paddr;
+
+  a = cpu->GetIreg (op->rs1);
+  b = cpu->GetIreg (op->rs2);
+  switch (op->kind) {
+  case DLX_HOT_ADDU:	cpu->PutIreg (op->rd, a + b); break;
+  case DLX_HOT_SUBU:	cpu->PutIreg (op->rd, a - b); break;
+  case DLX_HOT_AND:	cpu->PutIreg (op->rd, a & b); break;
+  case DLX_HOT_OR:	cpu->PutIreg (op->rd, a | b); break;
+  case DLX_HOT_XOR:	cpu->PutIreg (op->rd, a ^ b); break;
+  case DLX_HOT_SLL:	cpu->PutIreg (op->rd, a << (b & 0x1f)); break;
+  case DLX_HOT_SRL:	cpu->PutIreg (op->rd, a >> (b & 0x1f)); break;
+  case DLX_HOT_SRA:	cpu->PutIreg (op->rd, (int)a >> (b & 0x1f)); break;
+  case DLX_HOT_SEQ:	cpu->PutIreg (op->rd, a == b); break;
+  case DLX_HOT_SNE:	cpu->PutIreg (op->rd, a != b); break;
+  case DLX_HOT_SLT:	cpu->PutIreg (op->rd, (int)a < (int)b); break;
+  case DLX_HOT_SGT:	cpu->PutIreg (op->rd, (int)a > (int)b); break;
+  case DLX_HOT_SLE:	cpu->PutIreg (op->rd, (int)a <= (int)b); break;
+  case DLX_HOT_SGE:	cpu->PutIreg (op->rd, (int)a >= (int)b); break;
+  case DLX_HOT_ADDUI:	cpu->PutIreg (op->rd, a + op->imm); break;
+  case DLX_HOT_SUBUI:	cpu->PutIreg (op->rd, a - op->imm); break;
+  case DLX_HOT_ANDI:	cpu->PutIreg (op->rd, a & op->imm); break;
+  case DLX_HOT_ORI:	cpu->PutIreg (op->rd, a | op->imm); break;
+  case DLX_HOT_XORI:	cpu->PutIreg (op->rd, a ^ op->imm); break;
+  case DLX_HOT_SLLI:	cpu->PutIreg (op->rd, a << op->imm); break;
+  case DLX_HOT_SRLI:	cpu->PutIreg (op->rd, a >> op->imm); break;
+  case DLX_HOT_SRAI:	cpu->PutIreg (op->rd, (int)a >> op->imm); break;
+  case DLX_HOT_SEQI:	cpu->PutIreg (op->rd, a == op->imm); break;
+  case DLX_HOT_SNEI:	cpu->PutIreg (op->rd, a != op->imm); break;
+  case DLX_HOT_SLTI:	cpu->PutIreg (op->rd, (int)a < (int)op->imm); break;
+  case DLX_HOT_SGTI:	cpu->PutIreg (op->rd, (int)a > (int)op->imm); break;
+  case DLX_HOT_SLEI:	cpu->PutIreg (op->rd, (int)a <= (int)op->imm); break;
+  case DLX_HOT_SGEI:	cpu->PutIreg (op->rd, (int)a >= (int)op->imm); break;
+  case DLX_HOT_LHI:	cpu->PutIreg (op->rd, op->imm); break;
+  case DLX_HOT_NOP:	break;
+  case DLX_HOT_LW:
+    if (!HotXlate (cpu, cpu->EffectiveAddress (op->rs1, op->imm), paddr, 0)) {
+      return (handler (inst, cpu));
+    }
+    PerfCount (DLX_PERF_LOADS);
+    cpu->PutIreg (op->rd, cpu->Memory (paddr));
+    break;
+  case DLX_HOT_SW:
+    if (!HotXlate (cpu, cpu->EffectiveAddress (op->rs1, op->imm), paddr, 1)) {
+      return (handler (inst, cpu));
+    }
+    cpu->SetMemory (paddr, cpu->GetIreg (op->rd));
+    PerfCount (DLX_PERF_STORES);
+    AtomicNoteWrite (paddr);
+    DecodeCacheInvalidate (paddr);
+    TlbNoteWrite (paddr);
+    BlockNoteWrite (paddr);
+    break;
+  default:
+    return (handler (inst, cpu));
+  }
+  return (1);
 }
-
+
 //----------------------------------------------------------------------
 //
-//	Cpu::Printf
-//
-//	This is the actual printf routine because we have to handle strings
-//	differently because of the pointers involved.  Everything else works
-//	as would be expected.
+//	Cpu::ExecBlocks
 //
-//	IMPORTANT: floating point numbers aren't supported.
+//	Run cached blocks starting with the instruction at physical
+//	address paddr, which ExecOne has already counted, fetched and
+//	translated.  Keeps going from block to block until an event is
+//	due, an instruction fails or raises an exception, or the next
+//	instruction isn't in ordinary memory.  Returns the number of
+//	instructions executed.
 //
-//	IMPORTANT: all pointers must be passed as addresses in physical
-//	simulated memory, not as virtual addresses.  This basically means
-//	that you don't want to call printf from user level because the
-//	format string itself is in user space.  Of course, you can always
-//	copy it into kernel space, but it's harder to copy the other string
-//	arguments.
+//	The state between instructions is exactly what ExecOne would
+//	leave, so stopping anywhere is safe: the next call to ExecOne
+//	simply picks up at PC.
 //
 //----------------------------------------------------------------------
-void
-Cpu::Printf ()
+int
+Cpu::ExecBlocks (uint32 paddr)
 {
-  uint32	fmtaddr;
-  char	*c;
-  uint32	args[10];
-  int		nargs = 0;
+  DlxBlock	*b, *next;
+  uint32	vstart, a;
+  int		i, n = 0;
 
-  fmtaddr = GetParam(0);
-  // 
-  for (c = fmtaddr + (char *)memory; *c != '\0'; c++) {
-    if (*c == '%') {
-      // if this is a %%, skip past second %
-      if (*(c+1) == '%') {
-	c++;
-	continue;
-      }
-      // Get the current argument off the stack
-      args[nargs] = GetParam(nargs+1);
-      DBPRINTF ('p', "Argument %d at 0x%x is %d (0x%x).\n", nargs,
-		args[nargs], args[nargs]);
-      while (1) {
-	c++;
-	if (*c == 's') {
-	  // If it's a string, the address is relative to the
-	  // start of emulated memory.
-	  args[nargs] += (uint32)memory;
-	  break;
-	} else if (*c == 'l') {
-	  continue;
-	} else if ((*c == 'f') || (*c == 'g') || (*c == 'e')) {
-	  // If it's a floating point number, it'll be passed as
-	  // a double, so grab the second word also.
-	  nargs += 1;
-	  args[nargs] = GetParam(nargs+1);
-	  break;
-	} else if ((*c >= 'a') && (*c <= 'z')) {
-	  // If it's another formatting character, it's not
-	  // a string, but we can leave the loop anyway.
+  vstart = PC() - 4;
+  b = BlockSlot (paddr);
+  while (1) {
+    if (!BlockValid (b, paddr)) {
+      BlockStart (b, paddr, memSize);
+      for (a = paddr; a < memSize; a += 4) {
+	b->inst[b->ninstrs] = Memory (a);
+	b->handler[b->ninstrs] = DecodeHandler (b->inst[b->ninstrs], rrrInstrs,
+						fpInstrs, regInstrs);
+	b->ninstrs += 1;
+	if (BlockEndsWith (b->inst[b->ninstrs-1]) ||
+	    (b->ninstrs == DLX_BLOCK_MAX_INSTRS) ||
+	    (((a + 4) & (DLX_BLOCK_REGION_SIZE - 1)) == 0)) {
 	  break;
 	}
       }
-      nargs += 1;
     }
+    if (!b->hot && (++b->runs >= DLX_HOT_THRESHOLD) &&
+	(dlxTier >= DLX_TIER_HOT)) {
+      HotTranslate (b);
+    }
+    // The first instruction has been counted and PC advanced past it
+    // by the caller (or by the chaining code below).
+    for (i = 0; ; i++) {
+      if (b->hot ? (HotExec (this, &b->hotOp[i], b->inst[i],
+			     b->handler[i]) == 0) :
+	  ((b->handler[i])(b->inst[i], this) == 0)) {
+	return (n);
+      }
+      n += 1;
+      if (PC() != vstart + 4 * (i + 1)) {
+	// Jump, branch taken, or exception
+	break;
+      }
+      if (i + 1 == b->ninstrs) {
+	break;
+      }
+      if (dlxCycle + 1 >= eventNext) {
+	return (n);
+      }
+      dlxCycle++;
+      SetPC (PC() + 4);
+    }
+    // Chain to the block at the new PC, which needs the same bookkeeping
+    // ExecOne does before an instruction.
+    if (dlxCycle + 1 >= eventNext) {
+      return (n);
+    }
+    dlxCycle++;
+    vstart = PC();
+    SetPC (PC() + 4);
+    if (!VaddrToPaddrWith<DlxFastPolicy> (vstart, paddr, DLX_MEM_INSTR,
+					  DLX_FETCH_PTEFLAGS)) {
+      return (n);
+    }
+    if (paddr >= memSize) {
+      // Leave I/O space fetches to ExecOne.
+      SetPC (vstart);
+      dlxCycle--;
+      return (n);
+    }
+    if ((b->chain != NULL) && (b->chainVaddr == vstart) &&
+	BlockValid (b->chain, paddr)) {
+      next = b->chain;
+    } else {
+      next = BlockSlot (paddr);
+      b->chain = next;
+      b->chainVaddr = vstart;
+    }
+    b = next;
   }
-  printf (fmtaddr + (char *)memory,
-	  args[0], args[1], args[2], args[3],
-	  args[4], args[5], args[6], args[7]);
-  fflush (stdout);
 }
-
-//----------------------------------------------------------------------
-//
-//	Cpu::Exit
-//
-//	Exit the CPU altogether.  Before doing so, print statistics on
-//	instructions executed and time taken.
-//
-//----------------------------------------------------------------------
-void
-Cpu::Exit ()
-{
-  struct timeval	t;
 
-  printf ("Exiting at program request.\n");
-  printf ("Instructions executed: %.0lf\n", instrsExecuted);
-  printf ("Time simulated: %.03lf secs\n", usElapsed / 1e6);
-  //Zheng add timezone*
-  //gettimeofday (&t, (timezone*)(void *)0);
-  gettimeofday (&t, (void *)0);
-  realElapsed = ((double)t.tv_sec + ((double)t.tv_usec)*1e-6) - realElapsed;
-  printf ("Real time elapsed: %.03lf secs\n", realElapsed);
-  printf ("Execution rate: %.2lfM simulated instructions per real second.\n",
-	  instrsExecuted * 1e-6 / realElapsed);
-  exit (0);
-}
-
 //----------------------------------------------------------------------
 //
 //	Cpu::ExecOne
 //
-//	Execute a single CPU instruction in the simulator.
+//	Execute a single CPU instruction in the simulator.  ExecOneWith
+//	does the work; see "Interpreter policies" above for why there
+//	are two of them.
 //
 //----------------------------------------------------------------------
+template <class Policy>
+inline
 int
-Cpu::ExecOne ()
+Cpu::ExecOneWith ()
 {
   uint32	curInst;
-  uint32	tmpPc;
+  uint32	paddr;
   uint32	curOp;
   uint32	retval;
-  uint32	funcCode;		// subcode for RRR & FP ops
+  DecodedInst	*dc;
+  DecodedHandler handler;
 
-  usElapsed += usPerInst;
-  instrsExecuted += 1.0;
+  dlxCycle++;
+  if (Policy::instrumented) {
+    // Debug output prints the time, so keep it exact.
+    DLX_SYNC_TIME ();
+  }
   // Increment PC before checking for interrupts because CauseException
   // will subtract 4 off the PC before placing the value into the IAR.
   // By incrementing here, we ensure that the current instruction is
   // the one whose address goes into the IAR.
   SetPC (PC() + 4);
-  // Check for an input character.  If we got one and interrupts are
-  // enabled, do an interrupt.
-  if (kbdcounter++ > DLX_KBD_FREQUENCY) {
-    kbdcounter = 0;
-    if (GetCharIfAvail () && (IntrLevel () < 8)) {
-      DBPRINTF ('t',"Keyboard interrupt at PC=0x%x, t=%.0fus\n",
-		PC()-4, usElapsed);
-      CauseException (DLX_EXC_KBD);
-      return (0);
+  if (dlxCycle >= eventNext) {
+    DLX_SYNC_TIME ();
+    if (EventDue (DLX_EVENT_PROFILE)) {
+      ProfileSample (PC()-4, UserMode () ? 1 : 0,
+		     GetSreg (DLX_SREG_PGTBL_BASE));
+      EventSchedule (DLX_EVENT_PROFILE, dlxCycle + profInterval);
     }
-  }
-  if (IntrLevel() < 8) {
-    if (timerInterrupt < usElapsed) {
-      DBPRINTF ('t', "Timer interrupt at PC=0x%x, t=%.0fus, intr@%.0fus\n",
-		PC()-4, usElapsed, timerInterrupt);
+    if (EventDue (DLX_EVENT_CONSOLE)) {
+      ConsFlush ();
+    }
+    if (EventDue (DLX_EVENT_SMP)) {
+      // Finish this instruction; ExecOne switches cores after it.
+      EventCancel (DLX_EVENT_SMP);
+      smpSwitchDue = 1;
+    }
+    // Check for an input character.  If we got one and interrupts are
+    // enabled, do an interrupt.
+    if (EventDue (DLX_EVENT_KBD)) {
+      EventSchedule (DLX_EVENT_KBD, dlxCycle + DLX_KBD_FREQUENCY + 2);
+      if (KbdPoll () && (IntrLevel () < 8)) {
+	PDBPRINTF ('t',"Keyboard interrupt at PC=0x%x, t=%.0fus\n",
+		   PC()-4, usElapsed);
+	CauseException (DLX_EXC_KBD);
+	return (0);
+      }
+    }
+    if (EventDue (DLX_EVENT_DISK)) {
+      if (diskStatus == DLX_DMADISK_BUSY) {
+	DiskTransfer ((unsigned char *)memory);
+      }
+      if (!diskIntrEnabled) {
+	EventCancel (DLX_EVENT_DISK);
+      } else if (IntrLevel () < 8) {
+	PDBPRINTF ('t', "Disk interrupt at PC=0x%x, t=%.0fus\n",
+		   PC()-4, usElapsed);
+	EventCancel (DLX_EVENT_DISK);
+	CauseException (DLX_DMADISK_EXC);
+	return (0);
+      }
+    }
+    if (EventDue (DLX_EVENT_TIMER) && (IntrLevel() < 8)) {
+      PDBPRINTF ('t', "Timer interrupt at PC=0x%x, t=%.0fus, intr@%.0fus\n",
+		 PC()-4, usElapsed, timerInterrupt);
       timerInterrupt = DLX_TIMER_NOT_ACTIVE;
+      EventCancel (DLX_EVENT_TIMER);
       CauseException (DLX_EXC_TIMER);
       return (0);
     }
+    if (EventDue (DLX_EVENT_IPI) && (IntrLevel() < 8)) {
+      PDBPRINTF ('t', "IPI on cpu %d at PC=0x%x, t=%.0fus\n", smpCur,
+		 PC()-4, usElapsed);
+      EventCancel (DLX_EVENT_IPI);
+      CauseException (DLX_SMP_IPI_EXC);
+      return (0);
+    }
+  }
+  // Instruction fetch.  Translate first, then look the physical address
+  // up in the decode cache; only a miss has to read and decode the word.
+  if (!VaddrToPaddrWith<Policy> (PC()-4, paddr, DLX_MEM_INSTR,
+				 DLX_FETCH_PTEFLAGS)) {
+    PDBPRINTF ('I', "Instruction fetch at 0x%x failed!\n", PC()-4);
+    return (0);
+  }
+  if (!Policy::instrumented && (paddr < memSize)) {
+    return (ExecBlocks (paddr));
+  }
+  if (Policy::instrumented && (paddr < memSize)) {
+    if (cacheOn) {
+      CacheAccess (&icache, paddr);
+    }
+    if (heatOn) {
+      HeatCount (DLX_HEAT_FETCH, paddr);
+    }
   }
-  if (! ReadWord (PC()-4, curInst, DLX_MEM_INSTR)) {
-    DBPRINTF ('I', "Instruction fetch at 0x%x failed!\n", PC()-4);
+  dc = NULL;
+  if ((paddr <= memSize) && (!Policy::instrumented ||
+			     (dlxTier >= DLX_TIER_DECODE))) {
+    dc = DecodeCacheSlot (paddr);
+    if (dc->paddr == paddr) {
+      decodeCacheHits += 1.0;
+      PDBPRINTF ('I', "Instr %06d: %08x : %08x (cached)\n",
+		(int)(dlxCycle % 1000000), dc->inst, PC() - 4);
+      if (Policy::instrumented && costOn) {
+	CostInstr (dc->inst);
+      }
+      return ((dc->handler)(dc->inst, this));
+    }
+    decodeCacheMisses += 1.0;
+    curInst = Memory (paddr);
+  } else if (! ReadWord (PC()-4, curInst, DLX_MEM_INSTR)) {
+    PDBPRINTF ('I', "Instruction fetch at 0x%x failed!\n", PC()-4);
     return (0);
   }
   curOp = (curInst >> DLX_OPCODE_SHIFT) & DLX_OPCODE_MASK;
-  DBPRINTF ('I', "Instr %06d: %08x : %08x (main=%02x, aux=%02x)\n",
-	    (int)instrsExecuted % 1000000,
+  PDBPRINTF ('I', "Instr %06d: %08x : %08x (main=%02x, aux=%02x)\n",
+	    (int)(dlxCycle % 1000000),
 	    curInst, PC() - 4, curOp,
 	    (curInst >> DLX_ALU_FUNC_CODE_SHIFT) & DLX_ALU_FUNC_CODE_MASK);
-  switch (curOp) {
-  case 0x00:		// ALU and other R-R operations
-    funcCode = ((curInst >> DLX_ALU_FUNC_CODE_SHIFT) &
-		DLX_ALU_FUNC_CODE_MASK);
-    retval = (rrrInstrs[funcCode].handler)(curInst, this);
-    break;
-  case 0x01:		// FP operations
-    funcCode = ((curInst >> DLX_FPU_FUNC_CODE_SHIFT) &
-		DLX_FPU_FUNC_CODE_MASK);
-    retval = (fpInstrs[funcCode].handler)(curInst, this);
-    break;
-  default:
-    retval = (regInstrs[curOp].handler)(curInst, this);
-    break;
+  handler = DecodeHandler (curInst, rrrInstrs, fpInstrs, regInstrs);
+  if (dc != NULL) {
+    dc->paddr = paddr;
+    dc->inst = curInst;
+    dc->handler = handler;
   }
+  if (Policy::instrumented && costOn) {
+    CostInstr (curInst);
+  }
+  retval = handler (curInst, this);
   return (retval);
 }
+
+int
+Cpu::ExecOne ()
+{
+  Cpu		*cpu = this;
+  const char	*tier;
+  int		r;
+
+  if (dlxExecMode == DLX_EXEC_UNDECIDED) {
+    if ((tier = getenv ("DLXSIM_TIER")) != NULL) {
+      for (r = DLX_TIER_PLAIN; r <= DLX_TIER_HOT; r++) {
+	if (strcmp (tier, dlxTierNames[r]) == 0) {
+	  dlxTier = r;
+	  break;
+	}
+      }
+      if (r > DLX_TIER_HOT) {
+	fprintf (stderr, "Unknown DLXSIM_TIER \"%s\", using \"%s\"\n", tier,
+		 dlxTierNames[dlxTier]);
+      }
+    }
+    // First instruction: options have been parsed by now, so this is
+    // when we know whether anyone wants to see what's going on.
+    if ((dlxTier < DLX_TIER_BLOCK) || (debug[0] != '\0') || cacheOn ||
+	costOn || heatOn ||
+	(flags & (DLX_TRACE_INSTRUCTIONS | DLX_TRACE_MEMORY))) {
+      dlxExecMode = DLX_EXEC_INSTRUMENTED;
+    } else {
+      dlxExecMode = DLX_EXEC_FAST;
+    }
+    SmpInit ();
+  }
+  // The caller always runs the boot core; with SMP, run whichever
+  // core's turn it is.
+  if (smpNumCpus > 1) {
+    cpu = smpCpus[smpCur];
+  }
+  if (dlxExecMode == DLX_EXEC_FAST) {
+    r = cpu->ExecOneWith<DlxFastPolicy> ();
+  } else {
+    r = cpu->ExecOneWith<DlxTracePolicy> ();
+  }
+  if (smpSwitchDue) {
+    SmpSwitch ();
+  }
+  return (r);
+}
 
 //----------------------------------------------------------------------
 //
@@ -2611,6 +7058,51 @@ getxvalue (int x)
   }
 }
 
+//----------------------------------------------------------------------
+//
+//	LoadImageSegments
+//
+//	Load a binary image whose header has already been read into hdr.
+//	Each segment is read directly into simulated memory.  Returns the
+//	number of bytes loaded, or 0 if the image is malformed.
+//
+//----------------------------------------------------------------------
+static
+int
+LoadImageSegments (FILE *fp, const unsigned char *hdr, unsigned char *mem,
+		   uint32 memsize)
+{
+  unsigned char	seghdr[DLX_IMAGE_SEGHDR_SIZE];
+  uint32	nsegs, addr, len;
+  int		nread = 0;
+
+  if (DlxImageGetWord (hdr, DLX_IMAGE_VERSION_WORD) != DLX_IMAGE_VERSION) {
+    fprintf (stderr, "Unsupported DLX image version %d\n",
+	     DlxImageGetWord (hdr, DLX_IMAGE_VERSION_WORD));
+    return (0);
+  }
+  nsegs = DlxImageGetWord (hdr, DLX_IMAGE_NSEGS_WORD);
+  while (nsegs-- > 0) {
+    if (fread (seghdr, 1, sizeof (seghdr), fp) != sizeof (seghdr)) {
+      fprintf (stderr, "Truncated DLX image (segment header)\n");
+      return (nread);
+    }
+    addr = DlxImageGetWord (seghdr, 0);
+    len = DlxImageGetWord (seghdr, 1);
+    if ((addr > memsize) || (len > memsize - addr)) {
+      fprintf (stderr, "DLX image segment 0x%x+0x%x is outside memory\n",
+	       addr, len);
+      return (nread);
+    }
+    if (fread (mem + addr, 1, len, fp) != len) {
+      fprintf (stderr, "Truncated DLX image (segment at 0x%x)\n", addr);
+      return (nread);
+    }
+    nread += len;
+  }
+  return (nread);
+}
+
 int
 Cpu::LoadMemory (const char *file, uint32& startAt)
 {
@@ -2625,6 +7117,29 @@ Cpu::LoadMemory (const char *file, uint32& startAt)
   if ((fp = fopen (file, "r")) == NULL) {
     return (0);
   }
+  // A snapshot resumes the whole machine rather than loading a program.
+  if ((fread (&val, 1, sizeof (val), fp) == sizeof (val)) &&
+      (val == DLX_SNAP_MAGIC)) {
+    nread = RestoreSnapshot (fp, startAt);
+    fclose (fp);
+    return (nread);
+  }
+  rewind (fp);
+  // Binary images (see dlximage.h) start with a magic number; anything
+  // else is treated as the hex text format.
+  if ((fread (buffer, 1, DLX_IMAGE_HEADER_SIZE, fp) == DLX_IMAGE_HEADER_SIZE)
+      && (DlxImageGetWord ((unsigned char *)buffer, DLX_IMAGE_MAGIC_WORD) ==
+	  DLX_IMAGE_MAGIC)) {
+    startAt = DlxImageGetWord ((unsigned char *)buffer, DLX_IMAGE_START_WORD);
+    DecodeCacheFlush ();
+    BlockCacheFlush ();
+    TlbFlush ();
+    nread = LoadImageSegments (fp, (unsigned char *)buffer,
+			       (unsigned char *)memory, memSize);
+    fclose (fp);
+    return (nread);
+  }
+  rewind (fp);
   if (fgets (buffer, sizeof (buffer) - 1, fp) == NULL) {
     return (0);
   }
@@ -2634,6 +7149,10 @@ Cpu::LoadMemory (const char *file, uint32& startAt)
   }
   pos = index (buffer, ':') + 1;
   startAt = strtol (pos, NULL, 16);
+  // Whatever was decoded or translated before is about to be overwritten.
+  DecodeCacheFlush ();
+  BlockCacheFlush ();
+  TlbFlush ();
   while (1) {
     pos = buffer;
     if (fgets (buffer, sizeof (buffer) - 1, fp) == NULL) {
@@ -2678,7 +7197,12 @@ Cpu::LoadMemory (const char *file, uint32& startAt)
 void
 Cpu::SetTimer (uint32 usecs)
 {
+  DLX_SYNC_TIME ();
   timerInterrupt = usElapsed + (double)usecs;
+  // The interrupt is taken on the first instruction that ends after
+  // timerInterrupt.
+  EventSchedule (DLX_EVENT_TIMER,
+		 dlxCycle + (DlxCycle)((double)usecs / usPerInst) + 1);
 }
 
 //----------------------------------------------------------------------
@@ -2692,6 +7216,7 @@ uint32
 Cpu::Timerget()
 {
    unsigned int result;
+   DLX_SYNC_TIME ();
    result = (unsigned int)(usElapsed/1e3);
    SetResult (result);
 }
@@ -2743,6 +7268,23 @@ Cpu::OutputBasicBlockActual ()
   int		i, ninstrs;
 
   ninstrs = (PC() - basicBlockStart) >> 2;
+  if (traceBinary) {
+    if (flags & DLX_TRACE_INSTRUCTIONS) {
+      TraceBinRecord (DLX_TRACE_REC_BLOCK, 0, 0,
+		      basicBlockStart - tracePrevBlock, ninstrs);
+      tracePrevBlock = basicBlockStart;
+    }
+    if (flags & DLX_TRACE_MEMORY) {
+      for (i = 0; i < naccesses; i++) {
+	TraceBinRecord (DLX_TRACE_REC_MEM, TraceOpIndex (accesses[i].inst),
+			accesses[i].reg, accesses[i].addr - tracePrevAddr,
+			accesses[i].value);
+	tracePrevAddr = accesses[i].addr;
+      }
+    }
+    naccesses = 0;
+    return;
+  }
   // Print out the basic block information here
   if (flags & DLX_TRACE_INSTRUCTIONS) {
     fprintf (tracefp, "I %x %d\n", basicBlockStart, ninstrs);
@@ -0,0 +1,83 @@
+//
+//	dlxtrace.h
+//
+//	Definitions for the binary DLX trace format.  It carries exactly
+//	the information in the text trace ("I", memory access, "T", "R"
+//	and "X" lines) but as fixed size records, so the simulator can
+//	buffer them and write them out in large blocks.
+//
+//	A trace is a header of DLX_TRACE_HEADER_WORDS words:
+//
+//	word 0	DLX_TRACE_MAGIC
+//	word 1	DLX_TRACE_VERSION
+//	word 2	record size in bytes (DLX_TRACE_RECSIZE)
+//	word 3	reserved (0)
+//
+//	followed by records of DLX_TRACE_RECSIZE bytes:
+//
+//	byte 0	record type (one of the DLX_TRACE_REC_* characters)
+//	byte 1	memory records: access type (index into dlxTraceOps)
+//	byte 2	memory records: register number
+//	byte 3	reserved (0)
+//	word 1	first field
+//	word 2	second field
+//
+//	The fields are in the order they appear in the text trace.  For
+//	basic block ("I") records the first field is the start address
+//	minus that of the previous block, and for memory ("M") records
+//	it is the address minus that of the previous access; the decoder
+//	adds the deltas back up.  Everything else is stored as is.  All
+//	words are big-endian, as in dlximage.h.
+//
+//	A trace file whose name ends in ".gz" is piped through gzip.
+//
+
+#ifndef	_dlxtrace_h_
+#define	_dlxtrace_h_
+
+#define	DLX_TRACE_MAGIC		0x444c5854	// "DLXT"
+#define	DLX_TRACE_VERSION	1
+#define	DLX_TRACE_HEADER_WORDS	4
+#define	DLX_TRACE_HEADER_SIZE	(DLX_TRACE_HEADER_WORDS * 4)
+#define	DLX_TRACE_RECSIZE	12
+
+// File name suffix that selects the binary format
+#define	DLX_TRACE_BINARY_SUFFIX	".dtr"
+
+#define	DLX_TRACE_REC_BLOCK	'I'	// block start, instruction count
+#define	DLX_TRACE_REC_MEM	'M'	// address, value
+#define	DLX_TRACE_REC_TRAP	'T'	// trap vector, pc
+#define	DLX_TRACE_REC_RFE	'R'	// pc, return address
+#define	DLX_TRACE_REC_EXC	'X'	// cause, pc
+
+// Access types, in the names the text trace uses.  Index 0 is
+// reserved for names that aren't in the table.
+static const char	*dlxTraceOps[] = {
+  "??", "lw", "lh", "lhu", "lb", "lbu", "sw", "sh", "sb",
+  "lf", "ld0", "ld1", "sf", "sd0", "sd1",
+};
+#define	DLX_TRACE_NUM_OPS	((int)(sizeof (dlxTraceOps) / sizeof (dlxTraceOps[0])))
+
+static
+inline
+unsigned int
+DlxTraceGetWord (const unsigned char *p, int word)
+{
+  p += word * 4;
+  return (((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+	  ((unsigned int)p[2] << 8) | (unsigned int)p[3]);
+}
+
+static
+inline
+void
+DlxTracePutWord (unsigned char *p, int word, unsigned int v)
+{
+  p += word * 4;
+  p[0] = (v >> 24) & 0xff;
+  p[1] = (v >> 16) & 0xff;
+  p[2] = (v >> 8) & 0xff;
+  p[3] = v & 0xff;
+}
+
+#endif	// _dlxtrace_h_
@@ -0,0 +1,252 @@
+//
+//	dlxtracedump.cc
+//
+//	Decode a binary DLX trace (see dlxtrace.h).  By default the trace
+//	is printed in the simulator's text trace format, so existing
+//	scripts can read it.  With -s a summary is printed instead: the
+//	hottest basic blocks, accesses by type, the most accessed pages
+//	and counts of traps, rfes and exceptions by cause.
+//
+//	Usage: dlxtracedump [-s] [-n count] trace.dtr[.gz]
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "dlxtrace.h"
+
+#define	HASH_SIZE	(1 << 16)	// must be a power of 2
+#define	PAGE_SHIFT	12
+
+typedef struct Entry {
+  unsigned int	key;
+  unsigned int	count;
+  double	weight;		// instructions for blocks, 0 for pages
+  struct Entry	*next;
+} Entry;
+
+typedef struct Table {
+  Entry		*buckets[HASH_SIZE];
+  int		nentries;
+} Table;
+
+static Table	blocks;
+static Table	loadPages;
+static Table	storePages;
+static Table	excCauses;
+static double	opCounts[DLX_TRACE_NUM_OPS];
+static double	recCounts[256];
+
+//----------------------------------------------------------------------
+//
+//	TableAdd
+//
+//	Add one occurrence (with the given weight) of key to a table.
+//
+//----------------------------------------------------------------------
+static
+void
+TableAdd (Table *t, unsigned int key, double weight)
+{
+  unsigned int	h = (key * 2654435761u) & (HASH_SIZE - 1);
+  Entry		*e;
+
+  for (e = t->buckets[h]; e != NULL; e = e->next) {
+    if (e->key == key) {
+      e->count++;
+      e->weight += weight;
+      return;
+    }
+  }
+  e = (Entry *)malloc (sizeof (Entry));
+  if (e == NULL) {
+    fprintf (stderr, "Out of memory\n");
+    exit (1);
+  }
+  e->key = key;
+  e->count = 1;
+  e->weight = weight;
+  e->next = t->buckets[h];
+  t->buckets[h] = e;
+  t->nentries++;
+}
+
+static int	sortByWeight;
+
+static
+int
+EntryCompare (const void *a, const void *b)
+{
+  const Entry	*ea = *(const Entry **)a;
+  const Entry	*eb = *(const Entry **)b;
+  double	va = sortByWeight ? ea->weight : ea->count;
+  double	vb = sortByWeight ? eb->weight : eb->count;
+
+  if (va != vb) {
+    return ((va > vb) ? -1 : 1);
+  }
+  return ((ea->key < eb->key) ? -1 : (ea->key > eb->key));
+}
+
+//----------------------------------------------------------------------
+//
+//	TablePrint
+//
+//	Print the top n entries of a table, largest first.  Blocks are
+//	ranked by instructions executed, everything else by count.
+//
+//----------------------------------------------------------------------
+static
+void
+TablePrint (Table *t, const char *title, int n, int byWeight)
+{
+  Entry		**all, *e;
+  int		i, j;
+
+  printf ("%s (%d distinct):\n", title, t->nentries);
+  if (t->nentries == 0) {
+    return;
+  }
+  all = (Entry **)malloc (t->nentries * sizeof (Entry *));
+  for (i = j = 0; i < HASH_SIZE; i++) {
+    for (e = t->buckets[i]; e != NULL; e = e->next) {
+      all[j++] = e;
+    }
+  }
+  sortByWeight = byWeight;
+  qsort (all, t->nentries, sizeof (Entry *), EntryCompare);
+  for (i = 0; (i < n) && (i < t->nentries); i++) {
+    if (byWeight) {
+      printf ("  %08x %10u runs %12.0lf instrs\n", all[i]->key,
+	      all[i]->count, all[i]->weight);
+    } else {
+      printf ("  %08x %10u\n", all[i]->key, all[i]->count);
+    }
+  }
+  free (all);
+}
+
+int
+main (int argc, char *argv[])
+{
+  FILE		*in;
+  char		cmd[1024];
+  unsigned char	rec[DLX_TRACE_RECSIZE];
+  unsigned char	hdr[DLX_TRACE_HEADER_SIZE];
+  unsigned int	block = 0, addr = 0, a, b;
+  int		summary = 0, top = 20, piped = 0;
+  int		i, len, op;
+  double	instrs = 0.0;
+
+  for (i = 1; (i < argc) && (argv[i][0] == '-') && argv[i][1]; i++) {
+    if (!strcmp (argv[i], "-s")) {
+      summary = 1;
+    } else if (!strcmp (argv[i], "-n") && (i + 1 < argc)) {
+      top = atoi (argv[++i]);
+    } else {
+      break;
+    }
+  }
+  if (i != argc - 1) {
+    fprintf (stderr, "Usage: %s [-s] [-n count] trace%s[.gz]\n", argv[0],
+	     DLX_TRACE_BINARY_SUFFIX);
+    exit (1);
+  }
+  len = strlen (argv[i]);
+  if (!strcmp (argv[i], "-")) {
+    in = stdin;
+  } else if ((len > 3) && !strcmp (argv[i] + len - 3, ".gz")) {
+    if (len + 32 > (int)sizeof (cmd)) {
+      fprintf (stderr, "%s: name too long\n", argv[i]);
+      exit (1);
+    }
+    sprintf (cmd, "gzip -dc '%s'", argv[i]);
+    in = popen (cmd, "r");
+    piped = 1;
+  } else {
+    in = fopen (argv[i], "rb");
+  }
+  if (in == NULL) {
+    perror (argv[i]);
+    exit (1);
+  }
+  if ((fread (hdr, 1, sizeof (hdr), in) != sizeof (hdr)) ||
+      (DlxTraceGetWord (hdr, 0) != DLX_TRACE_MAGIC)) {
+    fprintf (stderr, "%s: not a binary DLX trace\n", argv[i]);
+    exit (1);
+  }
+  if ((DlxTraceGetWord (hdr, 1) != DLX_TRACE_VERSION) ||
+      (DlxTraceGetWord (hdr, 2) != DLX_TRACE_RECSIZE)) {
+    fprintf (stderr, "%s: unsupported trace version %d\n", argv[i],
+	     DlxTraceGetWord (hdr, 1));
+    exit (1);
+  }
+
+  while (fread (rec, 1, sizeof (rec), in) == sizeof (rec)) {
+    a = DlxTraceGetWord (rec, 1);
+    b = DlxTraceGetWord (rec, 2);
+    recCounts[rec[0]] += 1.0;
+    switch (rec[0]) {
+    case DLX_TRACE_REC_BLOCK:
+      block += a;
+      if (summary) {
+	TableAdd (&blocks, block, (double)b);
+	instrs += b;
+      } else {
+	printf ("I %x %d\n", block, b);
+      }
+      break;
+    case DLX_TRACE_REC_MEM:
+      addr += a;
+      op = (rec[1] < DLX_TRACE_NUM_OPS) ? rec[1] : 0;
+      if (summary) {
+	opCounts[op] += 1.0;
+	TableAdd ((dlxTraceOps[op][0] == 's') ? &storePages : &loadPages,
+		  addr >> PAGE_SHIFT << PAGE_SHIFT, 0.0);
+      } else {
+	printf ("%s r%d %x %x\n", dlxTraceOps[op], rec[2], addr, b);
+      }
+      break;
+    case DLX_TRACE_REC_EXC:
+      if (summary) {
+	TableAdd (&excCauses, a, 0.0);
+	break;
+      }
+      // fall through
+    case DLX_TRACE_REC_TRAP:
+    case DLX_TRACE_REC_RFE:
+      if (!summary) {
+	printf ("%c %x %x\n", rec[0], a, b);
+      }
+      break;
+    default:
+      fprintf (stderr, "Unknown trace record type 0x%x\n", rec[0]);
+      exit (1);
+    }
+  }
+  if (piped) {
+    pclose (in);
+  } else if (in != stdin) {
+    fclose (in);
+  }
+  if (!summary) {
+    return (0);
+  }
+
+  printf ("Basic blocks: %.0lf, instructions: %.0lf\n",
+	  recCounts[DLX_TRACE_REC_BLOCK], instrs);
+  printf ("Memory accesses: %.0lf\n", recCounts[DLX_TRACE_REC_MEM]);
+  for (i = 0; i < DLX_TRACE_NUM_OPS; i++) {
+    if (opCounts[i] > 0.0) {
+      printf ("  %-4s %12.0lf\n", dlxTraceOps[i], opCounts[i]);
+    }
+  }
+  printf ("Traps: %.0lf, rfes: %.0lf, exceptions: %.0lf\n",
+	  recCounts[DLX_TRACE_REC_TRAP], recCounts[DLX_TRACE_REC_RFE],
+	  recCounts[DLX_TRACE_REC_EXC]);
+  TablePrint (&blocks, "Hot blocks", top, 1);
+  TablePrint (&loadPages, "Pages by loads", top, 0);
+  TablePrint (&storePages, "Pages by stores", top, 0);
+  TablePrint (&excCauses, "Exceptions by cause", top, 0);
+  return (0);
+}
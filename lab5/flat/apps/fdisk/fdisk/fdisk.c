@@ -3,25 +3,52 @@
 #include "fdisk.h"
 
 dfs_superblock sb;
-dfs_inode inodes[FDISK_NUM_INODES];
-uint32 fbv[DFS_FBV_MAX_NUM_WORDS];
 
 int diskblocksize = 0; // These are global in order to speed things up
 int disksize = 0;      // (i.e. fewer traps to OS to get the same number)
 
-static int negativeone = 0xFFFFFFFF;
-static inline uint32 invert (uint32 n) {
-  return (n ^ negativeone);
+int FdiskWriteBlocks(uint32 blocknum, int count, char *data); // Writes count file system
+// blocks with one disk_write_blocks() trap
+
+// Metadata is built here FDISK_WRITE_BYTES at a time and written out
+// in one go
+char chunk[FDISK_WRITE_BYTES];
+
+// Fills in fbv block number i (counting from the first fbv block): the
+// bits for the data blocks are set, the metadata blocks' are clear.
+// Only the words on the edges of the data blocks need bit by bit work.
+void FdiskFillFBV(int i, dfs_block *b) {
+  uint32 *words = (uint32 *)b->data;
+  int n = sb.dfs_blocksize / 4;
+  int j, k, p;
+
+  for (j = 0; j < n; j++) {
+    p = ((i * n) + j) * 32;
+    if ((p >= sb.dfs_start_block_data) && (p + 32 <= sb.dfs_numblocks)) {
+      words[j] = 0xFFFFFFFF;
+      continue;
+    }
+    words[j] = 0;
+    if ((p + 32 <= sb.dfs_start_block_data) || (p >= sb.dfs_numblocks)) {
+      continue;
+    }
+    for (k = 0; k < 32; k++) {
+      if ((p + k >= sb.dfs_start_block_data) && (p + k < sb.dfs_numblocks)) {
+        words[j] |= (1 << k);
+      }
+    }
+  }
 }
 
-int FdiskWriteBlock(uint32 blocknum, dfs_block *b); //You can use your own function. This function 
-//calls disk_write_block() to write physical blocks to disk
-
-inline void SetFBV(int p, int b) {
-  uint32  wd = p / 32;
-  uint32  bitnum = p % 32;
-
-  fbv[wd] = (fbv[wd] & invert(1 << bitnum)) | (b << bitnum);
+// Fills in file system block i of the metadata (the first inode block
+// up to and including the journal header): inodes, the journal header and anything else
+// are zeros, fbv blocks are filled in.
+void FdiskFillMetadata(int i, dfs_block *b) {
+  if ((i >= sb.dfs_start_block_fbv) && (i < sb.dfs_start_block_journal)) {
+    FdiskFillFBV(i - sb.dfs_start_block_fbv, b);
+  } else {
+    bzero(b->data, sb.dfs_blocksize);
+  }
 }
 
 void main (int argc, char *argv[])
@@ -30,12 +57,18 @@ void main (int argc, char *argv[])
 	// You need to think of the finer details. You can use bzero() to zero out bytes in memory
 
   // Declarations:
-  int i;
+  int i, n, chunk_blocks;
+  int inode_blocks, fbv_blocks;
+  int blocksize = FDISK_FS_BLOCKSIZE;
   dfs_block new_block;
 
-  //argc
-  if (argc != 1) {
-    Printf("Error incorrect argument numbers.\n");
+  //argc: the block size is optional
+  if (argc > 2) {
+    Printf("Usage: fdisk [blocksize]\n");
+    return;
+  }
+  if (argc == 2) {
+    blocksize = dstrtol(argv[1], NULL, 10);
   }
 
   Printf("Beginning fdisk.c tests.\n");
@@ -46,15 +79,29 @@ void main (int argc, char *argv[])
 
   disksize = disk_size();
   diskblocksize = disk_blocksize();
+  if ((blocksize < diskblocksize) || (blocksize > DFS_MAX_BLOCKSIZE) || (blocksize % diskblocksize)) {
+    Printf("fdisk (%d): Block size %d isn't a multiple of %d up to %d.\n", getpid(), blocksize,
+           diskblocksize, DFS_MAX_BLOCKSIZE);
+    return;
+  }
 
   //dfs_invalidate();
   sb.valid = 0;
-  sb.dfs_blocksize = FDISK_FS_BLOCKSIZE;
-  sb.dfs_numblocks = FDISK_NUM_BLOCKS;
-  sb.dfs_start_block_inodes = FDISK_INODE_BLOCK_START;
-  sb.num_inodes = FDISK_NUM_INODES;
-  sb.dfs_start_block_fbv = FDISK_FBV_BLOCK_START;
-  sb.dfs_start_block_data = FDISK_FBV_BLOCK_START + (DFS_FBV_MAX_NUM_WORDS * 4) / DFS_BLOCKSIZE;
+  sb.dfs_blocksize = blocksize;
+  // Lay the file system out to fit the disk the OS booted with
+  sb.dfs_numblocks = disksize / blocksize;
+  sb.num_inodes = sb.dfs_numblocks / FDISK_BLOCKS_PER_INODE;
+  if (sb.num_inodes < DFS_NUM_INODES) {
+    sb.num_inodes = DFS_NUM_INODES;
+  }
+  inode_blocks = (sb.num_inodes * sizeof(dfs_inode) + blocksize - 1) / blocksize;
+  fbv_blocks = ((sb.dfs_numblocks + 31) / 32 * 4 + blocksize - 1) / blocksize;
+  sb.dfs_start_block_inodes = FDISK_INODE_BLOCK_START(blocksize);
+  sb.dfs_start_block_fbv = sb.dfs_start_block_inodes + inode_blocks;
+  sb.dfs_start_block_journal = sb.dfs_start_block_fbv + fbv_blocks;
+  sb.dfs_start_block_data = sb.dfs_start_block_journal + DFS_JOURNAL_BLOCKS;
+  sb.dfs_free_blocks = sb.dfs_numblocks - sb.dfs_start_block_data;
+  sb.dfs_inodes_used = 0;
 
   // Make sure the disk exists before doing anything else
   if (disk_create() == DISK_FAIL) {
@@ -70,56 +117,46 @@ void main (int argc, char *argv[])
   Printf("Sizeof inode: %d, inode_st: %d, inode_end: %d\n", sizeof(dfs_inode), sb.dfs_start_block_inodes, sb.dfs_start_block_fbv);
   Printf("Disk blocksize: %d FS blocksize: %d\n", diskblocksize, sb.dfs_blocksize);
 
-  //Write them in as 0
-  bzero(new_block.data, sb.dfs_blocksize);
-  for (i = sb.dfs_start_block_inodes; i < sb.dfs_start_block_fbv; i++) {
-    FdiskWriteBlock(i, &new_block);
-  }
-
-  //setup free block vector fbv
-  for (i = 0; i < DFS_FBV_MAX_NUM_WORDS; i++) {
-    fbv[i] = 0;
-  }
-  //free the data blocks
-  for (i = sb.dfs_start_block_data; i < sb.dfs_numblocks; i++) {
-    SetFBV(i, 1);
-  }
-
-  //Write fbv to disk (block number 17 and 18)
-  for (i = sb.dfs_start_block_fbv; i < sb.dfs_start_block_data; i++) {
-    //bzero(new_block.data, sb.dfs_blocksize);
-    bcopy( &(((char*)fbv)[(i - sb.dfs_start_block_fbv) * sb.dfs_blocksize]), new_block.data, sb.dfs_blocksize);
-    FdiskWriteBlock(i, &new_block);
+  // The inodes, fbv and journal header are consecutive, so they go out
+  // a chunk at a time.  Data blocks are never written: DFS doesn't
+  // read a block before it's been written, so a sparse image stays sparse.
+  chunk_blocks = FDISK_WRITE_BYTES / blocksize;
+  n = 0;
+  for (i = sb.dfs_start_block_inodes; i <= sb.dfs_start_block_journal; i++) {
+    FdiskFillMetadata(i, (dfs_block *)&chunk[n * sb.dfs_blocksize]);
+    n++;
+    if ((n == chunk_blocks) || (i == sb.dfs_start_block_journal)) {
+      if (FdiskWriteBlocks(i - n + 1, n, chunk) == DISK_FAIL) {
+        Printf("fdisk (%d): Unable to write blocks %d-%d.\n", getpid(), i - n + 1, i);
+        return;
+      }
+      n = 0;
+    }
   }
 
   //Set superblock as valid file system and write superblock and boot record to disk
   sb.valid = 1;
 
-  //write superblock to block 0 in disk
-  bzero(new_block.data, sb.dfs_blocksize);
-  //must go into second physical block, so second half of dfs block
+  //write boot record and superblock to the first two physical blocks
+  bzero(new_block.data, 2 * diskblocksize);
+  //must go into second physical block
   bcopy((char *)&sb, &(new_block.data[diskblocksize]), sizeof(sb));
-  FdiskWriteBlock(0, &new_block);
+  // Last, so the disk only says valid once everything else is there
+  if (disk_write_blocks(0, 2, new_block.data) == DISK_FAIL) {
+    Printf("fdisk (%d): Unable to write the superblock.\n", getpid());
+    return;
+  }
 
 
   Printf("fdisk (%d): Formatted DFS disk for %d bytes.\n", getpid(), disksize);
 }
 
-int FdiskWriteBlock(uint32 blocknum, dfs_block *b) {
-  // STUDENT: put your code here
-  //calls disk_write_block() to write physical blocks to disk
-  disk_block db;
-  int i, m;
-  m = sb.dfs_blocksize / diskblocksize;
-  Printf("Starting FdiskWriteBlock. blocknum=%d. m=%d\n", blocknum, m);
-  for (i = 0; i < m; i++) {
-    bcopy(&(b->data[i * diskblocksize]), db.data, diskblocksize);
-    Printf("Writing to disk block: %d\n", blocknum * m + i);
-    if (disk_write_block(blocknum * m + i, &db) == DISK_FAIL) {
-      Printf("Unable to write physical block to disk.\n");
-      return DISK_FAIL;
-    }
-  }
+int FdiskWriteBlocks(uint32 blocknum, int count, char *data) {
+  int m = sb.dfs_blocksize / diskblocksize;
 
+  if (disk_write_blocks(blocknum * m, count * m, data) == DISK_FAIL) {
+    Printf("Unable to write physical blocks %d-%d to disk.\n", blocknum * m, (blocknum + count) * m - 1);
+    return DISK_FAIL;
+  }
   return DISK_SUCCESS;
 }
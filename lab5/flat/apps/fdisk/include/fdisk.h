@@ -5,10 +5,13 @@ typedef unsigned int uint32;
 
 #include "dfs_shared.h" // This gets us structures and #define's from main filesystem driver
 
-#define FDISK_INODE_BLOCK_START 1 // Starts after super block (which is in file system block 0, physical block 1)
-#define FDISK_INODE_NUM_BLOCKS 16 // Number of file system blocks to use for inodes
-#define FDISK_NUM_INODES  DFS_NUM_INODES
-#define FDISK_FBV_BLOCK_START (FDISK_INODE_NUM_BLOCKS + FDISK_INODE_BLOCK_START)
+// The inodes start in the first file system block after the boot record
+// and superblock (physical blocks 0 and 1): block 1, or 2 with 512 byte blocks
+#define FDISK_INODE_BLOCK_START(bs) ((2 * DISK_BLOCKSIZE + (bs) - 1) / (bs))
+// The file system covers the whole disk, with an inode for every
+// FDISK_BLOCKS_PER_INODE blocks of it but never fewer than DFS_NUM_INODES.
+// The inode and fbv blocks follow from those counts.
+#define FDISK_BLOCKS_PER_INODE 128
 #define FDISK_BOOT_FILESYSTEM_BLOCKNUM 0 // Where the boot record and superblock reside in the filesystem
 
 #ifndef NULL
@@ -16,10 +19,9 @@ typedef unsigned int uint32;
 #endif
 
 //STUDENT: define additional parameters here, if any
-#define FDISK_NUM_BLOCKS DFS_NUM_BLOCKS
-
 #define DISK_BLOCKSIZE 512
-#define FDISK_FS_BLOCKSIZE DFS_BLOCKSIZE
+#define FDISK_FS_BLOCKSIZE DFS_BLOCKSIZE // Unless given as the argument
+#define FDISK_WRITE_BYTES 16384 // Metadata written per trap
 
 typedef struct disk_block {
   char data[DISK_BLOCKSIZE];
@@ -2,5 +2,10 @@
 
 void main (int argc, char *argv[])
 {
-  run_os_tests();
+  // "ostests bench" runs the file system benchmarks instead
+  if ((argc > 1) && (argv[1][0] == 'b')) {
+    run_os_benchmarks();
+  } else {
+    run_os_tests();
+  }
 }
@@ -0,0 +1,59 @@
+#ifndef __coroutine_h__
+#define __coroutine_h__
+
+//---------------------------------------------------------------------
+// User level coroutines: many cooperative workers inside one process,
+// run one at a time by a M:1 scheduler in the process itself.
+// Switching between them (coro_yield, or blocking on a channel) never
+// enters the kernel.  To use them, add
+//	LIBS+= coroswitch.aso coroutine.o
+// to the application's Makefile and call coro_init() once first.
+//
+// A coroutine runs on a stack the caller provides (no malloc in user
+// space) and ends when its function returns.  Coroutines only change
+// at coro_yield/coro_chan_send/coro_chan_recv, so they need no locks
+// among themselves; a blocking trap (sem_wait, sleep ...) blocks all
+// of them.
+//---------------------------------------------------------------------
+
+#define CORO_SUCCESS	1
+#define CORO_FAIL	-1
+#define CORO_MIN_STACK	1024		// bytes
+
+typedef struct coro {
+  unsigned int	sp;			// Saved stack pointer while switched out
+  void		(*func)(void *);
+  void		*arg;
+  int		state;
+  struct coro	*next;			// Ready queue or channel wait queue link
+  void		*msg;			// Value being handed over by a channel
+} coro_t;
+
+typedef struct coro_queue {
+  coro_t	*head;
+  coro_t	*tail;
+} coro_queue;
+
+// A channel holds up to size values in buf; with size 0 every send
+// waits for a matching receive.
+typedef struct coro_chan {
+  void		**buf;
+  int		size;
+  int		head;
+  int		count;
+  coro_queue	senders;		// Blocked in coro_chan_send
+  coro_queue	receivers;		// Blocked in coro_chan_recv
+} coro_chan_t;
+
+void coro_init();
+int coro_create(coro_t *c, void (*func)(void *), void *arg, void *stack, int stacksize);
+void coro_yield();
+void coro_exit();
+void coro_run();			// Returns once every other coroutine has ended
+coro_t *coro_self();
+
+void coro_chan_init(coro_chan_t *ch, void **buf, int size);
+void coro_chan_send(coro_chan_t *ch, void *value);
+void *coro_chan_recv(coro_chan_t *ch);
+
+#endif
@@ -8,17 +8,43 @@ typedef struct dfs_superblock {
   uint32 dfs_start_block_inodes; //the starting file system block number for the array of inodes
   uint32 num_inodes; //Number of inodes in the inode array
   uint32 dfs_start_block_fbv; //the starting file system block number of the free block vector
+  uint32 dfs_start_block_journal; //the starting file system block number of the metadata journal
   uint32 dfs_start_block_data; // starting file system block number for data
+  uint32 dfs_free_blocks; // Free data blocks, as of the last close
+  uint32 dfs_inodes_used; // Inodes from this one on have never been used
 
 } dfs_superblock;
 
-#define DFS_BLOCKSIZE 1024  // Must be an integer multiple of the disk blocksize
+// fdisk picks the block size, DFS_BLOCKSIZE unless it's told otherwise,
+// and stores it in the superblock.  It's a multiple of the disk
+// blocksize up to DFS_MAX_BLOCKSIZE.
+#define DFS_BLOCKSIZE 1024
+#define DFS_MAX_BLOCKSIZE 4096
 
+// Room for a block of any size; only sb.dfs_blocksize bytes are used
 typedef struct dfs_block {
-  char data[DFS_BLOCKSIZE];
+  char data[DFS_MAX_BLOCKSIZE];
 } dfs_block;
 
 
+// A run of consecutive file system blocks holding consecutive blocks
+// of a file.  start 0 is a hole: those blocks were never written and
+// read back as zeros.  An extent with length 0 ends the list.
+typedef struct dfs_extent {
+	uint32 start; //first file system block of the run, 0 for a hole
+	uint32 length; //number of blocks in the run
+} dfs_extent;
+
+// Extents kept in the inode; the rest go in its extent block, which
+// holds dfs_blocksize / sizeof(dfs_extent) more.
+#define DFS_INODE_EXTENTS 5
+
+// A file no bigger than DFS_INODE_INLINE_BYTES is kept in the inode
+// itself, where its extents would be, with DFS_INODE_INLINE set in
+// inuse.  It moves out to blocks once it grows past that.
+#define DFS_INODE_INLINE 2
+#define DFS_INODE_INLINE_BYTES (DFS_INODE_EXTENTS * sizeof(dfs_extent))
+
 //inode needs to be 96 bytes, currently uses 53 bytes m max file name = 96-53 = 43
 #define DFS_MAX_FILENAME_SIZE 44
 typedef struct dfs_inode {
@@ -27,18 +53,32 @@ typedef struct dfs_inode {
   // inodes in the filesystem (and to make your life easier).  To do this, 
   // adjust the maximumm length of the filename until the size of the overall inode 
   // is 128 bytes.
-	int inuse; //Indicates if inode is inuse or not
+	int inuse; //Indicates if inode is inuse or not, and DFS_INODE_INLINE if its data is in extents
 	uint32 filesize; //size of file that the inode reresents
 	char filename[DFS_MAX_FILENAME_SIZE]; //Name of the file that the inode represents
-	uint32 virt_blocks[10]; //Table of direct translations for first 10 virtual blocks
-	uint32 indirect_block; //block num of file system, holds indirect address translations, only allocaed when needed
+	dfs_extent extents[DFS_INODE_EXTENTS]; //First runs of the file's blocks, in file order
+	uint32 extent_block; //block num of file system, holds the runs after those, only allocated when needed
 } dfs_inode;
 
-#define DFS_MAX_FILESYSTEM_SIZE 0x1000000  // 16MB
-
+// The file system's size and inode count are in the superblock; fdisk
+// sizes them to the disk, with at least DFS_NUM_INODES inodes.
 #define DFS_NUM_INODES 192 
-#define DFS_NUM_BLOCKS (DFS_MAX_FILESYSTEM_SIZE / DFS_BLOCKSIZE)
-#define DFS_FBV_MAX_NUM_WORDS (DFS_NUM_BLOCKS / 32)
+
+
+// Metadata journal: DFS_JOURNAL_BLOCKS blocks between the fbv and the
+// data.  The first holds a dfs_journal_header and the rest copies of
+// the inode and fbv blocks it names, written before those go to their
+// places.  A header without DFS_JOURNAL_MAGIC (fdisk writes zeros) or
+// with count 0 has nothing to replay.
+#define DFS_JOURNAL_BLOCKS 16
+#define DFS_JOURNAL_MAGIC 0x4a524e4c
+typedef struct dfs_journal_header {
+	uint32 magic;
+	uint32 sequence; //number of the flush that wrote it
+	uint32 count; //copies following the header
+	uint32 checksum; //sum of the words of the copies
+	uint32 target[DFS_JOURNAL_BLOCKS - 1]; //file system block each copy belongs in
+} dfs_journal_header;
 
 
 #define DFS_FAIL -1
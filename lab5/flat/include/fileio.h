@@ -0,0 +1,57 @@
+#ifndef __fileio_h__
+#define __fileio_h__
+
+//---------------------------------------------------------------------
+// Buffered file I/O for user programs, on top of the file_* traps.
+// Each stream keeps FIO_BUFFER_SIZE bytes in user space, so a program
+// reading or writing small records traps once per buffer instead of
+// once per record.  To use it, add
+//	LIBS+= fileio.o
+// to the application's Makefile.
+//
+// The caller provides the fio_t (there's no malloc in user space).
+// Modes are "r", "w" and "rw" as for file_open, plus "a", which opens
+// for writing at the end of the file.  Reads and writes bigger than
+// the buffer skip it when it's empty.  Data written is only sure to
+// reach the file system after fio_flush or fio_close.
+//
+// The names aren't fopen/fread/... so they don't clash with the
+// compiler's built in declarations of those.
+//---------------------------------------------------------------------
+
+#define FIO_SUCCESS	1
+#define FIO_FAIL	-1
+#define FIO_EOF		-1
+
+#define FIO_BUFFER_SIZE	1024
+
+#define FIO_READ	1
+#define FIO_WRITE	2
+
+// Must match FILE_SEEK_* in files_shared.h
+#define FIO_SEEK_SET	1
+#define FIO_SEEK_END	2
+#define FIO_SEEK_CUR	3
+
+typedef struct fio {
+  unsigned int	handle;			// From file_open
+  int		mode;			// FIO_READ and/or FIO_WRITE
+  int		pos;			// Next byte of buf to read or write
+  int		len;			// Bytes of buf read from the file
+  int		dirty;			// buf[0..pos) hasn't been written yet
+  int		eof;			// The last read hit the end of the file
+  char		buf[FIO_BUFFER_SIZE];
+} fio_t;
+
+int fio_open(fio_t *f, char *filename, char *mode);
+int fio_close(fio_t *f);
+int fio_read(fio_t *f, void *mem, int n);	// Bytes read, 0 at end of file
+int fio_write(fio_t *f, void *mem, int n);	// Bytes written or FIO_FAIL
+char *fio_gets(fio_t *f, char *s, int n);	// NULL at end of file
+int fio_getc(fio_t *f);			// FIO_EOF at end of file
+int fio_putc(fio_t *f, int c);
+int fio_puts(fio_t *f, char *s);
+int fio_flush(fio_t *f);
+int fio_seek(fio_t *f, int offset, int from_where);	// FIO_SEEK_* values
+
+#endif
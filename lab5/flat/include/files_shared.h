@@ -7,8 +7,14 @@
 
 #define FILE_MAX_FILENAME_LENGTH 44
 
+// No longer a limit on file_read/file_write: any size moves in one
+// call.  Still a convenient size for user buffers.
 #define FILE_MAX_READWRITE_BYTES 4096
 
+// Most pieces one file_readv/file_writev takes.  A piece is a
+// file_iovec_t in usertraps.h: its address, then its length.
+#define FILE_MAX_IOVEC 16
+
 typedef struct file_descriptor {
 	char inuse;
 	char filename[FILE_MAX_FILENAME_LENGTH];  
@@ -16,6 +22,8 @@ typedef struct file_descriptor {
 	uint32 pos; //Current position of the file
 	char eof_flag; // End of file flag
 	char mode; // Mode of the file 0 is undefined, 1 = read, 2 = write, 3 = read/write
+	uint32 ra_pos; //Where the next read starts if reads are sequential
+	int ra_blocks; //Blocks read ahead after the last read, 0 if it wasn't sequential
 } file_descriptor;
 
 #define FILE_FAIL -1
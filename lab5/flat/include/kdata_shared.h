@@ -0,0 +1,20 @@
+#ifndef __KDATA_SHARED__
+#define __KDATA_SHARED__
+
+// The kernel data page.  The kernel maps one page, the same one for
+// every user process, at KDATA_ADDRESS (the last page of the address
+// space, PROCESS_KDATA_PAGE), and brings it up to date each time it
+// returns to user mode: after every trap, interrupt and context
+// switch.  The library reads the process's pid and the time from here
+// without a trap.  The time is as of the last return from the kernel,
+// so with the clock tickless it stands still while a process runs
+// alone; clock_usec() reads the clock itself.
+#define KDATA_ADDRESS 0xf0000
+
+typedef struct kdata {
+	int pid;                // Of the process running
+	int jiffies;            // ClkGetCurJiffies()
+	unsigned int usec;      // ClkGetUsec()
+} kdata;
+
+#endif
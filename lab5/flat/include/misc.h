@@ -19,6 +19,19 @@ int min(int a, int b);
 int max(int a, int b);
 void bzero(char *mem, int num_bytes);
 void bcopy(char *src, char *dst, int num_bytes);
+char *dmemmove(char *dst, const char *src, int num_bytes);
+char *dmemset(char *dst, int c, int num_bytes);
+
+// Set to 0 to build for a simulator without the ffs, popc, cmpb and
+// zbyte instructions; the helpers below then use plain C loops.
+#define	MISC_HAVE_BITOPS	1
+
+extern int	dlx_ffs (int v);
+extern int	dlx_popc (int v);
+extern int	dlx_cmpb (int a, int b);
+extern int	dlx_zbyte (int v);
+extern int	dffs (int v);
+extern int	dpopcount (int v);
 
 inline
 int
@@ -14,10 +14,15 @@ void ClkModuleInit();   // Initializes the clock module
 void ClkStart();        // Starts the clock firing
 void ClkStop();         // Stops the clock
 int ClkInterrupt();     // Called from traps.c when a timer interrupt occurs
+void ClkUpdate();       // Called when a process becomes runnable, sets the timer if needed
+void ClkWakeAt(int jiffies); // Sets the timer for when a sleeping process wakes
 inline void ClkSetResolution(int usec); // Sets resolution of clock, in microseconds
 inline int ClkGetResolution(); // Returns the resolution of the clock, in microseconds
-inline double ClkGetCurTime();    // Returns number of milliseconds since clock was started
+inline double ClkGetCurTime();    // Returns number of seconds since clock was started
 inline int ClkGetCurJiffies(); // Returns number of jiffies that have fired since clock started
-void ClkResetProcess();  // Resets the current process counter to the current time
+inline uint32 ClkGetUsec();    // Returns simulated microseconds, monotonic, wraps at 2^32
+inline uint32 ClkGetCycles();  // Returns instructions executed, monotonic, wraps at 2^32
+inline uint32 ClkUsecSince(uint32 start); // Returns microseconds since ClkGetUsec() gave start
+void ClkResetProcess();  // Starts a new quantum for the process just switched to
 
 #endif
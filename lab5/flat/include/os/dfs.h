@@ -2,23 +2,102 @@
 #define __DFS_H__
 
 #include "dfs_shared.h"
+
+// Blocks the buffer cache holds by default; the -C boot option sets
+// it, up to DFS_CACHE_MAX_BUFFERS, and -C 0 turns the cache off.
+#define DFS_CACHE_BUFFERS 32
+#define DFS_CACHE_MAX_BUFFERS 64
+#define DFS_CACHE_HASH_BUCKETS 32
+
+extern int dfsCacheBuffers;
+
+// Chains in the in-memory filename index
+#define DFS_NAME_HASH_BUCKETS 64
+
+// Most extents one file can have: those in the inode and a full extent
+// block.  A file written in order needs only one per free run it uses.
+// An extent block holds dfs_blocksize / sizeof(dfs_extent), so this is
+// sized for the largest blocks.
+#define DFS_EXTENT_BLOCK_EXTENTS ((int)(DFS_MAX_BLOCKSIZE / sizeof(dfs_extent)))
+#define DFS_MAX_EXTENTS (DFS_INODE_EXTENTS + DFS_EXTENT_BLOCK_EXTENTS)
+
+// Groups the data blocks are split into for placing new files
+#define DFS_ALLOC_GROUPS 8
+
+// Inodes whose extent lists are kept decoded in memory
+#define DFS_EXTENT_MAPS 8
+
+// Locks the inodes are spread over (see inode_locks in dfs.c)
+#define DFS_INODE_LOCKS 8
+
+// One piece of memory in a vectored read or write
+typedef struct dfs_iovec {
+	void *mem;
+	int len;
+} dfs_iovec;
+
+// One file as DfsReadDir reports it (dfs_dirent_t in usertraps.h
+// must match)
+typedef struct dfs_dirent {
+	uint32 inode;
+	uint32 filesize;
+	int isinline;               // Its data is kept in the inode
+	char filename[DFS_MAX_FILENAME_SIZE];
+} dfs_dirent;
+
+// DFS activity since boot (file_stats() hands it out as part of
+// file_stats_t in usertraps.h, which must match)
+typedef struct DfsStats {
+	int cacheHits;
+	int cacheMisses;
+	int cacheEvictions;         // Valid buffers reused for another block
+	int cacheWritebacks;
+	int cachePrefetches;
+	int blocksRead;             // DFS blocks read from the disk, metadata aside
+	int blocksWritten;          //   and written to it
+	int readModifyWrites;       // Partial block writes that read the block first
+	int allocCalls;             // DfsAllocateBlocksNear calls
+	int allocScanWords;         // fbv and summary words they looked at
+	int inodeLookups;           // Filename lookups
+	int inodeLookupSteps;       // Inodes they compared names with
+	int journalFlushes;
+	int journalBlocks;          // Inode and fbv blocks written through the journal
+} DfsStats;
+
+
 void DfsModuleInit();
 void DfsInvalidate();
 int DfsOpenFileSystem();
 int DfsCloseFileSystem();
+int DfsSync();
+void DfsGetStats(DfsStats *stats);
 uint32 DfsAllocateBlock();
+uint32 DfsAllocateBlockNear(uint32 hint);
+uint32 DfsAllocateBlocksNear(uint32 hint, int want, int *got);
 int DfsFreeBlock(uint32 blocknum);
 int DfsReadBlock(uint32 blocknum, dfs_block *b);
 int DfsWriteBlock(uint32 blocknum, dfs_block *b);
+int DfsWriteBlocks(uint32 blocknum, int count, char *data);
+int DfsReadBlocks(uint32 blocknum, int count, char *data);
+int DfsReadBlockPart(uint32 blocknum, int offset, int n, char *dst);
+int DfsWriteBlockPart(uint32 blocknum, int offset, int n, char *src, int fresh);
 uint32 DfsInodeFilenameExists(char *filename);
 uint32 DfsInodeOpen(char *filename);
 int DfsInodeDelete(uint32 handle);
 uint32 DfsInodeFilesize(uint32 handle);
-int DfsInodeTruncateFile(uint32 handle); // this new function is used when writing
+int DfsInodeTruncateFile(uint32 handle, uint32 size); // frees blocks past size, or leaves a hole up to it
+int DfsInodeDefrag(uint32 handle);      // moves a file's blocks into one run
+int DfsDefrag(uint32 start);            // defrags the next file from start on
+int DfsReadDir(uint32 start, dfs_dirent *ents, int n); // lists up to n files from inode start on
 uint32 DfsInodeAllocateVirtualBlock(uint32 handle, uint32 virtual_blocknum);
 uint32 DfsInodeTranslateVirtualToFilesys(uint32 handle, uint32 virtual_blocknum);
 int DfsInodeReadBytes(uint32 handle, void *mem, int start_byte, int num_bytes);
+int DfsInodeReadv(uint32 handle, dfs_iovec *iov, int n, int start_byte, int num_bytes);
+int DfsInodePrefetch(uint32 handle, int start_byte, int count);
+int DfsInodeUncache(uint32 handle, int start_byte, int num_bytes); // the page cache holds them now
 int DfsInodeWriteBytes(uint32 handle, void *mem, int start_byte, int num_bytes);
+int DfsInodeWritev(uint32 handle, dfs_iovec *iov, int n, int start_byte);
+int DfsInodeSync(uint32 handle, int datasync); // writes back one file's dirty blocks and inode
 
 
 #endif
@@ -1,7 +1,10 @@
 #ifndef __DISK_H__
 #define __DISK_H__
 
-// Name of file which represents the "hard disk"
+// Name of file which represents the "hard disk".  The simulator's DMA
+// disk doesn't say how big its image is, so the image and its size in
+// blocks default to DISK_FILENAME and DISK_NUMBLOCKS and can be set at
+// boot with the -I and -B options instead.
 #define DISK_FILENAME "/tmp/ee469g69.img"
 //#define DISK_FILENAME "/tmp/ee469g99.img"
 
@@ -18,11 +21,71 @@ typedef struct disk_block {
 
 #define DISK_SUCCESS 1
 #define DISK_FAIL -1
+#define DISK_PENDING 0    // A queued request that isn't done yet
 
+// Most blocks moved by one request; the simulator has no limit, this
+// just bounds how long interrupts stay off.
+#define DISK_MAX_REQUEST_BLOCKS 64
+
+// Requests that can be queued at once; callers wait for a free slot
+#define DISK_MAX_REQUESTS 32
+
+// Blocks disk_write_blocks() copies in from user space per request
+#define DISK_TRAP_BLOCKS 8
+
+// Blocks the track buffer reads ahead on a miss by default (-T sets
+// it, up to DISK_TRACK_MAX_BLOCKS; 0 turns the buffer off)
+#define DISK_TRACK_BLOCKS 16
+#define DISK_TRACK_MAX_BLOCKS DISK_MAX_REQUEST_BLOCKS
+
+// Service-time model used with the -L boot option, in microseconds.
+// A transfer that doesn't start where the last one ended pays a seek
+// (settle time plus a cost per 1024 blocks of distance) and, on
+// average, half a rotation; every block then costs the transfer time.
+#define DISK_SEEK_SETTLE_US 1000
+#define DISK_SEEK_US_PER_KBLOCK 250
+#define DISK_ROTATION_US 8333          // 7200 rpm
+#define DISK_TRANSFER_US_PER_BLOCK 10
+
+// Regions the access heatmap splits the disk into
+#define DISK_HEAT_REGIONS 16
+
+// What disk_stats() reports.  Must match disk_stats_t in usertraps.h.
+typedef struct DiskStats {
+  int reads;                    // Requests submitted
+  int writes;
+  int blocksRead;
+  int blocksWritten;
+  int trackHits;                // Reads served from the track buffer
+  int trackFills;               // Reads that filled it
+  int transfers;                // Transfers the device saw after merging
+  int sequential;               //   that started where the last one ended
+  int random;                   //   and that had to seek
+  int seekBlocks;               // Total seek distance
+  int serviceUs;                // Modelled service time, 0 without -L
+  int heat[DISK_HEAT_REGIONS];  // Blocks moved in each region
+} DiskStats;
+
+extern int diskLatencyModel;    // Set by -L
+extern char *diskFilename;      // Set by -I
+extern uint32 diskNumBlocks;    // Set by -B
+extern int diskTrackBlocks;     // Set by -T
+
+void DiskModuleInit();
+void DiskInterrupt();
+void DiskStartQueue();
+void DiskStopQueue();
+int DiskPoll();
+void DiskGetStats(DiskStats *stats);
+void DiskPrintStats();
 int DiskBytesPerBlock();
 int DiskSize();
 int DiskCreate();
 int DiskWriteBlock (uint32 blocknum, disk_block *b);
 int DiskReadBlock (uint32 blocknum, disk_block *b);
+int DiskWriteBlocks (uint32 blocknum, int count, void *buf);
+int DiskReadBlocks (uint32 blocknum, int count, void *buf);
+int DiskStartRead (uint32 blocknum, int count, void *buf,
+                   void (*callback)(void *arg, int ok), void *arg);
 
 #endif
@@ -14,6 +14,7 @@ typedef  unsigned int  uint32;
 extern void  SetTimer (int);
 
 extern char  debugstr[];
+extern char  debugflags[];  // debugflags[c] is set if c is in debugstr
 
 #define  ASSERT(cond,s)  (cond ? 0 : printf ("%s: %s\n", __FUNCTION__,s))
 
@@ -24,14 +25,15 @@ extern char  debugstr[];
 // statements at different times by using different letters.  For example,
 // process debugging statements could use 'p', and memory 'm'.  Specifying
 // a '+' in the debugging string will turn on all debugging printfs.
+// The flags are looked up in debugflags, which ProcessSetDebug builds
+// from debugstr, so a dbprintf that's off costs one load and a test.
 /*#define  dbprintf(flag, format, args...)     \
     if ((dindex(debugstr,flag)!=(char *)0) ||  \
   (dindex(debugstr,'+')!=(char *)0)) {  \
   printf (format, ## args);    \
     } */
 #define  dbprintf(flag, format, args...) \
-         if (dindex(debugstr,flag)!=(char *)0) { printf(format, ## args); }  \
-         if (dindex(debugstr,'+')!=(char *)0)  { printf(format, ## args); }
+         if (debugflags[(flag) & 0x7f]) { printf(format, ## args); }
 
 #ifndef NULL
 #define NULL ((void *)0x0)
@@ -0,0 +1,52 @@
+//
+//	evlog.h
+//
+//	Kernel event log.  Hot paths record what they do as fixed-size
+//	binary records in a ring in memory, instead of printing it as
+//	they go: EVLOG costs one test when the log is off and a few
+//	stores when it's on.  The ring keeps the last EVLOG_ENTRIES
+//	records, which are turned into text only when it's dumped, on
+//	exit or by the evlog_dump trap.  Run the OS with -E to turn it
+//	on.
+//
+
+#ifndef	_evlog_h_
+#define	_evlog_h_
+
+#define	EVLOG_ENTRIES		1024	// Records kept; a power of two
+
+// Event numbers.  Each has a name and a format for its arguments in
+// evlog_events in evlog.c, in the same order.
+#define	EV_PAGE_ALLOC		1	// page, pages still free
+#define	EV_PAGE_FREE		2	// page, pages still free
+#define	EV_KMEM_ALLOC		3	// object, object size
+#define	EV_KMEM_FREE		4	// object, object size
+#define	EV_KMEM_SLAB_NEW	5	// page, object size
+#define	EV_KMEM_SLAB_FREE	6	// page, object size
+#define	EV_FILE_READ		7	// handle, position, bytes
+#define	EV_FILE_WRITE		8	// handle, position, bytes
+#define	EV_DFS_WRITE_BLOCKS	9	// inode, file system block, blocks
+#define	EV_DFS_WRITE_PART	10	// inode, file system block, offset, bytes
+#define	EV_BOOT_PHASE		11	// phase name, instructions, instruction count at the end, us
+#define	EVLOG_EVENTS		12
+
+#define	EVLOG_BOOT_PHASES	24	// Boot phases timed; later ones are dropped
+
+typedef struct evlog_record {
+  int		jiffies;		// When it happened
+  short		event;			// EV_*
+  short		pid;			// Process running then
+  uint32	args[4];
+} evlog_record;
+
+extern int	evlog_on;
+
+#define	EVLOG(event, a0, a1, a2, a3) \
+	if (evlog_on) { EvlogRecord ((event), (uint32)(a0), (uint32)(a1), (uint32)(a2), (uint32)(a3)); }
+
+void	EvlogRecord (int event, uint32 a0, uint32 a1, uint32 a2, uint32 a3);
+void	EvlogDump ();
+void	EvlogBootPhase (char *name);
+void	EvlogBootDone ();
+
+#endif	// _evlog_h_
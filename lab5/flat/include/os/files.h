@@ -3,15 +3,78 @@
 
 #include "dfs.h"
 #include "files_shared.h"
+#include "synch.h"
+#include "process.h"
 
 #define FILE_MAX_OPEN_FILES 15
 
+// Pieces the kernel gathers a vectored read or write into before
+// handing them to the file layer
+#define FILE_TRAP_IOVEC (FILE_MAX_IOVEC * 2)
+
+// Sequential reads read ahead FILE_READAHEAD_MIN_BLOCKS DFS blocks at
+// first, doubling with each one after that up to the maximum
+#define FILE_READAHEAD_MIN_BLOCKS 2
+#define FILE_READAHEAD_MAX_BLOCKS 16
+
+// Asynchronous reads and writes that can be queued at once
+#define FILE_MAX_ASYNC 16
+
+// A queued file_read_async/file_write_async.  The data moves between
+// the file and the physical memory in pieces, from pos on.
+typedef struct file_async_request {
+	int inuse;
+	int ticket;                   // What file_wait is given, or 0
+	int pid;                      // Process that queued it
+	int write;
+	uint32 inode_handle;
+	uint32 pos;
+	int len;                      // Bytes to move
+	dfs_iovec pieces[FILE_TRAP_IOVEC];
+	int npieces;
+	int result;                   // Bytes moved or FILE_FAIL, once it's done
+	Sem finished;                 // Signalled when it's done
+	struct file_async_request *next; // In the queue
+} file_async_request;
+
+// Activity since boot, what file_stats() copies out (file_stats_t in
+// usertraps.h must match).  Bytes count everything read or written
+// through the file layer, asynchronous and positional calls included.
+typedef struct FileStats {
+	int opens;
+	int closes;
+	int bytesRead;
+	int bytesWritten;
+	DfsStats dfs;
+} FileStats;
+
 void FileModuleInit();
 int FileOpen(char *filename, char *mode);
 int FileClose(int handle);
+void FileTableInit(PCB *pcb);
+int FileFdHandle(PCB *pcb, int fd);
+int FileFdOpen(PCB *pcb, char *filename, char *mode);
+int FileFdClose(PCB *pcb, int fd);
+void FileFdCloseAll(PCB *pcb);
 int FileRead(int handle, void *mem, int num_bytes);
 int FileWrite(int handle, void *mem, int num_bytes);
+int FilePread(int handle, void *mem, int num_bytes, int offset);
+int FilePwrite(int handle, void *mem, int num_bytes, int offset);
+int FileCopyRange(int src, int dst, int offset, int len);
+int FileSync(int handle);
+int FileDataSync(int handle);
+int FileReadv(int handle, dfs_iovec *iov, int iovcnt);
+int FileWritev(int handle, dfs_iovec *iov, int iovcnt);
+int FileStartAsync(int handle, dfs_iovec *pieces, int npieces, int write);
+int FileWait(int ticket);
+void FileAsyncExit(int pid);
 int FileSeek(int handle, int num_bytes, int from_where);
+int FileTell(int handle);
+int FileLength(int handle);
 int FileDelete(char *filename);
+int FileMap(int handle, int offset, int length);
+int FileUnmap(uint32 addr);
+int FileSyncMap(uint32 addr);
+void FileGetStats(FileStats *stats);
 
 #endif
@@ -49,6 +49,7 @@ typedef struct FsUnixInfo {
 
 typedef struct FsDlxInfo {
   int	curpos;		// What's our current position in the file?
+  int	handle;		// files.c descriptor the file is open on
 } FsDlxInfo;
 
 typedef struct FsOpenFile {
@@ -0,0 +1,59 @@
+//
+//	kmalloc.h
+//
+//	Kernel object caches.  A cache hands out objects of one size
+//	from slabs: pages from MemoryAllocPage, each starting with a
+//	KmemSlab header and cut into objects after it.  A slab that
+//	empties goes straight back to the page allocator, and all caches
+//	together never hold more than KMEM_MAX_PAGES pages, so the tables
+//	built on them grow with the load but can't eat the user's memory.
+//
+//	kmalloc/kfree serve odd sizes from a cache per power of two
+//	between KMEM_MIN_BYTES and KMEM_MAX_BYTES.
+//
+
+#ifndef	_kmalloc_h_
+#define	_kmalloc_h_
+
+#define	KMEM_MAX_PAGES		4	// Pages all caches may hold at once
+#define	KMEM_ALIGN		8	// Objects are multiples of this
+#define	KMEM_MIN_SHIFT		4
+#define	KMEM_SIZE_CLASSES	8
+#define	KMEM_MIN_BYTES		(1 << KMEM_MIN_SHIFT)
+#define	KMEM_MAX_BYTES		(1 << (KMEM_MIN_SHIFT + KMEM_SIZE_CLASSES - 1))
+
+typedef struct KmemObj {
+  struct KmemObj	*next;		// Next free object in the slab
+} KmemObj;
+
+typedef struct KmemSlab {
+  struct KmemCache	*cache;
+  struct KmemSlab	*prev;		// Neighbours on the cache's list of
+  struct KmemSlab	*next;		//   slabs with free objects
+  KmemObj		*freelist;
+  int			inuse;		// Objects handed out
+  int			page;		// Page number, for MemoryFreePage
+} KmemSlab;
+
+#define	KMEM_SLAB_HEADER	((sizeof(KmemSlab) + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1))
+
+typedef struct KmemCache {
+  char			*name;
+  int			objsize;
+  int			perslab;	// Objects in one slab
+  int			maxobjs;	// Most objects handed out at once; 0 for no limit
+  int			nobjs;		// Objects handed out
+  int			nslabs;
+  KmemSlab		*partial;	// Slabs with free objects
+} KmemCache;
+
+void KmemModuleInit();
+// Sets up a cache; it takes no memory until the first KmemCacheAlloc,
+// so this may be called before KmemModuleInit.
+void KmemCacheInit(KmemCache *c, char *name, int objsize, int maxobjs);
+void *KmemCacheAlloc(KmemCache *c);	// NULL if over a limit or out of pages
+void KmemCacheFree(void *obj);		// Finds the cache from obj's slab
+void *kmalloc(int bytes);		// NULL if bytes > KMEM_MAX_BYTES
+void kfree(void *ptr);
+
+#endif	// _kmalloc_h_
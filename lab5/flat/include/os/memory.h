@@ -37,9 +37,18 @@
 #define	MEMORY_PTE_REFERENCED	0x00000004
 #define	MEMORY_PTE_MASK		(~(MEMORY_PTE_VALID|MEMORY_PTE_DIRTY|MEMORY_PTE_REFERENCED))
 
+#define	MEMORY_FAIL		0
+#define	MEMORY_SUCCESS		1
+
+// Pages of files that the page cache can hold at once.  The pages of a
+// file mapping are shared through it by every process that maps the
+// same part of the file, and file reads and writes go to them too.
+#define	MEMORY_FILE_CACHE_PAGES	16
+
 extern int	lastosaddress;		// Defined in an assembly file
 extern int	MemoryGetSize ();
 extern int	MemoryAllocPage ();
+extern int	MemoryAllocPages (int n);
 extern void	MemoryFreePage (uint32 page);
 extern uint32	MemorySetupPte (uint32 page);
 extern void	MemoryFreePte (uint32 pte);
@@ -48,5 +57,13 @@ extern void	MemoryModuleInit ();
 extern uint32	MemoryTranslateUserToSystem ();
 extern int	MemoryCopySystemToUser ();
 extern int	MemoryCopyUserToSystem ();
+extern int	MemoryCopyStringFromUser ();
+extern uint32	MemoryMapFile ();
+extern int	MemoryUnmapFile ();
+extern int	MemorySyncFile ();
+extern void	MemoryUnmapAll ();
+extern int	MemoryPageFaultHandler ();
+extern uint32	MemoryFileCacheLookup ();
+extern void	MemoryFileCacheDrop ();
 
 #endif	// _memory_h_
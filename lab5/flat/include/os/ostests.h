@@ -2,5 +2,6 @@
 #define __OS_TESTS__
 
 void RunOSTests();
+void RunOSBenchmarks();
 
 #endif
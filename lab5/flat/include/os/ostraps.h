@@ -19,5 +19,11 @@ void bcopy(char *source, char *destination, int numbytes);
 void exitsim();
 void TimerSet(int us);
 
+// Simulator snapshots (trap_random.s).  snapshot() returns 0 when the
+// snapshot is written and 1 in a run resumed from it; resumeargs()
+// fetches that run's arguments as one space separated string.
+int snapshot(const char *name);
+int resumeargs(char *buf, int size);
+
 
 #endif
@@ -15,7 +15,11 @@
 #define PROCESS_FAIL 0
 #define PROCESS_SUCCESS 1
 
-#define	PROCESS_MAX_PROCS	32	// Maximum number of active processes
+#define	PROCESS_MAX_PROCS	128	// Maximum number of PCBs (and pids)
+#define	PROCESS_MAX_PAGES	16	// Entries in a process's page table
+#define	PROCESS_KDATA_PAGE	(PROCESS_MAX_PAGES - 1) // At KDATA_ADDRESS in user processes
+#define	PROCESS_RUNTIME_PAGE	(PROCESS_KDATA_PAGE - 1) // At RUNTIME_ADDRESS in user processes
+#define	PROCESS_MAX_FILES	16	// Files one process can have open
 
 #define	PROCESS_INIT_ISR_SYS	0x140	// Initial status reg value for system processes
 #define	PROCESS_INIT_ISR_USER	0x100	// Initial status reg value for user processes
@@ -31,6 +35,16 @@
 
 typedef	void (*VoidFunc)();
 
+// A page of the address space that a file is mapped into.  Its PTE
+// stays invalid until the first touch faults it in from the file.
+typedef struct ProcessMapPage {
+  int		start;		// First page of the mapping, -1 if not mapped
+  uint32	inode;		// DFS inode handle of the file
+  uint32	offset;		// Byte offset in the file of this page
+  int		bytes;		// Bytes of this page that belong to the mapping
+  int		writable;	// Dirty pages are written back if set
+} ProcessMapPage;
+
 // Process control block
 typedef struct PCB {
   uint32	*currentSavedFrame; // -> current saved frame.  MUST BE 1ST!
@@ -38,9 +52,15 @@ typedef struct PCB {
   uint32	sysStackArea;	// System stack area for this process
   unsigned int	flags;
   char		name[80];	// Process name
-  uint32	pagetable[16];	// Statically allocated page table
+  uint32	pagetable[PROCESS_MAX_PAGES]; // Statically allocated page table
   int		npages;		// Number of pages allocated to this process
+  ProcessMapPage maps[PROCESS_MAX_PAGES]; // File mappings, by page
+  int		files[PROCESS_MAX_FILES]; // Open file handle of each descriptor
+  uint32	files_free;	// Bit fd is set if descriptor fd is free
+  uint32	ring;		// User address of its trap ring, 0 if none
+  void		*ring_sys;	// ... and the same in system space
   Link		*l;		// Used for keeping PCB in queues
+  int		pid;
 
   int           pinfo;          // Turns on printing of runtime stats
   int           pnice;          // Used in priority calculation
@@ -85,6 +105,21 @@ typedef struct PCB {
 #define PROCESS_PRIORITIES_PER_QUEUE 4
 #define PROCESS_NUM_QUEUES ((PROCESS_MAX_PRIORITY+1) / PROCESS_PRIORITIES_PER_QUEUE) // should be 32
 
+// Binary executable images.  This matches dlximage.h in the simulator
+// source: a header of PROCESS_IMAGE_HEADER_WORDS big-endian words
+// followed by segments of (load address, length, bytes).
+#define PROCESS_IMAGE_MAGIC		0x444c5849	// "DLXI"
+#define PROCESS_IMAGE_VERSION		1
+#define PROCESS_IMAGE_HEADER_WORDS	9
+#define PROCESS_IMAGE_SEGHDR_WORDS	2
+#define PROCESS_IMAGE_MAGIC_WORD	0
+#define PROCESS_IMAGE_VERSION_WORD	1
+#define PROCESS_IMAGE_START_WORD	2
+#define PROCESS_IMAGE_CODESTART_WORD	4
+#define PROCESS_IMAGE_CODESIZE_WORD	5
+#define PROCESS_IMAGE_DATASTART_WORD	6
+#define PROCESS_IMAGE_DATASIZE_WORD	7
+
 // Number of jiffies in a single process quantum (i.e. how often ProcessSchedule is called)
 #define PROCESS_QUANTUM_JIFFIES  CLOCK_PROCESS_JIFFIES
 // Number of jiffies that have to pass before decaying all estcpu's
@@ -117,5 +152,11 @@ void ProcessForkIdle();
 int ProcessCountAutowake();
 void ProcessPrintRunQueues();
 void ProcessYield();
+int ProcessRunnableCount();
+void ProcessUpdateKdata();
+void ProcessLoadRuntime();
+int ProcessSleepUntil(int deadline);
+int ProcessSleepMs(int ms);
+void ProcessWakeSleepers();
 
 #endif	/* __process_h__ */
@@ -14,7 +14,10 @@
 #define	NULL	((void *)0)
 #endif
 
+// Links made at boot; once they're all in use, more come from the
+// link cache (see kmalloc.h), up to QUEUE_MAX_CACHED_LINKS of them.
 #define	QUEUE_MAX_LINKS		400
+#define	QUEUE_MAX_CACHED_LINKS	4096
 
 #define QUEUE_FAIL 0
 #define QUEUE_SUCCESS 1
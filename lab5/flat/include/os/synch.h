@@ -25,10 +25,12 @@
 				//This is because condition vars also use
 				//locks from the same pool
 #define MAX_CONDS	32	//Maximum 32 conds allowed in the system
+#define MAX_RWLOCKS	16	//Maximum 16 reader-writer locks (rwlock.c)
 
 typedef int sem_t;
 typedef int lock_t;
 typedef int cond_t;
+typedef int rwlock_t;
 
 #define INVALID_SEM -1
 #define INVALID_LOCK -1
@@ -78,4 +80,22 @@ int CondHandleWait(cond_t cond);
 int CondHandleSignal(cond_t cond);
 int CondHandleBroadcast(cond_t cond);
 
+typedef struct RwLock {
+  int readers;        // Number of processes holding the lock for reading
+  int writer;         // PID of process holding it for writing, -1 if none
+  Queue readWaiting;  // Queue of processes waiting to read
+  Queue writeWaiting; // Queue of processes waiting to write
+  int inuse;          // Bookkeeping variable for free vs. used structures
+} RwLock;
+
+void RwLockModuleInit();
+int RwLockInit(RwLock *);
+int RwLockAcquireRead(RwLock *);
+int RwLockAcquireWrite(RwLock *);
+int RwLockRelease(RwLock *);
+rwlock_t RwLockCreate();
+int RwLockHandleAcquireRead(rwlock_t rw);
+int RwLockHandleAcquireWrite(rwlock_t rw);
+int RwLockHandleRelease(rwlock_t rw);
+
 #endif	//_synch_h_
@@ -37,6 +37,7 @@
 #define	TRAP_TLBFAULT		0x30
 #define	TRAP_TIMER		0x40	// timer interrupt
 #define	TRAP_KBD		0x48	// keyboard interrupt
+#define	TRAP_DISK		0x50	// disk transfer complete
 
 // This bit is set in CAUSE if the interrupt was a trap instruction
 #define	TRAP_TRAP_INSTR		0x08000000
@@ -74,6 +75,10 @@
 #define TRAP_COND_WAIT		0x457
 #define TRAP_COND_SIGNAL	0x458
 #define TRAP_COND_BROADCAST	0x459
+#define TRAP_RWLOCK_CREATE	0x45a
+#define TRAP_RWLOCK_READ	0x45b
+#define TRAP_RWLOCK_WRITE	0x45c
+#define TRAP_RWLOCK_RELEASE	0x45d
 #define TRAP_MBOX_CREATE        0x460
 #define TRAP_MBOX_OPEN          0x461
 #define TRAP_MBOX_CLOSE         0x462
@@ -87,9 +92,14 @@
 #define TRAP_DISK_SIZE          0x468
 #define TRAP_DISK_BLOCKSIZE     0x469
 #define TRAP_DISK_CREATE        0x470
+#define TRAP_DISK_STATS         0x478
+#define TRAP_DISK_WRITE_BLOCKS  0x47a
 
 // Traps for DFS filesystem
 #define TRAP_DFS_INVALIDATE     0x471
+#define TRAP_DFS_SYNC           0x479
+#define TRAP_DFS_DEFRAG         0x47b
+#define TRAP_DFS_READDIR        0x492
 
 // Traps for file functions
 #define TRAP_FILE_OPEN          0x472
@@ -98,12 +108,72 @@
 #define TRAP_FILE_READ          0x475
 #define TRAP_FILE_WRITE         0x476
 #define TRAP_FILE_SEEK          0x477
+#define TRAP_FILE_MMAP          0x47c
+#define TRAP_FILE_MUNMAP        0x47d
+#define TRAP_FILE_MSYNC         0x47e
+#define TRAP_FILE_READV         0x47f
+#define TRAP_FILE_WRITEV        0x480
+#define TRAP_FILE_READ_ASYNC    0x481
+#define TRAP_FILE_WRITE_ASYNC   0x482
+#define TRAP_FILE_WAIT          0x483
+#define TRAP_FILE_PREAD         0x484
+#define TRAP_FILE_PWRITE        0x485
+#define TRAP_FILE_COPY_RANGE    0x486
+#define TRAP_FILE_SYNC          0x487
+#define TRAP_FILE_DATASYNC      0x488
+#define TRAP_FILE_STATS         0x489
+
+// Traps for batched submission
+#define TRAP_RING_SETUP         0x48a
+#define TRAP_RING_ENTER         0x48b
+
+// Console output from the user library's Printf
+#define TRAP_CONSOLE_WRITE      0x48c
+
+// Monotonic clock
+#define TRAP_CLOCK_USEC         0x48d
+#define TRAP_CLOCK_CYCLES       0x48e
+
+// Timed sleeps
+#define TRAP_SLEEP_MS           0x48f
+#define TRAP_SLEEP_UNTIL        0x490
+
+// File system benchmarks, like run_os_tests
+#define TRAP_OSBENCH            0x491
 
 // Misc. Traps
+#define TRAP_EVLOG_DUMP         0x4FD
+#define TRAP_PROFILE            0x4FE
 #define TRAP_TESTOS             0x4FF
 
 #define TRAP_USER_EXIT          0x500
 
+// A submission/completion ring that a process sets up in its own
+// memory with ring_setup(), so that ring_enter() can run a batch of
+// traps for it at once.  The process fills sq[sq_tail % ENTRIES] and
+// bumps sq_tail; ring_enter runs entries from sq_head on while there's
+// room in cq and posts each result at cq[cq_tail % ENTRIES], and the
+// process takes them from cq_head on.  The counters only ever grow.
+// usertraps.h has the same structure as trap_ring_t.
+#define TRAP_RING_ENTRIES 32
+typedef struct trap_ring_sqe {
+  int		op;		// Trap number
+  int		user_data;	// Copied to the completion
+  uint32	args[4];	// The trap's arguments, as its stub would pass them
+} trap_ring_sqe;
+typedef struct trap_ring_cqe {
+  int		user_data;
+  int		result;		// What the trap returned, -1 if it can't be batched
+} trap_ring_cqe;
+typedef struct trap_ring {
+  uint32	sq_head;	// Written by the kernel
+  uint32	sq_tail;	// Written by the process
+  uint32	cq_head;	// Written by the process
+  uint32	cq_tail;	// Written by the kernel
+  trap_ring_sqe	sq[TRAP_RING_ENTRIES];
+  trap_ring_cqe	cq[TRAP_RING_ENTRIES];
+} trap_ring;
+
 // The following are special I/O addresses for DLX.
 #define	DLX_TIMER_ADDRESS	0xfff00010
 #define	DLX_KBD_PUTCHAR		0xfff00100
@@ -112,9 +182,38 @@
 #define	DLX_KBD_NCHARSIN	0xfff001a0
 #define	DLX_KBD_INTR		0xfff001c0
 
+// Simulator clock registers, read only.  USEC is the simulated time in
+// microseconds and CYCLES the instructions executed, both since the
+// simulator started; both wrap around at 2^32.
+#define	DLX_CLOCK_USEC		0xfff00020
+#define	DLX_CLOCK_CYCLES	0xfff00024
+
+// DMA disk registers.  Program BLOCK, ADDR (physical) and COUNT, then
+// write READ or WRITE to REQUEST; STATUS says when it's done.
+#define	DLX_DMADISK_NAME	0xfff00400	// physical addr of host file name
+#define	DLX_DMADISK_BLOCK	0xfff00404
+#define	DLX_DMADISK_ADDR	0xfff00408
+#define	DLX_DMADISK_COUNT	0xfff0040c
+#define	DLX_DMADISK_REQUEST	0xfff00410
+#define	DLX_DMADISK_STATUS	0xfff00414	// write to acknowledge
+#define	DLX_DMADISK_INTR	0xfff00418	// 1 enables TRAP_DISK
+#define	DLX_DMADISK_LATENCY	0xfff0041c	// us per request
+#define	DLX_DMADISK_BLOCKLAT	0xfff00420	// us per block
+
+#define	DLX_DMADISK_READ	1
+#define	DLX_DMADISK_WRITE	2
+
+#define	DLX_DMADISK_IDLE	0
+#define	DLX_DMADISK_BUSY	1
+#define	DLX_DMADISK_DONE	2
+#define	DLX_DMADISK_ERROR	3
+
 #define	TRAP_STACK_SIZE		0x800	// interrupt stack is 2K words
 
 // Global graceful exit that is replacing exitsim
 void GracefulExit();
 
+// Run work from an interrupt handler after it, with interrupts enabled
+void TrapDefer(void (*func)(void *arg), void *arg);
+
 #endif	/* _dlxtraps_h_ */
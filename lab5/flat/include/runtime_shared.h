@@ -0,0 +1,26 @@
+#ifndef __RUNTIME_SHARED__
+#define __RUNTIME_SHARED__
+
+// The shared user runtime.  The library code every program would
+// otherwise link in (misc.o, uprintf.o and ukdata.o) is built once as
+// its own executable, RUNTIME_FILE, assembled to run at RUNTIME_ADDRESS.
+// The kernel loads it into one page at boot and maps that page into
+// every user process at PROCESS_RUNTIME_PAGE, just below the kernel
+// data page.  Programs link rtstubs.aso instead of the library: each
+// stub jumps to the function's entry in the table at the start of the
+// page, which jumps on to the function itself.  The runtime keeps no
+// data of its own that it writes, so one copy serves every process.
+//
+// Programs linked the old way (STATIC_RUNTIME=1, see apps/Makerules)
+// carry their own copy and don't need the page.
+#define RUNTIME_ADDRESS 0xe0000
+#define RUNTIME_DATA    0xe8000         // Its constants, in the same page
+#define RUNTIME_FILE    "runtime.dlx.obj"
+
+// Bytes in each entry of the jump table (j and its delay slot); entry
+// n is at RUNTIME_ADDRESS + n * RUNTIME_ENTRY_SIZE.  The order is fixed
+// by rttable.s and rtstubs.s, and only ever grows at the end, so older
+// programs keep working against a newer runtime.
+#define RUNTIME_ENTRY_SIZE 8
+
+#endif
@@ -7,6 +7,7 @@
 typedef int sem_t;
 typedef int lock_t;
 typedef int cond_t;
+typedef int rwlock_t;
 typedef int mbox_t;
 
 //---------------------------------------------------------------------
@@ -25,12 +26,19 @@ typedef int mbox_t;
 //---------------------------------------------------------------------
 
 int Open(char *filename, int arg2);
-void Printf(char *format, ...);
+void Printf(char *format, ...);        //in uprintf.o, formats here and calls console_write
+int console_write(char *buf, int len);  //trap 0x48c, puts len bytes of text on the console
 void Exit();
 
 // Related to processes
-int getpid();                           //trap 0x431
+int getpid();                           //in ukdata.o, read from the kernel data page
 void process_create(char *exec_name, int pnice, int pinfo, ...);  //trap 0x432
+// Sleeps take no CPU time: the clock wakes the process when it's due.
+// They're as precise as a jiffy (time_jiffies()), rounding up, and
+// return 0, straight away if the time has already come.
+void sleep(int seconds);                //trap 0x465
+int sleep_ms(int ms);                   //trap 0x48f
+int sleep_until(int jiffies);           //trap 0x490, until time_jiffies() reaches jiffies
 
 // Related to semaphores
 sem_t sem_create(int count);		//trap 0x450
@@ -48,14 +56,52 @@ int cond_wait(cond_t cond);		//trap 0x457
 int cond_signal(cond_t cond);		//trap 0x458
 int cond_broadcast(cond_t cond);	//trap 0x459
 
+// Related to reader-writer locks (writers are preferred)
+rwlock_t rwlock_create();		//trap 0x45a
+int rwlock_acquire_read(rwlock_t rw);	//trap 0x45b
+int rwlock_acquire_write(rwlock_t rw);	//trap 0x45c
+int rwlock_release(rwlock_t rw);	//trap 0x45d
+
 // Related to the disk
 int disk_write_block(int blocknum, char *b); //trap 0x467
 int disk_size();                        //trap 0x468
 int disk_blocksize();                   //trap 0x469
 int disk_create();                      //trap 0x470
 
+//Disk activity since boot (must match DiskStats in disk.h)
+typedef struct disk_stats {
+  int reads;                    //requests submitted
+  int writes;
+  int blocksRead;
+  int blocksWritten;
+  int trackHits;                //reads served from the track buffer
+  int trackFills;               //reads that filled it
+  int transfers;                //transfers the device saw after merging
+  int sequential;               //  that started where the last one ended
+  int random;                   //  and that had to seek
+  int seekBlocks;               //total seek distance
+  int serviceUs;                //modelled service time, 0 without -L
+  int heat[16];                 //blocks moved in each 1/16th of the disk
+} disk_stats_t;
+int disk_stats(disk_stats_t *stats);    //trap 0x478, 1 on success, -1 on failure
+int disk_write_blocks(int blocknum, int count, char *b); //trap 0x47a, bytes written or -1
+
 // Related to DFS file system
 void dfs_invalidate();                  //trap 0x471
+int dfs_sync();                         //trap 0x479, writes back the buffer cache
+int dfs_defrag(int start);              //trap 0x47b, defrags a file from inode start on and returns
+                                        //where to go on, 0 when done
+//One file as dfs_readdir lists it (must match dfs_dirent in dfs.h)
+typedef struct dfs_dirent {
+  unsigned int inode;
+  unsigned int filesize;
+  int isinline;                 //data kept in the inode, no blocks
+  char filename[44];            //DFS_MAX_FILENAME_SIZE
+} dfs_dirent_t;
+//Up to n files, with their sizes, in inode order from inode start on.
+//Returns how many it filled in, 0 past the last file, or -1; go on
+//from ents[got-1].inode + 1.
+int dfs_readdir(int start, dfs_dirent_t *ents, int n); //trap 0x492
 
 // Related to files
 unsigned int file_open(char *filename, char *mode);
@@ -64,11 +110,104 @@ int file_delete(char *filename);
 int file_read(unsigned int handle, void *mem, int num_bytes);
 int file_write(unsigned int handle, void *mem, int num_bytes);
 int file_seek(unsigned int handle, int num_bytes, int from_where);
+//Read or write at offset without using or moving the file's position
+int file_pread(unsigned int handle, void *mem, int num_bytes, int offset);  //trap 0x484
+int file_pwrite(unsigned int handle, void *mem, int num_bytes, int offset); //trap 0x485
+//Copy len bytes of src from offset to dst at its position, inside the
+//kernel.  Returns the bytes copied (short if src ends first) or -1.
+int file_copy_range(unsigned int src, unsigned int dst, int offset, int len); //trap 0x486
+//Write the file's cached data and then its inode to the disk, and
+//nothing else; file_datasync skips the inode unless the size changed.
+int file_sync(unsigned int handle);     //trap 0x487
+int file_datasync(unsigned int handle); //trap 0x488
+//File layer and DFS activity since boot (must match FileStats in files.h)
+typedef struct file_stats {
+  int opens;
+  int closes;
+  int bytesRead;                //through every kind of read
+  int bytesWritten;
+  int cacheHits;                //buffer cache
+  int cacheMisses;
+  int cacheEvictions;           //valid buffers reused for another block
+  int cacheWritebacks;
+  int cachePrefetches;
+  int blocksRead;               //DFS blocks read from the disk, metadata aside
+  int blocksWritten;
+  int readModifyWrites;         //partial block writes that read the block first
+  int allocCalls;               //block allocations; allocScanWords / allocCalls
+  int allocScanWords;           //  is the average fbv scan length in words
+  int inodeLookups;             //filename lookups
+  int inodeLookupSteps;         //inodes they compared names with
+  int journalFlushes;
+  int journalBlocks;            //inode and fbv blocks written through the journal
+} file_stats_t;
+int file_stats(file_stats_t *stats);    //trap 0x489, 1 on success, -1 on failure
+
+// Batched traps.  Fill in sq[sq_tail % TRAP_RING_ENTRIES] with a trap
+// number and its arguments, bump sq_tail, and ring_enter() runs every
+// queued entry with one trap, posting each result in cq from cq_tail
+// on; bump cq_head as they're taken.  Traps that switch processes or
+// don't return a value (exit, sleep, printf...) complete with -1.
+// Must match trap_ring in traps.h.
+#define TRAP_RING_ENTRIES 32
+typedef struct trap_ring {
+  unsigned int sq_head;         //written by the kernel
+  unsigned int sq_tail;
+  unsigned int cq_head;
+  unsigned int cq_tail;         //written by the kernel
+  struct {
+    int op;                     //trap number, e.g. 0x475 for file_read
+    int user_data;              //copied to the completion
+    unsigned int args[4];
+  } sq[TRAP_RING_ENTRIES];
+  struct {
+    int user_data;
+    int result;
+  } cq[TRAP_RING_ENTRIES];
+} trap_ring_t;
+int ring_setup(trap_ring_t *ring);      //trap 0x48a, ring must not cross a 64KB page
+int ring_enter();                       //trap 0x48b, returns the entries run or -1
+void *file_mmap(unsigned int handle, int offset, int length); //trap 0x47c, maps a page aligned range,
+                                        //returns its address or (void *)-1
+int file_munmap(void *addr);            //trap 0x47d, writes back and removes the mapping
+int file_msync(void *addr);             //trap 0x47e, writes back the mapping's dirty pages
+
+//One buffer of a vectored read or write (must match dfs_iovec in dfs.h)
+typedef struct file_iovec {
+  void *base;
+  int len;
+} file_iovec_t;
+#define FILE_MAX_IOVEC 16               //must match files_shared.h
+//Up to FILE_MAX_IOVEC buffers, filled or written one after the other
+//with one trap.  Return the bytes moved, or -1 as file_read/file_write.
+int file_readv(unsigned int handle, file_iovec_t *iov, int iovcnt);  //trap 0x47f
+int file_writev(unsigned int handle, file_iovec_t *iov, int iovcnt); //trap 0x480
+//Queue a read or write from the file's position and return a ticket
+//without waiting; the position moves on right away.  The buffer must
+//be left alone until file_wait(ticket) returns the bytes moved (or -1).
+//A process that exits waits for its requests first.
+int file_read_async(unsigned int handle, void *mem, int num_bytes);  //trap 0x481
+int file_write_async(unsigned int handle, void *mem, int num_bytes); //trap 0x482
+int file_wait(int ticket);                                           //trap 0x483
+
 
 
+// Monotonic clock.  Both wrap at 2^32; the difference of two readings
+// taken as an unsigned int is right across a wrap.
+unsigned int clock_usec();              //trap 0x48d, simulated microseconds
+unsigned int clock_cycles();            //trap 0x48e, instructions executed
+// The same without a trap, from the kernel data page, so only as of the
+// last time the kernel ran (see kdata_shared.h)
+int time_jiffies();                     //in ukdata.o
+unsigned int time_usec();               //in ukdata.o
 
 // Miscellaneous traps
+int trap_profile();                     //trap 0x4FE, prints the calls and microseconds of every
+                                        //trap so far and returns the total calls
+int evlog_dump();                       //trap 0x4FD, prints and empties the kernel event log
+                                        //(the OS must be run with -E to fill it)
 void run_os_tests();
+void run_os_benchmarks();                //trap 0x491, times the file system; leaves no files
 
 #ifndef NULL
 #define NULL (void *)0x0
@@ -10,11 +10,24 @@
 
 // Definition: a "jiffy" is defined as the minimum clock resolution.  For instance,
 // if timer interrupts are set to go off every 1 millisecond, then 1 jiffy = 1 milliseond.
+//
+// The clock is tickless: the timer isn't set to go off every jiffy, but
+// only when something is due, which is the end of the running process's
+// quantum if another process is waiting to run, or the first sleeping
+// process's wake up time (see ClkWakeAt).  With one runnable process
+// (or none) and nobody asleep there are no timer interrupts at all.
+// Jiffies are worked out from the microsecond clock when they're asked
+// for.
 
-static int curtime = 0;              // The number of "jiffies" that have passed
 static int clock_resolution = CLOCK_DEFAULT_RESOLUTION;   // Number of microseconds in one "jiffy"
 static int clock_running = 0;        // Flag to enable starting/stopping clock
-static int last_trigger_jiffies = 0; // Keeps track of last time we triggered ProcessSchedule
+static uint32 start_usec = 0;        // Simulator time when the clock was started
+static uint32 quantum_end = 0;       // When the running process's quantum is up
+static int quantum_timed = 0;        // ... if it's sharing the CPU, so that matters
+static uint32 wake_usec = 0;         // When the first sleeping process wakes
+static int wake_pending = 0;         // ... if there is one
+static uint32 timer_usec = 0;        // When the timer goes off
+static int timer_armed = 0;          // ... if a timer interrupt is on its way
 
 //-------------------------------------------------------------
 //
@@ -24,17 +37,45 @@ static int last_trigger_jiffies = 0; // Keeps track of last time we triggered Pr
 //
 //-------------------------------------------------------------
 void ClkModuleInit() {
-  curtime = 0;
   clock_resolution = CLOCK_DEFAULT_RESOLUTION; // 100 usec per jiffy
   clock_running = 0;
+  quantum_timed = 0;
+  wake_pending = 0;
+  timer_armed = 0;
+}
+
+//-------------------------------------------------------------
+// ClkQuantum is the length of a process quantum in
+// microseconds.  ClkArm sets the timer to go off at when (or
+// right away if that's past), unless it's already set to go off
+// sooner; an interrupt that comes before what it was for is
+// sorted out by ClkInterrupt.
+//-------------------------------------------------------------
+static inline uint32 ClkQuantum() {
+  return CLOCK_PROCESS_JIFFIES * clock_resolution;
+}
+
+static void ClkArm(uint32 when) {
+  int usec = (int)(when - ClkGetUsec());
+
+  if (timer_armed && ((int)(timer_usec - when) <= 0)) {
+    return;
+  }
+  if (usec < 1) {
+    usec = 1;
+  }
+  timer_armed = 1;
+  timer_usec = ClkGetUsec() + usec;
+  *((int *)DLX_TIMER_ADDRESS) = usec; // in microseconds
 }
 
 //-------------------------------------------------------------
-// ClkStart starts timer interrupts 
+// ClkStart starts the clock.  The first quantum starts now.
 //-------------------------------------------------------------
 void ClkStart() {
   clock_running = 1;
-  *((int *)DLX_TIMER_ADDRESS) = clock_resolution; // in microseconds
+  start_usec = ClkGetUsec();
+  ClkResetProcess();
   dbprintf('c', "ClkStart: clock started\n");
 }
 
@@ -45,28 +86,71 @@ void ClkStop() {
   clock_running = 0;
 }
 
+//-------------------------------------------------------------
+// ClkUpdate is called when a process becomes runnable.  If the
+// running process had the CPU to itself its quantum starts
+// now, and the timer is set for the end of it.
+//-------------------------------------------------------------
+void ClkUpdate() {
+  if (clock_running && !quantum_timed && (ProcessRunnableCount() > 1)) {
+    quantum_end = ClkGetUsec() + ClkQuantum();
+    quantum_timed = 1;
+    ClkArm(quantum_end);
+  }
+}
+
+//-------------------------------------------------------------
+// ClkWakeAt sets the timer for jiffies, when a sleeping
+// process is due to wake, if nothing else is due before then.
+// ClkInterrupt calls ProcessWakeSleepers when it comes, which
+// calls this again for the next one.
+//-------------------------------------------------------------
+void ClkWakeAt(int jiffies) {
+  uint32 when = start_usec + jiffies * clock_resolution;
+
+  if (!wake_pending || ((int)(when - wake_usec) < 0)) {
+    wake_usec = when;
+    wake_pending = 1;
+  }
+  if (clock_running) {
+    ClkArm(wake_usec);
+  }
+}
+
 //-------------------------------------------------------------
 // ClkInterrupt is called in traps.c when a timer interrupt
-// occurs.  Returns 1 if enough jiffies have passed to 
-// trigger a call to ProcessSchedule.  Returns 0 otherwise.
+// occurs.  It wakes the sleeping processes that are due, then
+// returns 1 if the running process's quantum is up and another
+// process is waiting, so ProcessSchedule should be called.
+// Returns 0 otherwise.  An interrupt set for a quantum that was
+// cut short by a process switch comes early, and just sets the
+// timer again for the rest of the new one.
 //-------------------------------------------------------------
 int ClkInterrupt() {
-  if (clock_running) {
-    curtime++;
-    // Set the timer to go off again so that it can be
-    // ticking away while we're in ProcessSchedule.
-    *((int *)DLX_TIMER_ADDRESS) = clock_resolution;
-
-    // Now check to see if enough jiffies have occurred to trigger
-    // another ProcessSchedule
-    if (curtime - last_trigger_jiffies > CLOCK_PROCESS_JIFFIES) {
-      last_trigger_jiffies = curtime;
-      dbprintf('c', "ClkInterrupt: calling ProcessSchedule\n");
-      return 1; // can call ProcessSchedule
-    }
+  timer_armed = 0;
+  if (!clock_running) {
+    return 0;
+  }
+  if (wake_pending && ((int)(wake_usec - ClkGetUsec()) <= 0)) {
+    wake_pending = 0;
+    ProcessWakeSleepers();
+  }
+  if (wake_pending) {
+    ClkArm(wake_usec);
+  }
+  if (ProcessRunnableCount() <= 1) {
+    quantum_timed = 0;
+    return 0; // Nothing else to run, so no need for the quantum
+  }
+  if ((int)(quantum_end - ClkGetUsec()) > 0) {
+    ClkArm(quantum_end);
     return 0; // too soon to call ProcessSchedule
   }
-  return 0; // Clock isn't running, so don't call ProcessSchedule
+  // The next process gets a full quantum
+  quantum_end = ClkGetUsec() + ClkQuantum();
+  ClkArm(quantum_end);
+  dbprintf('c', "ClkInterrupt: calling ProcessSchedule\n");
+  return 1;
 }
 
 //-------------------------------------------------------------
@@ -87,14 +171,12 @@ inline int ClkGetResolution() {
 
 //-------------------------------------------------------------
 // ClkGetCurTime returns the number of seconds (and fractional 
-// seconds) since the clock started.  Note that this is 
-// inaccurate if the clock resolution was ever changed after 
-// calling ClkStart.
+// seconds) since the clock started.  It comes from the
+// simulator's microsecond clock, so changing the resolution
+// doesn't throw it off, but it wraps after about 71 minutes.
 //-------------------------------------------------------------
 inline double ClkGetCurTime() {
-  // First convert clock_resolution to seconds (divide by 1 million),
-  // then multiply by number of jiffies.
-  return (double)clock_resolution / (double)1000000 * (double)curtime;
+  return (double)ClkUsecSince(start_usec) / (double)1000000;
 }
 
 //-------------------------------------------------------------
@@ -102,12 +184,41 @@ inline double ClkGetCurTime() {
 // passed since the clock started.
 //-------------------------------------------------------------
 inline int ClkGetCurJiffies() {
-  return curtime;
+  return clock_running ? ClkUsecSince(start_usec) / clock_resolution : 0;
 }
 
 //-------------------------------------------------------------
-// ClkResetProcess resets the process jiffies counter
+// ClkGetUsec and ClkGetCycles read the simulator's clock
+// registers: microseconds of simulated time and instructions
+// executed.  They never go backwards, apart from wrapping at
+// 2^32, and unlike jiffies they don't depend on timer
+// interrupts, so they can time anything down to a few
+// instructions.  Take the difference of two readings as a
+// uint32 (or use ClkUsecSince) and the wrap takes care of
+// itself.
+//-------------------------------------------------------------
+inline uint32 ClkGetUsec() {
+  return *((volatile uint32 *)DLX_CLOCK_USEC);
+}
+
+inline uint32 ClkGetCycles() {
+  return *((volatile uint32 *)DLX_CLOCK_CYCLES);
+}
+
+inline uint32 ClkUsecSince(uint32 start) {
+  return ClkGetUsec() - start;
+}
+
+//-------------------------------------------------------------
+// ClkResetProcess starts a new quantum, for a process that was
+// just switched to.  The timer is set for the end of it if it
+// isn't on its way already; if it is, it comes early and
+// ClkInterrupt sets it again.
 //-------------------------------------------------------------
 void ClkResetProcess() {
-  last_trigger_jiffies = curtime;
+  quantum_end = ClkGetUsec() + ClkQuantum();
+  quantum_timed = (ProcessRunnableCount() > 1);
+  if (clock_running && quantum_timed) {
+    ClkArm(quantum_end);
+  }
 }
@@ -0,0 +1,287 @@
+//
+//	coroutine.c
+//
+//	User level coroutines, their M:1 scheduler and channels (see
+//	coroutine.h).  This is part of the user library, not the
+//	operating system: every switch is a call to coro_switch in
+//	coroswitch.s.
+//
+
+#include "usertraps.h"
+#include "coroutine.h"
+
+#ifndef NULL
+#define NULL (void *)0x0
+#endif
+
+#define CORO_READY	1
+#define CORO_BLOCKED	2
+#define CORO_DEAD	3
+
+// Size of the register frame coro_switch pushes
+#define CORO_FRAME_BYTES	248
+// Offset of saved r31 in that frame
+#define CORO_FRAME_R31		112
+
+extern void coro_switch (unsigned int *savesp, unsigned int newsp);
+extern void coro_entry ();
+
+static coro_t		coroMain;	// The code that called coro_init
+static coro_t		*coroCurrent = NULL;
+static coro_queue	coroReady;
+
+//----------------------------------------------------------------------
+//
+//	CoroPut / CoroGet
+//
+//	Append to / take from the head of a FIFO of coroutines.
+//
+//----------------------------------------------------------------------
+static void CoroPut (coro_queue *q, coro_t *c) {
+  c->next = NULL;
+  if (q->tail == NULL) {
+    q->head = c;
+  } else {
+    q->tail->next = c;
+  }
+  q->tail = c;
+}
+
+static coro_t *CoroGet (coro_queue *q) {
+  coro_t	*c = q->head;
+
+  if (c != NULL) {
+    q->head = c->next;
+    if (q->head == NULL) {
+      q->tail = NULL;
+    }
+  }
+  return (c);
+}
+
+//----------------------------------------------------------------------
+//
+//	CoroSwitchTo
+//
+//	Run coroutine c; the current one must already be on a queue (or
+//	dead), or it never runs again.
+//
+//----------------------------------------------------------------------
+static void CoroSwitchTo (coro_t *c) {
+  coro_t	*prev = coroCurrent;
+
+  c->state = CORO_READY;
+  coroCurrent = c;
+  coro_switch (&prev->sp, c->sp);
+}
+
+//----------------------------------------------------------------------
+//
+//	CoroBlock
+//
+//	The current coroutine waits on some queue: run the next ready
+//	one.  With none ready nothing could ever wake it up.
+//
+//----------------------------------------------------------------------
+static void CoroBlock () {
+  coro_t	*next = CoroGet (&coroReady);
+
+  if (next == NULL) {
+    Printf ("coro: every coroutine is blocked, exiting\n");
+    Exit ();
+  }
+  coroCurrent->state = CORO_BLOCKED;
+  CoroSwitchTo (next);
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_init
+//
+//	Make the caller the first coroutine.  It keeps running on the
+//	process's own stack.
+//
+//----------------------------------------------------------------------
+void coro_init () {
+  coroReady.head = coroReady.tail = NULL;
+  coroMain.state = CORO_READY;
+  coroMain.next = NULL;
+  coroCurrent = &coroMain;
+}
+
+coro_t *coro_self () {
+  return (coroCurrent);
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_create
+//
+//	Set up c to run func(arg) on the stacksize bytes at stack and
+//	put it on the ready queue.  The first switch to it "returns"
+//	from coro_switch into coro_entry.
+//
+//----------------------------------------------------------------------
+int coro_create (coro_t *c, void (*func)(void *), void *arg, void *stack, int stacksize) {
+  unsigned int	sp;
+  int		i;
+
+  if ((coroCurrent == NULL) || (stacksize < CORO_MIN_STACK)) {
+    return (CORO_FAIL);
+  }
+  // Leave room above the frame for coro_main's caller area, and keep
+  // the frame double aligned
+  sp = ((unsigned int)stack + stacksize - 16) & ~7;
+  sp -= CORO_FRAME_BYTES;
+  for (i = 0; i < CORO_FRAME_BYTES; i += 4) {
+    *((unsigned int *)(sp + i)) = 0;
+  }
+  *((unsigned int *)(sp + CORO_FRAME_R31)) = (unsigned int)coro_entry;
+  c->sp = sp;
+  c->func = func;
+  c->arg = arg;
+  c->state = CORO_READY;
+  CoroPut (&coroReady, c);
+  return (CORO_SUCCESS);
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_main
+//
+//	Called from coro_entry when a coroutine first runs.
+//
+//----------------------------------------------------------------------
+void coro_main () {
+  coroCurrent->func (coroCurrent->arg);
+  coro_exit ();
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_yield
+//
+//	Let the other ready coroutines run; returns at once if there are
+//	none.
+//
+//----------------------------------------------------------------------
+void coro_yield () {
+  coro_t	*next = CoroGet (&coroReady);
+
+  if (next == NULL) {
+    return;
+  }
+  CoroPut (&coroReady, coroCurrent);
+  CoroSwitchTo (next);
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_exit
+//
+//	End the current coroutine.  The first coroutine (the one that
+//	called coro_init) ends the process instead.
+//
+//----------------------------------------------------------------------
+void coro_exit () {
+  coro_t	*next;
+
+  if (coroCurrent == &coroMain) {
+    Exit ();
+  }
+  coroCurrent->state = CORO_DEAD;
+  if ((next = CoroGet (&coroReady)) == NULL) {
+    Printf ("coro: every coroutine is blocked, exiting\n");
+    Exit ();
+  }
+  CoroSwitchTo (next);
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_run
+//
+//	Yield until nothing else is ready, i.e. every other coroutine has
+//	ended (or is blocked forever).
+//
+//----------------------------------------------------------------------
+void coro_run () {
+  while (coroReady.head != NULL) {
+    coro_yield ();
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_chan_init
+//
+//----------------------------------------------------------------------
+void coro_chan_init (coro_chan_t *ch, void **buf, int size) {
+  ch->buf = buf;
+  ch->size = size;
+  ch->head = ch->count = 0;
+  ch->senders.head = ch->senders.tail = NULL;
+  ch->receivers.head = ch->receivers.tail = NULL;
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_chan_send
+//
+//	Hand value to a waiting receiver, or buffer it, or wait until a
+//	receiver takes it.  A woken receiver runs at its turn on the
+//	ready queue; the sender keeps going.
+//
+//----------------------------------------------------------------------
+void coro_chan_send (coro_chan_t *ch, void *value) {
+  coro_t	*c;
+
+  if ((c = CoroGet (&ch->receivers)) != NULL) {
+    c->msg = value;
+    c->state = CORO_READY;
+    CoroPut (&coroReady, c);
+  } else if (ch->count < ch->size) {
+    ch->buf[(ch->head + ch->count) % ch->size] = value;
+    ch->count++;
+  } else {
+    coroCurrent->msg = value;
+    CoroPut (&ch->senders, coroCurrent);
+    CoroBlock ();
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	coro_chan_recv
+//
+//	Take the oldest value from the channel, waiting if it's empty.
+//	Taking one from the buffer lets the first blocked sender's value
+//	in behind it.
+//
+//----------------------------------------------------------------------
+void *coro_chan_recv (coro_chan_t *ch) {
+  coro_t	*c;
+  void		*value;
+
+  if (ch->count > 0) {
+    value = ch->buf[ch->head];
+    ch->head = (ch->head + 1) % ch->size;
+    ch->count--;
+    if ((c = CoroGet (&ch->senders)) != NULL) {
+      ch->buf[(ch->head + ch->count) % ch->size] = c->msg;
+      ch->count++;
+      c->state = CORO_READY;
+      CoroPut (&coroReady, c);
+    }
+    return (value);
+  }
+  if ((c = CoroGet (&ch->senders)) != NULL) {
+    // Unbuffered channel
+    c->state = CORO_READY;
+    CoroPut (&coroReady, c);
+    return (c->msg);
+  }
+  CoroPut (&ch->receivers, coroCurrent);
+  CoroBlock ();
+  return (coroCurrent->msg);
+}
@@ -5,10 +5,64 @@
 #include "disk.h"
 #include "dfs.h"
 #include "synch.h"
+#include "memory.h"
+#include "evlog.h"
 
-static dfs_inode inodes[DFS_NUM_INODES]; 			// all inodes
+static dfs_inode *inodes = NULL; 					// all inodes, sb.num_inodes of them
 static dfs_superblock sb; 							// superblock
-static uint32 fbv[DFS_FBV_MAX_NUM_WORDS]; 			// Free block vector
+static uint32 *fbv = NULL; 							// Free block vector
+static int fbv_words = 0; 							// Words in fbv
+
+// The inodes and fbv are sized by the superblock, so they live in one
+// run of pages taken when the file system is opened: the inode blocks
+// as they are on the disk, then the fbv blocks, so the copy of
+// metadata block b is (b - sb.dfs_start_block_inodes) blocks in.
+static int inode_bytes = 0;
+static int fbv_bytes = 0;
+static int meta_page = 0;
+static int meta_pages = 0;
+static int extent_block_extents = 0; 	// Extents an extent block holds
+
+// Filename index.  inode_next chains the inodes in use by a hash of
+// their names from name_hash[], and the free ones from inode_free, so
+// neither an open nor an allocation scans the table.  It lives after
+// the fbv in the same pages and is covered by inode_lock like the
+// inuse flags.
+//
+// The inode blocks aren't read when the file system is opened.  Only
+// the first sb.dfs_inodes_used inodes can be in use, and the rest
+// start out on the free list as zeros; the blocks holding the others
+// are read and indexed in one request by the first lookup
+// (DfsIndexLoad), so opening costs nothing however many inodes there
+// are.
+static int *inode_next = NULL;
+static int name_hash[DFS_NAME_HASH_BUCKETS];
+static int inode_free = -1;
+static uint32 inode_unloaded = 0; 	// Inodes below this haven't been read yet
+static int sb_dirty = 0; 			// dfs_inodes_used grew since the superblock was written
+
+// Free block summary: bit w of fbv_summary is set while fbv[w] has a
+// free block, so a search skips 32 full words per summary word.  An
+// allocation without a hint starts at fbv_cursor, the word the last
+// one came from.  It follows inode_next in the metadata pages and,
+// like fbv and sb.dfs_free_blocks, is covered by fbv_lock.
+static uint32 *fbv_summary = NULL;
+static int fbv_summary_words = 0;
+static int fbv_cursor = 0;
+
+// Metadata flushing.  meta_dirty has a flag for every inode and fbv
+// block, counting from the first inode block, set when the copy in
+// memory changes; DfsMetadataFlush writes only the flagged ones,
+// through the journal.  It's last in the metadata pages but for
+// inode_changed, which flags each inode whose size or blocks changed
+// since its block was last written, so DfsInodeSync can tell whether
+// a file's own metadata needs writing.  journal_lock keeps two flushes
+// from using the journal at once.
+static char *meta_dirty = NULL;
+static char *inode_changed = NULL;
+static int meta_blocks = 0;
+static uint32 journal_sequence = 0;
+static lock_t journal_lock;
 
 static int negativeone = 0xFFFFFFFF;
 static inline uint32 invert (uint32 n) {
@@ -18,7 +72,81 @@ static inline uint32 invert (uint32 n) {
 // You have already been told about the most likely places where you should use locks. You may use 
 // additional locks if it is really necessary.
 static lock_t fbv_lock;
-static lock_t inode_lock;
+// Lookups far outnumber allocations, so the inode table is guarded by
+// a reader-writer lock: opens can search it at the same time, and only
+// changes to an inode's inuse flag need it exclusively.
+static rwlock_t inode_lock;
+// What an inode maps its blocks to, and its size, are changed only
+// with the inode's lock held: one of DFS_INODE_LOCKS, picked by the
+// inode number, since there aren't enough locks for one per inode.
+// Writes to different files (mostly) don't wait for each other, and a
+// file's own writers and deleters take turns.  Readers take it only
+// to translate a block; filesize is one word and read without it.
+static lock_t inode_locks[DFS_INODE_LOCKS];
+
+// The buffer cache.  DfsReadBlock and DfsWriteBlock work on copies of
+// blocks kept in cache[], found through a hash on the block number.
+// The least recently used buffer is the one reused on a miss, after
+// writing it back if it's dirty; dirty buffers are also written back
+// by DfsSync and when the file system is closed.  cache_lock covers
+// all of it, including the disk I/O done on a buffer's behalf.
+typedef struct dfs_buffer {
+	uint32 blocknum;
+	int valid; 						// Holds blocknum's contents
+	int dirty; 						// Newer than the disk
+	volatile int filling; 			// Read-ahead still on its way in
+	volatile int fill_failed; 		// ... and it didn't make it
+	struct dfs_buffer *hash_next;
+	struct dfs_buffer *lru_prev; 	// Towards the most recently used
+	struct dfs_buffer *lru_next;
+	char *data; 					// sb.dfs_blocksize bytes in the metadata pages
+} dfs_buffer;
+
+static dfs_buffer cache[DFS_CACHE_MAX_BUFFERS];
+static dfs_buffer *cache_hash[DFS_CACHE_HASH_BUCKETS];
+static dfs_buffer *cache_mru = NULL; 	// Head of the LRU list
+static dfs_buffer *cache_lru = NULL; 	// Its tail, the next to be reused
+static int cache_buffers = 0; 			// Buffers in use, 0 with no cache
+static lock_t cache_lock;
+// A read-ahead's completion wakes the one process (it holds cache_lock)
+// waiting for a buffer to fill, if cache_fill_waiting says there is one
+static Sem cache_fill;
+static volatile int cache_fill_waiting = 0;
+
+int dfsCacheBuffers = DFS_CACHE_BUFFERS;
+
+// Decoded extent lists of the inodes used most recently that have an
+// extent block, so translating their later blocks doesn't read and
+// walk that block each time.  ends[i] is the virtual block just past
+// ext[i], which makes a lookup a binary search.  Entries are kept up
+// to date by DfsExtentsStore and dropped on delete; extent_lock
+// covers them.
+typedef struct dfs_extent_map {
+	int handle; 					// -1 if unused
+	int n;
+	uint32 used; 					// extent_clock at the last lookup
+	dfs_extent ext[DFS_MAX_EXTENTS];
+	uint32 ends[DFS_MAX_EXTENTS];
+} dfs_extent_map;
+
+static dfs_extent_map extent_maps[DFS_EXTENT_MAPS];
+static uint32 extent_clock = 0;
+static lock_t extent_lock;
+
+// Counters DfsGetStats hands out, bumped where the things they count
+// happen.  They're statistics, so they don't get a lock of their own.
+static DfsStats dfs_stats;
+
+static void DfsCacheReset();
+static void DfsExtentMapReset();
+static void DfsInodeDirty(uint32 handle);
+static int DfsMetadataFlush(int only);
+static uint32 DfsInodeMapBlock(uint32 handle, uint32 virtual_blocknum, int want);
+static int DfsInodeUninline(uint32 handle);
+static uint32 DfsInodeLookupBlock(uint32 handle, uint32 virtual_blocknum);
+static void DfsIndexBuild();
+static int DfsWriteSuperblock();
+static void DfsSummaryBuild();
 
 // STUDENT: put your file system level functions below.
 // Some skeletons are provided. You can implement additional functions.
@@ -29,9 +157,69 @@ inline void SetFBV (int p, int b)
   uint32  bitnum = p % 32;
 
   fbv[wd] = (fbv[wd] & invert(1 << bitnum)) | (b << bitnum);
+  meta_dirty[sb.dfs_start_block_fbv + (wd * 4) / sb.dfs_blocksize - sb.dfs_start_block_inodes] = 1;
+  if (fbv[wd] != 0) {
+    fbv_summary[wd / 32] |= (1 << (wd % 32));
+  } else {
+    fbv_summary[wd / 32] &= invert(1 << (wd % 32));
+  }
   dbprintf ('Q', "Set fbv entry %d to 0x%x.\n", wd, fbv[wd]);
 }
 
+//-----------------------------------------------------------------
+// DfsSummaryBuild sets up the free block summary and count from the
+// fbv just read from the disk.  The count in the superblock is only
+// a copy; the fbv is what's trusted.
+//-----------------------------------------------------------------
+
+static void DfsSummaryBuild() {
+	uint32 nfree = 0;
+	uint32 v;
+	int i;
+
+	for (i = 0; i < fbv_summary_words; i++) {
+		fbv_summary[i] = 0;
+	}
+	for (i = 0; i < fbv_words; i++) {
+		if ((v = fbv[i]) != 0) {
+			fbv_summary[i / 32] |= (1 << (i % 32));
+			for (; v != 0; v &= v - 1) {
+				nfree++;
+			}
+		}
+	}
+	if (nfree != sb.dfs_free_blocks) {
+		dbprintf('Q', "DfsSummaryBuild: superblock said %d free blocks, fbv has %d.\n", sb.dfs_free_blocks, nfree);
+	}
+	sb.dfs_free_blocks = nfree;
+	fbv_cursor = 0;
+}
+
+//-----------------------------------------------------------------
+// DfsSummaryFind returns the first free block in an fbv word at or
+// after word start, wrapping around to the words before it, or -1
+// if there isn't one.  The caller holds fbv_lock.
+//-----------------------------------------------------------------
+
+static int DfsSummaryFind(int start) {
+	uint32 v;
+	int i, w;
+
+	for (i = 0; i <= fbv_summary_words; i++) {
+		w = (start / 32 + i) % fbv_summary_words;
+		v = fbv_summary[w];
+		if (i == 0) {
+			v &= invert((1 << (start % 32)) - 1);
+		}
+		if (v != 0) {
+			dfs_stats.allocScanWords += i + 1;
+			return w * 32 + dffs(v);
+		}
+	}
+	dfs_stats.allocScanWords += i;
+	return -1;
+}
+
 ///////////////////////////////////////////////////////////////////
 // Non-inode functions first
 ///////////////////////////////////////////////////////////////////
@@ -44,10 +232,20 @@ inline void SetFBV (int p, int b)
 void DfsModuleInit() {
 // You essentially set the file system as invalid and then open 
 // using DfsOpenFileSystem().
+	int i;
+
 	dbprintf('Q', "DfsModuleInit begin.\n");
 	DfsInvalidate();
 	fbv_lock = LockCreate();
-	inode_lock = LockCreate();
+	inode_lock = RwLockCreate();
+	for (i = 0; i < DFS_INODE_LOCKS; i++) {
+		inode_locks[i] = LockCreate();
+	}
+	cache_lock = LockCreate();
+	SemInit(&cache_fill, 0);
+	journal_lock = LockCreate();
+	extent_lock = LockCreate();
+	EvlogBootPhase("dfs setup");
 	DfsOpenFileSystem();
 	dbprintf('Q', "DfsModuleInit end.\n");
 }
@@ -64,6 +262,525 @@ void DfsInvalidate() {
 // superblock to 0.
 	//printf("DfsInvalidate: superblock invalidated.\n");
 	sb.valid = 0;
+	// Whatever is about to be written to the disk directly replaces
+	// what's cached, so drop it all, dirty or not
+	DfsCacheReset();
+	DfsExtentMapReset();
+	MemoryFileCacheDrop(-1);
+}
+
+//-----------------------------------------------------------------
+// Buffer cache helpers.  Except for DfsCacheReset, the caller holds
+// cache_lock.
+//-----------------------------------------------------------------
+
+// DfsCacheReset empties the cache without writing anything back and
+// sizes it to dfsCacheBuffers.
+static int DfsCacheWait(dfs_buffer *buf);
+
+static void DfsCacheReset() {
+	int i;
+
+	//Nothing may still be coming in from the disk
+	for (i = 0; i < DFS_CACHE_MAX_BUFFERS; i++) {
+		if (cache[i].filling) {
+			DfsCacheWait(&cache[i]);
+		}
+	}
+	cache_buffers = dfsCacheBuffers;
+	if (cache_buffers > DFS_CACHE_MAX_BUFFERS) {
+		cache_buffers = DFS_CACHE_MAX_BUFFERS;
+	} else if (cache_buffers < 0) {
+		cache_buffers = 0;
+	}
+	for (i = 0; i < DFS_CACHE_HASH_BUCKETS; i++) {
+		cache_hash[i] = NULL;
+	}
+	cache_mru = cache_lru = NULL;
+	for (i = 0; i < cache_buffers; i++) {
+		cache[i].valid = 0;
+		cache[i].dirty = 0;
+		cache[i].filling = 0;
+		cache[i].fill_failed = 0;
+		cache[i].hash_next = NULL;
+		cache[i].lru_prev = cache_lru;
+		cache[i].lru_next = NULL;
+		if (cache_lru != NULL) {
+			cache_lru->lru_next = &cache[i];
+		} else {
+			cache_mru = &cache[i];
+		}
+		cache_lru = &cache[i];
+	}
+}
+
+// DfsCacheTouch moves buf to the most recently used end of the list.
+static void DfsCacheTouch(dfs_buffer *buf) {
+	if (buf == cache_mru) {
+		return;
+	}
+	buf->lru_prev->lru_next = buf->lru_next;
+	if (buf->lru_next != NULL) {
+		buf->lru_next->lru_prev = buf->lru_prev;
+	} else {
+		cache_lru = buf->lru_prev;
+	}
+	buf->lru_prev = NULL;
+	buf->lru_next = cache_mru;
+	cache_mru->lru_prev = buf;
+	cache_mru = buf;
+}
+
+// DfsCacheLookup returns the buffer for blocknum, or NULL, even if
+// it's still filling.
+static dfs_buffer *DfsCacheLookup(uint32 blocknum) {
+	dfs_buffer *buf;
+
+	for (buf = cache_hash[blocknum % DFS_CACHE_HASH_BUCKETS]; buf != NULL; buf = buf->hash_next) {
+		if (buf->blocknum == blocknum) {
+			return buf;
+		}
+	}
+	return NULL;
+}
+
+static void DfsCacheUnhash(dfs_buffer *buf);
+
+// DfsCacheFilled is called from the disk interrupt when a read-ahead
+// into buf is done.  The hash chains are left alone, since whoever
+// holds cache_lock may be walking them.
+static void DfsCacheFilled(void *arg, int ok) {
+	dfs_buffer *buf = (dfs_buffer *)arg;
+
+	buf->fill_failed = !ok;
+	buf->filling = 0;
+	if (cache_fill_waiting) {
+		cache_fill_waiting = 0;
+		SemSignal(&cache_fill);
+	}
+}
+
+// DfsCacheWait waits for a read-ahead into buf to finish.  If it
+// failed, buf is taken out of the cache and 0 is returned.
+static int DfsCacheWait(dfs_buffer *buf) {
+	uint32 intrvals = DisableIntrs();
+
+	while (buf->filling) {
+		cache_fill_waiting = 1;
+		SemWait(&cache_fill);
+	}
+	RestoreIntrs(intrvals);
+	if (buf->fill_failed) {
+		DfsCacheUnhash(buf);
+		return 0;
+	}
+	return 1;
+}
+
+// DfsCacheFind returns the buffer holding blocknum, or NULL, waiting
+// for it first if it's being read ahead.
+static dfs_buffer *DfsCacheFind(uint32 blocknum) {
+	dfs_buffer *buf;
+
+	if ((buf = DfsCacheLookup(blocknum)) == NULL) {
+		return NULL;
+	}
+	if ((buf->filling || buf->fill_failed) && !DfsCacheWait(buf)) {
+		return NULL;
+	}
+	return buf;
+}
+
+// DfsCacheUnhash takes buf out of its hash chain and marks it empty.
+static void DfsCacheUnhash(dfs_buffer *buf) {
+	dfs_buffer **pp = &cache_hash[buf->blocknum % DFS_CACHE_HASH_BUCKETS];
+
+	while (*pp != buf) {
+		pp = &((*pp)->hash_next);
+	}
+	*pp = buf->hash_next;
+	buf->hash_next = NULL;
+	buf->valid = 0;
+	buf->dirty = 0;
+	buf->fill_failed = 0;
+}
+
+// DfsCacheWriteBack writes buf to the disk if it's dirty.
+static int DfsCacheWriteBack(dfs_buffer *buf) {
+	int m = sb.dfs_blocksize / DISK_BLOCKSIZE;
+
+	if (buf->valid && buf->dirty) {
+		if (DiskWriteBlocks(buf->blocknum * m, m, buf->data) == DISK_FAIL) {
+			printf("DfsCacheWriteBack: Error could not write block %d.\n", buf->blocknum);
+			return DFS_FAIL;
+		}
+		buf->dirty = 0;
+		dfs_stats.cacheWritebacks++;
+		dfs_stats.blocksWritten++;
+	}
+	return DFS_SUCCESS;
+}
+
+// DfsCacheGet returns the buffer for blocknum, reusing the least
+// recently used one on a miss.  If fill is set the block is read into
+// it; otherwise the caller is about to overwrite all of it.  Returns
+// NULL if the disk fails.
+static dfs_buffer *DfsCacheGet(uint32 blocknum, int fill) {
+	int m = sb.dfs_blocksize / DISK_BLOCKSIZE;
+	dfs_buffer *buf;
+
+	if ((buf = DfsCacheFind(blocknum)) != NULL) {
+		dfs_stats.cacheHits++;
+		DfsCacheTouch(buf);
+		return buf;
+	}
+	dfs_stats.cacheMisses++;
+	buf = cache_lru;
+	if (buf->filling) {
+		DfsCacheWait(buf);
+	}
+	if (DfsCacheWriteBack(buf) == DFS_FAIL) {
+		return NULL;
+	}
+	if (buf->valid) {
+		DfsCacheUnhash(buf);
+		dfs_stats.cacheEvictions++;
+	}
+	if (fill) {
+		if (DiskReadBlocks(blocknum * m, m, buf->data) == DISK_FAIL) {
+			return NULL;
+		}
+		dfs_stats.blocksRead++;
+	}
+	buf->blocknum = blocknum;
+	buf->valid = 1;
+	buf->hash_next = cache_hash[blocknum % DFS_CACHE_HASH_BUCKETS];
+	cache_hash[blocknum % DFS_CACHE_HASH_BUCKETS] = buf;
+	DfsCacheTouch(buf);
+	return buf;
+}
+
+// DfsCacheFlush writes back every dirty buffer.
+static int DfsCacheFlush() {
+	int i;
+	int result = DFS_SUCCESS;
+
+	for (i = 0; i < cache_buffers; i++) {
+		if (DfsCacheWriteBack(&cache[i]) == DFS_FAIL) {
+			result = DFS_FAIL;
+		}
+	}
+	return result;
+}
+
+//-----------------------------------------------------------------
+// DfsSync writes every dirty buffer in the cache to the disk, then
+// the inode and fbv blocks that changed since the last sync.
+// Returns DFS_SUCCESS, or DFS_FAIL if any of them couldn't be.
+//-----------------------------------------------------------------
+
+int DfsSync() {
+	int result;
+
+	if (!sb.valid) {
+		printf("DfsSync: Error cannot sync if file system is invalid.\n");
+		return DFS_FAIL;
+	}
+	if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+		printf("DfsSync bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	result = DfsCacheFlush();
+	LockHandleRelease(cache_lock);
+	if (result == DFS_FAIL) {
+		return DFS_FAIL;
+	}
+	//Then the metadata pointing at that data
+	if (LockHandleAcquire(journal_lock) != SYNC_SUCCESS) {
+		printf("DfsSync bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	result = DfsMetadataFlush(-1);
+	LockHandleRelease(journal_lock);
+	return result;
+}
+
+//-----------------------------------------------------------------
+// DfsGetStats copies out the DFS statistics since boot.
+//-----------------------------------------------------------------
+
+void DfsGetStats(DfsStats *stats) {
+	uint32 intrvals = DisableIntrs();
+
+	bcopy((char *)&dfs_stats, (char *)stats, sizeof(dfs_stats));
+	RestoreIntrs(intrvals);
+}
+
+//-------------------------------------------------------------------
+// DfsMetadataIo moves the DFS blocks first .. last-1 (inodes or the
+// free block vector, which sit on the disk in one run) between the
+// disk and buf with one disk request.  buf must hold size bytes, which
+// must cover the whole run.  Returns DFS_SUCCESS or DFS_FAIL.
+//-------------------------------------------------------------------
+
+static int DfsMetadataIo(int iswrite, uint32 first, uint32 last, char *buf, int size) {
+	int m = sb.dfs_blocksize / DISK_BLOCKSIZE; // disk blocks per dfs block
+	int n;
+
+	if ((last - first) * sb.dfs_blocksize > size) {
+		printf("DfsMetadataIo: dfs blocks %d-%d don't fit in %d bytes.\n", first, last - 1, size);
+		return DFS_FAIL;
+	}
+	if (iswrite) {
+		n = DiskWriteBlocks(first * m, (last - first) * m, buf);
+	} else {
+		n = DiskReadBlocks(first * m, (last - first) * m, buf);
+	}
+	return (n == DISK_FAIL) ? DFS_FAIL : DFS_SUCCESS;
+}
+
+//-------------------------------------------------------------------
+// DfsFreeMetadata gives back the pages holding the inodes and fbv
+// (and the cache buffers' data).
+//-------------------------------------------------------------------
+
+static void DfsFreeMetadata() {
+	int i;
+
+	for (i = 0; i < meta_pages; i++) {
+		MemoryFreePage(meta_page + i);
+	}
+	meta_page = meta_pages = 0;
+	inodes = NULL;
+	fbv = NULL;
+	inode_next = NULL;
+	fbv_summary = NULL;
+	meta_dirty = NULL;
+	inode_changed = NULL;
+}
+
+//-------------------------------------------------------------------
+// DfsSetupMetadata checks the geometry in the superblock against the
+// disk and takes the memory for the inodes and free block vector it
+// describes, and for the cache buffers, which are as big as its
+// blocks.  Returns DFS_SUCCESS or DFS_FAIL.
+//-------------------------------------------------------------------
+
+static int DfsSetupMetadata() {
+	int m, i;
+
+	DfsFreeMetadata();
+	if ((sb.dfs_blocksize < DISK_BLOCKSIZE) || (sb.dfs_blocksize > DFS_MAX_BLOCKSIZE) ||
+	    (sb.dfs_blocksize % DISK_BLOCKSIZE)) {
+		printf("DfsSetupMetadata: bad dfs block size %d.\n", sb.dfs_blocksize);
+		return DFS_FAIL;
+	}
+	m = sb.dfs_blocksize / DISK_BLOCKSIZE;
+	if ((sb.dfs_numblocks > diskNumBlocks / m) || (sb.dfs_start_block_inodes * sb.dfs_blocksize < 2 * DISK_BLOCKSIZE) ||
+	    (sb.dfs_start_block_fbv < sb.dfs_start_block_inodes) ||
+	    (sb.dfs_start_block_journal < sb.dfs_start_block_fbv) ||
+	    (sb.dfs_start_block_data < sb.dfs_start_block_journal + DFS_JOURNAL_BLOCKS) ||
+	    (sb.dfs_start_block_data > sb.dfs_numblocks)) {
+		printf("DfsSetupMetadata: file system of %d blocks doesn't fit on the disk.\n", sb.dfs_numblocks);
+		return DFS_FAIL;
+	}
+	inode_bytes = (sb.dfs_start_block_fbv - sb.dfs_start_block_inodes) * sb.dfs_blocksize;
+	fbv_bytes = (sb.dfs_start_block_journal - sb.dfs_start_block_fbv) * sb.dfs_blocksize;
+	meta_blocks = sb.dfs_start_block_journal - sb.dfs_start_block_inodes;
+	fbv_words = (sb.dfs_numblocks + 31) / 32;
+	if ((sb.num_inodes * sizeof(dfs_inode) > inode_bytes) || (fbv_words * 4 > fbv_bytes)) {
+		printf("DfsSetupMetadata: %d inodes or the fbv don't fit their blocks.\n", sb.num_inodes);
+		return DFS_FAIL;
+	}
+	fbv_summary_words = (fbv_words + 31) / 32;
+	extent_block_extents = sb.dfs_blocksize / sizeof(dfs_extent);
+	// The cache buffers come first, sized to this file system's blocks
+	meta_pages = (cache_buffers * sb.dfs_blocksize + inode_bytes + fbv_bytes + sb.num_inodes * sizeof(int) +
+		      fbv_summary_words * 4 + meta_blocks + sb.num_inodes + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+	if ((meta_page = MemoryAllocPages(meta_pages)) == 0) {
+		printf("DfsSetupMetadata: no room for %d bytes of inodes and fbv.\n", inode_bytes + fbv_bytes);
+		meta_pages = 0;
+		return DFS_FAIL;
+	}
+	for (i = 0; i < cache_buffers; i++) {
+		cache[i].data = (char *)(meta_page * MEMORY_PAGE_SIZE) + i * sb.dfs_blocksize;
+	}
+	inodes = (dfs_inode *)((char *)(meta_page * MEMORY_PAGE_SIZE) + cache_buffers * sb.dfs_blocksize);
+	fbv = (uint32 *)((char *)inodes + inode_bytes);
+	inode_next = (int *)((char *)fbv + fbv_bytes);
+	fbv_summary = (uint32 *)(inode_next + sb.num_inodes);
+	meta_dirty = (char *)(fbv_summary + fbv_summary_words);
+	inode_changed = meta_dirty + meta_blocks;
+	bzero(meta_dirty, meta_blocks + sb.num_inodes);
+	dbprintf('Q', "DfsSetupMetadata: %d blocks, %d inodes, %d pages of metadata.\n",
+		 sb.dfs_numblocks, sb.num_inodes, meta_pages);
+	return DFS_SUCCESS;
+}
+
+//-------------------------------------------------------------------
+// Metadata journal.  DfsJournalSum adds up the words of a block;
+// DfsJournalClear writes a header with nothing to replay.
+//-------------------------------------------------------------------
+
+static uint32 DfsJournalSum(dfs_block *b) {
+	uint32 *words = (uint32 *)b->data;
+	uint32 sum = 0;
+	int i;
+
+	for (i = 0; i < sb.dfs_blocksize / 4; i++) {
+		sum += words[i];
+	}
+	return sum;
+}
+
+static int DfsJournalClear() {
+	dfs_block hb;
+
+	bzero(hb.data, sb.dfs_blocksize);
+	return DfsMetadataIo(1, sb.dfs_start_block_journal, sb.dfs_start_block_journal + 1, hb.data, sb.dfs_blocksize);
+}
+
+static void DfsInodeDirty(uint32 handle) {
+	meta_dirty[(handle * sizeof(dfs_inode)) / sb.dfs_blocksize] = 1;
+	inode_changed[handle] = 1;
+}
+
+//-------------------------------------------------------------------
+// DfsJournalReplay finishes a flush that was cut short: if the
+// journal holds a complete batch, its copies are written to their
+// places.  One whose copies don't add up to the checksum never got
+// its header written in full, so the blocks were never touched and it
+// is just dropped.  Run before the metadata is read.  Returns
+// DFS_SUCCESS or DFS_FAIL.
+//-------------------------------------------------------------------
+
+static int DfsJournalReplay() {
+	dfs_block hb, b;
+	dfs_journal_header *h = (dfs_journal_header *)hb.data;
+	uint32 sum = 0;
+	int k;
+
+	if (DfsMetadataIo(0, sb.dfs_start_block_journal, sb.dfs_start_block_journal + 1, hb.data, sb.dfs_blocksize) == DFS_FAIL) {
+		printf("DfsJournalReplay: Error reading the journal header.\n");
+		return DFS_FAIL;
+	}
+	if ((h->magic != DFS_JOURNAL_MAGIC) || (h->count == 0)) {
+		return DFS_SUCCESS;
+	}
+	if (h->count > DFS_JOURNAL_BLOCKS - 1) {
+		printf("DfsJournalReplay: journal header claims %d blocks, ignored.\n", h->count);
+		return DfsJournalClear();
+	}
+	for (k = 0; k < h->count; k++) {
+		if ((h->target[k] < sb.dfs_start_block_inodes) || (h->target[k] >= sb.dfs_start_block_journal) ||
+		    (DfsMetadataIo(0, sb.dfs_start_block_journal + 1 + k, sb.dfs_start_block_journal + 2 + k, b.data, sb.dfs_blocksize) == DFS_FAIL)) {
+			printf("DfsJournalReplay: Error with journal copy %d, ignored.\n", k);
+			return DfsJournalClear();
+		}
+		sum += DfsJournalSum(&b);
+	}
+	if (sum != h->checksum) {
+		printf("DfsJournalReplay: journal %d is incomplete, ignored.\n", h->sequence);
+		return DfsJournalClear();
+	}
+	for (k = 0; k < h->count; k++) {
+		if ((DfsMetadataIo(0, sb.dfs_start_block_journal + 1 + k, sb.dfs_start_block_journal + 2 + k, b.data, sb.dfs_blocksize) == DFS_FAIL) ||
+		    (DfsMetadataIo(1, h->target[k], h->target[k] + 1, b.data, sb.dfs_blocksize) == DFS_FAIL)) {
+			printf("DfsJournalReplay: Error replaying block %d.\n", h->target[k]);
+			return DFS_FAIL;
+		}
+	}
+	printf("DfsJournalReplay: replayed %d metadata blocks of journal %d.\n", h->count, h->sequence);
+	journal_sequence = h->sequence;
+	return DfsJournalClear();
+}
+
+//-------------------------------------------------------------------
+// DfsWriteSuperblock writes sb to the second physical block.
+//-------------------------------------------------------------------
+
+static int DfsWriteSuperblock() {
+	disk_block diskb;
+
+	bzero(diskb.data, DISK_BLOCKSIZE);
+	bcopy((char *)&sb, diskb.data, sizeof(sb));
+	if (DiskWriteBlock(1, &diskb) == DISK_FAIL) {
+		return DFS_FAIL;
+	}
+	sb_dirty = 0;
+	return DFS_SUCCESS;
+}
+
+//-------------------------------------------------------------------
+// DfsMetadataFlush writes the dirty inode and fbv blocks, up to
+// DFS_JOURNAL_BLOCKS - 1 at a time: copies of them into the journal,
+// then its header, then the blocks to their places and finally an
+// empty header.  A crash before the header is written leaves the old
+// blocks; one after it leaves a journal DfsJournalReplay completes.
+// If only isn't -1, the only inode block written is that one (counted
+// from the first inode block), though the fbv blocks still are.  The
+// caller holds journal_lock, or there's nobody left to race with.
+// Returns DFS_SUCCESS or DFS_FAIL.
+//-------------------------------------------------------------------
+
+static int DfsMetadataFlush(int only) {
+	dfs_block hb, b;
+	dfs_journal_header *h = (dfs_journal_header *)hb.data;
+	int inode_blocks = sb.dfs_start_block_fbv - sb.dfs_start_block_inodes;
+	int per_block = sb.dfs_blocksize / sizeof(dfs_inode);
+	uint32 blocknum;
+	int i = 0, j, k;
+
+	//Cover any newly used inodes before their blocks get there
+	if (sb_dirty && (DfsWriteSuperblock() == DFS_FAIL)) {
+		printf("DfsMetadataFlush: Error writing the superblock.\n");
+		return DFS_FAIL;
+	}
+
+	while (i < meta_blocks) {
+		bzero(hb.data, sb.dfs_blocksize);
+		for (; (i < meta_blocks) && (h->count < DFS_JOURNAL_BLOCKS - 1); i++) {
+			if (!meta_dirty[i] || ((only >= 0) && (i != only) && (i < inode_blocks))) {continue;}
+			//Cleared first, so a change made from here on is flushed next time
+			meta_dirty[i] = 0;
+			for (j = i * per_block; (i < inode_blocks) && (j < (i + 1) * per_block) && (j < sb.num_inodes); j++) {
+				inode_changed[j] = 0;
+			}
+			blocknum = sb.dfs_start_block_inodes + i;
+			bcopy((char *)inodes + i * sb.dfs_blocksize, b.data, sb.dfs_blocksize);
+			if (DfsMetadataIo(1, sb.dfs_start_block_journal + 1 + h->count, sb.dfs_start_block_journal + 2 + h->count,
+					  b.data, sb.dfs_blocksize) == DFS_FAIL) {
+				printf("DfsMetadataFlush: Error writing the journal copy of block %d.\n", blocknum);
+				return DFS_FAIL;
+			}
+			h->checksum += DfsJournalSum(&b);
+			h->target[h->count++] = blocknum;
+		}
+		if (h->count == 0) {
+			break;
+		}
+		h->magic = DFS_JOURNAL_MAGIC;
+		h->sequence = ++journal_sequence;
+		if (DfsMetadataIo(1, sb.dfs_start_block_journal, sb.dfs_start_block_journal + 1, hb.data, sb.dfs_blocksize) == DFS_FAIL) {
+			printf("DfsMetadataFlush: Error writing the journal header.\n");
+			return DFS_FAIL;
+		}
+		for (k = 0; k < h->count; k++) {
+			if (DfsMetadataIo(1, h->target[k], h->target[k] + 1,
+					  (char *)inodes + (h->target[k] - sb.dfs_start_block_inodes) * sb.dfs_blocksize,
+					  sb.dfs_blocksize) == DFS_FAIL) {
+				printf("DfsMetadataFlush: Error writing metadata block %d.\n", h->target[k]);
+				return DFS_FAIL;
+			}
+		}
+		if (DfsJournalClear() == DFS_FAIL) {
+			printf("DfsMetadataFlush: Error clearing the journal.\n");
+			return DFS_FAIL;
+		}
+		dfs_stats.journalFlushes++;
+		dfs_stats.journalBlocks += h->count;
+	}
+	return DFS_SUCCESS;
 }
 
 //-------------------------------------------------------------------
@@ -75,10 +792,6 @@ void DfsInvalidate() {
 int DfsOpenFileSystem() {
 	// Declarations
 	disk_block diskb;
-	dfs_block new_block;
-	char * inodebytes;
-	char * fbvbytes;
-	int i;
 
 	// Check that filesystem is not already open
 	if (sb.valid) {
@@ -98,6 +811,7 @@ int DfsOpenFileSystem() {
 	// Copy the data from the block we just read into the superblock in memory
 
 	bcopy(diskb.data, (char *)&sb, sizeof(sb));
+	EvlogBootPhase("dfs superblock");
 	// All other blocks are sized by virtual block size:
 	// Read inodes
 	// sb should be valid at this point since sb was supposed to be valid on disk
@@ -105,34 +819,37 @@ int DfsOpenFileSystem() {
 		printf("DfsOpenFileSystem: Filesystem on disk is not valid\n");
 		return DFS_FAIL;
 	}
-	inodebytes = (char *) inodes;
-	for (i = sb.dfs_start_block_inodes; i < sb.dfs_start_block_fbv; i++) {
-		//dbprintf('Q', "DfsOpenFileSystem: opening inodes. i=%d.\n", i);
-		if (DfsReadBlock(i, &new_block) == DFS_FAIL) {
-			printf("DfsOpenFileSystem: Error Reading dfs block for inodes.\n");
-			return DFS_FAIL;
-		}
-		bcopy(new_block.data, &(inodebytes[(i - sb.dfs_start_block_inodes) * sb.dfs_blocksize]), sb.dfs_blocksize);
+	DfsCacheReset();
+	DfsExtentMapReset();
+	MemoryFileCacheDrop(-1);
+	if (DfsSetupMetadata() == DFS_FAIL) {
+		sb.valid = 0;
+		return DFS_FAIL;
 	}
-	// Read free block vector
-	fbvbytes = (char *) fbv;
-	for (i = sb.dfs_start_block_fbv; i < sb.dfs_start_block_data; i++) {
-		if (DfsReadBlock(i, &new_block) == DFS_FAIL) {
-			printf("DfsOpenFileSystem: Error Reading dfs block for fbv.\n");
-			return DFS_FAIL;
-		}
-		bcopy(new_block.data, &(fbvbytes[(i - sb.dfs_start_block_fbv) * sb.dfs_blocksize]), sb.dfs_blocksize);
+	EvlogBootPhase("dfs metadata");
+	if (DfsJournalReplay() == DFS_FAIL) {
+		sb.valid = 0;
+		DfsFreeMetadata();
+		return DFS_FAIL;
 	}
-
-	// Change superblock to be invalid, write back to disk, then change 
-	// it back to be valid in memory
-	sb.valid = 0;
-	bzero(diskb.data, DISK_BLOCKSIZE);
-	bcopy((char *)&sb, diskb.data, sizeof(sb));
-	if ( DiskWriteBlock(1, &diskb) == DISK_FAIL ) {
-		printf("DfsOpenFileSystem: Error Writing superblock back to disk.\n");
+	EvlogBootPhase("dfs journal");
+	// Read free block vector; the inodes are read when first needed
+	if (DfsMetadataIo(0, sb.dfs_start_block_fbv, sb.dfs_start_block_journal,
+			  (char *)fbv, fbv_bytes) == DFS_FAIL) {
+		printf("DfsOpenFileSystem: Error Reading dfs block for fbv.\n");
+		sb.valid = 0;
+		DfsFreeMetadata();
 		return DFS_FAIL;
 	}
+	EvlogBootPhase("dfs fbv read");
+	DfsIndexBuild();
+	DfsSummaryBuild();
+	EvlogBootPhase("dfs inode index");
+
+	// The superblock on the disk stays valid while the file system is
+	// open: metadata only reaches the disk through the journal, so
+	// after a crash it's as of the last DfsSync, plus whatever the
+	// journal replays.
 	sb.valid = 1;
 	printf("DfsOpenFileSystem: Success. sb.valid=%d.\n", sb.valid);
 	return DFS_SUCCESS;
@@ -146,57 +863,64 @@ int DfsOpenFileSystem() {
 //-------------------------------------------------------------------
 
 int DfsCloseFileSystem() {
-	// Declarations
-	disk_block diskb;
-	dfs_block new_block;
-	char * bytes2write;
-	int i;
-
 	// Check that filesystem is not already closed
 	if (!sb.valid) {
 		printf("DfsCloseFileSystem: Error No File system open to close. sbvalid=%d\n", sb.valid);
 		return DFS_FAIL;
 	}
 
-	//Write Inodes:
-	bytes2write = (char *) inodes;
-	for (i = sb.dfs_start_block_inodes; i < sb.dfs_start_block_fbv; i++) {
-		bcopy(&(bytes2write[(i - sb.dfs_start_block_inodes) * sb.dfs_blocksize]), new_block.data, sb.dfs_blocksize);
-		if ( DfsWriteBlock(i, &new_block) == DFS_FAIL ) {
-			printf("DfsCloseFileSystem: Error writing inodes.\n");
-			return DFS_FAIL;
-		}
+	//Write back the buffer cache.  This runs as the OS exits, when no
+	//process will run again to release cache_lock, so it isn't taken.
+	if (DfsCacheFlush() == DFS_FAIL) {
+		printf("DfsCloseFileSystem: Error writing back the buffer cache.\n");
+		return DFS_FAIL;
 	}
+	dbprintf('Q', "DfsCloseFileSystem: buffer cache %d hits, %d misses, %d write-backs, %d read-aheads.\n",
+		 dfs_stats.cacheHits, dfs_stats.cacheMisses, dfs_stats.cacheWritebacks, dfs_stats.cachePrefetches);
 
-	//Write fbv
-	bytes2write = (char *) fbv;
-	for (i = sb.dfs_start_block_fbv; i < sb.dfs_start_block_data; i++) {
-		bcopy(&(bytes2write[(i - sb.dfs_start_block_fbv) * sb.dfs_blocksize]), new_block.data, sb.dfs_blocksize);
-		if ( DfsWriteBlock(i, &new_block) == DFS_FAIL ) {
-			printf("DfsCloseFileSystem: Error writing fbv.\n");
-			return DFS_FAIL;
-		}
+	//Write the inode and fbv blocks that changed
+	if (DfsMetadataFlush(-1) == DFS_FAIL) {
+		printf("DfsCloseFileSystem: Error writing inodes and fbv.\n");
+		return DFS_FAIL;
 	}
+	dbprintf('Q', "DfsCloseFileSystem: %d metadata blocks in %d journal flushes.\n",
+		 dfs_stats.journalBlocks, dfs_stats.journalFlushes);
 
 	//Write sb to disk
-	bzero(diskb.data, DISK_BLOCKSIZE);
-	bcopy((char *)&sb, diskb.data, sizeof(sb));
-	if (DiskWriteBlock(1, &diskb) == DISK_FAIL) {
+	if (DfsWriteSuperblock() == DFS_FAIL) {
 		printf("DfsCloseFileSystem: Error writing sb back to disk.\n");
 		return DFS_FAIL;
 	}
 	sb.valid = 0; 
+	DfsFreeMetadata();
 	printf("DfsCloseFileSystem: Success!\n");
+	DiskPrintStats();
 	return DFS_SUCCESS;
 }
 
 
 //-----------------------------------------------------------------
 // DfsAllocateBlock allocates a DFS block for use. Remember to use 
-// locks where necessary.
+// locks where necessary.  DfsAllocateBlockNear takes the block after
+// the one a file used last as a hint: it's used if it's free, or
+// else the first free block after it in the same fbv word, so that
+// sequential writes get contiguous blocks.  0 means no hint.
+// DfsAllocateBlocksNear goes on to take up to want - 1 blocks right
+// after that one while they're free, with the lock taken once,
+// and sets *got to how many it took.
 //-----------------------------------------------------------------
 
 uint32 DfsAllocateBlock() {
+	return DfsAllocateBlockNear(0);
+}
+
+uint32 DfsAllocateBlockNear(uint32 hint) {
+	int got;
+
+	return DfsAllocateBlocksNear(hint, 1, &got);
+}
+
+uint32 DfsAllocateBlocksNear(uint32 hint, int want, int *got) {
 	//Initializations:
 	int bitnum;
 	int i;
@@ -207,32 +931,50 @@ uint32 DfsAllocateBlock() {
 		printf("DfsAllocateBlock: Error cannot Allocate block if file system is invalid");
 		return DFS_FAIL;
 	}
-	// Find the first free block using the free block vector (FBV), mark it in use
-	// Return handle to block
 	//Wait for lock
 	if(LockHandleAcquire(fbv_lock) != SYNC_SUCCESS) {
     	printf("DfsAllocateBlock bad lock acquire!\n");
     	return DFS_FAIL;
   	}
-
-	for (i = 0; i < DFS_FBV_MAX_NUM_WORDS; i++) {
-		if(fbv[i] != 0) {
-    		break;
-    	}
+	if (hint >= sb.dfs_numblocks) {
+		hint = 0;
 	}
-
-	if(i == DFS_FBV_MAX_NUM_WORDS) {
+	dfs_stats.allocCalls++;
+	dfs_stats.allocScanWords++;
+
+	// Find the word to take it from: the hint's if that has a free block
+	// at or after the hint, otherwise the next one with any free block
+	i = -1;
+	if ((hint != 0) && (fbv[hint / 32] & invert((1 << (hint % 32)) - 1))) {
+		i = hint / 32;
+	} else if (sb.dfs_free_blocks > 0) {
+		i = DfsSummaryFind((hint != 0) ? hint / 32 : fbv_cursor);
+	}
+	if(i < 0) {
+		LockHandleRelease(fbv_lock);
 		printf("DfsAllocateBlock: Could not allocate block\n");
 		return DFS_FAIL;
 	}
 
 	//Mark the bit as in use
 	v = fbv[i];
-	for (bitnum = 0; (v & (1 << bitnum)) == 0; bitnum++) { }
-    fbv[i]  &= invert(1 << bitnum);
+	if ((hint != 0) && (i == hint / 32) && (v & invert((1 << (hint % 32)) - 1))) {
+		v &= invert((1 << (hint % 32)) - 1);
+	}
+	bitnum = dffs(v);
+	SetFBV((i * 32) + bitnum, 0);
+	sb.dfs_free_blocks--;
+	fbv_cursor = i;
    	//Find handle
     v = (i * 32) + bitnum;
-    dbprintf('Q', "DfsAllocateBlock: allocated block from fbv=%d, vector=%d\n", i, v);
+	//And the free blocks after it
+	for (*got = 1; (*got < want) && (v + *got < sb.dfs_numblocks) &&
+	               (fbv[(v + *got) / 32] & (1 << ((v + *got) % 32))); (*got)++) {
+		SetFBV(v + *got, 0);
+		sb.dfs_free_blocks--;
+		fbv_cursor = (v + *got) / 32;
+	}
+    dbprintf('Q', "DfsAllocateBlock: allocated %d blocks from fbv=%d, vector=%d, hint=%d\n", *got, i, v, hint);
     //Release Lock
     LockHandleRelease(fbv_lock);
     //return handle
@@ -240,11 +982,31 @@ uint32 DfsAllocateBlock() {
 }
 
 
+//-----------------------------------------------------------------
+// DfsGroupStart returns the first block of the allocation group inode
+// handle belongs to.  The data blocks are split into DFS_ALLOC_GROUPS
+// groups of whole fbv words, and inodes are dealt out to them in
+// turn, so files created one after another start in different groups
+// instead of interleaving their blocks wherever the last allocation
+// left off.  A file's later blocks then follow its earlier ones.
+//-----------------------------------------------------------------
+
+static uint32 DfsGroupStart(uint32 handle) {
+	uint32 first = sb.dfs_start_block_data / 32; 	// Word of the first data block
+	uint32 words = (fbv_words - first) / DFS_ALLOC_GROUPS; // Words per group
+	uint32 start = (first + (handle % DFS_ALLOC_GROUPS) * words) * 32;
+
+	return (start < sb.dfs_start_block_data) ? sb.dfs_start_block_data : start;
+}
+
+
 //-----------------------------------------------------------------
 // DfsFreeBlock deallocates a DFS block.
 //-----------------------------------------------------------------
 
 int DfsFreeBlock(uint32 blocknum) {
+	dfs_buffer *buf;
+
 	//Check if file system is valid
 	if (!sb.valid) {
 		printf("DfsAllocateBlock: Error cannot Allocate block if file system is invalid");
@@ -255,12 +1017,25 @@ int DfsFreeBlock(uint32 blocknum) {
 	while(LockHandleAcquire(fbv_lock) != SYNC_SUCCESS) {}
 
 	//Deallocate DFS block
+	if ((blocknum >= sb.dfs_numblocks) || (fbv[blocknum / 32] & (1 << (blocknum % 32)))) {
+		LockHandleRelease(fbv_lock);
+		printf("DfsFreeBlock: Error block %d is not allocated.\n", blocknum);
+		return DFS_FAIL;
+	}
 	SetFBV(blocknum, 1);
+	sb.dfs_free_blocks++;
 	dbprintf('Q', "DfsFreeBlock: Freed block %d\n", blocknum);
 
 	//Release Lock
 	LockHandleRelease(fbv_lock);
 
+	//Its contents don't matter any more, so never write them back
+	while(LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {}
+	if ((buf = DfsCacheFind(blocknum)) != NULL) {
+		DfsCacheUnhash(buf);
+	}
+	LockHandleRelease(cache_lock);
+
 	return DFS_SUCCESS;
 
 }
@@ -275,9 +1050,8 @@ int DfsFreeBlock(uint32 blocknum) {
 
 int DfsReadBlock(uint32 blocknum, dfs_block *b) {
 	//Initializations
-	disk_block diskb;
 	int m = sb.dfs_blocksize / DISK_BLOCKSIZE; // factor number of disk blocks per dfs block
-	int i;
+	dfs_buffer *buf;
 
 	//Check if file system is valid
 	if (!sb.valid) {
@@ -293,16 +1067,29 @@ int DfsReadBlock(uint32 blocknum, dfs_block *b) {
 		return DFS_FAIL;
 	}
 
-	//Read the block from disk
-	for (i = 0; i < m; i++) {
-		bzero(diskb.data, DISK_BLOCKSIZE);
-		if (DiskReadBlock(blocknum * m + i, &diskb) == DISK_FAIL) {
+	//Without a cache, read the block from disk in one request
+	if (cache_buffers == 0) {
+		if (DiskReadBlocks(blocknum * m, m, b->data) == DISK_FAIL) {
 			printf("DfsReadBlock: Error could not read disk block.\n");
 			return DFS_FAIL;
 		}
-		bcopy(diskb.data, &(b->data[i * DISK_BLOCKSIZE]), DISK_BLOCKSIZE);
+		dfs_stats.blocksRead++;
+		return sb.dfs_blocksize;
 	}
 
+	//Otherwise copy it out of its buffer
+	if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+		printf("DfsReadBlock bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	if ((buf = DfsCacheGet(blocknum, 1)) == NULL) {
+		LockHandleRelease(cache_lock);
+		printf("DfsReadBlock: Error could not read disk block.\n");
+		return DFS_FAIL;
+	}
+	bcopy(buf->data, b->data, sb.dfs_blocksize);
+	LockHandleRelease(cache_lock);
+
 	return sb.dfs_blocksize;
 
 }
@@ -317,11 +1104,10 @@ int DfsReadBlock(uint32 blocknum, dfs_block *b) {
 
 int DfsWriteBlock(uint32 blocknum, dfs_block *b){
 	//Initializations
-	disk_block diskb;
 	int dbsz;
 	int m; // factor number of disk blocks per dfs block
-	int i;
 	int num_writ = 0;
+	dfs_buffer *buf;
 
 	dbsz = DiskBytesPerBlock();
 	m = sb.dfs_blocksize / dbsz;
@@ -338,26 +1124,314 @@ int DfsWriteBlock(uint32 blocknum, dfs_block *b){
 		return DFS_FAIL;
 	}
 
-	//Write block to disk
-	for (i = 0; i < m; i++) {
-		bzero(diskb.data, dbsz);
-		bcopy(&(b->data[i * dbsz]), diskb.data, dbsz);
-		if (DiskWriteBlock(blocknum * m + i, &diskb) == DISK_FAIL) {
-			printf("DfsWriteBlock: Error could not write to disk. blocknum=%d, m=%d, i=%d\n", blocknum, m, i);
+	//Without a cache, write block to disk in one request
+	if (cache_buffers == 0) {
+		if (DiskWriteBlocks(blocknum * m, m, b->data) == DISK_FAIL) {
+			printf("DfsWriteBlock: Error could not write to disk. blocknum=%d, m=%d\n", blocknum, m);
 			return DFS_FAIL;
 		}
-		num_writ += dbsz;
+		dfs_stats.blocksWritten++;
+		return m * dbsz;
+	}
+
+	//Otherwise it replaces the whole buffer, which goes to disk later
+	if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+		printf("DfsWriteBlock bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	if ((buf = DfsCacheGet(blocknum, 0)) == NULL) {
+		LockHandleRelease(cache_lock);
+		printf("DfsWriteBlock: Error could not make room in the cache. blocknum=%d\n", blocknum);
+		return DFS_FAIL;
 	}
+	bcopy(b->data, buf->data, sb.dfs_blocksize);
+	buf->dirty = 1;
+	LockHandleRelease(cache_lock);
+	num_writ = m * dbsz;
 
 	//return bytes wriiten
 	return num_writ;
 }
 
 
+//-----------------------------------------------------------------
+// DfsWriteBlocks writes count consecutive allocated DFS blocks
+// starting at blocknum straight from data with one disk request.
+// Cached copies of them are dropped, since the disk now has newer
+// contents.  Returns DFS_FAIL on failure, and the number of bytes
+// written on success.
+//-----------------------------------------------------------------
+
+int DfsWriteBlocks(uint32 blocknum, int count, char *data) {
+	int m = sb.dfs_blocksize / DISK_BLOCKSIZE; // disk blocks per dfs block
+	dfs_buffer *buf;
+	int i;
+
+	if (!sb.valid) {
+		printf("DfsWriteBlocks: Error cannot write blocks if file system is invalid.\n");
+		return DFS_FAIL;
+	}
+	for (i = 0; i < count; i++) {
+		if (fbv[(blocknum + i) / 32] & (1 << ((blocknum + i) % 32))) {
+			printf("DfsWriteBlocks: Error blocknumber %d is not allocated.\n", blocknum + i);
+			return DFS_FAIL;
+		}
+	}
+
+	//Hold cache_lock across the write so nobody caches the old contents meanwhile
+	if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+		printf("DfsWriteBlocks bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	for (i = 0; (cache_buffers > 0) && (i < count); i++) {
+		if ((buf = DfsCacheFind(blocknum + i)) != NULL) {
+			DfsCacheUnhash(buf);
+		}
+	}
+	if (DiskWriteBlocks(blocknum * m, count * m, data) == DISK_FAIL) {
+		LockHandleRelease(cache_lock);
+		printf("DfsWriteBlocks: Error could not write blocks %d-%d.\n", blocknum, blocknum + count - 1);
+		return DFS_FAIL;
+	}
+	dfs_stats.blocksWritten += count;
+	LockHandleRelease(cache_lock);
+	return count * sb.dfs_blocksize;
+}
+
+//-----------------------------------------------------------------
+// DfsReadBlocks reads count consecutive allocated DFS blocks
+// starting at blocknum into data.  Cached blocks are copied out of
+// their buffers; each run of the others is read from the disk
+// straight into data with one request, without taking up buffers.
+// Returns DFS_FAIL on failure, and the number of bytes read on
+// success.
+//-----------------------------------------------------------------
+
+int DfsReadBlocks(uint32 blocknum, int count, char *data) {
+	int m = sb.dfs_blocksize / DISK_BLOCKSIZE; // disk blocks per dfs block
+	dfs_buffer *buf;
+	int i, run;
+
+	if (!sb.valid) {
+		printf("DfsReadBlocks: Error cannot read blocks if file system is invalid.\n");
+		return DFS_FAIL;
+	}
+	for (i = 0; i < count; i++) {
+		if (fbv[(blocknum + i) / 32] & (1 << ((blocknum + i) % 32))) {
+			printf("DfsReadBlocks: Error blocknumber %d is not allocated.\n", blocknum + i);
+			return DFS_FAIL;
+		}
+	}
+
+	if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+		printf("DfsReadBlocks bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	for (i = 0; i < count; i += run) {
+		if ((cache_buffers > 0) && ((buf = DfsCacheFind(blocknum + i)) != NULL)) {
+			dfs_stats.cacheHits++;
+			bcopy(buf->data, data + i * sb.dfs_blocksize, sb.dfs_blocksize);
+			run = 1;
+			continue;
+		}
+		for (run = 1; (i + run < count) && ((cache_buffers == 0) || (DfsCacheLookup(blocknum + i + run) == NULL)); run++) {
+		}
+		if (DiskReadBlocks((blocknum + i) * m, run * m, data + i * sb.dfs_blocksize) == DISK_FAIL) {
+			LockHandleRelease(cache_lock);
+			printf("DfsReadBlocks: Error could not read blocks %d-%d.\n", blocknum + i, blocknum + i + run - 1);
+			return DFS_FAIL;
+		}
+		dfs_stats.blocksRead += run;
+	}
+	LockHandleRelease(cache_lock);
+	return count * sb.dfs_blocksize;
+}
+
+//-----------------------------------------------------------------
+// DfsReadBlockPart copies n bytes at offset in allocated block
+// blocknum to dst, and DfsWriteBlockPart copies them from src into
+// it, both straight from or into the block's cache buffer.  If fresh
+// is set the block has never been written, so DfsWriteBlockPart
+// zeroes the rest instead of reading it.  Without a cache they go
+// through a dfs_block.  Both return DFS_FAIL on failure and n on
+// success.
+//-----------------------------------------------------------------
+
+int DfsReadBlockPart(uint32 blocknum, int offset, int n, char *dst) {
+	dfs_block b;
+	dfs_buffer *buf;
+
+	if (cache_buffers == 0) {
+		if (DfsReadBlock(blocknum, &b) == DFS_FAIL) {
+			return DFS_FAIL;
+		}
+		bcopy(&(b.data[offset]), dst, n);
+		return n;
+	}
+	if (!sb.valid || (fbv[blocknum / 32] & (1 << (blocknum % 32)))) {
+		printf("DfsReadBlockPart: Error blocknumber %d is not allocated.\n", blocknum);
+		return DFS_FAIL;
+	}
+	if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+		printf("DfsReadBlockPart bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	if ((buf = DfsCacheGet(blocknum, 1)) == NULL) {
+		LockHandleRelease(cache_lock);
+		printf("DfsReadBlockPart: Error could not read block %d.\n", blocknum);
+		return DFS_FAIL;
+	}
+	bcopy(&(buf->data[offset]), dst, n);
+	LockHandleRelease(cache_lock);
+	return n;
+}
+
+int DfsWriteBlockPart(uint32 blocknum, int offset, int n, char *src, int fresh) {
+	dfs_block b;
+	dfs_buffer *buf;
+	int misses;
+
+	if (cache_buffers == 0) {
+		if (fresh) {
+			bzero(b.data, sb.dfs_blocksize);
+		} else if (DfsReadBlock(blocknum, &b) == DFS_FAIL) {
+			return DFS_FAIL;
+		} else {
+			dfs_stats.readModifyWrites++;
+		}
+		bcopy(src, &(b.data[offset]), n);
+		return (DfsWriteBlock(blocknum, &b) == DFS_FAIL) ? DFS_FAIL : n;
+	}
+	if (!sb.valid || (fbv[blocknum / 32] & (1 << (blocknum % 32)))) {
+		printf("DfsWriteBlockPart: Error blocknumber %d is not allocated.\n", blocknum);
+		return DFS_FAIL;
+	}
+	if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+		printf("DfsWriteBlockPart bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	misses = dfs_stats.cacheMisses;
+	if ((buf = DfsCacheGet(blocknum, !fresh)) == NULL) {
+		LockHandleRelease(cache_lock);
+		printf("DfsWriteBlockPart: Error could not get block %d.\n", blocknum);
+		return DFS_FAIL;
+	}
+	if (!fresh && (dfs_stats.cacheMisses != misses)) {
+		dfs_stats.readModifyWrites++;
+	}
+	if (fresh) {
+		bzero(buf->data, sb.dfs_blocksize);
+	}
+	bcopy(src, &(buf->data[offset]), n);
+	buf->dirty = 1;
+	LockHandleRelease(cache_lock);
+	return n;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 // Inode-based functions
 ////////////////////////////////////////////////////////////////////////////////
 
+//Hashes the part of a filename that dstrncmp compares
+static int DfsNameHash(char *filename) {
+	uint32 h = 0;
+	int i;
+
+	for (i = 0; (i < DFS_MAX_FILENAME_SIZE) && (filename[i] != '\0'); i++) {
+		h = (h * 31) + filename[i];
+	}
+	return h % DFS_NAME_HASH_BUCKETS;
+}
+
+//Adds inode i, now in use, to its name's chain
+static void DfsIndexInsert(int i) {
+	int h = DfsNameHash(inodes[i].filename);
+
+	inode_next[i] = name_hash[h];
+	name_hash[h] = i;
+}
+
+//Takes inode i, about to be freed, off its name's chain and onto the
+//free list; its filename must still be set
+static void DfsIndexRemove(int i) {
+	int *pp = &name_hash[DfsNameHash(inodes[i].filename)];
+
+	while ((*pp != -1) && (*pp != i)) {
+		pp = &inode_next[*pp];
+	}
+	if (*pp == i) {
+		*pp = inode_next[i];
+	}
+	inode_next[i] = inode_free;
+	inode_free = i;
+}
+
+//Starts the index when the file system is opened: the inodes past
+//the blocks that may hold used ones are zeroed and made free, and the
+//rest are left for DfsIndexLoad.  The free list is pushed from the top
+//so that the lowest inodes are used first.
+static void DfsIndexBuild() {
+	int per_block = sb.dfs_blocksize / sizeof(dfs_inode);
+	int i;
+
+	for (i = 0; i < DFS_NAME_HASH_BUCKETS; i++) {
+		name_hash[i] = -1;
+	}
+	inode_unloaded = ((sb.dfs_inodes_used + per_block - 1) / per_block) * per_block;
+	if (inode_unloaded > sb.num_inodes) {
+		inode_unloaded = sb.num_inodes;
+	}
+	bzero((char *)inodes, inode_bytes);
+	inode_free = -1;
+	for (i = sb.num_inodes - 1; i >= (int)inode_unloaded; i--) {
+		inode_next[i] = inode_free;
+		inode_free = i;
+	}
+	sb_dirty = 0;
+}
+
+//Reads the inode blocks DfsIndexBuild left out and indexes them.  The
+//caller holds inode_lock for writing.  Returns DFS_SUCCESS or DFS_FAIL.
+static int DfsIndexLoad() {
+	int per_block = sb.dfs_blocksize / sizeof(dfs_inode);
+	int i;
+
+	if (inode_unloaded == 0) {
+		return DFS_SUCCESS;
+	}
+	if (DfsMetadataIo(0, sb.dfs_start_block_inodes, sb.dfs_start_block_inodes + inode_unloaded / per_block,
+			  (char *)inodes, inode_bytes) == DFS_FAIL) {
+		printf("DfsIndexLoad: Error reading the first %d inodes.\n", inode_unloaded);
+		return DFS_FAIL;
+	}
+	for (i = inode_unloaded - 1; i >= 0; i--) {
+		if (inodes[i].inuse) {
+			DfsIndexInsert(i);
+		} else {
+			inode_next[i] = inode_free;
+			inode_free = i;
+		}
+	}
+	dbprintf('Q', "DfsIndexLoad: read %d inodes.\n", inode_unloaded);
+	inode_unloaded = 0;
+	return DFS_SUCCESS;
+}
+
+//Searches the index; the caller holds inode_lock either way
+static uint32 DfsInodeFind(char *filename) {
+	int i;
+
+	dfs_stats.inodeLookups++;
+	for (i = name_hash[DfsNameHash(filename)]; i != -1; i = inode_next[i]) {
+		dfs_stats.inodeLookupSteps++;
+		if (dstrncmp(filename, inodes[i].filename, DFS_MAX_FILENAME_SIZE) == 0) {
+			return i;
+		}
+	}
+	return DFS_FAIL;
+}
+
 //-----------------------------------------------------------------
 // DfsInodeFilenameExists looks through all the inuse inodes for 
 // the given filename. If the filename is found, return the handle 
@@ -366,7 +1440,7 @@ int DfsWriteBlock(uint32 blocknum, dfs_block *b){
 
 uint32 DfsInodeFilenameExists(char *filename) {
 	//Initializations
-	int i;
+	uint32 inhandle;
 
 	//Check if file system is valid
 	if (!sb.valid) {
@@ -374,16 +1448,28 @@ uint32 DfsInodeFilenameExists(char *filename) {
 		return DFS_FAIL;
 	}
 
-	//Check if filename exists
-	for (i = 0; i < DFS_NUM_INODES; i++) {
-		if (inodes[i].inuse) {
-			if (dstrncmp(filename, inodes[i].filename, DFS_MAX_FILENAME_SIZE) == 0) {
-				return i;
-			}
+	//The first lookup reads the inodes in
+	if (inode_unloaded != 0) {
+		if (RwLockHandleAcquireWrite(inode_lock) != SYNC_SUCCESS) {
+			printf("DfsInodeFilenameExists bad lock acquire!\n");
+			return DFS_FAIL;
+		}
+		inhandle = DfsIndexLoad();
+		RwLockHandleRelease(inode_lock);
+		if (inhandle == DFS_FAIL) {
+			return DFS_FAIL;
 		}
 	}
+
+	//Check if filename exists
+	if (RwLockHandleAcquireRead(inode_lock) != SYNC_SUCCESS) {
+		printf("DfsInodeFilenameExists bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	inhandle = DfsInodeFind(filename);
+	RwLockHandleRelease(inode_lock);
 	//printf("DfsInodeFilenameExists: Error Inode filename was not found\n");
-	return DFS_FAIL;
+	return inhandle;
 
 }
 
@@ -413,26 +1499,38 @@ uint32 DfsInodeOpen(char *filename) {
 	} else {
 		//Acquire Lock
 		// dbprintf('Q', "DfsInodeOpen: Acquire lock.\n");
-		while (LockHandleAcquire(inode_lock) != SYNC_SUCCESS);
+		while (RwLockHandleAcquireWrite(inode_lock) != SYNC_SUCCESS);
+		//Someone may have created it since we looked
+		if ((inhandle = DfsInodeFind(filename)) != DFS_FAIL) {
+			RwLockHandleRelease(inode_lock);
+			return inhandle;
+		}
 		//Allocate new inode for filename
 		// dbprintf('Q', "DfsInodeOpen: Allocate new inode for filename.\n");
 		/*(while (inodes[i].inuse == 0) {
 			i += 1;
-			if (i >= DFS_NUM_INODES) {
+			if (i >= sb.num_inodes) {
 				printf("DfsInodeOpen: Error all inodes inuse, cannot open inode\n");
 				return DFS_FAIL;
 			}
 		}*/
-		for(i=0; i < DFS_NUM_INODES; i++) {
-			if(!inodes[i].inuse) {
-				inodes[i].inuse = 1;
-				inodes[i].filesize = 0;
-				dstrncpy(inodes[i].filename, filename, DFS_MAX_FILENAME_SIZE);
-				break;
-			}
+		if ((i = inode_free) == -1) {
+			RwLockHandleRelease(inode_lock);
+			printf("DfsInodeOpen: Error all inodes inuse, cannot open inode\n");
+			return DFS_FAIL;
+		}
+		inode_free = inode_next[i];
+		if (i >= sb.dfs_inodes_used) {
+			sb.dfs_inodes_used = i + 1;
+			sb_dirty = 1;
 		}
+		inodes[i].inuse = 1;
+		inodes[i].filesize = 0;
+		dstrncpy(inodes[i].filename, filename, DFS_MAX_FILENAME_SIZE);
+		DfsIndexInsert(i);
+		DfsInodeDirty(i);
 		//Release lock
-		LockHandleRelease(inode_lock);
+		RwLockHandleRelease(inode_lock);
 		dbprintf('Q', "DfsInodeOpen: Opened inode:%d, inuse=%d\n", i, inodes[i].inuse);
 		return i; 
 	}
@@ -440,20 +1538,268 @@ uint32 DfsInodeOpen(char *filename) {
 }
 
 
+//-----------------------------------------------------------------
+// DfsInodeLock and DfsInodeUnlock take and release the lock that
+// covers inode handle's blocks and size.  Neither may be held twice.
+//-----------------------------------------------------------------
+
+static void DfsInodeLock(uint32 handle) {
+	while (LockHandleAcquire(inode_locks[handle % DFS_INODE_LOCKS]) != SYNC_SUCCESS) {}
+}
+
+static void DfsInodeUnlock(uint32 handle) {
+	LockHandleRelease(inode_locks[handle % DFS_INODE_LOCKS]);
+}
+
+
+//-----------------------------------------------------------------
+// Extent map helpers.  DfsExtentMapReset forgets every map; the
+// others take extent_lock themselves.
+//-----------------------------------------------------------------
+
+static void DfsExtentMapReset() {
+	int i;
+
+	for (i = 0; i < DFS_EXTENT_MAPS; i++) {
+		extent_maps[i].handle = -1;
+	}
+}
+
+// DfsExtentMapFind returns handle's map, or NULL.  extent_lock held.
+static dfs_extent_map *DfsExtentMapFind(uint32 handle) {
+	int i;
+
+	for (i = 0; i < DFS_EXTENT_MAPS; i++) {
+		if (extent_maps[i].handle == handle) {
+			extent_maps[i].used = ++extent_clock;
+			return &extent_maps[i];
+		}
+	}
+	return NULL;
+}
+
+// DfsExtentMapSet records handle's n extents, taking the least
+// recently used map if it has none, or drops its map if they all fit
+// in the inode.
+static void DfsExtentMapSet(uint32 handle, dfs_extent *ext, int n) {
+	dfs_extent_map *m;
+	uint32 end = 0;
+	int i;
+
+	if (LockHandleAcquire(extent_lock) != SYNC_SUCCESS) {
+		return;
+	}
+	if ((m = DfsExtentMapFind(handle)) == NULL) {
+		if (n <= DFS_INODE_EXTENTS) {
+			LockHandleRelease(extent_lock);
+			return;
+		}
+		m = &extent_maps[0];
+		for (i = 1; i < DFS_EXTENT_MAPS; i++) {
+			if ((extent_maps[i].handle == -1) ||
+			    ((m->handle != -1) && (extent_maps[i].used < m->used))) {
+				m = &extent_maps[i];
+			}
+		}
+		m->used = ++extent_clock;
+	}
+	if (n <= DFS_INODE_EXTENTS) {
+		m->handle = -1;
+	} else {
+		m->handle = handle;
+		m->n = n;
+		for (i = 0; i < n; i++) {
+			m->ext[i] = ext[i];
+			end += ext[i].length;
+			m->ends[i] = end;
+		}
+	}
+	LockHandleRelease(extent_lock);
+}
+
+// DfsExtentMapGet copies handle's extents into ext and returns how
+// many, or DFS_FAIL if it has no map.
+static int DfsExtentMapGet(uint32 handle, dfs_extent *ext) {
+	dfs_extent_map *m;
+	int n = DFS_FAIL;
+
+	if (LockHandleAcquire(extent_lock) != SYNC_SUCCESS) {
+		return DFS_FAIL;
+	}
+	if ((m = DfsExtentMapFind(handle)) != NULL) {
+		n = m->n;
+		bcopy((char *)m->ext, (char *)ext, n * sizeof(dfs_extent));
+	}
+	LockHandleRelease(extent_lock);
+	return n;
+}
+
+// DfsExtentMapTranslate looks virtual_blocknum up in handle's map,
+// setting *blocknum to its block (0 for a hole or past the end).
+// Returns DFS_FAIL if handle has no map.
+static int DfsExtentMapTranslate(uint32 handle, uint32 virtual_blocknum, uint32 *blocknum) {
+	dfs_extent_map *m;
+	int lo, hi, mid;
+
+	if (LockHandleAcquire(extent_lock) != SYNC_SUCCESS) {
+		return DFS_FAIL;
+	}
+	if ((m = DfsExtentMapFind(handle)) == NULL) {
+		LockHandleRelease(extent_lock);
+		return DFS_FAIL;
+	}
+	*blocknum = 0;
+	if (virtual_blocknum < m->ends[m->n - 1]) {
+		// First extent ending past virtual_blocknum
+		lo = 0;
+		hi = m->n - 1;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (m->ends[mid] > virtual_blocknum) {
+				hi = mid;
+			} else {
+				lo = mid + 1;
+			}
+		}
+		if (m->ext[lo].start != 0) {
+			*blocknum = m->ext[lo].start + virtual_blocknum - (m->ends[lo] - m->ext[lo].length);
+		}
+	}
+	LockHandleRelease(extent_lock);
+	return DFS_SUCCESS;
+}
+
+
+//-----------------------------------------------------------------
+// DfsExtentsLoad copies the inode's extents, the ones in its extent
+// block included, into ext (DFS_MAX_EXTENTS of them at most) and
+// returns how many there are, or DFS_FAIL if the block can't be read.
+// The extent block is only read if the inode has no extent map.  An
+// inline file has none.
+//-----------------------------------------------------------------
+
+static int DfsExtentsLoad(uint32 handle, dfs_extent *ext) {
+	dfs_block b;
+	dfs_extent *more = (dfs_extent *)b.data;
+	int n, i;
+
+	//An inline file has no blocks
+	if (inodes[handle].inuse & DFS_INODE_INLINE) {
+		return 0;
+	}
+	for (n = 0; (n < DFS_INODE_EXTENTS) && (inodes[handle].extents[n].length != 0); n++) {
+		ext[n] = inodes[handle].extents[n];
+	}
+	if ((n < DFS_INODE_EXTENTS) || (inodes[handle].extent_block == 0)) {
+		return n;
+	}
+	if ((i = DfsExtentMapGet(handle, ext)) != DFS_FAIL) {
+		return i;
+	}
+	if (DfsReadBlock(inodes[handle].extent_block, &b) == DFS_FAIL) {
+		printf("DfsExtentsLoad: Error could not read extent block %d\n", inodes[handle].extent_block);
+		return DFS_FAIL;
+	}
+	for (i = 0; (i < extent_block_extents) && (more[i].length != 0); i++) {
+		ext[n++] = more[i];
+	}
+	DfsExtentMapSet(handle, ext, n);
+	return n;
+}
+
+//-----------------------------------------------------------------
+// DfsExtentsStore puts the n extents in ext back into the inode,
+// allocating its extent block when they no longer fit and freeing it
+// once they do again.  Returns DFS_FAIL if there are too many or the
+// extent block can't be allocated or written, leaving the inode and
+// its extent map as they were.
+//-----------------------------------------------------------------
+
+static int DfsExtentsStore(uint32 handle, dfs_extent *ext, int n) {
+	dfs_block b;
+	int i;
+	uint32 eb = inodes[handle].extent_block;
+
+	if (n > DFS_INODE_EXTENTS + extent_block_extents) {
+		printf("DfsExtentsStore: Error inode %d would need %d extents\n", handle, n);
+		return DFS_FAIL;
+	}
+	//The extent block is allocated and written before anything changes
+	if (n > DFS_INODE_EXTENTS) {
+		if (eb == 0) {
+			if ((eb = DfsAllocateBlockNear(ext[DFS_INODE_EXTENTS - 1].start)) == DFS_FAIL) {
+				printf("DfsExtentsStore: Error cannot allocate extent block\n");
+				return DFS_FAIL;
+			}
+		}
+		bzero(b.data, sb.dfs_blocksize);
+		bcopy((char *)&ext[DFS_INODE_EXTENTS], b.data, (n - DFS_INODE_EXTENTS) * sizeof(dfs_extent));
+		if (DfsWriteBlock(eb, &b) == DFS_FAIL) {
+			printf("DfsExtentsStore: Error writing extent block %d\n", eb);
+			if (inodes[handle].extent_block == 0) {
+				DfsFreeBlock(eb);
+			}
+			return DFS_FAIL;
+		}
+	}
+	DfsExtentMapSet(handle, ext, n);
+	DfsInodeDirty(handle);
+	for (i = 0; i < DFS_INODE_EXTENTS; i++) {
+		if (i < n) {
+			inodes[handle].extents[i] = ext[i];
+		} else {
+			inodes[handle].extents[i].start = 0;
+			inodes[handle].extents[i].length = 0;
+		}
+	}
+	if (n <= DFS_INODE_EXTENTS) {
+		if (inodes[handle].extent_block != 0) {
+			DfsFreeBlock(inodes[handle].extent_block);
+			inodes[handle].extent_block = 0;
+		}
+		return DFS_SUCCESS;
+	}
+	inodes[handle].extent_block = eb;
+	return DFS_SUCCESS;
+}
+
+//-----------------------------------------------------------------
+// DfsExtentsMerge joins neighbouring extents that continue each
+// other (two holes, or a run ending where the next one starts) and
+// drops empty ones.  Returns the new count.
+//-----------------------------------------------------------------
+
+static int DfsExtentsMerge(dfs_extent *ext, int n) {
+	int i, j = 0;
+
+	for (i = 0; i < n; i++) {
+		if (ext[i].length == 0) {
+			continue;
+		}
+		if ((j > 0) && (((ext[j-1].start == 0) && (ext[i].start == 0)) ||
+		                ((ext[j-1].start != 0) && (ext[j-1].start + ext[j-1].length == ext[i].start)))) {
+			ext[j-1].length += ext[i].length;
+		} else {
+			ext[j++] = ext[i];
+		}
+	}
+	return j;
+}
+
+
 //-----------------------------------------------------------------
 // DfsInodeDelete de-allocates any data blocks used by this inode, 
-// including the indirect addressing block if necessary, then mark 
+// including its extent block if it has one, then mark 
 // the inode as no longer in use. Use locks when modifying the 
 // "inuse" flag in an inode.Return DFS_FAIL on failure, and 
 // DFS_SUCCESS on success.
 //-----------------------------------------------------------------
 
-int DfsInodeDelete(uint32 handle) {
+static int DfsInodeRelease(uint32 handle) {
 	//Initializations
-	int i = 0; 
-	//uint32 inhandle;
-	dfs_block ind_block;
-	uint32 indirect_table[sb.dfs_blocksize / 4];
+	int i, n;
+	uint32 j;
+	dfs_extent ext[DFS_MAX_EXTENTS];
 	//Check if file system is valid
 	if (!sb.valid) {
 		printf("DfsInodeDelete: Error cannot delete inode if file system is invalid\n");
@@ -467,65 +1813,372 @@ int DfsInodeDelete(uint32 handle) {
 	}
 
 	//Deallocate blocks represented by Inodes
-	
-	//Deallocate inderect addressing block
-	//Read the inderect block from disk into a dfs block to make a table of indirect addresses to free
-	if (DfsReadBlock(inodes[handle].indirect_block, &ind_block) == DFS_FAIL) {
-		printf("DfsInodeDelete: Error could not read inderct block into dfs block\n");
+	if ((n = DfsExtentsLoad(handle, ext)) == DFS_FAIL) {
+		printf("DfsInodeDelete: Error could not read the extents of inode %d\n", handle);
+		return DFS_FAIL;
+	}
+	for (i = 0; i < n; i++) {
+		if (ext[i].start == 0) {continue;}
+		for (j = 0; j < ext[i].length; j++) {
+			if (DfsFreeBlock(ext[i].start + j) == DFS_FAIL) {
+				printf("DfsInodeDelete: Error could not deallocate block # %d of extent %d\n", ext[i].start + j, i);
+				return DFS_FAIL;
+			}
+		}
+	}
+
+	//Drop the extents, and the extent block with them
+	if (DfsExtentsStore(handle, ext, 0) == DFS_FAIL) {
+		return DFS_FAIL;
+	}
+
+	//clear filesize
+	inodes[handle].filesize = 0;
+
+	//Acquire lock for changing inode use
+	if(RwLockHandleAcquireWrite(inode_lock) != SYNC_SUCCESS) {
+    	printf("DfsFreeBlock bad lock acquire!\n");
+    	return DFS_FAIL;
+	}
+
+	DfsIndexRemove(handle);
+	bzero(inodes[handle].filename, DFS_MAX_FILENAME_SIZE);
+	inodes[handle].inuse = 0;
+	DfsInodeDirty(handle);
+
+	if(RwLockHandleRelease(inode_lock) != SYNC_SUCCESS) {
+    	printf("DfsFreeBlock bad lock release!\n");
+    	return DFS_FAIL;
+	}
+
+	return DFS_SUCCESS;
+}
+
+int DfsInodeDelete(uint32 handle) {
+	int result;
+
+	DfsInodeLock(handle);
+	result = DfsInodeRelease(handle);
+	//The handle may be reused for another file
+	MemoryFileCacheDrop(handle);
+	DfsInodeUnlock(handle);
+	return result;
+}
+
+
+//-----------------------------------------------------------------
+// DfsInodeTruncateFile sets the size of the file to size bytes.  A
+// smaller size frees the blocks past it and zeroes the rest of its
+// last block, so that growing the file again reads zeros there.  A
+// larger size allocates nothing: the new bytes are a hole until
+// they're written.  Return DFS_FAIL on failure, and DFS_SUCCESS on
+// success.
+//-----------------------------------------------------------------
+
+static int DfsInodeResize(uint32 handle, uint32 size) {
+	dfs_extent ext[DFS_MAX_EXTENTS];
+	dfs_block zeros;
+	uint32 keep = (size + sb.dfs_blocksize - 1) / sb.dfs_blocksize; // blocks left
+	uint32 base = 0;
+	uint32 len, cut, j, blocknum;
+	int i, n;
+
+	if (!sb.valid) {
+		printf("DfsInodeTruncateFile: Error cannot truncate if file system is invalid\n");
+		return DFS_FAIL;
+	}
+	if (!inodes[handle].inuse) {
+		printf("DfsInodeTruncateFile: Error cannot truncate inode %d, it is not inuse\n", handle);
+		return DFS_FAIL;
+	}
+	if (inodes[handle].inuse & DFS_INODE_INLINE) {
+		if (size <= DFS_INODE_INLINE_BYTES) {
+			//What's past the end must read as zeros if it grows again
+			if (size < inodes[handle].filesize) {
+				bzero((char *)inodes[handle].extents + size, DFS_INODE_INLINE_BYTES - size);
+			}
+			inodes[handle].filesize = size;
+			DfsInodeDirty(handle);
+			return DFS_SUCCESS;
+		}
+		if (DfsInodeUninline(handle) == DFS_FAIL) {
+			return DFS_FAIL;
+		}
+	}
+	if (size >= inodes[handle].filesize) {
+		inodes[handle].filesize = size;
+		DfsInodeDirty(handle);
+		return DFS_SUCCESS;
+	}
+
+	//Zero what's past the new end in the last block left
+	if ((size % sb.dfs_blocksize) != 0) {
+		if ((blocknum = DfsInodeLookupBlock(handle, size / sb.dfs_blocksize)) == DFS_FAIL) {
+			return DFS_FAIL;
+		}
+		bzero(zeros.data, sb.dfs_blocksize);
+		if ((blocknum != 0) &&
+		    (DfsWriteBlockPart(blocknum, size % sb.dfs_blocksize, sb.dfs_blocksize - (size % sb.dfs_blocksize),
+				       zeros.data, 0) == DFS_FAIL)) {
+			printf("DfsInodeTruncateFile: Error zeroing the end of block %d\n", blocknum);
+			return DFS_FAIL;
+		}
+	}
+
+	//Free the blocks past it and cut the extents short
+	if ((n = DfsExtentsLoad(handle, ext)) == DFS_FAIL) {
+		printf("DfsInodeTruncateFile: Error could not read the extents of inode %d\n", handle);
+		return DFS_FAIL;
+	}
+	for (i = 0; i < n; i++) {
+		len = ext[i].length;
+		if (base + len > keep) {
+			cut = (keep > base) ? keep - base : 0;
+			for (j = cut; (ext[i].start != 0) && (j < len); j++) {
+				if (DfsFreeBlock(ext[i].start + j) == DFS_FAIL) {
+					printf("DfsInodeTruncateFile: Error could not deallocate block # %d\n", ext[i].start + j);
+					return DFS_FAIL;
+				}
+			}
+			ext[i].length = cut;
+		}
+		base += len;
+	}
+	n = DfsExtentsMerge(ext, n);
+	//A hole at the end maps nothing
+	while ((n > 0) && (ext[n-1].start == 0)) {
+		n--;
+	}
+	if (DfsExtentsStore(handle, ext, n) == DFS_FAIL) {
+		return DFS_FAIL;
+	}
+	inodes[handle].filesize = size;
+	DfsInodeDirty(handle);
+	return DFS_SUCCESS;
+}
+
+int DfsInodeTruncateFile(uint32 handle, uint32 size) {
+	int result;
+
+	DfsInodeLock(handle);
+	result = DfsInodeResize(handle, size);
+	//Cached pages may hold bytes that should now read as zeros
+	MemoryFileCacheDrop(handle);
+	DfsInodeUnlock(handle);
+	return result;
+}
+
+
+//-----------------------------------------------------------------
+// DfsAllocateRun allocates count consecutive free data blocks, the
+// first such run in the fbv, and returns the first of them, or
+// DFS_FAIL if there's no run that long.
+//-----------------------------------------------------------------
+
+static uint32 DfsAllocateRun(int count) {
+	uint32 b, first;
+	int run = 0;
+
+	if (LockHandleAcquire(fbv_lock) != SYNC_SUCCESS) {
+		printf("DfsAllocateRun bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	for (b = sb.dfs_start_block_data; (b < sb.dfs_numblocks) && (run < count); b++) {
+		if (((b % 32) == 0) && (fbv[b / 32] == 0)) {
+			//A whole word in use
+			run = 0;
+			b += 31;
+		} else if (fbv[b / 32] & (1 << (b % 32))) {
+			run++;
+		} else {
+			run = 0;
+		}
+	}
+	if (run < count) {
+		LockHandleRelease(fbv_lock);
+		return DFS_FAIL;
+	}
+	first = b - count;
+	for (b = first; b < first + count; b++) {
+		SetFBV(b, 0);
+	}
+	sb.dfs_free_blocks -= count;
+	LockHandleRelease(fbv_lock);
+	dbprintf('Q', "DfsAllocateRun: blocks %d-%d.\n", first, first + count - 1);
+	return first;
+}
+
+
+//-----------------------------------------------------------------
+// DfsInodeDefrag moves the blocks of a file spread over more than
+// one run of the disk into one contiguous run, copying them through
+// the buffer cache, then switches the file's extents over to the new
+// run (holes stay holes) and frees the old blocks.  The inode's lock
+// is held throughout, so the file's readers and writers wait and
+// never see a half moved file.  Returns the number of blocks moved,
+// 0 if the file is already contiguous or there's no run long enough,
+// or DFS_FAIL.
+//-----------------------------------------------------------------
+
+static int DfsInodeMove(uint32 handle) {
+	dfs_extent ext[DFS_MAX_EXTENTS];
+	dfs_extent old[DFS_MAX_EXTENTS];
+	dfs_block b;
+	uint32 first, next, j;
+	int n, i, runs = 0, total = 0;
+
+	if (!sb.valid || !inodes[handle].inuse) {
+		printf("DfsInodeDefrag: Error inode %d is not inuse\n", handle);
+		return DFS_FAIL;
+	}
+	if ((n = DfsExtentsLoad(handle, ext)) == DFS_FAIL) {
+		return DFS_FAIL;
+	}
+	for (i = 0; i < n; i++) {
+		if (ext[i].start != 0) {
+			if ((runs == 0) || (ext[i].start != next)) {
+				runs++;
+			}
+			next = ext[i].start + ext[i].length;
+			total += ext[i].length;
+		}
+	}
+	if ((runs <= 1) || ((first = DfsAllocateRun(total)) == DFS_FAIL)) {
+		return 0;
+	}
+
+	//Copy each block to its new place
+	next = first;
+	for (i = 0; i < n; i++) {
+		old[i] = ext[i];
+		if (ext[i].start == 0) {continue;}
+		for (j = 0; j < ext[i].length; j++) {
+			if ((DfsReadBlock(ext[i].start + j, &b) == DFS_FAIL) ||
+			    (DfsWriteBlock(next + j, &b) == DFS_FAIL)) {
+				printf("DfsInodeDefrag: Error copying block %d of inode %d\n", ext[i].start + j, handle);
+				for (j = first; j < first + total; j++) {
+					DfsFreeBlock(j);
+				}
+				return DFS_FAIL;
+			}
+		}
+		ext[i].start = next;
+		next += ext[i].length;
+	}
+
+	//Switch over, then let the old blocks go
+	if (DfsExtentsStore(handle, ext, DfsExtentsMerge(ext, n)) == DFS_FAIL) {
+		for (j = first; j < first + total; j++) {
+			DfsFreeBlock(j);
+		}
+		return DFS_FAIL;
+	}
+	for (i = 0; i < n; i++) {
+		for (j = 0; (old[i].start != 0) && (j < old[i].length); j++) {
+			DfsFreeBlock(old[i].start + j);
+		}
+	}
+	dbprintf('Q', "DfsInodeDefrag: inode %d, %d blocks from %d runs to %d-%d.\n",
+		 handle, total, runs, first, first + total - 1);
+	return total;
+}
+
+int DfsInodeDefrag(uint32 handle) {
+	int moved;
+
+	DfsInodeLock(handle);
+	moved = DfsInodeMove(handle);
+	DfsInodeUnlock(handle);
+	return moved;
+}
+
+
+//-----------------------------------------------------------------
+// DfsDefrag defragments the first file at or after inode start that
+// DfsInodeDefrag moves blocks of, and returns the inode to start from
+// the next time, or 0 once no file is left to move.  A process that
+// calls it in a loop, yielding in between, defragments the whole
+// file system a file at a time, and at its own priority.  Returns
+// DFS_FAIL on failure.
+//-----------------------------------------------------------------
+
+int DfsDefrag(uint32 start) {
+	uint32 i;
+	int moved;
+
+	if (!sb.valid) {
+		printf("DfsDefrag: Error cannot defragment if file system is invalid\n");
 		return DFS_FAIL;
 	}
-
-	//Free/Deallocate all blocks referenced by the indirect address
-	bcopy (ind_block.data, (char *)indirect_table, sb.dfs_blocksize);
-	while(indirect_table[i] != 0) {
-		if(DfsFreeBlock(indirect_table[i]) == DFS_FAIL) {
-			printf("DfsInodeDelete: could not free an address in indirect table. i=%d\n", i);
+	//The inodes have to be read in first
+	if (inode_unloaded != 0) {
+		if (RwLockHandleAcquireWrite(inode_lock) != SYNC_SUCCESS) {
+			printf("DfsDefrag bad lock acquire!\n");
 			return DFS_FAIL;
 		}
-		i++;
-	}
-
-	if(inodes[handle].indirect_block != 0) {
-		if(DfsFreeBlock(inodes[handle].indirect_block) == DFS_FAIL) {
-			printf("DfsInodeDelete: could not free indirect block.\n");
+		moved = DfsIndexLoad();
+		RwLockHandleRelease(inode_lock);
+		if (moved == DFS_FAIL) {
 			return DFS_FAIL;
 		}
 	}
-
-	//Set indirect address to 0
-	inodes[handle].indirect_block = 0;
-
-	//Free blocks referenced by virt address blocks
-	for (i = 0; i < 10; i++) {
-		if(inodes[handle].virt_blocks[i] != 0) {
-			if (DfsFreeBlock(inodes[handle].virt_blocks[i]) == DFS_FAIL) {
-				printf("DfsInodeDelete: Error could not deallocate block # %d, referenced by virtual address block", inodes[handle].virt_blocks[i]);
-				return DFS_FAIL;
-			}
+	for (i = start; i < sb.dfs_inodes_used; i++) {
+		if (!inodes[i].inuse) {continue;}
+		if ((moved = DfsInodeDefrag(i)) == DFS_FAIL) {
+			return DFS_FAIL;
+		}
+		if (moved > 0) {
+			return i + 1;
 		}
-
-		//Set translation back to 0
-		inodes[handle].virt_blocks[i] = 0;
 	}
+	return 0;
+}
 
-	//clear filesize
-	inodes[handle].filesize = 0;
-	bzero(inodes[handle].filename, DFS_MAX_FILENAME_SIZE);
 
-	//Acquire lock for changing inode use
-	if(LockHandleAcquire(inode_lock) != SYNC_SUCCESS) {
-    	printf("DfsFreeBlock bad lock acquire!\n");
-    	return DFS_FAIL;
-	}
+//-----------------------------------------------------------------
+// DfsReadDir fills ents with up to n of the files in use, in inode
+// order from inode start on, along with their sizes.  It's all from
+// the inodes in memory, so listing the file system takes no disk
+// reads after the first lookup.  Returns the number filled in, 0 if
+// there are none past start, or DFS_FAIL.  The next call goes on
+// from the last one's inode plus one.
+//-----------------------------------------------------------------
 
-	inodes[handle].inuse = 0;
+int DfsReadDir(uint32 start, dfs_dirent *ents, int n) {
+	uint32 i;
+	int got = 0;
 
-	if(LockHandleRelease(inode_lock) != SYNC_SUCCESS) {
-    	printf("DfsFreeBlock bad lock release!\n");
-    	return DFS_FAIL;
+	if (!sb.valid) {
+		printf("DfsReadDir: Error cannot list files if file system is invalid\n");
+		return DFS_FAIL;
 	}
-
-	return DFS_SUCCESS;
+	//The inodes have to be read in first
+	if (inode_unloaded != 0) {
+		if (RwLockHandleAcquireWrite(inode_lock) != SYNC_SUCCESS) {
+			printf("DfsReadDir bad lock acquire!\n");
+			return DFS_FAIL;
+		}
+		got = DfsIndexLoad();
+		RwLockHandleRelease(inode_lock);
+		if (got == DFS_FAIL) {
+			return DFS_FAIL;
+		}
+		got = 0;
+	}
+	if (RwLockHandleAcquireRead(inode_lock) != SYNC_SUCCESS) {
+		printf("DfsReadDir bad lock acquire!\n");
+		return DFS_FAIL;
+	}
+	for (i = start; (i < sb.dfs_inodes_used) && (got < n); i++) {
+		if (!inodes[i].inuse) {continue;}
+		ents[got].inode = i;
+		ents[got].filesize = inodes[i].filesize;
+		ents[got].isinline = (inodes[i].inuse == DFS_INODE_INLINE);
+		dstrncpy(ents[got].filename, inodes[i].filename, DFS_MAX_FILENAME_SIZE);
+		got++;
+	}
+	RwLockHandleRelease(inode_lock);
+	return got;
 }
 
 
@@ -533,17 +2186,42 @@ int DfsInodeDelete(uint32 handle) {
 // DfsInodeReadBytes reads num_bytes from the file represented by 
 // the inode handle, starting at virtual byte start_byte, copying 
 // the data to the address pointed to by mem. Return DFS_FAIL on 
-// failure, and the number of bytes read on success.
+// failure, and the number of bytes read on success.  Pages of the
+// file in the memory module's page cache are copied from there,
+// since that's the only copy cached (and a mapping may have changed
+// it since it was last written back); DfsInodeReadSpan reads the
+// rest through the buffer cache.
 //-----------------------------------------------------------------
 
+static int DfsInodeReadSpan(uint32 handle, void *mem, int start_byte, int num_bytes);
+
 int DfsInodeReadBytes(uint32 handle, void *mem, int start_byte, int num_bytes) {
+	int bytes_read = 0;
+	int n;
+	uint32 page;
+
+	while (bytes_read < num_bytes) {
+		n = MEMORY_PAGE_SIZE - ((start_byte + bytes_read) % MEMORY_PAGE_SIZE);
+		if (n > num_bytes - bytes_read) {
+			n = num_bytes - bytes_read;
+		}
+		if ((page = MemoryFileCacheLookup(handle, start_byte + bytes_read)) != 0) {
+			bcopy((char *)page + ((start_byte + bytes_read) % MEMORY_PAGE_SIZE), (char *)mem + bytes_read, n);
+		} else if (DfsInodeReadSpan(handle, (char *)mem + bytes_read, start_byte + bytes_read, n) == DFS_FAIL) {
+			return DFS_FAIL;
+		}
+		bytes_read += n;
+	}
+	return bytes_read;
+}
+
+static int DfsInodeReadSpan(uint32 handle, void *mem, int start_byte, int num_bytes) {
 	//Initializations
-	//int i; 
-	dfs_block new_block;
-	//uint32 indirect_table[sb.dfs_blocksize / 4];
 	int curr_byte = start_byte;
 	int bytes_read = 0;
 	int bytestoread;
+	int offset;
+	int run, maxrun; 					// Whole blocks read at once
 	uint32 filesys_blocknum;
 
 	//Check if file system is valid
@@ -558,31 +2236,56 @@ int DfsInodeReadBytes(uint32 handle, void *mem, int start_byte, int num_bytes) {
 		return DFS_FAIL;
 	}
 
+	//An inline file is all in the inode; the bytes past its end are zeros
+	if (inodes[handle].inuse & DFS_INODE_INLINE) {
+		bytes_read = DFS_INODE_INLINE_BYTES - start_byte;
+		if (start_byte >= DFS_INODE_INLINE_BYTES) {
+			bytes_read = 0;
+		} else if (bytes_read > num_bytes) {
+			bytes_read = num_bytes;
+		}
+		bcopy((char *)inodes[handle].extents + start_byte, (char *)mem, bytes_read);
+		bzero((char *)mem + bytes_read, num_bytes - bytes_read);
+		return num_bytes;
+	}
+
+	maxrun = DISK_MAX_REQUEST_BLOCKS / (sb.dfs_blocksize / DISK_BLOCKSIZE);
 	//Read bytes from the file represented, starting at the start byte, going until num bytes
 	while (bytes_read < num_bytes) {
+		//Caluclate bytes being read from this block into mem
+		offset = curr_byte % sb.dfs_blocksize;
+		bytestoread = sb.dfs_blocksize - offset;
+		if ((bytestoread + bytes_read) > num_bytes) {
+			bytestoread = num_bytes - bytes_read;
+		}
+
 		//get block number from translation
 		if ( (filesys_blocknum = DfsInodeTranslateVirtualToFilesys(handle, curr_byte / sb.dfs_blocksize)) == DFS_FAIL) {
 			printf("DfsInodeReadBytes: Error trying to translate virt_blocknum to filesys_blocknum\n");
 			return DFS_FAIL;
 		}
-		//read block into a new dfs block
-		if (DfsReadBlock(filesys_blocknum, &new_block) == DFS_FAIL) {
-			printf("DfsInodeReadBytes: Error reading into dfs block\n");
-			return DFS_FAIL;
-		}
 
-		//Caluclate bytes being read from block into mem
-		bytestoread = sb.dfs_blocksize - (curr_byte % sb.dfs_blocksize);
-
-		//check if bytestoread  + the current byte count goes over the num_bytes, if so adjust bytestoread to reach num_bytes
-		if ((bytestoread + bytes_read) > num_bytes) {
-			bytestoread = num_bytes - bytes_read;
+		if (filesys_blocknum == 0) {
+			//a hole reads as zeros
+			bzero((char *) mem + bytes_read, bytestoread);
+		} else if (bytestoread < sb.dfs_blocksize) {
+			//part of a block comes straight out of its buffer
+			if (DfsReadBlockPart(filesys_blocknum, offset, bytestoread, (char *) mem + bytes_read) == DFS_FAIL) {
+				printf("DfsInodeReadBytes: Error reading block %d\n", filesys_blocknum);
+				return DFS_FAIL;
+			}
+		} else {
+			//whole blocks go straight into mem, a run that's consecutive on disk at once
+			for (run = 1; (run < maxrun) && (num_bytes - bytes_read >= (run + 1) * sb.dfs_blocksize) &&
+			     (DfsInodeTranslateVirtualToFilesys(handle, curr_byte / sb.dfs_blocksize + run) == filesys_blocknum + run); run++) {
+			}
+			bytestoread = run * sb.dfs_blocksize;
+			if (DfsReadBlocks(filesys_blocknum, run, (char *) mem + bytes_read) == DFS_FAIL) {
+				printf("DfsInodeReadBytes: Error reading blocks %d-%d\n", filesys_blocknum, filesys_blocknum + run - 1);
+				return DFS_FAIL;
+			}
 		}
 
-		//Copy bytes to read from dfs block into mem
-		//bcopy(&(new_block.data[curr_byte % sb.dfs_blocksize]), &(mem[bytes_read]), bytestoread);
-		bcopy(&(new_block.data[curr_byte % sb.dfs_blocksize]), (char *) mem + bytes_read, bytestoread);
-
 		//update curr_byte and bytes_read
 		curr_byte += bytestoread;
 		bytes_read += bytestoread;
@@ -592,23 +2295,200 @@ int DfsInodeReadBytes(uint32 handle, void *mem, int start_byte, int num_bytes) {
 }
 
 
+//-----------------------------------------------------------------
+// DfsInodeReadv reads up to num_bytes from the file represented by
+// the inode handle, starting at virtual byte start_byte, into the n
+// pieces of memory in iov, filling each in turn.  Return DFS_FAIL on
+// failure, and the number of bytes read on success.
+//-----------------------------------------------------------------
+
+int DfsInodeReadv(uint32 handle, dfs_iovec *iov, int n, int start_byte, int num_bytes) {
+	int bytes_read = 0;
+	int len, i;
+
+	for (i = 0; (i < n) && (bytes_read < num_bytes); i++) {
+		len = iov[i].len;
+		if (len > num_bytes - bytes_read) {
+			len = num_bytes - bytes_read;
+		}
+		if ((len > 0) && (DfsInodeReadBytes(handle, iov[i].mem, start_byte + bytes_read, len) == DFS_FAIL)) {
+			return DFS_FAIL;
+		}
+		bytes_read += len;
+	}
+	return bytes_read;
+}
+
+
+//-----------------------------------------------------------------
+// DfsInodePrefetch starts reading up to count blocks of the file,
+// beginning with the one holding start_byte, into the buffer cache
+// without waiting for them.  Blocks already cached (in the buffer
+// cache or the page cache), holes and blocks past the end of the
+// file are skipped.  It stops early rather than
+// wait: when the disk queue is busy, or the buffer it would reuse is
+// dirty or still filling.  Returns the number of reads started.
+//-----------------------------------------------------------------
+
+int DfsInodePrefetch(uint32 handle, int start_byte, int count) {
+	int m = sb.dfs_blocksize / DISK_BLOCKSIZE; // disk blocks per dfs block
+	uint32 vb, last, blocknum;
+	dfs_buffer *buf;
+	int started = 0;
+
+	if (!sb.valid || (cache_buffers == 0) || !inodes[handle].inuse || (inodes[handle].filesize == 0)) {
+		return 0;
+	}
+	//Leave at least half the cache to what's actually been read
+	if (count > cache_buffers / 2) {
+		count = cache_buffers / 2;
+	}
+	last = (inodes[handle].filesize - 1) / sb.dfs_blocksize;
+	for (vb = start_byte / sb.dfs_blocksize; (vb <= last) && (count > 0); vb++, count--) {
+		if (MemoryFileCacheLookup(handle, vb * sb.dfs_blocksize) != 0) {continue;}
+		if ((blocknum = DfsInodeTranslateVirtualToFilesys(handle, vb)) == DFS_FAIL) {
+			break;
+		}
+		if (blocknum == 0) {continue;}
+		if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+			break;
+		}
+		if (DfsCacheLookup(blocknum) != NULL) {
+			LockHandleRelease(cache_lock);
+			continue;
+		}
+		buf = cache_lru;
+		if (buf->dirty || buf->filling) {
+			LockHandleRelease(cache_lock);
+			break;
+		}
+		if (buf->valid) {
+			DfsCacheUnhash(buf);
+			dfs_stats.cacheEvictions++;
+		}
+		buf->blocknum = blocknum;
+		buf->valid = 1;
+		buf->filling = 1;
+		buf->hash_next = cache_hash[blocknum % DFS_CACHE_HASH_BUCKETS];
+		cache_hash[blocknum % DFS_CACHE_HASH_BUCKETS] = buf;
+		DfsCacheTouch(buf);
+		if (DiskStartRead(blocknum * m, m, buf->data, DfsCacheFilled, buf) == DISK_FAIL) {
+			buf->filling = 0;
+			DfsCacheUnhash(buf);
+			LockHandleRelease(cache_lock);
+			break;
+		}
+		dfs_stats.cachePrefetches++;
+		dfs_stats.blocksRead++;
+		started++;
+		LockHandleRelease(cache_lock);
+	}
+	dbprintf('Q', "DfsInodePrefetch: inode %d, %d reads started from vblock %d.\n", handle, started, start_byte / sb.dfs_blocksize);
+	return started;
+}
+
+
+//-----------------------------------------------------------------
+// DfsInodeUncache writes back and drops the buffers holding the
+// blocks of bytes start_byte to start_byte + num_bytes of the file,
+// once the page cache has a copy of them, so the same data isn't
+// cached twice.  DfsInodeUncacheSpan does the work for callers
+// already holding the inode's lock.  Returns DFS_SUCCESS, or
+// DFS_FAIL if a buffer couldn't be written back (it's kept then).
+//-----------------------------------------------------------------
+
+static int DfsInodeUncacheSpan(uint32 handle, int start_byte, int num_bytes) {
+	uint32 vb, last, blocknum;
+	dfs_buffer *buf;
+	int result = DFS_SUCCESS;
+
+	if (!sb.valid || (cache_buffers == 0) || (num_bytes <= 0) || (inodes[handle].inuse & DFS_INODE_INLINE)) {
+		return DFS_SUCCESS;
+	}
+	last = (start_byte + num_bytes - 1) / sb.dfs_blocksize;
+	for (vb = start_byte / sb.dfs_blocksize; vb <= last; vb++) {
+		//Translated first, since that may read the extent block through the cache
+		if (((blocknum = DfsInodeLookupBlock(handle, vb)) == DFS_FAIL) || (blocknum == 0)) {
+			continue;
+		}
+		if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+			return DFS_FAIL;
+		}
+		if ((buf = DfsCacheFind(blocknum)) != NULL) {
+			if (DfsCacheWriteBack(buf) == DFS_FAIL) {
+				result = DFS_FAIL;
+			} else {
+				DfsCacheUnhash(buf);
+			}
+		}
+		LockHandleRelease(cache_lock);
+	}
+	return result;
+}
+
+int DfsInodeUncache(uint32 handle, int start_byte, int num_bytes) {
+	int result;
+
+	DfsInodeLock(handle);
+	result = DfsInodeUncacheSpan(handle, start_byte, num_bytes);
+	DfsInodeUnlock(handle);
+	return result;
+}
+
+//-----------------------------------------------------------------
+// DfsPageCacheUpdate copies num_bytes just written at start_byte
+// from mem into the pages of the file in the page cache, so mappings
+// and later reads see them, and drops the buffers the write left
+// them in.  Writes to cached pages go through to the disk this way,
+// rather than waiting in the buffer cache as a second copy.  The
+// caller holds the inode's lock.
+//-----------------------------------------------------------------
+
+static void DfsPageCacheUpdate(uint32 handle, void *mem, int start_byte, int num_bytes) {
+	int done = 0;
+	int n;
+	char *to;
+	uint32 page;
+
+	while (done < num_bytes) {
+		n = MEMORY_PAGE_SIZE - ((start_byte + done) % MEMORY_PAGE_SIZE);
+		if (n > num_bytes - done) {
+			n = num_bytes - done;
+		}
+		if ((page = MemoryFileCacheLookup(handle, start_byte + done)) != 0) {
+			//A mapping writing its own page back has nothing to copy
+			to = (char *)page + ((start_byte + done) % MEMORY_PAGE_SIZE);
+			if (to != (char *)mem + done) {
+				bcopy((char *)mem + done, to, n);
+			}
+			if (DfsInodeUncacheSpan(handle, start_byte + done, n) == DFS_FAIL) {
+				printf("DfsPageCacheUpdate: Error could not write back blocks of inode %d\n", handle);
+			}
+		}
+		done += n;
+	}
+}
+
 //-----------------------------------------------------------------
 // DfsInodeWriteBytes writes num_bytes from the memory pointed to 
 // by mem to the file represented by the inode handle, starting at 
 // virtual byte start_byte. Note that if you are only writing part 
 // of a given file system block, you'll need to read that block 
 // from the disk first. Return DFS_FAIL on failure and the number 
-// of bytes written on success.
+// of bytes written on success.  The whole write is done with the
+// inode's lock held, so it's never mixed with another one.
 //-----------------------------------------------------------------
 
-int DfsInodeWriteBytes(uint32 handle, void *mem, int start_byte, int num_bytes) {
+static int DfsInodeWriteSpan(uint32 handle, void *mem, int start_byte, int num_bytes) {
 	//Initializations
 	//int i; 
-	dfs_block new_block;
 	int curr_byte = start_byte;
 	int bytes_written = 0;
 	int bytestowrite;
 	int virt_blocknum;
+	int fresh; 						// Block not allocated before this write
+	int run, maxrun; 				// Whole blocks written at once
+	uint32 blocknum;
 
 	//Check if file system is valid
 	if (!sb.valid) {
@@ -622,56 +2502,162 @@ int DfsInodeWriteBytes(uint32 handle, void *mem, int start_byte, int num_bytes)
 		return DFS_FAIL;
 	}
 
+	//A file with no blocks that still fits in the inode is kept there
+	if ((start_byte + num_bytes <= DFS_INODE_INLINE_BYTES) &&
+	    ((inodes[handle].inuse & DFS_INODE_INLINE) ||
+	     ((inodes[handle].filesize == 0) && (inodes[handle].extents[0].length == 0)))) {
+		if (!(inodes[handle].inuse & DFS_INODE_INLINE)) {
+			bzero((char *)inodes[handle].extents, DFS_INODE_INLINE_BYTES);
+			inodes[handle].inuse |= DFS_INODE_INLINE;
+		}
+		bcopy((char *)mem, (char *)inodes[handle].extents + start_byte, num_bytes);
+		if (inodes[handle].filesize < start_byte + num_bytes) {
+			inodes[handle].filesize = start_byte + num_bytes;
+		}
+		DfsInodeDirty(handle);
+		return num_bytes;
+	}
+	if ((inodes[handle].inuse & DFS_INODE_INLINE) && (DfsInodeUninline(handle) == DFS_FAIL)) {
+		return DFS_FAIL;
+	}
+
 	// dbprintf('Q', "DfsInodeWriteBytes: entering while loop. num_bytes=%d, handle=%d.\n", num_bytes, handle);
 	//write bytes from the file represented, starting at the start byte, going until num bytes
 	while (bytes_written < num_bytes) {
-		if((virt_blocknum = DfsInodeAllocateVirtualBlock(handle, curr_byte / sb.dfs_blocksize)) == DFS_FAIL) {
-			printf("DfsInodeWriteBytes: Error cannot allocate virt block.\n");
-			return DFS_FAIL;
-		}
-		dbprintf('Q', "DfsInodeWriteBytes: allocate virt_block returned: %d.\n", virt_blocknum);
-
-		bytestowrite = sb.dfs_blocksize - (curr_byte % sb.dfs_blocksize);
-		if(bytestowrite == sb.dfs_blocksize) {
-			// first part is block alligned
-			if((bytes_written + bytestowrite) > num_bytes) {
-				bytestowrite = bytestowrite - ((bytes_written + bytestowrite) - num_bytes);
-				if(DfsReadBlock(virt_blocknum, &new_block) == DFS_FAIL) {
-					printf("DfsInodeWriteBytes: DfsReadBlock failed.\n");
+		// Whole blocks go straight from mem, a run of them that's
+		// consecutive on disk in one request
+		if (((curr_byte % sb.dfs_blocksize) == 0) && (num_bytes - bytes_written >= sb.dfs_blocksize)) {
+			maxrun = (num_bytes - bytes_written) / sb.dfs_blocksize;
+			if (maxrun > DISK_MAX_REQUEST_BLOCKS / (sb.dfs_blocksize / DISK_BLOCKSIZE)) {
+				maxrun = DISK_MAX_REQUEST_BLOCKS / (sb.dfs_blocksize / DISK_BLOCKSIZE);
+			}
+			for (run = 0; run < maxrun; run++) {
+				// The whole run is allocated on the first call
+				if ((blocknum = DfsInodeMapBlock(handle, curr_byte / sb.dfs_blocksize + run, maxrun - run)) == DFS_FAIL) {
+					printf("DfsInodeWriteBytes: Error cannot allocate virt block.\n");
 					return DFS_FAIL;
 				}
+				if (run == 0) {
+					virt_blocknum = blocknum;
+				} else if (blocknum != virt_blocknum + run) {
+					// Allocated already, so the next pass picks it up
+					break;
+				}
 			}
-		} else {
-			// woah, not block aligned
-			if((bytes_written + bytestowrite) > num_bytes) {
-				bytestowrite = bytestowrite - ((bytes_written + bytestowrite) - num_bytes);
-			}
-			if(DfsReadBlock(virt_blocknum, &new_block) == DFS_FAIL) {
-					printf("DfsInodeWriteBytes: DfsReadBlock failed.\n");
-					return DFS_FAIL;
+			if (DfsWriteBlocks(virt_blocknum, run, (char *)mem + bytes_written) == DFS_FAIL) {
+				printf("DfsInodeWriteBytes: Error writing blocks %d-%d.\n", virt_blocknum, virt_blocknum + run - 1);
+				return DFS_FAIL;
 			}
+			curr_byte += run * sb.dfs_blocksize;
+			bytes_written += run * sb.dfs_blocksize;
+			EVLOG(EV_DFS_WRITE_BLOCKS, handle, virt_blocknum, run, 0);
+			continue;
 		}
 
-		bcopy((char *) mem + bytes_written, &(new_block.data[curr_byte % sb.dfs_blocksize]), bytestowrite);
-
+		bytestowrite = sb.dfs_blocksize - (curr_byte % sb.dfs_blocksize);
+		if((bytes_written + bytestowrite) > num_bytes) {
+			bytestowrite = bytestowrite - ((bytes_written + bytestowrite) - num_bytes);
+		}
+		// Only part of the block is written.  A block that isn't
+		// allocated yet (past the end of the file, or in a hole) has
+		// never been written, and on a sparse image may hold anything,
+		// so it starts out as zeros instead.
+		fresh = ((curr_byte - (curr_byte % sb.dfs_blocksize)) >= inodes[handle].filesize) ||
+		        (DfsInodeLookupBlock(handle, curr_byte / sb.dfs_blocksize) == 0);
+
+		if((virt_blocknum = DfsInodeMapBlock(handle, curr_byte / sb.dfs_blocksize, 1)) == DFS_FAIL) {
+			printf("DfsInodeWriteBytes: Error cannot allocate virt block.\n");
+			return DFS_FAIL;
+		}
 
-		if (DfsWriteBlock(virt_blocknum, &new_block) == DFS_FAIL) {
+		//Straight into the block's buffer
+		if (DfsWriteBlockPart(virt_blocknum, curr_byte % sb.dfs_blocksize, bytestowrite,
+				      (char *) mem + bytes_written, fresh) == DFS_FAIL) {
 			printf("DfsInodeWriteBytes: Error Writing dfs block back to disk after writing in from mem\n");
 			return DFS_FAIL;
 		}
 		curr_byte += bytestowrite;
 		bytes_written += bytestowrite;
-		dbprintf('Q', "DfsInodeWriteBytes: curr_byte = %d, bytes_written: %d, num_bytes: %d, fs_blck=%d.\n", curr_byte, bytes_written, num_bytes, virt_blocknum);
+		EVLOG(EV_DFS_WRITE_PART, handle, virt_blocknum, (curr_byte - bytestowrite) % sb.dfs_blocksize, bytestowrite);
 	}
 
 	if (inodes[handle].filesize < start_byte + bytes_written) {
 		inodes[handle].filesize = start_byte + bytes_written;
+		DfsInodeDirty(handle);
 	}
 
 	return bytes_written;
 
 }
 
+int DfsInodeWriteBytes(uint32 handle, void *mem, int start_byte, int num_bytes) {
+	int written;
+
+	DfsInodeLock(handle);
+	if ((written = DfsInodeWriteSpan(handle, mem, start_byte, num_bytes)) != DFS_FAIL) {
+		DfsPageCacheUpdate(handle, mem, start_byte, written);
+	}
+	DfsInodeUnlock(handle);
+	return written;
+}
+
+
+//-----------------------------------------------------------------
+// DfsInodeWritev writes the n pieces of memory in iov one after the
+// other to the file represented by the inode handle, starting at
+// virtual byte start_byte.  The inode's lock is held across all of
+// them, so the record lands in one piece, and a block shared by two
+// pieces is still in its buffer when the second one is written.
+// Return DFS_FAIL on failure and the number of bytes written on
+// success.
+//-----------------------------------------------------------------
+
+int DfsInodeWritev(uint32 handle, dfs_iovec *iov, int n, int start_byte) {
+	int written = 0;
+	int i;
+
+	DfsInodeLock(handle);
+	for (i = 0; i < n; i++) {
+		if ((iov[i].len > 0) &&
+		    (DfsInodeWriteSpan(handle, iov[i].mem, start_byte + written, iov[i].len) == DFS_FAIL)) {
+			written = DFS_FAIL;
+			break;
+		}
+		DfsPageCacheUpdate(handle, iov[i].mem, start_byte + written, iov[i].len);
+		written += iov[i].len;
+	}
+	DfsInodeUnlock(handle);
+	return written;
+}
+
+
+//-----------------------------------------------------------------
+// DfsInodeUninline moves an inline file's data out of the inode and
+// into a block, so it can grow.  The caller holds the inode's lock.
+// Return DFS_FAIL on failure, and DFS_SUCCESS on success.
+//-----------------------------------------------------------------
+
+static int DfsInodeUninline(uint32 handle) {
+	char data[DFS_INODE_INLINE_BYTES];
+	uint32 size = inodes[handle].filesize;
+	uint32 blocknum;
+
+	dbprintf('Q', "DfsInodeUninline: inode %d, %d bytes.\n", handle, size);
+	bcopy((char *)inodes[handle].extents, data, DFS_INODE_INLINE_BYTES);
+	bzero((char *)inodes[handle].extents, DFS_INODE_INLINE_BYTES);
+	inodes[handle].inuse &= ~DFS_INODE_INLINE;
+	DfsInodeDirty(handle);
+	if (size == 0) {
+		return DFS_SUCCESS;
+	}
+	if (((blocknum = DfsInodeMapBlock(handle, 0, 1)) == DFS_FAIL) ||
+	    (DfsWriteBlockPart(blocknum, 0, size, data, 1) == DFS_FAIL)) {
+		printf("DfsInodeUninline: Error could not move the data of inode %d to a block\n", handle);
+		return DFS_FAIL;
+	}
+	return DFS_SUCCESS;
+}
+
 
 //-----------------------------------------------------------------
 // DfsInodeFilesize simply returns the size of an inode's file. 
@@ -680,6 +2666,8 @@ int DfsInodeWriteBytes(uint32 handle, void *mem, int start_byte, int num_bytes)
 //-----------------------------------------------------------------
 
 uint32 DfsInodeFilesize(uint32 handle) {
+	uint32 filesize;
+
 	//Check if file system is valid
 	if (!sb.valid) {
 		printf("DfsInodeWriteBytes: Error cannot write num_bytes into mem if file system is invalid\n");
@@ -692,25 +2680,38 @@ uint32 DfsInodeFilesize(uint32 handle) {
 		return DFS_FAIL;
 	}
 
-	return inodes[handle].filesize;
+	//One aligned word, only ever set whole by a writer holding the
+	//inode's lock, so no lock is needed to read it
+	filesize = inodes[handle].filesize;
+	return filesize;
 
 }
 
 
 //-----------------------------------------------------------------
 // DfsInodeAllocateVirtualBlock allocates a new filesystem block 
-// for the given inode, storing its blocknumber at index 
-// virtual_blocknumber in the translation table. If the 
-// virtual_blocknumber resides in the indirect address space, and 
-// there is not an allocated indirect addressing table, allocate it. 
+// for the given inode at virtual_blocknumber.  The file's blocks are
+// kept as extents: a block right after the extent before it just
+// makes that extent longer, and it's asked for next to it so that
+// usually works; one with nothing before it starts in the file's
+// allocation group.  A block past the end of the file leaves a hole for
+// the blocks it skips, and a block in a hole splits the hole.
 // Return DFS_FAIL on failure, and the newly allocated file system 
-// block number on success.
+// block number on success (or the one already there).  The caller
+// holds the inode's lock; DfsInodeMapBlock does that part.  It can
+// also allocate the want - 1 unallocated blocks after the one asked
+// for, which a write about to fill them all uses to get the whole
+// run from one allocator call, laid out contiguously.
 //-----------------------------------------------------------------
 
-uint32 DfsInodeAllocateVirtualBlock(uint32 handle, uint32 virtual_blocknum) {
+static uint32 DfsInodeMapBlock(uint32 handle, uint32 virtual_blocknum, int want) {
 	//Initializations
-	dfs_block new_block;
-	uint32 indirect_table[sb.dfs_blocksize / 4];
+	dfs_extent ext[DFS_MAX_EXTENTS + 2]; 		// Room for splitting a hole in three
+	uint32 hint = 0; 							// The block before, to allocate after
+	uint32 base = 0; 							// First virtual block of ext[i]
+	uint32 off;
+	uint32 blocknum;
+	int n, i, j, got;
 	
 	dbprintf('Q', "DfsInodeAllocateVirtualBlock: Begin. Handle=%d, vblock=%d\n", handle, virtual_blocknum);
 	//Check if file system is valid
@@ -724,64 +2725,74 @@ uint32 DfsInodeAllocateVirtualBlock(uint32 handle, uint32 virtual_blocknum) {
 		printf("DfsInodeAllocateVirtualBlock: Error Cannot allocate virt block if inode is not inuse\n");
 		return DFS_FAIL;
 	}
+	if ((inodes[handle].inuse & DFS_INODE_INLINE) && (DfsInodeUninline(handle) == DFS_FAIL)) {
+		return DFS_FAIL;
+	}
 
-	//Decide if virt_blocknumber is in virt_block table or indirect
-	//Virt_block table allocate
-	if (virtual_blocknum < 10) {
-		dbprintf('Q', "DfsInodeAllocateVirtualBlock: virt_block table.\n");
-		if (inodes[handle].virt_blocks[virtual_blocknum] != 0) { 
-			return inodes[handle].virt_blocks[virtual_blocknum];
-		}
-		if ((inodes[handle].virt_blocks[virtual_blocknum] = DfsAllocateBlock()) == DFS_FAIL) {
-			printf("DfsInodeAllocateVirtualBlock: Error Cannot allocate virtual block from v-table\n");
-			return DFS_FAIL;
-		}
-		return inodes[handle].virt_blocks[virtual_blocknum];
+	if ((n = DfsExtentsLoad(handle, ext)) == DFS_FAIL) {
+		return DFS_FAIL;
+	}
+	//Find the extent holding virtual_blocknum
+	for (i = 0; i < n; i++) {
+		if (virtual_blocknum < base + ext[i].length) {break;}
+		base += ext[i].length;
+	}
+	if ((i < n) && (ext[i].start != 0)) {
+		return ext[i].start + (virtual_blocknum - base);
+	}
+	if ((i > 0) && (ext[i-1].start != 0)) {
+		hint = ext[i-1].start + ext[i-1].length;
+	} else {
+		//Nothing before it to follow: start in the file's group
+		hint = DfsGroupStart(handle);
+	}
+	off = virtual_blocknum - base;
+	if ((i < n) && (want > ext[i].length - off)) {
+		want = ext[i].length - off;
+	}
+	if ((blocknum = DfsAllocateBlocksNear(hint, want, &got)) == DFS_FAIL) {
+		printf("DfsInodeAllocateVirtualBlock: Error Cannot allocate virtual block %d\n", virtual_blocknum);
+		return DFS_FAIL;
 	}
-	//indirect_table allocate
-	else {
-		dbprintf('Q', "DfsInodeAllocateVirtualBlock: indirect table.\n");
-		//check if indirect_block has been allocated, if not allocate it
-		if (inodes[handle].indirect_block == 0) {
-			dbprintf('Q', "DfsInodeAllocateVirtualBlock: indirect_block not allocated.\n");
-			if ((inodes[handle].indirect_block = DfsAllocateBlock()) == DFS_FAIL) {
-				printf("DfsInodeAllocateVirtualBlock: Error Cannot allocate indirect_block\n");
-				return DFS_FAIL;
-			}
-			dbprintf('Q', "DfsInodeAllocateVirtualBlock: bzero and DfsWriteBlock.\n");
-			//0 disk for allocation
-			bzero(new_block.data, sb.dfs_blocksize);
-			if (DfsWriteBlock(inodes[handle].indirect_block, &new_block) == DFS_FAIL) {
-				printf("DfsInodeAllocateVirtualBlock: Error writing 0 to disk for indirect_addressing. Block=%d.\n", inodes[handle].indirect_block);
-				return DFS_FAIL;
-			}
-			dbprintf('Q', "DfsInodeAllocateVirtualBlock: allocation complete.\n");
-		}
 
-		dbprintf('Q', "DfsInodeAllocateVirtualBlock: read indirect block.\n");
-		//Read indirect block from disk, copy into indirect table, allocate properly, write back to disk
-		if (DfsReadBlock(inodes[handle].indirect_block, &new_block) == DFS_FAIL) {
-			printf("DfsInodeAllocateVirtualBlock: Error could not read inderct block into dfs block for allocation\n");
-			return DFS_FAIL;
+	if (i < n) {
+		//In a hole: the hole before it, the block, the hole after it
+		dbprintf('Q', "DfsInodeAllocateVirtualBlock: splitting hole %d.\n", i);
+		for (j = n - 1; j > i; j--) {
+			ext[j+2] = ext[j];
 		}
-		dbprintf('Q', "DfsInodeAllocateVirtualBlock: bcopy and DfsAllocateBlock.\n");
-		bcopy (new_block.data, (char *)indirect_table, sb.dfs_blocksize);
-		virtual_blocknum -= 10;
-		if ((indirect_table[virtual_blocknum] = DfsAllocateBlock()) == DFS_FAIL) {
-			printf("DfsInodeAllocateVirtualBlock: Error Cannot allocate indirect_table at virt_blocknum");
-			return DFS_FAIL;
+		ext[i+2].start = 0;
+		ext[i+2].length = ext[i].length - off - got;
+		ext[i+1].start = blocknum;
+		ext[i+1].length = got;
+		ext[i].length = off;
+		n += 2;
+	} else {
+		//Past the end: a hole for the blocks skipped, then the block
+		ext[n].start = 0;
+		ext[n].length = off;
+		ext[n+1].start = blocknum;
+		ext[n+1].length = got;
+		n += 2;
+	}
+	n = DfsExtentsMerge(ext, n);
+	if (DfsExtentsStore(handle, ext, n) == DFS_FAIL) {
+		for (j = 0; j < got; j++) {
+			DfsFreeBlock(blocknum + j);
 		}
+		return DFS_FAIL;
+	}
+	dbprintf('Q', "DfsInodeAllocateVirtualBlock: vblock %d is block %d (%d allocated), %d extents.\n", virtual_blocknum, blocknum, got, n);
+	return blocknum;
+}
 
-		//write back into disk
-		dbprintf('Q', "DfsInodeAllocateVirtualBlock: write back into disk.\n");
-		bcopy((char *)indirect_table, new_block.data, sb.dfs_blocksize);
-		if (DfsWriteBlock(inodes[handle].indirect_block, &new_block) == DFS_FAIL) {
-			printf("DfsInodeAllocateVirtualBlock: Error writing updated indirect_adress table back to disk\n");
-			return DFS_FAIL;
-		}
+uint32 DfsInodeAllocateVirtualBlock(uint32 handle, uint32 virtual_blocknum) {
+	uint32 blocknum;
 
-		return indirect_table[virtual_blocknum];
-	}
+	DfsInodeLock(handle);
+	blocknum = DfsInodeMapBlock(handle, virtual_blocknum, 1);
+	DfsInodeUnlock(handle);
+	return blocknum;
 }
 
 
@@ -789,13 +2800,19 @@ uint32 DfsInodeAllocateVirtualBlock(uint32 handle, uint32 virtual_blocknum) {
 //-----------------------------------------------------------------
 // DfsInodeTranslateVirtualToFilesys translates the 
 // virtual_blocknum to the corresponding file system block using 
-// the inode identified by handle. Return DFS_FAIL on failure.
+// the inode identified by handle.  Returns 0 for a block that isn't
+// allocated, and DFS_FAIL on failure.  Blocks past the extents in
+// the inode are looked up in its extent map, which is built from the
+// extent block the first time one is needed.  DfsInodeLookupBlock
+// does the work for callers already holding the inode's lock.
 //-----------------------------------------------------------------
 
-uint32 DfsInodeTranslateVirtualToFilesys(uint32 handle, uint32 virtual_blocknum) {
+static uint32 DfsInodeLookupBlock(uint32 handle, uint32 virtual_blocknum) {
 	//initializations
-	dfs_block new_block;
-	uint32 indirect_table[sb.dfs_blocksize / 4];
+	dfs_extent ext[DFS_MAX_EXTENTS];
+	uint32 blocknum;
+	uint32 vb = virtual_blocknum;
+	int n, i;
 
 	//Check if file system is valid
 	if (!sb.valid) {
@@ -809,34 +2826,145 @@ uint32 DfsInodeTranslateVirtualToFilesys(uint32 handle, uint32 virtual_blocknum)
 		return DFS_FAIL;
 	}
 
-	//Decide if its in virt_block table or indirect
-	//Virt_block translation
-	if (virtual_blocknum < 10) {
-		return inodes[handle].virt_blocks[virtual_blocknum];
+	//An inline file's data isn't in any block
+	if (inodes[handle].inuse & DFS_INODE_INLINE) {
+		return 0;
 	}
-	//indirect translation
-	else {
-			//check if indirect block has been allocated (must be allocated for translation)
-			if (inodes[handle].indirect_block == 0) {return 0;}
-			//Read the inderect block from disk into a dfs block to make a table of indirect addresses to check for translation
-			bzero(new_block.data, sb.dfs_blocksize);
-			if (DfsReadBlock(inodes[handle].indirect_block, &new_block) == DFS_FAIL) {
-				printf("DfsInodeTranslateVirtualToFilesys: Error could not read inderct block into dfs block for translation\n");
-				return DFS_FAIL;
-			}
-			bcopy (new_block.data, (char *)indirect_table, sb.dfs_blocksize);
-			//Go through indirect table, check if virt_blocknum matches and return the translation
-			virtual_blocknum -= 10;
-			if (virtual_blocknum >= (sb.dfs_blocksize/4)) {
-				printf("DfsInodeTranslateVirtualToFilesys: Error virt blocknum is out of index of indirect addressing\n");
-				return DFS_FAIL;
-			}
-			return indirect_table[virtual_blocknum];
+
+	//Walk the inode's own extents first
+	for (i = 0; (i < DFS_INODE_EXTENTS) && (inodes[handle].extents[i].length != 0); i++) {
+		if (vb < inodes[handle].extents[i].length) {
+			blocknum = inodes[handle].extents[i].start;
+			return (blocknum == 0) ? 0 : blocknum + vb;
+		}
+		vb -= inodes[handle].extents[i].length;
+	}
+	if ((i < DFS_INODE_EXTENTS) || (inodes[handle].extent_block == 0)) {
+		return 0;
+	}
+	if (DfsExtentMapTranslate(handle, virtual_blocknum, &blocknum) != DFS_FAIL) {
+		return blocknum;
+	}
+	//Not mapped: decoding the extent block maps it for next time
+	if ((n = DfsExtentsLoad(handle, ext)) == DFS_FAIL) {
+		printf("DfsInodeTranslateVirtualToFilesys: Error could not read extent block for translation\n");
+		return DFS_FAIL;
 	}
+	vb = virtual_blocknum;
+	for (i = 0; i < n; i++) {
+		if (vb < ext[i].length) {
+			return (ext[i].start == 0) ? 0 : ext[i].start + vb;
+		}
+		vb -= ext[i].length;
+	}
+	return 0;
+}
+
+uint32 DfsInodeTranslateVirtualToFilesys(uint32 handle, uint32 virtual_blocknum) {
+	uint32 blocknum;
+
+	DfsInodeLock(handle);
+	blocknum = DfsInodeLookupBlock(handle, virtual_blocknum);
+	DfsInodeUnlock(handle);
+	return blocknum;
+}
 
 
-	printf("DfsInodeTranslateVirtualToFilesys: Wierd Error");
-	return DFS_FAIL;
+// Whether blocknum is one of the n extents' blocks or handle's extent block
+static int DfsExtentsHold(uint32 handle, dfs_extent *ext, int n, uint32 blocknum) {
+	int i;
 
+	if ((inodes[handle].extent_block != 0) && (blocknum == inodes[handle].extent_block)) {
+		return 1;
+	}
+	for (i = 0; i < n; i++) {
+		if ((ext[i].start != 0) && (blocknum >= ext[i].start) && (blocknum < ext[i].start + ext[i].length)) {
+			return 1;
+		}
+	}
+	return 0;
 }
 
+
+//-----------------------------------------------------------------
+// DfsInodeSync writes inode handle's dirty buffers to the disk, in
+// block number order, and then its inode block if that's dirty, so
+// one file can be made durable without writing back every other
+// file's buffers.  With datasync set the inode block is only written
+// if this file's size or blocks changed since it last was, since
+// that's all reading the data back needs.  If the fbv is dirty too,
+// blocks may have gone from one file to another since the last
+// flush, so then all the dirty metadata goes together to keep the
+// inodes and fbv on the disk agreeing.  Returns DFS_SUCCESS or
+// DFS_FAIL.
+//-----------------------------------------------------------------
+
+int DfsInodeSync(uint32 handle, int datasync) {
+	dfs_extent ext[DFS_MAX_EXTENTS];
+	dfs_buffer *dirty[DFS_CACHE_MAX_BUFFERS];
+	dfs_buffer *buf;
+	int inode_blocks = sb.dfs_start_block_fbv - sb.dfs_start_block_inodes;
+	int block = (handle * sizeof(dfs_inode)) / sb.dfs_blocksize;
+	int only = block;
+	int n, ndirty = 0, i, j;
+	int result = DFS_SUCCESS;
+
+	if (!sb.valid) {
+		printf("DfsInodeSync: Error cannot sync if file system is invalid.\n");
+		return DFS_FAIL;
+	}
+	if ((handle >= sb.num_inodes) || !inodes[handle].inuse) {
+		printf("DfsInodeSync: Error inode %d is not in use.\n", handle);
+		return DFS_FAIL;
+	}
+
+	DfsInodeLock(handle);
+	if ((n = DfsExtentsLoad(handle, ext)) == DFS_FAIL) {
+		DfsInodeUnlock(handle);
+		return DFS_FAIL;
+	}
+	if (cache_buffers > 0) {
+		if (LockHandleAcquire(cache_lock) != SYNC_SUCCESS) {
+			DfsInodeUnlock(handle);
+			printf("DfsInodeSync bad lock acquire!\n");
+			return DFS_FAIL;
+		}
+		//Pick out the file's dirty buffers, kept sorted as they're found
+		for (i = 0; i < cache_buffers; i++) {
+			buf = &cache[i];
+			if (!buf->valid || !buf->dirty || !DfsExtentsHold(handle, ext, n, buf->blocknum)) {
+				continue;
+			}
+			for (j = ndirty; (j > 0) && (dirty[j-1]->blocknum > buf->blocknum); j--) {
+				dirty[j] = dirty[j-1];
+			}
+			dirty[j] = buf;
+			ndirty++;
+		}
+		for (i = 0; i < ndirty; i++) {
+			if (DfsCacheWriteBack(dirty[i]) == DFS_FAIL) {
+				result = DFS_FAIL;
+			}
+		}
+		LockHandleRelease(cache_lock);
+	}
+
+	//Then the metadata pointing at that data
+	if ((result == DFS_SUCCESS) && (datasync ? inode_changed[handle] : meta_dirty[block])) {
+		for (i = inode_blocks; i < meta_blocks; i++) {
+			if (meta_dirty[i]) {
+				only = -1;
+			}
+		}
+		if (LockHandleAcquire(journal_lock) != SYNC_SUCCESS) {
+			DfsInodeUnlock(handle);
+			printf("DfsInodeSync bad lock acquire!\n");
+			return DFS_FAIL;
+		}
+		result = DfsMetadataFlush(only);
+		LockHandleRelease(journal_lock);
+	}
+	DfsInodeUnlock(handle);
+	dbprintf('Q', "DfsInodeSync: inode %d, %d buffers written.\n", handle, ndirty);
+	return result;
+}
@@ -3,6 +3,7 @@
 #include "traps.h"
 #include "disk.h"
 #include "filesys.h"
+#include "synch.h"
 
 //----------------------------------------------------------------------------
 // DiskBytesPerBlock returns the number of bytes in each physical block
@@ -18,140 +19,617 @@ int DiskBytesPerBlock() {
 //----------------------------------------------------------------------------
 
 int DiskSize() {
-  return DISK_BLOCKSIZE * DISK_NUMBLOCKS;
+  return DISK_BLOCKSIZE * diskNumBlocks;
 }
 
 //----------------------------------------------------------------------------
-// DiskCreate opens the filesystem for writing, which will erase whatever
-// was there before.  You need to call this only when formattig the
-// disk to make sure that the file actually exists.
+// The request queue.  Every transfer is described by a disk_request
+// and queued on disk_pending, which is kept sorted by block number.
+// One transfer is on the device at a time (disk_active); when it
+// finishes, the disk interrupt wakes its waiters and starts the next
+// one.  The next one is picked C-LOOK style: the first pending request
+// at or past the block the last transfer ended on, or the lowest one
+// once nothing is left ahead of the head.  Whole requests that follow
+// it on the disk, in the same direction, are merged into the same
+// transfer through disk_merge_buf as long as they fit in one request.
+//
+// Before DiskStartQueue and after DiskStopQueue there's no process to
+// put to sleep, so the caller polls the device for its own request.
+// Nobody waits for a request started by DiskStartRead; its callback
+// is called when it's done and its slot goes straight back.
 //----------------------------------------------------------------------------
 
-int DiskCreate() {
-  char *filename = NULL;
-  int fsfd = -1;
-  disk_block b;
+typedef struct disk_request {
+  int req;                      // DLX_DMADISK_READ or DLX_DMADISK_WRITE
+  uint32 blocknum;              // Next block to move
+  int count;                    // Blocks still to move
+  char *buf;                    // Where the next block goes (or comes from)
+  int status;                   // DISK_PENDING until it's done
+  Sem done;                     // Signalled by the interrupt when it's done
+  void (*callback)(void *arg, int ok);  // Instead, for DiskStartRead
+  void *arg;
+  struct disk_request *next;    // In disk_pending, disk_active or the free list
+} disk_request;
+
+static disk_request disk_requests[DISK_MAX_REQUESTS];
+static disk_request *disk_free = NULL;
+static disk_request *disk_pending = NULL;
+static disk_request *disk_active = NULL;  // On the device, merged ones after it
+static Sem disk_slots;                    // Counts the free list
+static int disk_active_blocks = 0;        // Blocks in the transfer on the device
+static int disk_merged = 0;               // It went through disk_merge_buf
+static uint32 disk_head = 0;              // Block the last transfer ended on
+static int disk_polling = 1;              // Nobody can sleep on the disk yet
+static uint32 disk_done_status = DLX_DMADISK_IDLE;  // Acknowledged, not finished yet
+static disk_block disk_merge_buf[DISK_MAX_REQUEST_BLOCKS];
+
+static int disk_ready = 0;
+static int disk_interrupts = 0;
+static DiskStats disk_stats;
+
+int diskLatencyModel = 0;
+char *diskFilename = DISK_FILENAME;
+uint32 diskNumBlocks = DISK_NUMBLOCKS;
+
+//----------------------------------------------------------------------------
+// DiskModuleInit points the simulator's DMA disk at the file named by
+// diskFilename, turns on its completion interrupt and sets up the
+// request queue.  It must be called before any other disk function.
+//----------------------------------------------------------------------------
+
+void DiskModuleInit() {
+  char *filename = diskFilename;
   int i;
 
   // Check that you remembered to rename the filename for your group
-  filename = DISK_FILENAME;
   if (filename[11] == 'X') {
-    printf("DiskCreate: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
+    printf("DiskModuleInit: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
     GracefulExit();
   }
-  // Open the hard disk file
-  //dbprintf('Q', "DiskCreate, opening hard disk file...\n");
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_WRITE)) < 0) {
-    printf ("DiskCreate: File system %s cannot be opened!\n", DISK_FILENAME);
-    return DISK_FAIL;
+  *((uint32 *)DLX_DMADISK_STATUS) = 0;
+  *((uint32 *)DLX_DMADISK_NAME) = (uint32)filename;
+  if (*((uint32 *)DLX_DMADISK_STATUS) == DLX_DMADISK_ERROR) {
+    printf("DiskModuleInit: File system %s cannot be opened!\n", filename);
+    GracefulExit();
+  }
+  for (i = 0; i < DISK_MAX_REQUESTS; i++) {
+    disk_requests[i].next = disk_free;
+    disk_free = &disk_requests[i];
   }
+  if (SemInit(&disk_slots, DISK_MAX_REQUESTS) != SYNC_SUCCESS) {
+    printf("FATAL ERROR: could not initialize disk request semaphore in DiskModuleInit!\n");
+    GracefulExit();
+  }
+  *((uint32 *)DLX_DMADISK_INTR) = 1;
+  disk_ready = 1;
+}
+
+//----------------------------------------------------------------------------
+// DiskStartQueue lets callers sleep until their request is done; main
+// calls it just before the first process runs.  DiskStopQueue waits
+// for whatever is queued and goes back to polling, so the file system
+// can still be written out as the OS exits.
+//----------------------------------------------------------------------------
 
-  // Write all zeros to the hard disk file to make sure it is the right size.
-  // You need to do this because the writeblock/readblock operations are allowed in
-  // random order.
-  bzero(b.data, DISK_BLOCKSIZE);
-  for(i=0; i<DISK_NUMBLOCKS; i++) {
-    FsWrite(fsfd, b.data, DISK_BLOCKSIZE);
+void DiskStartQueue() {
+  disk_polling = 0;
+}
+
+void DiskStopQueue() {
+  uint32 intrvals = DisableIntrs();
+
+  disk_polling = 1;
+  while (DiskPoll()) {
   }
-  
-  // Close the hard disk file
-  if (FsClose(fsfd) < 0) {
-    printf("DiskCreate: unable to close open file!\n");
-    return DISK_FAIL;
+  dbprintf('d', "DiskStopQueue: %d requests in %d transfers, %d interrupts\n",
+           disk_stats.reads + disk_stats.writes, disk_stats.transfers,
+           disk_interrupts);
+  RestoreIntrs(intrvals);
+}
+
+//----------------------------------------------------------------------------
+// DiskQueueInsert adds r to disk_pending in block order, after any
+// request that starts on the same block.  Interrupts must be disabled.
+//----------------------------------------------------------------------------
+
+static void DiskComplete(uint32 status);
+
+static void DiskQueueInsert(disk_request *r) {
+  disk_request **pp = &disk_pending;
+
+  while ((*pp != NULL) && ((*pp)->blocknum <= r->blocknum)) {
+    pp = &((*pp)->next);
   }
-  return DISK_SUCCESS;
+  r->next = *pp;
+  *pp = r;
 }
 
 //----------------------------------------------------------------------------
-// DiskWriteBlock writes one block to the disk, using the bytes pointed to 
-// by memory.  The blocksize is specified by DISK_BLOCKSIZE.  Returns
-// the number of bytes written on success, or DISK_FAIL on failure.
+// DiskCountTransfer records a transfer of n blocks at blocknum in the
+// statistics and, with -L, tells the device how long to take over it.
+// Interrupts must be disabled.
 //----------------------------------------------------------------------------
 
-int DiskWriteBlock (uint32 blocknum, disk_block *b) {
-  int fsfd = -1;
-  uint32 intrvals = 0;
-  char *filename = NULL;
+static void DiskCountTransfer(uint32 blocknum, int n) {
+  int distance = (blocknum > disk_head) ? blocknum - disk_head : disk_head - blocknum;
+  int latency = 0;
 
-  if (blocknum >= DISK_NUMBLOCKS) {
-    printf("DiskWriteBlock: cannot write to block larger than filesystem size\n");
-    return DISK_FAIL;
+  disk_stats.transfers++;
+  if (distance == 0) {
+    disk_stats.sequential++;
+  } else {
+    disk_stats.random++;
+    disk_stats.seekBlocks += distance;
+    latency = DISK_SEEK_SETTLE_US + distance * DISK_SEEK_US_PER_KBLOCK / 1024 +
+              DISK_ROTATION_US / 2;
   }
+  disk_stats.heat[blocknum / ((diskNumBlocks + DISK_HEAT_REGIONS - 1) / DISK_HEAT_REGIONS)] += n;
+  if (diskLatencyModel) {
+    disk_stats.serviceUs += latency + n * DISK_TRANSFER_US_PER_BLOCK;
+    *((uint32 *)DLX_DMADISK_LATENCY) = latency;
+    *((uint32 *)DLX_DMADISK_BLOCKLAT) = DISK_TRANSFER_US_PER_BLOCK;
+  }
+}
 
-  // Check that you remembered to rename the filename for your group
-  filename = DISK_FILENAME;
-  if (filename[11] == 'X') {
-    printf("DiskWriteBlock: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
-    GracefulExit();
+//----------------------------------------------------------------------------
+// DiskDispatch starts the next transfer if the device is idle.  The
+// first request moves at most DISK_MAX_REQUEST_BLOCKS of its blocks
+// straight to or from its buffer; if it fits whole, the requests right
+// behind it on the disk ride along in disk_merge_buf.  Interrupts must
+// be disabled.
+//----------------------------------------------------------------------------
+
+static void DiskDispatch() {
+  disk_request **pp = &disk_pending;
+  disk_request *r, *last;
+  char *addr;
+  int n;
+
+  if ((disk_active != NULL) || (disk_pending == NULL)) {
+    return;
+  }
+  while ((*pp != NULL) && ((*pp)->blocknum < disk_head)) {
+    pp = &((*pp)->next);
+  }
+  if (*pp == NULL) {
+    pp = &disk_pending;
+  }
+  r = *pp;
+  *pp = r->next;
+  r->next = NULL;
+  disk_active = last = r;
+  n = r->count;
+  if (n > DISK_MAX_REQUEST_BLOCKS) {
+    n = DISK_MAX_REQUEST_BLOCKS;
+  }
+  // pp now points at whatever followed r, the next block up
+  while ((n == r->count) && (*pp != NULL) && ((*pp)->req == r->req) &&
+         ((*pp)->blocknum == r->blocknum + n) &&
+         ((*pp)->count <= DISK_MAX_REQUEST_BLOCKS - n)) {
+    last->next = *pp;
+    last = *pp;
+    *pp = last->next;
+    last->next = NULL;
+    n += last->count;
+  }
+  disk_merged = (last != r);
+  addr = r->buf;
+  if (disk_merged) {
+    addr = (char *)disk_merge_buf;
+    if (r->req == DLX_DMADISK_WRITE) {
+      for (last = r; last != NULL; last = last->next) {
+        bcopy(last->buf, addr, last->count * DISK_BLOCKSIZE);
+        addr += last->count * DISK_BLOCKSIZE;
+      }
+      addr = (char *)disk_merge_buf;
+    }
   }
+  disk_active_blocks = n;
+  DiskCountTransfer(r->blocknum, n);
+  dbprintf('d', "DiskDispatch: %s blocks %d-%d%s\n",
+           (r->req == DLX_DMADISK_WRITE) ? "writing" : "reading", r->blocknum,
+           r->blocknum + n - 1, disk_merged ? " (merged)" : "");
+  *((uint32 *)DLX_DMADISK_BLOCK) = r->blocknum;
+  *((uint32 *)DLX_DMADISK_ADDR) = (uint32)addr;
+  *((uint32 *)DLX_DMADISK_COUNT) = n;
+  *((uint32 *)DLX_DMADISK_REQUEST) = r->req;
+  if (*((uint32 *)DLX_DMADISK_STATUS) == DLX_DMADISK_ERROR) {
+    // Refused outright: there won't be an interrupt for it
+    DiskComplete(DLX_DMADISK_ERROR);
+  }
+}
 
-  intrvals = DisableIntrs();
+//----------------------------------------------------------------------------
+// DiskComplete finishes the transfer on the device, which ended with
+// status, and starts the next one.  A request with blocks left goes
+// back in the queue; the rest are done and their waiters woken.
+// Interrupts must be disabled.
+//----------------------------------------------------------------------------
 
-  // Open the hard disk file
-  //dbprintf('Q', "DiskWriteBlock, opening hard disk file...\n");
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_RW)) < 0) {
-    printf ("DiskWriteBlock: File system %s cannot be opened!\n", DISK_FILENAME);
-    return DISK_FAIL;
+static void DiskComplete(uint32 status) {
+  disk_request *r = disk_active;
+  disk_request *next;
+  char *addr = (char *)disk_merge_buf;
+  int ok = (status == DLX_DMADISK_DONE);
+  int n;
+
+  *((uint32 *)DLX_DMADISK_STATUS) = 0;
+  disk_active = NULL;
+  if (r == NULL) {
+    return;
+  }
+  disk_head = r->blocknum + disk_active_blocks;
+  if (!ok) {
+    printf("DiskIo: transfer of blocks %d-%d failed!\n", r->blocknum,
+           disk_head - 1);
   }
+  for (; r != NULL; r = next) {
+    next = r->next;
+    n = (r->count < disk_active_blocks) ? r->count : disk_active_blocks;
+    if (ok && disk_merged && (r->req == DLX_DMADISK_READ)) {
+      bcopy(addr, r->buf, n * DISK_BLOCKSIZE);
+    }
+    addr += n * DISK_BLOCKSIZE;
+    r->blocknum += n;
+    r->count -= n;
+    r->buf += n * DISK_BLOCKSIZE;
+    if (ok && (r->count > 0)) {
+      DiskQueueInsert(r);
+    } else {
+      r->status = ok ? DISK_SUCCESS : DISK_FAIL;
+      if (r->callback != NULL) {
+        r->callback(r->arg, ok);
+        r->next = disk_free;
+        disk_free = r;
+        SemSignal(&disk_slots);
+      } else {
+        SemSignal(&(r->done));
+      }
+    }
+  }
+  DiskDispatch();
+}
 
-  // Write data to virtual disk
-  FsSeek(fsfd, blocknum * DISK_BLOCKSIZE, FS_SEEK_SET);
-  if (FsWrite(fsfd, b->data, DISK_BLOCKSIZE) != DISK_BLOCKSIZE) {
-    printf ("DiskWriteBlock: Block %d could not be written!\n", blocknum);
-    FsClose (fsfd);
-    return DISK_FAIL;
+//----------------------------------------------------------------------------
+// DiskInterrupt handles TRAP_DISK: the transfer on the device is over.
+// It only takes the status and acknowledges the device; waking the
+// waiters, the callbacks and starting the next transfer are left to
+// DiskFinish, which runs once the interrupt has been dealt with.
+//----------------------------------------------------------------------------
+
+static void DiskFinish(void *arg) {
+  int intrs = DisableIntrs();
+
+  DiskPoll();
+  RestoreIntrs(intrs);
+}
+
+void DiskInterrupt() {
+  uint32 status = *((uint32 *)DLX_DMADISK_STATUS);
+
+  disk_interrupts++;
+  dbprintf('d', "DiskInterrupt: status=%d (%d interrupts)\n", status,
+           disk_interrupts);
+  // IDLE means DiskPoll got to it first
+  if ((status == DLX_DMADISK_DONE) || (status == DLX_DMADISK_ERROR)) {
+    disk_done_status = status;
+    *((uint32 *)DLX_DMADISK_STATUS) = 0;
+    TrapDefer(DiskFinish, NULL);
   }
+}
 
-  // Close the hard disk file
-  FsClose (fsfd);
+//----------------------------------------------------------------------------
+// DiskPoll finishes the transfer on the device if it's over without
+// waiting for its interrupt, or if the interrupt has come but its
+// DiskFinish hasn't run yet.  Returns 1 if requests are still queued
+// or on the device, 0 once the queue is empty.  Interrupts must be
+// disabled.
+//----------------------------------------------------------------------------
 
-  RestoreIntrs(intrvals);
-  return DISK_BLOCKSIZE;
+int DiskPoll() {
+  uint32 status;
+
+  if (disk_active != NULL) {
+    status = disk_done_status;
+    if (status == DLX_DMADISK_IDLE) {
+      status = *((uint32 *)DLX_DMADISK_STATUS);
+    }
+    if ((status == DLX_DMADISK_DONE) || (status == DLX_DMADISK_ERROR)) {
+      disk_done_status = DLX_DMADISK_IDLE;
+      DiskComplete(status);
+    }
+  }
+  return ((disk_active != NULL) || (disk_pending != NULL));
 }
 
 //----------------------------------------------------------------------------
-// DiskReadBlock reads one block from the disk, putting the bytes into the
-// memory pointed to by memory.  The blocksize is specified by DISK_BLOCKSIZE.
-// Returns the number of bytes read on success, or DISK_FAIL on failure.
+// DiskQueueIo queues a request to move count blocks starting at
+// blocknum between the disk and buf and waits for it.  Returns
+// DISK_SUCCESS or DISK_FAIL.
 //----------------------------------------------------------------------------
 
-int DiskReadBlock (uint32 blocknum, disk_block *b) {
-  int fsfd = -1;
+static int DiskQueueIo (int req, uint32 blocknum, int count, char *buf) {
   uint32 intrvals = 0;
-  char *filename = NULL;
+  disk_request *r;
+  int status;
+
+  // While polling there's never more than one request, so this never sleeps
+  SemWait(&disk_slots);
+  intrvals = DisableIntrs();
+  r = disk_free;
+  disk_free = r->next;
+  r->req = req;
+  r->blocknum = blocknum;
+  r->count = count;
+  r->buf = buf;
+  r->status = DISK_PENDING;
+  r->callback = NULL;
+  SemInit(&(r->done), 0);
+  DiskQueueInsert(r);
+  DiskDispatch();
+  if (disk_polling) {
+    while (r->status == DISK_PENDING) {
+      DiskPoll();
+    }
+  } else {
+    SemWait(&(r->done));
+  }
+  status = r->status;
+  r->next = disk_free;
+  disk_free = r;
+  RestoreIntrs(intrvals);
+  SemSignal(&disk_slots);
+  return status;
+}
+
+//----------------------------------------------------------------------------
+// DiskStartRead queues a read of count blocks starting at blocknum into
+// buf and returns without waiting; callback(arg, ok) is called from the
+// disk interrupt once they're in.  It's meant for reading ahead, so it
+// never waits for a slot: it fails while polling, or when fewer than
+// half the slots are free, to leave them for requests someone waits
+// on.  Returns DISK_SUCCESS or DISK_FAIL.
+//----------------------------------------------------------------------------
+
+int DiskStartRead (uint32 blocknum, int count, void *buf,
+                   void (*callback)(void *arg, int ok), void *arg) {
+  uint32 intrvals;
+  disk_request *r;
 
-  if (blocknum >= DISK_NUMBLOCKS) {
-    printf("DiskReadBlock: cannot read from block larger than filesystem size\n");
+  if (!disk_ready || (count <= 0) || (blocknum >= diskNumBlocks) ||
+      (count > diskNumBlocks - blocknum)) {
     return DISK_FAIL;
   }
+  intrvals = DisableIntrs();
+  if (disk_polling || (disk_slots.count <= DISK_MAX_REQUESTS / 2)) {
+    RestoreIntrs(intrvals);
+    return DISK_FAIL;
+  }
+  disk_slots.count--;
+  r = disk_free;
+  disk_free = r->next;
+  r->req = DLX_DMADISK_READ;
+  r->blocknum = blocknum;
+  r->count = count;
+  r->buf = (char *)buf;
+  r->status = DISK_PENDING;
+  r->callback = callback;
+  r->arg = arg;
+  disk_stats.reads++;
+  disk_stats.blocksRead += count;
+  DiskQueueInsert(r);
+  DiskDispatch();
+  RestoreIntrs(intrvals);
+  return DISK_SUCCESS;
+}
 
-  if (filename[11] == 'X') {
-    printf("DiskReadBlock: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
-    GracefulExit();
+//----------------------------------------------------------------------------
+// The track buffer.  A read of fewer than diskTrackBlocks blocks that
+// misses it fetches diskTrackBlocks blocks from the same place in one
+// transfer, so the reads that follow in a sequential scan are copied
+// out of memory.  One fill runs at a time; readers that come along
+// meanwhile go to the disk.  Writes drop the buffer if they overlap
+// it, and a write during a fill bumps track_gen so the fill isn't kept.
+//----------------------------------------------------------------------------
+
+static disk_block track_buf[DISK_TRACK_MAX_BLOCKS];
+static uint32 track_start = 0;
+static int track_count = 0;             // Valid blocks in track_buf
+static int track_filling = 0;
+static int track_gen = 0;
+
+int diskTrackBlocks = DISK_TRACK_BLOCKS;
+
+//----------------------------------------------------------------------------
+// DiskTrackRead serves a read from the track buffer, filling it first
+// on a miss.  Returns 1 if buf now holds the blocks, 0 if the caller
+// has to read them itself.
+//----------------------------------------------------------------------------
+
+static int DiskTrackRead (uint32 blocknum, int count, char *buf) {
+  uint32 intrvals = DisableIntrs();
+  int gen;
+  int n;
+
+  if ((track_count > 0) && (blocknum >= track_start) &&
+      (blocknum + count <= track_start + track_count)) {
+    bcopy((char *)track_buf + (blocknum - track_start) * DISK_BLOCKSIZE, buf,
+          count * DISK_BLOCKSIZE);
+    disk_stats.trackHits++;
+    RestoreIntrs(intrvals);
+    return 1;
   }
+  if ((count >= diskTrackBlocks) || track_filling) {
+    RestoreIntrs(intrvals);
+    return 0;
+  }
+  n = diskTrackBlocks;
+  if (n > diskNumBlocks - blocknum) {
+    n = diskNumBlocks - blocknum;
+  }
+  track_filling = 1;
+  track_count = 0;
+  gen = track_gen;
+  disk_stats.trackFills++;
+  RestoreIntrs(intrvals);
+
+  n = (DiskQueueIo(DLX_DMADISK_READ, blocknum, n, (char *)track_buf) == DISK_SUCCESS) ? n : 0;
 
   intrvals = DisableIntrs();
+  track_filling = 0;
+  if ((n == 0) || (gen != track_gen)) {
+    RestoreIntrs(intrvals);
+    return 0;
+  }
+  track_start = blocknum;
+  track_count = n;
+  bcopy((char *)track_buf, buf, count * DISK_BLOCKSIZE);
+  RestoreIntrs(intrvals);
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+// DiskTrackInvalidate forgets the track buffer before count blocks at
+// blocknum are written.
+//----------------------------------------------------------------------------
+
+static void DiskTrackInvalidate (uint32 blocknum, int count) {
+  uint32 intrvals = DisableIntrs();
+
+  if ((track_count > 0) && (blocknum < track_start + track_count) &&
+      (blocknum + count > track_start)) {
+    track_count = 0;
+  }
+  if (track_filling) {
+    track_gen++;
+  }
+  RestoreIntrs(intrvals);
+}
 
-  // Open the hard disk file
-  //dbprintf('Q', "DiskReadBlock, opening hard disk file...\n");
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_READ)) < 0) {
-    printf ("DiskReadBlock: File system %s cannot be opened!\n", DISK_FILENAME);
+//----------------------------------------------------------------------------
+// DiskIo moves count blocks starting at blocknum between the disk and
+// buf, through the track buffer for short reads.  Returns the number of
+// bytes moved, or DISK_FAIL.
+//----------------------------------------------------------------------------
+
+static int DiskIo (int req, uint32 blocknum, int count, void *buf) {
+  uint32 intrvals;
+
+  if (!disk_ready) {
+    printf("DiskIo: disk used before DiskModuleInit\n");
+    return DISK_FAIL;
+  }
+  if ((count <= 0) || (blocknum >= diskNumBlocks) ||
+      (count > diskNumBlocks - blocknum)) {
+    printf("DiskIo: blocks %d-%d are outside the filesystem\n", blocknum,
+           blocknum + count - 1);
     return DISK_FAIL;
   }
 
-  // Read data from virtual disk
-  FsSeek(fsfd, blocknum * DISK_BLOCKSIZE, FS_SEEK_SET);
-  if (FsRead(fsfd, b->data, DISK_BLOCKSIZE) != DISK_BLOCKSIZE) {
-    printf ("DiskReadBlock: Block %d could not be read!\n", blocknum);
-    FsClose (fsfd);
+  intrvals = DisableIntrs();
+  if (req == DLX_DMADISK_WRITE) {
+    disk_stats.writes++;
+    disk_stats.blocksWritten += count;
+  } else {
+    disk_stats.reads++;
+    disk_stats.blocksRead += count;
+  }
+  RestoreIntrs(intrvals);
+  if (req == DLX_DMADISK_WRITE) {
+    DiskTrackInvalidate(blocknum, count);
+  } else if (DiskTrackRead(blocknum, count, (char *)buf)) {
+    return count * DISK_BLOCKSIZE;
+  }
+  if (DiskQueueIo(req, blocknum, count, (char *)buf) != DISK_SUCCESS) {
     return DISK_FAIL;
   }
+  return count * DISK_BLOCKSIZE;
+}
 
-  // Close the hard disk file
-  FsClose (fsfd);
+//----------------------------------------------------------------------------
+// DiskGetStats copies out the disk statistics, and DiskPrintStats
+// prints them; DfsCloseFileSystem does that as the OS exits.
+//----------------------------------------------------------------------------
+
+void DiskGetStats(DiskStats *stats) {
+  uint32 intrvals = DisableIntrs();
 
+  bcopy((char *)&disk_stats, (char *)stats, sizeof(disk_stats));
   RestoreIntrs(intrvals);
-  return DISK_BLOCKSIZE;
 }
 
+void DiskPrintStats() {
+  DiskStats st;
+  int i;
+
+  DiskGetStats(&st);
+  printf("Disk: %d reads (%d bytes), %d writes (%d bytes)\n", st.reads,
+         st.blocksRead * DISK_BLOCKSIZE, st.writes,
+         st.blocksWritten * DISK_BLOCKSIZE);
+  printf("Disk: %d track buffer hits, %d fills\n", st.trackHits, st.trackFills);
+  printf("Disk: %d transfers, %d sequential, %d random (%d blocks of seeks)",
+         st.transfers, st.sequential, st.random, st.seekBlocks);
+  if (diskLatencyModel) {
+    printf(", %d us modelled", st.serviceUs);
+  }
+  printf("\nDisk: blocks moved per 1/%d of the disk:", DISK_HEAT_REGIONS);
+  for (i = 0; i < DISK_HEAT_REGIONS; i++) {
+    printf(" %d", st.heat[i]);
+  }
+  printf("\n");
+}
+
+//----------------------------------------------------------------------------
+// DiskCreate makes sure the image covers the whole disk by writing its
+// last block.  The host fills the rest in as a hole, so a big disk costs
+// neither host space nor time to format.  A reused image keeps its old
+// contents; fdisk rewrites all of the DFS metadata, and the DFS never
+// reads a data block before writing it (see DfsInodeWriteBytes).  You
+// need to call this only when formatting the disk.
+//----------------------------------------------------------------------------
+
+int DiskCreate() {
+  static disk_block zero_block;
+
+  bzero(zero_block.data, DISK_BLOCKSIZE);
+  if (DiskIo(DLX_DMADISK_WRITE, diskNumBlocks - 1, 1, zero_block.data) == DISK_FAIL) {
+    printf("DiskCreate: unable to size the disk!\n");
+    return DISK_FAIL;
+  }
+  return DISK_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// DiskWriteBlocks writes count consecutive blocks starting at blocknum
+// from buf, and DiskReadBlocks reads them into buf.  buf must hold
+// count * DISK_BLOCKSIZE bytes.  Both return the number of bytes moved
+// on success, or DISK_FAIL on failure.
+//----------------------------------------------------------------------------
 
+int DiskWriteBlocks (uint32 blocknum, int count, void *buf) {
+  return DiskIo(DLX_DMADISK_WRITE, blocknum, count, buf);
+}
+
+int DiskReadBlocks (uint32 blocknum, int count, void *buf) {
+  return DiskIo(DLX_DMADISK_READ, blocknum, count, buf);
+}
+
+//----------------------------------------------------------------------------
+// DiskWriteBlock writes one block to the disk, using the bytes pointed to 
+// by memory.  The blocksize is specified by DISK_BLOCKSIZE.  Returns
+// the number of bytes written on success, or DISK_FAIL on failure.
+//----------------------------------------------------------------------------
+
+int DiskWriteBlock (uint32 blocknum, disk_block *b) {
+  return DiskWriteBlocks(blocknum, 1, b->data);
+}
+
+//----------------------------------------------------------------------------
+// DiskReadBlock reads one block from the disk, putting the bytes into the
+// memory pointed to by memory.  The blocksize is specified by DISK_BLOCKSIZE.
+// Returns the number of bytes read on success, or DISK_FAIL on failure.
+//----------------------------------------------------------------------------
+
+int DiskReadBlock (uint32 blocknum, disk_block *b) {
+  return DiskReadBlocks(blocknum, 1, b->data);
+}
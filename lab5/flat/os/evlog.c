@@ -0,0 +1,135 @@
+//
+//	evlog.c
+//
+//	Kernel event log (see evlog.h).  Records go in evlog_ring at
+//	evlog_next, which only ever grows, so the ring holds records
+//	evlog_next - EVLOG_ENTRIES up to evlog_next once it has wrapped.
+//
+
+#include "ostraps.h"
+#include "dlxos.h"
+#include "process.h"
+#include "clock.h"
+#include "evlog.h"
+
+int evlog_on = 0;
+static evlog_record evlog_ring[EVLOG_ENTRIES];
+static int evlog_next = 0;
+
+// Name and argument format of each event, by number
+static struct {
+  char	*name;
+  char	*format;
+} evlog_events[EVLOG_EVENTS] = {
+  {"?",			"%d %d %d %d"},
+  {"page_alloc",	"page %d, %d free"},
+  {"page_free",		"page %d, %d free"},
+  {"kmem_alloc",	"object 0x%x, %d bytes"},
+  {"kmem_free",		"object 0x%x, %d bytes"},
+  {"kmem_slab_new",	"page %d, %d-byte objects"},
+  {"kmem_slab_free",	"page %d, %d-byte objects"},
+  {"file_read",		"handle %d, position %d, %d bytes"},
+  {"file_write",	"handle %d, position %d, %d bytes"},
+  {"dfs_write_blocks",	"inode %d, block %d, %d blocks"},
+  {"dfs_write_part",	"inode %d, block %d, offset %d, %d bytes"},
+  {"boot_phase",	"%-16s %10u instructions, at %10u, %u us"},
+};
+
+// Boot phases so far, kept here because the log may not be on yet
+// when they end.  Instruction counts and times are the simulator's,
+// which run from when it started, so the first phase is loading the
+// OS up to main.
+static struct {
+  char		*name;
+  uint32	instrs;			// At the end of the phase
+  uint32	usec;
+} evlog_boot[EVLOG_BOOT_PHASES];
+static int evlog_boot_phases = 0;
+static int evlog_boot_done = 0;
+
+//----------------------------------------------------------------------
+//
+//	EvlogRecord
+//
+//	Add a record to the ring, over the oldest one if it's full.
+//	Called through EVLOG, so only when the log is on.
+//
+//----------------------------------------------------------------------
+void EvlogRecord(int event, uint32 a0, uint32 a1, uint32 a2, uint32 a3) {
+  int intrs = DisableIntrs();
+  evlog_record *r = &evlog_ring[evlog_next++ & (EVLOG_ENTRIES - 1)];
+
+  r->jiffies = ClkGetCurJiffies();
+  r->event = event;
+  r->pid = GetCurrentPid();
+  r->args[0] = a0;
+  r->args[1] = a1;
+  r->args[2] = a2;
+  r->args[3] = a3;
+  RestoreIntrs(intrs);
+}
+
+//----------------------------------------------------------------------
+//
+//	EvlogDump
+//
+//	Print the records in the ring, oldest first, and empty it.
+//
+//----------------------------------------------------------------------
+void EvlogDump() {
+  int i, first;
+  int event;
+  evlog_record *r;
+
+  first = (evlog_next > EVLOG_ENTRIES) ? evlog_next - EVLOG_ENTRIES : 0;
+  printf("Event log: %d events, last %d kept\n", evlog_next, evlog_next - first);
+  for (i = first; i < evlog_next; i++) {
+    r = &evlog_ring[i & (EVLOG_ENTRIES - 1)];
+    event = ((r->event > 0) && (r->event < EVLOG_EVENTS)) ? r->event : 0;
+    printf("%8d pid %2d %-16s ", r->jiffies, r->pid, evlog_events[event].name);
+    printf(evlog_events[event].format, r->args[0], r->args[1], r->args[2], r->args[3]);
+    printf("\n");
+  }
+  evlog_next = 0;
+}
+
+//----------------------------------------------------------------------
+//
+//	EvlogBootPhase
+//
+//	Mark the end of boot phase name, which began where the last one
+//	ended.  Does nothing once EvlogBootDone has been called, so code
+//	that also runs later (mounting the file system again, say) can
+//	mark its phases unconditionally.
+//
+//----------------------------------------------------------------------
+void EvlogBootPhase(char *name) {
+  if (evlog_boot_done || (evlog_boot_phases >= EVLOG_BOOT_PHASES)) {
+    return;
+  }
+  evlog_boot[evlog_boot_phases].name = name;
+  evlog_boot[evlog_boot_phases].instrs = ClkGetCycles();
+  evlog_boot[evlog_boot_phases].usec = ClkGetUsec();
+  evlog_boot_phases++;
+}
+
+//----------------------------------------------------------------------
+//
+//	EvlogBootDone
+//
+//	Boot is over: put a boot_phase record for each phase in the log,
+//	if it's on, and stop timing phases.
+//
+//----------------------------------------------------------------------
+void EvlogBootDone() {
+  int i;
+  uint32 instrs = 0, usec = 0;
+
+  evlog_boot_done = 1;
+  for (i = 0; i < evlog_boot_phases; i++) {
+    EVLOG(EV_BOOT_PHASE, evlog_boot[i].name, evlog_boot[i].instrs - instrs,
+	  evlog_boot[i].instrs, evlog_boot[i].usec - usec);
+    instrs = evlog_boot[i].instrs;
+    usec = evlog_boot[i].usec;
+  }
+}
@@ -0,0 +1,262 @@
+//
+//	fileio.c
+//
+//	Buffered file I/O (see fileio.h).  A stream's buffer holds either
+//	data read ahead of the caller (buf[pos..len) not yet handed out)
+//	or data written behind it (buf[0..pos) not yet in the file), never
+//	both: switching from one to the other flushes the writes, or
+//	seeks the file back over what was read ahead.
+//
+//	This is part of the user library, not the operating system.
+//
+
+#include "usertraps.h"
+#include "fileio.h"
+
+#ifndef NULL
+#define NULL (void *)0x0
+#endif
+
+static void FioCopy(char *to, char *from, int n) {
+  while (n-- > 0) *to++ = *from++;
+}
+
+int fio_open(fio_t *f, char *filename, char *mode) {
+  int append = 0;
+
+  if ((mode[0] == 'r') && (mode[1] == '\0')) {
+    f->mode = FIO_READ;
+  } else if ((mode[0] == 'w') && (mode[1] == '\0')) {
+    f->mode = FIO_WRITE;
+  } else if ((mode[0] == 'r') && (mode[1] == 'w') && (mode[2] == '\0')) {
+    f->mode = FIO_READ | FIO_WRITE;
+  } else if ((mode[0] == 'a') && (mode[1] == '\0')) {
+    f->mode = FIO_WRITE;
+    mode = "w";
+    append = 1;
+  } else {
+    return FIO_FAIL;
+  }
+  if ((int)(f->handle = file_open(filename, mode)) == FIO_FAIL) {
+    return FIO_FAIL;
+  }
+  if (append && (file_seek(f->handle, 0, FIO_SEEK_END) == FIO_FAIL)) {
+    file_close(f->handle);
+    return FIO_FAIL;
+  }
+  f->pos = f->len = 0;
+  f->dirty = f->eof = 0;
+  return FIO_SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//	FioDrop
+//
+//	Give back what was read ahead, so the file position is where the
+//	caller thinks it is.  Then the buffer is empty.
+//----------------------------------------------------------------------
+static int FioDrop(fio_t *f) {
+  int ahead = f->len - f->pos;
+
+  f->pos = f->len = 0;
+  if (ahead > 0) {
+    f->eof = 0;
+    return file_seek(f->handle, -ahead, FIO_SEEK_CUR);
+  }
+  return FIO_SUCCESS;
+}
+
+int fio_flush(fio_t *f) {
+  int n = f->pos;
+
+  if (!f->dirty) {
+    return FioDrop(f);
+  }
+  f->pos = 0;
+  f->dirty = 0;
+  if (file_write(f->handle, f->buf, n) != n) {
+    return FIO_FAIL;
+  }
+  return FIO_SUCCESS;
+}
+
+int fio_close(fio_t *f) {
+  int ret = FIO_SUCCESS;
+
+  if (f->dirty) {
+    ret = fio_flush(f);
+  }
+  if (file_close(f->handle) == FIO_FAIL) {
+    ret = FIO_FAIL;
+  }
+  return ret;
+}
+
+//----------------------------------------------------------------------
+//	FioFill
+//
+//	Refill an empty read buffer (nothing may be waiting to be written).  Returns the number of bytes now in
+//	it, 0 at the end of the file.
+//----------------------------------------------------------------------
+static int FioFill(fio_t *f) {
+  int n;
+
+  f->pos = f->len = 0;
+  if (f->eof) {
+    return 0;
+  }
+  if ((n = file_read(f->handle, f->buf, FIO_BUFFER_SIZE)) <= 0) {
+    f->eof = 1;
+    return 0;
+  }
+  if (n < FIO_BUFFER_SIZE) {
+    // Don't ask again: another file_read would just fail
+    f->eof = 1;
+  }
+  f->len = n;
+  return n;
+}
+
+int fio_read(fio_t *f, void *mem, int n) {
+  char *to = (char *)mem;
+  int got = 0;
+  int k;
+
+  if (!(f->mode & FIO_READ) || (n <= 0)) {
+    return 0;
+  }
+  if (f->dirty && (fio_flush(f) == FIO_FAIL)) {
+    return 0;
+  }
+  while (got < n) {
+    if (f->pos == f->len) {
+      if ((n - got >= FIO_BUFFER_SIZE) && !f->eof) {
+        // Big reads go straight into the caller's memory
+        f->pos = f->len = 0;
+        k = file_read(f->handle, to + got, n - got);
+        if (k <= 0) {
+          f->eof = 1;
+          break;
+        }
+        if (k < n - got) {
+          f->eof = 1;
+        }
+        got += k;
+        continue;
+      }
+      if (FioFill(f) == 0) {
+        break;
+      }
+    }
+    k = f->len - f->pos;
+    if (k > n - got) {
+      k = n - got;
+    }
+    FioCopy(to + got, f->buf + f->pos, k);
+    f->pos += k;
+    got += k;
+  }
+  return got;
+}
+
+int fio_getc(fio_t *f) {
+  if (!(f->mode & FIO_READ)) {
+    return FIO_EOF;
+  }
+  if (f->dirty && (fio_flush(f) == FIO_FAIL)) {
+    return FIO_EOF;
+  }
+  if ((f->pos == f->len) && (FioFill(f) == 0)) {
+    return FIO_EOF;
+  }
+  return (unsigned char)f->buf[f->pos++];
+}
+
+char *fio_gets(fio_t *f, char *s, int n) {
+  int i = 0;
+  int c;
+
+  if (n <= 0) {
+    return NULL;
+  }
+  while (i < n - 1) {
+    if ((c = fio_getc(f)) == FIO_EOF) {
+      break;
+    }
+    s[i++] = c;
+    if (c == '\n') {
+      break;
+    }
+  }
+  s[i] = '\0';
+  return (i == 0) ? NULL : s;
+}
+
+int fio_write(fio_t *f, void *mem, int n) {
+  char *from = (char *)mem;
+  int put = 0;
+  int k;
+
+  if (!(f->mode & FIO_WRITE) || (n < 0)) {
+    return FIO_FAIL;
+  }
+  if (!f->dirty && (FioDrop(f) == FIO_FAIL)) {
+    return FIO_FAIL;
+  }
+  // Appending to the buffer is the common case
+  if (n <= FIO_BUFFER_SIZE - f->pos) {
+    FioCopy(f->buf + f->pos, from, n);
+    f->pos += n;
+    f->dirty = (f->pos > 0);
+    return n;
+  }
+  while (put < n) {
+    if ((f->pos == 0) && (n - put >= FIO_BUFFER_SIZE)) {
+      // Big writes go straight from the caller's memory
+      if ((k = file_write(f->handle, from + put, n - put)) <= 0) {
+        return (put > 0) ? put : FIO_FAIL;
+      }
+      put += k;
+      continue;
+    }
+    k = FIO_BUFFER_SIZE - f->pos;
+    if (k > n - put) {
+      k = n - put;
+    }
+    FioCopy(f->buf + f->pos, from + put, k);
+    f->pos += k;
+    f->dirty = 1;
+    put += k;
+    if ((f->pos == FIO_BUFFER_SIZE) && (fio_flush(f) == FIO_FAIL)) {
+      return FIO_FAIL;
+    }
+  }
+  return put;
+}
+
+int fio_putc(fio_t *f, int c) {
+  char ch = c;
+
+  return (fio_write(f, &ch, 1) == 1) ? (unsigned char)ch : FIO_EOF;
+}
+
+int fio_puts(fio_t *f, char *s) {
+  int n = 0;
+
+  while (s[n] != '\0') n++;
+  return fio_write(f, s, n);
+}
+
+int fio_seek(fio_t *f, int offset, int from_where) {
+  if (f->dirty) {
+    if (fio_flush(f) == FIO_FAIL) {
+      return FIO_FAIL;
+    }
+  } else if (from_where == FIO_SEEK_CUR) {
+    // Relative to where the caller is, not to what was read ahead
+    offset -= f->len - f->pos;
+  }
+  f->pos = f->len = 0;
+  f->eof = 0;
+  return file_seek(f->handle, offset, from_where);
+}
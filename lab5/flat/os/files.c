@@ -4,158 +4,279 @@
 #include "dfs.h"
 #include "files.h"
 #include "synch.h"
+#include "memory.h"
+#include "evlog.h"
 
 // You have already been told about the most likely places where you should use locks. You may use 
 // additional locks if it is really necessary.
 static file_descriptor fds[FILE_MAX_OPEN_FILES];
+static uint32 fds_free; //Bit i is set if fds[i] is free
 static lock_t fds_lock; 
 
+// Asynchronous requests are serviced in the order they're queued by a
+// system process, which is started when one is queued with nobody to
+// service it and exits once the queue is empty.  The queue and the
+// request slots are only touched with interrupts off.
+static file_async_request asyncs[FILE_MAX_ASYNC];
+static file_async_request *async_head = NULL;
+static file_async_request *async_tail = NULL;
+static int async_worker = 0;
+static int async_seq = 0;
+
+// File layer counters FileGetStats hands out along with the DFS ones
+static FileStats file_stats;
+
 // STUDENT: put your file-level functions here
 
 void FileModuleInit() {
 	int i;
 	for (i = 0; i < FILE_MAX_OPEN_FILES; i++) {
-		fds[0].inuse = 0;
+		fds[i].inuse = 0;
+	}
+	fds_free = (1 << FILE_MAX_OPEN_FILES) - 1;
+	for (i = 0; i < FILE_MAX_ASYNC; i++) {
+		asyncs[i].inuse = 0;
 	}
 	fds_lock = LockCreate();
 }
 
+//Return 1 if handle names an open file descriptor, 0 otherwise
+static int FileValid(int handle) {
+	return ((handle >= 0) && (handle < FILE_MAX_OPEN_FILES) && fds[handle].inuse);
+}
+
 //open the given filename with one of three possible modes: "r", "w", or "rw". Return FILE_FAIL on failure 
 //(e.g., when a process tries to open a file that is already open for another process),
 //and the handle of a file descriptor on success. Remember to use locks whenever you allocate a new file descriptor.
+//A file opened for writing is created if it doesn't exist yet.
 int FileOpen(char *filename, char *mode) {
 	//Initializations:
 	int i;
+	int fmode;
 	uint32 inode_handle;
 
-	//Check if already open:
-	for (i = 0; i < FILE_MAX_OPEN_FILES; i++) {
-		//check if inuse
-		if (fds[i].inuse) {
-			//compare filenames
-			if (dstrncmp(filename, fds[i].filename, DFS_MAX_FILENAME_SIZE) == 0) {
-				printf("FileOpen: Error file is already opened by another process\n");
-				return FILE_FAIL;
-			}
-		}
+	//Work out the mode first
+	if (dstrncmp("r", mode, 2) == 0) {
+		fmode = 1;
+	} else if (dstrncmp("w", mode, 2) == 0) {
+		fmode = 2;
+	} else if (dstrncmp("rw", mode, 3) == 0) {
+		fmode = 3;
+	} else {
+		printf("FileOpen: Error Mode passed through into fileopen as parameter is invalid\n");
+		return FILE_FAIL;
 	}
 
-
-	//Retrieve inode handle, fails if it does not exist
-	if (( inode_handle = DfsInodeFilenameExists(filename)) == DFS_FAIL) {
+	//Retrieve inode handle, fails if it does not exist and we're only reading
+	if (fmode == 1) {
+		inode_handle = DfsInodeFilenameExists(filename);
+	} else {
+		inode_handle = DfsInodeOpen(filename);
+	}
+	if (inode_handle == DFS_FAIL) {
 		printf("FileOpen: Error Could not open file for inode_handle dfs inode handle does not exist\n");
 		return FILE_FAIL;
 	}
 
-	//Find the next available file descriptor, mark as inuse and copy its filename to the descriptor and everything else to 0 (for now)
-	//Acquire Lock before allocating new file descriptor
+	//Acquire Lock before looking for the file and allocating new file descriptor
 	while (LockHandleAcquire(fds_lock) != SYNC_SUCCESS) {}
-	i = 0;
-	while (fds[i].inuse == 1) {
-		if (i >= FILE_MAX_OPEN_FILES) {
-			printf("FileOpen: Error all files are inuse\n");
+	//Check if already open:
+	for (i = 0; i < FILE_MAX_OPEN_FILES; i++) {
+		if (fds[i].inuse && (fds[i].inode_handle == inode_handle)) {
+			LockHandleRelease(fds_lock);
+			printf("FileOpen: Error file is already opened by another process\n");
 			return FILE_FAIL;
 		}
 	}
+	//Take the lowest free file descriptor, mark as inuse and copy its filename to the descriptor and everything else to 0 (for now)
+	i = dffs(fds_free);
+	if (i >= FILE_MAX_OPEN_FILES) {
+		LockHandleRelease(fds_lock);
+		printf("FileOpen: Error all files are inuse\n");
+		return FILE_FAIL;
+	}
 	fds[i].inuse = 1;
-	dstrcpy(fds[i].filename, filename);
-	fds[i].mode = 0;
+	fds_free &= ~(1 << i);
+	dstrncpy(fds[i].filename, filename, FILE_MAX_FILENAME_LENGTH);
+	fds[i].inode_handle = inode_handle;
+	fds[i].mode = fmode;
 	fds[i].pos = 0;
 	fds[i].eof_flag = 0;
-
-	//Mark its mode
-	//check read
-	//debug strncmp
-	printf("Type of mode = %s, strncp: %d", mode, dstrncmp("r", mode,)); 
-	if (dstrncmp("r", mode, 2) == 0) {
-		fds[i].mode = 1;
-	} 
-	//check write
-	else if (dstrncmp("w", mode, 2) == 0) {
-		fds[i].mode = 2;
-	}
-	//check read/write
-	else if (dstrncmp("rw", mode, 3) == 0) {
-		fds[i].mode = 3;
-	}
-	//Otherwise no valid mode selected, return fail
-	else {
-		printf("FileOpen: Error Mode passed through into fileopen as parameter is invalid\n");
-		return FILE_FAIL;
-	}
+	fds[i].ra_pos = 0;
+	fds[i].ra_blocks = 0;
+	file_stats.opens++;
 	LockHandleRelease(fds_lock);
-    return i;
-	
+	return i;
 }
 
 //close the given file descriptor handle. Return FILE_FAIL on failure, and FILE_SUCCESS on success
 int FileClose(int handle) {
-	//Initializations:
 	//Check if file is already closed
-	int i;
-
-	if (!fds[i].inuse) {
+	if (!FileValid(handle)) {
 		printf("FileClose: Error File is already closed \n");
 		return FILE_FAIL; 
 	}
 
-	fds[i].inuse = 0;
+	while (LockHandleAcquire(fds_lock) != SYNC_SUCCESS) {}
+	fds[handle].inuse = 0;
+	fds_free |= 1 << handle;
+	file_stats.closes++;
+	LockHandleRelease(fds_lock);
 	return FILE_SUCCESS;
 }
 
+//Per-process descriptors. A user program's file handles index its own table, pcb->files, whose entries are handles
+//of the open files above; pcb->files_free has bit fd set while fd is free, so opening takes the lowest set bit and
+//closing sets it again. Kernel code such as filesys.c uses the open file handles directly.
+
+//Set up an empty descriptor table for a new process
+void FileTableInit(PCB *pcb) {
+	pcb->files_free = (1 << PROCESS_MAX_FILES) - 1;
+}
+
+//Return the open file handle that descriptor fd of pcb stands for, or FILE_FAIL if fd isn't open
+int FileFdHandle(PCB *pcb, int fd) {
+	if ((fd < 0) || (fd >= PROCESS_MAX_FILES) || (pcb->files_free & (1 << fd))) {
+		return FILE_FAIL;
+	}
+	return pcb->files[fd];
+}
+
+//Open filename as for FileOpen and give it a descriptor of pcb's. Return the descriptor, or FILE_FAIL
+int FileFdOpen(PCB *pcb, char *filename, char *mode) {
+	int fd, handle;
+
+	if ((fd = dffs(pcb->files_free)) >= PROCESS_MAX_FILES) {
+		printf("FileFdOpen: Error process %d has %d files open already\n", pcb->pid, PROCESS_MAX_FILES);
+		return FILE_FAIL;
+	}
+	if ((handle = FileOpen(filename, mode)) == FILE_FAIL) {
+		return FILE_FAIL;
+	}
+	pcb->files_free &= ~(1 << fd);
+	pcb->files[fd] = handle;
+	return fd;
+}
+
+//Close descriptor fd of pcb. Return FILE_FAIL on failure, and FILE_SUCCESS on success
+int FileFdClose(PCB *pcb, int fd) {
+	int handle;
+
+	if ((handle = FileFdHandle(pcb, fd)) == FILE_FAIL) {
+		printf("FileFdClose: Error descriptor %d is not open\n", fd);
+		return FILE_FAIL;
+	}
+	pcb->files_free |= 1 << fd;
+	return FileClose(handle);
+}
+
+//Close every descriptor pcb still has open, when it exits
+void FileFdCloseAll(PCB *pcb) {
+	int fd;
+
+	while ((fd = dffs(~pcb->files_free & ((1 << PROCESS_MAX_FILES) - 1))) < PROCESS_MAX_FILES) {
+		FileFdClose(pcb, fd);
+	}
+}
+
+//Return the size in bytes of the open file identified by handle, or FILE_FAIL
+int FileLength(int handle) {
+	uint32 filesize;
+
+	if (!FileValid(handle)) {
+		return FILE_FAIL;
+	}
+	if ((filesize = DfsInodeFilesize(fds[handle].inode_handle)) == DFS_FAIL) {
+		return FILE_FAIL;
+	}
+	return filesize;
+}
+
 //read num_bytes from the open file descriptor identified by handle. Return FILE_FAIL on failure or upon reaching end of file, 
-//and the number of bytes read on success. If end of file is reached, the end-of-file flag in the file descriptor should be set
+//and the number of bytes read on success. If end of file is reached, the end-of-file flag in the file descriptor should be set.
+//A read that runs into the end of the file returns the bytes it did get; only one that gets none returns FILE_FAIL.
 int FileRead(int handle, void *mem, int num_bytes) {
+	dfs_iovec iov;
+
+	iov.mem = mem;
+	iov.len = num_bytes;
+	return FileReadv(handle, &iov, 1);
+}
+
+//Like FileRead, but fills the iovcnt pieces of memory in iov one after the other, in a single read from the file.
+int FileReadv(int handle, dfs_iovec *iov, int iovcnt) {
 	//Initializations:
 	int filesize;
+	int num_bytes = 0;
 	int i;
+	uint32 start;
 	//Check if file is inuse
-	if (!fds[i].inuse) {
+	if (!FileValid(handle)) {
 		printf("FileRead: Error could not read file already closed \n");
 		return FILE_FAIL; 
 	}
 
 	//Check if its in the correct mode
-	if (fds[i].mode != 1) {
+	if (!(fds[handle].mode & 1)) {
 		printf("FileRead: Error could not read file because mode is not in read\n");
 		return FILE_FAIL;
 	}
 
 	//Check if if it reached eof already
-	if (fds[i].eof_flag) {
+	if (fds[handle].eof_flag) {
 		printf("FileRead: Error could not read file because file already reached eof (eof flag is set)\n");
 		return FILE_FAIL;
 	}
 
-	//maximum number of bytes that can be read or written at any time by the file functions is 4096 bytes, check if num_bytes surpasses this
-	if (num_bytes > FILE_MAX_READWRITE_BYTES) {
-		printf("FileRead: Error could not read file because the number of bytes wanting to be read exceeds the max # of bytes to be read possible (4096)\n");
-		return FILE_FAIL;
+	//Any number of bytes can be read at once
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].len < 0) {
+			printf("FileRead: Error could not read a negative number of bytes\n");
+			return FILE_FAIL;
+		}
+		num_bytes += iov[i].len;
 	}
 
 	//Get the filesize
-	if ( (filesize = DfsInodeFilesize(fds[handle].inode_handle)) == DFS_FAIL ) {
+	if ((filesize = FileLength(handle)) == FILE_FAIL) {
 		printf("FileRead: Error could not read file because the filesize could not be found from inode handle\n");
 		return FILE_FAIL;
 	}
 
 	//Check if it reaches end of file
-	if (fds[i].pos + num_bytes > filesize) {
-		printf("Reading until the end of file\n");
-		num_bytes = filesize - fds[i].pos;
-		fds[i].eof_flag = 1;
+	if (fds[handle].pos + num_bytes > filesize) {
+		dbprintf('F', "FileRead: reading until the end of file\n");
+		num_bytes = filesize - fds[handle].pos;
+		fds[handle].eof_flag = 1;
 	}
 
 	//Read the bytes, return fail if failed
-	if ((DfsInodeReadBytes(fds[handle].inode_handle, mem, fds[i].pos, num_bytes)) == DFS_FAIL) {
+	if ((num_bytes > 0) && (DfsInodeReadv(fds[handle].inode_handle, iov, iovcnt, fds[handle].pos, num_bytes) == DFS_FAIL)) {
 		printf("FileRead: Error could not read file because DfsInodeReadBytes failed\n");
 		return FILE_FAIL;
 	}
 
-	fds[i].pos += num_bytes;
-	//check if eof reach, return failed if so
-	if (fds[i].eof_flag) {
-		printf("FileRead: Error End of file reached could not read all bytes specified originall\n");
+	start = fds[handle].pos;
+	EVLOG(EV_FILE_READ, handle, start, num_bytes, 0);
+	fds[handle].pos += num_bytes;
+	file_stats.bytesRead += num_bytes;
+
+	//Read ahead once reads look sequential, further the longer they stay that way
+	if (start == fds[handle].ra_pos) {
+		fds[handle].ra_blocks = (fds[handle].ra_blocks == 0) ? FILE_READAHEAD_MIN_BLOCKS : fds[handle].ra_blocks * 2;
+		if (fds[handle].ra_blocks > FILE_READAHEAD_MAX_BLOCKS) {
+			fds[handle].ra_blocks = FILE_READAHEAD_MAX_BLOCKS;
+		}
+		if (!fds[handle].eof_flag) {
+			DfsInodePrefetch(fds[handle].inode_handle, fds[handle].pos, fds[handle].ra_blocks);
+		}
+	} else {
+		fds[handle].ra_blocks = 0;
+	}
+	fds[handle].ra_pos = fds[handle].pos;
+	//check if eof reach with nothing read, return failed if so
+	if (fds[handle].eof_flag && (num_bytes == 0)) {
+		dbprintf('F', "FileRead: End of file reached could not read any bytes\n");
 		return FILE_FAIL;
 	}
 
@@ -165,114 +286,421 @@ int FileRead(int handle, void *mem, int num_bytes) {
 
 
 //write num_bytes to the open file descriptor identified by handle. Return FILE_FAIL on failure, and the number of bytes written on success.
+//Writing past the end of the file makes it longer.
 int FileWrite(int handle, void *mem, int num_bytes) {
-	//Initializations:
-	int filesize, i;
+	dfs_iovec iov;
+
+	iov.mem = mem;
+	iov.len = num_bytes;
+	return FileWritev(handle, &iov, 1);
+}
+
+//Like FileWrite, but writes the iovcnt pieces of memory in iov one after the other, in a single pass over the file's blocks.
+int FileWritev(int handle, dfs_iovec *iov, int iovcnt) {
+	int num_bytes = 0;
+	int i;
 	//Check if file is inuse
-	if (!fds[i].inuse) {
+	if (!FileValid(handle)) {
 		printf("FileWrite: Error could not write file already closed \n");
 		return FILE_FAIL; 
 	}
 
 	//Check if its in the correct mode
-	if (fds[i].mode != 2) {
+	if (!(fds[handle].mode & 2)) {
 		printf("FileWrite: Error could not write file because mode is not in write\n");
 		return FILE_FAIL;
 	}
 
-	//Check if if it reached eof already
-	if (fds[i].eof_flag) {
-		printf("FileWrite: Error could not write file because file already reached eof (eof flag is set)\n");
-		return FILE_FAIL;
+	//Any number of bytes can be written at once
+	for (i = 0; i < iovcnt; i++) {
+		if (iov[i].len < 0) {
+			printf("FileWrite: Error could not write a negative number of bytes\n");
+			return FILE_FAIL;
+		}
+		num_bytes += iov[i].len;
 	}
 
-	//maximum number of bytes that can be read or written at any time by the file functions is 4096 bytes, check if num_bytes surpasses this
-	if (num_bytes > FILE_MAX_READWRITE_BYTES) {
-		printf("FileWrite: Error could not write file because the number of bytes wanting to be read exceeds the max # of bytes to be written possible (4096)\n");
+	//Write the bytes, return fail if failed
+	if ((num_bytes > 0) && (DfsInodeWritev(fds[handle].inode_handle, iov, iovcnt, fds[handle].pos) == DFS_FAIL)) {
+		printf("FileWrite: Error could not write file because DfsInodeWriteBytes failed\n");
 		return FILE_FAIL;
 	}
 
-	//Get the filesize
-	if ( (filesize = DfsInodeFilesize(fds[handle].inode_handle)) == DFS_FAIL ) {
-		printf("FileWrite: Error could not write file because the filesize could not be found from inode handle\n");
+	EVLOG(EV_FILE_WRITE, handle, fds[handle].pos, num_bytes, 0);
+	fds[handle].pos += num_bytes;
+	file_stats.bytesWritten += num_bytes;
+	return num_bytes;
+}
+
+//Service queued asynchronous requests until there are none left. This runs as a system process.
+static void FileAsyncWorker() {
+	file_async_request *r;
+	int intrs;
+
+	while (1) {
+		intrs = DisableIntrs();
+		if ((r = async_head) == NULL) {
+			async_worker = 0;
+			RestoreIntrs(intrs);
+			return;
+		}
+		if ((async_head = r->next) == NULL) {
+			async_tail = NULL;
+		}
+		RestoreIntrs(intrs);
+
+		if (r->write) {
+			r->result = DfsInodeWritev(r->inode_handle, r->pieces, r->npieces, r->pos);
+		} else {
+			r->result = DfsInodeReadv(r->inode_handle, r->pieces, r->npieces, r->pos, r->len);
+		}
+		if (r->result == DFS_FAIL) {
+			printf("FileAsyncWorker: Error could not %s file\n", r->write ? "write" : "read");
+			r->result = FILE_FAIL;
+		} else if (r->write) {
+			file_stats.bytesWritten += r->result;
+		} else {
+			file_stats.bytesRead += r->result;
+		}
+		SemSignal(&(r->finished));
+	}
+}
+
+//Queue a read (or write, if write is set) between the open file identified by handle and the npieces pieces of memory,
+//from the current position on, and return without waiting. The position moves on (and the end-of-file flag is set)
+//right away, as if the request were already done, so a run of requests reads or writes the file in order. Requests
+//are done in the order they're queued. Return a ticket to give FileWait on success, or FILE_FAIL.
+int FileStartAsync(int handle, dfs_iovec *pieces, int npieces, int write) {
+	file_async_request *r = NULL;
+	int num_bytes = 0;
+	int filesize;
+	int i, intrs, start;
+
+	if (!FileValid(handle)) {
+		printf("FileStartAsync: Error file is closed\n");
+		return FILE_FAIL;
+	}
+	if (!(fds[handle].mode & (write ? 2 : 1))) {
+		printf("FileStartAsync: Error file is not open for %s\n", write ? "writing" : "reading");
+		return FILE_FAIL;
+	}
+	if ((npieces < 0) || (npieces > FILE_TRAP_IOVEC)) {
 		return FILE_FAIL;
 	}
+	for (i = 0; i < npieces; i++) {
+		if (pieces[i].len < 0) {
+			return FILE_FAIL;
+		}
+		num_bytes += pieces[i].len;
+	}
+	if (!write) {
+		if (fds[handle].eof_flag || ((filesize = FileLength(handle)) == FILE_FAIL)) {
+			return FILE_FAIL;
+		}
+		if (fds[handle].pos + num_bytes > filesize) {
+			num_bytes = filesize - fds[handle].pos;
+			fds[handle].eof_flag = 1;
+			if (num_bytes == 0) {
+				return FILE_FAIL;
+			}
+		}
+	}
 
-	//Check if it reaches end of file
-	if (fds[i].pos + num_bytes > filesize) {
-		printf("writing until the end of file\n");
-		num_bytes = filesize - fds[i].pos;
-		fds[i].eof_flag = 1;
+	intrs = DisableIntrs();
+	for (i = 0; i < FILE_MAX_ASYNC; i++) {
+		if (!asyncs[i].inuse) {
+			r = &asyncs[i];
+			break;
+		}
+	}
+	if (r == NULL) {
+		RestoreIntrs(intrs);
+		printf("FileStartAsync: Error all %d requests are in use\n", FILE_MAX_ASYNC);
+		return FILE_FAIL;
 	}
+	r->inuse = 1;
+	r->ticket = (++async_seq) * FILE_MAX_ASYNC + i;
+	r->pid = GetCurrentPid();
+	r->write = write;
+	r->inode_handle = fds[handle].inode_handle;
+	r->pos = fds[handle].pos;
+	r->len = num_bytes;
+	bcopy((char *)pieces, (char *)r->pieces, npieces * sizeof(dfs_iovec));
+	r->npieces = npieces;
+	SemInit(&(r->finished), 0);
+	r->next = NULL;
+	if (async_tail == NULL) {
+		async_head = r;
+	} else {
+		async_tail->next = r;
+	}
+	async_tail = r;
+	start = !async_worker;
+	async_worker = 1;
+	RestoreIntrs(intrs);
+
+	fds[handle].pos += num_bytes;
+	if (start) {
+		ProcessFork(FileAsyncWorker, 0, "FileAsync", 0);
+	}
+	return r->ticket;
+}
 
-	//Read the bytes, return fail if failed
-	if ((DfsInodeWriteBytes(fds[handle].inode_handle, mem, fds[i].pos, num_bytes)) == DFS_FAIL) {
-		printf("FileWrite: Error could not write file because DfsInodeWriteBytes failed\n");
+//Wait for the asynchronous request identified by ticket to finish and free it. Only the process that queued it
+//can wait for it, and only once. Return the number of bytes moved, or FILE_FAIL.
+int FileWait(int ticket) {
+	file_async_request *r;
+	int result;
+
+	if (ticket <= 0) {
+		return FILE_FAIL;
+	}
+	r = &asyncs[ticket % FILE_MAX_ASYNC];
+	if (!r->inuse || (r->ticket != ticket) || (r->pid != GetCurrentPid())) {
+		printf("FileWait: Error %d is not a ticket for a queued request\n", ticket);
 		return FILE_FAIL;
 	}
+	SemWait(&(r->finished));
+	result = r->result;
+	r->ticket = 0;
+	r->inuse = 0;
+	return result;
+}
+
+//Wait for and free every asynchronous request process pid queued, before its memory goes away.
+void FileAsyncExit(int pid) {
+	int i;
+
+	for (i = 0; i < FILE_MAX_ASYNC; i++) {
+		if (asyncs[i].inuse && (asyncs[i].pid == pid)) {
+			FileWait(asyncs[i].ticket);
+		}
+	}
+}
 
-	fds[i].pos += num_bytes;
-	//check if eof reach, return failed if so
-	if (fds[i].eof_flag) {
-		printf("FileWrite: Error End of file reached could not write all bytes specified originally\n");
+//read num_bytes from the open file identified by handle, starting at byte offset, into mem. Unlike FileRead this
+//neither uses nor moves the file's position and leaves the end-of-file flag alone, so readers at different offsets
+//don't get in each other's way. Return the number of bytes read, which is short at the end of the file, or FILE_FAIL
+//if none could be.
+int FilePread(int handle, void *mem, int num_bytes, int offset) {
+	int filesize;
+
+	if (!FileValid(handle)) {
+		printf("FilePread: Error could not read file already closed \n");
+		return FILE_FAIL;
+	}
+	if (!(fds[handle].mode & 1)) {
+		printf("FilePread: Error could not read file because mode is not in read\n");
+		return FILE_FAIL;
+	}
+	if ((num_bytes < 0) || (offset < 0)) {
+		printf("FilePread: Error could not read %d bytes at %d\n", num_bytes, offset);
 		return FILE_FAIL;
 	}
+	if ((filesize = FileLength(handle)) == FILE_FAIL) {
+		return FILE_FAIL;
+	}
+	if (offset + num_bytes > filesize) {
+		num_bytes = (offset < filesize) ? filesize - offset : 0;
+		if (num_bytes == 0) {
+			return FILE_FAIL;
+		}
+	}
+	if ((num_bytes > 0) && (DfsInodeReadBytes(fds[handle].inode_handle, mem, offset, num_bytes) == DFS_FAIL)) {
+		printf("FilePread: Error could not read file because DfsInodeReadBytes failed\n");
+		return FILE_FAIL;
+	}
+	file_stats.bytesRead += num_bytes;
+	return num_bytes;
+}
 
+//write num_bytes from mem to the open file identified by handle, starting at byte offset, without using or moving
+//the file's position. Writing past the end of the file makes it longer. Return FILE_FAIL on failure, and the number of
+//bytes written on success.
+int FilePwrite(int handle, void *mem, int num_bytes, int offset) {
+	if (!FileValid(handle)) {
+		printf("FilePwrite: Error could not write file already closed \n");
+		return FILE_FAIL;
+	}
+	if (!(fds[handle].mode & 2)) {
+		printf("FilePwrite: Error could not write file because mode is not in write\n");
+		return FILE_FAIL;
+	}
+	if ((num_bytes < 0) || (offset < 0)) {
+		printf("FilePwrite: Error could not write %d bytes at %d\n", num_bytes, offset);
+		return FILE_FAIL;
+	}
+	if ((num_bytes > 0) && (DfsInodeWriteBytes(fds[handle].inode_handle, mem, offset, num_bytes) == DFS_FAIL)) {
+		printf("FilePwrite: Error could not write file because DfsInodeWriteBytes failed\n");
+		return FILE_FAIL;
+	}
+	file_stats.bytesWritten += num_bytes;
 	return num_bytes;
 }
 
+//Copy len bytes of the open file src, starting at byte offset, to the open file dst at its position, and move dst's
+//position past them. The data goes a block at a time through the buffer cache and never through user space. A copy
+//within one file works even if the two ranges overlap. Return the number of bytes copied, which is short if src ends
+//first, or FILE_FAIL if none could be.
+int FileCopyRange(int src, int dst, int offset, int len) {
+	dfs_block b;
+	int filesize;
+	int done, n, from, to;
+	int backwards;
+
+	if (!FileValid(src) || !FileValid(dst)) {
+		printf("FileCopyRange: Error file is closed\n");
+		return FILE_FAIL;
+	}
+	if (!(fds[src].mode & 1) || !(fds[dst].mode & 2)) {
+		printf("FileCopyRange: Error source must be open for reading and destination for writing\n");
+		return FILE_FAIL;
+	}
+	if ((offset < 0) || (len < 0) || ((filesize = FileLength(src)) == FILE_FAIL)) {
+		return FILE_FAIL;
+	}
+	if (offset + len > filesize) {
+		len = (offset < filesize) ? filesize - offset : 0;
+		if (len == 0) {
+			return FILE_FAIL;
+		}
+	}
+	//Copying a range of a file to later in itself has to start at the end
+	backwards = (fds[src].inode_handle == fds[dst].inode_handle) && (fds[dst].pos > offset) &&
+	            (fds[dst].pos < offset + len);
+	for (done = 0; done < len; done += n) {
+		n = len - done;
+		if (n > sizeof(b.data)) {
+			n = sizeof(b.data);
+		}
+		from = backwards ? offset + len - done - n : offset + done;
+		to = fds[dst].pos + (from - offset);
+		if ((DfsInodeReadBytes(fds[src].inode_handle, b.data, from, n) == DFS_FAIL) ||
+		    (DfsInodeWriteBytes(fds[dst].inode_handle, b.data, to, n) == DFS_FAIL)) {
+			printf("FileCopyRange: Error copying %d bytes from %d to %d\n", n, from, to);
+			if (backwards || (done == 0)) {
+				return FILE_FAIL;
+			}
+			break;
+		}
+	}
+	fds[dst].pos += done;
+	return done;
+}
+
+//Write the open file's data that's still only in the buffer cache, and then its inode, to the disk, without writing
+//back anything else. FileDataSync leaves the inode out unless the file's size or blocks changed, since the data can
+//be read back without it. Return FILE_FAIL on failure, and FILE_SUCCESS on success
+int FileSync(int handle) {
+	if (!FileValid(handle)) {
+		printf("FileSync: Error could not sync file already closed \n");
+		return FILE_FAIL;
+	}
+	return (DfsInodeSync(fds[handle].inode_handle, 0) == DFS_FAIL) ? FILE_FAIL : FILE_SUCCESS;
+}
+
+int FileDataSync(int handle) {
+	if (!FileValid(handle)) {
+		printf("FileDataSync: Error could not sync file already closed \n");
+		return FILE_FAIL;
+	}
+	return (DfsInodeSync(fds[handle].inode_handle, 1) == DFS_FAIL) ? FILE_FAIL : FILE_SUCCESS;
+}
+
 //Seek num_bytes within the file descriptor identified by handle, from the location specified by from_where. 
 //There are three possible values for from_where: FILE_SEEK_CUR (seek relative to the current position), 
 //FILE_SEEK_SET (seek relative to the beginning of the file), and FILE_SEEK_END (seek relative to the end of the file). Any seek operation will clear the eof flag.
 int FileSeek(int handle, int num_bytes, int from_where) {
 	//Initializations:
-	int filesize, i;
+	int filesize;
+	int pos;
 	//Check if file is inuse
-	if (!fds[i].inuse) {
+	if (!FileValid(handle)) {
 		printf("FileSeek: Error could not seek file already closed \n");
 		return FILE_FAIL; 
 	}
 
-	//Check for valid from_where Seek parameter
-	if ((from_where != FILE_SEEK_SET) || (from_where != FILE_SEEK_END) || (from_where != FILE_SEEK_CUR)) {
-		printf("FileSeek: Error from_where parameter is invalid for File Seek\n"); 
-	}
-
 	//Clear eof flag and get filesize
 	fds[handle].eof_flag = 0;
-	if ( (filesize = DfsInodeFilesize(fds[handle].inode_handle)) == DFS_FAIL ) {
+	if ((filesize = FileLength(handle)) == FILE_FAIL) {
 		printf("FileSeek: Error could not seek file because the filesize could not be found from inode handle\n");
 		return FILE_FAIL;
 	}
 
-	//SEEK SET
-	if (from_where == FILE_SEEK_SET) {
-		if ((num_bytes < 0) || (num_bytes > filesize)) {
-			printf("FileSeek: Error Seek Set is out of bounds\n");
-			return FILE_FAIL;
-		}
-		fds[handle].pos = num_bytes;
+	switch (from_where) {
+	case FILE_SEEK_SET:
+		pos = num_bytes;
+		break;
+	case FILE_SEEK_CUR:
+		pos = fds[handle].pos + num_bytes;
+		break;
+	case FILE_SEEK_END:
+		pos = filesize + num_bytes;
+		break;
+	default:
+		printf("FileSeek: Error from_where parameter is invalid for File Seek\n"); 
+		return FILE_FAIL;
 	}
+	if ((pos < 0) || (pos > filesize)) {
+		printf("FileSeek: Error seek to %d is out of bounds\n", pos);
+		return FILE_FAIL;
+	}
+	fds[handle].pos = pos;
+	return FILE_SUCCESS;
+}
 
-	//SEEK CUR
-	if (from_where == FILE_SEEK_CUR) {
-		if ((fds[handle].pos + num_bytes > filesize) || (fds[handle].pos + num_bytes < 0)) {
-			printf("FileSeek: Error Seek Cur is out of bounds\n");
-			return FILE_FAIL;
-		}
-		fds[handle].pos += num_bytes;
+//Return the current position in the open file identified by handle, or FILE_FAIL
+int FileTell(int handle) {
+	if (!FileValid(handle)) {
+		return FILE_FAIL;
 	}
+	return fds[handle].pos;
+}
 
-	//SEEK END num_bytes should be negative
-	if (from_where == FILE_SEEK_END) {
-		if ((num_bytes + filesize < 0) || (num_bytes > 0)) {
-			printf("FileSeek: Error Seek Cur is out of bounds\n");
-			return FILE_FAIL;
-		}
-		fds[handle].pos = filesize + num_bytes;
+//Map length bytes of the open file identified by handle, from the page aligned byte offset, into the current
+//process's address space. Pages are read in when first touched and written back on unmap, sync or exit if the
+//file is open for writing. Processes mapping the same page of a file share it, and file reads and writes see it. The mapping stays valid after the file is closed. Return the address of the mapping
+//on success, or FILE_FAIL.
+int FileMap(int handle, int offset, int length) {
+	int filesize;
+	uint32 addr;
+
+	if (!FileValid(handle)) {
+		printf("FileMap: Error could not map file already closed \n");
+		return FILE_FAIL;
 	}
+	if ((filesize = FileLength(handle)) == FILE_FAIL) {
+		return FILE_FAIL;
+	}
+	if ((offset < 0) || (length <= 0) || (offset + length > filesize)) {
+		printf("FileMap: Error mapping %d bytes at %d is out of bounds\n", length, offset);
+		return FILE_FAIL;
+	}
+	addr = MemoryMapFile(currentPCB, fds[handle].inode_handle, offset, length, fds[handle].mode & 2);
+	if (addr == MEMORY_FAIL) {
+		printf("FileMap: Error could not map %d bytes at %d\n", length, offset);
+		return FILE_FAIL;
+	}
+	return addr;
+}
 
-	return FILE_SUCCESS;
+//Write back and remove the mapping containing addr. Return FILE_FAIL on failure, and FILE_SUCCESS on success
+int FileUnmap(uint32 addr) {
+	return (MemoryUnmapFile(currentPCB, addr) == MEMORY_SUCCESS) ? FILE_SUCCESS : FILE_FAIL;
+}
+
+//Write back the dirty pages of the mapping containing addr. Return FILE_FAIL on failure, and FILE_SUCCESS on success
+int FileSyncMap(uint32 addr) {
+	return (MemorySyncFile(currentPCB, addr) == MEMORY_SUCCESS) ? FILE_SUCCESS : FILE_FAIL;
+}
+
+//Copy the file layer's and the DFS's statistics since boot into stats
+void FileGetStats(FileStats *stats) {
+	uint32 intrvals = DisableIntrs();
+
+	bcopy((char *)&file_stats, (char *)stats, sizeof(file_stats));
+	RestoreIntrs(intrvals);
+	DfsGetStats(&(stats->dfs));
 }
 
 //delete the file specified by filename. Return FILE_FAIL on failure, and FILE_SUCCESS on success
@@ -12,6 +12,7 @@
 #include "dlxos.h"
 #include "process.h"
 #include "filesys.h"
+#include "files.h"
 
 // One entry for each type of file system.  Currently, the file systems
 // are native Unix (0) and DLX (1).
@@ -266,14 +267,38 @@ FsUnixDelete (const char *name)
 //
 //	FsDlxIo
 //
-//	Perform a read or a write on a DLX file.
+//	Perform a read or a write on a DLX file.  The DLX file system is
+//	the DFS, reached through the file layer in files.c, so the data
+//	goes through the DFS buffer cache.  Reads stop at the end of the
+//	file; the number of bytes moved is returned, or -1 on failure.
 //
 //----------------------------------------------------------------------
 int
 FsDlxIo (int fd, char *buf, int n, int which)
 {
-  // Your code to read or write a DLX file goes here.
-  return (1);
+  int	handle = openfiles[fd].u.Dlx.handle;
+  int	left, r;
+
+  if (n < 0) {
+    return (-1);
+  }
+  if (which) {
+    r = FileWrite (handle, buf, n);
+  } else {
+    // Don't ask the file layer for more than is there: once a read
+    // runs into the end of the file it refuses any more until a seek.
+    if ((left = FileLength (handle) - FileTell (handle)) < 0) {
+      return (-1);
+    }
+    if (n > left) {
+      n = left;
+    }
+    r = (n == 0) ? 0 : FileRead (handle, buf, n);
+  }
+  openfiles[fd].u.Dlx.curpos = FileTell (handle);
+  dbprintf ('f', "FsDlxIo: %s %d of %d bytes on slot %d.\n",
+	    which ? "write" : "read", r, n, fd);
+  return ((r == FILE_FAIL) ? -1 : r);
 }
 
 
@@ -297,22 +322,37 @@ FsDlxWrite (int fd, char *buf, int n)
 {
   return (FsDlxIo (fd, buf, n, 1));
 }
-
+
 //----------------------------------------------------------------------
 //
 //	FsDlxOpen
 //
-//	Open a file in the DLX file system.  Currently, this just means
-//	to set current position to 0.  However, it should also check to
-//	make sure that the file exists.
+//	Open a file in the DLX file system and set the current position
+//	to 0.  Opening for reading fails if the file doesn't exist;
+//	opening for writing creates it.
 //
 //----------------------------------------------------------------------
 int
 FsDlxOpen (int f, const char *name, int mode)
 {
+  char	*fmode;
+
+  switch (mode & FS_MODE_RW) {
+  case FS_MODE_READ:
+    fmode = "r";
+    break;
+  case FS_MODE_WRITE:
+    fmode = "w";
+    break;
+  default:
+    fmode = "rw";
+    break;
+  }
+  if ((openfiles[f].u.Dlx.handle = FileOpen ((char *)name, fmode)) == FILE_FAIL) {
+    dbprintf ('f', "FsDlxOpen: could not open %s mode %s.\n", name, fmode);
+    return (-1);
+  }
   openfiles[f].u.Dlx.curpos = 0;
-  // You may want to put additional code here (checking to see if the
-  // file exists, etc.)
   return (1);
 }
 
@@ -320,21 +360,33 @@ FsDlxOpen (int f, const char *name, int mode)
 //
 //	FsDlxSeek
 //
-//	Seek in a DLX file.  This just requires adjusting the current
-//	position as recorded in the open files table.
+//	Seek in a DLX file.  Like lseek, this returns the new position,
+//	or -1 if it would be outside the file.
 //
 //----------------------------------------------------------------------
 int
 FsDlxSeek (int f, int offset, int whence)
 {
+  int	handle = openfiles[f].u.Dlx.handle;
+  int	from;
+
   switch (whence) {
   case FS_SEEK_SET:
+    from = FILE_SEEK_SET;
     break;
   case FS_SEEK_CUR:
+    from = FILE_SEEK_CUR;
     break;
   case FS_SEEK_END:
+    from = FILE_SEEK_END;
     break;
+  default:
+    return (-1);
   };
+  if (FileSeek (handle, offset, from) == FILE_FAIL) {
+    return (-1);
+  }
+  openfiles[f].u.Dlx.curpos = FileTell (handle);
   return (openfiles[f].u.Dlx.curpos);
 }
 
@@ -347,10 +399,12 @@ FsDlxSeek (int f, int offset, int whence)
 int
 FsDlxClose (int f)
 {
-  // You may want to add code to this routine.
+  if (FileClose (openfiles[f].u.Dlx.handle) == FILE_FAIL) {
+    return (-1);
+  }
   return (1);
 }
-
+
 //----------------------------------------------------------------------
 //
 //	FsDlxDelete
@@ -361,11 +415,13 @@ FsDlxClose (int f)
 int
 FsDlxDelete (const char *file)
 {
-  // Your code goes here.
+  if (FileDelete ((char *)file) == FILE_FAIL) {
+    return (-1);
+  }
   return (1);
 }
 
-
+
 //----------------------------------------------------------------------
 //
 //	FsModuleInit
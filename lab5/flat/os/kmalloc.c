@@ -0,0 +1,173 @@
+//
+//	kmalloc.c
+//
+//	Kernel object caches (see kmalloc.h).  An object's slab is the
+//	page it's in, so freeing needs nothing but the pointer.  Caches
+//	are shared by every process, so all changes are made with
+//	interrupts off.
+//
+
+#include "ostraps.h"
+#include "dlxos.h"
+#include "queue.h"
+#include "memory.h"
+#include "kmalloc.h"
+#include "evlog.h"
+
+static int kmem_ready = 0;
+static int kmem_pages = 0;	// Pages held by all caches together
+static KmemCache kmem_sizes[KMEM_SIZE_CLASSES];
+
+//----------------------------------------------------------------------
+//
+//	KmemModuleInit
+//
+//	Set up the kmalloc caches and let caches take pages.  Called
+//	after MemoryModuleInit.
+//
+//----------------------------------------------------------------------
+void KmemModuleInit() {
+  int i;
+
+  for (i = 0; i < KMEM_SIZE_CLASSES; i++) {
+    KmemCacheInit(&kmem_sizes[i], "kmalloc", 1 << (KMEM_MIN_SHIFT + i), 0);
+  }
+  kmem_ready = 1;
+}
+
+void KmemCacheInit(KmemCache *c, char *name, int objsize, int maxobjs) {
+  c->name = name;
+  c->objsize = (objsize + KMEM_ALIGN - 1) & ~(KMEM_ALIGN - 1);
+  c->perslab = (MEMORY_PAGE_SIZE - KMEM_SLAB_HEADER) / c->objsize;
+  c->maxobjs = maxobjs;
+  c->nobjs = 0;
+  c->nslabs = 0;
+  c->partial = NULL;
+}
+
+//----------------------------------------------------------------------
+//
+//	KmemSlabLink, KmemSlabUnlink
+//
+//	Put slab s on (take it off) its cache's list of slabs with free
+//	objects.
+//
+//----------------------------------------------------------------------
+static void KmemSlabLink(KmemSlab *s) {
+  s->prev = NULL;
+  s->next = s->cache->partial;
+  if (s->next != NULL) {
+    s->next->prev = s;
+  }
+  s->cache->partial = s;
+}
+
+static void KmemSlabUnlink(KmemSlab *s) {
+  if (s->prev != NULL) {
+    s->prev->next = s->next;
+  } else {
+    s->cache->partial = s->next;
+  }
+  if (s->next != NULL) {
+    s->next->prev = s->prev;
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	KmemSlabNew
+//
+//	Get a page for a new slab of c and thread its objects onto the
+//	slab's free list.  Returns NULL if the budget is spent or there
+//	are no free pages.
+//
+//----------------------------------------------------------------------
+static KmemSlab *KmemSlabNew(KmemCache *c) {
+  KmemSlab *s;
+  char *obj;
+  int page, i;
+
+  if (!kmem_ready || (kmem_pages >= KMEM_MAX_PAGES) || (c->perslab <= 0)) {
+    return NULL;
+  }
+  if ((page = MemoryAllocPage()) == 0) {
+    return NULL;
+  }
+  kmem_pages++;
+  c->nslabs++;
+  s = (KmemSlab *)(page * MEMORY_PAGE_SIZE);
+  s->cache = c;
+  s->inuse = 0;
+  s->page = page;
+  s->freelist = NULL;
+  obj = (char *)s + KMEM_SLAB_HEADER + (c->perslab - 1) * c->objsize;
+  for (i = 0; i < c->perslab; i++, obj -= c->objsize) {
+    ((KmemObj *)obj)->next = s->freelist;
+    s->freelist = (KmemObj *)obj;
+  }
+  KmemSlabLink(s);
+  EVLOG(EV_KMEM_SLAB_NEW, page, c->objsize, 0, 0);
+  return s;
+}
+
+void *KmemCacheAlloc(KmemCache *c) {
+  int intrs = DisableIntrs();
+  KmemSlab *s;
+  KmemObj *obj;
+
+  if (((c->maxobjs > 0) && (c->nobjs >= c->maxobjs)) ||
+      (((s = c->partial) == NULL) && ((s = KmemSlabNew(c)) == NULL))) {
+    RestoreIntrs(intrs);
+    dbprintf('k', "KmemCacheAlloc: %s cache is full\n", c->name);
+    return NULL;
+  }
+  obj = s->freelist;
+  s->freelist = obj->next;
+  s->inuse++;
+  if (s->freelist == NULL) {
+    KmemSlabUnlink(s);
+  }
+  c->nobjs++;
+  EVLOG(EV_KMEM_ALLOC, obj, c->objsize, 0, 0);
+  RestoreIntrs(intrs);
+  return obj;
+}
+
+void KmemCacheFree(void *obj) {
+  int intrs = DisableIntrs();
+  KmemSlab *s = (KmemSlab *)((uint32)obj & ~MEMORY_PAGE_MASK);
+  KmemCache *c = s->cache;
+
+  if (s->freelist == NULL) {
+    KmemSlabLink(s);
+  }
+  ((KmemObj *)obj)->next = s->freelist;
+  s->freelist = (KmemObj *)obj;
+  s->inuse--;
+  c->nobjs--;
+  EVLOG(EV_KMEM_FREE, obj, c->objsize, 0, 0);
+  if (s->inuse == 0) {
+    KmemSlabUnlink(s);
+    c->nslabs--;
+    kmem_pages--;
+    EVLOG(EV_KMEM_SLAB_FREE, s->page, c->objsize, 0, 0);
+    MemoryFreePage(s->page);
+  }
+  RestoreIntrs(intrs);
+}
+
+void *kmalloc(int bytes) {
+  int i;
+
+  if ((bytes <= 0) || (bytes > KMEM_MAX_BYTES)) {
+    return NULL;
+  }
+  for (i = 0; (1 << (KMEM_MIN_SHIFT + i)) < bytes; i++) { }
+  return KmemCacheAlloc(&kmem_sizes[i]);
+}
+
+void kfree(void *ptr) {
+  if (ptr != NULL) {
+    KmemCacheFree(ptr);
+  }
+}
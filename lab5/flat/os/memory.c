@@ -10,6 +10,8 @@
 #include "memory.h"
 #include "process.h"
 #include "queue.h"
+#include "dfs.h"
+#include "evlog.h"
 
 static uint32	pagestart;
 static int	freemapmax;
@@ -17,6 +19,25 @@ static int	nfreepages;
 static uint32	freepages[MEMORY_MAX_PAGES/32];
 static uint32	negativeone = 0xffffffff;
 
+// The page cache.  Each entry is a physical page holding the page of a
+// DFS file at offset, shared by every PTE (refs of them) mapping that
+// part of the file, and read and written in place by the DFS, so no
+// file data is held both here and in its buffer cache.  A page nobody
+// maps any more stays cached until MemoryAllocPage runs out of free
+// pages and takes back the least recently used one.  A page whose file
+// has been deleted or truncated is detached: never found again, and
+// freed with its last PTE.
+typedef struct MemoryFilePage {
+  int		page;		// Physical page, 0 if the entry is free
+  int		inode;		// DFS inode handle, -1 once detached
+  uint32	offset;		// Page aligned byte offset in the file
+  int		refs;		// PTEs mapping it
+  uint32	used;		// filecache_clock when last looked up
+} MemoryFilePage;
+
+static MemoryFilePage	filecache[MEMORY_FILE_CACHE_PAGES];
+static uint32	filecache_clock = 0;
+
 //----------------------------------------------------------------------
 //
 //	This silliness is required because the compiler believes that
@@ -99,11 +120,44 @@ MemoryModuleInit ()
   dbprintf ('m', "Initialized %d free pages.\n", nfreepages);
 }
 
+//----------------------------------------------------------------------
+//
+//	MemoryFileCacheReclaim
+//
+//	Free the least recently used page cache page that nothing maps.
+//	They're clean: mappings write their pages back before they let go
+//	of them, and file writes go through to the disk.  Returns 1 if it
+//	freed a page, or 0 if every cached page is mapped.
+//
+//----------------------------------------------------------------------
+static
+int
+MemoryFileCacheReclaim ()
+{
+  MemoryFilePage *f, *victim = NULL;
+
+  for (f = filecache; f < &filecache[MEMORY_FILE_CACHE_PAGES]; f++) {
+    if ((f->page != 0) && (f->refs == 0) &&
+	((victim == NULL) || (f->used < victim->used))) {
+      victim = f;
+    }
+  }
+  if (victim == NULL) {
+    return (0);
+  }
+  dbprintf ('m', "Reclaimed page %d (inode %d offset 0x%x) from the page cache.\n",
+	    victim->page, victim->inode, victim->offset);
+  MemoryFreePage (victim->page);
+  victim->page = 0;
+  return (1);
+}
+
 //----------------------------------------------------------------------
 //
 //	MemoryAllocPage
 //
-//	Allocate a page of memory.
+//	Allocate a page of memory, taking one back from the page cache
+//	if there are no free ones.
 //
 //----------------------------------------------------------------------
 inline
@@ -114,10 +168,9 @@ MemoryAllocPage ()
   int		bitnum;
   uint32	v;
 
-  if (nfreepages == 0) {
+  if ((nfreepages == 0) && !MemoryFileCacheReclaim ()) {
     return (0);
   }
-  dbprintf ('m', "Allocating memory, starting with page %d\n", mapnum);
   while (freepages[mapnum] == 0) {
     mapnum += 1;
     if (mapnum >= freemapmax) {
@@ -125,16 +178,47 @@ MemoryAllocPage ()
     }
   }
   v = freepages[mapnum];
-  for (bitnum = 0; (v & (1 << bitnum)) == 0; bitnum++) {
-  }
+  bitnum = dffs (v);
   freepages[mapnum] &= invert(1 << bitnum);
   v = (mapnum * 32) + bitnum;
-  dbprintf ('m', "Allocated memory, from map %d, page %d, map=0x%x.\n",
-	    mapnum, v, freepages[mapnum]);
   nfreepages -= 1;
+  EVLOG (EV_PAGE_ALLOC, v, nfreepages, 0, 0);
   return (v);
 }
 
+//----------------------------------------------------------------------
+//
+//	MemoryAllocPages
+//
+//	Allocate n physically contiguous pages, for kernel tables bigger
+//	than a page.  Returns the first page number, or 0 if there's no
+//	free run that long.
+//
+//----------------------------------------------------------------------
+int
+MemoryAllocPages (int n)
+{
+  int		maxpage = MemoryGetSize () / MEMORY_PAGE_SIZE;
+  int		start, page;
+
+  for (start = pagestart; start + n <= maxpage; start = page + 1) {
+    for (page = start; page < start + n; page++) {
+      if (!(freepages[page / 32] & (1 << (page % 32)))) {
+	break;
+      }
+    }
+    if (page == start + n) {
+      for (page = start; page < start + n; page++) {
+	MemorySetFreemap (page, 0);
+      }
+      nfreepages -= n;
+      dbprintf ('m', "Allocated %d pages from page %d.\n", n, start);
+      return (start);
+    }
+  }
+  return (0);
+}
+
 //----------------------------------------------------------------------
 //
 //	MemoryFreePage
@@ -147,7 +231,7 @@ MemoryFreePage(uint32 page)
 {
   MemorySetFreemap (page, 1);
   nfreepages += 1;
-  dbprintf ('m',"Freed page 0x%x, %d remaining.\n", page, nfreepages);
+  EVLOG (EV_PAGE_FREE, page, nfreepages, 0, 0);
 }
 
 //----------------------------------------------------------------------
@@ -157,7 +241,8 @@ MemoryFreePage(uint32 page)
 //	Translate a user address (in the process referenced by pcb)
 //	into an OS (physical) address.  This works for simple one-level
 //	page tables, but will have to be modified for two-level page
-//	tables.
+//	tables.  Pages mapped from files aren't translated; the kernel
+//	doesn't mark them dirty when it writes to them.
 //
 //----------------------------------------------------------------------
 uint32
@@ -166,7 +251,7 @@ MemoryTranslateUserToSystem (PCB *pcb, uint32 addr)
     int	page = addr / MEMORY_PAGE_SIZE;
     int offset = addr % MEMORY_PAGE_SIZE;
 
-    if (page > pcb->npages) {
+    if (page >= pcb->npages) {
       return (0);
     }
     return ((pcb->pagetable[page] & MEMORY_PTE_MASK) + offset);
@@ -249,6 +334,49 @@ MemoryCopyUserToSystem (PCB *pcb, unsigned char *from,unsigned char *to, int n)
   return (moveBetweenSpaces (pcb, to, from, n, -1));
 }
 
+//----------------------------------------------------------------------
+//
+//	MemoryCopyStringFromUser
+//
+//	Copy a null-terminated string from user space into the system
+//	buffer to, which holds max bytes.  Like moveBetweenSpaces, this
+//	translates the user address once per page and copies straight out
+//	of the physical page.  Returns the length of the string, not
+//	counting the '\0', or -1 if it runs into an unmapped page or
+//	doesn't fit in max bytes.
+//
+//----------------------------------------------------------------------
+int
+MemoryCopyStringFromUser (PCB *pcb, char *from, char *to, int max)
+{
+  char		*curUser;
+  int		len = 0;
+  int		bytesLeft;
+
+  while (len < max) {
+    curUser = (char *)MemoryTranslateUserToSystem (pcb, (uint32)from);
+    if (curUser == (char *)0) {
+      break;
+    }
+    bytesLeft = MEMORY_PAGE_SIZE - ((uint32)curUser % MEMORY_PAGE_SIZE);
+    if (bytesLeft > max - len) {
+      bytesLeft = max - len;
+    }
+    // Copy up to the end of the page or the string, whichever is first
+    while (bytesLeft-- > 0) {
+      if ((to[len] = *curUser++) == '\0') {
+        return (len);
+      }
+      len++;
+      from++;
+    }
+  }
+  if (max > 0) {
+    to[(len < max) ? len : max - 1] = '\0';
+  }
+  return (-1);
+}
+
 
 //----------------------------------------------------------------------
 //
@@ -326,3 +454,382 @@ MemoryGetOperandAddress (PCB *pcb, uint32 instr)
 	    instr, addr, reg, regValue);
   return (addr);
 }
+
+//----------------------------------------------------------------------
+//
+//	MemoryFileCacheFind
+//
+//	Return the page cache entry for the page of inode at offset, or
+//	NULL if it isn't cached.
+//
+//----------------------------------------------------------------------
+static
+MemoryFilePage *
+MemoryFileCacheFind (int inode, uint32 offset)
+{
+  MemoryFilePage *f;
+
+  for (f = filecache; f < &filecache[MEMORY_FILE_CACHE_PAGES]; f++) {
+    if ((f->page != 0) && (f->inode == inode) && (f->offset == offset)) {
+      f->used = ++filecache_clock;
+      return (f);
+    }
+  }
+  return (NULL);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryFileCacheLookup
+//
+//	Return the system address of the cached page of inode holding
+//	byte offset, or 0 if that page isn't cached.  The DFS reads and
+//	writes a cached page here rather than through its buffers.
+//
+//----------------------------------------------------------------------
+uint32
+MemoryFileCacheLookup (int inode, uint32 offset)
+{
+  MemoryFilePage *f = MemoryFileCacheFind (inode, offset & ~MEMORY_PAGE_MASK);
+
+  return ((f == NULL) ? 0 : f->page * MEMORY_PAGE_SIZE);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryFileCacheInsert
+//
+//	Cache page, just filled from the page of inode at offset, with one
+//	PTE mapping it.  The entry of a page nothing maps is reused if
+//	there's no free one.  Returns 0 if every entry is mapped, in which
+//	case page stays the caller's own.
+//
+//----------------------------------------------------------------------
+static
+int
+MemoryFileCacheInsert (int inode, uint32 offset, int page)
+{
+  MemoryFilePage *f, *slot = NULL;
+
+  for (f = filecache; f < &filecache[MEMORY_FILE_CACHE_PAGES]; f++) {
+    if (f->page == 0) {
+      slot = f;
+      break;
+    }
+    if ((f->refs == 0) && ((slot == NULL) || (f->used < slot->used))) {
+      slot = f;
+    }
+  }
+  if (slot == NULL) {
+    return (0);
+  }
+  if (slot->page != 0) {
+    MemoryFreePage (slot->page);
+  }
+  slot->page = page;
+  slot->inode = inode;
+  slot->offset = offset;
+  slot->refs = 1;
+  slot->used = ++filecache_clock;
+  return (1);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryFileCacheRelease
+//
+//	Drop a mapped file page's PTE.  A cached page stays cached (unless
+//	it's been detached) when its last PTE goes; a page that couldn't
+//	be cached is freed.
+//
+//----------------------------------------------------------------------
+static
+void
+MemoryFileCacheRelease (uint32 pte)
+{
+  int		page = MemoryPteToPage (pte) / MEMORY_PAGE_SIZE;
+  MemoryFilePage *f;
+
+  for (f = filecache; f < &filecache[MEMORY_FILE_CACHE_PAGES]; f++) {
+    if (f->page == page) {
+      if ((--f->refs == 0) && (f->inode < 0)) {
+	MemoryFreePage (page);
+	f->page = 0;
+      }
+      return;
+    }
+  }
+  MemoryFreePage (page);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryFileCacheDrop
+//
+//	Forget the cached pages of inode, or of every file if inode is -1,
+//	because the file is gone or its contents changed under them.
+//	Mapped pages are detached, so the mappings keep them until they're
+//	unmapped; the rest are freed.
+//
+//----------------------------------------------------------------------
+void
+MemoryFileCacheDrop (int inode)
+{
+  MemoryFilePage *f;
+
+  for (f = filecache; f < &filecache[MEMORY_FILE_CACHE_PAGES]; f++) {
+    if ((f->page == 0) || ((inode >= 0) && (f->inode != inode))) {
+      continue;
+    }
+    if (f->refs > 0) {
+      f->inode = -1;
+    } else {
+      MemoryFreePage (f->page);
+      f->page = 0;
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryMapFile
+//
+//	Map length bytes of the DFS file inode, starting at the page
+//	aligned byte offset, into free pages of pcb's address space.  No
+//	memory is allocated here: the PTEs are left invalid and each page
+//	is read in by MemoryPageFaultHandler the first time it's touched.
+//	The page table is grown to cover the mapping if it has to be.
+//	Returns the user address of the mapping, or MEMORY_FAIL.
+//
+//----------------------------------------------------------------------
+uint32
+MemoryMapFile (PCB *pcb, uint32 inode, uint32 offset, int length,
+	       int writable)
+{
+  int		n = (length + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE;
+  int		start, page;
+
+  if ((length <= 0) || (offset % MEMORY_PAGE_SIZE)) {
+    return (MEMORY_FAIL);
+  }
+  // Find n free pages in a row above the process's own memory, and
+  // below the shared runtime and kernel data pages
+  for (start = pcb->npages; start + n <= PROCESS_RUNTIME_PAGE; start = page + 1) {
+    for (page = start; page < start + n; page++) {
+      if (pcb->maps[page].start >= 0) {
+	break;
+      }
+    }
+    if (page == start + n) {
+      break;
+    }
+  }
+  if (start + n > PROCESS_RUNTIME_PAGE) {
+    dbprintf ('m', "No room to map %d pages.\n", n);
+    return (MEMORY_FAIL);
+  }
+  for (page = start; page < start + n; page++) {
+    pcb->pagetable[page] = 0;
+    pcb->maps[page].start = start;
+    pcb->maps[page].inode = inode;
+    pcb->maps[page].offset = offset + (page - start) * MEMORY_PAGE_SIZE;
+    pcb->maps[page].bytes = length - (page - start) * MEMORY_PAGE_SIZE;
+    if (pcb->maps[page].bytes > MEMORY_PAGE_SIZE) {
+      pcb->maps[page].bytes = MEMORY_PAGE_SIZE;
+    }
+    pcb->maps[page].writable = writable;
+  }
+  if (pcb->currentSavedFrame[PROCESS_STACK_PTSIZE] < start + n) {
+    pcb->currentSavedFrame[PROCESS_STACK_PTSIZE] = start + n;
+  }
+  dbprintf ('m', "Mapped inode %d offset 0x%x at pages %d-%d.\n",
+	    inode, offset, start, start + n - 1);
+  return (start * MEMORY_PAGE_SIZE);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryWriteBackPage
+//
+//	Write a mapped page back to its file if the simulator has marked
+//	it dirty, and clear the dirty bit.  Only the part of the page
+//	that's still inside the file is written, so a mapping never makes
+//	a file longer.
+//
+//----------------------------------------------------------------------
+static
+int
+MemoryWriteBackPage (PCB *pcb, int page)
+{
+  ProcessMapPage *m = &pcb->maps[page];
+  uint32	pte = pcb->pagetable[page];
+  uint32	filesize;
+  int		n = m->bytes;
+
+  if (!(pte & MEMORY_PTE_VALID) || !(pte & MEMORY_PTE_DIRTY) || !m->writable) {
+    return (MEMORY_SUCCESS);
+  }
+  if ((filesize = DfsInodeFilesize (m->inode)) == DFS_FAIL) {
+    return (MEMORY_FAIL);
+  }
+  if (m->offset + n > filesize) {
+    n = (m->offset < filesize) ? filesize - m->offset : 0;
+  }
+  if ((n > 0) && (DfsInodeWriteBytes (m->inode, (void *)MemoryPteToPage (pte),
+				      m->offset, n) == DFS_FAIL)) {
+    return (MEMORY_FAIL);
+  }
+  pcb->pagetable[page] = pte & ~MEMORY_PTE_DIRTY;
+  return (MEMORY_SUCCESS);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemorySyncFile
+//
+//	Write back the dirty pages of the mapping containing user address
+//	addr.  Returns MEMORY_FAIL if addr isn't mapped or a write fails.
+//
+//----------------------------------------------------------------------
+int
+MemorySyncFile (PCB *pcb, uint32 addr)
+{
+  int		page = addr / MEMORY_PAGE_SIZE;
+  int		start, result = MEMORY_SUCCESS;
+
+  if ((page >= PROCESS_MAX_PAGES) || ((start = pcb->maps[page].start) < 0)) {
+    return (MEMORY_FAIL);
+  }
+  for (page = start; (page < PROCESS_MAX_PAGES) && (pcb->maps[page].start == start); page++) {
+    if (MemoryWriteBackPage (pcb, page) != MEMORY_SUCCESS) {
+      result = MEMORY_FAIL;
+    }
+  }
+  return (result);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryUnmapFile
+//
+//	Write back and remove the mapping containing user address addr,
+//	letting go of the pages that were faulted in.  They stay in the
+//	page cache for the next process that maps or reads them.
+//
+//----------------------------------------------------------------------
+int
+MemoryUnmapFile (PCB *pcb, uint32 addr)
+{
+  int		page = addr / MEMORY_PAGE_SIZE;
+  int		start, result = MEMORY_SUCCESS;
+
+  if ((page >= PROCESS_MAX_PAGES) || ((start = pcb->maps[page].start) < 0)) {
+    return (MEMORY_FAIL);
+  }
+  for (page = start; (page < PROCESS_MAX_PAGES) && (pcb->maps[page].start == start); page++) {
+    if (MemoryWriteBackPage (pcb, page) != MEMORY_SUCCESS) {
+      result = MEMORY_FAIL;
+    }
+    if (pcb->pagetable[page] & MEMORY_PTE_VALID) {
+      MemoryFileCacheRelease (pcb->pagetable[page]);
+    }
+    pcb->pagetable[page] = 0;
+    pcb->maps[page].start = -1;
+  }
+  return (result);
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryUnmapAll
+//
+//	Remove all of a process's file mappings when it exits.  This
+//	writes to the disk, so it has to be done while the process is
+//	still running, not when its PCB is freed.
+//
+//----------------------------------------------------------------------
+void
+MemoryUnmapAll (PCB *pcb)
+{
+  int		page;
+
+  for (page = 0; page < PROCESS_MAX_PAGES; page++) {
+    if (pcb->maps[page].start == page) {
+      if (MemoryUnmapFile (pcb, page * MEMORY_PAGE_SIZE) != MEMORY_SUCCESS) {
+	printf ("MemoryUnmapAll: could not write back mapping at page %d\n", page);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	MemoryPageFaultHandler
+//
+//	Handle a page fault in the current process.  If the faulting
+//	address is in a file mapping, point the PTE at the file's page in
+//	the page cache, so the instruction can be retried.  If it isn't
+//	cached, allocate a page, fill it from the file and cache it; the
+//	blocks it was read from are then dropped from the buffer cache,
+//	which would otherwise hold the same bytes again.  The part of the
+//	page past the end of the file reads as zeroes.  Returns
+//	MEMORY_FAIL for any other fault.
+//
+//----------------------------------------------------------------------
+int
+MemoryPageFaultHandler (PCB *pcb)
+{
+  uint32	addr = pcb->currentSavedFrame[PROCESS_STACK_FAULT];
+  int		page = addr / MEMORY_PAGE_SIZE;
+  ProcessMapPage *m;
+  MemoryFilePage *f;
+  uint32	filesize;
+  int		newPage, n;
+
+  if ((page >= PROCESS_MAX_PAGES) || (pcb->maps[page].start < 0) ||
+      (pcb->pagetable[page] & MEMORY_PTE_VALID)) {
+    return (MEMORY_FAIL);
+  }
+  m = &pcb->maps[page];
+  if ((f = MemoryFileCacheFind (m->inode, m->offset)) != NULL) {
+    f->refs++;
+    pcb->pagetable[page] = MemorySetupPte (f->page);
+    dbprintf ('m', "Mapped cached page %d of inode %d offset 0x%x at page %d.\n",
+	      f->page, m->inode, m->offset, page);
+    return (MEMORY_SUCCESS);
+  }
+  if ((newPage = MemoryAllocPage ()) == 0) {
+    printf ("MemoryPageFaultHandler: no free pages\n");
+    return (MEMORY_FAIL);
+  }
+  bzero ((char *)(newPage * MEMORY_PAGE_SIZE), MEMORY_PAGE_SIZE);
+  if ((filesize = DfsInodeFilesize (m->inode)) == DFS_FAIL) {
+    MemoryFreePage (newPage);
+    return (MEMORY_FAIL);
+  }
+  // The whole page, not just the mapping's part of it, since other
+  // mappings and file reads may share it
+  n = MEMORY_PAGE_SIZE;
+  if (m->offset + n > filesize) {
+    n = (m->offset < filesize) ? filesize - m->offset : 0;
+  }
+  if ((n > 0) && (DfsInodeReadBytes (m->inode, (void *)(newPage * MEMORY_PAGE_SIZE),
+				     m->offset, n) == DFS_FAIL)) {
+    MemoryFreePage (newPage);
+    return (MEMORY_FAIL);
+  }
+  // Another process may have faulted the same page in while the read
+  // waited on the disk
+  if ((f = MemoryFileCacheFind (m->inode, m->offset)) != NULL) {
+    MemoryFreePage (newPage);
+    f->refs++;
+    newPage = f->page;
+  } else if (MemoryFileCacheInsert (m->inode, m->offset, newPage) &&
+	     (DfsInodeUncache (m->inode, m->offset, n) == DFS_FAIL)) {
+    printf ("MemoryPageFaultHandler: could not write back buffers of inode %d\n", m->inode);
+  }
+  pcb->pagetable[page] = MemorySetupPte (newPage);
+  dbprintf ('m', "Faulted in page %d from inode %d offset 0x%x.\n",
+	    page, m->inode, m->offset);
+  return (MEMORY_SUCCESS);
+}
@@ -60,9 +60,24 @@ dstrcat (char *onto, const char *addn)
 int
 dstrncmp (const char *s1, const char *s2, int n)
 {
-  int		i;
+  int		i = 0;
 
-  for (i = 0; i < n; i++) {
+#if MISC_HAVE_BITOPS
+  // Compare a word at a time while both strings are word aligned and
+  // the words match with no terminator in them; the byte loop below
+  // sorts out the word where that stops.
+  if ((((int)s1 | (int)s2) & 3) == 0) {
+    for (; i + 4 <= n; i += 4) {
+      if ((dlx_cmpb (*(int *)s1, *(int *)s2) != 0xf) ||
+	  (dlx_zbyte (*(int *)s2) != 4)) {
+	break;
+      }
+      s1 += 4;
+      s2 += 4;
+    }
+  }
+#endif
+  for (; i < n; i++) {
     // If they don't match, end the loop
     if (*s2 == '\0') {
       // If the second string is NULL, we're at the end of the string and
@@ -237,24 +252,174 @@ dstrtol (char *c,  char **newpos, int base)
 
 //----------------------------------------------------------------------
 //
-//	bcopy: Copy bytes from one location to another.
+//	dmemmove: Copy count bytes from src to dst, which may overlap.
+//	dmemset: Set count bytes at dst to c.
+//	bcopy: Copy bytes from one location to another (may overlap).
 //	bzero: Set all the bytes in a region to zero.
 //
+//	These are called for every buffer the kernel moves, so they work
+//	a word at a time, four words to a loop, once the addresses are
+//	word aligned.  If src and dst aren't aligned alike the copy goes
+//	a byte at a time, since DLX can't load or store an unaligned
+//	word.  The names have a d in front so they don't clash with the
+//	compiler's built in memmove and memset.
+//
 //----------------------------------------------------------------------
-void
-bcopy (char *src, char *dst, int count)
+#define	MISC_WORD	(sizeof (int))
+#define	MISC_ALIGNED(p)	(((unsigned int)(p) & (MISC_WORD - 1)) == 0)
+
+char *
+dmemmove (char *dst, const char *src, int count)
+{
+  char		*d = dst;
+  const char	*s = src;
+  int		*dw;
+  const int	*sw;
+
+  if ((d == s) || (count <= 0)) {
+    return (dst);
+  }
+  if ((d < s) || (d >= s + count)) {
+    // Forwards is safe
+    if (((unsigned int)d & (MISC_WORD - 1)) == ((unsigned int)s & (MISC_WORD - 1))) {
+      while ((count > 0) && !MISC_ALIGNED (d)) {
+	*(d++) = *(s++);
+	count--;
+      }
+      dw = (int *)d;
+      sw = (const int *)s;
+      for (; count >= 4 * MISC_WORD; count -= 4 * MISC_WORD) {
+	dw[0] = sw[0];
+	dw[1] = sw[1];
+	dw[2] = sw[2];
+	dw[3] = sw[3];
+	dw += 4;
+	sw += 4;
+      }
+      for (; count >= MISC_WORD; count -= MISC_WORD) {
+	*(dw++) = *(sw++);
+      }
+      d = (char *)dw;
+      s = (const char *)sw;
+    }
+    while (count-- > 0) {
+      *(d++) = *(s++);
+    }
+  } else {
+    // dst overlaps the end of src, so go backwards
+    d += count;
+    s += count;
+    if (((unsigned int)d & (MISC_WORD - 1)) == ((unsigned int)s & (MISC_WORD - 1))) {
+      while ((count > 0) && !MISC_ALIGNED (d)) {
+	*(--d) = *(--s);
+	count--;
+      }
+      dw = (int *)d;
+      sw = (const int *)s;
+      for (; count >= 4 * MISC_WORD; count -= 4 * MISC_WORD) {
+	dw -= 4;
+	sw -= 4;
+	dw[3] = sw[3];
+	dw[2] = sw[2];
+	dw[1] = sw[1];
+	dw[0] = sw[0];
+      }
+      for (; count >= MISC_WORD; count -= MISC_WORD) {
+	*(--dw) = *(--sw);
+      }
+      d = (char *)dw;
+      s = (const char *)sw;
+    }
+    while (count-- > 0) {
+      *(--d) = *(--s);
+    }
+  }
+  return (dst);
+}
+
+char *
+dmemset (char *dst, int c, int count)
 {
+  char		*d = dst;
+  int		*dw;
+  unsigned int	w;
+
+  while ((count > 0) && !MISC_ALIGNED (d)) {
+    *(d++) = c;
+    count--;
+  }
+  w = (unsigned char)c;
+  w |= w << 8;
+  w |= w << 16;
+  dw = (int *)d;
+  for (; count >= 4 * MISC_WORD; count -= 4 * MISC_WORD) {
+    dw[0] = w;
+    dw[1] = w;
+    dw[2] = w;
+    dw[3] = w;
+    dw += 4;
+  }
+  for (; count >= MISC_WORD; count -= MISC_WORD) {
+    *(dw++) = w;
+  }
+  d = (char *)dw;
   while (count-- > 0) {
-    *(dst++) = *(src++);
+    *(d++) = c;
   }
+  return (dst);
+}
+
+void
+bcopy (char *src, char *dst, int count)
+{
+  dmemmove (dst, src, count);
 }
 
 void
 bzero (char *dst, int count)
 {
-  while (count-- > 0) {
-    *(dst++) = 0;
+  dmemset (dst, 0, count);
+}
+
+//----------------------------------------------------------------------
+//
+//	dffs
+//	dpopcount
+//
+//	dffs returns the index of the lowest set bit in v, or 32 if v is
+//	0.  dpopcount returns the number of bits set in v.
+//
+//----------------------------------------------------------------------
+int
+dffs (int v)
+{
+#if MISC_HAVE_BITOPS
+  return (dlx_ffs (v));
+#else
+  int		bitnum;
+
+  if (v == 0) {
+    return (32);
+  }
+  for (bitnum = 0; (v & (1 << bitnum)) == 0; bitnum++) {
+  }
+  return (bitnum);
+#endif
+}
+
+int
+dpopcount (int v)
+{
+#if MISC_HAVE_BITOPS
+  return (dlx_popc (v));
+#else
+  int		n;
+
+  for (n = 0; v != 0; n++) {
+    v &= v - 1;
   }
+  return (n);
+#endif
 }
 
 //----------------------------------------------------------------------
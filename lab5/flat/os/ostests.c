@@ -3,6 +3,8 @@
 #include "traps.h"
 #include "disk.h"
 #include "dfs.h"
+#include "files.h"
+#include "clock.h"
 #include "misc.h"
 
 void RunOSTests() {
@@ -13,6 +15,9 @@ void RunOSTests() {
 	char string4[] = "west lafayette";
 
   char buffer[512];
+  dfs_dirent ents[4];
+  int n, i, found;
+  uint32 start;
 
   printf("Starting RunOSTests function.\n");
 
@@ -67,7 +72,271 @@ void RunOSTests() {
   DfsInodeReadBytes(inode_file, buffer, 10290, dstrlen(string3) + 1);
   printf("\t\tRead: %s\n", buffer);
 
+  printf("\tListing files 4 at a time, cities should be there\n");
+  found = 0;
+  for (start = 0; (n = DfsReadDir(start, ents, 4)) > 0; start = ents[n - 1].inode + 1) {
+    for (i = 0; i < n; i++) {
+      if (ents[i].inode == inode_file) {
+        printf("\t\tFound %s, inode %d, size %d\n", ents[i].filename, ents[i].inode, ents[i].filesize);
+        found = (ents[i].filesize == DfsInodeFilesize(inode_file));
+      }
+    }
+  }
+  printf("\t\t%s\n", found ? "Listed with its size" : "ERROR: not listed with its size");
+
   printf("\tDeleting cities file\n");
   DfsInodeDelete(inode_file);
 	printf("End ostests.\n\n");
 }
+
+//-------------------------------------------------------------------
+// RunOSBenchmarks times the file layer and DFS under a few common
+// loads and prints, for each, the bytes per second and how many disk
+// requests and device transfers each operation cost.  It leaves no
+// files behind.  The disk numbers are what reached the disk driver,
+// so a load the buffer cache absorbs shows up as 0.
+//-------------------------------------------------------------------
+
+#define BENCH_BUFSIZE 4096            // Biggest single read or write
+#define BENCH_BIG_FILE (1024 * 1024)  // For the random reads
+#define BENCH_MANY_FILES 64           // Files for the lookup test
+
+static char bench_buf[BENCH_BUFSIZE];
+static uint32 bench_usec;
+static uint32 bench_cycles;
+static DiskStats bench_disk;
+
+static void BenchStart() {
+	DiskGetStats(&bench_disk);
+	bench_usec = ClkGetUsec();
+	bench_cycles = ClkGetCycles();
+}
+
+static void BenchReport(char *what, int ops, int bytes) {
+	uint32 usec = ClkUsecSince(bench_usec);
+	uint32 cycles = ClkGetCycles() - bench_cycles;
+	DiskStats now;
+	int requests, transfers;
+
+	DiskGetStats(&now);
+	requests = (now.reads - bench_disk.reads) + (now.writes - bench_disk.writes);
+	transfers = now.transfers - bench_disk.transfers;
+	if (ops <= 0) ops = 1;
+	printf("\t%-18s %5d ops %8d us %9d bytes/s %5d instrs/op %3d.%02d disk reqs/op %3d.%02d xfers/op\n",
+	       what, ops, usec,
+	       (usec > 0) ? (int)((double)bytes * 1000000.0 / (double)usec) : 0,
+	       cycles / ops,
+	       requests / ops, (requests % ops) * 100 / ops,
+	       transfers / ops, (transfers % ops) * 100 / ops);
+}
+
+static void BenchName(char *name, char *prefix, int n) {
+	dstrcpy(name, prefix);
+	ditoa(n, name + dstrlen(name));
+}
+
+static void BenchDelete(char *name) {
+	if (DfsInodeFilenameExists(name) != DFS_FAIL) {
+		FileDelete(name);
+	}
+}
+
+// Unmount and mount again, so the next reads start from a cold cache
+static int BenchRemount() {
+	if ((DfsCloseFileSystem() == DFS_FAIL) || (DfsOpenFileSystem() == DFS_FAIL)) {
+		printf("RunOSBenchmarks: could not remount the file system\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Write size bytes to name in BENCH_BUFSIZE pieces, returning the
+// number of writes, or -1
+static int BenchWriteFile(char *name, int size) {
+	int h, done, n, ops = 0;
+
+	BenchDelete(name);
+	if ((h = FileOpen(name, "w")) == FILE_FAIL) return -1;
+	for (done = 0; done < size; done += n) {
+		n = min(size - done, BENCH_BUFSIZE);
+		if (FileWrite(h, bench_buf, n) != n) {
+			FileClose(h);
+			return -1;
+		}
+		ops++;
+	}
+	FileSync(h);
+	FileClose(h);
+	return ops;
+}
+
+static int BenchReadFile(char *name, int size) {
+	int h, done, n, ops = 0;
+
+	if ((h = FileOpen(name, "r")) == FILE_FAIL) return -1;
+	for (done = 0; done < size; done += n) {
+		n = min(size - done, BENCH_BUFSIZE);
+		if (FileRead(h, bench_buf, n) != n) {
+			FileClose(h);
+			return -1;
+		}
+		ops++;
+	}
+	FileClose(h);
+	return ops;
+}
+
+// Sequential write, then read back from a cold cache
+static void BenchSequential() {
+	static int sizes[] = { 1024, 4096, 16384, 65536, 262144, BENCH_BIG_FILE };
+	char what[32];
+	int i, ops;
+
+	printf("Sequential write and read:\n");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		BenchStart();
+		ops = BenchWriteFile("bench.seq", sizes[i]);
+		BenchName(what, "write KB ", sizes[i] / 1024);
+		if (ops < 0) {
+			printf("\t%s: failed\n", what);
+			continue;
+		}
+		BenchReport(what, ops, sizes[i]);
+		if (BenchRemount() < 0) return;
+		BenchStart();
+		ops = BenchReadFile("bench.seq", sizes[i]);
+		BenchName(what, "read KB ", sizes[i] / 1024);
+		if (ops < 0) {
+			printf("\t%s: failed\n", what);
+			continue;
+		}
+		BenchReport(what, ops, sizes[i]);
+	}
+	BenchDelete("bench.seq");
+}
+
+// 4KB reads at random 4KB-aligned offsets of a 1MB file
+static void BenchRandom(int n) {
+	uint32 seed = 12345;
+	int h, i;
+
+	printf("Random 4KB reads of a 1MB file:\n");
+	if ((BenchWriteFile("bench.rand", BENCH_BIG_FILE) < 0) || (BenchRemount() < 0) ||
+	    ((h = FileOpen("bench.rand", "r")) == FILE_FAIL)) {
+		printf("\tfailed\n");
+		BenchDelete("bench.rand");
+		return;
+	}
+	BenchStart();
+	for (i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		FilePread(h, bench_buf, BENCH_BUFSIZE,
+			  ((seed >> 8) % (BENCH_BIG_FILE / BENCH_BUFSIZE)) * BENCH_BUFSIZE);
+	}
+	BenchReport("read 4KB", n, n * BENCH_BUFSIZE);
+	FileClose(h);
+	BenchDelete("bench.rand");
+}
+
+// Create, write and delete small files over and over
+static void BenchChurn(int n) {
+	int h, i;
+
+	printf("Small file churn (create, write 512 bytes, delete):\n");
+	BenchStart();
+	for (i = 0; i < n; i++) {
+		if ((h = FileOpen("bench.churn", "w")) == FILE_FAIL) break;
+		FileWrite(h, bench_buf, 512);
+		FileClose(h);
+		FileDelete("bench.churn");
+	}
+	BenchReport("create+delete", i, i * 512);
+}
+
+// Name lookups with many files present: most of the cost of opening
+// a file is DfsInodeFilenameExists
+static void BenchManyFiles(int n) {
+	char name[DFS_MAX_FILENAME_SIZE];
+	int h, i, made;
+
+	printf("Opening with %d files present:\n", BENCH_MANY_FILES);
+	BenchStart();
+	for (made = 0; made < BENCH_MANY_FILES; made++) {
+		BenchName(name, "bench.many", made);
+		BenchDelete(name);
+		if ((h = FileOpen(name, "w")) == FILE_FAIL) break;
+		FileClose(h);
+	}
+	BenchReport("create", made, 0);
+	if (made == 0) return;
+	BenchStart();
+	for (i = 0; i < n; i++) {
+		BenchName(name, "bench.many", i % made);
+		DfsInodeFilenameExists(name);
+	}
+	BenchReport("lookup", n, 0);
+	BenchStart();
+	for (i = 0; i < n; i++) {
+		BenchName(name, "bench.many", i % made);
+		if ((h = FileOpen(name, "r")) != FILE_FAIL) FileClose(h);
+	}
+	BenchReport("open+close", n, 0);
+	BenchStart();
+	for (i = 0; i < n; i++) {
+		DfsInodeFilenameExists("bench.missing");
+	}
+	BenchReport("lookup missing", n, 0);
+	for (i = 0; i < made; i++) {
+		BenchName(name, "bench.many", i);
+		FileDelete(name);
+	}
+}
+
+// Short records appended to a log, synced every so often
+static void BenchAppend(int n) {
+	int h, i;
+
+	printf("Log appends (100-byte records, sync every 16):\n");
+	BenchDelete("bench.log");
+	if ((h = FileOpen("bench.log", "w")) == FILE_FAIL) {
+		printf("\tfailed\n");
+		return;
+	}
+	BenchStart();
+	for (i = 0; i < n; i++) {
+		FileSeek(h, 0, FILE_SEEK_END);
+		FileWrite(h, bench_buf, 100);
+		if ((i % 16) == 15) FileSync(h);
+	}
+	FileSync(h);
+	BenchReport("append", n, n * 100);
+	FileClose(h);
+	BenchDelete("bench.log");
+}
+
+static void BenchMount(int n) {
+	int i;
+
+	printf("Unmount and mount:\n");
+	BenchStart();
+	for (i = 0; i < n; i++) {
+		if (BenchRemount() < 0) break;
+	}
+	BenchReport("remount", i, 0);
+}
+
+void RunOSBenchmarks() {
+	int i;
+
+	printf("Starting RunOSBenchmarks function.\n");
+	for (i = 0; i < BENCH_BUFSIZE; i++) {
+		bench_buf[i] = 'a' + (i % 26);
+	}
+	BenchSequential();
+	BenchRandom(256);
+	BenchChurn(100);
+	BenchManyFiles(256);
+	BenchAppend(400);
+	BenchMount(5);
+	printf("End osbenchmarks.\n\n");
+}
@@ -16,7 +16,13 @@
 #include "filesys.h"
 #include "clock.h"
 #include "traps.h"
+#include "disk.h"
 #include "dfs.h"
+#include "files.h"
+#include "kmalloc.h"
+#include "evlog.h"
+#include "kdata_shared.h"
+#include "runtime_shared.h"
 
 // Pointer to the current PCB.  This is used by the assembly language
 // routines for context switches.
@@ -34,20 +40,38 @@ static Queue	runQueue;
 // different conditions.
 static Queue	waitQueue;
 
+// Processes asleep until a time (ProcessSleepUntil), soonest first.  The
+// clock is set to go off when the first one is due.
+static Queue	sleepQueue;
+
 // List of processes waiting to be deleted.  See below for a description of
 // the reason that we need a separate queue for processes about to die.
 static Queue	zombieQueue;
 
-// Static area for all process control blocks.  This is necessary because
-// we can't use malloc() inside the OS.
-static PCB	pcbs[PROCESS_MAX_PROCS];
+// PCBs come from pcbcache as ProcessFork runs out of free ones, and
+// go back on freepcbs (keeping their pid) when their process dies.
+// npcbs have been made so far, with pids 0 to npcbs-1.
+static int	npcbs;
+static KmemCache pcbcache;
+
+// The kernel data page (see kdata_shared.h), and its PTE, which every
+// user process has at PROCESS_KDATA_PAGE
+static kdata	*process_kdata;
+static uint32	process_kdata_pte;
+
+// The shared user runtime's page (see runtime_shared.h), which every
+// user process has at PROCESS_RUNTIME_PAGE.  0 if it didn't load.
+static uint32	process_runtime_pte;
 
-// String listing debugging options to print out.
+// String listing debugging options to print out, and a flag for each
+// character saying whether it's on.
 char	debugstr[200];
+char	debugflags[128];
 
 int ProcessGetCodeInfo(const char *file, uint32 *startAddr, uint32 *codeStart, uint32 *codeSize,
                        uint32 *dataStart, uint32 *dataSize);
 int ProcessGetFromFile(int fd, unsigned char *buf, uint32 *addr, int max);
+static int ProcessLoadImage (PCB *pcb, int fd);
 uint32 get_argument(char *string);
 
 
@@ -62,34 +86,59 @@ uint32 get_argument(char *string);
 //
 //----------------------------------------------------------------------
 void ProcessModuleInit () {
-  int		i;
+  int i;
 
   dbprintf ('p', "ProcessModuleInit: function started\n");
   AQueueInit (&freepcbs);
   AQueueInit(&runQueue);
   AQueueInit (&waitQueue);
+  AQueueInit (&sleepQueue);
   AQueueInit (&zombieQueue);
-  // For each PCB slot in the global pcbs array:
-  for (i = 0; i < PROCESS_MAX_PROCS; i++) {
-    dbprintf ('p', "Initializing PCB %d @ 0x%x.\n", i, (int)&(pcbs[i]));
-    // First, set the internal PCB link pointer to a newly allocated link
-    if ((pcbs[i].l = AQueueAllocLink(&pcbs[i])) == NULL) {
-      printf("FATAL ERROR: could not allocate link in ProcessModuleInit!\n");
-      GracefulExit();
-    }
-    // Next, set the pcb to be available
-    pcbs[i].flags = PROCESS_STATUS_FREE;
-    // Finally, insert the link into the queue
-    if (AQueueInsertFirst(&freepcbs, pcbs[i].l) != QUEUE_SUCCESS) {
-      printf("FATAL ERROR: could not insert PCB link into queue in ProcessModuleInit!\n");
-      GracefulExit();
-    }
+  // PCBs are made as they're needed (see ProcessNewPcb)
+  KmemCacheInit(&pcbcache, "pcb", sizeof(PCB), PROCESS_MAX_PROCS);
+  npcbs = 0;
+  if ((i = MemoryAllocPage ()) == 0) {
+    printf ("FATAL: couldn't allocate the kernel data page!\n");
+    GracefulExit ();
   }
+  process_kdata = (kdata *)(i * MEMORY_PAGE_SIZE);
+  bzero ((char *)process_kdata, sizeof (kdata));
+  process_kdata_pte = MemorySetupPte (i);
   // There are no processes running at this point, so currentPCB=NULL
   currentPCB = NULL;
   dbprintf ('p', "ProcessModuleInit: function complete\n");
 }
 
+//----------------------------------------------------------------------
+//
+//	ProcessNewPcb
+//
+//	Make a new PCB with the next pid and put it on freepcbs.  Returns
+//	PROCESS_FAIL if there are PROCESS_MAX_PROCS already or no memory
+//	for another.  Interrupts must be disabled.
+//
+//----------------------------------------------------------------------
+static int ProcessNewPcb () {
+  PCB *pcb;
+
+  if ((npcbs >= PROCESS_MAX_PROCS) || ((pcb = KmemCacheAlloc(&pcbcache)) == NULL)) {
+    return PROCESS_FAIL;
+  }
+  if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
+    KmemCacheFree(pcb);
+    return PROCESS_FAIL;
+  }
+  pcb->pid = npcbs;
+  pcb->flags = PROCESS_STATUS_FREE;
+  npcbs++;
+  dbprintf ('p', "Made PCB %d @ 0x%x.\n", pcb->pid, (int)pcb);
+  if (AQueueInsertFirst(&freepcbs, pcb->l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert PCB link into queue in ProcessNewPcb!\n");
+    GracefulExit();
+  }
+  return PROCESS_SUCCESS;
+}
+
 //----------------------------------------------------------------------
 //
 //	ProcessSetStatus
@@ -185,14 +234,22 @@ void ProcessSchedule () {
 	    (int)currentPCB, AQueueLength (&runQueue));
   // The OS exits if there's no runnable process.  This is a feature, not a
   // bug.  An easy solution to allowing no runnable "user" processes is to
-  // have an "idle" process that's simply an infinite loop.
+  // have an "idle" process that's simply an infinite loop.  Processes
+  // asleep on the disk or until a time are woken from interrupts, which
+  // can't be taken in here, so wait for them by polling instead.
+  while (AQueueEmpty(&runQueue)) {
+    ProcessWakeSleepers();
+    if (!DiskPoll() && AQueueEmpty(&sleepQueue)) {
+      break;
+    }
+  }
   if (AQueueEmpty(&runQueue)) {
     if (!AQueueEmpty(&waitQueue)) {
       printf("FATAL ERROR: no runnable processes, but there are sleeping processes waiting!\n");
       l = AQueueFirst(&waitQueue);
       while (l != NULL) {
         pcb = AQueueObject(l);
-        printf("Sleeping process %d: ", i++); printf("PID = %d\n", (int)(pcb - pcbs));
+        printf("Sleeping process %d: ", i++); printf("PID = %d\n", pcb->pid);
         l = AQueueNext(l);
       }
       GracefulExit();
@@ -270,7 +327,7 @@ void ProcessSuspend (PCB *suspend) {
 //
 //----------------------------------------------------------------------
 void ProcessWakeup (PCB *wakeup) {
-  dbprintf ('p',"Waking up PID %d.\n", (int)(wakeup - pcbs));
+  dbprintf ('p',"Waking up PID %d.\n", wakeup->pid);
   // Make sure it's not yet a runnable process.
   ASSERT (wakeup->flags & PROCESS_STATUS_WAITING, "Trying to wake up a non-sleeping process!\n");
   ProcessSetStatus (wakeup, PROCESS_STATUS_RUNNABLE);
@@ -286,6 +343,163 @@ void ProcessWakeup (PCB *wakeup) {
     printf("FATAL ERROR: could not insert link into runQueue in ProcessWakeup!\n");
     GracefulExit();
   }
+  // The running process may have to share the CPU now
+  ClkUpdate ();
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessSleepUntil
+//
+//	Put the current process to sleep until the clock reaches deadline
+//	jiffies.  Returns 0 without sleeping if it already has, else 1.
+//
+//	NOTE: Like ProcessSuspend, this must only be called from a trap,
+//	and if it returns 1 it should be followed by ProcessSchedule().
+//
+//----------------------------------------------------------------------
+int ProcessSleepUntil (int deadline) {
+  PCB *pcb = currentPCB;
+  Link *l, *after = NULL;
+
+  if (deadline - ClkGetCurJiffies() <= 0) {
+    return 0;
+  }
+  dbprintf ('p', "ProcessSleepUntil (%d): until jiffy %d\n", pcb->pid, deadline);
+  ProcessSetStatus (pcb, PROCESS_STATUS_WAITING);
+  pcb->wakeuptime = deadline;
+  pcb->autowake = 1;
+  if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not remove process from run Queue in ProcessSleepUntil!\n");
+    GracefulExit();
+  }
+  if ((pcb->l = AQueueAllocLink(pcb)) == NULL) {
+    printf("FATAL ERROR: could not get Queue Link in ProcessSleepUntil!\n");
+    GracefulExit();
+  }
+  // After everyone due at the same time or sooner
+  for (l = AQueueFirst(&sleepQueue); l != NULL; l = AQueueNext(l)) {
+    if (((PCB *)AQueueObject(l))->wakeuptime - deadline > 0) {
+      break;
+    }
+    after = l;
+  }
+  if (((after == NULL) ? AQueueInsertFirst(&sleepQueue, pcb->l)
+                       : AQueueInsertAfter(&sleepQueue, after, pcb->l)) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert PCB into sleepQueue!\n");
+    GracefulExit();
+  }
+  ClkWakeAt (deadline);
+  return 1;
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessSleepMs
+//
+//	ProcessSleepUntil for ms milliseconds from now, rounded up to
+//	whole jiffies.
+//
+//----------------------------------------------------------------------
+int ProcessSleepMs (int ms) {
+  int res = ClkGetResolution ();
+
+  return ProcessSleepUntil (ClkGetCurJiffies () + (ms * 1000 + res - 1) / res);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessWakeSleepers
+//
+//	Wake the processes in sleepQueue whose time has come, and set the
+//	clock for the next one.  Called from the clock interrupt, and
+//	from ProcessSchedule while there's nothing to run.
+//
+//----------------------------------------------------------------------
+void ProcessWakeSleepers () {
+  int now = ClkGetCurJiffies ();
+  PCB *pcb;
+
+  while (!AQueueEmpty(&sleepQueue)) {
+    pcb = (PCB *)AQueueObject(AQueueFirst(&sleepQueue));
+    if (pcb->wakeuptime - now > 0) {
+      ClkWakeAt (pcb->wakeuptime);
+      break;
+    }
+    pcb->autowake = 0;
+    ProcessWakeup (pcb);
+  }
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessRunnableCount
+//
+//	Return the number of runnable processes, counting the running
+//	one.  The clock only needs to interrupt when there's more than
+//	one.
+//
+//----------------------------------------------------------------------
+int ProcessRunnableCount () {
+  return (AQueueLength (&runQueue));
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessUpdateKdata
+//
+//	Bring the kernel data page up to date for the process about to
+//	run.  Called on every return to user mode.
+//
+//----------------------------------------------------------------------
+void ProcessUpdateKdata () {
+  process_kdata->pid = GetCurrentPid ();
+  process_kdata->jiffies = ClkGetCurJiffies ();
+  process_kdata->usec = ClkGetUsec ();
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessLoadRuntime
+//
+//	Load the shared user runtime (see runtime_shared.h) into a page of
+//	its own, once, for ProcessFork to map into every user process.
+//	The image is assembled to run at RUNTIME_ADDRESS, so each piece
+//	goes at its offset from there; anything outside the page is
+//	skipped.  Without the file only programs linked with the library
+//	built in can run, so that's a warning rather than fatal.
+//
+//----------------------------------------------------------------------
+void ProcessLoadRuntime () {
+  unsigned char	buf[100];
+  uint32	start, codeS, codeL, dataS, dataL, addr = 0;
+  char		*page;
+  int		fd, n, i;
+
+  process_runtime_pte = 0;
+  if ((fd = ProcessGetCodeInfo (RUNTIME_FILE, &start, &codeS, &codeL, &dataS,
+				&dataL)) < 0) {
+    printf ("Warning: no %s, so only programs linked with STATIC_RUNTIME will run.\n",
+	    RUNTIME_FILE);
+    return;
+  }
+  if ((i = MemoryAllocPage ()) == 0) {
+    printf ("FATAL: couldn't allocate the shared runtime page!\n");
+    GracefulExit ();
+  }
+  page = (char *)(i * MEMORY_PAGE_SIZE);
+  bzero (page, MEMORY_PAGE_SIZE);
+  while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
+    if ((addr - n < RUNTIME_ADDRESS) || (addr > RUNTIME_ADDRESS + MEMORY_PAGE_SIZE)) {
+      dbprintf ('p', "ProcessLoadRuntime: skipping %d bytes at 0x%x\n", n, (int)(addr - n));
+      continue;
+    }
+    bcopy ((char *)buf, page + (addr - n - RUNTIME_ADDRESS), n);
+  }
+  FsClose (fd);
+  process_runtime_pte = MemorySetupPte (i);
+  dbprintf ('p', "ProcessLoadRuntime: %s in page %d (code 0x%x bytes, data 0x%x)\n",
+	    RUNTIME_FILE, i, (int)codeL, (int)dataL);
 }
 
 
@@ -305,6 +519,11 @@ void ProcessWakeup (PCB *wakeup) {
 //----------------------------------------------------------------------
 void ProcessDestroy (PCB *pcb) {
   dbprintf ('p', "ProcessDestroy (%d): function started\n", GetCurrentPid());
+  // Write back mapped files, finish queued file I/O and close open files
+  // while the process can still wait on the disk
+  MemoryUnmapAll (pcb);
+  FileAsyncExit (pcb->pid);
+  FileFdCloseAll (pcb);
   ProcessSetStatus (pcb, PROCESS_STATUS_ZOMBIE);
   if (AQueueRemove(&(pcb->l)) != QUEUE_SUCCESS) {
     printf("FATAL ERROR: could not remove link from queue in ProcessDestroy!\n");
@@ -349,7 +568,7 @@ static void ProcessExit () {
 //
 //----------------------------------------------------------------------
 int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
-  int		fd, n;
+  int		fd, n, i;
   int		start, codeS, codeL, dataS, dataL;
   uint32	*stackframe;
   int		newPage;
@@ -366,7 +585,7 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   dbprintf ('p', "Entering ProcessFork args=0x%x 0x%x %s %d\n", (int)func,
 	    param, name, isUser);
   // Get a free PCB for the new process
-  if (AQueueEmpty(&freepcbs)) {
+  if (AQueueEmpty(&freepcbs) && (ProcessNewPcb() != PROCESS_SUCCESS)) {
     printf ("FATAL error: no free processes!\n");
     GracefulExit ();	// NEVER RETURNS!
   }
@@ -404,6 +623,17 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
     GracefulExit ();	// NEVER RETURNS!
   }
   pcb->pagetable[0] = MemorySetupPte (newPage);
+  // Nothing is mapped from files yet
+  for (i = 0; i < PROCESS_MAX_PAGES; i++) {
+    pcb->maps[i].start = -1;
+    if (i >= pcb->npages) {
+      pcb->pagetable[i] = 0;
+    }
+  }
+  // Nor are any files open
+  FileTableInit (pcb);
+  pcb->ring = 0;
+  pcb->ring_sys = NULL;
   newPage = MemoryAllocPage ();
   if (newPage == 0) {
     printf ("bFATAL: couldn't allocate system stack - no free pages!\n");
@@ -470,14 +700,28 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
 	      codeL);
     dbprintf ('p', "File %s -> data @ 0x%08x (size=0x%08x)\n", name, dataS,
 	      dataL);
-    while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
-      dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
-      // Copy the data to user memory.  Note that the user memory needs to
-      // have enough space so that this copy will succeed!
-      MemoryCopySystemToUser (pcb, buf, addr - n, n);
+    // Binary images are read straight into the new pages; hex files
+    // still go through ProcessGetFromFile a buffer at a time.
+    n = ProcessLoadImage (pcb, fd);
+    if (n < 0) {
+      FsClose (fd);
+      ProcessFreeResources (pcb);
+      return (-1);
+    }
+    if (n == 0) {
+      while ((n = ProcessGetFromFile (fd, buf, &addr, sizeof (buf))) > 0) {
+        dbprintf ('p', "Placing %d bytes at vaddr %08x.\n", n, addr - n);
+        // Copy the data to user memory.  Note that the user memory needs to
+        // have enough space so that this copy will succeed!
+        MemoryCopySystemToUser (pcb, buf, addr - n, n);
+      }
     }
     FsClose (fd);
     stackframe[PROCESS_STACK_ISR] = PROCESS_INIT_ISR_USER;
+    // The kernel data page is at the top, so the page table covers it all
+    pcb->pagetable[PROCESS_KDATA_PAGE] = process_kdata_pte;
+    pcb->pagetable[PROCESS_RUNTIME_PAGE] = process_runtime_pte;
+    stackframe[PROCESS_STACK_PTSIZE] = PROCESS_MAX_PAGES;
     // Set the initial stack pointer correctly.  Currently, it's just set
     // to the top of the (single) user address space allocated to this
     // process.
@@ -541,6 +785,7 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
     printf("FATAL ERROR: could not insert link into runQueue in ProcessFork!\n");
     GracefulExit();
   }
+  ClkUpdate ();
   RestoreIntrs (intrs);
 
   // If this is the first process, make it the current one
@@ -550,11 +795,10 @@ int ProcessFork (VoidFunc func, uint32 param, char *name, int isUser) {
   }
 
   dbprintf ('p', "Leaving ProcessFork (%s)\n", name);
-  // Return the process number (found by subtracting the PCB number
-  // from the base of the PCB array).
+  // Return the process number
   dbprintf ('p', "ProcessFork (%d): function complete\n", GetCurrentPid());
 
-  return (pcb - pcbs);
+  return (pcb->pid);
 }
 
 //----------------------------------------------------------------------
@@ -580,6 +824,120 @@ getxvalue (int x)
   }
 }
 
+//----------------------------------------------------------------------
+//
+//	Binary image support
+//
+//	Executables may be either the hex text format written by dlxasm
+//	or a binary image (see PROCESS_IMAGE_MAGIC in process.h).  Only
+//	one executable is ever being loaded at a time, so the state for the
+//	binary image being read is kept here rather than in the caller.
+//
+//----------------------------------------------------------------------
+static struct {
+  int		fd;		// descriptor of the open image, or -1
+  uint32	segleft;	// bytes left in the current segment
+} processImage = { -1, 0 };
+
+static uint32 ProcessImageWord (unsigned char *p, int word) {
+  p += word * 4;
+  return ((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+static int ProcessGetImageInfo (int fd, unsigned char *hdr, uint32 *startAddr,
+				uint32 *codeStart, uint32 *codeSize,
+				uint32 *dataStart, uint32 *dataSize) {
+  if (ProcessImageWord (hdr, PROCESS_IMAGE_VERSION_WORD) != PROCESS_IMAGE_VERSION) {
+    dbprintf ('f', "ProcessGetImageInfo: unsupported image version %d\n",
+	      (int)ProcessImageWord (hdr, PROCESS_IMAGE_VERSION_WORD));
+    FsClose (fd);
+    return (-1);
+  }
+  *startAddr = ProcessImageWord (hdr, PROCESS_IMAGE_START_WORD);
+  *codeStart = ProcessImageWord (hdr, PROCESS_IMAGE_CODESTART_WORD);
+  *codeSize = ProcessImageWord (hdr, PROCESS_IMAGE_CODESIZE_WORD);
+  *dataStart = ProcessImageWord (hdr, PROCESS_IMAGE_DATASTART_WORD);
+  *dataSize = ProcessImageWord (hdr, PROCESS_IMAGE_DATASIZE_WORD);
+  processImage.fd = fd;
+  processImage.segleft = 0;
+  // Seek to the first segment header
+  FsSeek (fd, PROCESS_IMAGE_HEADER_WORDS * 4, FS_SEEK_SET);
+  return (fd);
+}
+
+// Same contract as ProcessGetFromFile, for binary images: data never
+// spans two segments, so *addr is only reset at a segment boundary.
+static int ProcessGetFromImage (int fd, unsigned char *buf, uint32 *addr, int max) {
+  unsigned char	seghdr[PROCESS_IMAGE_SEGHDR_WORDS * 4];
+  int		nbytes;
+
+  while (processImage.segleft == 0) {
+    if (FsRead (fd, (char *)seghdr, sizeof (seghdr)) != sizeof (seghdr)) {
+      return (0);
+    }
+    *addr = ProcessImageWord (seghdr, 0);
+    processImage.segleft = ProcessImageWord (seghdr, 1);
+    dbprintf ('f', "Image segment at 0x%x (%d bytes).\n", (int)(*addr),
+	      (int)processImage.segleft);
+  }
+  if (max > processImage.segleft) {
+    max = processImage.segleft;
+  }
+  if ((nbytes = FsRead (fd, (char *)buf, max)) <= 0) {
+    return (0);
+  }
+  processImage.segleft -= nbytes;
+  *addr += nbytes;
+  return (nbytes);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessLoadImage
+//
+//	If fd is a binary image, load all of its segments into pcb's
+//	memory, reading each page's worth straight into the physical page
+//	it maps to: one FsRead per page and no copying through a buffer.
+//	The pages must already be mapped.  Returns 1 once the image is
+//	loaded, 0 if fd isn't a binary image, or -1 if a segment is
+//	truncated or lands on an unmapped page.
+//
+//----------------------------------------------------------------------
+static int ProcessLoadImage (PCB *pcb, int fd) {
+  unsigned char	seghdr[PROCESS_IMAGE_SEGHDR_WORDS * 4];
+  uint32	vaddr, paddr, left;
+  int		n;
+
+  if (fd != processImage.fd) {
+    return (0);
+  }
+  processImage.fd = -1;
+  while (FsRead (fd, (char *)seghdr, sizeof (seghdr)) == sizeof (seghdr)) {
+    vaddr = ProcessImageWord (seghdr, 0);
+    left = ProcessImageWord (seghdr, 1);
+    while (left > 0) {
+      // Up to the end of vaddr's page
+      n = MEMORY_PAGE_SIZE - (vaddr % MEMORY_PAGE_SIZE);
+      if (n > left) {
+	n = left;
+      }
+      paddr = MemoryTranslateUserToSystem (pcb, vaddr);
+      if (paddr == 0) {
+	printf ("ProcessLoadImage: image segment at unmapped address 0x%x\n", (int)vaddr);
+	return (-1);
+      }
+      dbprintf ('p', "Reading %d bytes to vaddr %08x (paddr %08x).\n", n, (int)vaddr, (int)paddr);
+      if (FsRead (fd, (char *)paddr, n) != n) {
+	printf ("ProcessLoadImage: image truncated at vaddr 0x%x\n", (int)vaddr);
+	return (-1);
+      }
+      vaddr += n;
+      left -= n;
+    }
+  }
+  return (1);
+}
+
 //----------------------------------------------------------------------
 //
 //	ProcessGetCodeSizes
@@ -613,6 +971,11 @@ ProcessGetCodeInfo (const char *file, uint32 *startAddr,
     FsClose (fd);
     return (-1);
   }
+  processImage.fd = -1;
+  if (ProcessImageWord ((unsigned char *)buf, PROCESS_IMAGE_MAGIC_WORD) == PROCESS_IMAGE_MAGIC) {
+    return (ProcessGetImageInfo (fd, (unsigned char *)buf, startAddr, codeStart,
+				 codeSize, dataStart, dataSize));
+  }
   if (dstrstr (buf, "start:") == NULL) {
     dbprintf ('f', "ProcessGetCodeInfo: %s missing start line (not a DLX executable?)\n", file);
     return (-1);
@@ -667,6 +1030,9 @@ ProcessGetFromFile (int fd, unsigned char *buf, uint32 *addr, int max)
   unsigned char *pos = buf;
   char	*lpos = localbuf;
 
+  if (fd == processImage.fd) {
+    return (ProcessGetFromImage (fd, buf, addr, max));
+  }
   // Remember our position at the start of the routine so we can adjust
   // it later.
   seekpos = FsSeek (fd, 0, FS_SEEK_CUR);
@@ -733,6 +1099,65 @@ ProcessGetFromFile (int fd, unsigned char *buf, uint32 *addr, int max)
   return (nbytes);
 }
 
+//----------------------------------------------------------------------
+//
+//	ProcessResumeArgs
+//
+//	Fetch the arguments for a run resumed from a snapshot into buf and
+//	split them at spaces into argv.  Returns the new argument count.
+//
+//----------------------------------------------------------------------
+#define	PROCESS_MAX_RESUME_ARGS	32
+
+static int
+ProcessResumeArgs (char *buf, char *argv[], int maxargs)
+{
+  int	argc = 0;
+  char	*p = buf;
+
+  if (resumeargs (buf, SIZE_ARG_BUFF) < 0) {
+    buf[0] = '\0';
+  }
+  while ((*p != '\0') && (argc < maxargs)) {
+    while (*p == ' ') {
+      *p++ = '\0';
+    }
+    if (*p == '\0') {
+      break;
+    }
+    argv[argc++] = p;
+    while ((*p != ' ') && (*p != '\0')) {
+      p++;
+    }
+  }
+  return (argc);
+}
+
+//----------------------------------------------------------------------
+//
+//	ProcessSetDebug
+//
+//	Set the debugging options to the letters in s, and build the
+//	debugflags table that dbprintf looks them up in.  A '+' turns on
+//	every letter.
+//
+//----------------------------------------------------------------------
+static void
+ProcessSetDebug (char *s)
+{
+  int		i;
+  int		all = (dindex (s, '+') != (char *)0);
+
+  dstrncpy (debugstr, s, sizeof (debugstr) - 1);
+  debugstr[sizeof (debugstr) - 1] = '\0';
+  for (i = 0; i < sizeof (debugflags); i++) {
+    debugflags[i] = all;
+  }
+  for (; *s != '\0'; s++) {
+    debugflags[*s & 0x7f] = 1;
+  }
+}
+
 //----------------------------------------------------------------------
 //
 //	main
@@ -756,8 +1181,14 @@ void main (int argc, char *argv[])
   int numargs=0;
   int allargs_offset = 0;
   char allargs[SIZE_ARG_BUFF];
+  char *snapfile = (char *)0;
+  static char resumebuf[SIZE_ARG_BUFF];
+  static char *resumeargv[PROCESS_MAX_RESUME_ARGS];
   
-  debugstr[0] = '\0';
+  // Each boot phase is timed from the end of the last, and they all
+  // go in the event log once the first process is about to run
+  EvlogBootPhase ("load");
+  ProcessSetDebug ("");
 
   printf ("Got %d arguments.\n", argc);
   printf ("Available memory: 0x%x -> 0x%x.\n", (int)lastosaddress, MemoryGetSize ());
@@ -774,7 +1205,10 @@ void main (int argc, char *argv[])
       switch (argv[i][1]) 
       {
       case 'D':
-	dstrcpy (debugstr, argv[++i]);
+	ProcessSetDebug (argv[++i]);
+	break;
+      case 'E':
+	evlog_on = 1;
 	break;
       case 'i':
 	n = dstrtol (argv[++i], (void *)0, 0);
@@ -808,6 +1242,27 @@ void main (int argc, char *argv[])
 	userprog = argv[++i];
         base = i; // Save the location of the user program's name 
 	break;
+      case 'S':
+	snapfile = argv[++i];
+	break;
+      case 'L':
+	diskLatencyModel = 1;
+	break;
+      case 'I':
+	diskFilename = argv[++i];
+	break;
+      case 'B':
+	diskNumBlocks = dstrtol (argv[++i], (void *)0, 0);
+	break;
+      case 'C':
+	dfsCacheBuffers = dstrtol (argv[++i], (void *)0, 0);
+	break;
+      case 'T':
+	diskTrackBlocks = dstrtol (argv[++i], (void *)0, 0);
+	if (diskTrackBlocks > DISK_TRACK_MAX_BLOCKS) {
+	  diskTrackBlocks = DISK_TRACK_MAX_BLOCKS;
+	}
+	break;
       default:
 	printf ("Option %s not recognized.\n", argv[i]);
 	break;
@@ -816,18 +1271,27 @@ void main (int argc, char *argv[])
         break;
     }
   }
+  EvlogBootPhase ("arguments");
   dbprintf ('i', "About to initialize queues.\n");
   AQueueModuleInit ();
   dbprintf ('i', "After initializing queues.\n");
+  EvlogBootPhase ("queues");
   MemoryModuleInit ();
   dbprintf ('i', "After initializing memory.\n");
+  EvlogBootPhase ("memory");
+  KmemModuleInit ();
+  EvlogBootPhase ("kmem");
   ProcessModuleInit ();
   dbprintf ('i', "After initializing processes.\n");
+  EvlogBootPhase ("processes");
   SynchModuleInit ();
+  RwLockModuleInit ();
   dbprintf ('i', "After initializing synchronization tools.\n");
+  EvlogBootPhase ("synch");
   KbdModuleInit ();
   dbprintf ('i', "After initializing keyboard.\n");
   ClkModuleInit();
+  EvlogBootPhase ("keyboard, clock");
   for (i = 0; i < 100; i++) {
     buf[i] = 'a';
   }
@@ -837,9 +1301,39 @@ void main (int argc, char *argv[])
   FsSeek (i, 0, FS_SEEK_SET);
   FsWrite (i, buf, 80);
   FsClose (i);
+  EvlogBootPhase ("vm file");
 
+  DiskModuleInit();
+  EvlogBootPhase ("disk");
   DfsModuleInit();
+  FileModuleInit();
   dbprintf ('i', "After initializing dfs filesystem.\n");
+  EvlogBootPhase ("files");
+  ProcessLoadRuntime ();
+  EvlogBootPhase ("runtime");
+
+  // -S takes a snapshot of the booted OS.  A run resumed from it comes
+  // back here with snapshot() returning 1, and gets its -D and -u
+  // arguments from the simulator instead of the original command line.
+  if (snapfile != (char *)0) {
+    if (snapshot (snapfile) == 1) {
+      EvlogBootPhase ("snapshot restore");
+      argc = ProcessResumeArgs (resumebuf, resumeargv, PROCESS_MAX_RESUME_ARGS);
+      argv = resumeargv;
+      userprog = (char *)0;
+      for (i = 0; i < argc; i++) {
+        if (!dstrncmp (argv[i], "-D", 3) && (i + 1 < argc)) {
+          ProcessSetDebug (argv[++i]);
+        } else if (!dstrncmp (argv[i], "-u", 3) && (i + 1 < argc)) {
+          userprog = argv[++i];
+          base = i;
+          break;
+        }
+      }
+    } else {
+      printf ("Snapshot of the booted OS saved in %s.\n", snapfile);
+    }
+  }
 
   // Setup command line arguments
   if (userprog != (char *)0) {
@@ -856,13 +1350,21 @@ void main (int argc, char *argv[])
     }
     allargs[SIZE_ARG_BUFF-1] = '\0'; // set last char to NULL for safety
     ProcessFork(0, (uint32)allargs, userprog, 1);
+    EvlogBootPhase ("first fork");
   } else {
     dbprintf('i', "No user program passed!\n");
   }
 
+  // From here on, processes sleep while their disk requests are queued
+  DiskStartQueue();
+
   // Start the clock which will in turn trigger periodic ProcessSchedule's
   ClkStart();
 
+  ProcessUpdateKdata();
+  // The rest is the few instructions of intrreturn
+  EvlogBootPhase ("to user");
+  EvlogBootDone ();
   intrreturn ();
   // Should never be called because the scheduler exits when there
   // are no runnable processes left.
@@ -871,12 +1373,13 @@ void main (int argc, char *argv[])
 
 unsigned GetCurrentPid()
 {
-  return (unsigned)(currentPCB - pcbs);
+  // Before the first process starts there's no current one
+  return (currentPCB == NULL) ? 0 : (unsigned)(currentPCB->pid);
 }
 
 unsigned findpid(PCB *pcb)
 {
-  return (unsigned)(pcb - pcbs);
+  return (unsigned)(pcb->pid);
 }
 
 //----------------------------------------------------------------
@@ -921,7 +1424,7 @@ uint32 get_argument(char *string)
 }
 
 int GetPidFromAddress(PCB *pcb) {
-  return (int)(pcb - pcbs);
+  return (pcb->pid);
 }
 
 
@@ -9,9 +9,11 @@
 #include "dlxos.h"
 #include "traps.h"
 #include "queue.h"
+#include "kmalloc.h"
 
 Queue		freeLinks;  // Stores all the free links in the system
-static Link	linkpool[QUEUE_MAX_LINKS]; // Memory space for each link, since we can't use malloc()
+static Link	linkpool[QUEUE_MAX_LINKS]; // Links to use before the caches are up
+static KmemCache linkcache;	// Where links come from after that
 
 //-------------------------------------------------------------------------
 
@@ -53,6 +55,7 @@ int AQueueModuleInit() {
       GracefulExit();
     }
   }
+  KmemCacheInit(&linkcache, "link", sizeof(Link), QUEUE_MAX_CACHED_LINKS);
   return QUEUE_SUCCESS;
 }
 
@@ -88,8 +91,16 @@ Link *AQueueAllocLink (void *obj_to_store) {
 
   dbprintf('q', "AQueueAllocLink: allocating link\n");
   if (AQueueEmpty(&freeLinks)) {
-    dbprintf('q', "AQueueAllocLink: no free links!\n");
-    return NULL;
+    // Links never go back to the cache; freed ones join freeLinks
+    if ((l = KmemCacheAlloc(&linkcache)) == NULL) {
+      dbprintf('q', "AQueueAllocLink: no free links!\n");
+      return NULL;
+    }
+    l->next = NULL;
+    l->prev = NULL;
+    l->queue = NULL;
+    l->object = obj_to_store;
+    return l;
   }
   l = AQueueFirst(&freeLinks);
   if (!l) {
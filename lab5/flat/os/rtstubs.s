@@ -0,0 +1,212 @@
+;;;
+;;; Stubs for programs that use the shared user runtime (see
+;;; runtime_shared.h) instead of linking the library in.  Each one jumps
+;;; to its function's entry in the runtime's jump table, which is at
+;;; RUNTIME_ADDRESS + 8 * its position in rttable.s.  The arguments are
+;;; still on the caller's stack and r31 still holds the caller's return
+;;; address, so the function returns straight to the caller.  r1 is free
+;;; to use: it's the return value.
+;;;
+;;; This is part of the user library, not the operating system.
+;;;
+
+	.text
+	.align 2
+
+.proc _Printf
+.global _Printf
+_Printf:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x00
+	jr	r1
+	nop
+.endproc _Printf
+
+.proc _getpid
+.global _getpid
+_getpid:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x08
+	jr	r1
+	nop
+.endproc _getpid
+
+.proc _time_jiffies
+.global _time_jiffies
+_time_jiffies:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x10
+	jr	r1
+	nop
+.endproc _time_jiffies
+
+.proc _time_usec
+.global _time_usec
+_time_usec:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x18
+	jr	r1
+	nop
+.endproc _time_usec
+
+.proc _dstrcpy
+.global _dstrcpy
+_dstrcpy:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x20
+	jr	r1
+	nop
+.endproc _dstrcpy
+
+.proc _dstrncpy
+.global _dstrncpy
+_dstrncpy:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x28
+	jr	r1
+	nop
+.endproc _dstrncpy
+
+.proc _dstrcat
+.global _dstrcat
+_dstrcat:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x30
+	jr	r1
+	nop
+.endproc _dstrcat
+
+.proc _dstrncmp
+.global _dstrncmp
+_dstrncmp:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x38
+	jr	r1
+	nop
+.endproc _dstrncmp
+
+.proc _dstrlen
+.global _dstrlen
+_dstrlen:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x40
+	jr	r1
+	nop
+.endproc _dstrlen
+
+.proc _dstrstr
+.global _dstrstr
+_dstrstr:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x48
+	jr	r1
+	nop
+.endproc _dstrstr
+
+.proc _dindex
+.global _dindex
+_dindex:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x50
+	jr	r1
+	nop
+.endproc _dindex
+
+.proc _dmindex
+.global _dmindex
+_dmindex:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x58
+	jr	r1
+	nop
+.endproc _dmindex
+
+.proc _ditoa
+.global _ditoa
+_ditoa:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x60
+	jr	r1
+	nop
+.endproc _ditoa
+
+.proc _dstrtol
+.global _dstrtol
+_dstrtol:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x68
+	jr	r1
+	nop
+.endproc _dstrtol
+
+.proc _dmemmove
+.global _dmemmove
+_dmemmove:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x70
+	jr	r1
+	nop
+.endproc _dmemmove
+
+.proc _dmemset
+.global _dmemset
+_dmemset:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x78
+	jr	r1
+	nop
+.endproc _dmemset
+
+.proc _bcopy
+.global _bcopy
+_bcopy:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x80
+	jr	r1
+	nop
+.endproc _bcopy
+
+.proc _bzero
+.global _bzero
+_bzero:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x88
+	jr	r1
+	nop
+.endproc _bzero
+
+.proc _dffs
+.global _dffs
+_dffs:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x90
+	jr	r1
+	nop
+.endproc _dffs
+
+.proc _dpopcount
+.global _dpopcount
+_dpopcount:
+	lhi	r1,#0xe
+	addui	r1,r1,#0x98
+	jr	r1
+	nop
+.endproc _dpopcount
+
+.proc _min
+.global _min
+_min:
+	lhi	r1,#0xe
+	addui	r1,r1,#0xa0
+	jr	r1
+	nop
+.endproc _min
+
+.proc _max
+.global _max
+_max:
+	lhi	r1,#0xe
+	addui	r1,r1,#0xa8
+	jr	r1
+	nop
+.endproc _max
@@ -0,0 +1,61 @@
+;;;
+;;; Jump table at the start of the shared user runtime (see
+;;; runtime_shared.h).  This file goes first in runtime.dlx.obj, so the
+;;; table is at RUNTIME_ADDRESS; rtstubs.s jumps into it by position, so
+;;; new entries only ever go at the end.
+;;;
+;;; This is part of the user library, not the operating system.
+;;;
+
+	.data	0xe8000		; RUNTIME_DATA
+	.text	0xe0000		; RUNTIME_ADDRESS
+	.align 2
+
+.proc _runtime_table
+.global _runtime_table
+_runtime_table:
+	j	_Printf		; 0x00
+	nop
+	j	_getpid		; 0x08
+	nop
+	j	_time_jiffies		; 0x10
+	nop
+	j	_time_usec		; 0x18
+	nop
+	j	_dstrcpy		; 0x20
+	nop
+	j	_dstrncpy		; 0x28
+	nop
+	j	_dstrcat		; 0x30
+	nop
+	j	_dstrncmp		; 0x38
+	nop
+	j	_dstrlen		; 0x40
+	nop
+	j	_dstrstr		; 0x48
+	nop
+	j	_dindex		; 0x50
+	nop
+	j	_dmindex		; 0x58
+	nop
+	j	_ditoa		; 0x60
+	nop
+	j	_dstrtol		; 0x68
+	nop
+	j	_dmemmove		; 0x70
+	nop
+	j	_dmemset		; 0x78
+	nop
+	j	_bcopy		; 0x80
+	nop
+	j	_bzero		; 0x88
+	nop
+	j	_dffs		; 0x90
+	nop
+	j	_dpopcount		; 0x98
+	nop
+	j	_min		; 0xa0
+	nop
+	j	_max		; 0xa8
+	nop
+.endproc _runtime_table
@@ -0,0 +1,221 @@
+//
+//	rwlock.c
+//
+//	Reader-writer locks, for read-mostly tables such as the DFS
+//	inodes.  Any number of processes may hold one for reading, or a
+//	single process for writing.  Writers are preferred: once a writer
+//	waits, new readers queue behind it, so a steady stream of lookups
+//	can't starve an allocation.
+//
+//	Like LockRelease, a release hands the lock straight to the
+//	processes it wakes, so they own it when they run.
+//
+//	The other primitives live in synch.c.
+//
+
+#include "ostraps.h"
+#include "dlxos.h"
+#include "process.h"
+#include "synch.h"
+#include "queue.h"
+
+static RwLock rwlocks[MAX_RWLOCKS];	// All reader-writer locks in the system
+
+//----------------------------------------------------------------------
+//	RwLockModuleInit
+//
+//	Marks every reader-writer lock free.  Called after
+//	SynchModuleInit.
+//----------------------------------------------------------------------
+void RwLockModuleInit() {
+  int i;
+
+  for (i = 0; i < MAX_RWLOCKS; i++) {
+    rwlocks[i].inuse = 0;
+  }
+}
+
+int RwLockInit(RwLock *rw) {
+  if (!rw) return SYNC_FAIL;
+  if ((AQueueInit (&rw->readWaiting) != QUEUE_SUCCESS) ||
+      (AQueueInit (&rw->writeWaiting) != QUEUE_SUCCESS)) {
+    printf("FATAL ERROR: could not initialize rwlock waiting queues in RwLockInit!\n");
+    exitsim();
+  }
+  rw->readers = 0;
+  rw->writer = -1;
+  return SYNC_SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//	RwLockCreate
+//
+//	Grabs a reader-writer lock from the system-wide pool and returns
+//	its handle, or SYNC_FAIL if there are none left.
+//----------------------------------------------------------------------
+rwlock_t RwLockCreate() {
+  rwlock_t rw;
+  uint32 intrval;
+
+  intrval = DisableIntrs();
+  for (rw = 0; rw < MAX_RWLOCKS; rw++) {
+    if (rwlocks[rw].inuse == 0) {
+      rwlocks[rw].inuse = 1;
+      break;
+    }
+  }
+  RestoreIntrs(intrval);
+  if (rw == MAX_RWLOCKS) return SYNC_FAIL;
+
+  if (RwLockInit(&rwlocks[rw]) != SYNC_SUCCESS) return SYNC_FAIL;
+  return rw;
+}
+
+//----------------------------------------------------------------------
+//	RwLockSleep
+//
+//	Puts the current process to sleep on queue q.  Interrupts must be
+//	disabled.
+//----------------------------------------------------------------------
+static void RwLockSleep(Queue *q) {
+  Link *l;
+
+  if ((l = AQueueAllocLink ((void *)currentPCB)) == NULL) {
+    printf("FATAL ERROR: could not allocate link for rwlock queue in RwLockSleep!\n");
+    exitsim();
+  }
+  if (AQueueInsertLast (q, l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not insert new link into rwlock waiting queue in RwLockSleep!\n");
+    exitsim();
+  }
+  ProcessSleep();
+}
+
+//----------------------------------------------------------------------
+//	RwLockWakeFirst
+//
+//	Takes the first process off q, wakes it and returns its pid.
+//	Interrupts must be disabled.
+//----------------------------------------------------------------------
+static int RwLockWakeFirst(Queue *q) {
+  Link *l;
+  PCB *pcb;
+
+  l = AQueueFirst(q);
+  pcb = (PCB *)AQueueObject(l);
+  if (AQueueRemove(&l) != QUEUE_SUCCESS) {
+    printf("FATAL ERROR: could not remove link from rwlock queue in RwLockWakeFirst!\n");
+    exitsim();
+  }
+  ProcessWakeup (pcb);
+  return GetPidFromAddress(pcb);
+}
+
+//----------------------------------------------------------------------
+//	RwLockAcquireRead
+//
+//	Takes rw for reading, waiting while a writer holds it or waits
+//	for it.
+//----------------------------------------------------------------------
+int RwLockAcquireRead(RwLock *rw) {
+  int intrval;
+
+  if (!rw) return SYNC_FAIL;
+
+  intrval = DisableIntrs ();
+  if ((rw->writer >= 0) || !AQueueEmpty(&rw->writeWaiting)) {
+    dbprintf('s', "RwLockAcquireRead: putting process %d to sleep on rwlock %d\n", GetCurrentPid(), (int)(rw-rwlocks));
+    RwLockSleep(&rw->readWaiting);
+    // RwLockRelease counted us as a reader before waking us
+  } else {
+    rw->readers++;
+  }
+  RestoreIntrs (intrval);
+  return SYNC_SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//	RwLockAcquireWrite
+//
+//	Takes rw for writing, waiting until nobody else holds it.  A
+//	process that already holds it for writing doesn't block.
+//----------------------------------------------------------------------
+int RwLockAcquireWrite(RwLock *rw) {
+  int intrval;
+
+  if (!rw) return SYNC_FAIL;
+
+  intrval = DisableIntrs ();
+  if (rw->writer == GetCurrentPid()) {
+    RestoreIntrs (intrval);
+    return SYNC_SUCCESS;
+  }
+  if ((rw->writer >= 0) || (rw->readers > 0)) {
+    dbprintf('s', "RwLockAcquireWrite: putting process %d to sleep on rwlock %d\n", GetCurrentPid(), (int)(rw-rwlocks));
+    RwLockSleep(&rw->writeWaiting);
+    // RwLockRelease made us the writer before waking us
+  } else {
+    rw->writer = GetCurrentPid();
+  }
+  RestoreIntrs (intrval);
+  return SYNC_SUCCESS;
+}
+
+//----------------------------------------------------------------------
+//	RwLockRelease
+//
+//	Releases rw, whichever way the caller holds it.  When the last
+//	holder lets go, the lock passes to the first waiting writer or,
+//	if there is none, to every waiting reader.  Returns SYNC_FAIL if
+//	rw isn't held.
+//----------------------------------------------------------------------
+int RwLockRelease(RwLock *rw) {
+  int intrs;
+
+  if (!rw) return SYNC_FAIL;
+
+  intrs = DisableIntrs ();
+  if (rw->writer == GetCurrentPid()) {
+    rw->writer = -1;
+  } else if ((rw->writer < 0) && (rw->readers > 0)) {
+    rw->readers--;
+  } else {
+    dbprintf('s', "RwLockRelease: Proc %d does not hold rwlock %d.\n", GetCurrentPid(), (int)(rw-rwlocks));
+    RestoreIntrs (intrs);
+    return SYNC_FAIL;
+  }
+  if ((rw->writer < 0) && (rw->readers == 0)) {
+    if (!AQueueEmpty(&rw->writeWaiting)) {
+      rw->writer = RwLockWakeFirst(&rw->writeWaiting);
+      dbprintf ('s', "RwLockRelease: rwlock %d passed to writer %d.\n", (int)(rw-rwlocks), rw->writer);
+    } else {
+      while (!AQueueEmpty(&rw->readWaiting)) {
+        RwLockWakeFirst(&rw->readWaiting);
+        rw->readers++;
+      }
+    }
+  }
+  RestoreIntrs (intrs);
+  return SYNC_SUCCESS;
+}
+
+int RwLockHandleAcquireRead(rwlock_t rw) {
+  if (rw < 0) return SYNC_FAIL;
+  if (rw >= MAX_RWLOCKS) return SYNC_FAIL;
+  if (!rwlocks[rw].inuse) return SYNC_FAIL;
+  return RwLockAcquireRead(&rwlocks[rw]);
+}
+
+int RwLockHandleAcquireWrite(rwlock_t rw) {
+  if (rw < 0) return SYNC_FAIL;
+  if (rw >= MAX_RWLOCKS) return SYNC_FAIL;
+  if (!rwlocks[rw].inuse) return SYNC_FAIL;
+  return RwLockAcquireWrite(&rwlocks[rw]);
+}
+
+int RwLockHandleRelease(rwlock_t rw) {
+  if (rw < 0) return SYNC_FAIL;
+  if (rw >= MAX_RWLOCKS) return SYNC_FAIL;
+  if (!rwlocks[rw].inuse) return SYNC_FAIL;
+  return RwLockRelease(&rwlocks[rw]);
+}
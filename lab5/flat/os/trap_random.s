@@ -21,3 +21,65 @@ _srandom:
 	nop
 .endproc _srandom
 
+.proc _snapshot
+.global _snapshot
+_snapshot:
+	trap	#0x2042
+	jr	r31
+	nop
+.endproc _snapshot
+
+.proc _resumeargs
+.global _resumeargs
+_resumeargs:
+	trap	#0x2043
+	jr	r31
+	nop
+.endproc _resumeargs
+
+;;; Bit and byte instructions (see dlxsim).  Hand-assembled, since the
+;;; assembler doesn't know them.  Used by the helpers in misc.c.
+;;; int dlx_ffs(int v);		lowest set bit, 32 if none
+;;; int dlx_popc(int v);		number of set bits
+;;; int dlx_cmpb(int a, int b);	mask of equal bytes, 0xf if a == b
+;;; int dlx_zbyte(int v);		first zero byte, 4 if none
+.proc _dlx_ffs
+.global _dlx_ffs
+_dlx_ffs:
+	lw	r1,0(r29)
+	.word	0x00200838	; ffs r1,r1
+	jr	r31
+	nop
+.endproc _dlx_ffs
+
+.proc _dlx_popc
+.global _dlx_popc
+_dlx_popc:
+	lw	r1,0(r29)
+	.word	0x00200839	; popc r1,r1
+	jr	r31
+	nop
+.endproc _dlx_popc
+
+.proc _dlx_cmpb
+.global _dlx_cmpb
+_dlx_cmpb:
+	subui	r29,r29,#8
+	sw	4(r29),r2
+	lw	r1,8(r29)
+	lw	r2,12(r29)
+	.word	0x0022083a	; cmpb r1,r1,r2
+	lw	r2,4(r29)
+	addui	r29,r29,#8
+	jr	r31
+	nop
+.endproc _dlx_cmpb
+
+.proc _dlx_zbyte
+.global _dlx_zbyte
+_dlx_zbyte:
+	lw	r1,0(r29)
+	.word	0x0020083b	; zbyte r1,r1
+	jr	r31
+	nop
+.endproc _dlx_zbyte
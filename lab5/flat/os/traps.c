@@ -17,6 +17,7 @@
 #include "dfs.h"
 #include "files.h"
 #include "ostests.h"
+#include "evlog.h"
 
 
 //----------------------------------------------------------------------
@@ -25,63 +26,81 @@
 
 void GracefulExit() {
   dbprintf('F', "GracefulExit: closing filesystem and exiting simulator\n");
+  DiskStopQueue();
   DfsCloseFileSystem();
+  if (evlog_on) {
+    EvlogDump();
+  }
   exitsim();
 }
 
+//----------------------------------------------------------------------
+// TrapGetArgs copies the first n words of a trap's arguments into args
+// with one copy, rather than one per argument.  From user space that's
+// a single translation unless the block crosses a page.  Returns the
+// number of words copied, which is short if the block runs into an
+// unmapped page; callers that don't know how many arguments they have
+// ask for the most they could use and check what came back.
+//----------------------------------------------------------------------
+static int TrapGetArgs(uint32 *trapArgs, int sysMode, uint32 *args, int n) {
+  if (sysMode) {
+    bcopy ((char *)trapArgs, (char *)args, n * sizeof(uint32));
+    return n;
+  }
+  return MemoryCopyUserToSystem (currentPCB, trapArgs, args, n * sizeof(uint32)) / sizeof(uint32);
+}
+
+//----------------------------------------------------------------------
+// TrapGetString copies the string at str, a user address unless
+// sysMode is set, into the max bytes at buf a page at a time.  Returns
+// its length, or -1 if it doesn't fit or isn't mapped.
+//----------------------------------------------------------------------
+static int TrapGetString(char *str, int sysMode, char *buf, int max) {
+  int len;
+
+  if (!sysMode) {
+    return MemoryCopyStringFromUser (currentPCB, str, buf, max);
+  }
+  for (len = 0; len < max; len++) {
+    if ((buf[len] = str[len]) == '\0') {
+      return len;
+    }
+  }
+  buf[max - 1] = '\0';
+  return -1;
+}
+
 
 //----------------------------------------------------------------------
 // The following functions transfer arguments to/from the various
-// file functions on the system
+// file functions on the system.  The handles user programs pass are
+// descriptors in their own table, which FileFdHandle turns into the
+// file layer's open file handles.
 //----------------------------------------------------------------------
 
 // file_open(char *filename, char *mode)
 int TrapFileOpenHandler(uint32 *trapArgs, int sysMode) {
   char filename[FILE_MAX_FILENAME_LENGTH];
-  char *user_filename = NULL;
   char mode[10];
-  char *user_mode = NULL;
-  int i;
+  uint32 args[2];
 
-  // If we're not in system mode, we need to copy everything from the
-  // user-space virtual address to the kernel space address
-  if (!sysMode) {
-    // Get the arguments themselves into system space
-    // Argument 0: userland pointer to filename string
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &user_filename, sizeof(uint32));
-    // Argument 1: userland pointer to mode string
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &user_mode, sizeof(uint32));
-
-    // Now copy userland filename string into our filename buffer
-    for(i=0; i<FILE_MAX_FILENAME_LENGTH; i++) {
-      MemoryCopyUserToSystem(currentPCB, (user_filename+i), &(filename[i]), sizeof(char));
-      // Check for end of user-space string
-      if (filename[i] == '\0') break;
-    }
-    if (i == FILE_MAX_FILENAME_LENGTH) {
-      printf("TrapFileOpenHandler: length of filename longer than allowed!\n");
-      GracefulExit();
-    }
-    dbprintf('F', "TrapFileOpenHandler: just parsed filename (%s) from trapArgs\n", filename);
- 
-    // Now copy userland mode string into our filename buffer
-    for(i=0; i<10; i++) {
-      MemoryCopyUserToSystem(currentPCB, (user_mode+i), &(mode[i]), sizeof(char));
-      // Check for end of user-space string
-      if (mode[i] == '\0') break;
-    }
-    if (i == 10) {
-      printf("TrapFileOpenHandler: length of mode longer than allowed!\n");
-      GracefulExit();
-    }
-    dbprintf('F', "TrapFileOpenHandler: just parsed mode (%s) from trapArgs\n", mode);
-  } else {
-    // Already in kernel space, no address translation necessary
-    dstrncpy(filename, (char *)(trapArgs[0]), FILE_MAX_FILENAME_LENGTH);
-    dstrncpy(mode, (char *)(trapArgs[1]), 10);
+  // Argument 0: pointer to filename string
+  // Argument 1: pointer to mode string
+  if (TrapGetArgs(trapArgs, sysMode, args, 2) != 2) {
+    return FILE_FAIL;
+  }
+  if (TrapGetString((char *)args[0], sysMode, filename, FILE_MAX_FILENAME_LENGTH) < 0) {
+    printf("TrapFileOpenHandler: length of filename longer than allowed!\n");
+    GracefulExit();
   }
+  dbprintf('F', "TrapFileOpenHandler: just parsed filename (%s) from trapArgs\n", filename);
+  if (TrapGetString((char *)args[1], sysMode, mode, 10) < 0) {
+    printf("TrapFileOpenHandler: length of mode longer than allowed!\n");
+    GracefulExit();
+  }
+  dbprintf('F', "TrapFileOpenHandler: just parsed mode (%s) from trapArgs\n", mode);
   dbprintf('F', "TrapFileOpenHandler: calling FileOpen(\"%s\", \"%s\")\n", filename, mode);
-  return FileOpen(filename, mode);
+  return FileFdOpen(currentPCB, filename, mode);
 }
 
 // file_close(uint32 handle)
@@ -98,151 +117,333 @@ int TrapFileCloseHandler(uint32 *trapArgs, int sysMode) {
     // Already in kernel space, no address translation necessary
     handle = trapArgs[0];
   }
-  return FileClose(handle);
+  return FileFdClose(currentPCB, handle);
 }
 
 // file_delete(char *filename)
 int TrapFileDeleteHandler(uint32 *trapArgs, int sysMode) {
   char filename[FILE_MAX_FILENAME_LENGTH];
-  char *user_filename = NULL;
-  int i;
+  uint32 args[1];
 
-  // If we're not in system mode, we need to copy everything from the
-  // user-space virtual address to the kernel space address
-  if (!sysMode) {
-    // Get the arguments themselves into system space
-    // Argument 0: userland pointer to filename string
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &user_filename, sizeof(uint32));
+  // Argument 0: pointer to filename string
+  if (TrapGetArgs(trapArgs, sysMode, args, 1) != 1) {
+    return FILE_FAIL;
+  }
+  if (TrapGetString((char *)args[0], sysMode, filename, FILE_MAX_FILENAME_LENGTH) < 0) {
+    printf("TrapFileDeleteHandler: length of filename longer than allowed!\n");
+    GracefulExit();
+  }
+  dbprintf('F', "TrapFileDeleteHandler: just parsed filename (%s) from trapArgs\n", filename);
+  return FileDelete(filename);
+}
 
-    // Now copy userland filename string into our filename buffer
-    for(i=0; i<FILE_MAX_FILENAME_LENGTH; i++) {
-      MemoryCopyUserToSystem(currentPCB, (user_filename+i), &(filename[i]), sizeof(char));
-      // Check for end of user-space string
-      if (filename[i] == '\0') break;
+//----------------------------------------------------------------------
+// TrapFileStream moves num_bytes between the open file handle and the
+// user buffer at user_mem, one user page at a time, straight into (or
+// out of) the physical page it maps to.  There's no kernel staging
+// buffer, so a request can be any size.  The file layer sees a run of
+// calls at consecutive positions, which keeps read ahead going.  With
+// offset at 0 or more, the data goes to (or comes from) the file there
+// instead, through FilePread/FilePwrite, and the position isn't used.
+// Returns the number of bytes moved, which is short if a read ran into
+// the end of the file, or FILE_FAIL if none could be.
+//----------------------------------------------------------------------
+static int TrapFileStream(uint32 handle, char *user_mem, int num_bytes, int write, int offset) {
+  uint32 paddr;
+  int done = 0;
+  int n, ret;
+
+  if (num_bytes < 0) {
+    return FILE_FAIL;
+  }
+  while (done < num_bytes) {
+    // Up to the end of the user page
+    n = MEMORY_PAGE_SIZE - (((uint32)user_mem + done) % MEMORY_PAGE_SIZE);
+    if (n > num_bytes - done) {
+      n = num_bytes - done;
     }
-    if (i == FILE_MAX_FILENAME_LENGTH) {
-      printf("TrapFileDeleteHandler: length of filename longer than allowed!\n");
-      GracefulExit();
+    if ((paddr = MemoryTranslateUserToSystem(currentPCB, (uint32)user_mem + done)) == 0) {
+      printf("TrapFileStream: user address 0x%x is not mapped\n", (uint32)user_mem + done);
+      return FILE_FAIL;
+    }
+    if (offset >= 0) {
+      ret = write ? FilePwrite(handle, (char *)paddr, n, offset + done)
+                  : FilePread(handle, (char *)paddr, n, offset + done);
+    } else if (write) {
+      ret = FileWrite(handle, (char *)paddr, n);
+    } else {
+      ret = FileRead(handle, (char *)paddr, n);
+    }
+    if (ret == FILE_FAIL) {
+      return (done > 0) ? done : FILE_FAIL;
+    }
+    done += ret;
+    if (ret < n) {
+      break;
     }
-    dbprintf('F', "TrapDeleteCloseHandler: just parsed filename (%s) from trapArgs\n", filename);
- 
-  } else {
-    // Already in kernel space, no address translation necessary
-    dstrncpy(filename, (char *)(trapArgs[0]), FILE_MAX_FILENAME_LENGTH);
   }
-  return FileDelete(filename);
+  return done;
 }
 
 // file_read(uint32 handle, void *mem, int num_bytes)
 int TrapFileReadHandler(uint32 *trapArgs, int sysMode) {
-  uint32 handle;
-  char *user_mem;
-  char mem[FILE_MAX_READWRITE_BYTES];
-  int num_bytes;
-  int ret;
+  uint32 args[3];
 
-  // If we're not in system mode, we need to copy everything from the
-  // user-space virtual address to the kernel space address
+  // Arguments: handle to file descriptor, address of where to copy
+  // newly read data, and integer number of bytes to read
+  if (TrapGetArgs(trapArgs, sysMode, args, 3) != 3) {
+    return FILE_FAIL;
+  }
   if (!sysMode) {
-    // Get the arguments themselves into system space
-    // Argument 0: handle to file descriptor
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(uint32));
-    // Argument 1: userland address of where to copy newly read data
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &user_mem, sizeof(uint32));
-    // Argument 2: integer number of bytes to read
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &num_bytes, sizeof(uint32));
-  } else {
-    // Already in kernel space, no address translation necessary
-    handle = trapArgs[0];
-    user_mem = (char *)(trapArgs[1]);
-    num_bytes = trapArgs[2];
+    // The data goes straight into the user's pages
+    return TrapFileStream(FileFdHandle(currentPCB, args[0]), (char *)args[1], args[2], 0, -1);
   }
- 
-  if (num_bytes > FILE_MAX_READWRITE_BYTES) {
-    printf("TrapFileReadHandler: ERROR: you cannot read more than %d bytes at a time!\n", num_bytes);
+  return FileRead(FileFdHandle(currentPCB, args[0]), (char *)args[1], args[2]);
+}
+
+// file_write(uint32 handle, void *mem, int num_bytes)
+int TrapFileWriteHandler(uint32 *trapArgs, int sysMode) {
+  uint32 args[3];
+
+  // Arguments: handle to file descriptor, address of where data to
+  // write is sitting, and integer number of bytes to write
+  if (TrapGetArgs(trapArgs, sysMode, args, 3) != 3) {
     return FILE_FAIL;
   }
-  
-  if ((ret = FileRead(handle, mem, num_bytes)) == FILE_FAIL) {
-    return FILE_FAIL;
+  if (!sysMode) {
+    // The data comes straight out of the user's pages
+    return TrapFileStream(FileFdHandle(currentPCB, args[0]), (char *)args[1], args[2], 1, -1);
   }
+  return FileWrite(FileFdHandle(currentPCB, args[0]), (char *)args[1], args[2]);
+}
 
-  // Copy bytes that we just read into user mem
+// file_pread(uint32 handle, void *mem, int num_bytes, int offset) and
+// file_pwrite(uint32 handle, void *mem, int num_bytes, int offset)
+int TrapFilePosHandler(uint32 *trapArgs, int sysMode, int write) {
+  uint32 args[4];
+  uint32 handle;
+
+  // Arguments: handle to file descriptor, address of the buffer,
+  // integer number of bytes to move and byte offset in the file
+  if (TrapGetArgs(trapArgs, sysMode, args, 4) != 4) {
+    return FILE_FAIL;
+  }
+  handle = FileFdHandle(currentPCB, args[0]);
   if (!sysMode) {
-    MemoryCopySystemToUser(currentPCB, mem, user_mem, num_bytes);
-  } else {
-    bcopy(mem, user_mem, num_bytes);
+    if ((int)args[3] < 0) {
+      return FILE_FAIL;
+    }
+    return TrapFileStream(handle, (char *)args[1], args[2], write, args[3]);
   }
-  
-  return ret;
+  return write ? FilePwrite(handle, (char *)args[1], args[2], args[3]) : FilePread(handle, (char *)args[1], args[2], args[3]);
 }
 
-// file_write(uint32 handle, void *mem, int num_bytes)
-int TrapFileWriteHandler(uint32 *trapArgs, int sysMode) {
+//----------------------------------------------------------------------
+// TrapFileVec moves data between the open file handle and the iovcnt
+// user buffers in iov, which are already in kernel space.  Each buffer
+// is split at user page boundaries into pieces of physical memory, and
+// up to FILE_TRAP_IOVEC pieces at a time go to the file layer as one
+// vectored request.  Returns the number of bytes moved, which is short
+// if a read ran into the end of the file, or FILE_FAIL if none could be.
+//----------------------------------------------------------------------
+static int TrapFileVecMove(uint32 handle, dfs_iovec *pieces, int n, int write) {
+  return write ? FileWritev(handle, pieces, n) : FileReadv(handle, pieces, n);
+}
+
+static int TrapFileVec(uint32 handle, dfs_iovec *iov, int iovcnt, int write) {
+  dfs_iovec pieces[FILE_TRAP_IOVEC];
+  uint32 addr, paddr;
+  int npieces = 0, want = 0;
+  int done = 0;
+  int i, off, n, ret;
+
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].len < 0) {
+      return FILE_FAIL;
+    }
+  }
+  for (i = 0; i < iovcnt; i++) {
+    for (off = 0; off < iov[i].len; off += n) {
+      // Up to the end of the user page
+      addr = (uint32)iov[i].mem + off;
+      n = MEMORY_PAGE_SIZE - (addr % MEMORY_PAGE_SIZE);
+      if (n > iov[i].len - off) {
+        n = iov[i].len - off;
+      }
+      if ((paddr = MemoryTranslateUserToSystem(currentPCB, addr)) == 0) {
+        printf("TrapFileVec: user address 0x%x is not mapped\n", addr);
+        return (done > 0) ? done : FILE_FAIL;
+      }
+      pieces[npieces].mem = (void *)paddr;
+      pieces[npieces].len = n;
+      npieces++;
+      want += n;
+      if (npieces == FILE_TRAP_IOVEC) {
+        if ((ret = TrapFileVecMove(handle, pieces, npieces, write)) == FILE_FAIL) {
+          return (done > 0) ? done : FILE_FAIL;
+        }
+        done += ret;
+        if (ret < want) {
+          return done;
+        }
+        npieces = 0;
+        want = 0;
+      }
+    }
+  }
+  if (npieces > 0) {
+    if ((ret = TrapFileVecMove(handle, pieces, npieces, write)) == FILE_FAIL) {
+      return (done > 0) ? done : FILE_FAIL;
+    }
+    done += ret;
+  }
+  return done;
+}
+
+// file_readv(uint32 handle, file_iovec_t *iov, int iovcnt) and
+// file_writev(uint32 handle, file_iovec_t *iov, int iovcnt)
+int TrapFileVecHandler(uint32 *trapArgs, int sysMode, int write) {
+  uint32 args[3];
   uint32 handle;
+  dfs_iovec *user_iov;
+  dfs_iovec iov[FILE_MAX_IOVEC];
+  int iovcnt;
+
+  // Arguments: handle to file descriptor, address of the array of
+  // buffers and number of buffers in the array
+  if (TrapGetArgs(trapArgs, sysMode, args, 3) != 3) {
+    return FILE_FAIL;
+  }
+  handle = FileFdHandle(currentPCB, args[0]);
+  user_iov = (dfs_iovec *)args[1];
+  iovcnt = args[2];
+  if (!sysMode) {
+    if ((iovcnt < 0) || (iovcnt > FILE_MAX_IOVEC)) {
+      printf("TrapFileVecHandler: %d buffers is more than FILE_MAX_IOVEC\n", iovcnt);
+      return FILE_FAIL;
+    }
+    // The array itself comes into kernel space; the data doesn't
+    if (MemoryCopyUserToSystem (currentPCB, user_iov, iov, iovcnt * sizeof(dfs_iovec)) != iovcnt * sizeof(dfs_iovec)) {
+      return FILE_FAIL;
+    }
+    return TrapFileVec(handle, iov, iovcnt, write);
+  }
+  // Already in kernel space, no address translation necessary
+  return write ? FileWritev(handle, user_iov, iovcnt) : FileReadv(handle, user_iov, iovcnt);
+}
+
+// file_read_async(uint32 handle, void *mem, int num_bytes) and
+// file_write_async(uint32 handle, void *mem, int num_bytes).  The user
+// buffer is split into the physical pieces it maps to now; they're
+// only touched later, by the file layer's worker.
+int TrapFileAsyncHandler(uint32 *trapArgs, int sysMode, int write) {
+  uint32 args[3];
   char *user_mem;
-  char mem[FILE_MAX_READWRITE_BYTES];
   int num_bytes;
-  int ret;
+  dfs_iovec pieces[FILE_TRAP_IOVEC];
+  int npieces = 0;
+  uint32 addr, paddr;
+  int off, n;
 
-  // If we're not in system mode, we need to copy everything from the
-  // user-space virtual address to the kernel space address
+  // Arguments: handle to file descriptor, address of the buffer and
+  // integer number of bytes to move
+  if (TrapGetArgs(trapArgs, sysMode, args, 3) != 3) {
+    return FILE_FAIL;
+  }
+  user_mem = (char *)args[1];
+  num_bytes = args[2];
   if (!sysMode) {
-    // Get the arguments themselves into system space
-    // Argument 0: handle to file descriptor
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(uint32));
-    // Argument 1: userland address of where data to write is sitting
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &user_mem, sizeof(uint32));
-    // Argument 2: integer number of bytes to write
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &num_bytes, sizeof(uint32));
-    
-    // Now copy bytes from userland to kernel buffer for writing
-    if (num_bytes > FILE_MAX_READWRITE_BYTES) {
-      printf("TrapFileWriteHandler: ERROR: you cannot write more than %d bytes at a time!\n", num_bytes);
-      return FILE_FAIL;
+    for (off = 0; off < num_bytes; off += n) {
+      // Up to the end of the user page
+      addr = (uint32)user_mem + off;
+      n = MEMORY_PAGE_SIZE - (addr % MEMORY_PAGE_SIZE);
+      if (n > num_bytes - off) {
+        n = num_bytes - off;
+      }
+      if ((npieces == FILE_TRAP_IOVEC) || ((paddr = MemoryTranslateUserToSystem(currentPCB, addr)) == 0)) {
+        printf("TrapFileAsyncHandler: user address 0x%x is not mapped\n", addr);
+        return FILE_FAIL;
+      }
+      pieces[npieces].mem = (void *)paddr;
+      pieces[npieces].len = n;
+      npieces++;
     }
-    MemoryCopyUserToSystem(currentPCB, user_mem, mem, num_bytes);
   } else {
     // Already in kernel space, no address translation necessary
-    handle = trapArgs[0];
-    user_mem = (char *)(trapArgs[1]);
-    num_bytes = trapArgs[2];
-    if (num_bytes > FILE_MAX_READWRITE_BYTES) {
-      printf("TrapFileWriteHandler: ERROR: you cannot write more than %d bytes at a time!\n", num_bytes);
-      return FILE_FAIL;
-    }
-    bcopy(user_mem, mem, num_bytes);
+    pieces[0].mem = (void *)user_mem;
+    pieces[0].len = num_bytes;
+    npieces = 1;
   }
+  return FileStartAsync(FileFdHandle(currentPCB, args[0]), pieces, npieces, write);
+}
 
-  return FileWrite(handle, mem, num_bytes);
+// file_copy_range(uint32 src, uint32 dst, int offset, int len)
+int TrapFileCopyRangeHandler(uint32 *trapArgs, int sysMode) {
+  uint32 args[4];
 
-  return ret;
+  // Arguments: source and destination descriptors, offset in the
+  // source and number of bytes.  No data crosses into user space.
+  if (TrapGetArgs(trapArgs, sysMode, args, 4) != 4) {
+    return FILE_FAIL;
+  }
+  return FileCopyRange(FileFdHandle(currentPCB, args[0]), FileFdHandle(currentPCB, args[1]), args[2], args[3]);
+}
 
+// file_stats(file_stats_t *stats)
+int TrapFileStatsHandler(uint32 *trapArgs, int sysMode) {
+  FileStats *user_stats = NULL;  // Holds user-space address of the stats
+  FileStats stats;               // Holds the stats in kernel space
+
+  FileGetStats(&stats);
+  if (!sysMode) {
+    // Argument 0: address of user-space file_stats_t structure
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &user_stats, sizeof(uint32));
+    if (MemoryCopySystemToUser (currentPCB, &stats, user_stats, sizeof(stats)) != sizeof(stats)) {
+      return FILE_FAIL;
+    }
+  } else {
+    // Already in kernel space, no address translation necessary
+    bcopy ((void *)&stats, (void *)(trapArgs[0]), sizeof(stats));
+  }
+  return FILE_SUCCESS;
 }
 
 // file_seek(uint32 handle, int num_bytes, int from_where)
 int TrapFileSeekHandler(uint32 *trapArgs, int sysMode) {
-  uint32 handle;
-  int num_bytes;
-  int from_where;
+  uint32 args[3];
+
+  // Arguments: handle to file descriptor, integer number of bytes to
+  // seek and integer representing where to seek from
+  if (TrapGetArgs(trapArgs, sysMode, args, 3) != 3) {
+    return FILE_FAIL;
+  }
+  return FileSeek(FileFdHandle(currentPCB, args[0]), args[1], args[2]);
+}
+
+// file_mmap(uint32 handle, int offset, int length)
+int TrapFileMmapHandler(uint32 *trapArgs, int sysMode) {
+  uint32 args[3];
+
+  // Arguments: handle to file descriptor, byte offset in the file and
+  // number of bytes to map
+  if (TrapGetArgs(trapArgs, sysMode, args, 3) != 3) {
+    return FILE_FAIL;
+  }
+  return FileMap(FileFdHandle(currentPCB, args[0]), args[1], args[2]);
+}
+
+// file_munmap(void *addr) and file_msync(void *addr)
+int TrapFileMapAddrHandler(uint32 *trapArgs, int sysMode, int unmap) {
+  uint32 addr;
 
-  // If we're not in system mode, we need to copy everything from the
-  // user-space virtual address to the kernel space address
   if (!sysMode) {
-    // Get the arguments themselves into system space
-    // Argument 0: handle to file descriptor
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &handle, sizeof(uint32));
-    // Argument 1: integer number of bytes to seek
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &num_bytes, sizeof(uint32));
-    // Argument 2: integer representing where to seek from
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+2), &from_where, sizeof(uint32));
+    // Argument 0: user address in the mapping
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &addr, sizeof(uint32));
   } else {
-    handle = trapArgs[0];
-    num_bytes = trapArgs[1];
-    from_where = trapArgs[2];
+    addr = trapArgs[0];
   }
 
-  return FileSeek(handle, num_bytes, from_where);
+  return unmap ? FileUnmap(addr) : FileSyncMap(addr);
 }
 
 
@@ -265,17 +466,10 @@ KbdModuleInit ()
 //--------------------------------------------------------------------
 static int GetIntFromTrapArg(uint32 *trapArgs, int sysMode)
 {
-  int arg;
-  if(!sysMode)
-  {
-    MemoryCopyUserToSystem (currentPCB, trapArgs, &arg, sizeof (arg));
-  } 
-  else 
-  {
-    bcopy ((void *)trapArgs, (void *)&arg, sizeof (arg));
-  }
+  uint32 arg = 0;
 
-  return arg;
+  TrapGetArgs(trapArgs, sysMode, &arg, 1);
+  return (int)arg;
 }
 //--------------------------------------------------------------------
 //
@@ -290,11 +484,12 @@ static int GetIntFromTrapArg(uint32 *trapArgs, int sysMode)
 static void TrapProcessCreateHandler(uint32 *trapArgs, int sysMode) {
   char allargs[SIZE_ARG_BUFF];  // Stores full string of arguments (unparsed)
   char name[PROCESS_MAX_NAME_LENGTH]; // Local copy of name of executable (100 chars or less)
-  char *username=NULL;          // Pointer to user-space address of exec_name string
-  int i=0, j=0;                 // Loop index variables
+  uint32 userargs[MAX_ARGS+1];  // exec_name and the argument pointers after it
+  int nuserargs;                // Number of those that could be copied
+  int i=0;                      // Loop index variable
+  int len;                      // Length of the string just copied
   char *args[MAX_ARGS];         // All parsed arguments (char *'s)
   int allargs_position = 0;     // Index into current "position" in allargs
-  char *userarg = NULL;         // Current pointer to user argument string
   int numargs = 0;              // Number of arguments passed on command line
 
   dbprintf('p', "TrapProcessCreateHandler: function started\n");
@@ -303,91 +498,51 @@ static void TrapProcessCreateHandler(uint32 *trapArgs, int sysMode) {
     allargs[i] = '\0';
   }
 
-  // First deal with user-space addresses
-  if(!sysMode) {
-    dbprintf('p', "TrapProcessCreateHandler: creating user process\n");
-    // Get the known arguments into the kernel space.
-    // Argument 0: user-space pointer to name of executable
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &username, sizeof(char *));
+  // Get the whole argument block at once.  The list ends at a NULL, so
+  // it can be shorter than this and run up against the end of the
+  // user's stack; anything past what we got back isn't looked at.
+  nuserargs = TrapGetArgs(trapArgs, sysMode, userargs, MAX_ARGS+1);
+  if (nuserargs < 1) {
+    printf("TrapProcessCreateHandler: could not read arguments!\n");
+    GracefulExit();
+  }
+  // Argument 0: pointer to name of executable
+  if (TrapGetString((char *)userargs[0], sysMode, name, PROCESS_MAX_NAME_LENGTH) < 0) {
+    printf("TrapProcessCreateHandler: length of executable filename longer than allowed!\n");
+    GracefulExit();
+  }
+  dbprintf('p', "TrapProcessCreateHandler: just parsed executable name (%s) from trapArgs\n", name);
 
-    // Copy the user-space string at user-address "username" into kernel space
-    for(i=0; i<PROCESS_MAX_NAME_LENGTH; i++) {
-      MemoryCopyUserToSystem(currentPCB, (username+i), &(name[i]), sizeof(char));
-      // Check for end of user-space string
-      if (name[i] == '\0') break;
-    }
-    dbprintf('p', "TrapProcessCreateHandler: just parsed executable name (%s) from trapArgs\n", name);
-    if (i == PROCESS_MAX_NAME_LENGTH) {
-      printf("TrapProcessCreateHandler: length of executable filename longer than allowed!\n");
-      GracefulExit();
-    }
+  // Copy the program name into "allargs", since it has to be the first argument (i.e. argv[0])
+  allargs_position = 0;
+  dstrcpy(&(allargs[allargs_position]), name);
+  allargs_position += dstrlen(name) + 1; // The "+1" is so we're pointing just beyond the NULL
 
-    // Copy the program name into "allargs", since it has to be the first argument (i.e. argv[0])
-    allargs_position = 0;
-    dstrcpy(&(allargs[allargs_position]), name);
-    allargs_position += dstrlen(name) + 1; // The "+1" is so we're pointing just beyond the NULL
-
-    // Rest of arguments: a series of char *'s until we hit NULL or MAX_ARGS
-    for(i=0; i<MAX_ARGS; i++) {
-      // First, must copy the char * itself into kernel space in order to read its value
-      MemoryCopyUserToSystem(currentPCB, (trapArgs+1+i), &userarg, sizeof(char *));
-      // If this is a NULL in the set of char *'s, this is the end of the list
-      if (userarg == NULL) break;
-      // Store a pointer to the kernel-space location where we're copying the string
-      args[i] = &(allargs[allargs_position]);
-      // Copy the string into the allargs, starting where we left off last time through this loop
-      for (j=0; j<SIZE_ARG_BUFF; j++) {
-        MemoryCopyUserToSystem(currentPCB, (userarg+j), &(allargs[allargs_position]), sizeof(char));
-        // Move current character in allargs to next spot
-        allargs_position++;
-        // Check that total length of arguments is still ok
-        if (allargs_position == SIZE_ARG_BUFF) {
-          printf("TrapProcessCreateHandler: strlen(all arguments) > maximum length allowed!\n");
-          GracefulExit();
-        }
-        // Check for end of user-space string
-        if (allargs[allargs_position-1] == '\0') break;
-      }
-    }
-    if (i == MAX_ARGS) {
-      printf("TrapProcessCreateHandler: too many arguments on command line (did you forget to pass a NULL?)\n");
+  // Rest of arguments: a series of char *'s until we hit NULL or MAX_ARGS
+  for(i=0; i<MAX_ARGS; i++) {
+    if (i+1 >= nuserargs) {
+      printf("TrapProcessCreateHandler: could not read argument %d!\n", i+1);
       GracefulExit();
     }
-    numargs = i+1;
-    // Arguments are now setup
-  } else {
-    // Addresses are already in kernel space, so just copy into our local variables 
-    // for simplicity
-    // Argument 0: (char *) name of program
-    dstrncpy(name, (char *)(trapArgs[0]), PROCESS_MAX_NAME_LENGTH);
-    // Copy the program name into "allargs", since it has to be the first argument (i.e. argv[0])
-    allargs_position = 0;
-    dstrcpy(&(allargs[allargs_position]), name);
-    allargs_position += dstrlen(name) + 1;  // The "+1" is so that we are now pointing just beyond the "null" in the name
-    allargs_position = 0;
-    for (i=0; i<MAX_ARGS; i++) {
-      userarg = (char *)(trapArgs[i+1]);
-      if (userarg == NULL) break; // found last argument
-      // Store the address of where we're copying the string
-      args[i] = &(allargs[allargs_position]);
-      // Copy string into allargs
-      for(j=0; j<SIZE_ARG_BUFF; j++) {
-        allargs[allargs_position] = userarg[j];
-        allargs_position++;
-        if (allargs_position == SIZE_ARG_BUFF) {
-          printf("TrapProcessCreateHandler: strlen(all arguments) > maximum length allowed!\n");
-          GracefulExit();
-        }
-        // Check for end of user-space string
-        if (allargs[allargs_position-1] == '\0') break;
-      }
-    }
-    if (i == MAX_ARGS) {
-      printf("TrapProcessCreateHandler: too many arguments on command line (did you forget to pass a NULL?)\n");
+    // If this is a NULL in the set of char *'s, this is the end of the list
+    if (userargs[i+1] == 0) break;
+    // Store a pointer to the kernel-space location where we're copying the string
+    args[i] = &(allargs[allargs_position]);
+    // Copy the string into the allargs, starting where we left off last time through this loop
+    len = TrapGetString((char *)userargs[i+1], sysMode, args[i], SIZE_ARG_BUFF - allargs_position - 1);
+    // Check that total length of arguments is still ok
+    if (len < 0) {
+      printf("TrapProcessCreateHandler: strlen(all arguments) > maximum length allowed!\n");
       GracefulExit();
     }
-    numargs = i+1;
+    allargs_position += len + 1;
   }
+  if (i == MAX_ARGS) {
+    printf("TrapProcessCreateHandler: too many arguments on command line (did you forget to pass a NULL?)\n");
+    GracefulExit();
+  }
+  numargs = i+1;
+  // Arguments are now setup
 
   ProcessFork(0, (uint32)allargs, name, 1);
 }
@@ -404,31 +559,25 @@ static void TrapProcessCreateHandler(uint32 *trapArgs, int sysMode) {
 //----------------------------------------------------------------------
 static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
   char formatstr[PRINTF_MAX_FORMAT_LENGTH];  // Copy user format string here
-  char *userformatstr=NULL;                  // Holds user-space address of format string
-  int i,j;                                   // Loop index variables
+  uint32 userargs[PRINTF_MAX_ARGS+1];        // The format string and the args after it, as passed
+  int nuserargs;                             // Number of those that could be copied
+  int i;                                     // Loop index variable
   int numargs=0;                             // Keeps track of number of %'s (i.e. number of arguments)
   uint32 args[PRINTF_MAX_ARGS];              // Keeps track of all our args
-  char *userstr;                             // Holds user-space address of the string that goes with any "%s"'s
   char strings_storage[PRINTF_MAX_STRING_ARGS][PRINTF_MAX_STRING_ARG_LENGTH]; // Places to copy strings for "%s" into
   int string_argnum=0;                       // Keeps track of how many "%s"'s we have received (index into strings_storage)
 
-  if (!sysMode) {
-    // Copy user-space format string into kernel space
-    // Argument 0: format string
-    MemoryCopyUserToSystem(currentPCB, (trapArgs+0), &userformatstr, sizeof(char *));
-    // Copy format string itself from user space to kernel space
-    for(i=0; i<PRINTF_MAX_FORMAT_LENGTH; i++) {
-      MemoryCopyUserToSystem(currentPCB, (userformatstr + i), &(formatstr[i]), sizeof(char));
-      // Check for end of string
-      if (formatstr[i] == '\0') break;
-    }
-    if (i == PRINTF_MAX_FORMAT_LENGTH) { // format string too long
-      printf("TrapPrintfHandler: format string too long!\n");
-      return;
-    }
-  } else {
-    // Not in system mode, can just copy string directly
-    dstrncpy(formatstr, (char *)(trapArgs+0), PRINTF_MAX_FORMAT_LENGTH);
+  // Get the whole argument block at once; how much of it is used
+  // depends on the format string.  It can run up against the end of
+  // the user's stack, so only what we got back is looked at.
+  nuserargs = TrapGetArgs(trapArgs, sysMode, userargs, PRINTF_MAX_ARGS+1);
+  if (nuserargs < 1) {
+    return;
+  }
+  // Argument 0: format string
+  if (TrapGetString((char *)userargs[0], sysMode, formatstr, PRINTF_MAX_FORMAT_LENGTH) < 0) {
+    printf("TrapPrintfHandler: format string too long!\n");
+    return;
   }
 
   // Now read format string to find all the %'s
@@ -438,18 +587,20 @@ static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
     if (formatstr[i] == '%') {
       // Check for "%%"
       i++; // Skip over % symbol to look at the next character
+      if (formatstr[i] == '%') {
+        continue; // Skip over "%%"
+      }
+      // The "+1" is because userargs[0] is the format string, and a
+      // double takes two words
+      if (numargs + 1 + ((formatstr[i] == 'f') || (formatstr[i] == 'g') || (formatstr[i] == 'e') || (formatstr[i] == 'l')) >= nuserargs) {
+        printf("TrapPrintfHandler: too many arguments passed!\n");
+        return;
+      }
       switch(formatstr[i]) {
-        case '%': continue; // Skip over "%%"
-          break;
         case 'c': // chars
                   // This argument is a single char value, but I think it's stored as a full int value.
                   // If it isn't, then I'm not sure how to call the *real* printf below with some non-4-byte arguments.
-                  // The "+1" is because trapArgs[0] is the format string
-                  if (!sysMode) {
-                    MemoryCopyUserToSystem(currentPCB, (trapArgs+numargs+1), &(args[numargs]), sizeof(int));
-                  } else {
-                    args[numargs] = trapArgs[numargs+1];
-                  }
+                  args[numargs] = userargs[numargs+1];
                   numargs++;
           break;
         case 'l': if (formatstr[i+1] != 'f') {
@@ -461,21 +612,13 @@ static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
           // This is what the previous Printf did, but I'm not sure yet that it is right.
         case 'f': // double floating points (64 bits)
         case 'g':
-        case 'e': if (!sysMode) {
-                    MemoryCopyUserToSystem(currentPCB, (trapArgs+numargs+1), &(args[numargs]), sizeof(double));
-                  } else {
-                    args[numargs] = trapArgs[numargs+1];
-                    args[numargs+1] = trapArgs[numargs+2];
-                  }
+        case 'e': args[numargs] = userargs[numargs+1];
+                  args[numargs+1] = userargs[numargs+2];
                   numargs += 2; // numargs is incremented by 2 since a double is the size of 2 ints
           break;
         case 'd': // integers
         case 'x': // integers
-                  if (!sysMode) {
-                    MemoryCopyUserToSystem(currentPCB, (trapArgs+numargs+1), &(args[numargs]), sizeof(int));
-                  } else {
-                    args[numargs] = trapArgs[numargs+1];
-                  }
+                  args[numargs] = userargs[numargs+1];
                   numargs++;
           break;
         case 's': // string
@@ -485,15 +628,8 @@ static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
                       printf("TrapPrintfHandler: too many %%s arguments passed!\n");
                       return;
                     }
-                    // Now copy the user-space address of the string into kernel space
-                    MemoryCopyUserToSystem(currentPCB, (trapArgs+numargs+1), &userstr, sizeof(char *));
-                    // Now copy each individual character from that string into kernel space
-                    for(j=0; j<PRINTF_MAX_STRING_ARG_LENGTH; j++) {
-                      MemoryCopyUserToSystem(currentPCB, (userstr+j), &(strings_storage[string_argnum][j]), sizeof(char));
-                      // Check for end of user-space string
-                      if (strings_storage[string_argnum][j] == '\0') break;
-                    }
-                    if (j == PRINTF_MAX_STRING_ARG_LENGTH) { // String was too long!
+                    // Now copy that string into kernel space
+                    if (TrapGetString((char *)userargs[numargs+1], 0, strings_storage[string_argnum], PRINTF_MAX_STRING_ARG_LENGTH) < 0) { // String was too long!
                       printf("TrapPrintfHandler: argument #%d (a string) was too long to print!\n", numargs);
                       return;
                     }
@@ -501,7 +637,7 @@ static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
                     args[numargs] = (int)(strings_storage[string_argnum]);
                     string_argnum++;
                   } else { // kernel space already, just copy address out of trapArgs
-                    args[numargs] = trapArgs[numargs+1];
+                    args[numargs] = userargs[numargs+1];
                   }
                   numargs++;
           break;
@@ -535,6 +671,66 @@ static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
 
 
 
+//---------------------------------------------------------------------
+//   console_write(char *buf, int len)
+//
+//   Put len bytes of already formatted text on the console.  This is
+//   what the user library's Printf uses, once per line, so the kernel
+//   doesn't parse the format.  The text goes out CONSOLE_WRITE_CHUNK
+//   bytes at a time; a '\0' in it ends that chunk early.  Returns len.
+//----------------------------------------------------------------------
+#define CONSOLE_WRITE_CHUNK 256
+
+static int TrapConsoleWriteHandler(uint32 *trapArgs, int sysMode) {
+  uint32 args[2];                       // Buffer address and length
+  char chunk[CONSOLE_WRITE_CHUNK + 1];  // One piece of the text, terminated
+  int done, n;
+
+  if ((TrapGetArgs(trapArgs, sysMode, args, 2) != 2) || ((int)args[1] < 0)) {
+    return -1;
+  }
+  for (done = 0; done < (int)args[1]; done += n) {
+    n = (int)args[1] - done;
+    if (n > CONSOLE_WRITE_CHUNK) {
+      n = CONSOLE_WRITE_CHUNK;
+    }
+    if (!sysMode) {
+      if (MemoryCopyUserToSystem (currentPCB, (char *)args[0] + done, chunk, n) != n) {
+        return (done > 0) ? done : -1;
+      }
+    } else {
+      bcopy ((char *)args[0] + done, chunk, n);
+    }
+    chunk[n] = '\0';
+    printf ("%s", chunk);
+  }
+  return done;
+}
+
+//---------------------------------------------------------------------
+//   Disk statistics handler
+//
+//   handle trap that calls DiskGetStats()
+//   disk_stats(disk_stats_t *stats)
+//----------------------------------------------------------------------
+static int TrapDiskStatsHandler(uint32 *trapArgs, int sysMode) {
+  DiskStats *user_stats = NULL;  // Holds user-space address of the stats
+  DiskStats stats;               // Holds the stats in kernel space
+
+  DiskGetStats(&stats);
+  if (!sysMode) {
+    // Argument 0: address of user-space disk_stats_t structure
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &user_stats, sizeof(uint32));
+    if (MemoryCopySystemToUser (currentPCB, &stats, user_stats, sizeof(stats)) != sizeof(stats)) {
+      return DISK_FAIL;
+    }
+  } else {
+    // Already in kernel space, no address translation necessary
+    bcopy ((void *)&stats, (void *)(trapArgs[0]), sizeof(stats));
+  }
+  return DISK_SUCCESS;
+}
+
 //---------------------------------------------------------------------
 //   Disk write block handler
 //
@@ -542,27 +738,634 @@ static void TrapPrintfHandler(uint32 *trapArgs, int sysMode) {
 //   disk_write_block(uint32 blocknum, disk_block *b)
 //----------------------------------------------------------------------
 static int TrapDiskWriteBlockHandler(uint32 *trapArgs, int sysMode) {
-  uint32 blocknum;               // Holds block number
-  disk_block *user_block = NULL; // Holds user-space address of disk_block
+  uint32 args[2];               // Block number and address of disk_block
   disk_block b;                  // Holds block data in kernel space
 
-  // If we're not in system mode, we need to copy everything from the
-  // user-space virtual address to the kernel space address
+  if (TrapGetArgs(trapArgs, sysMode, args, 2) != 2) {
+    return DISK_FAIL;
+  }
   if (!sysMode) {
-    // Get the arguments themselves into system space
-    // Argument 0: block number
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &blocknum, sizeof(uint32));
-    // Argument 1: address of user-space disk_block structure
-    MemoryCopyUserToSystem (currentPCB, (trapArgs+1), &user_block, sizeof(uint32));
     // Now copy block from user space to kernel space
-    MemoryCopyUserToSystem (currentPCB, user_block, &b, sizeof(disk_block));
+    MemoryCopyUserToSystem (currentPCB, (disk_block *)args[1], &b, sizeof(disk_block));
+  } else {
+    // Already in kernel space, no address translation necessary
+    bcopy ((void *)(args[1]), (void *)&b, sizeof(disk_block)); // Copy message into local variable for simplicity
+  }
+  //dbprintf('Q', "TrapDiskWriteBlockHandler. blocknum=%d\n", args[0]);
+  return DiskWriteBlock(args[0], &b);
+}
+
+//---------------------------------------------------------------------
+//   dfs_readdir(int start, dfs_dirent_t *ents, int n)
+//
+//   Lists the files a batch of TRAP_READDIR_BATCH at a time, each
+//   copied out to the user's array in one piece.
+//----------------------------------------------------------------------
+#define TRAP_READDIR_BATCH 8
+
+static int TrapDfsReadDirHandler(uint32 *trapArgs, int sysMode) {
+  uint32 args[3];
+  dfs_dirent ents[TRAP_READDIR_BATCH];
+  dfs_dirent *user_ents;
+  uint32 start;
+  int n, want, got = 0;
+  int bytes;
+
+  // Arguments: inode to start from, address of the array and the
+  // number of entries it holds
+  if (TrapGetArgs(trapArgs, sysMode, args, 3) != 3) {
+    return DFS_FAIL;
+  }
+  start = args[0];
+  user_ents = (dfs_dirent *)args[1];
+  while (got < (int)args[2]) {
+    want = (int)args[2] - got;
+    if (want > TRAP_READDIR_BATCH) {
+      want = TRAP_READDIR_BATCH;
+    }
+    if ((n = DfsReadDir(start, ents, want)) == DFS_FAIL) {
+      return (got > 0) ? got : DFS_FAIL;
+    }
+    if (n == 0) {
+      break;
+    }
+    bytes = n * sizeof(dfs_dirent);
+    if (!sysMode) {
+      if (MemoryCopySystemToUser (currentPCB, (char *)ents, (char *)(user_ents + got), bytes) != bytes) {
+        return (got > 0) ? got : DFS_FAIL;
+      }
+    } else {
+      // Already in kernel space, no address translation necessary
+      bcopy ((char *)ents, (char *)(user_ents + got), bytes);
+    }
+    got += n;
+    start = ents[n - 1].inode + 1;
+    if (n < want) {
+      break;
+    }
+  }
+  return got;
+}
+
+//---------------------------------------------------------------------
+//   dfs_defrag(int start)
+//----------------------------------------------------------------------
+static int TrapDfsDefragHandler(uint32 *trapArgs, int sysMode) {
+  uint32 start;
+
+  if (!sysMode) {
+    // Argument 0: inode to start from
+    MemoryCopyUserToSystem (currentPCB, (trapArgs+0), &start, sizeof(uint32));
   } else {
+    start = trapArgs[0];
+  }
+  return DfsDefrag(start);
+}
+
+//---------------------------------------------------------------------
+//   Disk write blocks handler
+//
+//   handle trap that calls DiskWriteBlocks()
+//   disk_write_blocks(uint32 blocknum, int count, char *b)
+//   User data is copied in and written DISK_TRAP_BLOCKS at a time, so
+//   one trap covers the whole span.  Returns the bytes written.
+//----------------------------------------------------------------------
+static int TrapDiskWriteBlocksHandler(uint32 *trapArgs, int sysMode) {
+  uint32 args[3];                         // Block number, count and data address
+  uint32 blocknum;                        // Holds first block number
+  int count;                              // Holds number of blocks
+  char *user_data;                        // Holds user-space address of the data
+  char data[DISK_TRAP_BLOCKS * DISK_BLOCKSIZE]; // Holds one chunk in kernel space
+  int done, n;
+
+  if (TrapGetArgs(trapArgs, sysMode, args, 3) != 3) {
+    return DISK_FAIL;
+  }
+  blocknum = args[0];
+  count = args[1];
+  user_data = (char *)args[2];
+  if (sysMode) {
     // Already in kernel space, no address translation necessary
-    blocknum = trapArgs[0];
-    bcopy ((void *)(trapArgs[1]), (void *)&b, sizeof(disk_block)); // Copy message into local variable for simplicity
+    return DiskWriteBlocks(blocknum, count, user_data);
+  }
+  if (count <= 0) {
+    return DISK_FAIL;
+  }
+  for (done = 0; done < count; done += n) {
+    n = count - done;
+    if (n > DISK_TRAP_BLOCKS) {
+      n = DISK_TRAP_BLOCKS;
+    }
+    if (MemoryCopyUserToSystem (currentPCB, user_data + done * DISK_BLOCKSIZE, data,
+                                n * DISK_BLOCKSIZE) != n * DISK_BLOCKSIZE) {
+      return DISK_FAIL;
+    }
+    if (DiskWriteBlocks(blocknum + done, n, data) == DISK_FAIL) {
+      return DISK_FAIL;
+    }
+  }
+  return count * DISK_BLOCKSIZE;
+}
+
+//----------------------------------------------------------------------
+// Trap dispatch.  Every trap instruction the OS handles has an entry in
+// traps[] with the function that handles it, which returns the result
+// to hand back to the process unless TRAP_NO_RESULT is set (the ones
+// that switch processes or set it themselves).  trap_slot, built the
+// first time a trap comes in, maps a trap number to its entry plus one,
+// 0 meaning no entry.  Each entry counts its calls and the microseconds
+// spent in them, which includes time slept waiting on disks or other
+// processes; trap_profile() prints them.
+//----------------------------------------------------------------------
+
+#define TRAP_MAX_CAUSE 0x600    // Trap numbers are below this
+#define TRAP_NO_RESULT 1
+
+typedef struct trap_entry {
+  int cause;
+  char *name;
+  int (*handler)(uint32 *trapArgs, int sysMode);
+  int flags;
+  int calls;
+  uint32 usec;
+} trap_entry;
+
+static int TrapContextSwitchHandler(uint32 *trapArgs, int sysMode) {
+  dbprintf ('t', "Got a context switch trap!\n");
+  ProcessSchedule ();
+  ClkResetProcess();
+  return 0;
+}
+
+static int TrapExitHandler(uint32 *trapArgs, int sysMode) {
+  dbprintf ('t', "Got an exit trap!\n");
+  ProcessDestroy (currentPCB);
+  ProcessSchedule ();
+  ClkResetProcess();
+  return 0;
+}
+
+static int TrapForkHandler(uint32 *trapArgs, int sysMode) {
+  dbprintf ('t', "Got a fork trap!\n");
+  return 0;
+}
+
+static int TrapSleepHandler(uint32 *trapArgs, int sysMode) {
+  dbprintf ('t', "Got a process sleep trap!\n");
+  ProcessSuspend (currentPCB);
+  ProcessSchedule ();
+  ClkResetProcess();
+  return 0;
+}
+
+// The sleeps switch processes, so their result is set beforehand
+static int TrapSleepFor(int slept) {
+  if (slept) {
+    ProcessSchedule ();
+    ClkResetProcess();
+  }
+  return 0;
+}
+
+static int TrapUserSleepHandler(uint32 *trapArgs, int sysMode) {
+  ProcessSetResult(currentPCB, 0);
+  return TrapSleepFor(ProcessSleepMs(GetIntFromTrapArg(trapArgs, sysMode) * 1000));
+}
+
+static int TrapSleepMsHandler(uint32 *trapArgs, int sysMode) {
+  ProcessSetResult(currentPCB, 0);
+  return TrapSleepFor(ProcessSleepMs(GetIntFromTrapArg(trapArgs, sysMode)));
+}
+
+static int TrapSleepUntilHandler(uint32 *trapArgs, int sysMode) {
+  ProcessSetResult(currentPCB, 0);
+  return TrapSleepFor(ProcessSleepUntil(GetIntFromTrapArg(trapArgs, sysMode)));
+}
+
+static int TrapPrintf(uint32 *trapArgs, int sysMode) {
+  // Call the trap printf handler and pass the arguments and a flag
+  // indicating whether the trap was called from system mode.
+  dbprintf ('t', "Got a printf trap!\n");
+  TrapPrintfHandler (trapArgs, sysMode);
+  return 0;
+}
+
+static int TrapOpenHandler(uint32 *trapArgs, int sysMode) {
+  uint32 args[2];
+  char filename[32];
+  int intrs;
+
+  // Get the arguments to the trap handler.  If this is a user mode trap,
+  // copy them from user space.
+  if (sysMode) {
+    args[0] = trapArgs[0];
+    args[1] = trapArgs[1];
+  } else {
+    // trapArgs points to the trap arguments in user space.  There are
+    // two of them, so copy them to to system space.  The first argument
+    // is a string, so it has to be copied to system space and the
+    // argument replaced with a pointer to the string in system space.
+    MemoryCopyUserToSystem (currentPCB, trapArgs, args, sizeof(args[0])*2);
+    MemoryCopyUserToSystem (currentPCB, args[0], filename, 31);
+    // Null-terminate the string in case it's longer than 31 characters.
+    filename[31] = '\0';
+    // Set the argument to be the filename
+    args[0] = (uint32)filename;
+  }
+  // Allow Open() calls to be interruptible!
+  intrs = EnableIntrs ();
+  printf ("Got an open with parameters ('%s',0x%x)\n", (char *)(args[0]), args[1]);
+  RestoreIntrs (intrs);
+  return args[1] + 0x10000;
+}
+
+// Close, read, write, delete and seek through the simulator's traps
+// aren't supported and always fail
+static int TrapUnsupportedHandler(uint32 *trapArgs, int sysMode) {
+  return -1;
+}
+
+static int TrapGetPidHandler(uint32 *trapArgs, int sysMode) {
+  return GetCurrentPid();
+}
+
+static int TrapProcessCreate(uint32 *trapArgs, int sysMode) {
+  TrapProcessCreateHandler(trapArgs, sysMode);
+  return 0;
+}
+
+// Synchronization traps all take (at most) one integer: a handle, or
+// the count for sem_create and the lock for cond_create
+static int TrapSemCreateHandler(uint32 *trapArgs, int sysMode) {
+  return SemCreate(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapSemWaitHandler(uint32 *trapArgs, int sysMode) {
+  return SemHandleWait(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapSemSignalHandler(uint32 *trapArgs, int sysMode) {
+  return SemHandleSignal(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapLockCreateHandler(uint32 *trapArgs, int sysMode) {
+  return LockCreate();
+}
+static int TrapLockAcquireHandler(uint32 *trapArgs, int sysMode) {
+  return LockHandleAcquire(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapLockReleaseHandler(uint32 *trapArgs, int sysMode) {
+  return LockHandleRelease(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapRwLockCreateHandler(uint32 *trapArgs, int sysMode) {
+  return RwLockCreate();
+}
+static int TrapRwLockReadHandler(uint32 *trapArgs, int sysMode) {
+  return RwLockHandleAcquireRead(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapRwLockWriteHandler(uint32 *trapArgs, int sysMode) {
+  return RwLockHandleAcquireWrite(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapRwLockReleaseHandler(uint32 *trapArgs, int sysMode) {
+  return RwLockHandleRelease(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapCondCreateHandler(uint32 *trapArgs, int sysMode) {
+  return CondCreate(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapCondWaitHandler(uint32 *trapArgs, int sysMode) {
+  return CondHandleWait(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapCondSignalHandler(uint32 *trapArgs, int sysMode) {
+  return CondHandleSignal(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapCondBroadcastHandler(uint32 *trapArgs, int sysMode) {
+  return CondHandleBroadcast(GetIntFromTrapArg(trapArgs, sysMode));
+}
+
+static int TrapDiskSizeHandler(uint32 *trapArgs, int sysMode) {
+  return DiskSize();
+}
+static int TrapDiskBlocksizeHandler(uint32 *trapArgs, int sysMode) {
+  return DiskBytesPerBlock();
+}
+static int TrapDiskCreateHandler(uint32 *trapArgs, int sysMode) {
+  return DiskCreate();
+}
+
+static int TrapDfsInvalidateHandler(uint32 *trapArgs, int sysMode) {
+  DfsInvalidate();
+  return 0;
+}
+static int TrapDfsSyncHandler(uint32 *trapArgs, int sysMode) {
+  return DfsSync();
+}
+
+// The file traps that share a handler with their read or write twin
+static int TrapFileReadvHandler(uint32 *trapArgs, int sysMode) {
+  return TrapFileVecHandler(trapArgs, sysMode, 0);
+}
+static int TrapFileWritevHandler(uint32 *trapArgs, int sysMode) {
+  return TrapFileVecHandler(trapArgs, sysMode, 1);
+}
+static int TrapFileReadAsyncHandler(uint32 *trapArgs, int sysMode) {
+  return TrapFileAsyncHandler(trapArgs, sysMode, 0);
+}
+static int TrapFileWriteAsyncHandler(uint32 *trapArgs, int sysMode) {
+  return TrapFileAsyncHandler(trapArgs, sysMode, 1);
+}
+static int TrapFileWaitHandler(uint32 *trapArgs, int sysMode) {
+  return FileWait(GetIntFromTrapArg(trapArgs, sysMode));
+}
+static int TrapFilePreadHandler(uint32 *trapArgs, int sysMode) {
+  return TrapFilePosHandler(trapArgs, sysMode, 0);
+}
+static int TrapFilePwriteHandler(uint32 *trapArgs, int sysMode) {
+  return TrapFilePosHandler(trapArgs, sysMode, 1);
+}
+static int TrapFileSyncHandler(uint32 *trapArgs, int sysMode) {
+  return FileSync(FileFdHandle(currentPCB, GetIntFromTrapArg(trapArgs, sysMode)));
+}
+static int TrapFileDataSyncHandler(uint32 *trapArgs, int sysMode) {
+  return FileDataSync(FileFdHandle(currentPCB, GetIntFromTrapArg(trapArgs, sysMode)));
+}
+static int TrapFileMunmapHandler(uint32 *trapArgs, int sysMode) {
+  return TrapFileMapAddrHandler(trapArgs, sysMode, 1);
+}
+static int TrapFileMsyncHandler(uint32 *trapArgs, int sysMode) {
+  return TrapFileMapAddrHandler(trapArgs, sysMode, 0);
+}
+
+static int TrapClockUsecHandler(uint32 *trapArgs, int sysMode) {
+  return ClkGetUsec();
+}
+static int TrapClockCyclesHandler(uint32 *trapArgs, int sysMode) {
+  return ClkGetCycles();
+}
+static int TrapTestOsHandler(uint32 *trapArgs, int sysMode) {
+  RunOSTests();
+  return 0;
+}
+static int TrapOsBenchHandler(uint32 *trapArgs, int sysMode) {
+  RunOSBenchmarks();
+  return 0;
+}
+
+static int TrapProfileHandler(uint32 *trapArgs, int sysMode);
+static int TrapEvlogDumpHandler(uint32 *trapArgs, int sysMode) {
+  EvlogDump();
+  return 0;
+}
+static int TrapRingSetupHandler(uint32 *trapArgs, int sysMode);
+static int TrapRingEnterHandler(uint32 *trapArgs, int sysMode);
+
+static trap_entry traps[] = {
+  {TRAP_CONTEXT_SWITCH,   "context_switch",   TrapContextSwitchHandler,   TRAP_NO_RESULT},
+  {TRAP_EXIT,             "exit",             TrapExitHandler,            TRAP_NO_RESULT},
+  {TRAP_USER_EXIT,        "user_exit",        TrapExitHandler,            TRAP_NO_RESULT},
+  {TRAP_PROCESS_FORK,     "process_fork",     TrapForkHandler,            TRAP_NO_RESULT},
+  {TRAP_PROCESS_SLEEP,    "process_sleep",    TrapSleepHandler,           TRAP_NO_RESULT},
+  {TRAP_PRINTF,           "printf",           TrapPrintf,                 TRAP_NO_RESULT},
+  {TRAP_OPEN,             "Open",             TrapOpenHandler,            0},
+  {TRAP_CLOSE,            "Close",            TrapUnsupportedHandler,     0},
+  {TRAP_READ,             "Read",             TrapUnsupportedHandler,     0},
+  {TRAP_WRITE,            "Write",            TrapUnsupportedHandler,     0},
+  {TRAP_DELETE,           "Delete",           TrapUnsupportedHandler,     0},
+  {TRAP_SEEK,             "Seek",             TrapUnsupportedHandler,     0},
+  {TRAP_PROCESS_GETPID,   "getpid",           TrapGetPidHandler,          0},
+  {TRAP_PROCESS_CREATE,   "process_create",   TrapProcessCreate,          TRAP_NO_RESULT},
+  {TRAP_SEM_CREATE,       "sem_create",       TrapSemCreateHandler,       0},
+  {TRAP_SEM_WAIT,         "sem_wait",         TrapSemWaitHandler,         0},
+  {TRAP_SEM_SIGNAL,       "sem_signal",       TrapSemSignalHandler,       0},
+  {TRAP_LOCK_CREATE,      "lock_create",      TrapLockCreateHandler,      0},
+  {TRAP_LOCK_ACQUIRE,     "lock_acquire",     TrapLockAcquireHandler,     0},
+  {TRAP_LOCK_RELEASE,     "lock_release",     TrapLockReleaseHandler,     0},
+  {TRAP_RWLOCK_CREATE,    "rwlock_create",    TrapRwLockCreateHandler,    0},
+  {TRAP_RWLOCK_READ,      "rwlock_read",      TrapRwLockReadHandler,      0},
+  {TRAP_RWLOCK_WRITE,     "rwlock_write",     TrapRwLockWriteHandler,     0},
+  {TRAP_RWLOCK_RELEASE,   "rwlock_release",   TrapRwLockReleaseHandler,   0},
+  {TRAP_COND_CREATE,      "cond_create",      TrapCondCreateHandler,      0},
+  {TRAP_COND_WAIT,        "cond_wait",        TrapCondWaitHandler,        0},
+  {TRAP_COND_SIGNAL,      "cond_signal",      TrapCondSignalHandler,      0},
+  {TRAP_COND_BROADCAST,   "cond_broadcast",   TrapCondBroadcastHandler,   0},
+  {TRAP_DISK_WRITE_BLOCK, "disk_write_block", TrapDiskWriteBlockHandler,  0},
+  {TRAP_DISK_SIZE,        "disk_size",        TrapDiskSizeHandler,        0},
+  {TRAP_DISK_BLOCKSIZE,   "disk_blocksize",   TrapDiskBlocksizeHandler,   0},
+  {TRAP_DISK_CREATE,      "disk_create",      TrapDiskCreateHandler,      0},
+  {TRAP_DISK_STATS,       "disk_stats",       TrapDiskStatsHandler,       0},
+  {TRAP_DISK_WRITE_BLOCKS,"disk_write_blocks",TrapDiskWriteBlocksHandler, 0},
+  {TRAP_DFS_INVALIDATE,   "dfs_invalidate",   TrapDfsInvalidateHandler,   TRAP_NO_RESULT},
+  {TRAP_DFS_SYNC,         "dfs_sync",         TrapDfsSyncHandler,         0},
+  {TRAP_DFS_DEFRAG,       "dfs_defrag",       TrapDfsDefragHandler,       0},
+  {TRAP_DFS_READDIR,      "dfs_readdir",      TrapDfsReadDirHandler,      0},
+  {TRAP_FILE_OPEN,        "file_open",        TrapFileOpenHandler,        0},
+  {TRAP_FILE_CLOSE,       "file_close",       TrapFileCloseHandler,       0},
+  {TRAP_FILE_DELETE,      "file_delete",      TrapFileDeleteHandler,      0},
+  {TRAP_FILE_READ,        "file_read",        TrapFileReadHandler,        0},
+  {TRAP_FILE_WRITE,       "file_write",       TrapFileWriteHandler,       0},
+  {TRAP_FILE_SEEK,        "file_seek",        TrapFileSeekHandler,        0},
+  {TRAP_FILE_READV,       "file_readv",       TrapFileReadvHandler,       0},
+  {TRAP_FILE_WRITEV,      "file_writev",      TrapFileWritevHandler,      0},
+  {TRAP_FILE_READ_ASYNC,  "file_read_async",  TrapFileReadAsyncHandler,   0},
+  {TRAP_FILE_WRITE_ASYNC, "file_write_async", TrapFileWriteAsyncHandler,  0},
+  {TRAP_FILE_WAIT,        "file_wait",        TrapFileWaitHandler,        0},
+  {TRAP_FILE_PREAD,       "file_pread",       TrapFilePreadHandler,       0},
+  {TRAP_FILE_PWRITE,      "file_pwrite",      TrapFilePwriteHandler,      0},
+  {TRAP_FILE_COPY_RANGE,  "file_copy_range",  TrapFileCopyRangeHandler,   0},
+  {TRAP_FILE_SYNC,        "file_sync",        TrapFileSyncHandler,        0},
+  {TRAP_FILE_DATASYNC,    "file_datasync",    TrapFileDataSyncHandler,    0},
+  {TRAP_FILE_STATS,       "file_stats",       TrapFileStatsHandler,       0},
+  {TRAP_FILE_MMAP,        "file_mmap",        TrapFileMmapHandler,        0},
+  {TRAP_FILE_MUNMAP,      "file_munmap",      TrapFileMunmapHandler,      0},
+  {TRAP_FILE_MSYNC,       "file_msync",       TrapFileMsyncHandler,       0},
+  {TRAP_RING_SETUP,       "ring_setup",       TrapRingSetupHandler,       0},
+  {TRAP_RING_ENTER,       "ring_enter",       TrapRingEnterHandler,       0},
+  {TRAP_CONSOLE_WRITE,    "console_write",    TrapConsoleWriteHandler,    0},
+  {TRAP_CLOCK_USEC,       "clock_usec",       TrapClockUsecHandler,       0},
+  {TRAP_CLOCK_CYCLES,     "clock_cycles",     TrapClockCyclesHandler,     0},
+  {TRAP_USER_SLEEP,       "sleep",            TrapUserSleepHandler,       TRAP_NO_RESULT},
+  {TRAP_SLEEP_MS,         "sleep_ms",         TrapSleepMsHandler,         TRAP_NO_RESULT},
+  {TRAP_SLEEP_UNTIL,      "sleep_until",      TrapSleepUntilHandler,      TRAP_NO_RESULT},
+  {TRAP_TESTOS,           "run_os_tests",     TrapTestOsHandler,          TRAP_NO_RESULT},
+  {TRAP_OSBENCH,          "run_os_benchmarks", TrapOsBenchHandler,        TRAP_NO_RESULT},
+  {TRAP_PROFILE,          "trap_profile",     TrapProfileHandler,         0},
+  {TRAP_EVLOG_DUMP,       "evlog_dump",       TrapEvlogDumpHandler,       0},
+};
+#define TRAP_ENTRIES (sizeof(traps) / sizeof(traps[0]))
+
+static unsigned char trap_slot[TRAP_MAX_CAUSE];
+static int trap_slots_built = 0;
+
+static void TrapSlotsBuild() {
+  int i;
+
+  for (i = 0; i < TRAP_ENTRIES; i++) {
+    trap_slot[traps[i].cause] = i + 1;
+  }
+  trap_slots_built = 1;
+}
+
+// TrapLookup returns the entry for trap number cause, or NULL
+static trap_entry *TrapLookup(int cause) {
+  if (!trap_slots_built) {
+    TrapSlotsBuild();
+  }
+  if ((cause < 0) || (cause >= TRAP_MAX_CAUSE) || (trap_slot[cause] == 0)) {
+    return NULL;
+  }
+  return &traps[trap_slot[cause] - 1];
+}
+
+// TrapCall runs t's handler, counting the call and its time
+static int TrapCall(trap_entry *t, uint32 *trapArgs, int sysMode) {
+  uint32 start = ClkGetUsec();
+  int result;
+
+  t->calls++;
+  result = t->handler(trapArgs, sysMode);
+  t->usec += ClkUsecSince(start);
+  return result;
+}
+
+// trap_profile(): prints every trap called so far with its calls and
+// microseconds, and returns how many traps there have been in all
+static int TrapProfileHandler(uint32 *trapArgs, int sysMode) {
+  int i, total = 0;
+
+  printf("Trap profile:\n");
+  for (i = 0; i < TRAP_ENTRIES; i++) {
+    if (traps[i].calls == 0) {
+      continue;
+    }
+    printf("  0x%x %s: %d calls, %u usec\n", traps[i].cause, traps[i].name,
+           traps[i].calls, traps[i].usec);
+    total += traps[i].calls;
+  }
+  return total;
+}
+
+// ring_setup(trap_ring_t *ring): makes ring, which has to be in the
+// process's own memory and within one page, its trap ring, emptying
+// it.  The kernel keeps the system address of it, so ring_enter reads
+// and writes it in place rather than copying it in and out.
+static int TrapRingSetupHandler(uint32 *trapArgs, int sysMode) {
+  uint32 addr;
+  trap_ring *ring;
+
+  if (sysMode) {
+    return -1;
+  }
+  MemoryCopyUserToSystem (currentPCB, trapArgs, &addr, sizeof(addr));
+  if ((addr == 0) || (addr % 4) ||
+      (addr / MEMORY_PAGE_SIZE != (addr + sizeof(trap_ring) - 1) / MEMORY_PAGE_SIZE) ||
+      ((ring = (trap_ring *)MemoryTranslateUserToSystem (currentPCB, addr)) == NULL)) {
+    printf("TrapRingSetupHandler: bad ring address 0x%x\n", addr);
+    return -1;
+  }
+  ring->sq_head = ring->sq_tail = 0;
+  ring->cq_head = ring->cq_tail = 0;
+  currentPCB->ring = addr;
+  currentPCB->ring_sys = ring;
+  return 1;
+}
+
+// ring_enter(): runs the queued entries in order while there's room
+// for their completions, and returns how many ran.  Each runs as if
+// its trap had been made from user mode with its args, so handlers
+// copy them in as usual.  Traps that switch processes or set their
+// own result, and the ring traps, complete with -1 instead.
+static int TrapRingEnterHandler(uint32 *trapArgs, int sysMode) {
+  trap_ring *ring = (trap_ring *)currentPCB->ring_sys;
+  trap_ring_sqe *sqe;
+  trap_ring_cqe *cqe;
+  trap_entry *t;
+  int i, done = 0;
+
+  if (sysMode || (ring == NULL)) {
+    return -1;
+  }
+  while ((ring->sq_head != ring->sq_tail) && (ring->cq_tail - ring->cq_head < TRAP_RING_ENTRIES)) {
+    i = ring->sq_head % TRAP_RING_ENTRIES;
+    sqe = &ring->sq[i];
+    cqe = &ring->cq[ring->cq_tail % TRAP_RING_ENTRIES];
+    cqe->user_data = sqe->user_data;
+    t = TrapLookup(sqe->op);
+    if ((t == NULL) || (t->flags & TRAP_NO_RESULT) ||
+        (t->handler == TrapRingSetupHandler) || (t->handler == TrapRingEnterHandler)) {
+      cqe->result = -1;
+    } else {
+      cqe->result = TrapCall(t, (uint32 *)(currentPCB->ring + ((char *)sqe->args - (char *)ring)), 0);
+    }
+    ring->sq_head++;
+    ring->cq_tail++;
+    done++;
+  }
+  return done;
+}
+
+//----------------------------------------------------------------------
+//
+//	Deferred work
+//
+//	Interrupt handlers do only what has to happen with interrupts
+//	off, like acknowledging the device, and hand the rest to
+//	TrapDefer.  dointerrupt runs it on the way out, with interrupts
+//	back on, so a long completion doesn't hold off the timer or the
+//	other devices.  An interrupt that arrives meanwhile just adds its
+//	work to the queue; the run already going picks it up.  Deferred
+//	work must not sleep.
+//
+//----------------------------------------------------------------------
+#define TRAP_DEFER_ENTRIES 16   // A power of two
+
+typedef struct trap_defer_entry {
+  void (*func)(void *arg);
+  void *arg;
+} trap_defer_entry;
+
+static trap_defer_entry trap_defer[TRAP_DEFER_ENTRIES];
+static int trap_defer_head = 0;
+static int trap_defer_tail = 0;
+static int trap_defer_running = 0;
+static int trap_defer_resched = 0;     // A quantum ran out during the run
+
+//----------------------------------------------------------------------
+// TrapDefer queues func(arg) to run before the interrupt returns.  If
+// the queue is full it runs right away instead.  Interrupts must be
+// disabled.
+//----------------------------------------------------------------------
+void TrapDefer(void (*func)(void *arg), void *arg) {
+  trap_defer_entry *e;
+
+  if (trap_defer_tail - trap_defer_head == TRAP_DEFER_ENTRIES) {
+    func(arg);
+    return;
+  }
+  e = &trap_defer[trap_defer_tail++ & (TRAP_DEFER_ENTRIES - 1)];
+  e->func = func;
+  e->arg = arg;
+}
+
+//----------------------------------------------------------------------
+// TrapRunDeferred runs the queued work with interrupts enabled, unless
+// this interrupt came in during a run, which will get to its work too.
+// A process switch that came due meanwhile happens at the end, so the
+// run is never left half done on another process's stack.
+//----------------------------------------------------------------------
+static void TrapRunDeferred() {
+  trap_defer_entry e;
+
+  if (trap_defer_running || (trap_defer_head == trap_defer_tail)) {
+    return;
+  }
+  trap_defer_running = 1;
+  while (trap_defer_head != trap_defer_tail) {
+    e = trap_defer[trap_defer_head++ & (TRAP_DEFER_ENTRIES - 1)];
+    EnableIntrs();
+    e.func(e.arg);
+    DisableIntrs();
+  }
+  trap_defer_running = 0;
+  if (trap_defer_resched) {
+    trap_defer_resched = 0;
+    ProcessSchedule();
   }
-  //dbprintf('Q', "TrapDiskWriteBlockHandler. blocknum=%d\n", blocknum);
-  return DiskWriteBlock(blocknum, &b);
 }
 
 //----------------------------------------------------------------------
@@ -578,10 +1381,7 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
 {
   int	result;
   int	i;
-  uint32	args[4];
-  int	intrs;
-  uint32 handle;
-  int ihandle;
+  trap_entry *t;
 
   dbprintf ('t',"Interrupt cause=0x%x iar=0x%x isr=0x%x args=0x%08x.\n",
 	    cause, iar, isr, (int)trapArgs);
@@ -589,193 +1389,15 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
   // If the bit isn't set, this was a system interrupt.
   if (cause & TRAP_TRAP_INSTR) {
     cause &= ~TRAP_TRAP_INSTR;
-    switch (cause) {
-    case TRAP_CONTEXT_SWITCH:
-      dbprintf ('t', "Got a context switch trap!\n");
-      ProcessSchedule ();
-      ClkResetProcess();
-      break;
-    case TRAP_EXIT:
-    case TRAP_USER_EXIT:
-      dbprintf ('t', "Got an exit trap!\n");
-      ProcessDestroy (currentPCB);
-      ProcessSchedule ();
-      ClkResetProcess();
-      break;
-    case TRAP_PROCESS_FORK:
-      dbprintf ('t', "Got a fork trap!\n");
-      break;
-    case TRAP_PROCESS_SLEEP:
-      dbprintf ('t', "Got a process sleep trap!\n");
-      ProcessSuspend (currentPCB);
-      ProcessSchedule ();
-      ClkResetProcess();
-      break;
-    case TRAP_PRINTF:
-      // Call the trap printf handler and pass the arguments and a flag
-      // indicating whether the trap was called from system mode.
-      dbprintf ('t', "Got a printf trap!\n");
-      TrapPrintfHandler (trapArgs, isr & DLX_STATUS_SYSMODE);
-      break;
-    case TRAP_OPEN:
-      // Get the arguments to the trap handler.  If this is a user mode trap,
-      // copy them from user space.
-      if (isr & DLX_STATUS_SYSMODE) {
-	args[0] = trapArgs[0];
-	args[1] = trapArgs[1];
-      } else {
-	char	filename[32];
-	// trapArgs points to the trap arguments in user space.  There are
-	// two of them, so copy them to to system space.  The first argument
-	// is a string, so it has to be copied to system space and the
-	// argument replaced with a pointer to the string in system space.
-	MemoryCopyUserToSystem (currentPCB, trapArgs, args, sizeof(args[0])*2);
-	MemoryCopyUserToSystem (currentPCB, args[0], filename, 31);
-	// Null-terminate the string in case it's longer than 31 characters.
-	filename[31] = '\0';
-	// Set the argument to be the filename
-	args[0] = (uint32)filename;
-      }
-      // Allow Open() calls to be interruptible!
-      intrs = EnableIntrs ();
-      ProcessSetResult (currentPCB, args[1] + 0x10000);
-      printf ("Got an open with parameters ('%s',0x%x)\n", (char *)(args[0]), args[1]);
-      RestoreIntrs (intrs);
-      break;
-    case TRAP_CLOSE:
-      // Allow Close() calls to be interruptible!
-      intrs = EnableIntrs ();
-      ProcessSetResult (currentPCB, -1);
-      RestoreIntrs (intrs);
-      break;
-    case TRAP_READ:
-      // Allow Read() calls to be interruptible!
-      intrs = EnableIntrs ();
-      ProcessSetResult (currentPCB, -1);
-      RestoreIntrs (intrs);
-      break;
-    case TRAP_WRITE:
-      // Allow Write() calls to be interruptible!
-      intrs = EnableIntrs ();
-      ProcessSetResult (currentPCB, -1);
-      RestoreIntrs (intrs);
-      break;
-    case TRAP_DELETE:
-      intrs = EnableIntrs ();
-      ProcessSetResult (currentPCB, -1);
-      RestoreIntrs (intrs);
-      break;
-    case TRAP_SEEK:
-      intrs = EnableIntrs ();
-      ProcessSetResult (currentPCB, -1);
-      RestoreIntrs (intrs);
-      break;
-    case TRAP_PROCESS_GETPID:
-      ProcessSetResult(currentPCB, GetCurrentPid()); 
-      break;
-    case TRAP_PROCESS_CREATE:
-      TrapProcessCreateHandler(trapArgs, isr & DLX_STATUS_SYSMODE);
-      break;
-    case TRAP_SEM_CREATE:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      ihandle = SemCreate(ihandle);
-      ProcessSetResult(currentPCB, ihandle); //Return handle
-      break;
-    case TRAP_SEM_WAIT:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      handle = SemHandleWait(ihandle);
-      ProcessSetResult(currentPCB, handle); //Return 1 or 0
-      break;
-    case TRAP_SEM_SIGNAL:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      handle = SemHandleSignal(ihandle);
-      ProcessSetResult(currentPCB, handle); //Return 1 or 0
-      break;
-    case TRAP_LOCK_CREATE:
-      ihandle = LockCreate();
-      ProcessSetResult(currentPCB, ihandle); //Return handle
-      break;
-    case TRAP_LOCK_ACQUIRE:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      handle = LockHandleAcquire(ihandle);
-      ProcessSetResult(currentPCB, handle); //Return 1 or 0
-      break;
-    case TRAP_LOCK_RELEASE:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      handle = LockHandleRelease(ihandle);
-      ProcessSetResult(currentPCB, handle); //Return 1 or 0
-      break;
-    case TRAP_COND_CREATE:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      ihandle = CondCreate(ihandle);
-      ProcessSetResult(currentPCB, ihandle); //Return handle
-      break;
-    case TRAP_COND_WAIT:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      ihandle = CondHandleWait(ihandle);
-      ProcessSetResult(currentPCB, ihandle); //Return 1 or 0
-      break;
-    case TRAP_COND_SIGNAL:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      ihandle = CondHandleSignal(ihandle);
-      ProcessSetResult(currentPCB, ihandle); //Return 1 or 0
-      break;
-    case TRAP_COND_BROADCAST:
-      ihandle = GetIntFromTrapArg(trapArgs, isr & DLX_STATUS_SYSMODE);
-      ihandle = CondHandleBroadcast(ihandle);
-      ProcessSetResult(currentPCB, ihandle); //Return 1 or 0
-      break;
-
-    // Traps for Disk Access
-    case TRAP_DISK_WRITE_BLOCK:
-        ihandle = TrapDiskWriteBlockHandler(trapArgs, isr & DLX_STATUS_SYSMODE);
-        ProcessSetResult(currentPCB, ihandle);  
-      break;
-    case TRAP_DISK_SIZE:
-        ProcessSetResult(currentPCB, DiskSize());
-      break;
-    case TRAP_DISK_BLOCKSIZE:
-        ProcessSetResult(currentPCB, DiskBytesPerBlock());
-      break;
-    case TRAP_DISK_CREATE:
-        ProcessSetResult(currentPCB, DiskCreate());
-      break;
-
-    // Traps for DFS filesystem
-    case TRAP_DFS_INVALIDATE:
-        DfsInvalidate();
-      break;
-
-    // Traps for file functions
-    case TRAP_FILE_OPEN:
-        ProcessSetResult(currentPCB, TrapFileOpenHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
-      break;
-    case TRAP_FILE_CLOSE:
-        ProcessSetResult(currentPCB, TrapFileCloseHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
-      break;
-    case TRAP_FILE_DELETE:
-        ProcessSetResult(currentPCB, TrapFileDeleteHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
-      break;
-    case TRAP_FILE_READ:
-        ProcessSetResult(currentPCB, TrapFileReadHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
-      break;
-    case TRAP_FILE_WRITE:
-        ProcessSetResult(currentPCB, TrapFileWriteHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
-      break;
-    case TRAP_FILE_SEEK:
-        ProcessSetResult(currentPCB, TrapFileSeekHandler(trapArgs, isr & DLX_STATUS_SYSMODE));
-      break;
-
-    // Traps for running OS testing code
-    case TRAP_TESTOS:
-        RunOSTests();
-      break;
-
-    default:
+    if ((t = TrapLookup(cause)) == NULL) {
       printf ("Got an unrecognized trap (0x%x) - exiting!\n",
 	      cause);
       GracefulExit ();
-      break;
+    } else {
+      result = TrapCall(t, trapArgs, isr & DLX_STATUS_SYSMODE);
+      if (!(t->flags & TRAP_NO_RESULT)) {
+        ProcessSetResult(currentPCB, result);
+      }
     }
   } else {
     switch (cause) {
@@ -783,10 +1405,18 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       dbprintf ('t', "Got a timer interrupt!\n");
       // ClkInterrupt returns 1 when 1 "process quantum" has passed, meaning
       // that it's time to call ProcessSchedule again.
+      // During a deferred run, the switch waits until it's over.
       if (ClkInterrupt()) {
-        ProcessSchedule ();
+        if (trap_defer_running) {
+          trap_defer_resched = 1;
+        } else {
+          ProcessSchedule ();
+        }
       }
       break;
+    case TRAP_DISK:
+      DiskInterrupt();
+      break;
     case TRAP_KBD:
       do {
 	i = *((uint32 *)DLX_KBD_NCHARSIN);
@@ -811,6 +1441,11 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       GracefulExit ();
       break;
     case TRAP_PAGEFAULT:
+      // Faults in file mappings are filled in and the access retried
+      if (!(isr & DLX_STATUS_SYSMODE) &&
+          (MemoryPageFaultHandler(currentPCB) == MEMORY_SUCCESS)) {
+        break;
+      }
       printf ("Exiting after page fault at iar=0x%x, isr=0x%x\n",
 	      iar, isr);
       GracefulExit ();
@@ -822,6 +1457,8 @@ dointerrupt (unsigned int cause, unsigned int iar, unsigned int isr,
       break;
     }
   }
+  TrapRunDeferred();
+  ProcessUpdateKdata();
   dbprintf ('t',"About to return from dointerrupt.\n");
   // Note that this return may schedule a new process!
   intrreturn ();
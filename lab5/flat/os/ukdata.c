@@ -0,0 +1,25 @@
+//
+//	ukdata.c
+//
+//	Library calls that read the kernel data page (see kdata_shared.h)
+//	instead of trapping into the kernel.
+//
+//	This is part of the user library, not the operating system.
+//
+
+#include "usertraps.h"
+#include "kdata_shared.h"
+
+#define KDATA ((volatile kdata *)KDATA_ADDRESS)
+
+int getpid() {
+  return KDATA->pid;
+}
+
+int time_jiffies() {
+  return KDATA->jiffies;
+}
+
+unsigned int time_usec() {
+  return KDATA->usec;
+}
@@ -0,0 +1,285 @@
+//
+//	uprintf.c
+//
+//	Printf for user programs.  The formatting is done here, into a
+//	buffer on the caller's stack, and each line goes to the console
+//	with one console_write trap.  The kernel never sees the format
+//	string or the arguments, so it doesn't parse them (and then have
+//	the simulator parse them again); the printf trap is left for the
+//	kernel's own messages.
+//
+//	Conversions are %d, %i, %u, %x, %X, %c, %s, %f, %e, %g (with or
+//	without an l) and %%, each with an optional '-' or '0' flag, a
+//	width and a precision.
+//
+//	This is part of the user library, not the operating system.
+//
+
+#include <stdarg.h>
+#include "usertraps.h"
+
+#define PRINTF_BUFFER_SIZE	256	// A line longer than this goes out in pieces
+#define PRINTF_FLOAT_DIGITS	17	// A double has no more significant digits
+#define PRINTF_MAX_PRECISION	40	// Longer float precisions are cut to this
+
+typedef struct printf_buffer {
+  int	len;
+  char	buf[PRINTF_BUFFER_SIZE];
+} printf_buffer;
+
+static void PrintfFlush(printf_buffer *b) {
+  if (b->len > 0) {
+    console_write(b->buf, b->len);
+    b->len = 0;
+  }
+}
+
+static void PrintfPut(printf_buffer *b, char c) {
+  if (b->len == PRINTF_BUFFER_SIZE) {
+    PrintfFlush(b);
+  }
+  b->buf[b->len++] = c;
+  if (c == '\n') {
+    PrintfFlush(b);
+  }
+}
+
+//----------------------------------------------------------------------
+//	PrintfField
+//
+//	Put the len characters at s, after the sign character if there is
+//	one, padded out to width: on the right with spaces if left is set,
+//	else on the left with zeros (between the sign and the digits) if
+//	zero is set, else on the left with spaces.
+//----------------------------------------------------------------------
+static void PrintfField(printf_buffer *b, char sign, char *s, int len, int width, int left, int zero) {
+  int pad = width - len - (sign != '\0');
+
+  if (!left && !zero) {
+    for (; pad > 0; pad--) PrintfPut(b, ' ');
+  }
+  if (sign != '\0') {
+    PrintfPut(b, sign);
+  }
+  if (!left && zero) {
+    for (; pad > 0; pad--) PrintfPut(b, '0');
+  }
+  while (len-- > 0) {
+    PrintfPut(b, *s++);
+  }
+  for (; pad > 0; pad--) PrintfPut(b, ' ');
+}
+
+// Digits of v in the given base, written backwards ending just before
+// end.  Returns where they start.
+static char *PrintfUnsigned(char *end, unsigned int v, int base, int upper) {
+  char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+  do {
+    *--end = digits[v % base];
+    v /= base;
+  } while (v != 0);
+  return end;
+}
+
+// 0.5 in the last of places digits after the point
+static double PrintfRound(int places) {
+  double r = 0.5;
+
+  while (places-- > 0) r /= 10.0;
+  return r;
+}
+
+// Scale v, which is more than 0, into [1, 10) and return the power of
+// ten that took
+static int PrintfNormalize(double *v) {
+  int exp = 0;
+
+  while (*v >= 10.0) { *v /= 10.0; exp++; }
+  while (*v < 1.0) { *v *= 10.0; exp--; }
+  return exp;
+}
+
+// The next digit of the mantissa m, zeros once a double has no more
+static char PrintfNextDigit(double *m, int *n) {
+  int d;
+
+  if (*n >= PRINTF_FLOAT_DIGITS) {
+    return '0';
+  }
+  if ((d = (int)*m) > 9) d = 9;
+  *m = (*m - d) * 10.0;
+  // Leading zeros aren't significant
+  if ((d != 0) || (*n > 0)) (*n)++;
+  return '0' + d;
+}
+
+//----------------------------------------------------------------------
+//	PrintfFloat
+//
+//	Format v, which is 0 or more, for %f, %e or %g with prec digits of
+//	precision into buf, which is big enough for any of them.  Returns
+//	the length.
+//----------------------------------------------------------------------
+static int PrintfFloat(char *buf, double v, char conv, int prec) {
+  int exp = 0, n = 0, len = 0;
+  int trim = 0;
+  double m;
+
+  if (conv == 'g') {
+    // %e or %f, whichever suits the exponent after rounding to prec
+    // digits, without trailing zeros
+    if (prec == 0) prec = 1;
+    m = v;
+    if (v != 0.0) {
+      exp = PrintfNormalize(&m);
+      if (m + PrintfRound(prec - 1) >= 10.0) exp++;
+    }
+    if ((exp < -4) || (exp >= prec)) {
+      conv = 'e';
+      prec = prec - 1;
+    } else {
+      conv = 'f';
+      prec = prec - 1 - exp;
+    }
+    trim = 1;
+  }
+  m = v;
+  if (conv == 'e') {
+    if (v != 0.0) {
+      exp = PrintfNormalize(&m);
+      if ((m += PrintfRound(prec)) >= 10.0) {
+        m /= 10.0;
+        exp++;
+      }
+    }
+    buf[len++] = PrintfNextDigit(&m, &n);
+  } else {
+    // The digits run on from the most significant whole one, or from
+    // the first after the point if there isn't one
+    m += PrintfRound(prec);
+    if (m >= 1.0) {
+      exp = PrintfNormalize(&m);
+    } else {
+      exp = -1;
+      m *= 10.0;
+      buf[len++] = '0';
+    }
+    for (; exp >= 0; exp--) buf[len++] = PrintfNextDigit(&m, &n);
+  }
+  if (prec > 0) {
+    buf[len++] = '.';
+    while (prec-- > 0) buf[len++] = PrintfNextDigit(&m, &n);
+    if (trim) {
+      while (buf[len - 1] == '0') len--;
+      if (buf[len - 1] == '.') len--;
+    }
+  }
+  if (conv == 'e') {
+    buf[len++] = 'e';
+    buf[len++] = (exp < 0) ? '-' : '+';
+    if (exp < 0) exp = -exp;
+    if (exp >= 100) buf[len++] = '0' + exp / 100;
+    buf[len++] = '0' + (exp / 10) % 10;
+    buf[len++] = '0' + exp % 10;
+  }
+  return len;
+}
+
+void Printf(char *format, ...) {
+  printf_buffer b;
+  va_list ap;
+  char num[320 + PRINTF_MAX_PRECISION];   // Room for any %f of a double
+  char *s, *p;
+  char sign;
+  int left, zero, width, prec, len;
+  int i;
+  unsigned int u;
+  double d;
+
+  b.len = 0;
+  va_start(ap, format);
+  for (p = format; *p != '\0'; p++) {
+    if (*p != '%') {
+      PrintfPut(&b, *p);
+      continue;
+    }
+    // Flags, width and precision
+    left = zero = 0;
+    for (p++; (*p == '-') || (*p == '0'); p++) {
+      if (*p == '-') left = 1; else zero = 1;
+    }
+    for (width = 0; (*p >= '0') && (*p <= '9'); p++) {
+      width = width * 10 + *p - '0';
+    }
+    prec = -1;
+    if (*p == '.') {
+      for (prec = 0, p++; (*p >= '0') && (*p <= '9'); p++) {
+        prec = prec * 10 + *p - '0';
+      }
+    }
+    if (*p == 'l') p++;
+    sign = '\0';
+    switch (*p) {
+      case 'd':
+      case 'i':
+        i = va_arg(ap, int);
+        if (i < 0) {
+          sign = '-';
+          u = -i;
+        } else {
+          u = i;
+        }
+        s = PrintfUnsigned(num + sizeof(num), u, 10, 0);
+        PrintfField(&b, sign, s, num + sizeof(num) - s, width, left, zero);
+        break;
+      case 'u':
+      case 'x':
+      case 'X':
+        u = va_arg(ap, unsigned int);
+        s = PrintfUnsigned(num + sizeof(num), u, (*p == 'u') ? 10 : 16, *p == 'X');
+        PrintfField(&b, sign, s, num + sizeof(num) - s, width, left, zero);
+        break;
+      case 'c':
+        num[0] = (char)va_arg(ap, int);
+        PrintfField(&b, sign, num, 1, width, left, 0);
+        break;
+      case 's':
+        if ((s = va_arg(ap, char *)) == (char *)0) {
+          s = "(null)";
+        }
+        for (len = 0; (s[len] != '\0') && ((prec < 0) || (len < prec)); len++);
+        PrintfField(&b, sign, s, len, width, left, 0);
+        break;
+      case 'f':
+      case 'e':
+      case 'g':
+        d = va_arg(ap, double);
+        if (d < 0.0) {
+          sign = '-';
+          d = -d;
+        }
+        if (prec < 0) {
+          prec = 6;
+        } else if (prec > PRINTF_MAX_PRECISION) {
+          prec = PRINTF_MAX_PRECISION;
+        }
+        len = PrintfFloat(num, d, *p, prec);
+        PrintfField(&b, sign, num, len, width, left, zero);
+        break;
+      case '%':
+        PrintfPut(&b, '%');
+        break;
+      case '\0':
+        p--;
+        break;
+      default:
+        // Not a conversion we know; put it out as it was
+        PrintfPut(&b, '%');
+        PrintfPut(&b, *p);
+        break;
+    }
+  }
+  va_end(ap);
+  PrintfFlush(&b);
+}
@@ -66,21 +66,13 @@ _Putchar:
 	nop
 .endproc _Putchar
 
-.proc _Printf
-.global _Printf
-_Printf:		
-	trap	#0x201
+.proc _console_write
+.global _console_write
+_console_write:
+	trap	#0x48c
 	jr	r31
 	nop
-.endproc _Printf
-
-.proc _getpid
-.global _getpid
-_getpid:
-	trap 	#0x431
-	jr	r31
-	nop
-.endproc _getpid
+.endproc _console_write
 
 .proc _process_create
 .global _process_create
@@ -186,6 +178,38 @@ _cond_broadcast:
 	nop
 .endproc _cond_broadcast
 
+.proc _rwlock_create
+.global _rwlock_create
+_rwlock_create:
+	trap	#0x45a
+	jr	r31
+	nop
+.endproc _rwlock_create
+
+.proc _rwlock_acquire_read
+.global _rwlock_acquire_read
+_rwlock_acquire_read:
+	trap	#0x45b
+	jr	r31
+	nop
+.endproc _rwlock_acquire_read
+
+.proc _rwlock_acquire_write
+.global _rwlock_acquire_write
+_rwlock_acquire_write:
+	trap	#0x45c
+	jr	r31
+	nop
+.endproc _rwlock_acquire_write
+
+.proc _rwlock_release
+.global _rwlock_release
+_rwlock_release:
+	trap	#0x45d
+	jr	r31
+	nop
+.endproc _rwlock_release
+
 .proc _mbox_create
 .global _mbox_create
 _mbox_create:
@@ -274,6 +298,22 @@ _disk_create:
 	nop
 .endproc _disk_create
 
+.proc _disk_stats
+.global _disk_stats
+_disk_stats:
+	trap	#0x478
+	jr	r31
+	nop
+.endproc _disk_stats
+
+.proc _disk_write_blocks
+.global _disk_write_blocks
+_disk_write_blocks:
+	trap	#0x47a
+	jr	r31
+	nop
+.endproc _disk_write_blocks
+
 .proc _dfs_invalidate
 .global _dfs_invalidate
 _dfs_invalidate:
@@ -282,6 +322,30 @@ _dfs_invalidate:
 	nop
 .endproc _dfs_invalidate
 
+.proc _dfs_sync
+.global _dfs_sync
+_dfs_sync:
+	trap	#0x479
+	jr	r31
+	nop
+.endproc _dfs_sync
+
+.proc _dfs_defrag
+.global _dfs_defrag
+_dfs_defrag:
+	trap	#0x47b
+	jr	r31
+	nop
+.endproc _dfs_defrag
+
+.proc _dfs_readdir
+.global _dfs_readdir
+_dfs_readdir:
+	trap	#0x492
+	jr	r31
+	nop
+.endproc _dfs_readdir
+
 .proc _file_open
 .global _file_open
 _file_open:
@@ -330,6 +394,182 @@ _file_seek:
 	nop
 .endproc _file_seek
 
+.proc _file_mmap
+.global _file_mmap
+_file_mmap:
+	trap	#0x47c
+	jr	r31
+	nop
+.endproc _file_mmap
+
+.proc _file_munmap
+.global _file_munmap
+_file_munmap:
+	trap	#0x47d
+	jr	r31
+	nop
+.endproc _file_munmap
+
+.proc _file_msync
+.global _file_msync
+_file_msync:
+	trap	#0x47e
+	jr	r31
+	nop
+.endproc _file_msync
+
+.proc _file_readv
+.global _file_readv
+_file_readv:
+	trap	#0x47f
+	jr	r31
+	nop
+.endproc _file_readv
+
+.proc _file_writev
+.global _file_writev
+_file_writev:
+	trap	#0x480
+	jr	r31
+	nop
+.endproc _file_writev
+
+.proc _file_read_async
+.global _file_read_async
+_file_read_async:
+	trap	#0x481
+	jr	r31
+	nop
+.endproc _file_read_async
+
+.proc _file_write_async
+.global _file_write_async
+_file_write_async:
+	trap	#0x482
+	jr	r31
+	nop
+.endproc _file_write_async
+
+.proc _file_wait
+.global _file_wait
+_file_wait:
+	trap	#0x483
+	jr	r31
+	nop
+.endproc _file_wait
+
+.proc _file_pread
+.global _file_pread
+_file_pread:
+	trap	#0x484
+	jr	r31
+	nop
+.endproc _file_pread
+
+.proc _file_pwrite
+.global _file_pwrite
+_file_pwrite:
+	trap	#0x485
+	jr	r31
+	nop
+.endproc _file_pwrite
+
+.proc _file_copy_range
+.global _file_copy_range
+_file_copy_range:
+	trap	#0x486
+	jr	r31
+	nop
+.endproc _file_copy_range
+
+.proc _file_sync
+.global _file_sync
+_file_sync:
+	trap	#0x487
+	jr	r31
+	nop
+.endproc _file_sync
+
+.proc _file_datasync
+.global _file_datasync
+_file_datasync:
+	trap	#0x488
+	jr	r31
+	nop
+.endproc _file_datasync
+
+.proc _file_stats
+.global _file_stats
+_file_stats:
+	trap	#0x489
+	jr	r31
+	nop
+.endproc _file_stats
+
+.proc _ring_setup
+.global _ring_setup
+_ring_setup:
+	trap	#0x48a
+	jr	r31
+	nop
+.endproc _ring_setup
+
+.proc _ring_enter
+.global _ring_enter
+_ring_enter:
+	trap	#0x48b
+	jr	r31
+	nop
+.endproc _ring_enter
+
+.proc _clock_usec
+.global _clock_usec
+_clock_usec:
+	trap	#0x48d
+	jr	r31
+	nop
+.endproc _clock_usec
+
+.proc _clock_cycles
+.global _clock_cycles
+_clock_cycles:
+	trap	#0x48e
+	jr	r31
+	nop
+.endproc _clock_cycles
+
+.proc _sleep_ms
+.global _sleep_ms
+_sleep_ms:
+	trap	#0x48f
+	jr	r31
+	nop
+.endproc _sleep_ms
+
+.proc _sleep_until
+.global _sleep_until
+_sleep_until:
+	trap	#0x490
+	jr	r31
+	nop
+.endproc _sleep_until
+
+.proc _evlog_dump
+.global _evlog_dump
+_evlog_dump:
+	trap	#0x4FD
+	jr	r31
+	nop
+.endproc _evlog_dump
+
+.proc _trap_profile
+.global _trap_profile
+_trap_profile:
+	trap	#0x4FE
+	jr	r31
+	nop
+.endproc _trap_profile
+
 .proc _run_os_tests
 .global _run_os_tests
 _run_os_tests:
@@ -338,6 +578,14 @@ _run_os_tests:
 	nop
 .endproc _run_os_tests
 
+.proc _run_os_benchmarks
+.global _run_os_benchmarks
+_run_os_benchmarks:
+	trap	#0x491
+	jr	r31
+	nop
+.endproc _run_os_benchmarks
+
 
 .proc _Exit
 .global _Exit
@@ -346,3 +594,50 @@ _Exit:
 	jr	r31
 	nop
 .endproc _Exit
+
+;;; Bit and byte instructions (see dlxsim).  Hand-assembled, since the
+;;; assembler doesn't know them.  Used by the helpers in misc.c.
+;;; int dlx_ffs(int v);		lowest set bit, 32 if none
+;;; int dlx_popc(int v);		number of set bits
+;;; int dlx_cmpb(int a, int b);	mask of equal bytes, 0xf if a == b
+;;; int dlx_zbyte(int v);		first zero byte, 4 if none
+.proc _dlx_ffs
+.global _dlx_ffs
+_dlx_ffs:
+	lw	r1,0(r29)
+	.word	0x00200838	; ffs r1,r1
+	jr	r31
+	nop
+.endproc _dlx_ffs
+
+.proc _dlx_popc
+.global _dlx_popc
+_dlx_popc:
+	lw	r1,0(r29)
+	.word	0x00200839	; popc r1,r1
+	jr	r31
+	nop
+.endproc _dlx_popc
+
+.proc _dlx_cmpb
+.global _dlx_cmpb
+_dlx_cmpb:
+	subui	r29,r29,#8
+	sw	4(r29),r2
+	lw	r1,8(r29)
+	lw	r2,12(r29)
+	.word	0x0022083a	; cmpb r1,r1,r2
+	lw	r2,4(r29)
+	addui	r29,r29,#8
+	jr	r31
+	nop
+.endproc _dlx_cmpb
+
+.proc _dlx_zbyte
+.global _dlx_zbyte
+_dlx_zbyte:
+	lw	r1,0(r29)
+	.word	0x0020083b	; zbyte r1,r1
+	jr	r31
+	nop
+.endproc _dlx_zbyte
@@ -19,10 +19,14 @@ typedef struct disk_block {
 #define DISK_SUCCESS 1
 #define DISK_FAIL -1
 
+void DiskModuleInit();
 int DiskBytesPerBlock();
 int DiskSize();
 int DiskCreate();
 int DiskWriteBlock (uint32 blocknum, disk_block *b);
 int DiskReadBlock (uint32 blocknum, disk_block *b);
+int DiskWriteBlocks (uint32 blocknum, int count, void *buf);
+int DiskReadBlocks (uint32 blocknum, int count, void *buf);
+void DiskClose();
 
 #endif
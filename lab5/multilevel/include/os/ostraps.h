@@ -19,5 +19,19 @@ void bcopy(char *source, char *destination, int numbytes);
 void exitsim();
 void TimerSet(int us);
 
+// Vectored host I/O (trap_random.s).  iov holds iovcnt segments, each
+// a physical buffer address, a length and a file offset; one trap moves
+// all of them.  fd is a simulator descriptor returned by open().
+typedef struct host_iovec {
+  unsigned int addr;
+  unsigned int len;
+  unsigned int offset;
+} host_iovec;
+
+#define HOST_IOVEC_MAX 256
+
+int preadv(int fd, host_iovec *iov, int iovcnt);
+int pwritev(int fd, host_iovec *iov, int iovcnt);
+
 
 #endif
@@ -85,6 +85,21 @@ typedef struct PCB {
 #define PROCESS_PRIORITIES_PER_QUEUE 4
 #define PROCESS_NUM_QUEUES ((PROCESS_MAX_PRIORITY+1) / PROCESS_PRIORITIES_PER_QUEUE) // should be 32
 
+// Binary executable images.  This matches dlximage.h in the simulator
+// source: a header of PROCESS_IMAGE_HEADER_WORDS big-endian words
+// followed by segments of (load address, length, bytes).
+#define PROCESS_IMAGE_MAGIC		0x444c5849	// "DLXI"
+#define PROCESS_IMAGE_VERSION		1
+#define PROCESS_IMAGE_HEADER_WORDS	9
+#define PROCESS_IMAGE_SEGHDR_WORDS	2
+#define PROCESS_IMAGE_MAGIC_WORD	0
+#define PROCESS_IMAGE_VERSION_WORD	1
+#define PROCESS_IMAGE_START_WORD	2
+#define PROCESS_IMAGE_CODESTART_WORD	4
+#define PROCESS_IMAGE_CODESIZE_WORD	5
+#define PROCESS_IMAGE_DATASTART_WORD	6
+#define PROCESS_IMAGE_DATASIZE_WORD	7
+
 // Number of jiffies in a single process quantum (i.e. how often ProcessSchedule is called)
 #define PROCESS_QUANTUM_JIFFIES  CLOCK_PROCESS_JIFFIES
 // Number of jiffies that have to pass before decaying all estcpu's
@@ -3,6 +3,7 @@
 #include "traps.h"
 #include "disk.h"
 #include "filesys.h"
+#include "synch.h"
 
 //----------------------------------------------------------------------------
 // DiskBytesPerBlock returns the number of bytes in each physical block
@@ -22,133 +23,187 @@ int DiskSize() {
 }
 
 //----------------------------------------------------------------------------
-// DiskCreate opens the filesystem for writing, which will erase whatever
-// was there before.  You need to call this only when formattig the
-// disk to make sure that the file actually exists.
+// The disk file is opened once, as a simulator file descriptor, and kept
+// open; every transfer is then a single vectored trap instead of an
+// open/seek/read/close sequence per block.  disk_lock serializes use of
+// the handle, so a process that wants the disk while another has it
+// sleeps instead of everyone running with interrupts off.
 //----------------------------------------------------------------------------
 
-int DiskCreate() {
-  char *filename = NULL;
-  int fsfd = -1;
-  disk_block b;
-  int i;
+#define DISK_ZERO_BLOCKS 64
 
-  // Check that you remembered to rename the filename for your group
-  filename = DISK_FILENAME;
-  if (filename[11] == 'X') {
-    printf("DiskCreate: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
-    GracefulExit();
-  }
-  // Open the hard disk file
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_WRITE)) < 0) {
-    printf ("DiskCreate: File system %s cannot be opened!\n", DISK_FILENAME);
-    return DISK_FAIL;
-  }
+static int disk_fd = -1;
+static Lock disk_lock;
 
-  // Write all zeros to the hard disk file to make sure it is the right size.
-  // You need to do this because the writeblock/readblock operations are allowed in
-  // random order.
-  bzero(b.data, DISK_BLOCKSIZE);
-  for(i=0; i<DISK_NUMBLOCKS; i++) {
-    FsWrite(fsfd, b.data, DISK_BLOCKSIZE);
-  }
-  
-  // Close the hard disk file
-  if (FsClose(fsfd) < 0) {
-    printf("DiskCreate: unable to close open file!\n");
-    return DISK_FAIL;
+//----------------------------------------------------------------------------
+// DiskModuleInit sets up the disk lock.  It must be called before any
+// other disk function.
+//----------------------------------------------------------------------------
+
+void DiskModuleInit() {
+  if (LockInit(&disk_lock) != SYNC_SUCCESS) {
+    printf("FATAL ERROR: could not initialize disk lock in DiskModuleInit!\n");
+    GracefulExit();
   }
-  return DISK_SUCCESS;
 }
 
 //----------------------------------------------------------------------------
-// DiskWriteBlock writes one block to the disk, using the bytes pointed to 
-// by memory.  The blocksize is specified by DISK_BLOCKSIZE.  Returns
-// the number of bytes written on success, or DISK_FAIL on failure.
+// DiskOpenHandle opens the disk file with the given host open() mode if
+// it isn't open already.  Returns DISK_FAIL if it can't be opened.
+// The caller must hold disk_lock.
 //----------------------------------------------------------------------------
 
-int DiskWriteBlock (uint32 blocknum, disk_block *b) {
-  int fsfd = -1;
-  uint32 intrvals = 0;
-  char *filename = NULL;
+static int DiskOpenHandle(int mode) {
+  char *filename = DISK_FILENAME;
 
-  if (blocknum >= DISK_NUMBLOCKS) {
-    printf("DiskWriteBlock: cannot write to block larger than filesystem size\n");
-    return DISK_FAIL;
+  if (disk_fd >= 0) {
+    return DISK_SUCCESS;
   }
-
   // Check that you remembered to rename the filename for your group
-  filename = DISK_FILENAME;
   if (filename[11] == 'X') {
-    printf("DiskWriteBlock: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
+    printf("DiskOpenHandle: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
     GracefulExit();
   }
-
-  intrvals = DisableIntrs();
-
-  // Open the hard disk file
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_RW)) < 0) {
-    printf ("DiskWriteBlock: File system %s cannot be opened!\n", DISK_FILENAME);
-    return DISK_FAIL;
-  }
-
-  // Write data to virtual disk
-  FsSeek(fsfd, blocknum * DISK_BLOCKSIZE, FS_SEEK_SET);
-  if (FsWrite(fsfd, b->data, DISK_BLOCKSIZE) != DISK_BLOCKSIZE) {
-    printf ("DiskWriteBlock: Block %d could not be written!\n", blocknum);
-    FsClose (fsfd);
+  if ((disk_fd = open(filename, mode)) < 0) {
+    printf ("DiskOpenHandle: File system %s cannot be opened!\n", filename);
+    disk_fd = -1;
     return DISK_FAIL;
   }
+  return DISK_SUCCESS;
+}
 
-  // Close the hard disk file
-  FsClose (fsfd);
+//----------------------------------------------------------------------------
+// DiskClose closes the disk file, if it's open, so that everything
+// written is on the host file before the simulator exits.  The next
+// transfer would open it again.  It's only called as the OS exits, when
+// nothing else will touch the disk, so it doesn't wait for disk_lock.
+//----------------------------------------------------------------------------
 
-  RestoreIntrs(intrvals);
-  return DISK_BLOCKSIZE;
+void DiskClose() {
+  if (disk_fd >= 0) {
+    if (close(disk_fd) < 0) {
+      printf("DiskClose: unable to close open file!\n");
+    }
+    disk_fd = -1;
+  }
 }
 
 //----------------------------------------------------------------------------
-// DiskReadBlock reads one block from the disk, putting the bytes into the
-// memory pointed to by memory.  The blocksize is specified by DISK_BLOCKSIZE.
-// Returns the number of bytes read on success, or DISK_FAIL on failure.
+// DiskIo moves count consecutive blocks starting at blocknum between the
+// disk and buf with one vectored trap.  Returns the number of bytes
+// moved, or DISK_FAIL.
 //----------------------------------------------------------------------------
 
-int DiskReadBlock (uint32 blocknum, disk_block *b) {
-  int fsfd = -1;
-  uint32 intrvals = 0;
-  char *filename = NULL;
+static int DiskIo (int iswrite, uint32 blocknum, int count, void *buf) {
+  host_iovec iov;
+  int n;
 
-  if (blocknum >= DISK_NUMBLOCKS) {
-    printf("DiskReadBlock: cannot read from block larger than filesystem size\n");
+  if ((count <= 0) || (blocknum >= DISK_NUMBLOCKS) ||
+      (count > DISK_NUMBLOCKS - blocknum)) {
+    printf("DiskIo: blocks %d-%d are outside the filesystem\n", blocknum,
+           blocknum + count - 1);
     return DISK_FAIL;
   }
-
-  if (filename[11] == 'X') {
-    printf("DiskReadBlock: you didn't change the filesystem filename in include/os/disk.h.  Cowardly refusing to do anything.\n");
-    GracefulExit();
+  LockAcquire(&disk_lock);
+  if (DiskOpenHandle(FS_MODE_RW) == DISK_FAIL) {
+    LockRelease(&disk_lock);
+    return DISK_FAIL;
   }
+  iov.addr = (uint32)buf;
+  iov.len = count * DISK_BLOCKSIZE;
+  iov.offset = blocknum * DISK_BLOCKSIZE;
+  n = iswrite ? pwritev(disk_fd, &iov, 1) : preadv(disk_fd, &iov, 1);
+  LockRelease(&disk_lock);
+  if (n != count * DISK_BLOCKSIZE) {
+    printf ("DiskIo: blocks %d-%d could not be %s!\n", blocknum,
+            blocknum + count - 1, iswrite ? "written" : "read");
+    return DISK_FAIL;
+  }
+  return n;
+}
 
-  intrvals = DisableIntrs();
+//----------------------------------------------------------------------------
+// DiskCreate opens the filesystem for writing, which will erase whatever
+// was there before.  You need to call this only when formattig the
+// disk to make sure that the file actually exists.
+//----------------------------------------------------------------------------
 
-  // Open the hard disk file
-  if ((fsfd = FsOpen(DISK_FILENAME, FS_MODE_READ)) < 0) {
-    printf ("DiskReadBlock: File system %s cannot be opened!\n", DISK_FILENAME);
+int DiskCreate() {
+  static disk_block b;
+  host_iovec iov[DISK_ZERO_BLOCKS];
+  int i, j;
+
+  LockAcquire(&disk_lock);
+  // Reopen for writing so the old contents are thrown away.
+  if (disk_fd >= 0) {
+    close(disk_fd);
+    disk_fd = -1;
+  }
+  if (DiskOpenHandle(FS_MODE_WRITE) == DISK_FAIL) {
+    LockRelease(&disk_lock);
     return DISK_FAIL;
   }
 
-  // Read data from virtual disk
-  FsSeek(fsfd, blocknum * DISK_BLOCKSIZE, FS_SEEK_SET);
-  if (FsRead(fsfd, b->data, DISK_BLOCKSIZE) != DISK_BLOCKSIZE) {
-    printf ("DiskReadBlock: Block %d could not be read!\n", blocknum);
-    FsClose (fsfd);
+  // Write all zeros to the hard disk file to make sure it is the right size.
+  // You need to do this because the writeblock/readblock operations are allowed in
+  // random order.  Every segment points at the same zero block.
+  bzero(b.data, DISK_BLOCKSIZE);
+  for (i = 0; i < DISK_NUMBLOCKS; i += DISK_ZERO_BLOCKS) {
+    for (j = 0; j < DISK_ZERO_BLOCKS; j++) {
+      iov[j].addr = (uint32)b.data;
+      iov[j].len = DISK_BLOCKSIZE;
+      iov[j].offset = (i + j) * DISK_BLOCKSIZE;
+    }
+    if (pwritev(disk_fd, iov, DISK_ZERO_BLOCKS) != DISK_ZERO_BLOCKS * DISK_BLOCKSIZE) {
+      printf("DiskCreate: unable to clear the disk!\n");
+      LockRelease(&disk_lock);
+      return DISK_FAIL;
+    }
+  }
+
+  // Close the write-only handle; the next transfer reopens read/write.
+  if (close(disk_fd) < 0) {
+    printf("DiskCreate: unable to close open file!\n");
+    disk_fd = -1;
+    LockRelease(&disk_lock);
     return DISK_FAIL;
   }
+  disk_fd = -1;
+  LockRelease(&disk_lock);
+  return DISK_SUCCESS;
+}
 
-  // Close the hard disk file
-  FsClose (fsfd);
+//----------------------------------------------------------------------------
+// DiskWriteBlocks writes count consecutive blocks starting at blocknum
+// from buf, and DiskReadBlocks reads them into buf.  buf must hold
+// count * DISK_BLOCKSIZE bytes.  Both return the number of bytes moved
+// on success, or DISK_FAIL on failure.
+//----------------------------------------------------------------------------
 
-  RestoreIntrs(intrvals);
-  return DISK_BLOCKSIZE;
+int DiskWriteBlocks (uint32 blocknum, int count, void *buf) {
+  return DiskIo(1, blocknum, count, buf);
 }
 
+int DiskReadBlocks (uint32 blocknum, int count, void *buf) {
+  return DiskIo(0, blocknum, count, buf);
+}
 
+//----------------------------------------------------------------------------
+// DiskWriteBlock writes one block to the disk, using the bytes pointed to 
+// by memory.  The blocksize is specified by DISK_BLOCKSIZE.  Returns
+// the number of bytes written on success, or DISK_FAIL on failure.
+//----------------------------------------------------------------------------
+
+int DiskWriteBlock (uint32 blocknum, disk_block *b) {
+  return DiskWriteBlocks(blocknum, 1, b->data);
+}
+
+//----------------------------------------------------------------------------
+// DiskReadBlock reads one block from the disk, putting the bytes into the
+// memory pointed to by memory.  The blocksize is specified by DISK_BLOCKSIZE.
+// Returns the number of bytes read on success, or DISK_FAIL on failure.
+//----------------------------------------------------------------------------
+
+int DiskReadBlock (uint32 blocknum, disk_block *b) {
+  return DiskReadBlocks(blocknum, 1, b->data);
+}
@@ -21,3 +21,18 @@ _srandom:
 	nop
 .endproc _srandom
 
+.proc _preadv
+.global _preadv
+_preadv:
+	trap	#0x2040
+	jr	r31
+	nop
+.endproc _preadv
+
+.proc _pwritev
+.global _pwritev
+_pwritev:
+	trap	#0x2041
+	jr	r31
+	nop
+.endproc _pwritev
@@ -27,6 +27,7 @@
 void GracefulExit() {
   dbprintf('F', "GracefulExit: closing filesystem and exiting simulator\n");
   DfsCloseFileSystem();
+  DiskClose();
   exitsim();
 }
 